@@ -27,11 +27,14 @@ public:
   virtual void reset();
 
   // Utility
-  virtual size_t getChunkSize() const { return CHUNK_SIZE; }
+  virtual size_t getChunkSize() const { return chunkSize_; }
+  virtual void setChunkSize(size_t chunkSize) {
+    chunkSize_ = chunkSize > 0 ? chunkSize : CHUNK_SIZE;
+  }
 
 private:
   std::vector<std::pair<size_t, std::vector<uint8_t>>> chunks_;
-  static constexpr size_t CHUNK_SIZE = 65536; // 64KB chunks
+  size_t chunkSize_ = CHUNK_SIZE; // Negotiated with the server
 };
 
 } // namespace audio_stream
@@ -5,9 +5,16 @@
 #include "core/chunk_manager.h"
 #include "core/file_manager.h"
 #include "core/websocket_client.h"
+#include "util/block_checksums.h"
+#include "util/chunk_size_tuner.h"
 #include "util/error_handler.h"
+#include "util/performance_monitor.h"
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <queue>
@@ -20,10 +27,30 @@ namespace audio_stream {
  * Download manager for orchestrating file downloads from the server.
  * Handles GET request sequencing, binary frame assembly, and file writing.
  *
+ * GETs are pipelined: up to a configurable window of requests are kept in
+ * flight and replies are matched to them on arrival. Chunks that complete
+ * ahead of a retried request are held until the gap is filled, so the
+ * output file is still written sequentially. Request sizes follow the
+ * measured throughput and round-trip time within the server's chunk range.
+ *
+ * With range streaming enabled, a single STREAM request replaces the GETs:
+ * the server pushes the whole range as consecutive binary frames and ends
+ * it with STREAMED, so control traffic no longer grows with the file size.
+ *
+ * Data is checksummed as it is written. Given the upload's block checksums,
+ * each block is verified before it reaches the file, and a block that does
+ * not match is requested again by range rather than repeating the download.
+ *
+ * downloadRange fetches one byte range into a file opened for positional
+ * writes, so several managers on their own connections can download parts
+ * of one file at once (see ParallelTransfer).
+ *
  * Requirements: 7.1, 7.3, 7.6, 7.7
  */
 class DownloadManager {
 public:
+  static constexpr size_t DEFAULT_WINDOW_SIZE = 8; // Outstanding GETs
+
   /**
    * Construct a download manager.
    * @param client WebSocket client for communication
@@ -46,6 +73,18 @@ public:
   bool downloadFile(const std::string &streamId, const std::string &outputPath,
                     size_t expectedSize = 0);
 
+  /**
+   * Download bytes [begin, end) of a stream into the file manager's output,
+   * which must be open for positional writes. With expected checksums set,
+   * begin must be a multiple of their block size.
+   * Progress and getChecksums() then cover just this range.
+   * @param streamId Stream identifier to download from
+   * @param begin First byte of the range
+   * @param end One past the last byte of the range
+   * @return true if the whole range was received and written
+   */
+  bool downloadRange(const std::string &streamId, size_t begin, size_t end);
+
   /**
    * Get the last error message.
    * @return Error message string
@@ -76,6 +115,65 @@ public:
    */
   void setMaxRetries(int maxRetries) { maxRetries_ = maxRetries; }
 
+  /**
+   * Set how many GET requests may be outstanding at once
+   * @param windowSize Window size in requests (1 means stop-and-wait)
+   */
+  void setWindowSize(size_t windowSize) {
+    windowSize_ = windowSize > 0 ? windowSize : 1;
+  }
+
+  /**
+   * Download with one server-pushed STREAM range instead of pipelined GETs
+   * @param enabled true to request ranges (the server must support STREAM)
+   */
+  void setRangeStreaming(bool enabled) { rangeStreaming_ = enabled; }
+
+  /**
+   * Set the chunk size range requests may adapt within
+   * @param minChunkSize Smallest request size (e.g. from STARTED)
+   * @param maxChunkSize Largest request size (e.g. from STARTED)
+   */
+  void setChunkSizeLimits(size_t minChunkSize, size_t maxChunkSize) {
+    chunkTuner_.setLimits(minChunkSize, maxChunkSize);
+  }
+
+  /**
+   * Set the initial request size
+   * @param chunkSize Request size in bytes
+   */
+  void setChunkSize(size_t chunkSize) { chunkTuner_.setChunkSize(chunkSize); }
+
+  /**
+   * Enable or disable tuning the request size at runtime
+   * @param adaptive true to adapt to measured throughput and RTT
+   */
+  void setAdaptiveChunkSize(bool adaptive) { chunkTuner_.setAdaptive(adaptive); }
+
+  /**
+   * Verify downloads block by block against known checksums
+   * @param checksums Checksums of the original data, e.g. from the upload
+   */
+  void setExpectedChecksums(const BlockChecksums &checksums) {
+    expectedChecksums_ = checksums;
+    verifyBlocks_ = true;
+  }
+
+  /**
+   * Get the checksums of the bytes written by the last download
+   * @return Per-block and whole-file CRC32C of the output file
+   */
+  const BlockChecksums &getChecksums() const { return downloadChecksums_; }
+
+  /**
+   * Record per-chunk arrival gaps and GET round trips into a monitor;
+   * several managers of a parallel download may share one
+   * @param monitor Monitor to record into, or nullptr for none
+   */
+  void setPerformanceMonitor(std::shared_ptr<PerformanceMonitor> monitor) {
+    performanceMonitor_ = std::move(monitor);
+  }
+
   /**
    * Handle server response message (called from main message router)
    * @param message Server response message
@@ -85,6 +183,88 @@ public:
   }
 
 private:
+  /**
+   * Clear the state of the previous transfer before a new one.
+   * @param begin File offset the transfer starts at
+   * @param size Bytes the transfer is expected to carry (0 if unknown)
+   */
+  void resetTransfer(size_t begin, size_t size);
+
+  /**
+   * Request and write bytes [begin, end) with the window kept full.
+   * @param streamId Stream identifier
+   * @param begin First byte to request
+   * @param end One past the last byte (SIZE_MAX if the size is unknown)
+   * @param expectedSize Expected file size (0 if unknown)
+   * @return false on a transfer or protocol error
+   */
+  bool receiveRange(const std::string &streamId, size_t begin, size_t end,
+                    size_t expectedSize);
+
+  /**
+   * A GET or STREAM range that has been sent and is waiting for its reply.
+   */
+  struct PendingRequest {
+    size_t offset;
+    size_t length;
+    int attempts;
+    std::chrono::steady_clock::time_point sentAt;
+    size_t received = 0; // STREAM: bytes pushed so far
+  };
+
+  /**
+   * A reply from the server: chunk data, an error frame, or the STREAMED
+   * frame that ends a range.
+   */
+  struct Response {
+    bool isError = false;
+    bool isStreamEnd = false;
+    std::vector<uint8_t> data;
+    std::string error;
+    size_t streamedLength = 0; // STREAMED: bytes the range carried
+  };
+
+  /**
+   * Send a GET request, retrying with backoff if sending fails.
+   * @param streamId Stream identifier
+   * @param request Request to send; its send time is updated
+   * @return true if request was sent successfully
+   */
+  bool sendWithRetry(const std::string &streamId, PendingRequest &request);
+
+  /**
+   * Account a pushed frame or the end of the STREAM range in front.
+   * @param streamId Stream identifier
+   * @param response Reply that belongs to inFlight_.front()
+   * @param expectedSize Expected file size (0 if unknown)
+   * @param endOffset Lowered to the end of the stream once it is known
+   * @return false on a protocol error
+   */
+  bool handleRangeResponse(const std::string &streamId, Response &response,
+                           size_t expectedSize, size_t &endOffset);
+
+  /**
+   * Write completed chunks that continue the file, in offset order.
+   * @param streamId Stream identifier, for re-fetching corrupt blocks
+   * @return true if all writable chunks were written
+   */
+  bool flushCompletedChunks(const std::string &streamId);
+
+  /**
+   * Check and write every complete block held in blockBuffer_.
+   * @param streamId Stream identifier, for re-fetching corrupt blocks
+   * @return false if a block cannot be verified or written
+   */
+  bool verifyBufferedBlocks(const std::string &streamId);
+
+  /**
+   * Drop buffered data from the failed block onward and request it again.
+   * @param streamId Stream identifier
+   * @param blockIndex Index of the block that failed verification
+   * @return false once the block has been re-fetched maxRetries_ times
+   */
+  bool refetchBlock(const std::string &streamId, size_t blockIndex);
+
   /**
    * Send a GET request for a specific chunk.
    * @param streamId Stream identifier
@@ -96,18 +276,30 @@ private:
                       size_t length);
 
   /**
-   * Receive and process binary data from the server.
-   * @param data Binary data received
+   * Send a STREAM request for a range the server pushes.
+   * @param streamId Stream identifier
+   * @param offset First byte of the range
+   * @param length Range length, 0 for up to the end of the stream
+   * @return true if request was sent successfully
+   */
+  bool sendStreamRequest(const std::string &streamId, size_t offset,
+                         size_t length);
+
+  /**
+   * Write the next bytes of the file and account for them.
+   * @param data Data that continues the file
+   * @param size Number of bytes
    * @return true if data was processed successfully
    */
-  bool processBinaryData(const std::vector<uint8_t> &data);
+  bool processBinaryData(const uint8_t *data, size_t size);
 
   /**
-   * Wait for binary data with timeout.
+   * Wait for the next server reply with timeout.
+   * @param response Filled with the reply
    * @param timeoutMs Timeout in milliseconds
-   * @return Binary data received, empty if timeout or error
+   * @return true if a reply arrived, false on timeout
    */
-  std::vector<uint8_t> waitForBinaryData(int timeoutMs = 5000);
+  bool waitForResponse(Response &response, int timeoutMs = 5000);
 
   /**
    * Callback for binary data received from WebSocket.
@@ -136,20 +328,38 @@ private:
   std::shared_ptr<ErrorHandler> errorHandler_;
 
   std::string lastError_;
-  size_t bytesDownloaded_;
+  std::atomic<size_t> bytesDownloaded_; // Polled for progress by other threads
   size_t totalSize_;
   std::vector<uint8_t> downloadBuffer_;
   int requestTimeoutMs_;
   int maxRetries_;
+  size_t windowSize_;
+  bool rangeStreaming_;
+  ChunkSizeTuner chunkTuner_;
+  std::shared_ptr<PerformanceMonitor> performanceMonitor_;
+
+  // Pipelined request state (download thread only)
+  std::deque<PendingRequest> inFlight_;
+  std::map<size_t, std::vector<uint8_t>> completedChunks_;
+  size_t writeOffset_;    // Next file offset to pass verification
+  bool positionalWrites_; // Range download: write at fileOffset_
+  size_t fileOffset_;     // Next file offset to write
+
+  // Inline verification (download thread only)
+  BlockChecksums downloadChecksums_;
+  BlockChecksums expectedChecksums_;
+  bool verifyBlocks_;
+  std::vector<uint8_t> blockBuffer_; // Unverified bytes from blockStart_
+  size_t blockStart_;
+  std::map<size_t, int> blockRefetches_;
 
   // Synchronization for async message handling
-  std::queue<std::vector<uint8_t>> pendingData_;
+  std::queue<Response> pendingResponses_;
   std::mutex dataMutex_;
   std::condition_variable dataCondition_;
   bool downloadComplete_;
-  bool errorOccurred_;
 
-  static constexpr size_t CHUNK_SIZE = 65536; // 64KB chunks
+  static constexpr size_t PROGRESS_LOG_INTERVAL = 655360; // ~10 chunks
 };
 
 } // namespace audio_stream
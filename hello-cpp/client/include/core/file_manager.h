@@ -22,8 +22,10 @@ public:
   // File reading
   virtual bool openForReading(const std::string &filePath);
   virtual size_t read(std::vector<uint8_t> &buffer, size_t size);
+  virtual size_t read(uint8_t *buffer, size_t size); // Into caller storage
   virtual size_t
   readChunk(std::vector<uint8_t> &chunk); // Read next chunk (64KB)
+  virtual bool seek(size_t offset);       // Position of the next read
   virtual bool hasMoreData() const;
   virtual size_t getFileSize() const;
   virtual void closeReader();
@@ -31,8 +33,25 @@ public:
   // File writing
   virtual bool openForWriting(const std::string &filePath);
   virtual bool write(const std::vector<uint8_t> &data);
+  virtual bool write(const uint8_t *data, size_t size); // From caller storage
   virtual void closeWriter();
 
+  /**
+   * Open a file of known size for positional writes, so ranges of it can be
+   * written concurrently from several threads (parallel downloads).
+   * @param filePath Output file, created or truncated
+   * @param size Final file size; the file is extended to it up front
+   */
+  virtual bool openForPositionalWriting(const std::string &filePath,
+                                        uint64_t size);
+
+  /**
+   * Write at an offset of a file opened with openForPositionalWriting.
+   * Safe to call from several threads for disjoint ranges.
+   */
+  virtual bool writeAt(uint64_t offset, const uint8_t *data, size_t size);
+  virtual bool isPositionalWriting() const;
+
   // Utility
   virtual bool fileExists(const std::string &filePath) const;
   virtual std::string getFilePath() const;
@@ -42,6 +61,7 @@ private:
   size_t fileSize_ = 0;
   std::unique_ptr<std::ifstream> inputFile_;
   std::unique_ptr<std::ofstream> outputFile_;
+  intptr_t positionalFile_ = -1; // fd, or HANDLE on Windows; -1 if closed
 };
 
 } // namespace audio_stream
@@ -0,0 +1,220 @@
+#ifndef AUDIO_STREAM_LOAD_GENERATOR_H
+#define AUDIO_STREAM_LOAD_GENERATOR_H
+
+#include "../../include/common_types.h"
+#include "core/websocket_client.h"
+#include "latency_histogram.h"
+#include "util/stream_id_generator.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace audio_stream {
+
+struct LoadConfig {
+  std::string serverUri;
+  size_t clients = 100; // Virtual clients
+  size_t threads = 4;   // Event loops the clients are spread over
+  std::chrono::seconds duration{30};
+  // Closed loop: the clients' first sessions are spread over this
+  std::chrono::milliseconds rampUp{1000};
+  // Sessions started per second, as a Poisson process, by whichever client
+  // is idle; 0 runs a closed loop where each client starts its next session
+  // as soon as the last one ends
+  double arrivalRate = 0;
+  std::vector<size_t> fileSizes{1024 * 1024}; // Picked uniformly per upload
+  // Share of sessions that download a stream uploaded earlier in the run
+  double downloadFraction = 0.5;
+  // Sessions before a client reconnects; 0 keeps one connection throughout
+  size_t sessionsPerConnection = 0;
+  size_t chunkSize = CHUNK_SIZE; // Requested in START
+  size_t downloadWindow = 8;     // GETs in flight per download
+  std::chrono::milliseconds sessionTimeout{30000};
+};
+
+// Totals of a load run; histograms in nanoseconds
+struct LoadReport {
+  size_t clients = 0;
+  size_t threads = 0;
+  uint64_t uploads = 0;
+  uint64_t downloads = 0;
+  uint64_t failures = 0;
+  uint64_t refusedStarts = 0; // Refused for load, retried after the delay
+  uint64_t droppedArrivals = 0; // Open loop: arrivals while all were busy
+  uint64_t connects = 0;
+  uint64_t connectFailures = 0;
+  uint64_t bytesUploaded = 0;
+  uint64_t bytesDownloaded = 0;
+  std::chrono::nanoseconds elapsed{0};
+  LatencyHistogram connect;   // WebSocket handshake
+  LatencyHistogram upload;    // START sent to STOPPED received
+  LatencyHistogram download;  // First GET sent to the last byte
+  LatencyHistogram firstByte; // First GET sent to its reply
+
+  void merge(const LoadReport &other);
+  double uploadMbps() const;
+  double downloadMbps() const;
+
+  nlohmann::json toJson() const;
+  std::string format() const;
+};
+
+/**
+ * Load generator: many virtual clients uploading and downloading at once,
+ * to measure a server under concurrency.
+ *
+ * A WebSocketClient brings its own event loop thread and blocks its caller
+ * until replies arrive, which does not scale to thousands of clients.
+ * Instead each of a few worker threads runs one websocketpp endpoint that
+ * carries the connections of many virtual clients. A virtual client is a
+ * state machine driven by its connection's callbacks on that thread:
+ * connect, START, chunks (paced by the socket's send queue), STOP, or a
+ * window of pipelined GETs. Upload data comes from one shared random
+ * buffer; the first bytes of each upload are stamped so no two have equal
+ * content. Uploads are checked against the CRC32C in STOPPED, downloads
+ * against the CRC recorded for the stream.
+ */
+class LoadGenerator {
+public:
+  static constexpr size_t MAX_STORED_STREAMS = 1024; // Download candidates
+  static constexpr size_t SEND_HIGH_WATER_CHUNKS = 4;
+  static constexpr long SEND_POLL_MS = 2; // Recheck of a full send queue
+  static constexpr long FAILURE_BACKOFF_MS = 100; // Before the next session
+  static constexpr long MAX_RETRY_AFTER_MS = 30000; // Of a refused START
+
+  explicit LoadGenerator(LoadConfig config);
+  ~LoadGenerator();
+
+  LoadGenerator(const LoadGenerator &) = delete;
+  LoadGenerator &operator=(const LoadGenerator &) = delete;
+
+  /**
+   * Run the load for the configured duration, then let sessions in
+   * progress finish (up to the session timeout) and close all connections.
+   * @return Totals and latency histograms of the run
+   */
+  LoadReport run();
+
+  /**
+   * Parse a comma-separated list of sizes with optional K, M or G suffix
+   * (powers of 1024), e.g. "64K,1M,16M"
+   * @return true if every entry was a positive size
+   */
+  static bool parseSizes(const std::string &text, std::vector<size_t> &sizes);
+
+private:
+  enum class Phase {
+    IDLE,
+    CONNECTING,
+    STARTING,    // START sent
+    UPLOADING,   // Sending chunks
+    STOPPING,    // STOP sent
+    DOWNLOADING, // GETs in flight
+  };
+
+  struct StoredStream {
+    std::string streamId;
+    size_t size = 0;
+    size_t chunkSize = CHUNK_SIZE; // Granted in STARTED; used for its GETs
+    uint32_t crc = 0;
+  };
+
+  struct Worker;
+
+  // Touched only on its worker's thread
+  struct VirtualClient {
+    size_t id = 0;
+    Worker *worker = nullptr;
+    Phase phase = Phase::IDLE;
+    WebSocketClient_t::connection_ptr connection;
+    uint64_t generation = 0; // Per connection; older callbacks are ignored
+    bool open = false;
+    size_t sessionsOnConnection = 0;
+    uint64_t session = 0; // Per session; older timers are ignored
+    bool download = false;
+    WebSocketClient_t::timer_ptr timeout;
+    std::chrono::steady_clock::time_point connectStart;
+    std::chrono::steady_clock::time_point transferStart; // START or 1st GET
+
+    StoredStream stream;
+    size_t transferred = 0; // Upload: bytes sent; download: bytes requested
+    size_t received = 0;    // Download only
+    uint32_t crc = 0;       // Of the bytes sent or received so far
+    std::deque<size_t> inFlight; // GET lengths, oldest first
+  };
+
+  struct Worker {
+    size_t index = 0;
+    WebSocketClient_t endpoint;
+    std::thread thread;
+    std::vector<std::unique_ptr<VirtualClient>> clients;
+    std::vector<VirtualClient *> idle; // Open loop: free for an arrival
+    StreamIdGenerator ids;
+    std::mt19937_64 random;
+    std::vector<uint8_t> stamped; // First chunk of an upload
+    LoadReport report;            // Worker thread only until joined
+
+    // Read by the progress log
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> sessions{0};
+    std::atomic<size_t> active{0};      // Sessions in progress
+    std::atomic<size_t> connections{0}; // Open
+    std::atomic<bool> finished{false};  // The event loop has returned
+  };
+
+  void startSession(VirtualClient &client);
+  void connect(VirtualClient &client);
+  void beginTransfer(VirtualClient &client);
+  void beginUpload(VirtualClient &client);
+  void sendStart(VirtualClient &client);
+  void beginDownload(VirtualClient &client);
+  void sendChunks(VirtualClient &client);
+  void sendGets(VirtualClient &client);
+
+  void onOpen(VirtualClient &client, uint64_t generation, ConnectionHdl hdl);
+  void onFail(VirtualClient &client, uint64_t generation);
+  void onClose(VirtualClient &client, uint64_t generation);
+  void onMessage(VirtualClient &client, uint64_t generation,
+                 WebSocketClient_t::message_ptr message);
+  void onControlReply(VirtualClient &client, const std::string &text);
+  void onGetReply(VirtualClient &client, const std::string &payload);
+
+  void finishSession(VirtualClient &client);
+  void failSession(VirtualClient &client, const std::string &reason);
+  void endSession(VirtualClient &client, long nextSessionDelayMs);
+  void closeConnection(VirtualClient &client);
+  bool sendText(VirtualClient &client, const std::string &text);
+
+  void storeStream(Worker &worker, const StoredStream &stream);
+  bool pickStream(Worker &worker, StoredStream &stream);
+
+  void runArrivals(std::chrono::steady_clock::time_point start,
+                   std::chrono::steady_clock::time_point deadline);
+  void logProgress(std::chrono::steady_clock::time_point start) const;
+  void shutdown();
+
+  LoadConfig config_;
+  std::vector<uint8_t> payload_; // Shared source of upload bytes
+  uint64_t runStamp_ = 0;        // Distinguishes uploads of separate runs
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<bool> stopping_{false};
+  std::atomic<uint64_t> droppedArrivals_{0};
+
+  std::mutex streamsMutex_;
+  std::vector<StoredStream> streams_; // Uploaded during the run
+
+  static constexpr std::chrono::seconds PROGRESS_LOG_INTERVAL{1};
+  static constexpr std::chrono::seconds SHUTDOWN_TIMEOUT{2};
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_LOAD_GENERATOR_H
@@ -0,0 +1,187 @@
+#ifndef AUDIO_STREAM_PARALLEL_TRANSFER_H
+#define AUDIO_STREAM_PARALLEL_TRANSFER_H
+
+#include "core/download_manager.h"
+#include "core/file_manager.h"
+#include "core/upload_manager.h"
+#include "core/websocket_client.h"
+#include "util/block_checksums.h"
+#include "util/error_handler.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace audio_stream {
+
+/**
+ * Transfer of one large file over several connections at once.
+ * One TCP flow is capped by its congestion window on long, fast paths;
+ * several flows fill the link together. The file is split into byte ranges
+ * on block boundaries, one per connection. Each connection has its own
+ * WebSocketClient and DownloadManager on its own thread and writes its range
+ * into the shared output file at the range's offsets.
+ *
+ * The CRC32C of each range is combined into the checksum of the whole file,
+ * so verification still needs no second read.
+ *
+ * An upload is split the same way. The connection that started the stream
+ * sends the first range itself (UploadManager); every other range goes on
+ * a connection of its own attached to the stream (ATTACH), which leaves
+ * the stream with its owner. The owner's STOP waits until each attached
+ * connection's DETACHED reports its range written, and the ranges'
+ * checksums are appended to the owner's in file order.
+ */
+class ParallelTransfer {
+public:
+  // Applied to each connection's DownloadManager before its range starts
+  using DownloadSetup = std::function<void(DownloadManager &)>;
+  // Applied to each attached connection's UploadManager before its range
+  using UploadSetup = std::function<void(UploadManager &)>;
+
+  // Ranges start on multiples of this, the block size checksums use
+  static constexpr size_t RANGE_ALIGNMENT = BlockChecksums::DEFAULT_BLOCK_SIZE;
+
+  /**
+   * @param uri Server URI each connection connects to
+   * @param connections Most connections to open; small files use fewer
+   * @param errorHandler Error handler shared by all connections (optional)
+   */
+  ParallelTransfer(const std::string &uri, size_t connections,
+                   std::shared_ptr<ErrorHandler> errorHandler = nullptr);
+
+  // Waits for the ranges of an upload that was not finished
+  ~ParallelTransfer();
+
+  ParallelTransfer(const ParallelTransfer &) = delete;
+  ParallelTransfer &operator=(const ParallelTransfer &) = delete;
+
+  // Offer the binary control protocol on each connection
+  void setBinaryProtocol(bool enabled) { binaryProtocol_ = enabled; }
+  // ...with this codec for COMPRESSED_DATA (WebSocketClient::setCompression)
+  void setCompression(CompressionCodec codec) { compression_ = codec; }
+
+  /**
+   * Set how each connection's DownloadManager is configured: window, chunk
+   * sizes, range streaming and expected checksums.
+   */
+  void setDownloadSetup(DownloadSetup setup) {
+    downloadSetup_ = std::move(setup);
+  }
+
+  /**
+   * Set how each attached connection's UploadManager is configured: chunk
+   * sizes, resume attempts and the performance monitor to record into.
+   */
+  void setUploadSetup(UploadSetup setup) { uploadSetup_ = std::move(setup); }
+
+  /**
+   * Download a stream of known size over parallel connections.
+   * @param streamId Stream identifier to download from
+   * @param outputPath Path to write the downloaded file
+   * @param size Size of the stream in bytes
+   * @return true if every range was downloaded and written
+   */
+  bool download(const std::string &streamId, const std::string &outputPath,
+                size_t size);
+
+  // Connections the last download used
+  size_t getConnectionCount() const { return connections_.size(); }
+
+  /**
+   * Start sending every range of an upload but the first, each on its own
+   * connection attached to the stream; the caller sends the first one on
+   * the connection that started the stream, then calls finishUpload.
+   * @param streamId UPLOADING stream the caller started
+   * @param filePath File being uploaded
+   * @param size Size of the file in bytes
+   * @return End of the caller's range; size if the file is one range
+   */
+  uint64_t startUpload(const std::string &streamId,
+                       const std::string &filePath, uint64_t size);
+
+  /**
+   * Wait for the ranges startUpload started.
+   * @param checksums Checksums of the caller's range, to which those of
+   *        the other ranges are appended
+   * @return true if every range was written
+   */
+  bool finishUpload(BlockChecksums &checksums);
+
+  // Connections the last upload used, the caller's included
+  size_t getUploadConnectionCount() const { return uploads_.size() + 1; }
+
+  // Bytes of the attached ranges sent so far
+  uint64_t getBytesUploaded() const;
+
+  // Bytes written so far, summed over all connections
+  size_t getBytesDownloaded() const;
+
+  // CRC32C of the whole file written by the last download
+  uint32_t getChecksum() const { return checksum_; }
+
+  const std::string &getLastError() const { return lastError_; }
+
+private:
+  struct Connection {
+    std::shared_ptr<WebSocketClient> client;
+    std::shared_ptr<DownloadManager> downloadManager;
+    size_t begin;
+    size_t end;
+    bool succeeded = false;
+    std::string error;
+  };
+
+  /**
+   * Connect one connection and download its range (on its own thread).
+   * @return true if the range was downloaded
+   */
+  bool runConnection(Connection &connection, const std::string &streamId);
+
+  struct Upload {
+    std::shared_ptr<WebSocketClient> client;
+    std::shared_ptr<UploadManager> uploadManager;
+    uint64_t begin;
+    uint64_t end;
+    // Set from the upload's progress callback on its thread
+    std::shared_ptr<std::atomic<uint64_t>> sent;
+    bool succeeded = false;
+    std::string error;
+  };
+
+  // Connect one attached connection and send its range (on its own thread)
+  bool runUpload(Upload &upload, const std::string &streamId,
+                 const std::string &filePath);
+
+  std::string uri_;
+  size_t maxConnections_;
+  bool binaryProtocol_ = false;
+  CompressionCodec compression_ = CompressionCodec::NONE;
+  std::shared_ptr<ErrorHandler> errorHandler_;
+  DownloadSetup downloadSetup_;
+  UploadSetup uploadSetup_;
+
+  std::shared_ptr<FileManager> fileManager_;
+  std::vector<Connection> connections_; // Of the last download, in order
+  uint32_t checksum_ = 0;
+  std::string lastError_;
+
+  std::vector<Upload> uploads_; // Attached ranges of the last upload
+  std::vector<std::thread> uploadWorkers_;
+  std::mutex uploadMutex_;
+  std::condition_variable uploadDone_;
+  size_t uploadsRunning_ = 0;
+  uint64_t uploadSize_ = 0;
+
+  static constexpr std::chrono::seconds PROGRESS_LOG_INTERVAL{1};
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_PARALLEL_TRANSFER_H
@@ -5,21 +5,79 @@
 #include "core/chunk_manager.h"
 #include "core/file_manager.h"
 #include "core/websocket_client.h"
+#include "util/block_checksums.h"
+#include "util/chunk_size_tuner.h"
 #include "util/error_handler.h"
 #include "util/performance_monitor.h"
+#include "util/response_correlator.h"
 #include "util/stream_id_generator.h"
+#include <array>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <set>
 #include <string>
 
 namespace audio_stream {
 
+class ParallelTransfer;
+
 /**
  * Upload manager for orchestrating file upload workflow
  * Handles the complete upload process: START -> chunks -> STOP
+ *
+ * Chunks are read on a separate thread into a small ring of reusable
+ * buffers while the calling thread sends them, so file reads overlap
+ * transmission. Sending pauses while the socket's send queue holds more
+ * than SEND_HIGH_WATER_CHUNKS chunks.
+ *
+ * The reader also checksums each chunk as it is read, so the upload can be
+ * verified against the digest the server returns in STOPPED without reading
+ * the file again.
+ *
+ * If the connection drops mid-upload, the client reconnects and sends
+ * RESUME; the server replies with the number of bytes it has written and
+ * sending continues from there instead of restarting the stream.
+ *
+ * START and RESUME ask for flow control: never more than the window the
+ * server grants in CREDIT is sent ahead of what it has written, so a
+ * server whose storage falls behind slows its uploaders down rather than
+ * buffering for them. A START or PUT the server refuses for load is
+ * retried after the delay it names, a few times.
+ *
+ * Files up to the PUT threshold go in a single PUT instead, answered by
+ * STOPPED, saving the START and STOP round trips. Against a server that
+ * does not know PUT the client falls back to START for the session.
+ *
+ * With skipping of stored blocks, over the binary protocol, each block of
+ * a file (HAVE_BLOCK_SIZE) is first offered by its SHA-256 in a HAVE, with
+ * a proof keyed by the upload's nonce; the blocks the server answers it
+ * stores from another stream are then read for the checksum but not sent.
+ * That hashes the file twice before sending, so it only pays off for
+ * files the server may largely hold already.
+ *
+ * With a parallel transfer, over the binary protocol and against a server
+ * with CAPABILITY_ATTACH, this connection sends only the first byte range
+ * of the file; the others go at the same time on connections attached to
+ * the stream (uploadRange), and STOP follows once they are all written.
  */
 class UploadManager {
 public:
+  static constexpr size_t UPLOAD_RING_DEPTH = 4; // Chunks read ahead of send
+  static constexpr size_t SEND_HIGH_WATER_CHUNKS = 4; // Socket queue limit
+  static constexpr int DEFAULT_MAX_RESUME_ATTEMPTS = 3;
+  static constexpr size_t DEFAULT_PUT_THRESHOLD = 256 * 1024;
+  static constexpr uint64_t DEFAULT_UPLOAD_WINDOW = 16ULL * 1024 * 1024;
+  static constexpr int MAX_ADMISSION_RETRIES = 5;
+  static constexpr std::chrono::milliseconds MAX_RETRY_AFTER{30000};
+  // Longest wait for a CREDIT covering the next chunk before giving up
+  static constexpr std::chrono::milliseconds CREDIT_TIMEOUT{30000};
+  static constexpr size_t HAVE_PIPELINE = 16; // HAVEs sent ahead of HAS
+
   UploadManager(std::shared_ptr<WebSocketClient> client,
                 std::shared_ptr<ErrorHandler> errorHandler = nullptr);
   ~UploadManager() = default;
@@ -31,6 +89,20 @@ public:
    */
   std::string uploadFile(const std::string &filePath);
 
+  /**
+   * Send one byte range of a stream another connection uploads: ATTACH,
+   * the range as DATA frames at their offsets, then DETACH once the server
+   * has written them. A dropped connection attaches again and sends the
+   * range again from its start.
+   * @param streamId UPLOADING stream to attach to
+   * @param filePath File being uploaded
+   * @param begin Start of the range, on a block boundary
+   * @param end End of the range (exclusive)
+   * @return true once the server reports the range written
+   */
+  bool uploadRange(const std::string &streamId, const std::string &filePath,
+                   uint64_t begin, uint64_t end);
+
   /**
    * Set callback for upload progress
    * @param callback Function called with (bytesUploaded, totalBytes)
@@ -43,12 +115,87 @@ public:
    */
   PerformanceMetrics getPerformanceMetrics() const;
 
+  /**
+   * Share a performance monitor, e.g. the application's, for the upload's
+   * timings and per-chunk send latencies
+   * @param monitor Monitor to record into
+   */
+  void setPerformanceMonitor(std::shared_ptr<PerformanceMonitor> monitor) {
+    performanceMonitor_ = std::move(monitor);
+  }
+
   /**
    * Set timeout for server responses
    * @param timeoutMs Timeout in milliseconds
    */
   void setResponseTimeout(int timeoutMs) { responseTimeoutMs_ = timeoutMs; }
 
+  /**
+   * Set the chunk size requested in START
+   * @param chunkSize Requested chunk size in bytes
+   */
+  void setChunkSize(size_t chunkSize) { requestedChunkSize_ = chunkSize; }
+
+  /**
+   * Enable or disable tuning the chunk size from measured throughput
+   * @param adaptive true to adapt within the server's advertised range
+   */
+  void setAdaptiveChunkSize(bool adaptive) { adaptiveChunkSize_ = adaptive; }
+
+  /**
+   * Set the durability tier requested in START
+   * @param durability Tier, or DEFAULT for the server's
+   */
+  void setDurability(Durability durability) { durability_ = durability; }
+
+  /**
+   * Set how many times a dropped upload is resumed before giving up
+   * @param attempts Resume attempts per upload (0 disables resuming)
+   */
+  void setMaxResumeAttempts(int attempts) { maxResumeAttempts_ = attempts; }
+
+  /**
+   * Set the largest file uploaded with a single PUT
+   * @param bytes File size limit in bytes (0 always uses START and STOP)
+   */
+  void setPutThreshold(size_t bytes) { putThreshold_ = bytes; }
+
+  /**
+   * Set the flow control window asked for in START and RESUME; the server
+   * may grant less
+   * @param bytes Window in bytes (0 sends without flow control)
+   */
+  void setUploadWindow(uint64_t bytes) { uploadWindow_ = bytes; }
+
+  /**
+   * Offer the blocks of each upload by digest and leave out the ones the
+   * server already stores (binary protocol, servers with CAPABILITY_HAVE)
+   * @param skip true to offer blocks before sending
+   */
+  void setSkipStoredBlocks(bool skip) { skipStoredBlocks_ = skip; }
+
+  /**
+   * Split uploads across the connections of a parallel transfer
+   * @param transfer Transfer sending every range but the first, or null to
+   *        upload over this connection alone
+   */
+  void setParallelTransfer(std::shared_ptr<ParallelTransfer> transfer) {
+    parallelTransfer_ = std::move(transfer);
+  }
+
+  /**
+   * Get the chunk size state negotiated by the last START
+   * @return Tuner holding the negotiated limits and current size
+   */
+  const ChunkSizeTuner &getChunkSizeTuner() const { return chunkTuner_; }
+
+  /**
+   * Get the checksums of the bytes sent by the last upload, or by the last
+   * uploadRange
+   * @return Per-block and whole-file CRC32C of the uploaded file or range
+   */
+  const BlockChecksums &getUploadChecksums() const { return uploadChecksums_; }
+
   /**
    * Handle server response message (called from main message router)
    * @param message Server response message
@@ -56,10 +203,47 @@ public:
   void handleServerResponse(const std::string &message);
 
 private:
+  // STALLED: no CREDIT came within CREDIT_TIMEOUT on a live connection
+  enum class SendResult { COMPLETE, CONNECTION_LOST, STALLED, FAILED };
+  enum class CreditResult { GRANTED, CONNECTION_LOST, TIMED_OUT, FAILED };
+  enum class PutResult { STORED, FAILED };
+
   bool sendStartMessage(const std::string &streamId);
   bool sendFileChunks(const std::string &filePath);
+  // Send the file from offset up to end
+  SendResult sendChunksFrom(const std::string &filePath, uint64_t &offset,
+                            uint64_t end);
+  bool resumeUpload(const std::string &streamId, uint64_t &offset);
+  bool sendAttachMessage(const std::string &streamId);
+  bool sendDetachMessage(const std::string &streamId);
+  bool rewindTo(uint64_t offset);
   bool sendStopMessage(const std::string &streamId);
-  void waitForResponse(const std::string &expectedType, int timeoutMs = 5000);
+  PutResult putFile(const std::string &filePath, size_t size);
+  // Whether the server takes a PUT of size bytes
+  bool serverTakesPut(size_t size);
+  // Whether the server takes the optional message; asks with HELLO once
+  bool serverHas(uint32_t capability);
+  // Send a HAVE for every block of the file, from its start, and record
+  // the blocks the server stored; the caller rewinds the file after
+  void offerStoredBlocks(size_t totalSize);
+  // Read from the nonce field of STARTED or RESUMED, if there is one
+  void readUploadNonce(const nlohmann::json &reply);
+  bool verifyStoredChecksum(const nlohmann::json &stopped);
+  bool waitForSendWindow();
+  // Flow control: forget the credit and errors of the last upload, then
+  // wait until the server's latest CREDIT covers the stream up to end.
+  // Fails once the server reports an error for the stream.
+  void resetCredit(const std::string &streamId);
+  CreditResult waitForCredit(uint64_t end);
+  bool handleCredit(const std::string &message);
+  // An ERROR no request waits for that concerns the upload in progress
+  // (a failed chunk write); fails its sending
+  bool handleUploadError(const std::string &message);
+  // An ERROR refusing a request for load: remembers its delay
+  bool noteRetryAfter(const nlohmann::json &error, const std::string &request);
+  // Sleep for the delay of the last refusal, if there was one and retries
+  // are left
+  bool waitToRetry(int &retries);
   bool handleProtocolError(const std::string &message,
                            const std::string &context);
 
@@ -68,13 +252,39 @@ private:
   FileManager fileManager_;
   ChunkManager chunkManager_;
   StreamIdGenerator streamIdGenerator_;
-  PerformanceMonitor performanceMonitor_;
+  std::shared_ptr<PerformanceMonitor> performanceMonitor_;
+  ChunkSizeTuner chunkTuner_;
+  BlockChecksums uploadChecksums_;
+  size_t requestedChunkSize_;
+  bool adaptiveChunkSize_;
+  Durability durability_ = Durability::DEFAULT;
+  // Of the file being uploaded; decides COMPRESSED_DATA frames
+  CompressionProfile compressionProfile_ = INCOMPRESSIBLE;
 
   std::function<void(size_t, size_t)> progressCallback_;
-  std::string lastResponse_;
-  bool responseReceived_;
+  ResponseCorrelator responses_;
   std::string currentStreamId_;
+  uint32_t streamHandle_ = 0; // Tags DATA frames; from STARTED/RESUMED
   int responseTimeoutMs_;
+  int maxResumeAttempts_;
+  size_t putThreshold_ = DEFAULT_PUT_THRESHOLD;
+  uint64_t uploadWindow_ = DEFAULT_UPLOAD_WINDOW;
+  bool skipStoredBlocks_ = false;
+  std::shared_ptr<ParallelTransfer> parallelTransfer_;
+  uint64_t rangeEnd_ = 0;        // Of the bytes this connection sends
+  size_t uploadConnections_ = 1; // Of the last upload
+  // Keys HAVE proofs of the upload in progress; from STARTED/RESUMED
+  std::optional<std::array<uint8_t, HAVE_NONCE_BYTES>> uploadNonce_;
+  std::set<uint64_t> storedBlocks_; // Indexes the server stored from a HAVE
+  std::optional<std::chrono::milliseconds> retryAfter_;
+
+  // Credit of the upload in progress, set from the message thread
+  std::mutex creditMutex_;
+  std::condition_variable creditCv_;
+  std::string creditStreamId_;
+  std::optional<uint64_t> creditLimit_; // None: no flow control
+  std::optional<std::string> uploadError_; // From handleUploadError
+  std::optional<HelloMessage> serverHello_; // Until the first HELLO
 };
 
 } // namespace audio_stream
@@ -1,10 +1,12 @@
 #ifndef AUDIO_STREAM_WEBSOCKET_CLIENT_H
 #define AUDIO_STREAM_WEBSOCKET_CLIENT_H
 
+#include "../../include/binary_protocol.h"
 #include "../../include/common_types.h"
 #include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 // spdlog header for logging in template member functions
@@ -32,6 +34,15 @@ using ConnectionHdl = websocketpp::connection_hdl;
 /**
  * WebSocket client for audio stream communication
  * Handles connection, message sending/receiving, and reconnection logic
+ *
+ * When the binary protocol is requested and the server accepts it, binary
+ * frames carry BINARY_PROTOCOL headers: DATA payloads are delivered to the
+ * binary handler and control replies are delivered to the text handler as
+ * their JSON equivalents, so callers see the same messages either way.
+ * With a codec set as well it is offered first (compressedBinaryProtocol);
+ * if the server takes it, COMPRESSED_DATA frames are decompressed before
+ * they reach the binary handler, and DATA frames sent with a compressible
+ * profile go out compressed when that shrinks them.
  */
 class WebSocketClient {
 public:
@@ -44,9 +55,34 @@ public:
   virtual void disconnect();
   virtual bool isConnected() const;
 
+  // Binary control protocol (offered as a subprotocol on the next connect)
+  virtual void setBinaryProtocol(bool enabled) {
+    binaryProtocolRequested_ = enabled;
+  }
+  virtual bool isBinaryProtocol() const { return binaryProtocol_; }
+  // Codec offered with the binary protocol; NONE offers it plain only
+  virtual void setCompression(CompressionCodec codec) {
+    compressionRequested_ = codec;
+  }
+  // Codec the server accepted for this connection
+  virtual CompressionCodec getCompression() const { return compression_; }
+
   // Message sending
   virtual void sendTextMessage(const std::string &message);
   virtual void sendBinaryMessage(const std::vector<uint8_t> &data);
+  virtual void sendBinaryMessage(const uint8_t *data, size_t size);
+
+  // Send one binary protocol frame; header, text and payload are appended
+  // to the outgoing message without building an intermediate buffer. A
+  // DATA frame is sent as COMPRESSED_DATA if profile and codec allow.
+  virtual void sendBinaryFrame(const BinaryFrameHeader &header,
+                               std::string_view text,
+                               const uint8_t *payload = nullptr,
+                               size_t payloadSize = 0,
+                               CompressionProfile profile = INCOMPRESSIBLE);
+
+  // Bytes queued for sending but not yet written to the socket
+  virtual size_t getBufferedAmount() const;
 
   // Message handlers
   virtual void setOnMessage(std::function<void(const std::string &)> handler);
@@ -60,19 +96,24 @@ private:
   void onFail(ConnectionHdl hdl);
   bool attemptConnection();
   void waitWithExponentialBackoff(int attempt);
+  void dispatchBinaryProtocolFrame(const std::string &payload);
 
   template <typename MsgType>
   void onMessage([[maybe_unused]] ConnectionHdl hdl, const MsgType &msg) {
     if (msg->get_opcode() == websocketpp::frame::opcode::text) {
-      std::string payload = msg->get_payload();
-      spdlog::debug("Text message received: {}", payload);
+      const std::string &payload = msg->get_payload();
+      SPDLOG_DEBUG("Text message received: {}", payload);
       if (onMessageHandler_) {
         onMessageHandler_(payload);
       }
     } else if (msg->get_opcode() == websocketpp::frame::opcode::binary) {
-      std::string payload = msg->get_payload();
+      if (binaryProtocol_) {
+        dispatchBinaryProtocolFrame(msg->get_payload());
+        return;
+      }
+      const std::string &payload = msg->get_payload();
       std::vector<uint8_t> data(payload.begin(), payload.end());
-      spdlog::debug("Binary message received: {} bytes", data.size());
+      SPDLOG_DEBUG("Binary message received: {} bytes", data.size());
       if (onBinaryMessageHandler_) {
         onBinaryMessageHandler_(data);
       }
@@ -81,6 +122,10 @@ private:
 
   std::string uri_;
   bool connected_;
+  bool binaryProtocolRequested_ = false;
+  bool binaryProtocol_ = false;
+  CompressionCodec compressionRequested_ = CompressionCodec::NONE;
+  CompressionCodec compression_ = CompressionCodec::NONE;
   WebSocketClient_t client_;
   ConnectionHdl connection_;
 
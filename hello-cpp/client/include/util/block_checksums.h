@@ -0,0 +1,66 @@
+#ifndef AUDIO_STREAM_BLOCK_CHECKSUMS_H
+#define AUDIO_STREAM_BLOCK_CHECKSUMS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace audio_stream {
+
+/**
+ * CRC32C of a byte stream, kept per fixed-size block as data passes
+ * through, plus the checksum of the whole stream.
+ * Feeding it the chunks of a transfer in order checksums the file without
+ * another pass over it; comparing block lists locates a corrupt range to
+ * fetch again. Block boundaries do not depend on chunk sizes, so the
+ * upload and download sides agree even when their chunk sizes differ.
+ */
+class BlockChecksums {
+public:
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 1024 * 1024; // 1MB
+
+  explicit BlockChecksums(size_t blockSize = DEFAULT_BLOCK_SIZE);
+
+  void reset();
+
+  // Append the next bytes of the stream
+  void update(const uint8_t *data, size_t length);
+
+  /**
+   * Forget the stream from length onward, e.g. bytes a resumed upload
+   * sends again. The partial block cannot be shortened in place, so the
+   * stream is cut back to the block boundary at or below length.
+   * @return Bytes still covered; feed it the stream again from there
+   */
+  uint64_t truncate(uint64_t length);
+
+  /**
+   * Append the checksums of the bytes that follow, e.g. a range another
+   * connection of a parallel upload sent. Blocks only line up if this
+   * ends on a block boundary and both use the same block size.
+   * @return false, changing nothing, if they do not
+   */
+  bool append(const BlockChecksums &next);
+
+  // CRC32C of everything appended so far
+  uint32_t getChecksum() const;
+
+  uint64_t getTotalBytes() const { return totalBytes_; }
+  size_t getBlockSize() const { return blockSize_; }
+
+  // Blocks so far, the last of which may be partial
+  size_t getBlockCount() const;
+  uint32_t getBlockChecksum(size_t index) const;
+  size_t getBlockLength(size_t index) const;
+
+private:
+  size_t blockSize_;
+  std::vector<uint32_t> blocks_; // Completed blocks
+  uint32_t current_ = 0;         // CRC of the partial block
+  size_t currentLength_ = 0;
+  uint64_t totalBytes_ = 0;
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_BLOCK_CHECKSUMS_H
@@ -0,0 +1,60 @@
+#ifndef AUDIO_STREAM_CHUNK_RING_H
+#define AUDIO_STREAM_CHUNK_RING_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace audio_stream {
+
+/**
+ * Fixed ring of reusable chunk buffers between one producer and one
+ * consumer thread.
+ * The producer takes free slots, fills them and publishes them in order;
+ * the consumer takes filled slots and recycles them once sent. Slots keep
+ * their capacity across reuse, so a steady pipeline does not allocate, and
+ * the slot count bounds how far the producer can run ahead.
+ */
+class ChunkRing {
+public:
+  struct Slot {
+    std::vector<uint8_t> data; // Capacity is reused, size is not meaningful
+    size_t size = 0;           // Valid bytes
+    uint64_t offset = 0;       // Position in the source
+  };
+
+  explicit ChunkRing(size_t slotCount);
+
+  ChunkRing(const ChunkRing &) = delete;
+  ChunkRing &operator=(const ChunkRing &) = delete;
+
+  // Producer side; acquireFree blocks, returns nullptr once cancelled
+  Slot *acquireFree();
+  void publish(Slot *slot);
+  void close(); // No more slots will be published
+
+  // Consumer side; acquireFilled blocks, returns nullptr once closed and
+  // drained, or cancelled
+  Slot *acquireFilled();
+  void recycle(Slot *slot);
+  void cancel(); // Abandon the pipeline and wake the producer
+
+  size_t slotCount() const { return slots_.size(); }
+
+private:
+  std::vector<Slot> slots_;
+  std::mutex mutex_;
+  std::condition_variable freeCv_;
+  std::condition_variable filledCv_;
+  std::deque<Slot *> free_;
+  std::deque<Slot *> filled_;
+  bool closed_ = false;
+  bool cancelled_ = false;
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_CHUNK_RING_H
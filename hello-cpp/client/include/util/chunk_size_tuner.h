@@ -0,0 +1,61 @@
+#ifndef AUDIO_STREAM_CHUNK_SIZE_TUNER_H
+#define AUDIO_STREAM_CHUNK_SIZE_TUNER_H
+
+#include "../../include/common_types.h"
+#include <chrono>
+#include <cstddef>
+
+namespace audio_stream {
+
+/**
+ * Adaptive chunk size selection for uploads and downloads.
+ * Keeps a smoothed throughput estimate and the minimum round-trip time,
+ * and steps the chunk size by powers of two, within the limits the server
+ * advertised, until it covers the bandwidth-delay product of the pipeline
+ * and keeps the frame rate bounded on fast links.
+ */
+class ChunkSizeTuner {
+public:
+  using Duration = std::chrono::steady_clock::duration;
+
+  explicit ChunkSizeTuner(size_t initialChunkSize = CHUNK_SIZE,
+                          size_t minChunkSize = MIN_CHUNK_SIZE,
+                          size_t maxChunkSize = MAX_CHUNK_SIZE);
+
+  // Negotiated limits from STARTED; the current size is clamped into them
+  void setLimits(size_t minChunkSize, size_t maxChunkSize);
+  void setChunkSize(size_t chunkSize);
+  void setAdaptive(bool adaptive) { adaptive_ = adaptive; }
+  // Number of requests in flight whose sizes share one round trip
+  void setPipelineDepth(size_t depth) { pipelineDepth_ = depth > 0 ? depth : 1; }
+
+  // Measurements
+  void recordThroughput(size_t bytes, Duration elapsed);
+  void recordRoundTrip(Duration rtt);
+
+  size_t getChunkSize() const { return chunkSize_; }
+  size_t getMinChunkSize() const { return minChunkSize_; }
+  size_t getMaxChunkSize() const { return maxChunkSize_; }
+  bool isAdaptive() const { return adaptive_; }
+
+private:
+  void retune();
+  size_t clampToLimits(size_t chunkSize) const;
+
+  size_t chunkSize_;
+  size_t minChunkSize_;
+  size_t maxChunkSize_;
+  size_t pipelineDepth_ = 1;
+  bool adaptive_ = true;
+
+  double throughputBytesPerSec_ = 0.0; // EWMA, 0 until first sample
+  double rttSeconds_ = 0.0;            // Minimum, 0 until first sample
+
+  static constexpr double SMOOTHING = 0.25;
+  // Lower bound on the time one chunk represents, caps the frame rate
+  static constexpr double MIN_CHUNK_INTERVAL_SEC = 0.002;
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_CHUNK_SIZE_TUNER_H
@@ -1,6 +1,7 @@
 #ifndef AUDIO_STREAM_ERROR_HANDLER_H
 #define AUDIO_STREAM_ERROR_HANDLER_H
 
+#include <atomic>
 #include <chrono>
 #include <functional>
 #include <string>
@@ -58,12 +59,12 @@ public:
 private:
   std::function<void(const ErrorInfo &)> onErrorCallback_;
 
-  // Error counters
-  int connectionErrors_ = 0;
-  int fileIOErrors_ = 0;
-  int protocolErrors_ = 0;
-  int timeoutErrors_ = 0;
-  int validationErrors_ = 0;
+  // Error counters, shared by the connections of a parallel transfer
+  std::atomic<int> connectionErrors_{0};
+  std::atomic<int> fileIOErrors_{0};
+  std::atomic<int> protocolErrors_{0};
+  std::atomic<int> timeoutErrors_{0};
+  std::atomic<int> validationErrors_{0};
 
   void incrementErrorCount(ErrorType type);
   std::string errorTypeToString(ErrorType type) const;
@@ -2,40 +2,99 @@
 #define AUDIO_STREAM_PERFORMANCE_MONITOR_H
 
 #include "../../include/common_types.h"
+#include "latency_histogram.h"
 #include <chrono>
 #include <fstream>
+#include <mutex>
+#include <nlohmann/json.hpp>
 #include <string>
+#include <vector>
 
 namespace audio_stream {
 
+/**
+ * Bytes per fixed time slot since a transfer started. Once MAX_POINTS slots
+ * are used, neighbouring slots are merged and the interval doubles, so a
+ * long transfer keeps a bounded, coarser series.
+ */
+class ThroughputSeries {
+public:
+  static constexpr size_t MAX_POINTS = 4096;
+  static constexpr std::chrono::milliseconds DEFAULT_INTERVAL{100};
+
+  void start(std::chrono::steady_clock::time_point start);
+  void add(std::chrono::steady_clock::time_point at, size_t bytes);
+
+  std::chrono::milliseconds getInterval() const { return interval_; }
+  const std::vector<uint64_t> &getBytes() const { return bytes_; }
+
+  // {"intervalMs", "mbps": [per slot]}; the last slot may be partial
+  nlohmann::json toJson() const;
+
+private:
+  std::chrono::steady_clock::time_point start_;
+  std::chrono::milliseconds interval_ = DEFAULT_INTERVAL;
+  std::vector<uint64_t> bytes_;
+};
+
 /**
  * Performance monitor for tracking stream metrics
  * Records timestamps and calculates throughput
  * Requirements: 9.1, 9.2, 9.3, 9.4, 9.5
+ *
+ * Transfers also record each chunk: upload chunks the time from being
+ * ready to being handed to the socket (including waits for the send
+ * window), downloads the gap since the previous chunk arrived and, for
+ * GETs, the request's round trip. These go into histograms and a
+ * throughput series, which expose the stalls an average hides. The chunk
+ * recorders may be called from several threads (parallel downloads share
+ * one monitor).
  */
 class PerformanceMonitor {
 public:
   PerformanceMonitor() = default;
 
-  // Upload metrics
+  // Upload metrics; bytes and time cover all connections together
   void startUpload();
-  void endUpload(size_t bytes);
+  void endUpload(size_t bytes, size_t connections = 1);
 
-  // Download metrics
+  // Download metrics; bytes and time cover all connections together
   void startDownload();
-  void endDownload(size_t bytes);
+  void endDownload(size_t bytes, size_t connections = 1);
+
+  // Per-chunk samples, see the class comment
+  void recordUploadChunk(size_t bytes, std::chrono::nanoseconds sendTime);
+  void recordDownloadChunk(size_t bytes, std::chrono::nanoseconds gap);
+  void recordRoundTrip(std::chrono::nanoseconds roundTrip);
 
   // Get metrics
   PerformanceMetrics getMetrics() const;
   std::string generateReport() const;
 
-  // Logging functionality
+  // Copies of the per-chunk histograms (nanoseconds)
+  LatencyHistogram getUploadChunkHistogram() const;
+  LatencyHistogram getDownloadChunkHistogram() const;
+  LatencyHistogram getRoundTripHistogram() const;
+
+  /**
+   * Everything recorded, machine-readable: per direction bytes, duration,
+   * throughput, connections, chunk histograms (count, mean, p50, p90, p99,
+   * p999 and max, in microseconds) and the throughput series.
+   */
+  nlohmann::json toJson() const;
+
+  // Logging functionality; the file gets one toJson() line per call
   void logMetricsToConsole() const;
   void logMetricsToFile(const std::string &filePath) const;
 
   // Performance validation
   bool meetsPerformanceTargets() const;
 
+  // A nanosecond histogram as toJson() writes it (in microseconds), and as
+  // one line of percentiles in milliseconds
+  static nlohmann::json histogramToJson(const LatencyHistogram &histogram);
+  static std::string formatLatencies(const LatencyHistogram &histogram);
+
 private:
   double
   calculateThroughputMbps(size_t bytes,
@@ -45,6 +104,13 @@ private:
   std::string formatBytes(size_t bytes) const;
 
   PerformanceMetrics metrics_;
+
+  mutable std::mutex samplesMutex_; // Guards everything below
+  LatencyHistogram uploadChunks_;
+  LatencyHistogram downloadChunks_;
+  LatencyHistogram roundTrips_;
+  ThroughputSeries uploadSeries_;
+  ThroughputSeries downloadSeries_;
 };
 
 } // namespace audio_stream
@@ -0,0 +1,66 @@
+#ifndef AUDIO_STREAM_RESPONSE_CORRELATOR_H
+#define AUDIO_STREAM_RESPONSE_CORRELATOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace audio_stream {
+
+/**
+ * Matches control replies from the server to the requests waiting on them.
+ * A caller registers the reply it expects (type and stream ID) before
+ * sending the request, then blocks on its ticket; the websocket thread
+ * dispatches each incoming text message, which wakes exactly the waiter it
+ * answers. Any number of requests may be outstanding at once.
+ *
+ * Replies are matched to the oldest waiter with the same type and stream
+ * ID. A reply without a stream ID matches on type alone. Error replies
+ * complete the waiter for their stream, or the oldest waiter if the error
+ * names no stream, and are handed over unchanged for the caller to report.
+ */
+class ResponseCorrelator {
+public:
+  using Ticket = uint64_t;
+
+  /**
+   * Register interest in a reply; call before sending the request
+   * @param responseType Expected reply type, e.g. "STARTED"
+   * @param streamId Stream the request is for
+   * @return Ticket to wait on
+   */
+  Ticket expect(const std::string &responseType, const std::string &streamId);
+
+  /**
+   * Wait for the reply to a ticket. The ticket is released either way.
+   * @return The raw reply message, or nullopt on timeout
+   */
+  std::optional<std::string> waitFor(Ticket ticket,
+                                     std::chrono::milliseconds timeout);
+
+  /**
+   * Route an incoming text message to its waiter
+   * @return true if the message answered an outstanding request
+   */
+  bool dispatch(const std::string &message);
+
+private:
+  struct Pending {
+    std::string responseType;
+    std::string streamId;
+    std::optional<std::string> response;
+  };
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::map<Ticket, Pending> pending_; // Ordered by ticket, oldest first
+  Ticket nextTicket_ = 1;
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_RESPONSE_CORRELATOR_H
@@ -2,6 +2,7 @@
 #define AUDIO_STREAM_VERIFICATION_MODULE_H
 
 #include "../../include/common_types.h"
+#include <cstdint>
 #include <string>
 
 namespace audio_stream {
@@ -9,26 +10,64 @@ namespace audio_stream {
 /**
  * Verification module for file integrity checking
  * Computes checksums and compares files
+ *
+ * Files are hashed as a stream through a fixed-size buffer, so memory use
+ * does not depend on file size. CRC32C, the default for reports, is
+ * hardware-accelerated where available and hashes large files in parallel
+ * segments whose CRCs are combined.
  */
 class VerificationModule {
 public:
+  enum class ChecksumAlgorithm { CRC32C, MD5, SHA1, SHA256 };
+
+  static constexpr size_t HASH_BUFFER_SIZE = 1024 * 1024; // Per reader
+  static constexpr uint64_t PARALLEL_SEGMENT_SIZE =
+      64ULL * 1024 * 1024; // Minimum bytes per CRC32C thread
+
   VerificationModule() = default;
 
   // Checksum computation
+  std::string computeCRC32C(const std::string &filePath);
   std::string computeMD5(const std::string &filePath);
   std::string computeSHA1(const std::string &filePath);
   std::string computeSHA256(const std::string &filePath);
+  std::string computeChecksum(const std::string &filePath,
+                              ChecksumAlgorithm algorithm);
+
+  /**
+   * Set the algorithm used by compareFiles and generateReport
+   * @param algorithm Checksum algorithm (default CRC32C)
+   */
+  void setReportAlgorithm(ChecksumAlgorithm algorithm) {
+    reportAlgorithm_ = algorithm;
+  }
+  ChecksumAlgorithm getReportAlgorithm() const { return reportAlgorithm_; }
+
+  // Algorithm names ("crc32c", "md5", "sha1", "sha256")
+  static const char *algorithmName(ChecksumAlgorithm algorithm);
+  static bool parseAlgorithm(const std::string &name,
+                             ChecksumAlgorithm &algorithm);
 
   // File comparison
   bool compareFiles(const std::string &file1, const std::string &file2);
   VerificationReport generateReport(const std::string &originalFile,
                                     const std::string &downloadedFile);
 
+  /**
+   * Build a report from checksums computed elsewhere, e.g. inline while the
+   * data was transferred; only the file sizes are read from disk
+   */
+  VerificationReport generateReport(const std::string &originalFile,
+                                    const std::string &downloadedFile,
+                                    const std::string &algorithm,
+                                    const std::string &originalChecksum,
+                                    const std::string &downloadedChecksum);
+
 private:
-  enum class HashAlgorithm { MD5, SHA1, SHA256 };
+  bool computeFileCRC32C(const std::string &filePath, uint64_t fileSize,
+                         uint32_t &crc);
 
-  std::string computeChecksum(const std::string &filePath,
-                              HashAlgorithm algorithm);
+  ChecksumAlgorithm reportAlgorithm_ = ChecksumAlgorithm::CRC32C;
 };
 
 } // namespace audio_stream
@@ -1,15 +1,21 @@
 #include "audio_client_application.h"
+#include "crc32c.h"
+#include "logging.h"
 #include "core/chunk_manager.h"
 #include "core/download_manager.h"
 #include "core/file_manager.h"
+#include "core/load_generator.h"
+#include "core/parallel_transfer.h"
 #include "core/upload_manager.h"
 #include "core/websocket_client.h"
 #include "util/error_handler.h"
 #include "util/performance_monitor.h"
 #include "util/stream_id_generator.h"
 #include "util/verification_module.h"
+#include <algorithm>
 #include <chrono>
 #include <filesystem>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <memory>
@@ -25,6 +31,24 @@ struct ClientConfig {
   std::string serverUri;
   std::string inputFile;
   std::string outputFile;
+  size_t downloadWindow = DownloadManager::DEFAULT_WINDOW_SIZE;
+  bool rangeStream = false; // One STREAM request instead of pipelined GETs
+  size_t parallel = 1;       // Connections a transfer is split across
+  size_t chunkSize = CHUNK_SIZE;
+  bool adaptiveChunkSize = true;
+  Durability durability = Durability::DEFAULT; // Server's tier
+  bool binaryProtocol = false;
+  CompressionCodec compression = CompressionCodec::NONE; // Binary only
+  VerificationModule::ChecksumAlgorithm verifyAlgorithm =
+      VerificationModule::ChecksumAlgorithm::CRC32C;
+  bool fullVerify = false; // Re-read both files instead of inline checksums
+  int resumeAttempts = UploadManager::DEFAULT_MAX_RESUME_ATTEMPTS;
+  size_t putThreshold = UploadManager::DEFAULT_PUT_THRESHOLD;
+  uint64_t uploadWindow = UploadManager::DEFAULT_UPLOAD_WINDOW;
+  bool skipStored = false; // Offer blocks by digest first; binary only
+  std::string metricsFile; // JSON line of metrics appended per run
+  bool loadTest = false;   // Run virtual clients instead of one transfer
+  LoadConfig load;
   bool verbose = false;
 };
 
@@ -51,6 +75,75 @@ bool parseArguments(int argc, char *argv[], ClientConfig &config) {
       config.inputFile = argv[++i];
     } else if (arg == "--output" && i + 1 < argc) {
       config.outputFile = argv[++i];
+    } else if (arg == "--window" && i + 1 < argc) {
+      config.downloadWindow = std::stoul(argv[++i]);
+    } else if (arg == "--range-stream") {
+      config.rangeStream = true;
+    } else if (arg == "--parallel" && i + 1 < argc) {
+      config.parallel = std::stoul(argv[++i]);
+      config.binaryProtocol = true; // Attached uploads send offsets
+    } else if (arg == "--chunk-size" && i + 1 < argc) {
+      config.chunkSize = std::stoul(argv[++i]);
+    } else if (arg == "--fixed-chunk-size") {
+      config.adaptiveChunkSize = false;
+    } else if (arg == "--durability" && i + 1 < argc) {
+      std::string name = argv[++i];
+      auto durability = stringToDurability(name);
+      if (!durability) {
+        spdlog::error("Unknown durability: {}", name);
+        return false;
+      }
+      config.durability = *durability;
+    } else if (arg == "--binary-protocol") {
+      config.binaryProtocol = true;
+    } else if (arg == "--compress" && i + 1 < argc) {
+      std::string name = argv[++i];
+      auto codec = parseCompressionCodec(name);
+      if (!codec || !isCodecAvailable(*codec)) {
+        spdlog::error("Unknown or unavailable codec: {}", name);
+        return false;
+      }
+      config.compression = *codec;
+      config.binaryProtocol = true;
+    } else if (arg == "--verify-hash" && i + 1 < argc) {
+      std::string name = argv[++i];
+      if (!VerificationModule::parseAlgorithm(name, config.verifyAlgorithm)) {
+        spdlog::error("Unknown checksum algorithm: {}", name);
+        return false;
+      }
+    } else if (arg == "--resume-attempts" && i + 1 < argc) {
+      config.resumeAttempts = std::stoi(argv[++i]);
+    } else if (arg == "--put-threshold" && i + 1 < argc) {
+      config.putThreshold = std::stoul(argv[++i]);
+    } else if (arg == "--upload-window" && i + 1 < argc) {
+      config.uploadWindow = std::stoull(argv[++i]);
+    } else if (arg == "--skip-stored") {
+      config.skipStored = true;
+      config.binaryProtocol = true;
+    } else if (arg == "--full-verify") {
+      config.fullVerify = true;
+    } else if (arg == "--metrics-file" && i + 1 < argc) {
+      config.metricsFile = argv[++i];
+    } else if (arg == "--load-clients" && i + 1 < argc) {
+      config.load.clients = std::stoul(argv[++i]);
+      config.loadTest = true;
+    } else if (arg == "--load-threads" && i + 1 < argc) {
+      config.load.threads = std::stoul(argv[++i]);
+    } else if (arg == "--load-duration" && i + 1 < argc) {
+      config.load.duration = std::chrono::seconds(std::stoul(argv[++i]));
+    } else if (arg == "--load-rate" && i + 1 < argc) {
+      config.load.arrivalRate = std::stod(argv[++i]);
+    } else if (arg == "--load-sizes" && i + 1 < argc) {
+      std::string sizes = argv[++i];
+      if (!LoadGenerator::parseSizes(sizes, config.load.fileSizes)) {
+        spdlog::error("Invalid file sizes: {}", sizes);
+        return false;
+      }
+    } else if (arg == "--load-download" && i + 1 < argc) {
+      config.load.downloadFraction =
+          std::clamp(std::stod(argv[++i]), 0.0, 1.0);
+    } else if (arg == "--load-reuse" && i + 1 < argc) {
+      config.load.sessionsPerConnection = std::stoul(argv[++i]);
     } else if (arg == "--help" || arg == "-h") {
       spdlog::info("Usage: {} [options]", argv[0]);
       spdlog::info("Options:");
@@ -59,6 +152,55 @@ bool parseArguments(int argc, char *argv[], ClientConfig &config) {
       spdlog::info("  --input <file>     Input file path (required)");
       spdlog::info(
           "  --output <file>    Output file path (default: auto-generated)");
+      spdlog::info("  --window <n>       Outstanding GET requests during "
+                   "download (default: {})",
+                   DownloadManager::DEFAULT_WINDOW_SIZE);
+      spdlog::info("  --range-stream     Download with one server-pushed "
+                   "STREAM range instead of GETs");
+      spdlog::info("  --parallel <n>     Binary protocol, uploading and "
+                   "downloading over n connections at once (default: 1)");
+      spdlog::info("  --chunk-size <n>   Chunk size requested in START "
+                   "(default: {})",
+                   CHUNK_SIZE);
+      spdlog::info(
+          "  --fixed-chunk-size Keep the negotiated chunk size, do not adapt");
+      spdlog::info("  --durability <t>   Durability of the upload: none, "
+                   "periodic, finalize, strict (default: server's)");
+      spdlog::info("  --binary-protocol  Use binary control frames instead of "
+                   "JSON if the server supports them");
+      spdlog::info("  --compress <c>     Binary protocol with data frames "
+                   "compressed by lz4, zstd or deflate (as built)");
+      spdlog::info("  --verify-hash <a>  Checksum for --full-verify: crc32c, "
+                   "md5, sha1, sha256 (default: crc32c)");
+      spdlog::info("  --full-verify      Verify by re-reading both files "
+                   "instead of checksumming inline");
+      spdlog::info("  --resume-attempts <n> Times a dropped upload is resumed "
+                   "(default: {})",
+                   UploadManager::DEFAULT_MAX_RESUME_ATTEMPTS);
+      spdlog::info("  --put-threshold <n> Upload files up to n bytes with a "
+                   "single PUT (default: {}, 0 disables)",
+                   UploadManager::DEFAULT_PUT_THRESHOLD);
+      spdlog::info("  --upload-window <n> Bytes sent ahead of the server's "
+                   "writes (default: {}, 0 disables flow control)",
+                   UploadManager::DEFAULT_UPLOAD_WINDOW);
+      spdlog::info("  --skip-stored      Binary protocol, offering each 1MB "
+                   "block by SHA-256 and not sending those the server has");
+      spdlog::info("  --metrics-file <f> Append the run's metrics and chunk "
+                   "latency percentiles to f as a JSON line");
+      spdlog::info("Load test (no --input needed):");
+      spdlog::info("  --load-clients <n> Run n virtual clients against the "
+                   "server instead of one transfer");
+      spdlog::info("  --load-threads <n> Event loop threads they share "
+                   "(default: 4)");
+      spdlog::info("  --load-duration <s> Seconds of load (default: 30)");
+      spdlog::info("  --load-rate <r>    Sessions started per second, "
+                   "Poisson arrivals (default: 0, each client back to back)");
+      spdlog::info("  --load-sizes <l>   Upload sizes picked at random, e.g. "
+                   "64K,1M,16M (default: 1M)");
+      spdlog::info("  --load-download <f> Share of sessions downloading an "
+                   "earlier upload (default: 0.5)");
+      spdlog::info("  --load-reuse <n>   Sessions per connection before "
+                   "reconnecting (default: 0, never)");
       spdlog::info("  --verbose, -v      Enable verbose logging");
       spdlog::info("  --help, -h         Show this help message");
       return false;
@@ -68,6 +210,14 @@ bool parseArguments(int argc, char *argv[], ClientConfig &config) {
   return true;
 }
 
+bool validateServerUri(const std::string &uri) {
+  if (uri.find("ws://") != 0 && uri.find("wss://") != 0) {
+    spdlog::error("Invalid server URI format. Must start with ws:// or wss://");
+    return false;
+  }
+  return true;
+}
+
 bool validateInputs(const ClientConfig &config) {
   // Check if input file is specified
   if (config.inputFile.empty()) {
@@ -106,16 +256,44 @@ bool validateInputs(const ClientConfig &config) {
   }
 
   // Validate server URI format
-  if (config.serverUri.find("ws://") != 0 &&
-      config.serverUri.find("wss://") != 0) {
-    spdlog::error("Invalid server URI format. Must start with ws:// or wss://");
-    return false;
+  return validateServerUri(config.serverUri);
+}
+
+int runLoadTest(const ClientConfig &config) {
+  if (!validateServerUri(config.serverUri)) {
+    return 1;
   }
 
-  return true;
+  LoadConfig load = config.load;
+  load.serverUri = config.serverUri;
+  load.chunkSize = config.chunkSize;
+  load.downloadWindow = config.downloadWindow;
+
+  LoadGenerator generator(load);
+  LoadReport report = generator.run();
+
+  std::istringstream lines(report.format());
+  for (std::string line; std::getline(lines, line);) {
+    spdlog::info("{}", line);
+  }
+
+  if (!config.metricsFile.empty()) {
+    std::ofstream file(config.metricsFile, std::ios::app);
+    if (file.is_open()) {
+      file << report.toJson().dump() << "\n";
+      spdlog::info("Load report appended to: {}", config.metricsFile);
+    } else {
+      spdlog::error("Cannot open metrics file: {}", config.metricsFile);
+    }
+  }
+
+  // Overload shows up as dropped arrivals and latency; failures are errors
+  return report.failures == 0 && report.uploads > 0 ? 0 : 1;
 }
 
 int main(int argc, char *argv[]) {
+  logging::AsyncLogging asyncLogging("audio_stream_client");
+
   // Parse command line arguments
   ClientConfig config;
   if (!parseArguments(argc, argv, config)) {
@@ -131,6 +309,16 @@ int main(int argc, char *argv[]) {
 
   spdlog::info("Audio Stream Cache Client - C++ Implementation");
   spdlog::info("Server URI: {}", config.serverUri);
+
+  if (config.loadTest) {
+    try {
+      return runLoadTest(config);
+    } catch (const std::exception &e) {
+      spdlog::error("Load test failed: {}", e.what());
+      return 1;
+    }
+  }
+
   spdlog::info("Input file: {}", config.inputFile);
   spdlog::info("Output file: {}", config.outputFile);
 
@@ -145,11 +333,36 @@ int main(int argc, char *argv[]) {
     auto fileManager = std::make_shared<FileManager>();
     auto chunkManager = std::make_shared<ChunkManager>();
     auto errorHandler = std::make_shared<ErrorHandler>();
+    auto performanceMonitor = std::make_shared<PerformanceMonitor>();
     auto uploadManager = std::make_shared<UploadManager>(client, errorHandler);
+    uploadManager->setPerformanceMonitor(performanceMonitor);
+    uploadManager->setChunkSize(config.chunkSize);
+    uploadManager->setAdaptiveChunkSize(config.adaptiveChunkSize);
+    uploadManager->setDurability(config.durability);
+    uploadManager->setMaxResumeAttempts(config.resumeAttempts);
+    uploadManager->setPutThreshold(config.putThreshold);
+    uploadManager->setUploadWindow(config.uploadWindow);
+    uploadManager->setSkipStoredBlocks(config.skipStored);
+
+    // One transfer splits both the upload and the download
+    std::shared_ptr<ParallelTransfer> transfer;
+    if (config.parallel > 1) {
+      transfer = std::make_shared<ParallelTransfer>(
+          config.serverUri, config.parallel, errorHandler);
+      transfer->setBinaryProtocol(config.binaryProtocol);
+      transfer->setCompression(config.compression);
+      transfer->setUploadSetup([&](UploadManager &manager) {
+        manager.setPerformanceMonitor(performanceMonitor);
+        manager.setChunkSize(config.chunkSize);
+        manager.setAdaptiveChunkSize(config.adaptiveChunkSize);
+        manager.setMaxResumeAttempts(config.resumeAttempts);
+      });
+      uploadManager->setParallelTransfer(transfer);
+    }
     auto downloadManager = std::make_shared<DownloadManager>(
         client, fileManager, chunkManager, errorHandler);
     auto verificationModule = std::make_shared<VerificationModule>();
-    auto performanceMonitor = std::make_shared<PerformanceMonitor>();
+    verificationModule->setReportAlgorithm(config.verifyAlgorithm);
 
     // Set up error handling callback
     errorHandler->setOnError([](const ErrorHandler::ErrorInfo &error) {
@@ -160,6 +373,8 @@ int main(int argc, char *argv[]) {
     spdlog::info("=== Connecting to Server ===");
 
     // Connect to WebSocket server with retry logic
+    client->setBinaryProtocol(config.binaryProtocol);
+    client->setCompression(config.compression);
     if (!client->connectWithRetry(DEFAULT_MAX_RETRIES)) {
       errorHandler->reportError(ErrorHandler::ErrorType::CONNECTION_ERROR,
                                 "Failed to connect after all retry attempts",
@@ -183,18 +398,14 @@ int main(int argc, char *argv[]) {
 
     // Set message handler for upload phase
     client->setOnMessage([uploadManager](const std::string &message) {
-      spdlog::debug("Received server response during upload: {}", message);
+      SPDLOG_DEBUG("Received server response during upload: {}", message);
       // Forward to upload manager's internal handler
       uploadManager->handleServerResponse(message);
     });
 
-    // Start upload workflow
-    performanceMonitor->startUpload();
-
+    // Start upload workflow; the upload manager times it
     std::string uploadedStreamId = uploadManager->uploadFile(config.inputFile);
 
-    performanceMonitor->endUpload(fileSize);
-
     if (uploadedStreamId.empty()) {
       errorHandler->reportError(ErrorHandler::ErrorType::PROTOCOL_ERROR,
                                 "Upload failed - no stream ID returned",
@@ -210,6 +421,22 @@ int main(int argc, char *argv[]) {
 
     spdlog::info("=== Starting Download ===");
 
+    // Download within the range the server advertised for this stream, and
+    // check each block against what was uploaded as it arrives. A parallel
+    // download applies the same settings to each of its connections.
+    const ChunkSizeTuner &negotiated = uploadManager->getChunkSizeTuner();
+    auto configureDownload = [&](DownloadManager &manager) {
+      manager.setWindowSize(config.downloadWindow);
+      manager.setRangeStreaming(config.rangeStream);
+      manager.setChunkSizeLimits(negotiated.getMinChunkSize(),
+                                 negotiated.getMaxChunkSize());
+      manager.setChunkSize(config.chunkSize);
+      manager.setAdaptiveChunkSize(config.adaptiveChunkSize &&
+                                   negotiated.isAdaptive());
+      manager.setExpectedChecksums(uploadManager->getUploadChecksums());
+      manager.setPerformanceMonitor(performanceMonitor);
+    };
+
     // Set message handler for download phase
     client->setOnMessage([downloadManager](const std::string &message) {
       downloadManager->handleServerResponse(message);
@@ -218,10 +445,23 @@ int main(int argc, char *argv[]) {
     // Start download workflow
     performanceMonitor->startDownload();
 
-    bool downloadSuccess =
-        downloadManager->downloadFile(uploadedStreamId, config.outputFile);
+    bool downloadSuccess = false;
+    size_t downloadConnections = 1;
+    uint32_t downloadChecksum = 0;
+    if (transfer) {
+      transfer->setDownloadSetup(configureDownload);
+      downloadSuccess =
+          transfer->download(uploadedStreamId, config.outputFile, fileSize);
+      downloadConnections = transfer->getConnectionCount();
+      downloadChecksum = transfer->getChecksum();
+    } else {
+      configureDownload(*downloadManager);
+      downloadSuccess = downloadManager->downloadFile(
+          uploadedStreamId, config.outputFile, fileSize);
+      downloadChecksum = downloadManager->getChecksums().getChecksum();
+    }
 
-    performanceMonitor->endDownload(fileSize);
+    performanceMonitor->endDownload(fileSize, downloadConnections);
 
     if (!downloadSuccess) {
       errorHandler->reportError(ErrorHandler::ErrorType::PROTOCOL_ERROR,
@@ -237,9 +477,17 @@ int main(int argc, char *argv[]) {
 
     spdlog::info("=== Verifying File Integrity ===");
 
-    // Verify file integrity
+    // Verify file integrity. The checksums taken while the data passed
+    // through need no extra read of either file.
     VerificationReport report =
-        verificationModule->generateReport(config.inputFile, config.outputFile);
+        config.fullVerify
+            ? verificationModule->generateReport(config.inputFile,
+                                                 config.outputFile)
+            : verificationModule->generateReport(
+                  config.inputFile, config.outputFile, "crc32c",
+                  crc32c::toHex(
+                      uploadManager->getUploadChecksums().getChecksum()),
+                  crc32c::toHex(downloadChecksum));
 
     if (report.verificationPassed) {
       spdlog::info("✓ File verification PASSED - Files are identical");
@@ -252,8 +500,10 @@ int main(int argc, char *argv[]) {
       spdlog::error("✗ File verification FAILED");
       spdlog::error("  Original size: {} bytes, Downloaded size: {} bytes",
                     report.originalSize, report.downloadedSize);
-      spdlog::error("  Original checksum: {}", report.originalChecksum);
-      spdlog::error("  Downloaded checksum: {}", report.downloadedChecksum);
+      spdlog::error("  Original {}: {}", report.checksumAlgorithm,
+                    report.originalChecksum);
+      spdlog::error("  Downloaded {}: {}", report.checksumAlgorithm,
+                    report.downloadedChecksum);
       return 1;
     }
 
@@ -261,6 +511,9 @@ int main(int argc, char *argv[]) {
 
     // Generate and display performance report
     performanceMonitor->logMetricsToConsole();
+    if (!config.metricsFile.empty()) {
+      performanceMonitor->logMetricsToFile(config.metricsFile);
+    }
 
     // Check if performance targets are met
     if (performanceMonitor->meetsPerformanceTargets()) {
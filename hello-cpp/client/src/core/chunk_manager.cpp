@@ -15,7 +15,7 @@ ChunkManager::splitIntoChunks(const std::vector<uint8_t> &data) {
   size_t offset = 0;
 
   while (offset < totalSize) {
-    size_t chunkSize = std::min(CHUNK_SIZE, totalSize - offset);
+    size_t chunkSize = std::min(chunkSize_, totalSize - offset);
 
     std::vector<uint8_t> chunk(data.begin() + offset,
                                data.begin() + offset + chunkSize);
@@ -28,7 +28,7 @@ ChunkManager::splitIntoChunks(const std::vector<uint8_t> &data) {
 }
 
 size_t ChunkManager::calculateChunkCount(size_t totalSize) const {
-  return (totalSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  return (totalSize + chunkSize_ - 1) / chunkSize_;
 }
 
 void ChunkManager::addChunk(size_t offset, const std::vector<uint8_t> &chunk) {
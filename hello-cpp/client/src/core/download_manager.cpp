@@ -1,4 +1,7 @@
 #include "core/download_manager.h"
+#include "crc32c.h"
+#include "logging.h"
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
 #include <mutex>
@@ -19,8 +22,11 @@ DownloadManager::DownloadManager(std::shared_ptr<WebSocketClient> client,
                                  std::shared_ptr<ErrorHandler> errorHandler)
     : client_(client), fileManager_(fileManager), chunkManager_(chunkManager),
       errorHandler_(errorHandler), bytesDownloaded_(0), totalSize_(0),
-      requestTimeoutMs_(5000), maxRetries_(3), downloadComplete_(false),
-      errorOccurred_(false) {
+      requestTimeoutMs_(5000), maxRetries_(3),
+      windowSize_(DEFAULT_WINDOW_SIZE), rangeStreaming_(false),
+      writeOffset_(0), positionalWrites_(false), fileOffset_(0),
+      verifyBlocks_(false),
+      blockStart_(0), downloadComplete_(false) {
 
   // Set up binary message handler for receiving data
   client_->setOnBinaryMessage([this](const std::vector<uint8_t> &data) {
@@ -33,19 +39,13 @@ DownloadManager::DownloadManager(std::shared_ptr<WebSocketClient> client,
 bool DownloadManager::downloadFile(const std::string &streamId,
                                    const std::string &outputPath,
                                    size_t expectedSize) {
-  spdlog::info("Starting download: streamId={}, outputPath={}, expectedSize={}",
-               streamId, outputPath, expectedSize);
+  spdlog::info("Starting download: streamId={}, outputPath={}, expectedSize={}, "
+               "window={}{}",
+               streamId, outputPath, expectedSize, windowSize_,
+               rangeStreaming_ ? ", range streaming" : "");
 
-  // Reset state
-  bytesDownloaded_ = 0;
-  totalSize_ = expectedSize;
-  lastError_.clear();
-  downloadBuffer_.clear();
-  // Clear the queue by swapping with an empty queue
-  std::queue<std::vector<uint8_t>> empty;
-  pendingData_.swap(empty);
-  downloadComplete_ = false;
-  errorOccurred_ = false;
+  resetTransfer(0, expectedSize);
+  positionalWrites_ = false;
 
   // Open output file for writing
   if (!fileManager_->openForWriting(outputPath)) {
@@ -56,98 +56,410 @@ bool DownloadManager::downloadFile(const std::string &streamId,
     return false;
   }
 
-  // If expected size is unknown, start with first chunk to determine size
-  size_t currentOffset = 0;
-  size_t remainingBytes = expectedSize > 0 ? expectedSize : CHUNK_SIZE;
-
-  while (remainingBytes > 0 || expectedSize == 0) {
-    // Calculate chunk size for this request
-    size_t requestSize = std::min(remainingBytes, CHUNK_SIZE);
-
-    spdlog::debug("Requesting chunk: offset={}, size={}", currentOffset,
-                  requestSize);
-
-    // Send GET request with retry logic
-    int retryCount = 0;
-    bool requestSuccess = false;
-
-    while (retryCount <= maxRetries_ && !requestSuccess) {
-      if (!sendGetRequest(streamId, currentOffset, requestSize)) {
-        retryCount++;
-        if (retryCount <= maxRetries_) {
-          if (errorHandler_) {
-            errorHandler_->reportError(ErrorHandler::ErrorType::PROTOCOL_ERROR,
-                                       "GET request failed, retrying",
-                                       "Attempt " + std::to_string(retryCount),
-                                       true);
-          }
-          std::this_thread::sleep_for(
-              std::chrono::milliseconds(1000 * retryCount));
-          continue;
-        } else {
-          fileManager_->closeWriter();
-          return false;
-        }
+  // With an unknown size, keep requesting until a short chunk or an
+  // end-of-data error marks where the stream ends
+  bool received = receiveRange(
+      streamId, 0, expectedSize > 0 ? expectedSize : SIZE_MAX, expectedSize);
+  fileManager_->closeWriter();
+  if (!received) {
+    return false;
+  }
+
+  downloadComplete_ = true;
+  spdlog::info("Download completed: {} bytes downloaded",
+               bytesDownloaded_.load());
+  return true;
+}
+
+bool DownloadManager::downloadRange(const std::string &streamId, size_t begin,
+                                    size_t end) {
+  spdlog::info("Starting range download: streamId={}, range={}-{}, window={}",
+               streamId, begin, end, windowSize_);
+
+  if (!fileManager_->isPositionalWriting()) {
+    lastError_ = "Output file is not open for positional writes";
+    return handleProtocolError(lastError_, "Stream ID: " + streamId);
+  }
+  if (verifyBlocks_ && begin % expectedChecksums_.getBlockSize() != 0) {
+    lastError_ = "Range start " + std::to_string(begin) +
+                 " is not on a checksum block boundary";
+    return handleProtocolError(lastError_, "Stream ID: " + streamId);
+  }
+
+  resetTransfer(begin, end - begin);
+  positionalWrites_ = true;
+  if (!receiveRange(streamId, begin, end, end)) {
+    return false;
+  }
+
+  downloadComplete_ = true;
+  spdlog::info("Range download completed: {} bytes from offset {}",
+               bytesDownloaded_.load(), begin);
+  return true;
+}
+
+void DownloadManager::resetTransfer(size_t begin, size_t size) {
+  bytesDownloaded_ = 0;
+  totalSize_ = size;
+  lastError_.clear();
+  downloadBuffer_.clear();
+  inFlight_.clear();
+  completedChunks_.clear();
+  writeOffset_ = begin;
+  fileOffset_ = begin;
+  downloadChecksums_.reset();
+  blockBuffer_.clear();
+  blockStart_ = begin;
+  blockRefetches_.clear();
+  {
+    // Clear the queue by swapping with an empty queue
+    std::lock_guard<std::mutex> lock(dataMutex_);
+    std::queue<Response> empty;
+    pendingResponses_.swap(empty);
+  }
+  downloadComplete_ = false;
+}
+
+bool DownloadManager::receiveRange(const std::string &streamId, size_t begin,
+                                   size_t end, size_t expectedSize) {
+  size_t nextOffset = begin;
+  size_t endOffset = end;
+  chunkTuner_.setPipelineDepth(windowSize_);
+  auto lastArrival = std::chrono::steady_clock::now();
+
+  while (true) {
+    // Keep the window full; a STREAM range covers the rest of the file
+    while (inFlight_.size() < windowSize_ && nextOffset < endOffset) {
+      size_t span =
+          rangeStreaming_ ? endOffset - nextOffset : chunkTuner_.getChunkSize();
+      PendingRequest request{nextOffset,
+                             std::min(endOffset - nextOffset, span), 0,
+                             std::chrono::steady_clock::time_point()};
+      SPDLOG_DEBUG("Requesting chunk: offset={}, size={}", request.offset,
+                   request.length);
+      AUDIO_STREAM_TRACE(streamId, "requesting {} bytes at offset {}",
+                         request.length, request.offset);
+      if (!sendWithRetry(streamId, request)) {
+        return false;
       }
-      requestSuccess = true;
+      inFlight_.push_back(request);
+      nextOffset += request.length;
     }
 
-    // Wait for binary response with timeout
-    std::vector<uint8_t> chunkData = waitForBinaryData(requestTimeoutMs_);
-    if (chunkData.empty()) {
-      if (expectedSize == 0 && bytesDownloaded_ > 0) {
-        // End of file reached for unknown size
-        spdlog::info("End of file reached at {} bytes", bytesDownloaded_);
-        break;
+    if (inFlight_.empty()) {
+      break;
+    }
+
+    // Wait for the next reply with timeout
+    Response response;
+    if (!waitForResponse(response, requestTimeoutMs_)) {
+      return false;
+    }
+
+    // Pushed frames and STREAMED belong to the oldest range
+    if (rangeStreaming_ && !response.isError) {
+      auto arrivedAt = std::chrono::steady_clock::now();
+      chunkTuner_.recordThroughput(response.data.size(),
+                                   arrivedAt - lastArrival);
+      if (performanceMonitor_) {
+        performanceMonitor_->recordDownloadChunk(response.data.size(),
+                                                 arrivedAt - lastArrival);
       }
-      if (errorOccurred_) {
-        fileManager_->closeWriter();
+      lastArrival = arrivedAt;
+      if (!handleRangeResponse(streamId, response, expectedSize, endOffset)) {
         return false;
       }
-      lastError_ = "Failed to receive chunk data";
+      continue;
+    }
+
+    // The server handles a connection's messages in order and replies to
+    // each GET exactly once, so replies match requests first-in first-out
+    PendingRequest request = inFlight_.front();
+    inFlight_.pop_front();
+
+    // With the window full, reply spacing tracks throughput; the time since
+    // the request left tracks RTT plus queueing behind earlier requests
+    auto arrivedAt = std::chrono::steady_clock::now();
+    if (!response.isError) {
+      chunkTuner_.recordRoundTrip(arrivedAt - request.sentAt);
+      chunkTuner_.recordThroughput(response.data.size(),
+                                   arrivedAt - lastArrival);
+      if (performanceMonitor_) {
+        performanceMonitor_->recordDownloadChunk(response.data.size(),
+                                                 arrivedAt - lastArrival);
+        performanceMonitor_->recordRoundTrip(arrivedAt - request.sentAt);
+      }
+    }
+    lastArrival = arrivedAt;
+
+    if (response.isError) {
+      bool endOfData =
+          response.error.find("No data available") != std::string::npos;
+      if (endOfData && expectedSize == 0) {
+        // End of file reached for unknown size
+        endOffset = std::min(endOffset, request.offset);
+        continue;
+      }
+
+      // Retry just this request; later chunks stay buffered until it lands
+      request.offset += request.received;
+      request.length -= request.received;
+      request.received = 0;
+      if (++request.attempts > maxRetries_) {
+        lastError_ = response.error;
+        return handleProtocolError(lastError_,
+                                   "GET offset " +
+                                       std::to_string(request.offset));
+      }
       if (errorHandler_) {
-        errorHandler_->handleTimeoutError(lastError_, requestTimeoutMs_);
+        errorHandler_->reportError(
+            ErrorHandler::ErrorType::PROTOCOL_ERROR,
+            "GET request failed, retrying",
+            "Offset " + std::to_string(request.offset) + ", attempt " +
+                std::to_string(request.attempts),
+            true);
       }
-      fileManager_->closeWriter();
+      if (!sendWithRetry(streamId, request)) {
+        return false;
+      }
+      inFlight_.push_back(request);
+      continue;
+    }
+
+    size_t received = response.data.size();
+    if (received > request.length) {
+      lastError_ = "Received " + std::to_string(received) +
+                   " bytes for a GET of " + std::to_string(request.length);
+      return handleProtocolError(lastError_, "GET response");
+    }
+
+    if (received < request.length) {
+      if (expectedSize == 0) {
+        // For unknown size, a short chunk is the last one
+        spdlog::info("Received partial chunk, download complete");
+        endOffset = std::min(endOffset, request.offset + received);
+      } else {
+        // Ask again for the part that did not arrive
+        PendingRequest remainder{request.offset + received,
+                                 request.length - received, request.attempts,
+                                 request.sentAt};
+        if (!sendWithRetry(streamId, remainder)) {
+          return false;
+        }
+        inFlight_.push_back(remainder);
+      }
+    }
+
+    if (received > 0) {
+      completedChunks_.emplace(request.offset, std::move(response.data));
+    }
+    if (!flushCompletedChunks(streamId)) {
       return false;
     }
+  }
+
+  if (!completedChunks_.empty() ||
+      (expectedSize > 0 && writeOffset_ != end)) {
+    lastError_ = "Download ended with missing chunks at offset " +
+                 std::to_string(writeOffset_);
+    return handleProtocolError(lastError_, "Stream ID: " + streamId);
+  }
 
-    // Process the received data
-    if (!processBinaryData(chunkData)) {
-      fileManager_->closeWriter();
+  size_t verifyEnd =
+      std::min<uint64_t>(end, expectedChecksums_.getTotalBytes());
+  if (verifyBlocks_ && blockStart_ != verifyEnd) {
+    lastError_ = "Download verified " + std::to_string(blockStart_ - begin) +
+                 " of " + std::to_string(verifyEnd - begin) +
+                 " expected bytes";
+    return handleProtocolError(lastError_, "Stream ID: " + streamId);
+  }
+
+  return true;
+}
+
+bool DownloadManager::sendWithRetry(const std::string &streamId,
+                                    PendingRequest &request) {
+  for (int retryCount = 0; retryCount <= maxRetries_; ++retryCount) {
+    if (retryCount > 0) {
+      if (errorHandler_) {
+        errorHandler_->reportError(ErrorHandler::ErrorType::PROTOCOL_ERROR,
+                                   "GET request failed, retrying",
+                                   "Attempt " + std::to_string(retryCount),
+                                   true);
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1000 * retryCount));
+    }
+    request.sentAt = std::chrono::steady_clock::now();
+    bool sent = rangeStreaming_
+                    ? sendStreamRequest(streamId, request.offset,
+                                        request.length)
+                    : sendGetRequest(streamId, request.offset, request.length);
+    if (sent) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DownloadManager::handleRangeResponse(const std::string &streamId,
+                                          Response &response,
+                                          size_t expectedSize,
+                                          size_t &endOffset) {
+  PendingRequest &range = inFlight_.front();
+
+  if (!response.isStreamEnd) {
+    size_t received = response.data.size();
+    if (received > range.length - range.received) {
+      lastError_ = "Received " + std::to_string(range.received + received) +
+                   " bytes for a STREAM of " + std::to_string(range.length);
+      return handleProtocolError(lastError_, "STREAM response");
+    }
+    if (received > 0) {
+      completedChunks_.emplace(range.offset + range.received,
+                               std::move(response.data));
+      range.received += received;
+    }
+    // May queue a re-fetch behind this range; deque keeps range in place
+    return flushCompletedChunks(streamId);
+  }
+
+  PendingRequest done = range;
+  inFlight_.pop_front();
+  if (response.streamedLength != done.received) {
+    lastError_ = "STREAMED reports " + std::to_string(response.streamedLength) +
+                 " bytes, received " + std::to_string(done.received);
+    return handleProtocolError(lastError_, "STREAM response");
+  }
+
+  if (done.received < done.length) {
+    if (expectedSize == 0) {
+      // The range stopped at the end of the stream
+      endOffset = std::min(endOffset, done.offset + done.received);
+      return true;
+    }
+    if (++done.attempts > maxRetries_) {
+      lastError_ = "Stream ended at offset " +
+                   std::to_string(done.offset + done.received) +
+                   " before the expected " + std::to_string(expectedSize) +
+                   " bytes";
+      return handleProtocolError(lastError_, "Stream ID: " + streamId);
+    }
+    PendingRequest remainder{done.offset + done.received,
+                             done.length - done.received, done.attempts,
+                             std::chrono::steady_clock::time_point()};
+    if (!sendWithRetry(streamId, remainder)) {
       return false;
     }
+    inFlight_.push_back(remainder);
+  }
+  return true;
+}
 
-    // Update progress
-    currentOffset += chunkData.size();
-    bytesDownloaded_ += chunkData.size();
+bool DownloadManager::flushCompletedChunks(const std::string &streamId) {
+  auto it = completedChunks_.begin();
+  while (it != completedChunks_.end() && it->first == writeOffset_) {
+    std::vector<uint8_t> chunk = std::move(it->second);
+    completedChunks_.erase(it);
+    writeOffset_ += chunk.size();
 
-    if (expectedSize > 0) {
-      remainingBytes -= chunkData.size();
+    if (!verifyBlocks_) {
+      if (!processBinaryData(chunk.data(), chunk.size())) {
+        return false;
+      }
     } else {
-      // For unknown size, continue until we get less than requested
-      if (chunkData.size() < requestSize) {
-        spdlog::info("Received partial chunk, download complete");
-        break;
+      // Hold data back until its whole block has arrived and matches
+      blockBuffer_.insert(blockBuffer_.end(), chunk.begin(), chunk.end());
+      if (!verifyBufferedBlocks(streamId)) {
+        return false;
       }
     }
+    it = completedChunks_.begin();
+  }
+  return true;
+}
 
-    // Log progress periodically
-    if (bytesDownloaded_ % (CHUNK_SIZE * 10) == 0) {
-      spdlog::info("Downloaded {} bytes", bytesDownloaded_);
+bool DownloadManager::verifyBufferedBlocks(const std::string &streamId) {
+  while (true) {
+    size_t index = blockStart_ / expectedChecksums_.getBlockSize();
+    size_t blockLength = expectedChecksums_.getBlockLength(index);
+    if (blockLength == 0) {
+      if (blockBuffer_.empty()) {
+        return true;
+      }
+      lastError_ = "Received data beyond the expected " +
+                   std::to_string(expectedChecksums_.getTotalBytes()) +
+                   " bytes";
+      return handleProtocolError(lastError_, "Block verification");
+    }
+    if (blockBuffer_.size() < blockLength) {
+      return true; // Rest of the block is still in flight
     }
+
+    uint32_t crc = crc32c::extend(0, blockBuffer_.data(), blockLength);
+    if (crc != expectedChecksums_.getBlockChecksum(index)) {
+      return refetchBlock(streamId, index);
+    }
+
+    if (!processBinaryData(blockBuffer_.data(), blockLength)) {
+      return false;
+    }
+    blockBuffer_.erase(blockBuffer_.begin(),
+                       blockBuffer_.begin() + blockLength);
+    blockStart_ += blockLength;
   }
+}
 
-  // Close output file
-  fileManager_->closeWriter();
+bool DownloadManager::refetchBlock(const std::string &streamId,
+                                   size_t blockIndex) {
+  if (++blockRefetches_[blockIndex] > maxRetries_) {
+    lastError_ = "Block at offset " + std::to_string(blockStart_) +
+                 " failed checksum verification after " +
+                 std::to_string(maxRetries_) + " re-fetches";
+    return handleProtocolError(lastError_, "Stream ID: " + streamId);
+  }
+  if (errorHandler_) {
+    errorHandler_->reportError(
+        ErrorHandler::ErrorType::PROTOCOL_ERROR,
+        "Block checksum mismatch, re-fetching",
+        "Offset " + std::to_string(blockStart_) + ", attempt " +
+            std::to_string(blockRefetches_[blockIndex]),
+        true);
+  }
 
-  spdlog::info("Download completed: {} bytes downloaded", bytesDownloaded_);
+  // The buffer may extend past the failed block; request all of it again
+  // so the file still continues from blockStart_. Later chunks already
+  // completed or in flight are unaffected.
+  size_t offset = blockStart_;
+  size_t end = writeOffset_;
+  blockBuffer_.clear();
+  writeOffset_ = blockStart_;
+  while (offset < end) {
+    size_t span = rangeStreaming_ ? end - offset : chunkTuner_.getChunkSize();
+    PendingRequest request{offset, std::min(end - offset, span), 0,
+                           std::chrono::steady_clock::time_point()};
+    if (!sendWithRetry(streamId, request)) {
+      return false;
+    }
+    inFlight_.push_back(request);
+    offset += request.length;
+  }
   return true;
 }
 
 bool DownloadManager::sendGetRequest(const std::string &streamId, size_t offset,
                                      size_t length) {
   try {
+    if (client_->isBinaryProtocol()) {
+      BinaryFrameHeader header;
+      header.type = BinaryFrameType::GET;
+      header.offset = offset;
+      header.length = length;
+      client_->sendBinaryFrame(header, streamId);
+      SPDLOG_DEBUG("Sent binary GET request: offset {} length {}", offset,
+                   length);
+      return true;
+    }
+
     // Create GET control message using the audio_stream namespace
     audio_stream::GetMessage getMsg(streamId, static_cast<int64_t>(offset),
                                     static_cast<int64_t>(length));
@@ -158,7 +470,7 @@ bool DownloadManager::sendGetRequest(const std::string &streamId, size_t offset,
     // Send as text message
     client_->sendTextMessage(jsonMessage);
 
-    spdlog::debug("Sent GET request: {}", jsonMessage);
+    SPDLOG_DEBUG("Sent GET request: {}", jsonMessage);
     return true;
 
   } catch (const std::exception &e) {
@@ -171,18 +483,73 @@ bool DownloadManager::sendGetRequest(const std::string &streamId, size_t offset,
   }
 }
 
-bool DownloadManager::processBinaryData(const std::vector<uint8_t> &data) {
+bool DownloadManager::sendStreamRequest(const std::string &streamId,
+                                        size_t offset, size_t length) {
+  // An open-ended range (unknown size) goes to the end of the stream
+  if (length == SIZE_MAX - offset) {
+    length = 0;
+  }
+
+  try {
+    if (client_->isBinaryProtocol()) {
+      BinaryFrameHeader header;
+      header.type = BinaryFrameType::STREAM;
+      header.offset = offset;
+      header.length = length;
+      header.chunkSize = static_cast<uint32_t>(chunkTuner_.getChunkSize());
+      client_->sendBinaryFrame(header, streamId);
+      SPDLOG_DEBUG("Sent binary STREAM request: offset {} length {}", offset,
+                   length);
+      return true;
+    }
+
+    StreamMessage streamMsg;
+    streamMsg.streamId = streamId;
+    streamMsg.offset = offset;
+    streamMsg.length = length;
+    streamMsg.chunkSize = chunkTuner_.getChunkSize();
+    std::string jsonMessage = streamMsg.toJson();
+    client_->sendTextMessage(jsonMessage);
+
+    SPDLOG_DEBUG("Sent STREAM request: {}", jsonMessage);
+    return true;
+
+  } catch (const std::exception &e) {
+    lastError_ = "Exception in sendStreamRequest: " + std::string(e.what());
+    if (errorHandler_) {
+      errorHandler_->reportError(ErrorHandler::ErrorType::PROTOCOL_ERROR,
+                                 lastError_, "STREAM request", false);
+    }
+    return false;
+  }
+}
+
+bool DownloadManager::processBinaryData(const uint8_t *data, size_t size) {
   try {
-    // Write data to file
-    if (!fileManager_->write(data)) {
+    // Write data to file; a range lands at its own offset
+    bool written = positionalWrites_
+                       ? fileManager_->writeAt(fileOffset_, data, size)
+                       : fileManager_->write(data, size);
+    if (!written) {
       lastError_ = "Failed to write chunk to file";
       if (errorHandler_) {
         errorHandler_->handleFileIOError(lastError_, "Output file");
       }
       return false;
     }
+    downloadChecksums_.update(data, size);
+    fileOffset_ += size;
+
+    // Update progress
+    size_t downloaded = bytesDownloaded_ += size;
 
-    spdlog::debug("Processed {} bytes of binary data", data.size());
+    // Log progress periodically
+    if (downloaded / PROGRESS_LOG_INTERVAL !=
+        (downloaded - size) / PROGRESS_LOG_INTERVAL) {
+      spdlog::info("Downloaded {} bytes", downloaded);
+    }
+
+    SPDLOG_DEBUG("Processed {} bytes of binary data", size);
     return true;
 
   } catch (const std::exception &e) {
@@ -195,22 +562,19 @@ bool DownloadManager::processBinaryData(const std::vector<uint8_t> &data) {
   }
 }
 
-std::vector<uint8_t> DownloadManager::waitForBinaryData(int timeoutMs) {
+bool DownloadManager::waitForResponse(Response &response, int timeoutMs) {
   std::unique_lock<std::mutex> lock(dataMutex_);
 
   // Wait for data or timeout
   auto timeout = std::chrono::milliseconds(timeoutMs);
-  if (dataCondition_.wait_for(lock, timeout, [this] {
-        return !pendingData_.empty() || errorOccurred_;
-      })) {
-    if (errorOccurred_) {
-      return {};
-    }
-    if (!pendingData_.empty()) {
-      std::vector<uint8_t> data = std::move(pendingData_.front());
-      pendingData_.pop();
-      return data;
+  if (dataCondition_.wait_for(lock, timeout,
+                              [this] { return !pendingResponses_.empty(); })) {
+    response = std::move(pendingResponses_.front());
+    pendingResponses_.pop();
+    if (response.isError) {
+      spdlog::debug("Server error: {}", response.error);
     }
+    return true;
   }
 
   // Timeout occurred
@@ -218,31 +582,43 @@ std::vector<uint8_t> DownloadManager::waitForBinaryData(int timeoutMs) {
   if (errorHandler_) {
     errorHandler_->handleTimeoutError(lastError_, timeoutMs);
   }
-  return {};
+  return false;
 }
 
 void DownloadManager::onBinaryDataReceived(const std::vector<uint8_t> &data) {
   std::lock_guard<std::mutex> lock(dataMutex_);
-  pendingData_.push(data);
+  Response response;
+  response.data = data;
+  pendingResponses_.push(std::move(response));
   dataCondition_.notify_one();
-  spdlog::debug("Binary data received: {} bytes", data.size());
+  SPDLOG_DEBUG("Binary data received: {} bytes", data.size());
 }
 
 void DownloadManager::onTextMessageReceived(const std::string &message) {
-  spdlog::debug("Text message received during download: {}", message);
+  SPDLOG_DEBUG("Text message received during download: {}", message);
 
   // Parse as control message to check for errors
   try {
     // Try to parse as error message
     nlohmann::json j = nlohmann::json::parse(message);
-    if (j.contains("type") && j["type"] == "error") {
+    if (j.contains("type") && j["type"] == "STREAMED") {
+      // Ends a range; it arrives after the range's last data frame
+      std::lock_guard<std::mutex> lock(dataMutex_);
+      Response response;
+      response.isStreamEnd = true;
+      response.streamedLength = j.value("length", size_t{0});
+      pendingResponses_.push(std::move(response));
+      dataCondition_.notify_one();
+    } else if (j.contains("type") && j["type"] == "error") {
       std::string errorMsg =
           j.contains("message") ? j["message"] : "Unknown error";
-      lastError_ = "Server error: " + errorMsg;
-      spdlog::error(lastError_);
 
+      // Error frames answer a GET too, so they queue with the data
       std::lock_guard<std::mutex> lock(dataMutex_);
-      errorOccurred_ = true;
+      Response response;
+      response.isError = true;
+      response.error = "Server error: " + errorMsg;
+      pendingResponses_.push(std::move(response));
       dataCondition_.notify_one();
     }
   } catch (...) {
@@ -254,7 +630,7 @@ double DownloadManager::getProgress() const {
   if (totalSize_ == 0) {
     return 0.0;
   }
-  return static_cast<double>(bytesDownloaded_) /
+  return static_cast<double>(bytesDownloaded_.load()) /
          static_cast<double>(totalSize_);
 }
 
@@ -1,7 +1,23 @@
 #include "core/file_manager.h"
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <spdlog/spdlog.h>
 
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace audio_stream {
 
 FileManager::~FileManager() {
@@ -47,25 +63,30 @@ bool FileManager::openForReading(const std::string &filePath) {
 }
 
 size_t FileManager::read(std::vector<uint8_t> &buffer, size_t size) {
+  // Resize buffer to requested size
+  buffer.resize(size);
+
+  size_t bytesRead = read(buffer.data(), size);
+
+  // Resize buffer to actual bytes read
+  buffer.resize(bytesRead);
+  return bytesRead;
+}
+
+size_t FileManager::read(uint8_t *buffer, size_t size) {
   if (!inputFile_ || !inputFile_->is_open()) {
     spdlog::error("File not open for reading");
     return 0;
   }
 
   try {
-    // Resize buffer to requested size
-    buffer.resize(size);
-
     // Read data from file
-    inputFile_->read(reinterpret_cast<char *>(buffer.data()), size);
+    inputFile_->read(reinterpret_cast<char *>(buffer), size);
 
     // Get actual bytes read
     size_t bytesRead = static_cast<size_t>(inputFile_->gcount());
 
-    // Resize buffer to actual bytes read
-    buffer.resize(bytesRead);
-
-    spdlog::debug("Read {} bytes from file", bytesRead);
+    SPDLOG_DEBUG("Read {} bytes from file", bytesRead);
     return bytesRead;
 
   } catch (const std::exception &e) {
@@ -78,6 +99,30 @@ size_t FileManager::readChunk(std::vector<uint8_t> &chunk) {
   return read(chunk, CHUNK_SIZE);
 }
 
+bool FileManager::seek(size_t offset) {
+  if (!inputFile_ || !inputFile_->is_open()) {
+    spdlog::error("File not open for reading");
+    return false;
+  }
+
+  if (offset > fileSize_) {
+    spdlog::error("Cannot seek to {} past end of file ({} bytes)", offset,
+                  fileSize_);
+    return false;
+  }
+
+  // Reaching end of file sets eofbit, which would fail the seek
+  inputFile_->clear();
+  inputFile_->seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+  if (inputFile_->fail()) {
+    spdlog::error("Failed to seek to offset {}", offset);
+    return false;
+  }
+
+  spdlog::debug("Seeked to offset {}", offset);
+  return true;
+}
+
 bool FileManager::hasMoreData() const {
   if (!inputFile_ || !inputFile_->is_open()) {
     return false;
@@ -126,6 +171,10 @@ bool FileManager::openForWriting(const std::string &filePath) {
 }
 
 bool FileManager::write(const std::vector<uint8_t> &data) {
+  return write(data.data(), data.size());
+}
+
+bool FileManager::write(const uint8_t *data, size_t size) {
   if (!outputFile_ || !outputFile_->is_open()) {
     spdlog::error("File not open for writing");
     return false;
@@ -133,19 +182,18 @@ bool FileManager::write(const std::vector<uint8_t> &data) {
 
   try {
     // Write data to file
-    outputFile_->write(reinterpret_cast<const char *>(data.data()),
-                       data.size());
+    outputFile_->write(reinterpret_cast<const char *>(data), size);
 
     // Check for write errors
     if (outputFile_->fail()) {
-      spdlog::error("Failed to write {} bytes to file", data.size());
+      spdlog::error("Failed to write {} bytes to file", size);
       return false;
     }
 
     // Flush to ensure data is written
     outputFile_->flush();
 
-    spdlog::debug("Successfully wrote {} bytes to file", data.size());
+    SPDLOG_DEBUG("Successfully wrote {} bytes to file", size);
     return true;
 
   } catch (const std::exception &e) {
@@ -159,8 +207,114 @@ void FileManager::closeWriter() {
     outputFile_->close();
     outputFile_.reset();
   }
+  if (positionalFile_ != -1) {
+#ifdef _WIN32
+    CloseHandle(reinterpret_cast<HANDLE>(positionalFile_));
+#else
+    ::close(static_cast<int>(positionalFile_));
+#endif
+    positionalFile_ = -1;
+  }
+}
+
+bool FileManager::openForPositionalWriting(const std::string &filePath,
+                                           uint64_t size) {
+  try {
+    spdlog::debug("Opening file for positional writing: {}", filePath);
+    closeWriter();
+
+    std::filesystem::path path(filePath);
+    if (path.has_parent_path()) {
+      std::filesystem::create_directories(path.parent_path());
+    }
+
+#ifdef _WIN32
+    HANDLE handle =
+        CreateFileA(filePath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                    FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+      spdlog::error("Failed to open file for writing: {} (error {})", filePath,
+                    GetLastError());
+      return false;
+    }
+    positionalFile_ = reinterpret_cast<intptr_t>(handle);
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFilePointerEx(handle, end, nullptr, FILE_BEGIN) ||
+        !SetEndOfFile(handle)) {
+      spdlog::error("Failed to size {} to {} bytes (error {})", filePath, size,
+                    GetLastError());
+      closeWriter();
+      return false;
+    }
+#else
+    int fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      spdlog::error("Failed to open file for writing: {} ({})", filePath,
+                    std::strerror(errno));
+      return false;
+    }
+    positionalFile_ = fd;
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      spdlog::error("Failed to size {} to {} bytes ({})", filePath, size,
+                    std::strerror(errno));
+      closeWriter();
+      return false;
+    }
+#endif
+
+    filePath_ = filePath;
+    spdlog::info("Successfully opened file for positional writing: {}",
+                 filePath);
+    return true;
+
+  } catch (const std::exception &e) {
+    spdlog::error("Exception while opening file for writing {}: {}", filePath,
+                  e.what());
+    return false;
+  }
 }
 
+bool FileManager::writeAt(uint64_t offset, const uint8_t *data, size_t size) {
+  if (!isPositionalWriting()) {
+    spdlog::error("File not open for positional writing");
+    return false;
+  }
+
+  while (size > 0) {
+#ifdef _WIN32
+    OVERLAPPED position{};
+    position.Offset = static_cast<DWORD>(offset);
+    position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD request = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+    DWORD written = 0;
+    if (!WriteFile(reinterpret_cast<HANDLE>(positionalFile_), data, request,
+                   &written, &position)) {
+      spdlog::error("Failed to write {} bytes at offset {} (error {})", size,
+                    offset, GetLastError());
+      return false;
+    }
+#else
+    ssize_t written = ::pwrite(static_cast<int>(positionalFile_), data, size,
+                               static_cast<off_t>(offset));
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      spdlog::error("Failed to write {} bytes at offset {} ({})", size, offset,
+                    std::strerror(errno));
+      return false;
+    }
+#endif
+    data += written;
+    offset += static_cast<uint64_t>(written);
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+bool FileManager::isPositionalWriting() const { return positionalFile_ != -1; }
+
 bool FileManager::fileExists(const std::string &filePath) const {
   return std::filesystem::exists(filePath);
 }
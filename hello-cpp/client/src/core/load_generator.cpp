@@ -0,0 +1,784 @@
+#include "core/load_generator.h"
+#include "crc32c.h"
+#include "util/performance_monitor.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iomanip>
+#include <spdlog/spdlog.h>
+#include <sstream>
+
+namespace audio_stream {
+
+namespace {
+
+uint64_t nanosSince(std::chrono::steady_clock::time_point start) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count());
+}
+
+double megabits(uint64_t bytes, std::chrono::nanoseconds elapsed) {
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  return seconds > 0 ? static_cast<double>(bytes) * 8.0 / seconds / 1e6 : 0.0;
+}
+
+} // namespace
+
+void LoadReport::merge(const LoadReport &other) {
+  uploads += other.uploads;
+  downloads += other.downloads;
+  failures += other.failures;
+  refusedStarts += other.refusedStarts;
+  droppedArrivals += other.droppedArrivals;
+  connects += other.connects;
+  connectFailures += other.connectFailures;
+  bytesUploaded += other.bytesUploaded;
+  bytesDownloaded += other.bytesDownloaded;
+  connect.merge(other.connect);
+  upload.merge(other.upload);
+  download.merge(other.download);
+  firstByte.merge(other.firstByte);
+}
+
+double LoadReport::uploadMbps() const {
+  return megabits(bytesUploaded, elapsed);
+}
+
+double LoadReport::downloadMbps() const {
+  return megabits(bytesDownloaded, elapsed);
+}
+
+nlohmann::json LoadReport::toJson() const {
+  return {{"clients", clients},
+          {"threads", threads},
+          {"durationMs",
+           std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)
+               .count()},
+          {"uploads", uploads},
+          {"downloads", downloads},
+          {"failures", failures},
+          {"refusedStarts", refusedStarts},
+          {"droppedArrivals", droppedArrivals},
+          {"connects", connects},
+          {"connectFailures", connectFailures},
+          {"bytesUploaded", bytesUploaded},
+          {"bytesDownloaded", bytesDownloaded},
+          {"uploadMbps", uploadMbps()},
+          {"downloadMbps", downloadMbps()},
+          {"connectUs", PerformanceMonitor::histogramToJson(connect)},
+          {"uploadUs", PerformanceMonitor::histogramToJson(upload)},
+          {"downloadUs", PerformanceMonitor::histogramToJson(download)},
+          {"firstByteUs", PerformanceMonitor::histogramToJson(firstByte)}};
+}
+
+std::string LoadReport::format() const {
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(2);
+  oss << "=== Load Test Report ===\n";
+  oss << "Clients: " << clients << " on " << threads << " threads over "
+      << std::chrono::duration<double>(elapsed).count() << " s\n";
+  oss << "Sessions: " << uploads << " uploads, " << downloads
+      << " downloads, " << failures << " failed";
+  if (droppedArrivals > 0) {
+    oss << ", " << droppedArrivals << " arrivals dropped (all clients busy)";
+  }
+  if (refusedStarts > 0) {
+    oss << ", " << refusedStarts << " STARTs refused for load";
+  }
+  oss << "\n";
+  oss << "Connections: " << connects << " opened, " << connectFailures
+      << " failed\n";
+  oss << "Upload: " << bytesUploaded / (1024.0 * 1024.0) << " MB, "
+      << uploadMbps() << " Mbps\n";
+  oss << "Download: " << bytesDownloaded / (1024.0 * 1024.0) << " MB, "
+      << downloadMbps() << " Mbps\n";
+  oss << "Connect: " << PerformanceMonitor::formatLatencies(connect) << "\n";
+  oss << "Upload session: " << PerformanceMonitor::formatLatencies(upload)
+      << "\n";
+  oss << "Download session: " << PerformanceMonitor::formatLatencies(download)
+      << "\n";
+  oss << "First byte: " << PerformanceMonitor::formatLatencies(firstByte)
+      << "\n";
+  oss << "========================\n";
+  return oss.str();
+}
+
+LoadGenerator::LoadGenerator(LoadConfig config) : config_(std::move(config)) {
+  config_.clients = std::max<size_t>(config_.clients, 1);
+  config_.threads = std::clamp<size_t>(config_.threads, 1, config_.clients);
+  config_.downloadWindow = std::max<size_t>(config_.downloadWindow, 1);
+  if (config_.fileSizes.empty()) {
+    config_.fileSizes.push_back(CHUNK_SIZE);
+  }
+}
+
+LoadGenerator::~LoadGenerator() {
+  // run() normally stops the workers; this covers it throwing midway
+  for (auto &worker : workers_) {
+    if (worker->thread.joinable()) {
+      worker->endpoint.stop();
+      worker->thread.join();
+    }
+  }
+}
+
+LoadReport LoadGenerator::run() {
+  std::mt19937_64 random(std::random_device{}());
+  size_t largest =
+      *std::max_element(config_.fileSizes.begin(), config_.fileSizes.end());
+  payload_.resize(largest);
+  for (size_t i = 0; i < payload_.size(); i += sizeof(uint64_t)) {
+    uint64_t value = random();
+    std::memcpy(payload_.data() + i, &value,
+                std::min(sizeof(value), payload_.size() - i));
+  }
+  runStamp_ = static_cast<uint64_t>(
+      std::chrono::system_clock::now().time_since_epoch().count());
+
+  for (size_t w = 0; w < config_.threads; ++w) {
+    auto worker = std::make_unique<Worker>();
+    worker->index = w;
+    worker->random.seed(random());
+    worker->endpoint.init_asio();
+    worker->endpoint.clear_access_channels(websocketpp::log::alevel::all);
+    worker->endpoint.clear_error_channels(websocketpp::log::elevel::all);
+    worker->endpoint.start_perpetual();
+    workers_.push_back(std::move(worker));
+  }
+  for (size_t c = 0; c < config_.clients; ++c) {
+    Worker &worker = *workers_[c % workers_.size()];
+    auto client = std::make_unique<VirtualClient>();
+    client->id = c;
+    client->worker = &worker;
+    worker.idle.push_back(client.get());
+    worker.clients.push_back(std::move(client));
+  }
+  for (auto &worker : workers_) {
+    Worker *w = worker.get();
+    w->thread = std::thread([w]() {
+      try {
+        w->endpoint.run();
+      } catch (const std::exception &e) {
+        spdlog::error("Load worker {} stopped: {}", w->index, e.what());
+      }
+      w->finished = true;
+    });
+  }
+
+  spdlog::info("Load test: {} clients on {} threads for {} s against {}",
+               config_.clients, config_.threads, config_.duration.count(),
+               config_.serverUri);
+  if (config_.arrivalRate > 0) {
+    spdlog::info("Open loop: {} sessions/s, {}% downloads",
+                 config_.arrivalRate, config_.downloadFraction * 100);
+  } else {
+    spdlog::info("Closed loop, {}% downloads",
+                 config_.downloadFraction * 100);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + config_.duration;
+  if (config_.arrivalRate > 0) {
+    runArrivals(start, deadline);
+  } else {
+    for (auto &worker : workers_) {
+      Worker *w = worker.get();
+      websocketpp::lib::asio::post(w->endpoint.get_io_service(), [this, w]() {
+        for (auto &client : w->clients) {
+          VirtualClient *c = client.get();
+          long delayMs = static_cast<long>(config_.rampUp.count() *
+                                           static_cast<long>(c->id) /
+                                           static_cast<long>(config_.clients));
+          w->endpoint.set_timer(
+              delayMs, [this, c](const websocketpp::lib::error_code &ec) {
+                if (!ec) {
+                  startSession(*c);
+                }
+              });
+        }
+      });
+    }
+    while (std::chrono::steady_clock::now() < deadline) {
+      auto remaining = deadline - std::chrono::steady_clock::now();
+      std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(
+          remaining, PROGRESS_LOG_INTERVAL));
+      logProgress(start);
+    }
+  }
+
+  // No new sessions; let those in progress finish
+  stopping_ = true;
+  auto drainDeadline =
+      std::chrono::steady_clock::now() + config_.sessionTimeout;
+  auto sessionsActive = [this]() {
+    size_t active = 0;
+    for (const auto &worker : workers_) {
+      active += worker->active.load();
+    }
+    return active;
+  };
+  while (sessionsActive() > 0 &&
+         std::chrono::steady_clock::now() < drainDeadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  LoadReport report;
+  report.elapsed = std::chrono::steady_clock::now() - start;
+  shutdown();
+
+  report.clients = config_.clients;
+  report.threads = config_.threads;
+  for (const auto &worker : workers_) {
+    report.merge(worker->report);
+  }
+  report.droppedArrivals += droppedArrivals_.load();
+  return report;
+}
+
+void LoadGenerator::runArrivals(
+    std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point deadline) {
+  std::mt19937_64 random(std::random_device{}());
+  std::exponential_distribution<double> gap(config_.arrivalRate);
+  auto next = start;
+  auto nextLog = start + PROGRESS_LOG_INTERVAL;
+  size_t turn = 0;
+
+  while (true) {
+    next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(gap(random)));
+    while (nextLog <= std::min(next, deadline)) {
+      std::this_thread::sleep_until(nextLog);
+      logProgress(start);
+      nextLog += PROGRESS_LOG_INTERVAL;
+    }
+    if (next >= deadline) {
+      break;
+    }
+    std::this_thread::sleep_until(next);
+
+    // Workers take arrivals in turn; an arrival nobody is free for is lost,
+    // as it would be for a server at capacity
+    Worker *w = workers_[turn++ % workers_.size()].get();
+    websocketpp::lib::asio::post(w->endpoint.get_io_service(), [this, w]() {
+      if (w->idle.empty()) {
+        ++droppedArrivals_;
+        return;
+      }
+      VirtualClient *client = w->idle.back();
+      w->idle.pop_back();
+      startSession(*client);
+    });
+  }
+  std::this_thread::sleep_until(deadline);
+}
+
+void LoadGenerator::logProgress(
+    std::chrono::steady_clock::time_point start) const {
+  uint64_t bytes = 0;
+  uint64_t sessions = 0;
+  size_t active = 0;
+  size_t connections = 0;
+  for (const auto &worker : workers_) {
+    bytes += worker->bytes.load(std::memory_order_relaxed);
+    sessions += worker->sessions.load(std::memory_order_relaxed);
+    active += worker->active.load(std::memory_order_relaxed);
+    connections += worker->connections.load(std::memory_order_relaxed);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  spdlog::info("Load: {:.0f} s, {} sessions done, {} active, {} connections, "
+               "{:.1f} Mbps",
+               std::chrono::duration<double>(elapsed).count(), sessions,
+               active, connections, megabits(bytes, elapsed));
+}
+
+void LoadGenerator::shutdown() {
+  stopping_ = true;
+  for (auto &worker : workers_) {
+    Worker *w = worker.get();
+    websocketpp::lib::asio::post(w->endpoint.get_io_service(), [this, w]() {
+      for (auto &client : w->clients) {
+        if (client->timeout) {
+          client->timeout->cancel();
+          client->timeout.reset();
+        }
+        // Sessions still running after the drain are abandoned, not failed
+        if (client->phase != Phase::IDLE) {
+          client->phase = Phase::IDLE;
+          --w->active;
+        }
+        closeConnection(*client);
+      }
+    });
+    w->endpoint.stop_perpetual();
+  }
+
+  // Closing handshakes normally end each loop; stop those that linger
+  auto stopDeadline = std::chrono::steady_clock::now() + SHUTDOWN_TIMEOUT;
+  for (auto &worker : workers_) {
+    while (!worker->finished &&
+           std::chrono::steady_clock::now() < stopDeadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (!worker->finished) {
+      worker->endpoint.stop();
+    }
+    worker->thread.join();
+  }
+}
+
+void LoadGenerator::startSession(VirtualClient &client) {
+  if (stopping_) {
+    return;
+  }
+  Worker &worker = *client.worker;
+  ++client.session;
+  ++worker.active;
+
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  client.download = unit(worker.random) < config_.downloadFraction;
+
+  uint64_t session = client.session;
+  VirtualClient *c = &client;
+  client.timeout = worker.endpoint.set_timer(
+      static_cast<long>(config_.sessionTimeout.count()),
+      [this, c, session](const websocketpp::lib::error_code &ec) {
+        if (!ec && c->session == session && c->phase != Phase::IDLE) {
+          failSession(*c, "timed out");
+        }
+      });
+
+  if (client.open) {
+    beginTransfer(client);
+  } else {
+    connect(client);
+  }
+}
+
+void LoadGenerator::connect(VirtualClient &client) {
+  Worker &worker = *client.worker;
+  websocketpp::lib::error_code ec;
+  auto connection = worker.endpoint.get_connection(config_.serverUri, ec);
+  if (ec) {
+    client.phase = Phase::CONNECTING;
+    failSession(client, "connection setup: " + ec.message());
+    return;
+  }
+
+  uint64_t generation = ++client.generation;
+  VirtualClient *c = &client;
+  connection->set_open_handler([this, c, generation](ConnectionHdl hdl) {
+    onOpen(*c, generation, hdl);
+  });
+  connection->set_fail_handler(
+      [this, c, generation](ConnectionHdl) { onFail(*c, generation); });
+  connection->set_close_handler(
+      [this, c, generation](ConnectionHdl) { onClose(*c, generation); });
+  connection->set_message_handler(
+      [this, c, generation](ConnectionHdl,
+                            WebSocketClient_t::message_ptr message) {
+        onMessage(*c, generation, message);
+      });
+
+  client.connection = connection;
+  client.phase = Phase::CONNECTING;
+  client.connectStart = std::chrono::steady_clock::now();
+  ++worker.report.connects;
+  worker.endpoint.connect(connection);
+}
+
+void LoadGenerator::onOpen(VirtualClient &client, uint64_t generation,
+                           ConnectionHdl hdl) {
+  Worker &worker = *client.worker;
+  if (generation != client.generation) {
+    // Given up on while connecting; it is of no use now
+    websocketpp::lib::error_code ec;
+    worker.endpoint.close(hdl, websocketpp::close::status::normal, "", ec);
+    return;
+  }
+  client.open = true;
+  ++worker.connections;
+  client.sessionsOnConnection = 0;
+  worker.report.connect.record(nanosSince(client.connectStart));
+  if (client.phase == Phase::CONNECTING) {
+    beginTransfer(client);
+  }
+}
+
+void LoadGenerator::onFail(VirtualClient &client, uint64_t generation) {
+  if (generation != client.generation) {
+    return;
+  }
+  ++client.worker->report.connectFailures;
+  client.connection.reset();
+  failSession(client, "connect failed");
+}
+
+void LoadGenerator::onClose(VirtualClient &client, uint64_t generation) {
+  if (generation != client.generation) {
+    return;
+  }
+  if (client.open) {
+    client.open = false;
+    --client.worker->connections;
+  }
+  client.connection.reset();
+  failSession(client, "connection closed by server");
+}
+
+void LoadGenerator::beginTransfer(VirtualClient &client) {
+  if (client.download && pickStream(*client.worker, client.stream)) {
+    beginDownload(client);
+  } else {
+    // Nothing uploaded yet to download
+    client.download = false;
+    beginUpload(client);
+  }
+}
+
+void LoadGenerator::beginUpload(VirtualClient &client) {
+  Worker &worker = *client.worker;
+  std::uniform_int_distribution<size_t> pick(0, config_.fileSizes.size() - 1);
+  // Short IDs are random; the suffix keeps thousands of them unique
+  client.stream.streamId = worker.ids.generateShortWithPrefix("load") + "-" +
+                           std::to_string(client.id) + "-" +
+                           std::to_string(client.session);
+  client.stream.size = config_.fileSizes[pick(worker.random)];
+  client.transferred = 0;
+  client.crc = 0;
+  client.phase = Phase::STARTING;
+  client.transferStart = std::chrono::steady_clock::now();
+  sendStart(client);
+}
+
+void LoadGenerator::sendStart(VirtualClient &client) {
+  nlohmann::json start;
+  start["type"] = "START";
+  start["streamId"] = client.stream.streamId;
+  start["chunkSize"] = config_.chunkSize;
+  sendText(client, start.dump());
+}
+
+void LoadGenerator::sendChunks(VirtualClient &client) {
+  Worker &worker = *client.worker;
+  size_t chunkSize = client.stream.chunkSize;
+  size_t highWater = SEND_HIGH_WATER_CHUNKS * chunkSize;
+
+  while (client.transferred < client.stream.size) {
+    if (client.connection->get_buffered_amount() >= highWater) {
+      // No callback on drain; look again shortly
+      uint64_t session = client.session;
+      VirtualClient *c = &client;
+      worker.endpoint.set_timer(
+          SEND_POLL_MS,
+          [this, c, session](const websocketpp::lib::error_code &ec) {
+            if (!ec && c->session == session &&
+                c->phase == Phase::UPLOADING) {
+              sendChunks(*c);
+            }
+          });
+      return;
+    }
+
+    size_t length =
+        std::min(chunkSize, client.stream.size - client.transferred);
+    const uint8_t *data = payload_.data() + client.transferred;
+    if (client.transferred == 0) {
+      // Stamp the run, client and session so the server sees (and
+      // deduplicates) no two uploads as equal
+      worker.stamped.assign(data, data + length);
+      uint64_t stamp[3] = {runStamp_, client.id, client.session};
+      std::memcpy(worker.stamped.data(), stamp,
+                  std::min(length, sizeof(stamp)));
+      data = worker.stamped.data();
+    }
+    client.crc = crc32c::extend(client.crc, data, length);
+
+    websocketpp::lib::error_code ec = client.connection->send(
+        data, length, websocketpp::frame::opcode::binary);
+    if (ec) {
+      failSession(client, "send chunk: " + ec.message());
+      return;
+    }
+    client.transferred += length;
+    worker.bytes.fetch_add(length, std::memory_order_relaxed);
+  }
+
+  nlohmann::json stop;
+  stop["type"] = "STOP";
+  stop["streamId"] = client.stream.streamId;
+  client.phase = Phase::STOPPING;
+  sendText(client, stop.dump());
+}
+
+void LoadGenerator::beginDownload(VirtualClient &client) {
+  client.transferred = 0;
+  client.received = 0;
+  client.crc = 0;
+  client.inFlight.clear();
+  client.phase = Phase::DOWNLOADING;
+  client.transferStart = std::chrono::steady_clock::now();
+  sendGets(client);
+}
+
+void LoadGenerator::sendGets(VirtualClient &client) {
+  while (client.inFlight.size() < config_.downloadWindow &&
+         client.transferred < client.stream.size) {
+    size_t length = std::min(client.stream.chunkSize,
+                             client.stream.size - client.transferred);
+    GetMessage get(client.stream.streamId,
+                   static_cast<int64_t>(client.transferred),
+                   static_cast<int64_t>(length));
+    if (!sendText(client, get.toJson())) {
+      return;
+    }
+    client.inFlight.push_back(length);
+    client.transferred += length;
+  }
+}
+
+void LoadGenerator::onMessage(VirtualClient &client, uint64_t generation,
+                              WebSocketClient_t::message_ptr message) {
+  if (generation != client.generation) {
+    return;
+  }
+  if (message->get_opcode() == websocketpp::frame::opcode::text) {
+    onControlReply(client, message->get_payload());
+  } else if (client.phase == Phase::DOWNLOADING) {
+    onGetReply(client, message->get_payload());
+  } else {
+    failSession(client, "unexpected binary message");
+  }
+}
+
+void LoadGenerator::onControlReply(VirtualClient &client,
+                                   const std::string &text) {
+  Worker &worker = *client.worker;
+  try {
+    nlohmann::json reply = nlohmann::json::parse(text);
+    std::string type = reply.value("type", "");
+
+    if (type == "STARTED" && client.phase == Phase::STARTING) {
+      // Servers without negotiation only promise the default size
+      client.stream.chunkSize = reply.value("chunkSize", CHUNK_SIZE);
+      if (client.stream.chunkSize == 0) {
+        client.stream.chunkSize = CHUNK_SIZE;
+      }
+      client.phase = Phase::UPLOADING;
+      sendChunks(client);
+    } else if (type == "STOPPED" && client.phase == Phase::STOPPING) {
+      std::string stored = reply.value("crc32c", "");
+      if (!stored.empty() && stored != crc32c::toHex(client.crc)) {
+        failSession(client, "server stored CRC32C " + stored +
+                                ", upload has " + crc32c::toHex(client.crc));
+        return;
+      }
+      worker.report.upload.record(nanosSince(client.transferStart));
+      ++worker.report.uploads;
+      worker.report.bytesUploaded += client.stream.size;
+      client.stream.crc = client.crc;
+      storeStream(worker, client.stream);
+      finishSession(client);
+    } else if ((type == "ERROR" || type == "error") &&
+               client.phase == Phase::STARTING &&
+               reply.value("retryAfterMs", 0L) > 0) {
+      // Refused for load: the upload's time includes the wait
+      ++worker.report.refusedStarts;
+      long delayMs = std::min(reply.value("retryAfterMs", 0L),
+                              MAX_RETRY_AFTER_MS);
+      uint64_t session = client.session;
+      VirtualClient *c = &client;
+      worker.endpoint.set_timer(
+          delayMs, [this, c, session](const websocketpp::lib::error_code &ec) {
+            if (!ec && c->session == session &&
+                c->phase == Phase::STARTING) {
+              sendStart(*c);
+            }
+          });
+    } else if (type == "ERROR" || type == "error") {
+      failSession(client, "server error: " + reply.value("message", ""));
+    }
+    // Anything else is informational
+  } catch (const std::exception &e) {
+    failSession(client, std::string("bad reply: ") + e.what());
+  }
+}
+
+void LoadGenerator::onGetReply(VirtualClient &client,
+                               const std::string &payload) {
+  // The server answers a connection's GETs in order, so the oldest one is
+  // being answered
+  if (client.inFlight.empty() || payload.size() != client.inFlight.front()) {
+    failSession(client, "GET reply of " + std::to_string(payload.size()) +
+                            " bytes, expected " +
+                            std::to_string(client.inFlight.empty()
+                                               ? 0
+                                               : client.inFlight.front()));
+    return;
+  }
+
+  Worker &worker = *client.worker;
+  if (client.received == 0) {
+    worker.report.firstByte.record(nanosSince(client.transferStart));
+  }
+  client.inFlight.pop_front();
+  client.crc = crc32c::extend(
+      client.crc, reinterpret_cast<const uint8_t *>(payload.data()),
+      payload.size());
+  client.received += payload.size();
+  worker.bytes.fetch_add(payload.size(), std::memory_order_relaxed);
+
+  if (client.received < client.stream.size) {
+    sendGets(client);
+    return;
+  }
+
+  if (client.crc != client.stream.crc) {
+    failSession(client, "downloaded CRC32C " + crc32c::toHex(client.crc) +
+                            ", uploaded " + crc32c::toHex(client.stream.crc));
+    return;
+  }
+  worker.report.download.record(nanosSince(client.transferStart));
+  ++worker.report.downloads;
+  worker.report.bytesDownloaded += client.stream.size;
+  finishSession(client);
+}
+
+bool LoadGenerator::sendText(VirtualClient &client, const std::string &text) {
+  websocketpp::lib::error_code ec =
+      client.connection->send(text, websocketpp::frame::opcode::text);
+  if (ec) {
+    failSession(client, "send: " + ec.message());
+    return false;
+  }
+  return true;
+}
+
+void LoadGenerator::finishSession(VirtualClient &client) {
+  ++client.sessionsOnConnection;
+  if (config_.sessionsPerConnection > 0 &&
+      client.sessionsOnConnection >= config_.sessionsPerConnection) {
+    closeConnection(client);
+  }
+  endSession(client, 0);
+}
+
+void LoadGenerator::failSession(VirtualClient &client,
+                                const std::string &reason) {
+  if (client.phase == Phase::IDLE) {
+    return;
+  }
+  spdlog::debug("Virtual client {} session {} failed: {}", client.id,
+                client.session, reason);
+  ++client.worker->report.failures;
+  // The connection's protocol state is unknown; the next session starts
+  // on a new one, after a pause so a failing server is not hammered
+  closeConnection(client);
+  endSession(client, FAILURE_BACKOFF_MS);
+}
+
+void LoadGenerator::endSession(VirtualClient &client,
+                               long nextSessionDelayMs) {
+  Worker &worker = *client.worker;
+  if (client.timeout) {
+    client.timeout->cancel();
+    client.timeout.reset();
+  }
+  client.phase = Phase::IDLE;
+  client.inFlight.clear();
+  ++worker.sessions;
+  --worker.active;
+
+  if (config_.arrivalRate > 0) {
+    worker.idle.push_back(&client);
+    return;
+  }
+  if (stopping_) {
+    return;
+  }
+  // Not directly: a session that fails at once would recurse
+  VirtualClient *c = &client;
+  worker.endpoint.set_timer(
+      nextSessionDelayMs, [this, c](const websocketpp::lib::error_code &ec) {
+        if (!ec) {
+          startSession(*c);
+        }
+      });
+}
+
+void LoadGenerator::closeConnection(VirtualClient &client) {
+  ++client.generation; // Its remaining callbacks are ignored
+  if (client.open) {
+    client.open = false;
+    --client.worker->connections;
+  }
+  if (client.connection) {
+    websocketpp::lib::error_code ec;
+    client.connection->close(websocketpp::close::status::normal, "", ec);
+    client.connection.reset();
+  }
+}
+
+void LoadGenerator::storeStream(Worker &worker, const StoredStream &stream) {
+  std::lock_guard<std::mutex> lock(streamsMutex_);
+  if (streams_.size() < MAX_STORED_STREAMS) {
+    streams_.push_back(stream);
+    return;
+  }
+  std::uniform_int_distribution<size_t> pick(0, streams_.size() - 1);
+  streams_[pick(worker.random)] = stream;
+}
+
+bool LoadGenerator::pickStream(Worker &worker, StoredStream &stream) {
+  std::lock_guard<std::mutex> lock(streamsMutex_);
+  if (streams_.empty()) {
+    return false;
+  }
+  std::uniform_int_distribution<size_t> pick(0, streams_.size() - 1);
+  stream = streams_[pick(worker.random)];
+  return true;
+}
+
+bool LoadGenerator::parseSizes(const std::string &text,
+                               std::vector<size_t> &sizes) {
+  std::vector<size_t> parsed;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (item.empty() || !std::isdigit(static_cast<unsigned char>(item[0]))) {
+      return false;
+    }
+    size_t end = 0;
+    uint64_t value = 0;
+    try {
+      value = std::stoull(item, &end);
+    } catch (const std::exception &) {
+      return false;
+    }
+
+    std::string suffix = item.substr(end);
+    uint64_t scale = 1;
+    if (suffix == "K" || suffix == "k") {
+      scale = 1024;
+    } else if (suffix == "M" || suffix == "m") {
+      scale = 1024 * 1024;
+    } else if (suffix == "G" || suffix == "g") {
+      scale = 1024 * 1024 * 1024;
+    } else if (!suffix.empty()) {
+      return false;
+    }
+    if (value == 0) {
+      return false;
+    }
+    parsed.push_back(static_cast<size_t>(value * scale));
+  }
+  if (parsed.empty()) {
+    return false;
+  }
+  sizes = std::move(parsed);
+  return true;
+}
+
+} // namespace audio_stream
@@ -0,0 +1,275 @@
+#include "core/parallel_transfer.h"
+#include "core/chunk_manager.h"
+#include "crc32c.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <thread>
+
+namespace audio_stream {
+
+ParallelTransfer::ParallelTransfer(const std::string &uri, size_t connections,
+                                   std::shared_ptr<ErrorHandler> errorHandler)
+    : uri_(uri), maxConnections_(connections > 0 ? connections : 1),
+      errorHandler_(errorHandler),
+      fileManager_(std::make_shared<FileManager>()) {}
+
+ParallelTransfer::~ParallelTransfer() {
+  for (std::thread &worker : uploadWorkers_) {
+    worker.join();
+  }
+}
+
+bool ParallelTransfer::download(const std::string &streamId,
+                                const std::string &outputPath, size_t size) {
+  connections_.clear();
+  checksum_ = 0;
+  lastError_.clear();
+
+  // Every connection gets at least one block; the last range may be short
+  size_t blocks = (size + RANGE_ALIGNMENT - 1) / RANGE_ALIGNMENT;
+  size_t count = std::max<size_t>(1, std::min(maxConnections_, blocks));
+  size_t rangeSize = (blocks + count - 1) / count * RANGE_ALIGNMENT;
+
+  spdlog::info("Starting parallel download: streamId={}, outputPath={}, "
+               "size={}, connections={}",
+               streamId, outputPath, size, count);
+
+  if (!fileManager_->openForPositionalWriting(outputPath, size)) {
+    lastError_ = "Failed to open output file: " + outputPath;
+    if (errorHandler_) {
+      errorHandler_->handleFileIOError(lastError_, outputPath);
+    }
+    return false;
+  }
+
+  for (size_t begin = 0; connections_.empty() || begin < size;
+       begin += rangeSize) {
+    Connection connection;
+    connection.client = std::make_shared<WebSocketClient>(uri_);
+    connection.client->setBinaryProtocol(binaryProtocol_);
+    connection.client->setCompression(compression_);
+    connection.downloadManager = std::make_shared<DownloadManager>(
+        connection.client, fileManager_, std::make_shared<ChunkManager>(),
+        errorHandler_);
+    if (downloadSetup_) {
+      downloadSetup_(*connection.downloadManager);
+    }
+    std::weak_ptr<DownloadManager> manager = connection.downloadManager;
+    connection.client->setOnMessage([manager](const std::string &message) {
+      if (auto downloadManager = manager.lock()) {
+        downloadManager->handleServerResponse(message);
+      }
+    });
+    connection.begin = begin;
+    connection.end = std::min(size, begin + rangeSize);
+    connections_.push_back(std::move(connection));
+  }
+
+  // Report combined progress while the connections run
+  std::mutex doneMutex;
+  std::condition_variable doneCondition;
+  size_t running = connections_.size();
+  std::vector<std::thread> workers;
+  for (Connection &connection : connections_) {
+    workers.emplace_back([&, streamId] {
+      connection.succeeded = runConnection(connection, streamId);
+      std::lock_guard<std::mutex> lock(doneMutex);
+      --running;
+      doneCondition.notify_one();
+    });
+  }
+  {
+    std::unique_lock<std::mutex> lock(doneMutex);
+    while (!doneCondition.wait_for(lock, PROGRESS_LOG_INTERVAL,
+                                   [&] { return running == 0; })) {
+      spdlog::info("Downloaded {} of {} bytes over {} connections",
+                   getBytesDownloaded(), size, connections_.size());
+    }
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  fileManager_->closeWriter();
+
+  // Ranges are in file order, so their checksums chain into the file's
+  for (const Connection &connection : connections_) {
+    if (!connection.succeeded) {
+      lastError_ = "Range " + std::to_string(connection.begin) + "-" +
+                   std::to_string(connection.end) +
+                   " failed: " + connection.error;
+      spdlog::error("Parallel download failed: {}", lastError_);
+      return false;
+    }
+    checksum_ = crc32c::combine(
+        checksum_, connection.downloadManager->getChecksums().getChecksum(),
+        connection.end - connection.begin);
+  }
+
+  spdlog::info("Parallel download completed: {} bytes over {} connections",
+               getBytesDownloaded(), connections_.size());
+  return true;
+}
+
+uint64_t ParallelTransfer::startUpload(const std::string &streamId,
+                                       const std::string &filePath,
+                                       uint64_t size) {
+  for (std::thread &worker : uploadWorkers_) {
+    worker.join(); // Of an upload never finished
+  }
+  uploadWorkers_.clear();
+  uploads_.clear();
+  lastError_.clear();
+  uploadSize_ = size;
+
+  // Split like a download; the caller keeps the first range
+  uint64_t blocks = (size + RANGE_ALIGNMENT - 1) / RANGE_ALIGNMENT;
+  uint64_t count = std::min<uint64_t>(maxConnections_, blocks);
+  if (count < 2) {
+    return size;
+  }
+  uint64_t rangeSize = (blocks + count - 1) / count * RANGE_ALIGNMENT;
+
+  spdlog::info("Starting parallel upload: streamId={}, filePath={}, "
+               "size={}, connections={}",
+               streamId, filePath, size, count);
+
+  for (uint64_t begin = rangeSize; begin < size; begin += rangeSize) {
+    Upload upload;
+    upload.client = std::make_shared<WebSocketClient>(uri_);
+    upload.client->setBinaryProtocol(binaryProtocol_);
+    upload.client->setCompression(compression_);
+    upload.uploadManager =
+        std::make_shared<UploadManager>(upload.client, errorHandler_);
+    if (uploadSetup_) {
+      uploadSetup_(*upload.uploadManager);
+    }
+    std::weak_ptr<UploadManager> manager = upload.uploadManager;
+    upload.client->setOnMessage([manager](const std::string &message) {
+      if (auto uploadManager = manager.lock()) {
+        uploadManager->handleServerResponse(message);
+      }
+    });
+    upload.begin = begin;
+    upload.end = std::min(size, begin + rangeSize);
+    upload.sent = std::make_shared<std::atomic<uint64_t>>(0);
+    upload.uploadManager->setProgressCallback(
+        [sent = upload.sent, begin](size_t offset, size_t) {
+          sent->store(offset - begin, std::memory_order_relaxed);
+        });
+    uploads_.push_back(std::move(upload));
+  }
+
+  // uploads_ is left alone until finishUpload has joined these
+  uploadsRunning_ = uploads_.size();
+  for (Upload &upload : uploads_) {
+    uploadWorkers_.emplace_back([this, &upload, streamId, filePath] {
+      upload.succeeded = runUpload(upload, streamId, filePath);
+      std::lock_guard<std::mutex> lock(uploadMutex_);
+      --uploadsRunning_;
+      uploadDone_.notify_one();
+    });
+  }
+  return rangeSize;
+}
+
+bool ParallelTransfer::finishUpload(BlockChecksums &checksums) {
+  {
+    std::unique_lock<std::mutex> lock(uploadMutex_);
+    while (!uploadDone_.wait_for(lock, PROGRESS_LOG_INTERVAL,
+                                 [this] { return uploadsRunning_ == 0; })) {
+      spdlog::info("Uploaded {} of {} bytes on {} attached connections",
+                   getBytesUploaded(), uploadSize_ - uploads_.front().begin,
+                   uploads_.size());
+    }
+  }
+  for (std::thread &worker : uploadWorkers_) {
+    worker.join();
+  }
+  uploadWorkers_.clear();
+
+  // Ranges are in file order, so their block lists follow the caller's
+  for (const Upload &upload : uploads_) {
+    if (!upload.succeeded) {
+      lastError_ = "Range " + std::to_string(upload.begin) + "-" +
+                   std::to_string(upload.end) + " failed: " + upload.error;
+      spdlog::error("Parallel upload failed: {}", lastError_);
+      return false;
+    }
+    if (!checksums.append(upload.uploadManager->getUploadChecksums())) {
+      lastError_ = "Range " + std::to_string(upload.begin) + "-" +
+                   std::to_string(upload.end) +
+                   " does not follow the bytes before it";
+      spdlog::error("Parallel upload failed: {}", lastError_);
+      return false;
+    }
+  }
+
+  if (!uploads_.empty()) {
+    spdlog::info("Parallel upload: {} bytes written on {} attached "
+                 "connections",
+                 getBytesUploaded(), uploads_.size());
+  }
+  return true;
+}
+
+uint64_t ParallelTransfer::getBytesUploaded() const {
+  uint64_t total = 0;
+  for (const Upload &upload : uploads_) {
+    total += upload.sent->load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+size_t ParallelTransfer::getBytesDownloaded() const {
+  size_t total = 0;
+  for (const Connection &connection : connections_) {
+    total += connection.downloadManager->getBytesDownloaded();
+  }
+  return total;
+}
+
+bool ParallelTransfer::runConnection(Connection &connection,
+                                     const std::string &streamId) {
+  if (!connection.client->connectWithRetry(DEFAULT_MAX_RETRIES)) {
+    connection.error = "Failed to connect to " + uri_;
+    if (errorHandler_) {
+      errorHandler_->reportError(ErrorHandler::ErrorType::CONNECTION_ERROR,
+                                 "Failed to connect for a parallel range",
+                                 uri_, false);
+    }
+    return false;
+  }
+
+  bool received = connection.downloadManager->downloadRange(
+      streamId, connection.begin, connection.end);
+  connection.client->disconnect();
+  if (!received) {
+    connection.error = connection.downloadManager->getLastError();
+  }
+  return received;
+}
+
+bool ParallelTransfer::runUpload(Upload &upload, const std::string &streamId,
+                                 const std::string &filePath) {
+  if (!upload.client->connectWithRetry(DEFAULT_MAX_RETRIES)) {
+    upload.error = "Failed to connect to " + uri_;
+    if (errorHandler_) {
+      errorHandler_->reportError(ErrorHandler::ErrorType::CONNECTION_ERROR,
+                                 "Failed to connect for a parallel range",
+                                 uri_, false);
+    }
+    return false;
+  }
+
+  bool sent = upload.uploadManager->uploadRange(streamId, filePath,
+                                                upload.begin, upload.end);
+  upload.client->disconnect();
+  if (!sent) {
+    upload.error = "not written in full";
+  }
+  return sent;
+}
+
+} // namespace audio_stream
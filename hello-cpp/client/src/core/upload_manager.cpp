@@ -1,17 +1,30 @@
 #include "core/upload_manager.h"
 #include "../../include/common_types.h"
+#include "core/parallel_transfer.h"
+#include "util/chunk_ring.h"
 #include "util/performance_monitor.h"
+#include "crc32c.h"
+#include "logging.h"
+#include "sha256.h"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <deque>
 #include <nlohmann/json.hpp>
+#include <optional>
 #include <spdlog/spdlog.h>
 #include <thread>
+#include <vector>
 
 namespace audio_stream {
 
 UploadManager::UploadManager(std::shared_ptr<WebSocketClient> client,
                              std::shared_ptr<ErrorHandler> errorHandler)
-    : client_(client), errorHandler_(errorHandler), responseReceived_(false),
-      responseTimeoutMs_(5000) {
+    : client_(client), errorHandler_(errorHandler),
+      performanceMonitor_(std::make_shared<PerformanceMonitor>()),
+      requestedChunkSize_(CHUNK_SIZE), adaptiveChunkSize_(true),
+      responseTimeoutMs_(5000),
+      maxResumeAttempts_(DEFAULT_MAX_RESUME_ATTEMPTS) {
   // Message handling is now done by main.cpp message router
 }
 
@@ -26,6 +39,7 @@ std::string UploadManager::uploadFile(const std::string &filePath) {
     }
     return "";
   }
+  size_t fileSize = fileManager_.getFileSize();
   fileManager_.closeReader(); // Close immediately, will reopen later
 
   // Generate unique stream ID (using short UUID format like Java)
@@ -33,11 +47,38 @@ std::string UploadManager::uploadFile(const std::string &filePath) {
   spdlog::info("Generated stream ID: {}", currentStreamId_);
 
   // Start performance monitoring
-  performanceMonitor_.startUpload();
+  performanceMonitor_->startUpload();
 
   try {
-    // Step 1: Send START message
-    if (!sendStartMessage(currentStreamId_)) {
+    // Small files in one round trip, if the server takes PUT
+    if (putThreshold_ > 0 && fileSize <= putThreshold_ &&
+        serverTakesPut(fileSize)) {
+      PutResult put = putFile(filePath, fileSize);
+      for (int retries = 0; put == PutResult::FAILED && waitToRetry(retries);) {
+        put = putFile(filePath, fileSize);
+      }
+      if (put == PutResult::STORED) {
+        performanceMonitor_->endUpload(fileSize);
+        spdlog::info("Successfully uploaded file: {} with stream ID: {}",
+                     filePath, currentStreamId_);
+        return currentStreamId_;
+      }
+      if (put == PutResult::FAILED) {
+        if (errorHandler_) {
+          errorHandler_->reportError(ErrorHandler::ErrorType::PROTOCOL_ERROR,
+                                     "Failed to send PUT message",
+                                     "Stream ID: " + currentStreamId_, false);
+        }
+        return "";
+      }
+    }
+
+    // Step 1: Send START message, again if the server is too busy for it
+    bool started = sendStartMessage(currentStreamId_);
+    for (int retries = 0; !started && waitToRetry(retries);) {
+      started = sendStartMessage(currentStreamId_);
+    }
+    if (!started) {
       if (errorHandler_) {
         errorHandler_->reportError(ErrorHandler::ErrorType::PROTOCOL_ERROR,
                                    "Failed to send START message",
@@ -67,7 +108,8 @@ std::string UploadManager::uploadFile(const std::string &filePath) {
     }
 
     // End performance monitoring
-    performanceMonitor_.endUpload(fileManager_.getFileSize());
+    performanceMonitor_->endUpload(fileManager_.getFileSize(),
+                                   uploadConnections_);
 
     spdlog::info("Successfully uploaded file: {} with stream ID: {}", filePath,
                  currentStreamId_);
@@ -89,19 +131,46 @@ bool UploadManager::sendStartMessage(const std::string &streamId) {
 
   StartMessage startMsg;
   startMsg.streamId = streamId;
+  startMsg.chunkSize = requestedChunkSize_;
+  startMsg.durability = durability_;
+  startMsg.window = uploadWindow_;
 
   nlohmann::json j;
   j["type"] = startMsg.type;
   j["streamId"] = startMsg.streamId;
+  j["chunkSize"] = startMsg.chunkSize;
+  if (startMsg.durability != Durability::DEFAULT) {
+    j["durability"] = durabilityToString(startMsg.durability);
+  }
+  if (startMsg.window > 0) {
+    j["window"] = startMsg.window;
+  }
   std::string jsonMessage = j.dump();
 
-  responseReceived_ = false;
-  client_->sendTextMessage(jsonMessage);
+  // Fresh estimates for every upload
+  chunkTuner_ = ChunkSizeTuner(requestedChunkSize_);
+  retryAfter_.reset();
+  resetCredit(streamId);
+  uploadNonce_.reset();
+
+  auto ticket = responses_.expect("STARTED", streamId);
+  auto sentAt = std::chrono::steady_clock::now();
+  if (client_->isBinaryProtocol()) {
+    BinaryFrameHeader header;
+    header.type = BinaryFrameType::START;
+    header.chunkSize = static_cast<uint32_t>(startMsg.chunkSize);
+    header.length = static_cast<uint64_t>(startMsg.durability);
+    header.offset = startMsg.window;
+    client_->sendBinaryFrame(header, startMsg.streamId);
+  } else {
+    client_->sendTextMessage(jsonMessage);
+  }
 
   // Wait for STARTED response with timeout
-  waitForResponse("STARTED", responseTimeoutMs_);
+  auto response = responses_.waitFor(
+      ticket, std::chrono::milliseconds(responseTimeoutMs_));
 
-  if (!responseReceived_) {
+  if (!response) {
     if (errorHandler_) {
       errorHandler_->handleTimeoutError(
           "No response received for START message", responseTimeoutMs_);
@@ -110,15 +179,41 @@ bool UploadManager::sendStartMessage(const std::string &streamId) {
   }
 
   try {
-    nlohmann::json responseJson = nlohmann::json::parse(lastResponse_);
+    nlohmann::json responseJson = nlohmann::json::parse(*response);
     if (responseJson["type"] == "STARTED") {
       spdlog::info("Received STARTED response: {}",
                    responseJson["message"].get<std::string>());
+      chunkTuner_.recordRoundTrip(std::chrono::steady_clock::now() - sentAt);
+      streamHandle_ = responseJson.value("handle", uint32_t{0});
+      readUploadNonce(responseJson);
+
+      if (responseJson.contains("chunkSize")) {
+        StartedMessage started;
+        started.chunkSize = responseJson["chunkSize"].get<size_t>();
+        started.minChunkSize =
+            responseJson.value("minChunkSize", started.chunkSize);
+        started.maxChunkSize =
+            responseJson.value("maxChunkSize", started.chunkSize);
+        chunkTuner_.setLimits(started.minChunkSize, started.maxChunkSize);
+        chunkTuner_.setChunkSize(started.chunkSize);
+        chunkTuner_.setAdaptive(adaptiveChunkSize_);
+      } else {
+        // Servers without negotiation only promise the default size
+        chunkTuner_.setLimits(CHUNK_SIZE, CHUNK_SIZE);
+        chunkTuner_.setAdaptive(false);
+      }
+      spdlog::info("Negotiated chunk size {} (range {}-{}, adaptive: {})",
+                   chunkTuner_.getChunkSize(), chunkTuner_.getMinChunkSize(),
+                   chunkTuner_.getMaxChunkSize(), chunkTuner_.isAdaptive());
       return true;
-    } else if (responseJson["type"] == "ERROR") {
+    } else if (responseJson["type"] == "ERROR" ||
+               responseJson["type"] == "error") {
       std::string errorMsg = responseJson.contains("message")
                                  ? responseJson["message"].get<std::string>()
                                  : "Unknown error";
+      if (noteRetryAfter(responseJson, "START")) {
+        return false;
+      }
       return handleProtocolError("Server error in START: " + errorMsg,
                                  "START message");
     } else {
@@ -146,50 +241,654 @@ bool UploadManager::sendFileChunks(const std::string &filePath) {
   }
 
   size_t totalSize = fileManager_.getFileSize();
-  size_t bytesUploaded = 0;
+  chunkManager_.setChunkSize(chunkTuner_.getChunkSize());
+  uploadChecksums_.reset();
 
   spdlog::info("File size: {} bytes, estimated chunks: {}", totalSize,
                chunkManager_.calculateChunkCount(totalSize));
 
-  try {
-    // Read and send chunks
-    while (fileManager_.hasMoreData()) {
-      std::vector<uint8_t> chunk;
-      size_t bytesRead = fileManager_.readChunk(chunk);
+  // Connections attached to the stream send the ranges past the first
+  uint64_t end = totalSize;
+  uploadConnections_ = 1;
+  if (parallelTransfer_ && client_->isBinaryProtocol() &&
+      serverHas(CAPABILITY_ATTACH)) {
+    end = parallelTransfer_->startUpload(currentStreamId_, filePath, totalSize);
+    uploadConnections_ = parallelTransfer_->getUploadConnectionCount();
+  }
+  rangeEnd_ = end;
+
+  // Blocks the server already stores are offered by digest first, and left
+  // out of the DATA frames; only binary DATA frames say where they go
+  storedBlocks_.clear();
+  if (skipStoredBlocks_ && client_->isBinaryProtocol() && uploadNonce_ &&
+      end >= HAVE_BLOCK_SIZE && serverHas(CAPABILITY_HAVE)) {
+    offerStoredBlocks(static_cast<size_t>(end));
+    if (!rewindTo(0)) {
+      fileManager_.closeReader();
+      return false;
+    }
+  }
+
+  // A dropped connection continues from what the server has written
+  uint64_t offset = 0;
+  compressionProfile_ = INCOMPRESSIBLE; // Until the first chunk is read
+  SendResult result = sendChunksFrom(filePath, offset, end);
+  for (int resumes = 0;
+       result == SendResult::CONNECTION_LOST && resumes < maxResumeAttempts_;
+       ++resumes) {
+    spdlog::warn("Connection lost at {} of {} bytes, resuming (attempt {}/{})",
+                 offset, end, resumes + 1, maxResumeAttempts_);
+    if (!resumeUpload(currentStreamId_, offset) || !rewindTo(offset)) {
+      break;
+    }
+    result = sendChunksFrom(filePath, offset, end);
+  }
 
-      if (bytesRead == 0) {
-        break; // End of file
+  fileManager_.closeReader();
+  resetCredit(""); // Errors from here on answer STOP
+
+  // Waits for the attached ranges even if this one failed; their
+  // checksums follow this range's
+  bool rangesWritten =
+      end == totalSize || parallelTransfer_->finishUpload(uploadChecksums_);
+
+  if (result == SendResult::CONNECTION_LOST) {
+    if (errorHandler_) {
+      errorHandler_->reportError(ErrorHandler::ErrorType::CONNECTION_ERROR,
+                                 "Connection lost during upload",
+                                 "Sent " + std::to_string(offset) + " of " +
+                                     std::to_string(end) + " bytes",
+                                 false);
+    }
+    return false;
+  }
+  if (result == SendResult::STALLED) {
+    if (errorHandler_) {
+      errorHandler_->reportError(
+          ErrorHandler::ErrorType::TIMEOUT_ERROR,
+          "No flow control credit from the server for " +
+              std::to_string(CREDIT_TIMEOUT.count()) + " ms",
+          "Sent " + std::to_string(offset) + " of " +
+              std::to_string(end) + " bytes",
+          false);
+    }
+    return false;
+  }
+  if (result == SendResult::FAILED) {
+    return false;
+  }
+  if (!rangesWritten) {
+    if (errorHandler_) {
+      errorHandler_->reportError(ErrorHandler::ErrorType::PROTOCOL_ERROR,
+                                 "Failed to upload the attached ranges",
+                                 parallelTransfer_->getLastError(), false);
+    }
+    return false;
+  }
+
+  spdlog::info("Finished sending {} bytes in chunks", totalSize);
+  return true;
+}
+
+UploadManager::SendResult
+UploadManager::sendChunksFrom(const std::string &filePath, uint64_t &offset,
+                              uint64_t end) {
+  // Reader stage: fills ring slots ahead of the sender so disk reads overlap
+  // transmission. The sender publishes tuned chunk sizes through readSize.
+  ChunkRing ring(UPLOAD_RING_DEPTH);
+  std::atomic<size_t> readSize{chunkTuner_.getChunkSize()};
+  std::string readError;
+  std::thread reader([&, readOffset = offset]() mutable {
+    try {
+      while (ChunkRing::Slot *slot = ring.acquireFree()) {
+        size_t size = static_cast<size_t>(std::min<uint64_t>(
+            readSize.load(std::memory_order_relaxed), end - readOffset));
+        if (slot->data.size() < size) {
+          slot->data.resize(size);
+        }
+        size_t bytesRead =
+            size > 0 ? fileManager_.read(slot->data.data(), size) : 0;
+        if (bytesRead == 0) {
+          ring.recycle(slot);
+          break; // End of the range or file
+        }
+        // Checksum while the chunk is still hot in cache; only this thread
+        // touches uploadChecksums_ until it is joined
+        uploadChecksums_.update(slot->data.data(), bytesRead);
+        // Published with the slot, before the sender reads it
+        if (readOffset == 0) {
+          compressionProfile_ =
+              detectCompressionProfile(slot->data.data(), bytesRead);
+        }
+        slot->size = bytesRead;
+        slot->offset = readOffset;
+        readOffset += bytesRead;
+        ring.publish(slot);
+      }
+    } catch (const std::exception &e) {
+      readError = e.what();
+    }
+    ring.close();
+  });
+
+  // Throughput is what drains from the socket's send queue, not what is
+  // handed to it, since sendBinaryMessage only queues the frame
+  constexpr auto sampleInterval = std::chrono::milliseconds(50);
+  auto sampleStart = std::chrono::steady_clock::now();
+  size_t sampleBytes = 0;
+  size_t bufferedAtStart = client_->getBufferedAmount();
+  CreditResult stop = CreditResult::GRANTED;
+  std::string sendError;
+
+  // Send stage
+  try {
+    while (ChunkRing::Slot *slot = ring.acquireFilled()) {
+      // A chunk's send time includes waiting for the send window
+      auto chunkStart = std::chrono::steady_clock::now();
+      stop = waitForSendWindow() ? waitForCredit(slot->offset + slot->size)
+                                 : CreditResult::CONNECTION_LOST;
+      if (stop != CreditResult::GRANTED) {
+        ring.cancel();
+        break;
       }
 
       // Send chunk as binary message
-      client_->sendBinaryMessage(chunk);
+      size_t bytesSent = slot->size;
+      if (!client_->isBinaryProtocol()) {
+        client_->sendBinaryMessage(slot->data.data(), slot->size);
+      } else if (storedBlocks_.empty()) {
+        BinaryFrameHeader header;
+        header.type = BinaryFrameType::DATA;
+        header.offset = slot->offset;
+        header.length = slot->size;
+        header.handle = streamHandle_;
+        client_->sendBinaryFrame(header, {}, slot->data.data(), slot->size,
+                                 compressionProfile_);
+      } else {
+        // One frame per block the server does not store already
+        bytesSent = 0;
+        uint64_t end = slot->offset + slot->size;
+        for (uint64_t at = slot->offset; at < end;) {
+          uint64_t block = at / HAVE_BLOCK_SIZE;
+          uint64_t next =
+              std::min<uint64_t>((block + 1) * HAVE_BLOCK_SIZE, end);
+          if (storedBlocks_.count(block) == 0) {
+            BinaryFrameHeader header;
+            header.type = BinaryFrameType::DATA;
+            header.offset = at;
+            header.length = next - at;
+            header.handle = streamHandle_;
+            client_->sendBinaryFrame(
+                header, {}, slot->data.data() + (at - slot->offset),
+                static_cast<size_t>(next - at), compressionProfile_);
+            bytesSent += static_cast<size_t>(next - at);
+          }
+          at = next;
+        }
+      }
 
-      bytesUploaded += bytesRead;
+      offset += slot->size;
+      ring.recycle(slot);
+      sampleBytes += bytesSent;
+
+      auto now = std::chrono::steady_clock::now();
+      performanceMonitor_->recordUploadChunk(bytesSent, now - chunkStart);
+      if (now - sampleStart >= sampleInterval) {
+        size_t buffered = client_->getBufferedAmount();
+        size_t queued = bufferedAtStart + sampleBytes;
+        chunkTuner_.recordThroughput(queued > buffered ? queued - buffered : 0,
+                                     now - sampleStart);
+        readSize.store(chunkTuner_.getChunkSize(), std::memory_order_relaxed);
+        sampleStart = now;
+        sampleBytes = 0;
+        bufferedAtStart = buffered;
+      }
 
       // Call progress callback if set
       if (progressCallback_) {
-        progressCallback_(bytesUploaded, totalSize);
+        progressCallback_(offset, end);
       }
 
-      spdlog::debug("Sent chunk: {} bytes (total: {}/{})", bytesRead,
-                    bytesUploaded, totalSize);
+      SPDLOG_DEBUG("Sent chunk: {} bytes (total: {}/{})", bytesSent, offset,
+                   end);
+      AUDIO_STREAM_TRACE(currentStreamId_, "sent {} bytes, {} of {}",
+                         bytesSent, offset, end);
     }
+  } catch (const std::exception &e) {
+    ring.cancel();
+    sendError = e.what();
+  }
 
-    fileManager_.closeReader();
+  reader.join();
 
-    spdlog::info("Finished sending {} bytes in chunks", bytesUploaded);
-    return true;
+  if (!readError.empty() || !sendError.empty()) {
+    if (errorHandler_) {
+      std::string message =
+          readError.empty()
+              ? "Exception while sending file chunks: " + sendError
+              : "Exception while reading file chunks: " + readError;
+      errorHandler_->reportError(ErrorHandler::ErrorType::FILE_IO_ERROR,
+                                 message, "File: " + filePath, false);
+    }
+    return SendResult::FAILED;
+  }
+
+  if (stop == CreditResult::FAILED) {
+    std::string error;
+    {
+      std::lock_guard<std::mutex> lock(creditMutex_);
+      error = uploadError_.value_or("");
+    }
+    handleProtocolError("Server error during upload: " + error,
+                        "Stream ID: " + currentStreamId_);
+    return SendResult::FAILED;
+  }
+  if (stop == CreditResult::TIMED_OUT && client_->isConnected()) {
+    return SendResult::STALLED;
+  }
+
+  // Frames queued when the connection dropped may never have arrived
+  if (stop != CreditResult::GRANTED || !client_->isConnected()) {
+    return SendResult::CONNECTION_LOST;
+  }
+  return SendResult::COMPLETE;
+}
+
+bool UploadManager::resumeUpload(const std::string &streamId,
+                                 uint64_t &offset) {
+  if (!client_->isConnected() && !client_->connectWithRetry()) {
+    return false;
+  }
+
+  spdlog::debug("Sending RESUME message for stream: {}", streamId);
+
+  ResumeMessage resumeMsg;
+  resumeMsg.streamId = streamId;
+  resumeMsg.window = uploadWindow_;
+
+  // Credit of the dropped connection does not carry over
+  resetCredit(streamId);
+  auto ticket = responses_.expect("RESUMED", streamId);
+  if (client_->isBinaryProtocol()) {
+    BinaryFrameHeader header;
+    header.type = BinaryFrameType::RESUME;
+    header.offset = resumeMsg.window;
+    client_->sendBinaryFrame(header, resumeMsg.streamId);
+  } else {
+    nlohmann::json j;
+    j["type"] = resumeMsg.type;
+    j["streamId"] = resumeMsg.streamId;
+    if (resumeMsg.window > 0) {
+      j["window"] = resumeMsg.window;
+    }
+    client_->sendTextMessage(j.dump());
+  }
+
+  // Wait for RESUMED response with timeout
+  auto response = responses_.waitFor(
+      ticket, std::chrono::milliseconds(responseTimeoutMs_));
+
+  if (!response) {
+    if (errorHandler_) {
+      errorHandler_->handleTimeoutError(
+          "No response received for RESUME message", responseTimeoutMs_);
+    }
+    return false;
+  }
+
+  try {
+    nlohmann::json responseJson = nlohmann::json::parse(*response);
+    if (responseJson["type"] == "RESUMED") {
+      ResumedMessage resumed;
+      // Attached connections may have filled in past this one's range
+      resumed.offset = std::min<size_t>(responseJson["offset"].get<size_t>(),
+                                        rangeEnd_);
+      resumed.chunkSize =
+          responseJson.value("chunkSize", chunkTuner_.getChunkSize());
+      resumed.minChunkSize =
+          responseJson.value("minChunkSize", chunkTuner_.getMinChunkSize());
+      resumed.maxChunkSize =
+          responseJson.value("maxChunkSize", chunkTuner_.getMaxChunkSize());
+
+      // The server cannot hold more than was read for it
+      if (resumed.offset > uploadChecksums_.getTotalBytes()) {
+        return handleProtocolError(
+            "Server reports " + std::to_string(resumed.offset) +
+                " bytes written, only " +
+                std::to_string(uploadChecksums_.getTotalBytes()) + " were sent",
+            "RESUMED offset");
+      }
 
+      chunkTuner_.setLimits(resumed.minChunkSize, resumed.maxChunkSize);
+      chunkTuner_.setChunkSize(resumed.chunkSize);
+      streamHandle_ = responseJson.value("handle", uint32_t{0});
+      readUploadNonce(responseJson);
+      offset = resumed.offset;
+      spdlog::info("Resumed stream {} at offset {}", streamId, offset);
+      return true;
+    } else if (responseJson["type"] == "ERROR" ||
+               responseJson["type"] == "error") {
+      std::string errorMsg = responseJson.contains("message")
+                                 ? responseJson["message"].get<std::string>()
+                                 : "Unknown error";
+      return handleProtocolError("Server error in RESUME: " + errorMsg,
+                                 "RESUME message");
+    } else {
+      return handleProtocolError("Unexpected response type: " +
+                                     responseJson["type"].get<std::string>(),
+                                 "Expected 'RESUMED'");
+    }
   } catch (const std::exception &e) {
-    fileManager_.closeReader();
+    return handleProtocolError("Failed to parse RESUMED response: " +
+                                   std::string(e.what()),
+                               "JSON parsing");
+  }
+}
+
+bool UploadManager::uploadRange(const std::string &streamId,
+                                const std::string &filePath, uint64_t begin,
+                                uint64_t end) {
+  spdlog::info("Sending bytes {}-{} of stream {} on an attached connection",
+               begin, end, streamId);
+  currentStreamId_ = streamId;
+
+  // Only binary DATA frames say where their bytes go
+  if (!client_->isBinaryProtocol()) {
+    return handleProtocolError("Attached uploads need the binary protocol",
+                               "ATTACH message");
+  }
+  if (!fileManager_.openForReading(filePath)) {
     if (errorHandler_) {
-      errorHandler_->reportError(ErrorHandler::ErrorType::FILE_IO_ERROR,
-                                 "Exception while reading file chunks: " +
-                                     std::string(e.what()),
-                                 "File: " + filePath, false);
+      errorHandler_->handleFileIOError("Failed to open file for reading",
+                                       filePath);
+    }
+    return false;
+  }
+
+  // Compressed like the rest of the upload, so judged from the file's start
+  std::vector<uint8_t> head(CHUNK_SIZE);
+  compressionProfile_ = detectCompressionProfile(
+      head.data(), fileManager_.read(head.data(), head.size()));
+
+  // The server keeps no offset per attached connection to resume from, so
+  // a dropped one sends its whole range again
+  uint64_t offset = begin;
+  SendResult result = SendResult::CONNECTION_LOST;
+  for (int attempt = 0;
+       result == SendResult::CONNECTION_LOST && attempt <= maxResumeAttempts_;
+       ++attempt) {
+    if (attempt > 0) {
+      spdlog::warn("Connection lost at {} of range {}-{}, sending it again "
+                   "(attempt {}/{})",
+                   offset, begin, end, attempt, maxResumeAttempts_);
+    }
+    if ((!client_->isConnected() && !client_->connectWithRetry()) ||
+        !sendAttachMessage(streamId) ||
+        !fileManager_.seek(static_cast<size_t>(begin))) {
+      result = SendResult::FAILED;
+      break;
+    }
+    uploadChecksums_.reset();
+    offset = begin;
+    result = sendChunksFrom(filePath, offset, end);
+  }
+
+  fileManager_.closeReader();
+  resetCredit(""); // Errors from here on answer DETACH
+
+  if (result == SendResult::CONNECTION_LOST ||
+      result == SendResult::STALLED) {
+    if (errorHandler_) {
+      errorHandler_->reportError(ErrorHandler::ErrorType::CONNECTION_ERROR,
+                                 "Failed to send a range of the upload",
+                                 "Sent " + std::to_string(offset - begin) +
+                                     " of " + std::to_string(end - begin) +
+                                     " bytes from " + std::to_string(begin),
+                                 false);
+    }
+    return false;
+  }
+  return result == SendResult::COMPLETE && sendDetachMessage(streamId);
+}
+
+bool UploadManager::sendAttachMessage(const std::string &streamId) {
+  spdlog::debug("Sending ATTACH message for stream: {}", streamId);
+
+  AttachMessage attachMsg;
+  attachMsg.streamId = streamId;
+
+  // Attached connections send without flow control and offer no blocks
+  chunkTuner_ = ChunkSizeTuner(requestedChunkSize_);
+  resetCredit(streamId);
+  uploadNonce_.reset();
+  storedBlocks_.clear();
+
+  auto ticket = responses_.expect("ATTACHED", streamId);
+  BinaryFrameHeader header;
+  header.type = BinaryFrameType::ATTACH;
+  client_->sendBinaryFrame(header, attachMsg.streamId);
+
+  auto response = responses_.waitFor(
+      ticket, std::chrono::milliseconds(responseTimeoutMs_));
+
+  if (!response) {
+    if (errorHandler_) {
+      errorHandler_->handleTimeoutError(
+          "No response received for ATTACH message", responseTimeoutMs_);
+    }
+    return false;
+  }
+
+  try {
+    nlohmann::json responseJson = nlohmann::json::parse(*response);
+    if (responseJson["type"] == "ATTACHED") {
+      streamHandle_ = responseJson.value("handle", uint32_t{0});
+      size_t chunkSize = responseJson.value("chunkSize", CHUNK_SIZE);
+      chunkTuner_.setLimits(responseJson.value("minChunkSize", chunkSize),
+                            responseJson.value("maxChunkSize", chunkSize));
+      chunkTuner_.setChunkSize(chunkSize);
+      chunkTuner_.setAdaptive(adaptiveChunkSize_);
+      spdlog::info("Attached to stream {} (handle {}, chunk size {})",
+                   streamId, streamHandle_, chunkTuner_.getChunkSize());
+      return true;
+    } else if (responseJson["type"] == "ERROR" ||
+               responseJson["type"] == "error") {
+      std::string errorMsg = responseJson.contains("message")
+                                 ? responseJson["message"].get<std::string>()
+                                 : "Unknown error";
+      return handleProtocolError("Server error in ATTACH: " + errorMsg,
+                                 "ATTACH message");
+    } else {
+      return handleProtocolError("Unexpected response type: " +
+                                     responseJson["type"].get<std::string>(),
+                                 "Expected 'ATTACHED'");
     }
+  } catch (const std::exception &e) {
+    return handleProtocolError("Failed to parse ATTACHED response: " +
+                                   std::string(e.what()),
+                               "JSON parsing");
+  }
+}
+
+bool UploadManager::sendDetachMessage(const std::string &streamId) {
+  spdlog::debug("Sending DETACH message for stream: {}", streamId);
+
+  DetachMessage detachMsg;
+  detachMsg.streamId = streamId;
+
+  // Answered once the chunks sent before it are written, or with the
+  // error of one that was not
+  auto ticket = responses_.expect("DETACHED", streamId);
+  BinaryFrameHeader header;
+  header.type = BinaryFrameType::DETACH;
+  header.handle = streamHandle_;
+  client_->sendBinaryFrame(header, detachMsg.streamId);
+
+  auto response = responses_.waitFor(
+      ticket, std::chrono::milliseconds(responseTimeoutMs_));
+
+  if (!response) {
+    if (errorHandler_) {
+      errorHandler_->handleTimeoutError(
+          "No response received for DETACH message", responseTimeoutMs_);
+    }
+    return false;
+  }
+
+  try {
+    nlohmann::json responseJson = nlohmann::json::parse(*response);
+    if (responseJson["type"] == "DETACHED") {
+      spdlog::info("Detached from stream {}", streamId);
+      return true;
+    } else if (responseJson["type"] == "ERROR" ||
+               responseJson["type"] == "error") {
+      std::string errorMsg = responseJson.contains("message")
+                                 ? responseJson["message"].get<std::string>()
+                                 : "Unknown error";
+      return handleProtocolError("Server error in DETACH: " + errorMsg,
+                                 "DETACH message");
+    } else {
+      return handleProtocolError("Unexpected response type: " +
+                                     responseJson["type"].get<std::string>(),
+                                 "Expected 'DETACHED'");
+    }
+  } catch (const std::exception &e) {
+    return handleProtocolError("Failed to parse DETACHED response: " +
+                                   std::string(e.what()),
+                               "JSON parsing");
+  }
+}
+
+bool UploadManager::rewindTo(uint64_t offset) {
+  // Drop checksums of bytes the server did not keep, then re-read up to
+  // offset so they cover exactly what it holds
+  uint64_t covered = uploadChecksums_.truncate(offset);
+  if (!fileManager_.seek(static_cast<size_t>(covered))) {
     return false;
   }
+
+  std::vector<uint8_t> buffer(CHUNK_SIZE);
+  while (covered < offset) {
+    size_t want = static_cast<size_t>(
+        std::min<uint64_t>(offset - covered, buffer.size()));
+    size_t bytesRead = fileManager_.read(buffer.data(), want);
+    if (bytesRead == 0) {
+      if (errorHandler_) {
+        errorHandler_->handleFileIOError("Failed to re-read file on resume",
+                                         fileManager_.getFilePath());
+      }
+      return false;
+    }
+    uploadChecksums_.update(buffer.data(), bytesRead);
+    covered += bytesRead;
+  }
+  return true;
+}
+
+bool UploadManager::waitForSendWindow() {
+  // websocketpp queues every frame it is handed; hold the sender back while
+  // the queue already covers a few chunks so memory stays bounded
+  size_t highWater = SEND_HIGH_WATER_CHUNKS * chunkTuner_.getChunkSize();
+  while (client_->getBufferedAmount() > highWater) {
+    if (!client_->isConnected()) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return client_->isConnected();
+}
+
+void UploadManager::resetCredit(const std::string &streamId) {
+  std::lock_guard<std::mutex> lock(creditMutex_);
+  creditStreamId_ = streamId;
+  creditLimit_.reset();
+  uploadError_.reset();
+}
+
+UploadManager::CreditResult UploadManager::waitForCredit(uint64_t end) {
+  // Servers without flow control send no CREDIT, and are not waited for
+  auto deadline = std::chrono::steady_clock::now() + CREDIT_TIMEOUT;
+  std::unique_lock<std::mutex> lock(creditMutex_);
+  while (!uploadError_ && creditLimit_ && end > *creditLimit_) {
+    if (!client_->isConnected()) {
+      return CreditResult::CONNECTION_LOST;
+    }
+    if (std::chrono::steady_clock::now() >= deadline) {
+      spdlog::error("No credit for stream {} past byte {} after {} ms",
+                    creditStreamId_, *creditLimit_, CREDIT_TIMEOUT.count());
+      return CreditResult::TIMED_OUT;
+    }
+    creditCv_.wait_for(lock, std::chrono::milliseconds(10));
+  }
+  return uploadError_ ? CreditResult::FAILED : CreditResult::GRANTED;
+}
+
+bool UploadManager::handleCredit(const std::string &message) {
+  nlohmann::json credit = nlohmann::json::parse(message, nullptr, false);
+  if (!credit.is_object() || credit.value("type", "") != "CREDIT") {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(creditMutex_);
+    if (credit.value("streamId", "") != creditStreamId_) {
+      return true; // An upload that is over
+    }
+    // The latest grant applies, even if it shrinks the window
+    creditLimit_ = credit.value("offset", uint64_t{0}) +
+                   credit.value("length", uint64_t{0});
+  }
+  creditCv_.notify_all();
+  SPDLOG_DEBUG("Credit for stream {} up to byte {}",
+               credit.value("streamId", ""),
+               credit.value("offset", uint64_t{0}) +
+                   credit.value("length", uint64_t{0}));
+  return true;
+}
+
+bool UploadManager::handleUploadError(const std::string &message) {
+  nlohmann::json error = nlohmann::json::parse(message, nullptr, false);
+  if (!error.is_object()) {
+    return false;
+  }
+  std::string type = error.value("type", "");
+  if (type != "ERROR" && type != "error") {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(creditMutex_);
+    std::string streamId = error.value("streamId", "");
+    if (creditStreamId_.empty() ||
+        (!streamId.empty() && streamId != creditStreamId_)) {
+      return false; // No upload sending, or another stream's
+    }
+    uploadError_ = error.value("message", std::string("unknown error"));
+  }
+  creditCv_.notify_all();
+  return true;
+}
+
+bool UploadManager::noteRetryAfter(const nlohmann::json &error,
+                                   const std::string &request) {
+  uint32_t delayMs = error.value("retryAfterMs", uint32_t{0});
+  if (delayMs == 0) {
+    return false;
+  }
+  retryAfter_ = std::min(std::chrono::milliseconds(delayMs), MAX_RETRY_AFTER);
+  spdlog::warn("Server refused {} for load: {}", request,
+               error.value("message", std::string("busy")));
+  return true;
+}
+
+bool UploadManager::waitToRetry(int &retries) {
+  if (!retryAfter_ || retries >= MAX_ADMISSION_RETRIES) {
+    return false;
+  }
+  ++retries;
+  spdlog::info("Retrying in {} ms (attempt {}/{})", retryAfter_->count(),
+               retries, MAX_ADMISSION_RETRIES);
+  std::this_thread::sleep_for(*retryAfter_);
+  retryAfter_.reset();
+  return true;
 }
 
 bool UploadManager::handleProtocolError(const std::string &message,
@@ -213,13 +912,20 @@ bool UploadManager::sendStopMessage(const std::string &streamId) {
   j["streamId"] = stopMsg.streamId;
   std::string jsonMessage = j.dump();
 
-  responseReceived_ = false;
-  client_->sendTextMessage(jsonMessage);
+  auto ticket = responses_.expect("STOPPED", streamId);
+  if (client_->isBinaryProtocol()) {
+    BinaryFrameHeader header;
+    header.type = BinaryFrameType::STOP;
+    client_->sendBinaryFrame(header, stopMsg.streamId);
+  } else {
+    client_->sendTextMessage(jsonMessage);
+  }
 
   // Wait for STOPPED response with timeout
-  waitForResponse("STOPPED", responseTimeoutMs_);
+  auto response = responses_.waitFor(
+      ticket, std::chrono::milliseconds(responseTimeoutMs_));
 
-  if (!responseReceived_) {
+  if (!response) {
     if (errorHandler_) {
       errorHandler_->handleTimeoutError("No response received for STOP message",
                                         responseTimeoutMs_);
@@ -228,12 +934,14 @@ bool UploadManager::sendStopMessage(const std::string &streamId) {
   }
 
   try {
-    nlohmann::json responseJson = nlohmann::json::parse(lastResponse_);
+    nlohmann::json responseJson = nlohmann::json::parse(*response);
     if (responseJson["type"] == "STOPPED") {
       spdlog::info("Received STOPPED response: {}",
                    responseJson["message"].get<std::string>());
-      return true;
-    } else if (responseJson["type"] == "ERROR") {
+
+      return verifyStoredChecksum(responseJson);
+    } else if (responseJson["type"] == "ERROR" ||
+               responseJson["type"] == "error") {
       std::string errorMsg = responseJson.contains("message")
                                  ? responseJson["message"].get<std::string>()
                                  : "Unknown error";
@@ -251,20 +959,240 @@ bool UploadManager::sendStopMessage(const std::string &streamId) {
   }
 }
 
-void UploadManager::waitForResponse(const std::string &expectedType,
-                                    int timeoutMs) {
-  auto startTime = std::chrono::steady_clock::now();
-  auto timeout = std::chrono::milliseconds(timeoutMs);
-
-  while (!responseReceived_) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+UploadManager::PutResult UploadManager::putFile(const std::string &filePath,
+                                                size_t size) {
+  spdlog::debug("Sending PUT message for stream: {}", currentStreamId_);
+  retryAfter_.reset();
 
-    auto elapsed = std::chrono::steady_clock::now() - startTime;
-    if (elapsed > timeout) {
-      spdlog::warn("Timeout waiting for {} response", expectedType);
+  if (!fileManager_.openForReading(filePath)) {
+    if (errorHandler_) {
+      errorHandler_->handleFileIOError("Failed to open file for reading",
+                                       filePath);
+    }
+    return PutResult::FAILED;
+  }
+  std::vector<uint8_t> data(size);
+  size_t bytesRead = 0;
+  while (bytesRead < size) {
+    size_t n = fileManager_.read(data.data() + bytesRead, size - bytesRead);
+    if (n == 0) {
       break;
     }
+    bytesRead += n;
+  }
+  fileManager_.closeReader();
+  if (bytesRead != size) {
+    if (errorHandler_) {
+      errorHandler_->handleFileIOError("Failed to read file for PUT",
+                                       filePath);
+    }
+    return PutResult::FAILED;
+  }
+  uploadChecksums_.reset();
+  uploadChecksums_.update(data.data(), size);
+
+  PutMessage putMsg;
+  putMsg.streamId = currentStreamId_;
+  putMsg.length = size;
+  putMsg.durability = durability_;
+
+  auto ticket = responses_.expect("STOPPED", putMsg.streamId);
+  auto sentAt = std::chrono::steady_clock::now();
+  if (client_->isBinaryProtocol()) {
+    BinaryFrameHeader header;
+    header.type = BinaryFrameType::PUT;
+    header.length = static_cast<uint64_t>(putMsg.durability);
+    client_->sendBinaryFrame(header, putMsg.streamId, data.data(), size);
+  } else {
+    nlohmann::json j;
+    j["type"] = putMsg.type;
+    j["streamId"] = putMsg.streamId;
+    j["length"] = putMsg.length;
+    if (putMsg.durability != Durability::DEFAULT) {
+      j["durability"] = durabilityToString(putMsg.durability);
+    }
+    client_->sendTextMessage(j.dump());
+    if (size > 0) {
+      client_->sendBinaryMessage(data.data(), size);
+    }
   }
+
+  auto response = responses_.waitFor(
+      ticket, std::chrono::milliseconds(responseTimeoutMs_));
+  auto now = std::chrono::steady_clock::now();
+
+  if (!response) {
+    if (errorHandler_) {
+      errorHandler_->handleTimeoutError("No response received for PUT message",
+                                        responseTimeoutMs_);
+    }
+    return PutResult::FAILED;
+  }
+
+  try {
+    nlohmann::json responseJson = nlohmann::json::parse(*response);
+    if (responseJson["type"] == "STOPPED") {
+      spdlog::info("Stored stream {} with a single PUT ({} bytes)",
+                   putMsg.streamId, size);
+      performanceMonitor_->recordUploadChunk(size, now - sentAt);
+      if (!verifyStoredChecksum(responseJson)) {
+        return PutResult::FAILED;
+      }
+      if (progressCallback_) {
+        progressCallback_(size, size);
+      }
+      return PutResult::STORED;
+    } else if (responseJson["type"] == "ERROR" ||
+               responseJson["type"] == "error") {
+      std::string errorMsg = responseJson.contains("message")
+                                 ? responseJson["message"].get<std::string>()
+                                 : "Unknown error";
+      if (noteRetryAfter(responseJson, "PUT")) {
+        return PutResult::FAILED;
+      }
+      handleProtocolError("Server error in PUT: " + errorMsg, "PUT message");
+      return PutResult::FAILED;
+    } else {
+      handleProtocolError("Unexpected response type: " +
+                              responseJson["type"].get<std::string>(),
+                          "Expected 'STOPPED'");
+      return PutResult::FAILED;
+    }
+  } catch (const std::exception &e) {
+    handleProtocolError("Failed to parse PUT response: " +
+                            std::string(e.what()),
+                        "JSON parsing");
+    return PutResult::FAILED;
+  }
+}
+
+bool UploadManager::serverTakesPut(size_t size) {
+  return serverHas(CAPABILITY_PUT) && size <= serverHello_->maxPutSize;
+}
+
+bool UploadManager::serverHas(uint32_t capability) {
+  if (!serverHello_) {
+    // Servers older than HELLO refuse it or ignore it; either way they
+    // take none of the optional messages
+    serverHello_.emplace();
+    auto ticket = responses_.expect("HELLO", "");
+    if (client_->isBinaryProtocol()) {
+      BinaryFrameHeader header;
+      header.type = BinaryFrameType::HELLO;
+      client_->sendBinaryFrame(header, {});
+    } else {
+      client_->sendTextMessage(
+          nlohmann::json{{"type", serverHello_->type}}.dump());
+    }
+    auto response = responses_.waitFor(
+        ticket, std::chrono::milliseconds(responseTimeoutMs_));
+    nlohmann::json hello = response ? nlohmann::json::parse(*response, nullptr,
+                                                            false)
+                                    : nlohmann::json();
+    if (hello.is_object() && hello.value("type", "") == "HELLO") {
+      serverHello_->capabilities = hello.value("capabilities", 0u);
+      serverHello_->maxPutSize = hello.value("maxPutSize", uint64_t{0});
+    }
+    spdlog::info("Server capabilities: {:#x}, largest PUT {} bytes",
+                 serverHello_->capabilities, serverHello_->maxPutSize);
+  }
+  return (serverHello_->capabilities & capability) != 0;
+}
+
+void UploadManager::offerStoredBlocks(size_t totalSize) {
+  // Answered in order of the HAVEs; offering stops at the first reply that
+  // is not a HAS, and the blocks not confirmed are sent as DATA
+  std::deque<ResponseCorrelator::Ticket> offered;
+  bool answered = true;
+  auto awaitOldest = [&] {
+    ResponseCorrelator::Ticket ticket = offered.front();
+    offered.pop_front();
+    // Once one reply is missing, the rest are only released
+    auto response = responses_.waitFor(
+        ticket, std::chrono::milliseconds(answered ? responseTimeoutMs_ : 0));
+    nlohmann::json has = response ? nlohmann::json::parse(*response, nullptr,
+                                                          false)
+                                  : nlohmann::json();
+    if (!has.is_object() || has.value("type", "") != "HAS") {
+      answered = false;
+      return;
+    }
+    if (has.value("length", uint64_t{0}) > 0) {
+      storedBlocks_.insert(has.value("offset", uint64_t{0}) / HAVE_BLOCK_SIZE);
+    }
+  };
+
+  std::vector<uint8_t> block(HAVE_BLOCK_SIZE);
+  std::array<uint8_t, 2 * sha256::DIGEST_BYTES> payload;
+  for (uint64_t offset = 0; offset < totalSize && answered;
+       offset += HAVE_BLOCK_SIZE) {
+    size_t length = static_cast<size_t>(
+        std::min<uint64_t>(totalSize - offset, HAVE_BLOCK_SIZE));
+    size_t bytesRead = 0;
+    while (bytesRead < length) {
+      size_t n =
+          fileManager_.read(block.data() + bytesRead, length - bytesRead);
+      if (n == 0) {
+        break;
+      }
+      bytesRead += n;
+    }
+    if (bytesRead != length) {
+      break; // The send that follows reports the short file
+    }
+
+    sha256::Digest digest = sha256::digest(block.data(), length);
+    sha256::Digest proof = sha256::proof(
+        uploadNonce_->data(), uploadNonce_->size(), block.data(), length);
+    std::copy(digest.begin(), digest.end(), payload.begin());
+    std::copy(proof.begin(), proof.end(),
+              payload.begin() + sha256::DIGEST_BYTES);
+
+    if (offered.size() >= HAVE_PIPELINE) {
+      awaitOldest();
+    }
+    offered.push_back(responses_.expect("HAS", currentStreamId_));
+    BinaryFrameHeader header;
+    header.type = BinaryFrameType::HAVE;
+    header.offset = offset;
+    header.length = length;
+    header.handle = streamHandle_;
+    client_->sendBinaryFrame(header, {}, payload.data(), payload.size());
+  }
+  while (!offered.empty()) {
+    awaitOldest();
+  }
+
+  uint64_t blocks = (totalSize + HAVE_BLOCK_SIZE - 1) / HAVE_BLOCK_SIZE;
+  spdlog::info("Server stores {} of {} blocks of stream {} already{}",
+               storedBlocks_.size(), blocks, currentStreamId_,
+               answered ? "" : " (offer cut short)");
+}
+
+void UploadManager::readUploadNonce(const nlohmann::json &reply) {
+  std::array<uint8_t, HAVE_NONCE_BYTES> nonce;
+  if (reply.contains("nonce") &&
+      sha256::fromHex(reply["nonce"].get<std::string>(), nonce.data(),
+                      nonce.size())) {
+    uploadNonce_ = nonce;
+  }
+}
+
+bool UploadManager::verifyStoredChecksum(const nlohmann::json &stopped) {
+  // Servers that report a digest of the stored stream let the upload be
+  // verified here; older servers leave it out
+  if (!stopped.contains("crc32c")) {
+    return true;
+  }
+  std::string serverCrc = stopped["crc32c"].get<std::string>();
+  std::string localCrc = crc32c::toHex(uploadChecksums_.getChecksum());
+  if (serverCrc != localCrc) {
+    return handleProtocolError("Server stored CRC32C " + serverCrc +
+                                   ", uploaded data has " + localCrc,
+                               "STOPPED checksum");
+  }
+  spdlog::info("Server checksum matches upload (crc32c {})", localCrc);
+  return true;
 }
 
 void UploadManager::setProgressCallback(
@@ -273,13 +1201,19 @@ void UploadManager::setProgressCallback(
 }
 
 PerformanceMetrics UploadManager::getPerformanceMetrics() const {
-  return performanceMonitor_.getMetrics();
+  return performanceMonitor_->getMetrics();
 }
 
 void UploadManager::handleServerResponse(const std::string &message) {
-  spdlog::debug("Received server response: {}", message);
-  lastResponse_ = message;
-  responseReceived_ = true;
+  SPDLOG_DEBUG("Received server response: {}", message);
+  // Credit answers no request
+  if (message.find("\"CREDIT\"") != std::string::npos &&
+      handleCredit(message)) {
+    return;
+  }
+  if (!responses_.dispatch(message) && !handleUploadError(message)) {
+    SPDLOG_DEBUG("No request waiting for server response, ignoring");
+  }
 }
 
 } // namespace audio_stream
\ No newline at end of file
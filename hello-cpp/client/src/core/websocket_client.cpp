@@ -1,5 +1,8 @@
 #include "core/websocket_client.h"
+#include "crc32c.h"
+#include "sha256.h"
 #include <chrono>
+#include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 #include <thread>
 
@@ -67,6 +70,28 @@ bool WebSocketClient::attemptConnection() {
       return false;
     }
 
+    if (binaryProtocolRequested_ &&
+        compressionRequested_ != CompressionCodec::NONE &&
+        isCodecAvailable(compressionRequested_)) {
+      con->add_subprotocol(compressedBinaryProtocol(compressionRequested_),
+                           ec);
+      if (ec) {
+        spdlog::warn("Could not offer compression: {}", ec.message());
+      }
+    }
+    if (binaryProtocolRequested_) {
+      con->add_subprotocol(BINARY_PROTOCOL, ec);
+      if (ec) {
+        spdlog::warn("Could not offer binary protocol: {}", ec.message());
+      }
+    }
+
+    // After a dropped connection the last run() has returned; the io
+    // context must be restarted before it can serve a new one
+    if (client_.stopped()) {
+      client_.reset();
+    }
+
     connection_ = con->get_handle();
     client_.connect(con);
 
@@ -143,7 +168,7 @@ void WebSocketClient::sendTextMessage(const std::string &message) {
   }
 
   try {
-    spdlog::debug("Sending text message: {}", message);
+    SPDLOG_DEBUG("Sending text message: {}", message);
 
     websocketpp::lib::error_code ec;
     client_.send(connection_, message, websocketpp::frame::opcode::text, ec);
@@ -163,6 +188,10 @@ void WebSocketClient::sendTextMessage(const std::string &message) {
 }
 
 void WebSocketClient::sendBinaryMessage(const std::vector<uint8_t> &data) {
+  sendBinaryMessage(data.data(), data.size());
+}
+
+void WebSocketClient::sendBinaryMessage(const uint8_t *data, size_t size) {
   if (!connected_) {
     spdlog::error("Cannot send binary message: not connected");
     if (onErrorHandler_) {
@@ -172,11 +201,11 @@ void WebSocketClient::sendBinaryMessage(const std::vector<uint8_t> &data) {
   }
 
   try {
-    spdlog::debug("Sending binary message: {} bytes", data.size());
+    SPDLOG_DEBUG("Sending binary message: {} bytes", size);
 
     websocketpp::lib::error_code ec;
-    client_.send(connection_, data.data(), data.size(),
-                 websocketpp::frame::opcode::binary, ec);
+    client_.send(connection_, data, size, websocketpp::frame::opcode::binary,
+                 ec);
 
     if (ec) {
       spdlog::error("Send binary error: {}", ec.message());
@@ -192,6 +221,230 @@ void WebSocketClient::sendBinaryMessage(const std::vector<uint8_t> &data) {
   }
 }
 
+void WebSocketClient::sendBinaryFrame(const BinaryFrameHeader &header,
+                                      std::string_view text,
+                                      const uint8_t *payload,
+                                      size_t payloadSize,
+                                      CompressionProfile profile) {
+  if (!connected_) {
+    spdlog::error("Cannot send binary frame: not connected");
+    if (onErrorHandler_) {
+      onErrorHandler_("Cannot send binary frame: not connected");
+    }
+    return;
+  }
+
+  try {
+    websocketpp::lib::error_code ec;
+    auto con = client_.get_con_from_hdl(connection_, ec);
+    if (ec) {
+      spdlog::error("Send binary frame error: {}", ec.message());
+      return;
+    }
+
+    // Same frame with the payload compressed, if that shrinks it
+    thread_local std::vector<uint8_t> compressed;
+    BinaryFrameHeader sent = header;
+    if (header.type == BinaryFrameType::DATA &&
+        compression_ != CompressionCodec::NONE && profile.compressible &&
+        compressBlock(compression_, payload, payloadSize, compressed,
+                      profile.pcm16Channels)) {
+      sent.type = BinaryFrameType::COMPRESSED_DATA;
+      sent.length = payloadSize;
+      sent.codec = compression_;
+      sent.pcm16Channels = profile.pcm16Channels;
+      payload = compressed.data();
+      payloadSize = compressed.size();
+    }
+
+    uint8_t encoded[BINARY_FRAME_HEADER_SIZE];
+    encodeBinaryFrameHeader(encoded, sent,
+                            static_cast<uint16_t>(text.size()));
+
+    auto msg = con->get_message(websocketpp::frame::opcode::binary,
+                                sizeof(encoded) + text.size() + payloadSize);
+    msg->append_payload(encoded, sizeof(encoded));
+    msg->append_payload(text.data(), text.size());
+    if (payloadSize > 0) {
+      msg->append_payload(payload, payloadSize);
+    }
+
+    ec = con->send(msg);
+    if (ec) {
+      spdlog::error("Send binary frame error: {}", ec.message());
+      if (onErrorHandler_) {
+        onErrorHandler_("Send binary frame error: " + ec.message());
+      }
+    }
+  } catch (const std::exception &e) {
+    spdlog::error("Exception during send binary frame: {}", e.what());
+    if (onErrorHandler_) {
+      onErrorHandler_(std::string("Exception during send binary frame: ") +
+                      e.what());
+    }
+  }
+}
+
+void WebSocketClient::dispatchBinaryProtocolFrame(const std::string &payload) {
+  BinaryFrame frame;
+  if (!decodeBinaryFrame(reinterpret_cast<const uint8_t *>(payload.data()),
+                         payload.size(), frame)) {
+    spdlog::error("Malformed binary protocol frame: {} bytes", payload.size());
+    return;
+  }
+
+  if (frame.header.type == BinaryFrameType::DATA) {
+    SPDLOG_DEBUG("Data frame received: offset {} length {}",
+                 frame.header.offset, frame.payloadSize);
+    if (onBinaryMessageHandler_) {
+      onBinaryMessageHandler_(std::vector<uint8_t>(
+          frame.payload, frame.payload + frame.payloadSize));
+    }
+    return;
+  }
+
+  if (frame.header.type == BinaryFrameType::COMPRESSED_DATA) {
+    SPDLOG_DEBUG("Compressed data frame received: offset {} length {} "
+                 "({} bytes)",
+                 frame.header.offset, frame.header.length, frame.payloadSize);
+    std::vector<uint8_t> data;
+    if (frame.header.length <= MAX_CHUNK_SIZE) {
+      data.resize(static_cast<size_t>(frame.header.length));
+    }
+    if (data.empty() || !decompressFramePayload(frame, data.data())) {
+      spdlog::error("Corrupt compressed data frame at offset {}",
+                    frame.header.offset);
+      if (onErrorHandler_) {
+        onErrorHandler_("Corrupt compressed data frame");
+      }
+      return;
+    }
+    if (onBinaryMessageHandler_) {
+      onBinaryMessageHandler_(data);
+    }
+    return;
+  }
+
+  // Control replies are rare; hand them on in their JSON form
+  nlohmann::json j;
+  switch (frame.header.type) {
+  case BinaryFrameType::STARTED:
+    j["type"] = "STARTED";
+    j["message"] = "Stream started successfully";
+    j["streamId"] = std::string(frame.text);
+    j["chunkSize"] = frame.header.chunkSize;
+    j["minChunkSize"] = frame.header.minChunkSize;
+    j["maxChunkSize"] = frame.header.maxChunkSize;
+    j["handle"] = frame.header.handle;
+    if (frame.payloadSize == HAVE_NONCE_BYTES) {
+      j["nonce"] = sha256::toHex(frame.payload, frame.payloadSize);
+    }
+    break;
+  case BinaryFrameType::STOPPED:
+    j["type"] = "STOPPED";
+    j["message"] = "Stream stopped successfully";
+    j["streamId"] = std::string(frame.text);
+    j["crc32c"] = crc32c::toHex(frame.header.checksum);
+    break;
+  case BinaryFrameType::RESUMED:
+    j["type"] = "RESUMED";
+    j["message"] = "Stream resumed successfully";
+    j["streamId"] = std::string(frame.text);
+    j["offset"] = frame.header.offset;
+    j["chunkSize"] = frame.header.chunkSize;
+    j["minChunkSize"] = frame.header.minChunkSize;
+    j["maxChunkSize"] = frame.header.maxChunkSize;
+    j["handle"] = frame.header.handle;
+    if (frame.payloadSize == HAVE_NONCE_BYTES) {
+      j["nonce"] = sha256::toHex(frame.payload, frame.payloadSize);
+    }
+    break;
+  case BinaryFrameType::ATTACHED:
+    j["type"] = "ATTACHED";
+    j["message"] = "Stream attached successfully";
+    j["streamId"] = std::string(frame.text);
+    j["chunkSize"] = frame.header.chunkSize;
+    j["minChunkSize"] = frame.header.minChunkSize;
+    j["maxChunkSize"] = frame.header.maxChunkSize;
+    j["handle"] = frame.header.handle;
+    break;
+  case BinaryFrameType::DETACHED:
+    j["type"] = "DETACHED";
+    j["message"] = "Stream detached successfully";
+    j["streamId"] = std::string(frame.text);
+    break;
+  case BinaryFrameType::STREAMED:
+    j["type"] = "STREAMED";
+    j["message"] = "Range streamed successfully";
+    j["streamId"] = std::string(frame.text);
+    j["offset"] = frame.header.offset;
+    j["length"] = frame.header.length;
+    break;
+  case BinaryFrameType::HAS:
+    j["type"] = "HAS";
+    j["streamId"] = std::string(frame.text);
+    j["offset"] = frame.header.offset;
+    j["length"] = frame.header.length;
+    break;
+  case BinaryFrameType::CREDIT:
+    j["type"] = "CREDIT";
+    j["streamId"] = std::string(frame.text);
+    j["offset"] = frame.header.offset;
+    j["length"] = frame.header.length;
+    break;
+  case BinaryFrameType::ERROR_MSG:
+    j["type"] = "error";
+    j["message"] = std::string(frame.text);
+    if (frame.header.offset > 0) {
+      j["retryAfterMs"] = frame.header.offset;
+    }
+    break;
+  case BinaryFrameType::HELLO:
+    j["type"] = "HELLO";
+    j["capabilities"] = frame.header.offset;
+    j["maxPutSize"] = frame.header.length;
+    break;
+  case BinaryFrameType::STATS:
+    j["type"] = "STATS";
+    j["stats"] = nlohmann::json::parse(frame.payload,
+                                       frame.payload + frame.payloadSize,
+                                       nullptr, false);
+    break;
+  default:
+    spdlog::warn("Unexpected binary frame type {}",
+                 static_cast<int>(frame.header.type));
+    return;
+  }
+
+  if (frame.header.handle != 0 && !j.contains("handle")) {
+    j["handle"] = frame.header.handle; // Reply to a tagged request
+  }
+
+  if (onMessageHandler_) {
+    onMessageHandler_(j.dump());
+  }
+}
+
+size_t WebSocketClient::getBufferedAmount() const {
+  if (!connected_) {
+    return 0;
+  }
+
+  try {
+    // Need to cast away const to call get_con_from_hdl
+    auto &nonConstClient = const_cast<WebSocketClient_t &>(client_);
+    websocketpp::lib::error_code ec;
+    auto con = nonConstClient.get_con_from_hdl(connection_, ec);
+    if (ec || !con) {
+      return 0;
+    }
+    return con->get_buffered_amount();
+  } catch (const std::exception &e) {
+    spdlog::debug("Exception reading buffered amount: {}", e.what());
+    return 0;
+  }
+}
+
 void WebSocketClient::setOnMessage(
     std::function<void(const std::string &)> handler) {
   onMessageHandler_ = handler;
@@ -209,8 +462,22 @@ void WebSocketClient::setOnError(
 
 void WebSocketClient::onOpen(ConnectionHdl hdl) {
   connection_ = hdl;
+
+  websocketpp::lib::error_code ec;
+  auto con = client_.get_con_from_hdl(hdl, ec);
+  std::optional<CompressionCodec> codec;
+  if (!ec) {
+    codec = binaryProtocolCodec(con->get_subprotocol());
+  }
+  binaryProtocol_ = codec.has_value();
+  compression_ = codec.value_or(CompressionCodec::NONE);
+
   connected_ = true;
-  spdlog::info("Connection opened successfully");
+  spdlog::info("Connection opened successfully (protocol: {}{})",
+               binaryProtocol_ ? "binary" : "JSON",
+               compression_ != CompressionCodec::NONE
+                   ? ", " + compressionCodecToString(compression_)
+                   : std::string());
 }
 
 void WebSocketClient::onClose([[maybe_unused]] ConnectionHdl hdl) {
@@ -0,0 +1,79 @@
+#include "util/block_checksums.h"
+#include "crc32c.h"
+#include <algorithm>
+
+namespace audio_stream {
+
+BlockChecksums::BlockChecksums(size_t blockSize)
+    : blockSize_(blockSize > 0 ? blockSize : DEFAULT_BLOCK_SIZE) {}
+
+void BlockChecksums::reset() {
+  blocks_.clear();
+  current_ = 0;
+  currentLength_ = 0;
+  totalBytes_ = 0;
+}
+
+void BlockChecksums::update(const uint8_t *data, size_t length) {
+  totalBytes_ += length;
+  while (length > 0) {
+    size_t take = std::min(length, blockSize_ - currentLength_);
+    current_ = crc32c::extend(current_, data, take);
+    currentLength_ += take;
+    data += take;
+    length -= take;
+
+    if (currentLength_ == blockSize_) {
+      blocks_.push_back(current_);
+      current_ = 0;
+      currentLength_ = 0;
+    }
+  }
+}
+
+uint64_t BlockChecksums::truncate(uint64_t length) {
+  if (length >= totalBytes_) {
+    return totalBytes_;
+  }
+  blocks_.resize(static_cast<size_t>(length / blockSize_));
+  current_ = 0;
+  currentLength_ = 0;
+  totalBytes_ = static_cast<uint64_t>(blocks_.size()) * blockSize_;
+  return totalBytes_;
+}
+
+bool BlockChecksums::append(const BlockChecksums &next) {
+  if (currentLength_ > 0 || next.blockSize_ != blockSize_) {
+    return false;
+  }
+  blocks_.insert(blocks_.end(), next.blocks_.begin(), next.blocks_.end());
+  current_ = next.current_;
+  currentLength_ = next.currentLength_;
+  totalBytes_ += next.totalBytes_;
+  return true;
+}
+
+uint32_t BlockChecksums::getChecksum() const {
+  uint32_t crc = 0;
+  for (uint32_t block : blocks_) {
+    crc = crc32c::combine(crc, block, blockSize_);
+  }
+  return crc32c::combine(crc, current_, currentLength_);
+}
+
+size_t BlockChecksums::getBlockCount() const {
+  return blocks_.size() + (currentLength_ > 0 ? 1 : 0);
+}
+
+uint32_t BlockChecksums::getBlockChecksum(size_t index) const {
+  return index < blocks_.size() ? blocks_[index] : current_;
+}
+
+size_t BlockChecksums::getBlockLength(size_t index) const {
+  if (index < blocks_.size()) {
+    return blockSize_;
+  }
+  return index == blocks_.size() ? currentLength_ : 0;
+}
+
+} // namespace audio_stream
@@ -0,0 +1,67 @@
+#include "util/chunk_ring.h"
+
+namespace audio_stream {
+
+ChunkRing::ChunkRing(size_t slotCount) : slots_(slotCount > 0 ? slotCount : 1) {
+  for (auto &slot : slots_) {
+    free_.push_back(&slot);
+  }
+}
+
+ChunkRing::Slot *ChunkRing::acquireFree() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  freeCv_.wait(lock, [this] { return cancelled_ || !free_.empty(); });
+  if (cancelled_) {
+    return nullptr;
+  }
+  Slot *slot = free_.front();
+  free_.pop_front();
+  return slot;
+}
+
+void ChunkRing::publish(Slot *slot) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    filled_.push_back(slot);
+  }
+  filledCv_.notify_one();
+}
+
+void ChunkRing::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+  }
+  filledCv_.notify_all();
+}
+
+ChunkRing::Slot *ChunkRing::acquireFilled() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  filledCv_.wait(lock,
+                 [this] { return cancelled_ || closed_ || !filled_.empty(); });
+  if (cancelled_ || filled_.empty()) {
+    return nullptr;
+  }
+  Slot *slot = filled_.front();
+  filled_.pop_front();
+  return slot;
+}
+
+void ChunkRing::recycle(Slot *slot) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(slot);
+  }
+  freeCv_.notify_one();
+}
+
+void ChunkRing::cancel() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelled_ = true;
+  }
+  freeCv_.notify_all();
+  filledCv_.notify_all();
+}
+
+} // namespace audio_stream
@@ -0,0 +1,86 @@
+#include "util/chunk_size_tuner.h"
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+namespace audio_stream {
+
+ChunkSizeTuner::ChunkSizeTuner(size_t initialChunkSize, size_t minChunkSize,
+                               size_t maxChunkSize)
+    : chunkSize_(initialChunkSize), minChunkSize_(minChunkSize),
+      maxChunkSize_(std::max(minChunkSize, maxChunkSize)) {
+  chunkSize_ = clampToLimits(chunkSize_);
+}
+
+void ChunkSizeTuner::setLimits(size_t minChunkSize, size_t maxChunkSize) {
+  minChunkSize_ = minChunkSize;
+  maxChunkSize_ = std::max(minChunkSize, maxChunkSize);
+  chunkSize_ = clampToLimits(chunkSize_);
+}
+
+void ChunkSizeTuner::setChunkSize(size_t chunkSize) {
+  chunkSize_ = clampToLimits(chunkSize);
+}
+
+void ChunkSizeTuner::recordThroughput(size_t bytes, Duration elapsed) {
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  if (bytes == 0 || seconds <= 0.0) {
+    return;
+  }
+
+  double sample = static_cast<double>(bytes) / seconds;
+  throughputBytesPerSec_ =
+      throughputBytesPerSec_ == 0.0
+          ? sample
+          : SMOOTHING * sample + (1.0 - SMOOTHING) * throughputBytesPerSec_;
+  retune();
+}
+
+void ChunkSizeTuner::recordRoundTrip(Duration rtt) {
+  double sample = std::chrono::duration<double>(rtt).count();
+  if (sample <= 0.0) {
+    return;
+  }
+
+  // Pipelined requests queue behind each other, so only the fastest round
+  // trip reflects the path itself
+  if (rttSeconds_ == 0.0 || sample < rttSeconds_) {
+    rttSeconds_ = sample;
+  }
+}
+
+void ChunkSizeTuner::retune() {
+  if (!adaptive_ || throughputBytesPerSec_ == 0.0) {
+    return;
+  }
+
+  // Cover twice the bandwidth-delay product shared by the pipeline so the
+  // measured rate can keep climbing, and never drop below the size that
+  // keeps frames at least MIN_CHUNK_INTERVAL_SEC apart
+  double bdpTarget = 2.0 * throughputBytesPerSec_ * rttSeconds_ /
+                     static_cast<double>(pipelineDepth_);
+  double rateTarget = throughputBytesPerSec_ * MIN_CHUNK_INTERVAL_SEC;
+  double target = std::max(bdpTarget, rateTarget);
+
+  // Move one power-of-two step at a time; shrinking needs a 2x margin so
+  // the size does not oscillate between neighbouring steps
+  size_t next = chunkSize_;
+  if (target > static_cast<double>(chunkSize_)) {
+    next = chunkSize_ * 2;
+  } else if (target < static_cast<double>(chunkSize_) / 4.0) {
+    next = chunkSize_ / 2;
+  }
+  next = clampToLimits(next);
+
+  if (next != chunkSize_) {
+    spdlog::debug("Chunk size {} -> {} (throughput {:.1f} MB/s, rtt {:.2f} ms)",
+                  chunkSize_, next, throughputBytesPerSec_ / (1024 * 1024),
+                  rttSeconds_ * 1000.0);
+    chunkSize_ = next;
+  }
+}
+
+size_t ChunkSizeTuner::clampToLimits(size_t chunkSize) const {
+  return std::min(std::max(chunkSize, minChunkSize_), maxChunkSize_);
+}
+
+} // namespace audio_stream
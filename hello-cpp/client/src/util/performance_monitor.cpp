@@ -1,42 +1,163 @@
 #include "util/performance_monitor.h"
+#include <cmath>
 #include <iomanip>
 #include <spdlog/spdlog.h>
 #include <sstream>
 
 namespace audio_stream {
 
+namespace {
+
+double toMicros(uint64_t nanos) { return static_cast<double>(nanos) / 1000.0; }
+
+} // namespace
+
+void ThroughputSeries::start(std::chrono::steady_clock::time_point start) {
+  start_ = start;
+  interval_ = DEFAULT_INTERVAL;
+  bytes_.clear();
+}
+
+void ThroughputSeries::add(std::chrono::steady_clock::time_point at,
+                           size_t bytes) {
+  auto elapsed = at > start_ ? at - start_ : std::chrono::nanoseconds(0);
+  size_t slot = static_cast<size_t>(elapsed / interval_);
+  while (slot >= MAX_POINTS) {
+    // Halve the resolution: slot i and i + 1 become slot i / 2
+    for (size_t i = 0; i < bytes_.size(); ++i) {
+      bytes_[i / 2] = (i % 2 == 0 ? 0 : bytes_[i / 2]) + bytes_[i];
+    }
+    bytes_.resize((bytes_.size() + 1) / 2);
+    interval_ *= 2;
+    slot = static_cast<size_t>(elapsed / interval_);
+  }
+  if (slot >= bytes_.size()) {
+    bytes_.resize(slot + 1, 0);
+  }
+  bytes_[slot] += bytes;
+}
+
+nlohmann::json ThroughputSeries::toJson() const {
+  double seconds = std::chrono::duration<double>(interval_).count();
+  nlohmann::json mbps = nlohmann::json::array();
+  for (uint64_t bytes : bytes_) {
+    mbps.push_back(std::round(bytes * 8.0 / seconds / 1e4) / 100.0);
+  }
+  return {{"intervalMs", interval_.count()}, {"mbps", mbps}};
+}
+
 void PerformanceMonitor::startUpload() {
   metrics_.uploadStartTime = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(samplesMutex_);
+    uploadChunks_ = LatencyHistogram();
+    uploadSeries_.start(metrics_.uploadStartTime);
+  }
   spdlog::debug("Upload started at timestamp");
 }
 
-void PerformanceMonitor::endUpload(size_t bytes) {
+void PerformanceMonitor::endUpload(size_t bytes, size_t connections) {
   metrics_.uploadEndTime = std::chrono::steady_clock::now();
   metrics_.uploadBytes = bytes;
+  metrics_.uploadConnections = connections;
   metrics_.uploadThroughputMbps = calculateThroughputMbps(
       bytes, metrics_.uploadStartTime, metrics_.uploadEndTime);
 
-  spdlog::info("Upload completed: {} bytes, {:.2f} Mbps", bytes,
-               metrics_.uploadThroughputMbps);
+  spdlog::info("Upload completed: {} bytes, {:.2f} Mbps over {} connection(s)",
+               bytes, metrics_.uploadThroughputMbps, connections);
 }
 
 void PerformanceMonitor::startDownload() {
   metrics_.downloadStartTime = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(samplesMutex_);
+    downloadChunks_ = LatencyHistogram();
+    roundTrips_ = LatencyHistogram();
+    downloadSeries_.start(metrics_.downloadStartTime);
+  }
   spdlog::debug("Download started at timestamp");
 }
 
-void PerformanceMonitor::endDownload(size_t bytes) {
+void PerformanceMonitor::endDownload(size_t bytes, size_t connections) {
   metrics_.downloadEndTime = std::chrono::steady_clock::now();
   metrics_.downloadBytes = bytes;
+  metrics_.downloadConnections = connections;
   metrics_.downloadThroughputMbps = calculateThroughputMbps(
       bytes, metrics_.downloadStartTime, metrics_.downloadEndTime);
 
-  spdlog::info("Download completed: {} bytes, {:.2f} Mbps", bytes,
-               metrics_.downloadThroughputMbps);
+  spdlog::info(
+      "Download completed: {} bytes, {:.2f} Mbps over {} connection(s)", bytes,
+      metrics_.downloadThroughputMbps, connections);
+}
+
+void PerformanceMonitor::recordUploadChunk(size_t bytes,
+                                           std::chrono::nanoseconds sendTime) {
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(samplesMutex_);
+  uploadChunks_.record(static_cast<uint64_t>(sendTime.count()));
+  uploadSeries_.add(now, bytes);
+}
+
+void PerformanceMonitor::recordDownloadChunk(size_t bytes,
+                                             std::chrono::nanoseconds gap) {
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(samplesMutex_);
+  downloadChunks_.record(static_cast<uint64_t>(gap.count()));
+  downloadSeries_.add(now, bytes);
+}
+
+void PerformanceMonitor::recordRoundTrip(std::chrono::nanoseconds roundTrip) {
+  std::lock_guard<std::mutex> lock(samplesMutex_);
+  roundTrips_.record(static_cast<uint64_t>(roundTrip.count()));
 }
 
 PerformanceMetrics PerformanceMonitor::getMetrics() const { return metrics_; }
 
+LatencyHistogram PerformanceMonitor::getUploadChunkHistogram() const {
+  std::lock_guard<std::mutex> lock(samplesMutex_);
+  return uploadChunks_;
+}
+
+LatencyHistogram PerformanceMonitor::getDownloadChunkHistogram() const {
+  std::lock_guard<std::mutex> lock(samplesMutex_);
+  return downloadChunks_;
+}
+
+LatencyHistogram PerformanceMonitor::getRoundTripHistogram() const {
+  std::lock_guard<std::mutex> lock(samplesMutex_);
+  return roundTrips_;
+}
+
+nlohmann::json PerformanceMonitor::toJson() const {
+  auto durationMs = [](std::chrono::steady_clock::time_point start,
+                       std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
+        .count();
+  };
+
+  std::lock_guard<std::mutex> lock(samplesMutex_);
+  nlohmann::json j;
+  j["upload"] = {
+      {"bytes", metrics_.uploadBytes},
+      {"durationMs",
+       durationMs(metrics_.uploadStartTime, metrics_.uploadEndTime)},
+      {"throughputMbps", metrics_.uploadThroughputMbps},
+      {"connections", metrics_.uploadConnections},
+      {"chunkSendUs", histogramToJson(uploadChunks_)},
+      {"series", uploadSeries_.toJson()}};
+  j["download"] = {
+      {"bytes", metrics_.downloadBytes},
+      {"durationMs",
+       durationMs(metrics_.downloadStartTime, metrics_.downloadEndTime)},
+      {"throughputMbps", metrics_.downloadThroughputMbps},
+      {"connections", metrics_.downloadConnections},
+      {"chunkGapUs", histogramToJson(downloadChunks_)},
+      {"roundTripUs", histogramToJson(roundTrips_)},
+      {"series", downloadSeries_.toJson()}};
+  j["meetsTargets"] = meetsPerformanceTargets();
+  return j;
+}
+
 std::string PerformanceMonitor::generateReport() const {
   std::ostringstream oss;
   oss << std::fixed << std::setprecision(2);
@@ -52,6 +173,13 @@ std::string PerformanceMonitor::generateReport() const {
     oss << "  Bytes transferred: " << formatBytes(metrics_.uploadBytes) << "\n";
     oss << "  Duration: " << uploadDuration.count() << " ms\n";
     oss << "  Throughput: " << metrics_.uploadThroughputMbps << " Mbps\n";
+    oss << "  Chunk send: " << formatLatencies(getUploadChunkHistogram())
+        << "\n";
+    if (metrics_.uploadConnections > 1) {
+      oss << "  Connections: " << metrics_.uploadConnections << " ("
+          << metrics_.uploadThroughputMbps / metrics_.uploadConnections
+          << " Mbps each)\n";
+    }
     oss << "  Target: >100 Mbps "
         << (metrics_.uploadThroughputMbps >= 100.0 ? "✓ PASS" : "✗ FAIL")
         << "\n";
@@ -72,6 +200,17 @@ std::string PerformanceMonitor::generateReport() const {
         << "\n";
     oss << "  Duration: " << downloadDuration.count() << " ms\n";
     oss << "  Throughput: " << metrics_.downloadThroughputMbps << " Mbps\n";
+    oss << "  Chunk gap: " << formatLatencies(getDownloadChunkHistogram())
+        << "\n";
+    LatencyHistogram roundTrips = getRoundTripHistogram();
+    if (roundTrips.count > 0) {
+      oss << "  GET round trip: " << formatLatencies(roundTrips) << "\n";
+    }
+    if (metrics_.downloadConnections > 1) {
+      oss << "  Connections: " << metrics_.downloadConnections << " ("
+          << metrics_.downloadThroughputMbps / metrics_.downloadConnections
+          << " Mbps each)\n";
+    }
     oss << "  Target: >200 Mbps "
         << (metrics_.downloadThroughputMbps >= 200.0 ? "✓ PASS" : "✗ FAIL")
         << "\n";
@@ -109,12 +248,13 @@ void PerformanceMonitor::logMetricsToFile(const std::string &filePath) const {
     if (file.is_open()) {
       auto now = std::chrono::system_clock::now();
       auto time_t = std::chrono::system_clock::to_time_t(now);
+      std::ostringstream timestamp;
+      timestamp << std::put_time(std::localtime(&time_t), "%Y-%m-%dT%H:%M:%S");
 
-      file << "=== Performance Log Entry ===\n";
-      file << "Timestamp: "
-           << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S")
-           << "\n";
-      file << generateReport() << "\n";
+      // One JSON document per line, so runs can be appended and compared
+      nlohmann::json entry = toJson();
+      entry["timestamp"] = timestamp.str();
+      file << entry.dump() << "\n";
 
       spdlog::debug("Performance metrics logged to file: {}", filePath);
     } else {
@@ -150,6 +290,29 @@ double PerformanceMonitor::calculateThroughputMbps(
   return mbps;
 }
 
+nlohmann::json
+PerformanceMonitor::histogramToJson(const LatencyHistogram &histogram) {
+  return {{"count", histogram.count},
+          {"mean", toMicros(static_cast<uint64_t>(histogram.mean()))},
+          {"p50", toMicros(histogram.percentile(0.5))},
+          {"p90", toMicros(histogram.percentile(0.9))},
+          {"p99", toMicros(histogram.percentile(0.99))},
+          {"p999", toMicros(histogram.percentile(0.999))},
+          {"max", toMicros(histogram.max)}};
+}
+
+std::string
+PerformanceMonitor::formatLatencies(const LatencyHistogram &histogram) {
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(2);
+  oss << "p50 " << toMicros(histogram.percentile(0.5)) / 1000.0 << " ms, p99 "
+      << toMicros(histogram.percentile(0.99)) / 1000.0 << " ms, p99.9 "
+      << toMicros(histogram.percentile(0.999)) / 1000.0 << " ms, max "
+      << toMicros(histogram.max) / 1000.0 << " ms (" << histogram.count
+      << " samples)";
+  return oss.str();
+}
+
 std::string PerformanceMonitor::formatBytes(size_t bytes) const {
   std::ostringstream oss;
   oss << std::fixed << std::setprecision(2);
@@ -0,0 +1,65 @@
+#include "util/response_correlator.h"
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+namespace audio_stream {
+
+ResponseCorrelator::Ticket
+ResponseCorrelator::expect(const std::string &responseType,
+                           const std::string &streamId) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Ticket ticket = nextTicket_++;
+  Pending &pending = pending_[ticket];
+  pending.responseType = responseType;
+  pending.streamId = streamId;
+  return ticket;
+}
+
+std::optional<std::string>
+ResponseCorrelator::waitFor(Ticket ticket, std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = pending_.find(ticket);
+  if (it == pending_.end()) {
+    return std::nullopt;
+  }
+
+  cv_.wait_for(lock, timeout, [&] { return it->second.response.has_value(); });
+
+  std::optional<std::string> response = std::move(it->second.response);
+  if (!response) {
+    spdlog::warn("Timeout waiting for {} response", it->second.responseType);
+  }
+  pending_.erase(it);
+  return response;
+}
+
+bool ResponseCorrelator::dispatch(const std::string &message) {
+  std::string type;
+  std::string streamId;
+  try {
+    nlohmann::json j = nlohmann::json::parse(message);
+    type = j.value("type", "");
+    streamId = j.value("streamId", "");
+  } catch (const std::exception &e) {
+    spdlog::debug("Ignoring unparseable server message: {}", e.what());
+    return false;
+  }
+
+  bool isError = type == "error" || type == "ERROR";
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &[ticket, pending] : pending_) {
+    if (pending.response) {
+      continue; // Answered, waiter has not collected it yet
+    }
+    bool sameStream = streamId.empty() || pending.streamId == streamId;
+    if (sameStream && (isError || pending.responseType == type)) {
+      pending.response = message;
+      cv_.notify_all();
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace audio_stream
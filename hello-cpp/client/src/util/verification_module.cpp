@@ -1,9 +1,13 @@
 #include "util/verification_module.h"
+#include "crc32c.h"
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
-#include <iomanip>
+#include <future>
+#include <memory>
 #include <spdlog/spdlog.h>
-#include <sstream>
+#include <thread>
+#include <vector>
 
 // Third-party library websocketpp has pointer arithmetic warning in md5.hpp
 // This is a known issue in the library and cannot be fixed without modifying
@@ -15,38 +19,218 @@
 #pragma GCC diagnostic pop
 
 #ifndef WEBSOCKETPP_NO_TLS
-#include <openssl/sha.h>
+#include <openssl/evp.h>
 #endif
 
 namespace audio_stream {
 
+namespace {
+
+std::string toHex(const uint8_t *bytes, size_t length) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex(length * 2, '0');
+  for (size_t i = 0; i < length; ++i) {
+    hex[2 * i] = digits[bytes[i] >> 4];
+    hex[2 * i + 1] = digits[bytes[i] & 0x0F];
+  }
+  return hex;
+}
+
+/**
+ * Incremental digest over a file read in fixed-size blocks
+ */
+class StreamingHasher {
+public:
+  virtual ~StreamingHasher() = default;
+  virtual void update(const uint8_t *data, size_t length) = 0;
+  virtual std::string finish() = 0;
+};
+
+class Md5Hasher : public StreamingHasher {
+public:
+  Md5Hasher() { websocketpp::md5::md5_init(&state_); }
+
+  void update(const uint8_t *data, size_t length) override {
+    websocketpp::md5::md5_append(&state_, data, length);
+  }
+
+  std::string finish() override {
+    websocketpp::md5::md5_byte_t hash[16];
+    websocketpp::md5::md5_finish(&state_, hash);
+    return toHex(hash, sizeof(hash));
+  }
+
+private:
+  websocketpp::md5::md5_state_t state_;
+};
+
+#ifndef WEBSOCKETPP_NO_TLS
+class EvpHasher : public StreamingHasher {
+public:
+  explicit EvpHasher(const EVP_MD *md) : ctx_(EVP_MD_CTX_new()) {
+    if (!ctx_ || EVP_DigestInit_ex(ctx_, md, nullptr) != 1) {
+      throw std::runtime_error("Failed to initialise digest");
+    }
+  }
+  ~EvpHasher() override { EVP_MD_CTX_free(ctx_); }
+
+  void update(const uint8_t *data, size_t length) override {
+    EVP_DigestUpdate(ctx_, data, length);
+  }
+
+  std::string finish() override {
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    EVP_DigestFinal_ex(ctx_, hash, &length);
+    return toHex(hash, length);
+  }
+
+private:
+  EVP_MD_CTX *ctx_;
+};
+#else
+// websocketpp's SHA1 is one-shot, so without OpenSSL the file is buffered
+class BufferedSha1Hasher : public StreamingHasher {
+public:
+  void update(const uint8_t *data, size_t length) override {
+    buffer_.insert(buffer_.end(), data, data + length);
+  }
+
+  std::string finish() override {
+    unsigned char hash[20];
+    websocketpp::sha1::calc(buffer_.data(), buffer_.size(), hash);
+    return toHex(hash, sizeof(hash));
+  }
+
+private:
+  std::vector<uint8_t> buffer_;
+};
+#endif
+
+std::unique_ptr<StreamingHasher>
+makeHasher(VerificationModule::ChecksumAlgorithm algorithm) {
+  using Algorithm = VerificationModule::ChecksumAlgorithm;
+  switch (algorithm) {
+  case Algorithm::MD5:
+    return std::make_unique<Md5Hasher>();
+#ifndef WEBSOCKETPP_NO_TLS
+  case Algorithm::SHA1:
+    return std::make_unique<EvpHasher>(EVP_sha1());
+  case Algorithm::SHA256:
+    return std::make_unique<EvpHasher>(EVP_sha256());
+#else
+  case Algorithm::SHA1:
+    return std::make_unique<BufferedSha1Hasher>();
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+// CRC32C of [offset, offset + length) read through its own stream
+bool crc32cRange(const std::string &filePath, uint64_t offset,
+                 uint64_t length, uint32_t &crc) {
+  std::ifstream file(filePath, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  file.seekg(static_cast<std::streamoff>(offset));
+
+  std::vector<uint8_t> buffer(
+      std::min<uint64_t>(length, VerificationModule::HASH_BUFFER_SIZE));
+  uint32_t value = 0;
+  while (length > 0) {
+    size_t want = static_cast<size_t>(
+        std::min<uint64_t>(length, static_cast<uint64_t>(buffer.size())));
+    file.read(reinterpret_cast<char *>(buffer.data()), want);
+    size_t got = static_cast<size_t>(file.gcount());
+    if (got == 0) {
+      return false; // File shrank underneath us
+    }
+    value = crc32c::extend(value, buffer.data(), got);
+    length -= got;
+  }
+  crc = value;
+  return true;
+}
+
+} // namespace
+
+const char *
+VerificationModule::algorithmName(ChecksumAlgorithm algorithm) {
+  switch (algorithm) {
+  case ChecksumAlgorithm::CRC32C:
+    return "crc32c";
+  case ChecksumAlgorithm::MD5:
+    return "md5";
+  case ChecksumAlgorithm::SHA1:
+    return "sha1";
+  case ChecksumAlgorithm::SHA256:
+    return "sha256";
+  }
+  return "unknown";
+}
+
+bool VerificationModule::parseAlgorithm(const std::string &name,
+                                        ChecksumAlgorithm &algorithm) {
+  for (auto candidate :
+       {ChecksumAlgorithm::CRC32C, ChecksumAlgorithm::MD5,
+        ChecksumAlgorithm::SHA1, ChecksumAlgorithm::SHA256}) {
+    if (name == algorithmName(candidate)) {
+      algorithm = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string VerificationModule::computeCRC32C(const std::string &filePath) {
+  return computeChecksum(filePath, ChecksumAlgorithm::CRC32C);
+}
+
 std::string VerificationModule::computeMD5(const std::string &filePath) {
-  return computeChecksum(filePath, HashAlgorithm::MD5);
+  return computeChecksum(filePath, ChecksumAlgorithm::MD5);
 }
 
 std::string VerificationModule::computeSHA1(const std::string &filePath) {
-  return computeChecksum(filePath, HashAlgorithm::SHA1);
+  return computeChecksum(filePath, ChecksumAlgorithm::SHA1);
 }
 
 std::string VerificationModule::computeSHA256(const std::string &filePath) {
-  return computeChecksum(filePath, HashAlgorithm::SHA256);
+  return computeChecksum(filePath, ChecksumAlgorithm::SHA256);
 }
 
 std::string VerificationModule::computeChecksum(const std::string &filePath,
-                                                HashAlgorithm algorithm) {
-  const char *algorithmName = (algorithm == HashAlgorithm::MD5)    ? "MD5"
-                              : (algorithm == HashAlgorithm::SHA1) ? "SHA1"
-                                                                   : "SHA256";
-
-  spdlog::debug("Computing {} checksum for: {}", algorithmName, filePath);
+                                                ChecksumAlgorithm algorithm) {
+  const char *name = algorithmName(algorithm);
+  spdlog::debug("Computing {} checksum for: {}", name, filePath);
 
   try {
     // Check if file exists
-    if (!std::filesystem::exists(filePath)) {
+    std::error_code ec;
+    uint64_t fileSize = std::filesystem::file_size(filePath, ec);
+    if (ec) {
       spdlog::error("File does not exist: {}", filePath);
       return "";
     }
 
+    if (algorithm == ChecksumAlgorithm::CRC32C) {
+      uint32_t crc = 0;
+      if (!computeFileCRC32C(filePath, fileSize, crc)) {
+        spdlog::error("Failed to read file: {}", filePath);
+        return "";
+      }
+      std::string result = crc32c::toHex(crc);
+      spdlog::debug("crc32c checksum computed: {}", result);
+      return result;
+    }
+
+    auto hasher = makeHasher(algorithm);
+    if (!hasher) {
+      spdlog::error("{} not available (OpenSSL not found)", name);
+      return "";
+    }
+
     // Open file for binary reading
     std::ifstream file(filePath, std::ios::binary);
     if (!file.is_open()) {
@@ -54,92 +238,17 @@ std::string VerificationModule::computeChecksum(const std::string &filePath,
       return "";
     }
 
-    if (algorithm == HashAlgorithm::SHA256) {
-#ifndef WEBSOCKETPP_NO_TLS
-      // Use OpenSSL SHA256
-      file.seekg(0, std::ios::end);
-      size_t fileSize = file.tellg();
-      file.seekg(0, std::ios::beg);
-
-      std::vector<char> buffer(fileSize);
-      file.read(buffer.data(), fileSize);
-
-      // Calculate SHA256
-      unsigned char hash[SHA256_DIGEST_LENGTH];
-      SHA256(reinterpret_cast<const unsigned char *>(buffer.data()), fileSize,
-             hash);
-
-      // Convert to hex string
-      std::stringstream ss;
-      for (int i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
-        ss << std::hex << std::setw(2) << std::setfill('0')
-           << static_cast<int>(hash[i]);
-      }
-
-      std::string result = ss.str();
-      spdlog::debug("SHA256 checksum computed: {}", result);
-      return result;
-#else
-      spdlog::error("SHA256 not available (OpenSSL not found)");
-      return "";
-#endif
-
-    } else if (algorithm == HashAlgorithm::SHA1) {
-      // Use websocketpp SHA1
-      file.seekg(0, std::ios::end);
-      size_t fileSize = file.tellg();
-      file.seekg(0, std::ios::beg);
-
-      std::vector<char> buffer(fileSize);
-      file.read(buffer.data(), fileSize);
-
-      // Calculate SHA1
-      unsigned char hash[20];
-      websocketpp::sha1::calc(buffer.data(), fileSize, hash);
-
-      // Convert to hex string
-      std::stringstream ss;
-      for (int i = 0; i < 20; ++i) {
-        ss << std::hex << std::setw(2) << std::setfill('0')
-           << static_cast<int>(hash[i]);
-      }
-
-      std::string result = ss.str();
-      spdlog::debug("SHA1 checksum computed: {}", result);
-      return result;
-
-    } else {
-      // Use websocketpp MD5
-      websocketpp::md5::md5_state_t md5State;
-      websocketpp::md5::md5_init(&md5State);
-
-      // Read file in chunks and update hash
-      constexpr size_t bufferSize = 8192;
-      char buffer[bufferSize];
-
-      while (file.read(buffer, bufferSize) || file.gcount() > 0) {
-        websocketpp::md5::md5_append(
-            &md5State,
-            reinterpret_cast<const websocketpp::md5::md5_byte_t *>(buffer),
-            file.gcount());
-      }
-
-      // Finalize hash
-      websocketpp::md5::md5_byte_t hash[16];
-      websocketpp::md5::md5_finish(&md5State, hash);
-
-      // Convert to hex string
-      std::stringstream ss;
-      for (int i = 0; i < 16; ++i) {
-        ss << std::hex << std::setw(2) << std::setfill('0')
-           << static_cast<int>(hash[i]);
-      }
-
-      std::string result = ss.str();
-      spdlog::debug("MD5 checksum computed: {}", result);
-      return result;
+    // Hash through a fixed buffer so memory does not grow with the file
+    std::vector<uint8_t> buffer(HASH_BUFFER_SIZE);
+    while (file.read(reinterpret_cast<char *>(buffer.data()), buffer.size()) ||
+           file.gcount() > 0) {
+      hasher->update(buffer.data(), static_cast<size_t>(file.gcount()));
     }
 
+    std::string result = hasher->finish();
+    spdlog::debug("{} checksum computed: {}", name, result);
+    return result;
+
   } catch (const std::exception &e) {
     spdlog::error("Exception while computing checksum for {}: {}", filePath,
                   e.what());
@@ -147,6 +256,47 @@ std::string VerificationModule::computeChecksum(const std::string &filePath,
   }
 }
 
+bool VerificationModule::computeFileCRC32C(const std::string &filePath,
+                                           uint64_t fileSize, uint32_t &crc) {
+  uint64_t threads = std::max(1U, std::thread::hardware_concurrency());
+  uint64_t segments = std::max<uint64_t>(
+      1, std::min(threads, fileSize / PARALLEL_SEGMENT_SIZE));
+  if (segments == 1) {
+    return crc32cRange(filePath, 0, fileSize, crc);
+  }
+
+  // Hash equal segments concurrently and fold their CRCs together in order
+  uint64_t segmentSize = fileSize / segments;
+  std::vector<uint32_t> crcs(segments);
+  std::vector<std::future<bool>> results;
+  results.reserve(segments);
+  for (uint64_t i = 0; i < segments; ++i) {
+    uint64_t offset = i * segmentSize;
+    uint64_t length = (i + 1 == segments) ? fileSize - offset : segmentSize;
+    results.push_back(std::async(std::launch::async, crc32cRange, filePath,
+                                 offset, length, std::ref(crcs[i])));
+  }
+
+  bool ok = true;
+  for (auto &result : results) {
+    ok = result.get() && ok;
+  }
+  if (!ok) {
+    return false;
+  }
+
+  uint32_t value = crcs[0];
+  for (uint64_t i = 1; i < segments; ++i) {
+    uint64_t length = (i + 1 == segments) ? fileSize - i * segmentSize
+                                          : segmentSize;
+    value = crc32c::combine(value, crcs[i], length);
+  }
+  spdlog::debug("crc32c of {} bytes hashed in {} segments", fileSize,
+                segments);
+  crc = value;
+  return true;
+}
+
 bool VerificationModule::compareFiles(const std::string &file1,
                                       const std::string &file2) {
   spdlog::debug("Comparing files: {} vs {}", file1, file2);
@@ -180,9 +330,12 @@ bool VerificationModule::compareFiles(const std::string &file1,
       return false;
     }
 
-    // Compare checksums for thorough verification
-    std::string checksum1 = computeSHA1(file1);
-    std::string checksum2 = computeSHA1(file2);
+    // Compare checksums for thorough verification, hashing both at once
+    auto pending = std::async(std::launch::async, [&] {
+      return computeChecksum(file1, reportAlgorithm_);
+    });
+    std::string checksum2 = computeChecksum(file2, reportAlgorithm_);
+    std::string checksum1 = pending.get();
 
     if (checksum1.empty() || checksum2.empty()) {
       spdlog::error("Failed to compute checksums for comparison");
@@ -208,9 +361,34 @@ VerificationModule::generateReport(const std::string &originalFile,
   spdlog::info("Generating verification report for: {} vs {}", originalFile,
                downloadedFile);
 
+  std::string originalChecksum;
+  std::string downloadedChecksum;
+  try {
+    // Compute checksums, hashing both files at once
+    auto pending = std::async(std::launch::async, [&] {
+      return computeChecksum(originalFile, reportAlgorithm_);
+    });
+    downloadedChecksum = computeChecksum(downloadedFile, reportAlgorithm_);
+    originalChecksum = pending.get();
+  } catch (const std::exception &e) {
+    spdlog::error("Exception while computing checksums: {}", e.what());
+  }
+
+  return generateReport(originalFile, downloadedFile,
+                        algorithmName(reportAlgorithm_), originalChecksum,
+                        downloadedChecksum);
+}
+
+VerificationReport VerificationModule::generateReport(
+    const std::string &originalFile, const std::string &downloadedFile,
+    const std::string &algorithm, const std::string &originalChecksum,
+    const std::string &downloadedChecksum) {
   VerificationReport report;
   report.originalFilePath = originalFile;
   report.downloadedFilePath = downloadedFile;
+  report.checksumAlgorithm = algorithm;
+  report.originalChecksum = originalChecksum;
+  report.downloadedChecksum = downloadedChecksum;
 
   try {
     // Get file sizes
@@ -242,10 +420,6 @@ VerificationModule::generateReport(const std::string &originalFile,
     report.sizesMatch = (report.originalSize == report.downloadedSize &&
                          report.originalSize > 0 && report.downloadedSize > 0);
 
-    // Compute checksums
-    report.originalChecksum = computeSHA1(originalFile);
-    report.downloadedChecksum = computeSHA1(downloadedFile);
-
     // Compare checksums
     report.checksumsMatch =
         (!report.originalChecksum.empty() &&
@@ -257,12 +431,12 @@ VerificationModule::generateReport(const std::string &originalFile,
 
     // Log results
     spdlog::info("Verification Report:");
-    spdlog::info("  Original file: {} ({} bytes, checksum: {})",
+    spdlog::info("  Original file: {} ({} bytes, {}: {})",
                  report.originalFilePath, report.originalSize,
-                 report.originalChecksum);
-    spdlog::info("  Downloaded file: {} ({} bytes, checksum: {})",
+                 report.checksumAlgorithm, report.originalChecksum);
+    spdlog::info("  Downloaded file: {} ({} bytes, {}: {})",
                  report.downloadedFilePath, report.downloadedSize,
-                 report.downloadedChecksum);
+                 report.checksumAlgorithm, report.downloadedChecksum);
     spdlog::info("  Sizes match: {}", report.sizesMatch);
     spdlog::info("  Checksums match: {}", report.checksumsMatch);
     spdlog::info("  Verification passed: {}", report.verificationPassed);
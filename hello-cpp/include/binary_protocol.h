@@ -0,0 +1,326 @@
+#ifndef AUDIO_STREAM_BINARY_PROTOCOL_H
+#define AUDIO_STREAM_BINARY_PROTOCOL_H
+
+#include "compression.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace audio_stream {
+
+/**
+ * Compact binary control protocol, an opt-in alternative to JSON text
+ * frames. A client asks for it by offering BINARY_PROTOCOL as the
+ * WebSocket subprotocol; once the server selects it, every binary frame on
+ * that connection starts with this fixed header, and legacy JSON clients on
+ * other connections are unaffected.
+ *
+ * Header layout (32 bytes, little-endian):
+ *   0  u8   version        BINARY_PROTOCOL_VERSION
+ *   1  u8   type           BinaryFrameType
+ *   2  u16  textLength     bytes of streamId (or error message) that follow
+ *   4  u32  chunkSize      START/STREAM: requested, STARTED/RESUMED/
+ *                          ATTACHED: negotiated; COMPRESSED_DATA: codec
+ *                          (byte 4) and PCM16 filter channels (byte 5)
+ *   8  u64  offset         GET/DATA/STREAM/STREAMED/HAVE/HAS: byte offset,
+ *                          RESUMED/CREDIT: bytes written,
+ *                          START/RESUME: flow control window (0 = none),
+ *                          ERROR: retry after, in ms (0 = do not retry),
+ *                          HELLO reply: capability bits
+ *   16 u64  length         GET/STREAM/HAVE: requested bytes,
+ *                          STREAMED: bytes sent, HAS: bytes stored,
+ *                          COMPRESSED_DATA: payload bytes once decompressed,
+ *                          START/PUT: Durability tier (0 = server default),
+ *                          STARTED/RESUMED/ATTACHED: stream handle,
+ *                          CREDIT: window past the bytes written,
+ *                          HELLO reply: largest PUT
+ *   24 u32  minChunkSize   STARTED/RESUMED/ATTACHED; STOPPED: CRC32C of the
+ *                          stream; all other types: stream handle
+ *   28 u32  maxChunkSize   STARTED/RESUMED/ATTACHED
+ * followed by textLength bytes of text and then the payload.
+ *
+ * A connection may carry many streams at once. STARTED and RESUMED assign
+ * each a handle, unique on that connection, which tags its upload DATA
+ * frames; handle 0 selects the stream started or resumed last, so clients
+ * that leave the field zero see one stream per connection as before. GET
+ * and STREAM may carry any handle, and the DATA, STREAMED and ERROR frames
+ * answering them repeat it.
+ *
+ * A GET reply is a DATA frame carrying the requested offset together with
+ * the bytes, so header and payload travel in one frame. Upload chunks are
+ * DATA frames with an empty text field, written at their offset whatever
+ * order they arrive in. A STREAM reply is a run of DATA frames followed by
+ * one STREAMED frame.
+ *
+ * PUT stores a whole small stream in one frame, in place of START, DATA
+ * and STOP: text is the streamId and the payload the stream's bytes. It is
+ * answered by STOPPED with the stream's CRC32C, or by ERROR; payloads
+ * larger than the server's maximum chunk size must be uploaded with START.
+ *
+ * START and RESUME may ask for flow control with a window. The server then
+ * sends CREDIT before STARTED or RESUMED, and again as it writes: the
+ * client may send the stream's bytes up to offset + length of the latest
+ * CREDIT, and no further. An ERROR refusing a START or PUT for load
+ * carries the time after which the client may try again.
+ *
+ * STATS asks for the server's metrics; the STATS reply carries them as a
+ * JSON document in its payload (text stays empty, it may exceed 64KB).
+ *
+ * With CAPABILITY_ATTACH, ATTACH lets another connection write an
+ * UPLOADING stream too, without taking it from the connection that started
+ * it: ATTACHED assigns that connection a handle, and its DATA frames must
+ * carry their offsets. DETACH ends it and is answered by DETACHED once the
+ * connection's chunks are written; the owner's STOP comes after the
+ * DETACHED of every attached connection, so it finds all of their bytes.
+ *
+ * HELLO asks which optional messages the server takes (CAPABILITY_* in
+ * common_types.h); the reply is a HELLO with them. A server older than
+ * HELLO refuses the unknown frame type with an ERROR.
+ *
+ * STARTED and RESUMED carry the upload's nonce, HAVE_NONCE_BYTES, as their
+ * payload. With CAPABILITY_HAVE a client may offer a block of the upload
+ * (HAVE_BLOCK_SIZE bytes at a multiple of it) by a HAVE: offset and length
+ * name the block, the payload is its SHA-256 followed by SHA-256 of the
+ * nonce and the block. If a stream the server holds has a block of that
+ * digest, and the proof matches it, the server writes it at offset as if
+ * the client had sent it. HAS answers with the bytes stored, 0 when the
+ * client must send the block's DATA itself.
+ *
+ * Offering BINARY_PROTOCOL with a codec suffix (compressedBinaryProtocol,
+ * e.g. "audio-stream.binary.v1+lz4") also allows COMPRESSED_DATA in both
+ * directions in place of DATA: the same frame with its payload compressed
+ * by compressBlock. A client offers the codecs it has, best first, before
+ * plain BINARY_PROTOCOL; the server selects the first it has too. Senders
+ * fall back to DATA for payloads that do not shrink, and skip streams
+ * whose profile is not compressible (compressed audio formats).
+ */
+constexpr const char *BINARY_PROTOCOL = "audio-stream.binary.v1";
+constexpr uint8_t BINARY_PROTOCOL_VERSION = 1;
+constexpr size_t BINARY_FRAME_HEADER_SIZE = 32;
+
+enum class BinaryFrameType : uint8_t {
+  START = 1,
+  STARTED = 2,
+  STOP = 3,
+  STOPPED = 4,
+  GET = 5,
+  DATA = 6,
+  ERROR_MSG = 7,
+  RESUME = 8,
+  RESUMED = 9,
+  STREAM = 10,
+  STREAMED = 11,
+  COMPRESSED_DATA = 12,
+  STATS = 13,
+  PUT = 14,
+  CREDIT = 15,
+  HELLO = 16,
+  HAVE = 17,
+  HAS = 18,
+  ATTACH = 19,
+  ATTACHED = 20,
+  DETACH = 21,
+  DETACHED = 22
+};
+
+struct BinaryFrameHeader {
+  BinaryFrameType type = BinaryFrameType::DATA;
+  uint32_t chunkSize = 0;
+  uint64_t offset = 0;
+  uint64_t length = 0;
+  uint32_t minChunkSize = 0;
+  uint32_t maxChunkSize = 0;
+  uint32_t checksum = 0; // STOPPED only, shares bytes 24..27
+  uint32_t handle = 0;   // Stream handle, see the layout above
+  // COMPRESSED_DATA only, share bytes 4..5
+  CompressionCodec codec = CompressionCodec::NONE;
+  uint8_t pcm16Channels = 0;
+};
+
+// Subprotocol that offers BINARY_PROTOCOL with COMPRESSED_DATA in codec
+inline std::string compressedBinaryProtocol(CompressionCodec codec) {
+  return std::string(BINARY_PROTOCOL) + "+" + compressionCodecToString(codec);
+}
+
+/**
+ * Codec of a negotiated subprotocol: NONE for plain BINARY_PROTOCOL,
+ * nullopt if it is not the binary protocol or the codec is unknown here.
+ */
+inline std::optional<CompressionCodec>
+binaryProtocolCodec(std::string_view subprotocol) {
+  std::string_view base(BINARY_PROTOCOL);
+  if (subprotocol.substr(0, base.size()) != base) {
+    return std::nullopt;
+  }
+  if (subprotocol.size() == base.size()) {
+    return CompressionCodec::NONE;
+  }
+  if (subprotocol[base.size()] != '+') {
+    return std::nullopt;
+  }
+  auto codec = parseCompressionCodec(subprotocol.substr(base.size() + 1));
+  if (!codec || *codec == CompressionCodec::NONE ||
+      !isCodecAvailable(*codec)) {
+    return std::nullopt;
+  }
+  return codec;
+}
+
+/**
+ * Whether bytes 24..31 carry the chunk size range; the stream handle then
+ * moves to the length field.
+ */
+inline bool carriesChunkSizeLimits(BinaryFrameType type) {
+  return type == BinaryFrameType::STARTED ||
+         type == BinaryFrameType::RESUMED || type == BinaryFrameType::ATTACHED;
+}
+
+/**
+ * A decoded frame. text and payload point into the received buffer, so
+ * decoding never allocates; they are valid as long as that buffer is.
+ */
+struct BinaryFrame {
+  BinaryFrameHeader header;
+  std::string_view text;
+  const uint8_t *payload = nullptr;
+  size_t payloadSize = 0;
+};
+
+namespace binary_detail {
+
+inline void putLe(uint8_t *out, uint64_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) {
+    out[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+inline uint64_t getLe(const uint8_t *in, size_t bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) {
+    value |= static_cast<uint64_t>(in[i]) << (8 * i);
+  }
+  return value;
+}
+
+} // namespace binary_detail
+
+/**
+ * Write the fixed header for a frame whose text field is textLength bytes.
+ * @param out Destination of at least BINARY_FRAME_HEADER_SIZE bytes
+ */
+inline void encodeBinaryFrameHeader(uint8_t *out,
+                                    const BinaryFrameHeader &header,
+                                    uint16_t textLength) {
+  using binary_detail::putLe;
+  putLe(out + 0, BINARY_PROTOCOL_VERSION, 1);
+  putLe(out + 1, static_cast<uint8_t>(header.type), 1);
+  putLe(out + 2, textLength, 2);
+  putLe(out + 4,
+        header.type == BinaryFrameType::COMPRESSED_DATA
+            ? static_cast<uint32_t>(header.codec) |
+                  static_cast<uint32_t>(header.pcm16Channels) << 8
+            : header.chunkSize,
+        4);
+  putLe(out + 8, header.offset, 8);
+  bool limits = carriesChunkSizeLimits(header.type);
+  putLe(out + 16, limits ? header.handle : header.length, 8);
+  putLe(out + 24,
+        header.type == BinaryFrameType::STOPPED ? header.checksum
+        : limits                                ? header.minChunkSize
+                                                : header.handle,
+        4);
+  putLe(out + 28, header.maxChunkSize, 4);
+}
+
+/**
+ * Encode a complete frame into one buffer (control frames and tests; the
+ * data paths append header and payload to the socket message separately).
+ */
+inline std::vector<uint8_t> encodeBinaryFrame(const BinaryFrameHeader &header,
+                                              std::string_view text = {},
+                                              const uint8_t *payload = nullptr,
+                                              size_t payloadSize = 0) {
+  if (text.size() > UINT16_MAX) {
+    text = text.substr(0, UINT16_MAX);
+  }
+  std::vector<uint8_t> frame(BINARY_FRAME_HEADER_SIZE + text.size() +
+                             payloadSize);
+  encodeBinaryFrameHeader(frame.data(), header,
+                          static_cast<uint16_t>(text.size()));
+  std::copy(text.begin(), text.end(),
+            frame.begin() + BINARY_FRAME_HEADER_SIZE);
+  if (payloadSize > 0) {
+    std::copy(payload, payload + payloadSize,
+              frame.begin() + BINARY_FRAME_HEADER_SIZE + text.size());
+  }
+  return frame;
+}
+
+/**
+ * Decode a frame in place.
+ * @return false if the frame is truncated, has an unknown version or type
+ */
+inline bool decodeBinaryFrame(const uint8_t *data, size_t size,
+                              BinaryFrame &frame) {
+  using binary_detail::getLe;
+  if (size < BINARY_FRAME_HEADER_SIZE ||
+      getLe(data, 1) != BINARY_PROTOCOL_VERSION) {
+    return false;
+  }
+
+  uint8_t type = static_cast<uint8_t>(getLe(data + 1, 1));
+  if (type < static_cast<uint8_t>(BinaryFrameType::START) ||
+      type > static_cast<uint8_t>(BinaryFrameType::DETACHED)) {
+    return false;
+  }
+
+  size_t textLength = static_cast<size_t>(getLe(data + 2, 2));
+  if (size - BINARY_FRAME_HEADER_SIZE < textLength) {
+    return false;
+  }
+
+  frame.header.type = static_cast<BinaryFrameType>(type);
+  frame.header.chunkSize = static_cast<uint32_t>(getLe(data + 4, 4));
+  bool compressed = frame.header.type == BinaryFrameType::COMPRESSED_DATA;
+  frame.header.codec = compressed ? static_cast<CompressionCodec>(
+                                        frame.header.chunkSize & 0xFF)
+                                  : CompressionCodec::NONE;
+  frame.header.pcm16Channels =
+      compressed ? static_cast<uint8_t>(frame.header.chunkSize >> 8) : 0;
+  frame.header.offset = getLe(data + 8, 8);
+  uint64_t length = getLe(data + 16, 8);
+  uint32_t word24 = static_cast<uint32_t>(getLe(data + 24, 4));
+  bool stopped = frame.header.type == BinaryFrameType::STOPPED;
+  bool limits = carriesChunkSizeLimits(frame.header.type);
+  frame.header.length = limits ? 0 : length;
+  frame.header.minChunkSize = limits ? word24 : 0;
+  frame.header.checksum = stopped ? word24 : 0;
+  frame.header.handle = limits    ? static_cast<uint32_t>(length)
+                        : stopped ? 0
+                                  : word24;
+  frame.header.maxChunkSize = static_cast<uint32_t>(getLe(data + 28, 4));
+  frame.text = std::string_view(
+      reinterpret_cast<const char *>(data + BINARY_FRAME_HEADER_SIZE),
+      textLength);
+  frame.payload = data + BINARY_FRAME_HEADER_SIZE + textLength;
+  frame.payloadSize = size - BINARY_FRAME_HEADER_SIZE - textLength;
+  return true;
+}
+
+/**
+ * Decompress the payload of a COMPRESSED_DATA frame.
+ * @param out Destination of frame.header.length bytes
+ */
+inline bool decompressFramePayload(const BinaryFrame &frame, uint8_t *out) {
+  return decompressBlock(frame.header.codec, frame.payload, frame.payloadSize,
+                         out, static_cast<size_t>(frame.header.length),
+                         frame.header.pcm16Channels);
+}
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_BINARY_PROTOCOL_H
@@ -4,12 +4,15 @@
 #include <chrono>
 #include <cstdint>
 #include <nlohmann/json.hpp>
+#include <optional>
 #include <string>
 
 namespace audio_stream {
 
 // Constants
 constexpr size_t CHUNK_SIZE = 65536; // 64KB
+constexpr size_t MIN_CHUNK_SIZE = 4096;    // 4KB, low-latency streams
+constexpr size_t MAX_CHUNK_SIZE = 1048576; // 1MB, bulk ingestion
 constexpr int DEFAULT_PORT = 8080;
 constexpr int DEFAULT_TIMEOUT_MS = 5000;
 constexpr int DEFAULT_MAX_RETRIES = 10;
@@ -18,7 +21,28 @@ constexpr int DEFAULT_MAX_RETRIES = 10;
 #define DEFAULT_PATH "/audio"
 
 // Message types
-enum class MessageType { START, STARTED, STOP, STOPPED, GET, ERROR_MSG };
+enum class MessageType {
+  START,
+  STARTED,
+  STOP,
+  STOPPED,
+  GET,
+  RESUME,
+  RESUMED,
+  STREAM,
+  STREAMED,
+  STATS,
+  PUT,
+  CREDIT,
+  HELLO,
+  HAVE,
+  HAS,
+  ATTACH,
+  ATTACHED,
+  DETACH,
+  DETACHED,
+  ERROR_MSG
+};
 
 // Convert MessageType to uppercase string
 inline std::string messageTypeToString(MessageType type) {
@@ -33,6 +57,34 @@ inline std::string messageTypeToString(MessageType type) {
     return "STOPPED";
   case MessageType::GET:
     return "GET";
+  case MessageType::RESUME:
+    return "RESUME";
+  case MessageType::RESUMED:
+    return "RESUMED";
+  case MessageType::STREAM:
+    return "STREAM";
+  case MessageType::STREAMED:
+    return "STREAMED";
+  case MessageType::STATS:
+    return "STATS";
+  case MessageType::PUT:
+    return "PUT";
+  case MessageType::CREDIT:
+    return "CREDIT";
+  case MessageType::HELLO:
+    return "HELLO";
+  case MessageType::HAVE:
+    return "HAVE";
+  case MessageType::HAS:
+    return "HAS";
+  case MessageType::ATTACH:
+    return "ATTACH";
+  case MessageType::ATTACHED:
+    return "ATTACHED";
+  case MessageType::DETACH:
+    return "DETACH";
+  case MessageType::DETACHED:
+    return "DETACHED";
   case MessageType::ERROR_MSG:
     return "ERROR";
   default:
@@ -52,21 +104,100 @@ inline MessageType stringToMessageType(const std::string &typeStr) {
     return MessageType::STOPPED;
   if (typeStr == "GET")
     return MessageType::GET;
+  if (typeStr == "RESUME")
+    return MessageType::RESUME;
+  if (typeStr == "RESUMED")
+    return MessageType::RESUMED;
+  if (typeStr == "STREAM")
+    return MessageType::STREAM;
+  if (typeStr == "STREAMED")
+    return MessageType::STREAMED;
+  if (typeStr == "STATS")
+    return MessageType::STATS;
+  if (typeStr == "PUT")
+    return MessageType::PUT;
+  if (typeStr == "CREDIT")
+    return MessageType::CREDIT;
+  if (typeStr == "HELLO")
+    return MessageType::HELLO;
+  if (typeStr == "HAVE")
+    return MessageType::HAVE;
+  if (typeStr == "HAS")
+    return MessageType::HAS;
+  if (typeStr == "ATTACH")
+    return MessageType::ATTACH;
+  if (typeStr == "ATTACHED")
+    return MessageType::ATTACHED;
+  if (typeStr == "DETACH")
+    return MessageType::DETACH;
+  if (typeStr == "DETACHED")
+    return MessageType::DETACHED;
   if (typeStr == "ERROR")
     return MessageType::ERROR_MSG;
   return MessageType::ERROR_MSG; // Default to error for unknown types
 }
 
+// How far an upload is pushed towards the disk before it is acknowledged.
+// Values are carried on the wire (binary START), so they must not change.
+enum class Durability : uint8_t {
+  DEFAULT = 0,     // The server's configured tier
+  NONE = 1,        // Page cache only; the kernel writes back when it likes
+  PERIODIC = 2,    // Written back in the background every interval or bytes
+  ON_FINALIZE = 3, // Written back (msync) when the upload is finalized
+  STRICT_SYNC = 4  // Written back and fdatasync'd before STOPPED is sent
+};
+
+// Convert Durability to its lowercase name
+inline std::string durabilityToString(Durability durability) {
+  switch (durability) {
+  case Durability::DEFAULT:
+    return "default";
+  case Durability::NONE:
+    return "none";
+  case Durability::PERIODIC:
+    return "periodic";
+  case Durability::ON_FINALIZE:
+    return "finalize";
+  case Durability::STRICT_SYNC:
+    return "strict";
+  default:
+    return "unknown";
+  }
+}
+
+// Parse a durability name; nullopt for unknown names
+inline std::optional<Durability> stringToDurability(const std::string &name) {
+  if (name == "default")
+    return Durability::DEFAULT;
+  if (name == "none")
+    return Durability::NONE;
+  if (name == "periodic")
+    return Durability::PERIODIC;
+  if (name == "finalize")
+    return Durability::ON_FINALIZE;
+  if (name == "strict")
+    return Durability::STRICT_SYNC;
+  return std::nullopt;
+}
+
 // Control message structures
 struct StartMessage {
   std::string type = "START";
   std::string streamId;
+  size_t chunkSize = CHUNK_SIZE; // Requested chunk size
+  Durability durability = Durability::DEFAULT;
+  uint64_t window = 0; // Bytes to send ahead of CREDIT (0: no flow control)
 };
 
 struct StartedMessage {
   std::string type = "STARTED";
   std::string message;
   std::string streamId;
+  size_t chunkSize = CHUNK_SIZE; // Negotiated chunk size
+  size_t minChunkSize = MIN_CHUNK_SIZE;
+  size_t maxChunkSize = MAX_CHUNK_SIZE;
+  uint32_t handle = 0; // Tags this stream's binary frames on the connection
+  std::string nonce;   // Hex; keys the proofs of this upload's HAVEs
 };
 
 struct StopMessage {
@@ -80,6 +211,52 @@ struct StoppedMessage {
   std::string streamId;
 };
 
+// Store a whole small stream: START, data and STOP in one round trip. Over
+// JSON the next binary frame, with handle 0, carries its length bytes.
+// Answered by STOPPED, as a STOP would be.
+struct PutMessage {
+  std::string type = "PUT";
+  std::string streamId;
+  size_t length = 0;
+  Durability durability = Durability::DEFAULT;
+};
+
+// Continue an UPLOADING stream on a new connection
+struct ResumeMessage {
+  std::string type = "RESUME";
+  std::string streamId;
+  uint64_t window = 0; // As in START
+};
+
+// Reply to RESUME: the client continues sending from offset
+struct ResumedMessage {
+  std::string type = "RESUMED";
+  std::string streamId;
+  size_t offset = 0; // Bytes the server has written
+  size_t chunkSize = CHUNK_SIZE;
+  size_t minChunkSize = MIN_CHUNK_SIZE;
+  size_t maxChunkSize = MAX_CHUNK_SIZE;
+  uint32_t handle = 0; // Replaces the handle of the dropped connection
+  std::string nonce;   // As in STARTED, unchanged by the resume
+};
+
+// Write an UPLOADING stream from another connection as well, beside the one
+// that started it and keeps it: one upload split into byte ranges, each
+// sent on its own connection as DATA frames with offsets (binary protocol).
+// Answered by ATTACHED with the handle that tags them and the chunk sizes.
+struct AttachMessage {
+  std::string type = "ATTACH";
+  std::string streamId;
+};
+
+// Done writing an attached stream; answered by DETACHED once the chunks the
+// connection sent before it are written, so the STOP on the stream's own
+// connection can follow
+struct DetachMessage {
+  std::string type = "DETACH";
+  std::string streamId;
+};
+
 struct GetMessage {
   std::string type = "GET";
   std::string streamId;
@@ -105,9 +282,90 @@ struct GetMessage {
   }
 };
 
+// Ask the server to push [offset, offset + length) as consecutive binary
+// frames of chunkSize bytes; length 0 means up to the end of the stream
+struct StreamMessage {
+  std::string type = "STREAM";
+  std::string streamId;
+  size_t offset = 0;
+  size_t length = 0;
+  size_t chunkSize = CHUNK_SIZE;
+
+  std::string toJson() const {
+    nlohmann::json j;
+    j["type"] = type;
+    j["streamId"] = streamId;
+    j["offset"] = offset;
+    j["length"] = length;
+    j["chunkSize"] = chunkSize;
+    return j.dump();
+  }
+};
+
+// Sent after the last frame of a STREAM range
+struct StreamedMessage {
+  std::string type = "STREAMED";
+  std::string streamId;
+  size_t offset = 0; // Start of the range
+  size_t length = 0; // Bytes pushed; short of the request at end of stream
+};
+
+// Flow control of an upload whose START or RESUME asked for a window: the
+// client may send the stream's bytes up to offset + length
+struct CreditMessage {
+  std::string type = "CREDIT";
+  std::string streamId;
+  uint64_t offset = 0; // Bytes the server has written
+  uint64_t length = 0; // Window past them
+  uint32_t handle = 0;
+};
+
+// Optional messages a server takes, announced in its HELLO reply
+constexpr uint32_t CAPABILITY_PUT = 1u << 0;
+constexpr uint32_t CAPABILITY_HAVE = 1u << 1;
+constexpr uint32_t CAPABILITY_ATTACH = 1u << 2;
+
+// Ask the server which optional messages it takes. The reply is a HELLO
+// with the capability bits; a server older than HELLO answers with an
+// ERROR, or not at all, and then takes none of them.
+struct HelloMessage {
+  std::string type = "HELLO";
+  uint32_t capabilities = 0; // Reply: CAPABILITY_* bits
+  uint64_t maxPutSize = 0;   // Reply: largest PUT, with CAPABILITY_PUT
+};
+
+// Blocks HAVE names: HAVE_BLOCK_SIZE bytes at a multiple of it, the last
+// block of a stream short
+constexpr size_t HAVE_BLOCK_SIZE = 1048576; // 1MB
+constexpr size_t HAVE_NONCE_BYTES = 16;
+
+// Offer a block of an upload by its SHA-256 instead of sending it, binary
+// protocol only. proof is SHA-256 of the upload's nonce (STARTED) followed
+// by the block, so a digest alone does not get a client another stream's
+// bytes. Answered by HAS.
+struct HaveMessage {
+  std::string type = "HAVE";
+  uint32_t handle = 0;
+  uint64_t offset = 0; // Of the block, a multiple of HAVE_BLOCK_SIZE
+  uint64_t length = 0; // HAVE_BLOCK_SIZE, less for the last block
+  std::string sha256;  // Hex digest of the block
+  std::string proof;   // Hex
+};
+
+// Reply to HAVE: length is the bytes the server stored at offset from a
+// stream it already held, 0 if the client must send the block
+struct HasMessage {
+  std::string type = "HAS";
+  std::string streamId;
+  uint64_t offset = 0;
+  uint64_t length = 0;
+};
+
 struct ErrorMessage {
   std::string type = "ERROR";
   std::string message;
+  // Refused for load (START, PUT): worth retrying after this long, 0 if not
+  uint32_t retryAfterMs = 0;
 };
 
 // Stream status
@@ -119,11 +377,13 @@ struct PerformanceMetrics {
   std::chrono::steady_clock::time_point uploadEndTime;
   size_t uploadBytes = 0;
   double uploadThroughputMbps = 0.0;
+  size_t uploadConnections = 1;
 
   std::chrono::steady_clock::time_point downloadStartTime;
   std::chrono::steady_clock::time_point downloadEndTime;
   size_t downloadBytes = 0;
   double downloadThroughputMbps = 0.0;
+  size_t downloadConnections = 1; // Throughput is summed over all of them
 };
 
 // Verification report
@@ -132,6 +392,7 @@ struct VerificationReport {
   std::string downloadedFilePath;
   size_t originalSize = 0;
   size_t downloadedSize = 0;
+  std::string checksumAlgorithm;
   std::string originalChecksum;
   std::string downloadedChecksum;
   bool sizesMatch = false;
@@ -0,0 +1,360 @@
+#ifndef AUDIO_STREAM_COMPRESSION_H
+#define AUDIO_STREAM_COMPRESSION_H
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef AUDIO_STREAM_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef AUDIO_STREAM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef AUDIO_STREAM_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace audio_stream {
+
+/**
+ * Block codecs shared by the compressed cache format (CompressedStorage)
+ * and COMPRESSED_DATA frames of the binary protocol. Which ones a build
+ * has depends on the libraries CMake found (AUDIO_STREAM_HAVE_LZ4, _ZSTD,
+ * _ZLIB); NONE always exists.
+ *
+ * LZ4 is preferred: it compresses at hundreds of MB/s per core and
+ * decompresses faster still, cheap enough for I/O threads. ZSTD trades
+ * speed for ratio; DEFLATE (zlib) is the fallback found everywhere.
+ *
+ * PCM samples barely repeat byte for byte, so none of them shrinks raw
+ * audio much by itself. With pcm16Channels set, a block is first
+ * filtered: each 16-bit little-endian sample is replaced by its
+ * difference from the previous sample of the same channel, and the low
+ * bytes of all differences are stored before the high bytes, which are
+ * then mostly 0x00 or 0xFF. That takes typical PCM to 60-75% of its size.
+ */
+enum class CompressionCodec : uint8_t {
+  NONE = 0,
+  LZ4 = 1,
+  ZSTD = 2,
+  DEFLATE = 3
+};
+
+inline std::string compressionCodecToString(CompressionCodec codec) {
+  switch (codec) {
+  case CompressionCodec::LZ4:
+    return "lz4";
+  case CompressionCodec::ZSTD:
+    return "zstd";
+  case CompressionCodec::DEFLATE:
+    return "deflate";
+  default:
+    return "none";
+  }
+}
+
+inline std::optional<CompressionCodec>
+parseCompressionCodec(std::string_view name) {
+  for (CompressionCodec codec :
+       {CompressionCodec::NONE, CompressionCodec::LZ4, CompressionCodec::ZSTD,
+        CompressionCodec::DEFLATE}) {
+    if (name == compressionCodecToString(codec)) {
+      return codec;
+    }
+  }
+  return std::nullopt;
+}
+
+inline bool isCodecAvailable(CompressionCodec codec) {
+  switch (codec) {
+  case CompressionCodec::NONE:
+    return true;
+#ifdef AUDIO_STREAM_HAVE_LZ4
+  case CompressionCodec::LZ4:
+    return true;
+#endif
+#ifdef AUDIO_STREAM_HAVE_ZSTD
+  case CompressionCodec::ZSTD:
+    return true;
+#endif
+#ifdef AUDIO_STREAM_HAVE_ZLIB
+  case CompressionCodec::DEFLATE:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+// The codecs this build has, fastest first; NONE is not listed
+inline std::vector<CompressionCodec> availableCodecs() {
+  std::vector<CompressionCodec> codecs;
+  for (CompressionCodec codec : {CompressionCodec::LZ4, CompressionCodec::ZSTD,
+                                 CompressionCodec::DEFLATE}) {
+    if (isCodecAvailable(codec)) {
+      codecs.push_back(codec);
+    }
+  }
+  return codecs;
+}
+
+constexpr unsigned MAX_PCM16_CHANNELS = 8;
+
+/**
+ * How a stream's blocks are best compressed, judged from its first bytes
+ * (detectCompressionProfile). Compressed audio formats are left as they
+ * are; WAV declares its sample layout; headerless data is assumed to be
+ * 16-bit stereo PCM, and a block the guess does not suit just fails to
+ * shrink and stays uncompressed.
+ */
+struct CompressionProfile {
+  bool compressible = true;
+  uint8_t pcm16Channels = 2; // Interleaved channels of 16-bit PCM, 0: none
+};
+
+// Profile of data that is never compressed
+inline constexpr CompressionProfile INCOMPRESSIBLE{false, 0};
+
+namespace compression_detail {
+
+inline uint32_t getLe(const uint8_t *in, size_t bytes) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) {
+    value |= static_cast<uint32_t>(in[i]) << (8 * i);
+  }
+  return value;
+}
+
+inline void pcm16Encode(const uint8_t *in, size_t size, unsigned channels,
+                        uint8_t *out) {
+  size_t samples = size / 2;
+  uint16_t previous[MAX_PCM16_CHANNELS] = {};
+  unsigned channel = 0;
+  for (size_t i = 0; i < samples; ++i) {
+    auto sample = static_cast<uint16_t>(in[2 * i] | in[2 * i + 1] << 8);
+    auto delta = static_cast<uint16_t>(sample - previous[channel]);
+    previous[channel] = sample;
+    channel = channel + 1 == channels ? 0 : channel + 1;
+    out[i] = static_cast<uint8_t>(delta);
+    out[samples + i] = static_cast<uint8_t>(delta >> 8);
+  }
+  if (size % 2 != 0) {
+    out[size - 1] = in[size - 1];
+  }
+}
+
+inline void pcm16Decode(const uint8_t *in, size_t size, unsigned channels,
+                        uint8_t *out) {
+  size_t samples = size / 2;
+  uint16_t previous[MAX_PCM16_CHANNELS] = {};
+  unsigned channel = 0;
+  for (size_t i = 0; i < samples; ++i) {
+    auto delta = static_cast<uint16_t>(in[i] | in[samples + i] << 8);
+    auto sample = static_cast<uint16_t>(previous[channel] + delta);
+    previous[channel] = sample;
+    channel = channel + 1 == channels ? 0 : channel + 1;
+    out[2 * i] = static_cast<uint8_t>(sample);
+    out[2 * i + 1] = static_cast<uint8_t>(sample >> 8);
+  }
+  if (size % 2 != 0) {
+    out[size - 1] = in[size - 1];
+  }
+}
+
+inline bool validChannels(unsigned channels) {
+  return channels <= MAX_PCM16_CHANNELS;
+}
+
+} // namespace compression_detail
+
+/**
+ * Compress one block into out, resized to the compressed length.
+ * @return false if the codec is unavailable, or the block shrinks by less
+ *         than an eighth; it is then better stored or sent as it is
+ */
+inline bool compressBlock(CompressionCodec codec, const uint8_t *data,
+                          size_t size,
+                          [[maybe_unused]] std::vector<uint8_t> &out,
+                          unsigned pcm16Channels = 0) {
+  if (size == 0 || size > INT_MAX ||
+      !compression_detail::validChannels(pcm16Channels)) {
+    return false;
+  }
+  if (pcm16Channels > 0) {
+    thread_local std::vector<uint8_t> filtered;
+    filtered.resize(size);
+    compression_detail::pcm16Encode(data, size, pcm16Channels,
+                                    filtered.data());
+    data = filtered.data();
+  }
+  size_t compressed = 0;
+  switch (codec) {
+#ifdef AUDIO_STREAM_HAVE_LZ4
+  case CompressionCodec::LZ4: {
+    out.resize(static_cast<size_t>(LZ4_compressBound(static_cast<int>(size))));
+    int written = LZ4_compress_default(reinterpret_cast<const char *>(data),
+                                       reinterpret_cast<char *>(out.data()),
+                                       static_cast<int>(size),
+                                       static_cast<int>(out.size()));
+    if (written <= 0) {
+      return false;
+    }
+    compressed = static_cast<size_t>(written);
+    break;
+  }
+#endif
+#ifdef AUDIO_STREAM_HAVE_ZSTD
+  case CompressionCodec::ZSTD: {
+    out.resize(ZSTD_compressBound(size));
+    size_t written = ZSTD_compress(out.data(), out.size(), data, size, 1);
+    if (ZSTD_isError(written)) {
+      return false;
+    }
+    compressed = written;
+    break;
+  }
+#endif
+#ifdef AUDIO_STREAM_HAVE_ZLIB
+  case CompressionCodec::DEFLATE: {
+    uLongf written = compressBound(static_cast<uLong>(size));
+    out.resize(written);
+    if (compress2(out.data(), &written, data, static_cast<uLong>(size),
+                  Z_BEST_SPEED) != Z_OK) {
+      return false;
+    }
+    compressed = written;
+    break;
+  }
+#endif
+  default:
+    return false;
+  }
+
+  if (compressed > size - size / 8) {
+    return false;
+  }
+  out.resize(compressed);
+  return true;
+}
+
+namespace compression_detail {
+
+inline bool decode([[maybe_unused]] CompressionCodec codec,
+                   [[maybe_unused]] const uint8_t *data,
+                   [[maybe_unused]] size_t size,
+                   [[maybe_unused]] uint8_t *out,
+                   [[maybe_unused]] size_t originalSize) {
+  switch (codec) {
+#ifdef AUDIO_STREAM_HAVE_LZ4
+  case CompressionCodec::LZ4:
+    return LZ4_decompress_safe(reinterpret_cast<const char *>(data),
+                               reinterpret_cast<char *>(out),
+                               static_cast<int>(size),
+                               static_cast<int>(originalSize)) ==
+           static_cast<int>(originalSize);
+#endif
+#ifdef AUDIO_STREAM_HAVE_ZSTD
+  case CompressionCodec::ZSTD: {
+    size_t written = ZSTD_decompress(out, originalSize, data, size);
+    return !ZSTD_isError(written) && written == originalSize;
+  }
+#endif
+#ifdef AUDIO_STREAM_HAVE_ZLIB
+  case CompressionCodec::DEFLATE: {
+    uLongf written = static_cast<uLongf>(originalSize);
+    return uncompress(out, &written, data, static_cast<uLong>(size)) ==
+               Z_OK &&
+           written == originalSize;
+  }
+#endif
+  default:
+    return false;
+  }
+}
+
+} // namespace compression_detail
+
+/**
+ * Decompress one block that was originalSize bytes long.
+ * @param out Destination of originalSize bytes
+ * @param pcm16Channels As the block was compressed with
+ * @return false if the data is corrupt or does not decode to originalSize
+ */
+inline bool decompressBlock(CompressionCodec codec, const uint8_t *data,
+                            size_t size, uint8_t *out, size_t originalSize,
+                            unsigned pcm16Channels = 0) {
+  if (size > INT_MAX || originalSize > INT_MAX ||
+      !compression_detail::validChannels(pcm16Channels)) {
+    return false;
+  }
+  if (pcm16Channels == 0) {
+    return compression_detail::decode(codec, data, size, out, originalSize);
+  }
+  thread_local std::vector<uint8_t> filtered;
+  filtered.resize(originalSize);
+  if (!compression_detail::decode(codec, data, size, filtered.data(),
+                                  originalSize)) {
+    return false;
+  }
+  compression_detail::pcm16Decode(filtered.data(), originalSize,
+                                  pcm16Channels, out);
+  return true;
+}
+
+/**
+ * Profile of a stream from its first bytes. Compressed audio formats (MP3,
+ * AAC, FLAC, Ogg, MP4/M4A, WebM/Matroska, AMR, WavPack, APE) are not
+ * compressible; WAV gets its channel count if it holds 16-bit PCM, and no
+ * filter otherwise.
+ */
+inline CompressionProfile detectCompressionProfile(const uint8_t *data,
+                                                   size_t size) {
+  using compression_detail::getLe;
+  auto startsWith = [&](size_t at, const char *magic) {
+    size_t length = std::strlen(magic);
+    return size >= at + length && std::memcmp(data + at, magic, length) == 0;
+  };
+
+  CompressionProfile profile;
+  // MPEG audio and ADTS frames start with an 11-bit frame sync
+  if ((size >= 2 && data[0] == 0xFF && (data[1] & 0xE0) == 0xE0) ||
+      startsWith(0, "ID3") || startsWith(0, "fLaC") ||
+      startsWith(0, "OggS") || startsWith(4, "ftyp") ||
+      startsWith(0, "\x1A\x45\xDF\xA3") || startsWith(0, "#!AMR") ||
+      startsWith(0, "wvpk") || startsWith(0, "MAC ")) {
+    profile.compressible = false;
+    profile.pcm16Channels = 0;
+    return profile;
+  }
+
+  if (startsWith(0, "RIFF") && startsWith(8, "WAVE")) {
+    // Chunks follow the RIFF header; "fmt " precedes the samples
+    profile.pcm16Channels = 0;
+    for (size_t at = 12; at + 8 <= size;) {
+      uint32_t chunkSize = getLe(data + at + 4, 4);
+      if (startsWith(at, "fmt ") && chunkSize >= 16 && at + 24 <= size) {
+        uint32_t format = getLe(data + at + 8, 2);
+        uint32_t channels = getLe(data + at + 10, 2);
+        uint32_t bits = getLe(data + at + 22, 2);
+        // 1: PCM, 0xFFFE: WAVE_FORMAT_EXTENSIBLE
+        if ((format == 1 || format == 0xFFFE) && bits == 16 &&
+            channels > 0 && channels <= MAX_PCM16_CHANNELS) {
+          profile.pcm16Channels = static_cast<uint8_t>(channels);
+        }
+        break;
+      }
+      at += 8 + chunkSize + chunkSize % 2;
+    }
+  }
+  return profile;
+}
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_COMPRESSION_H
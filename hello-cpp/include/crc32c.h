@@ -0,0 +1,257 @@
+#ifndef AUDIO_STREAM_CRC32C_H
+#define AUDIO_STREAM_CRC32C_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define AUDIO_STREAM_CRC32C_X86 1
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define AUDIO_STREAM_CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+namespace audio_stream {
+
+/**
+ * CRC-32C (Castagnoli), the checksum used by iSCSI, ext4 and SCTP.
+ * Uses the SSE4.2 crc32 instruction on x86-64 when the CPU has it, the
+ * ARMv8 CRC extension when compiled for it, and a slicing-by-8 table
+ * otherwise. Not cryptographic: it catches corruption, not tampering.
+ * Header-only so the client and server share one implementation.
+ */
+namespace crc32c {
+namespace detail {
+
+inline constexpr uint32_t POLYNOMIAL = 0x82F63B78; // Reflected Castagnoli
+
+using Table = std::array<std::array<uint32_t, 256>, 8>;
+
+inline constexpr Table makeTable() {
+  Table table{};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 1) ? (crc >> 1) ^ POLYNOMIAL : crc >> 1;
+    }
+    table[0][i] = crc;
+  }
+  for (uint32_t i = 0; i < 256; ++i) {
+    for (size_t slice = 1; slice < 8; ++slice) {
+      uint32_t prev = table[slice - 1][i];
+      table[slice][i] = (prev >> 8) ^ table[0][prev & 0xFF];
+    }
+  }
+  return table;
+}
+
+inline constexpr Table TABLE = makeTable();
+
+// Slicing-by-8: eight table lookups per 8 input bytes
+inline uint32_t extendSoftware(uint32_t crc, const uint8_t *data,
+                               size_t length) {
+  while (length >= 8) {
+    uint32_t low;
+    uint32_t high;
+    std::memcpy(&low, data, 4);
+    std::memcpy(&high, data + 4, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    low = __builtin_bswap32(low);
+    high = __builtin_bswap32(high);
+#endif
+    low ^= crc;
+    crc = TABLE[7][low & 0xFF] ^ TABLE[6][(low >> 8) & 0xFF] ^
+          TABLE[5][(low >> 16) & 0xFF] ^ TABLE[4][low >> 24] ^
+          TABLE[3][high & 0xFF] ^ TABLE[2][(high >> 8) & 0xFF] ^
+          TABLE[1][(high >> 16) & 0xFF] ^ TABLE[0][high >> 24];
+    data += 8;
+    length -= 8;
+  }
+  while (length-- > 0) {
+    crc = (crc >> 8) ^ TABLE[0][(crc ^ *data++) & 0xFF];
+  }
+  return crc;
+}
+
+#if defined(AUDIO_STREAM_CRC32C_X86)
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("sse4.2")))
+#endif
+inline uint32_t
+extendHardware(uint32_t crc, const uint8_t *data, size_t length) {
+  while (length > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+    crc = _mm_crc32_u8(crc, *data++);
+    --length;
+  }
+  uint64_t crc64 = crc;
+  while (length >= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, 8);
+    crc64 = _mm_crc32_u64(crc64, word);
+    data += 8;
+    length -= 8;
+  }
+  crc = static_cast<uint32_t>(crc64);
+  while (length-- > 0) {
+    crc = _mm_crc32_u8(crc, *data++);
+  }
+  return crc;
+}
+
+inline bool detectHardware() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 20)) != 0;
+#else
+  return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#elif defined(AUDIO_STREAM_CRC32C_ARM)
+
+inline uint32_t extendHardware(uint32_t crc, const uint8_t *data,
+                               size_t length) {
+  while (length > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+    crc = __crc32cb(crc, *data++);
+    --length;
+  }
+  while (length >= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, 8);
+    crc = __crc32cd(crc, word);
+    data += 8;
+    length -= 8;
+  }
+  while (length-- > 0) {
+    crc = __crc32cb(crc, *data++);
+  }
+  return crc;
+}
+
+inline bool detectHardware() { return true; }
+
+#else
+
+inline uint32_t extendHardware(uint32_t crc, const uint8_t *data,
+                               size_t length) {
+  return extendSoftware(crc, data, length);
+}
+
+inline bool detectHardware() { return false; }
+
+#endif
+
+inline const bool HAS_HARDWARE = detectHardware();
+
+// GF(2) matrix helpers for combine(), as in zlib's crc32_combine
+inline uint32_t gf2MatrixTimes(const uint32_t *matrix, uint32_t vector) {
+  uint32_t sum = 0;
+  while (vector != 0) {
+    if (vector & 1) {
+      sum ^= *matrix;
+    }
+    vector >>= 1;
+    ++matrix;
+  }
+  return sum;
+}
+
+inline void gf2MatrixSquare(uint32_t *square, const uint32_t *matrix) {
+  for (int n = 0; n < 32; ++n) {
+    square[n] = gf2MatrixTimes(matrix, matrix[n]);
+  }
+}
+
+} // namespace detail
+
+/**
+ * Extend a running CRC with more data
+ * @param crc CRC of the data so far (0 for none)
+ * @return CRC of the data so far followed by data[0..length)
+ */
+inline uint32_t extend(uint32_t crc, const uint8_t *data, size_t length) {
+  uint32_t state = ~crc;
+  state = detail::HAS_HARDWARE ? detail::extendHardware(state, data, length)
+                               : detail::extendSoftware(state, data, length);
+  return ~state;
+}
+
+/**
+ * CRC of two concatenated blocks from the CRCs of each block, so blocks
+ * can be checksummed independently (e.g. on different threads)
+ * @param crc1 CRC of the first block
+ * @param crc2 CRC of the second block
+ * @param length2 Length of the second block in bytes
+ */
+inline uint32_t combine(uint32_t crc1, uint32_t crc2, uint64_t length2) {
+  if (length2 == 0) {
+    return crc1;
+  }
+
+  uint32_t even[32]; // Operator for an even power-of-two number of zero bits
+  uint32_t odd[32];  // Operator for an odd power-of-two number of zero bits
+
+  // Operator for one zero bit
+  odd[0] = detail::POLYNOMIAL;
+  uint32_t row = 1;
+  for (int n = 1; n < 32; ++n) {
+    odd[n] = row;
+    row <<= 1;
+  }
+
+  detail::gf2MatrixSquare(even, odd); // Two zero bits
+  detail::gf2MatrixSquare(odd, even); // Four zero bits
+
+  // Apply length2 zero bytes to crc1, one power of two at a time
+  do {
+    detail::gf2MatrixSquare(even, odd);
+    if (length2 & 1) {
+      crc1 = detail::gf2MatrixTimes(even, crc1);
+    }
+    length2 >>= 1;
+    if (length2 == 0) {
+      break;
+    }
+
+    detail::gf2MatrixSquare(odd, even);
+    if (length2 & 1) {
+      crc1 = detail::gf2MatrixTimes(odd, crc1);
+    }
+    length2 >>= 1;
+  } while (length2 != 0);
+
+  return crc1 ^ crc2;
+}
+
+/**
+ * @return true if extend() uses a hardware CRC instruction
+ */
+inline bool isHardwareAccelerated() { return detail::HAS_HARDWARE; }
+
+/**
+ * @return crc as 8 lowercase hex digits, most significant first
+ */
+inline std::string toHex(uint32_t crc) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex(8, '0');
+  for (int i = 7; i >= 0; --i) {
+    hex[i] = digits[crc & 0x0F];
+    crc >>= 4;
+  }
+  return hex;
+}
+
+} // namespace crc32c
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_CRC32C_H
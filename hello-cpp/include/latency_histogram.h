@@ -0,0 +1,117 @@
+#ifndef AUDIO_STREAM_LATENCY_HISTOGRAM_H
+#define AUDIO_STREAM_LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace audio_stream {
+
+/**
+ * Histogram of unsigned values (latencies in nanoseconds, sizes, depths)
+ * with log-linear buckets like an HDR histogram: values below SUB_BUCKETS
+ * exactly, above that SUB_BUCKETS buckets per power of two, so a bucket's
+ * width is at most 1/8 of its values. Values of 2^MAX_EXPONENT and more
+ * land in the last bucket. Recording is a few increments on a fixed array;
+ * callers synchronize (the server keeps one per thread and merges them).
+ */
+struct LatencyHistogram {
+  static constexpr unsigned SUB_BUCKET_BITS = 3;
+  static constexpr uint64_t SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+  static constexpr unsigned MAX_EXPONENT = 48;
+  static constexpr size_t BUCKETS =
+      (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t max = 0;
+  std::array<uint64_t, BUCKETS> buckets{};
+
+  void record(uint64_t value) {
+    ++buckets[bucketFor(value)];
+    ++count;
+    sum += value;
+    max = std::max(max, value);
+  }
+
+  void merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    sum += other.sum;
+    max = std::max(max, other.max);
+  }
+
+  static size_t bucketFor(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+      return static_cast<size_t>(value);
+    }
+    unsigned exponent = highestBit(value);
+    if (exponent >= MAX_EXPONENT) {
+      return BUCKETS - 1;
+    }
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS +
+           ((value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+  }
+
+  // Largest value that falls into bucket
+  static uint64_t bucketUpperBound(size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+      return bucket;
+    }
+    if (bucket >= BUCKETS - 1) {
+      return std::numeric_limits<uint64_t>::max();
+    }
+    unsigned exponent =
+        static_cast<unsigned>(bucket / SUB_BUCKETS) + SUB_BUCKET_BITS - 1;
+    uint64_t mantissa = bucket % SUB_BUCKETS;
+    return ((SUB_BUCKETS + mantissa + 1) << (exponent - SUB_BUCKET_BITS)) -
+           1;
+  }
+
+  // Upper bound of the bucket holding the q-quantile (0..1), at most max
+  uint64_t percentile(double q) const {
+    if (count == 0) {
+      return 0;
+    }
+    auto rank =
+        static_cast<uint64_t>(std::ceil(q * static_cast<double>(count)));
+    rank = std::max<uint64_t>(1, std::min(rank, count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      seen += buckets[i];
+      if (seen >= rank) {
+        return std::min(bucketUpperBound(i), max);
+      }
+    }
+    return max;
+  }
+
+  double mean() const {
+    return count > 0 ? static_cast<double>(sum) / static_cast<double>(count)
+                     : 0.0;
+  }
+
+private:
+  static unsigned highestBit(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+  }
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_LATENCY_HISTOGRAM_H
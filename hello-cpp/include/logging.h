@@ -0,0 +1,103 @@
+#ifndef AUDIO_STREAM_LOGGING_H
+#define AUDIO_STREAM_LOGGING_H
+
+#include "crc32c.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <string_view>
+
+namespace audio_stream {
+
+/**
+ * Logging shared by the client and server.
+ *
+ * Per-chunk log sites use SPDLOG_DEBUG and SPDLOG_TRACE, which Release
+ * builds compile out (SPDLOG_ACTIVE_LEVEL is set by CMake), so they cost
+ * nothing there, not even evaluating their arguments. What remains is
+ * written by a background thread from a bounded queue: a full queue drops
+ * its oldest messages rather than block the thread that logs.
+ *
+ * For diagnosis in any build, AUDIO_STREAM_TRACE logs at info level for a
+ * sample of streams: one in the AUDIO_STREAM_TRACE environment variable's
+ * value, chosen by the CRC32C of the stream ID so a traced stream is
+ * traced on both ends and on every chunk. Unset or 0 traces none, and
+ * then each site is a relaxed load and a branch.
+ */
+namespace logging {
+
+inline constexpr size_t QUEUE_MESSAGES = 8192;
+inline constexpr const char *TRACE_ENVIRONMENT = "AUDIO_STREAM_TRACE";
+
+namespace detail {
+inline std::atomic<uint32_t> traceEvery{0};
+} // namespace detail
+
+// Trace one in every streams, 0 for none
+inline void setStreamTraceSampling(uint32_t every) {
+  detail::traceEvery.store(every, std::memory_order_relaxed);
+}
+
+inline uint32_t getStreamTraceSampling() {
+  return detail::traceEvery.load(std::memory_order_relaxed);
+}
+
+inline bool isTraced(std::string_view streamId) {
+  uint32_t every = detail::traceEvery.load(std::memory_order_relaxed);
+  if (every == 0) {
+    return false;
+  }
+  uint32_t hash = crc32c::extend(
+      0, reinterpret_cast<const uint8_t *>(streamId.data()), streamId.size());
+  return hash % every == 0;
+}
+
+/**
+ * Replaces the default logger with an asynchronous one for its lifetime
+ * and reads the trace sampling from the environment. Constructed first in
+ * main; its destructor drains the queue, so messages logged just before
+ * the process exits are not lost.
+ */
+class AsyncLogging {
+public:
+  explicit AsyncLogging(const std::string &name) {
+    spdlog::init_thread_pool(QUEUE_MESSAGES, 1);
+    auto sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+    auto logger = std::make_shared<spdlog::async_logger>(
+        name, std::move(sink), spdlog::thread_pool(),
+        spdlog::async_overflow_policy::overrun_oldest);
+    logger->flush_on(spdlog::level::warn);
+    spdlog::set_default_logger(std::move(logger));
+
+    if (const char *every = std::getenv(TRACE_ENVIRONMENT)) {
+      setStreamTraceSampling(
+          static_cast<uint32_t>(std::strtoul(every, nullptr, 10)));
+    }
+    if (getStreamTraceSampling() != 0) {
+      spdlog::info("Tracing one in {} streams", getStreamTraceSampling());
+    }
+  }
+
+  ~AsyncLogging() { spdlog::shutdown(); }
+
+  AsyncLogging(const AsyncLogging &) = delete;
+  AsyncLogging &operator=(const AsyncLogging &) = delete;
+};
+
+} // namespace logging
+} // namespace audio_stream
+
+// Log for a sampled stream; format must be a string literal
+#define AUDIO_STREAM_TRACE(streamId, format, ...)                             \
+  do {                                                                         \
+    if (::audio_stream::logging::isTraced(streamId)) {                         \
+      spdlog::info("[trace {}] " format, streamId, __VA_ARGS__);               \
+    }                                                                          \
+  } while (0)
+
+#endif // AUDIO_STREAM_LOGGING_H
@@ -1,7 +1,8 @@
 # Run Server - C++ Implementation (Windows PowerShell)
 param(
     [int]$Port = 8080,
-    [string]$PathEndpoint = "/audio"
+    [string]$PathEndpoint = "/audio",
+    [int]$IoThreads = 0
 )
 
 [Console]::OutputEncoding = [System.Text.Encoding]::UTF8
@@ -26,4 +27,4 @@ Write-Host "Endpoint: $PathEndpoint" -ForegroundColor Green
 Write-Host "Press Ctrl+C to stop" -ForegroundColor Yellow
 Write-Host ""
 
-& $ServerBin $Port $PathEndpoint
+& $ServerBin $Port $PathEndpoint $IoThreads
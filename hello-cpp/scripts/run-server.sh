@@ -10,6 +10,7 @@ cd "$PROJECT_ROOT"
 
 PORT=${1:-8080}
 PATH_ENDPOINT=${2:-/audio}
+IO_THREADS=${3:-0}
 
 SERVER_BIN="build/bin/audio_stream_server"
 
@@ -27,4 +28,4 @@ echo "Endpoint: $PATH_ENDPOINT"
 echo "Press Ctrl+C to stop"
 echo ""
 
-exec "$SERVER_BIN" "$PORT" "$PATH_ENDPOINT"
+exec "$SERVER_BIN" "$PORT" "$PATH_ENDPOINT" "$IO_THREADS"
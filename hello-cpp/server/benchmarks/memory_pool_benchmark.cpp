@@ -0,0 +1,66 @@
+#include "memory/memory_pool_manager.h"
+#include <benchmark/benchmark.h>
+#include <memory>
+
+using namespace audio_stream;
+
+namespace {
+
+// Acquire and release one buffer of range(0) bytes; steady state is served
+// by the calling thread's cache
+void BM_PoolAcquireRelease(benchmark::State &state) {
+  MemoryPoolManager &pool = MemoryPoolManager::getInstance();
+  size_t size = static_cast<size_t>(state.range(0));
+  for (auto _ : state) {
+    PooledBufferPtr buffer = pool.acquire(size);
+    benchmark::DoNotOptimize(buffer.get());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Several buffers held at once, as a connection with frames in flight
+// does, so the thread cache runs dry and refills from the shared lists
+void BM_PoolAcquireReleaseBurst(benchmark::State &state) {
+  constexpr size_t BURST = 64;
+  MemoryPoolManager &pool = MemoryPoolManager::getInstance();
+  size_t size = static_cast<size_t>(state.range(0));
+  PooledBufferPtr held[BURST];
+  for (auto _ : state) {
+    for (auto &buffer : held) {
+      buffer = pool.acquire(size);
+    }
+    for (auto &buffer : held) {
+      buffer.reset();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * BURST);
+}
+
+// The same allocation from the heap, for comparison
+void BM_HeapAllocateFree(benchmark::State &state) {
+  size_t size = static_cast<size_t>(state.range(0));
+  for (auto _ : state) {
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[size]);
+    benchmark::DoNotOptimize(buffer.get());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_PoolAcquireRelease)
+    ->Arg(4 << 10)
+    ->Arg(64 << 10)
+    ->Arg(1 << 20)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK(BM_PoolAcquireReleaseBurst)
+    ->Arg(64 << 10)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK(BM_HeapAllocateFree)
+    ->Arg(4 << 10)
+    ->Arg(64 << 10)
+    ->Arg(1 << 20)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
@@ -0,0 +1,70 @@
+#include "binary_protocol.h"
+#include "handler/websocket_message.h"
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+using namespace audio_stream;
+
+namespace {
+
+const std::string GET_JSON =
+    R"({"type":"GET","streamId":"stream-1a2b3c4d","offset":7340032,)"
+    R"("length":65536})";
+
+// A JSON GET as it arrives on every download request
+void BM_MessageParseJson(benchmark::State &state) {
+  for (auto _ : state) {
+    WebSocketMessage message = WebSocketMessage::fromJsonString(GET_JSON);
+    benchmark::DoNotOptimize(message.offset);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// A STARTED reply with the negotiated chunk sizes
+void BM_MessageSerializeJson(benchmark::State &state) {
+  WebSocketMessage message = WebSocketMessage::started(
+      "stream-1a2b3c4d", 65536, 4096, static_cast<size_t>(1) << 20);
+  message.handle = 42;
+  for (auto _ : state) {
+    std::string text = message.toJsonString();
+    benchmark::DoNotOptimize(text.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// The same GET as a binary protocol frame
+void BM_MessageParseBinary(benchmark::State &state) {
+  BinaryFrameHeader header;
+  header.type = BinaryFrameType::GET;
+  header.offset = 7340032;
+  header.length = 65536;
+  std::string streamId = "stream-1a2b3c4d";
+  std::vector<uint8_t> encoded = encodeBinaryFrame(header, streamId);
+  for (auto _ : state) {
+    BinaryFrame frame;
+    bool decoded = decodeBinaryFrame(encoded.data(), encoded.size(), frame);
+    WebSocketMessage message = WebSocketMessage::fromBinaryFrame(frame);
+    benchmark::DoNotOptimize(decoded);
+    benchmark::DoNotOptimize(message.offset);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_MessageSerializeBinary(benchmark::State &state) {
+  WebSocketMessage message = WebSocketMessage::started(
+      "stream-1a2b3c4d", 65536, 4096, static_cast<size_t>(1) << 20);
+  message.handle = 42;
+  for (auto _ : state) {
+    std::vector<uint8_t> frame = message.toBinaryFrame();
+    benchmark::DoNotOptimize(frame.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_MessageParseJson);
+BENCHMARK(BM_MessageSerializeJson);
+BENCHMARK(BM_MessageParseBinary);
+BENCHMARK(BM_MessageSerializeBinary);
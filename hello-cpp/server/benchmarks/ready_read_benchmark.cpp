@@ -0,0 +1,97 @@
+#include "memory/stream_manager.h"
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace audio_stream;
+
+namespace {
+
+constexpr size_t STREAM_BYTES = 64 * 1024 * 1024;
+constexpr size_t READ_BYTES = 64 * 1024;
+constexpr const char *STREAM_ID = "ready-read-bench";
+
+/**
+ * One READY stream, read whole twice so it is sealed and resident, and its
+ * chunks, missed twice, are in the chunk cache. Every benchmark thread
+ * reads it, the contention one popular stream sees.
+ */
+StreamManager &readyStream(bool chunkCache) {
+  auto create = [](const std::string &name, bool cached) {
+    std::string cacheDir =
+        (std::filesystem::temp_directory_path() / name).string();
+    std::filesystem::remove_all(cacheDir);
+    auto manager = std::make_unique<StreamManager>(cacheDir);
+    CacheBudget budget;
+    budget.maxChunkCacheBytes = cached ? STREAM_BYTES * 2 : 0;
+    manager->setCacheBudget(budget);
+
+    std::vector<uint8_t> chunk(READ_BYTES);
+    manager->createStream(STREAM_ID);
+    for (size_t offset = 0; offset < STREAM_BYTES; offset += READ_BYTES) {
+      for (size_t i = 0; i < chunk.size(); ++i) {
+        chunk[i] = static_cast<uint8_t>((offset + i) * 31);
+      }
+      manager->writeChunkAt(STREAM_ID, offset, chunk.data(), chunk.size());
+    }
+    manager->finalizeStream(STREAM_ID);
+    for (int pass = 0; pass < 2; ++pass) {
+      for (size_t offset = 0; offset < STREAM_BYTES; offset += READ_BYTES) {
+        manager->readChunkView(STREAM_ID, offset, READ_BYTES);
+      }
+    }
+    return manager;
+  };
+  static auto uncached = create("audio_ready_bench", false);
+  static auto cached = create("audio_ready_bench_cached", true);
+  return chunkCache ? *cached : *uncached;
+}
+
+template <typename Read>
+void runReads(benchmark::State &state, Read read) {
+  // Each thread walks the stream from its own start, like separate clients
+  size_t offset = static_cast<size_t>(state.thread_index()) * 7 * READ_BYTES %
+                  STREAM_BYTES;
+  for (auto _ : state) {
+    BufferView view = read(offset);
+    benchmark::DoNotOptimize(view.begin());
+    offset = (offset + READ_BYTES) % STREAM_BYTES;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * READ_BYTES);
+}
+
+// The read path before READY streams were sealed: the stream's mutex,
+// then the file's shared lock
+void BM_LockedReadyRead(benchmark::State &state) {
+  StreamManager &manager = readyStream(false);
+  runReads(state, [&](size_t offset) {
+    auto stream = manager.getStream(STREAM_ID);
+    std::lock_guard<std::mutex> lock(stream->contextMutex);
+    stream->touch();
+    return stream->mmapFile->readView(offset, READ_BYTES);
+  });
+}
+
+void BM_SealedReadyRead(benchmark::State &state) {
+  StreamManager &manager = readyStream(false);
+  runReads(state, [&](size_t offset) {
+    return manager.readChunkView(STREAM_ID, offset, READ_BYTES);
+  });
+}
+
+void BM_ChunkCacheReadyRead(benchmark::State &state) {
+  StreamManager &manager = readyStream(true);
+  runReads(state, [&](size_t offset) {
+    return manager.readChunkView(STREAM_ID, offset, READ_BYTES);
+  });
+}
+
+} // namespace
+
+BENCHMARK(BM_LockedReadyRead)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_SealedReadyRead)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_ChunkCacheReadyRead)->ThreadRange(1, 64)->UseRealTime();
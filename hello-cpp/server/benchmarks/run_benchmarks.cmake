@@ -0,0 +1,36 @@
+# Runs the benchmark suite and writes its results as JSON, one file per
+# commit, so runs can be compared across commits.
+#
+# Invoked by the bench_json target with:
+#   BENCHMARK_EXECUTABLE  path of audio_server_bench
+#   SOURCE_DIR            source tree, for the commit hash
+#   RESULTS_DIR           directory the results are written to
+#   BENCHMARK_ARGS        extra arguments (optional, ;-separated)
+
+execute_process(
+    COMMAND git rev-parse --short HEAD
+    WORKING_DIRECTORY ${SOURCE_DIR}
+    OUTPUT_VARIABLE COMMIT
+    OUTPUT_STRIP_TRAILING_WHITESPACE
+    RESULT_VARIABLE GIT_RESULT
+    ERROR_QUIET
+)
+if(NOT GIT_RESULT EQUAL 0 OR COMMIT STREQUAL "")
+    set(COMMIT "unknown")
+endif()
+
+file(MAKE_DIRECTORY ${RESULTS_DIR})
+set(RESULTS_FILE ${RESULTS_DIR}/audio_server_bench-${COMMIT}.json)
+
+execute_process(
+    COMMAND ${BENCHMARK_EXECUTABLE}
+        --benchmark_out=${RESULTS_FILE}
+        --benchmark_out_format=json
+        --benchmark_context=commit=${COMMIT}
+        ${BENCHMARK_ARGS}
+    RESULT_VARIABLE BENCHMARK_RESULT
+)
+if(NOT BENCHMARK_RESULT EQUAL 0)
+    message(FATAL_ERROR "audio_server_bench failed: ${BENCHMARK_RESULT}")
+endif()
+message(STATUS "Benchmark results: ${RESULTS_FILE}")
@@ -0,0 +1,139 @@
+#include "memory/memory_mapped_cache.h"
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace audio_stream;
+
+namespace {
+
+constexpr size_t CHUNK_BYTES = 64 * 1024;
+constexpr size_t READ_FILE_BYTES = 64 * 1024 * 1024;
+
+std::string benchPath(const std::string &name) {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+std::vector<uint8_t> pattern(size_t size) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<uint8_t>(i * 31 + 7);
+  }
+  return data;
+}
+
+/**
+ * A 64 MB file written once and read by the read benchmarks. Reads are
+ * served from the page cache after the first pass, so they measure the
+ * mapping and copy rather than the disk.
+ */
+MemoryMappedCache &readFile() {
+  static auto cache = [] {
+    std::string path = benchPath("audio_storage_bench_read.dat");
+    std::filesystem::remove(path);
+    auto file = std::make_unique<MemoryMappedCache>(path);
+    file->create();
+    std::vector<uint8_t> chunk = pattern(CHUNK_BYTES);
+    for (size_t offset = 0; offset < READ_FILE_BYTES; offset += CHUNK_BYTES) {
+      file->write(offset, chunk.data(), chunk.size());
+    }
+    return file;
+  }();
+  return *cache;
+}
+
+// Appends a whole file of range(0) bytes in 64KB chunks, as an upload
+// does, including the file's geometric growth and remaps
+void BM_MappedAppend(benchmark::State &state) {
+  size_t fileBytes = static_cast<size_t>(state.range(0));
+  std::string path = benchPath("audio_storage_bench_append.dat");
+  std::vector<uint8_t> chunk = pattern(CHUNK_BYTES);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::filesystem::remove(path);
+    MemoryMappedCache file(path);
+    file.create();
+    state.ResumeTiming();
+
+    for (size_t offset = 0; offset < fileBytes; offset += CHUNK_BYTES) {
+      file.write(offset, chunk.data(), chunk.size());
+    }
+
+    state.PauseTiming();
+    file.close();
+    state.ResumeTiming();
+  }
+  std::filesystem::remove(path);
+  state.SetBytesProcessed(state.iterations() * fileBytes);
+}
+
+// 64KB writes just below the first segment boundary (range(0) == 0) or
+// straddling it (range(0) == 1), which copies into two mappings. The file
+// is sparse, so little of its 1GB is allocated.
+void BM_MappedWriteSegmentBoundary(benchmark::State &state) {
+  constexpr uint64_t BOUNDARY = MemoryMappedCache::SEGMENT_SIZE;
+  bool straddle = state.range(0) != 0;
+  std::string path = benchPath("audio_storage_bench_boundary.dat");
+  std::filesystem::remove(path);
+  MemoryMappedCache file(path);
+  file.create();
+  std::vector<uint8_t> chunk = pattern(CHUNK_BYTES);
+  // Grow past the boundary first so the loop only writes
+  file.write(BOUNDARY + CHUNK_BYTES, chunk.data(), chunk.size());
+
+  uint64_t offset = straddle ? BOUNDARY - CHUNK_BYTES / 2
+                             : BOUNDARY - 4 * CHUNK_BYTES;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(file.write(offset, chunk.data(), chunk.size()));
+  }
+  file.close();
+  std::filesystem::remove(path);
+  state.SetBytesProcessed(state.iterations() * CHUNK_BYTES);
+}
+
+// Copying reads of range(0) bytes, walking the file
+void BM_MappedRead(benchmark::State &state) {
+  MemoryMappedCache &file = readFile();
+  size_t length = static_cast<size_t>(state.range(0));
+  uint64_t offset = 0;
+  for (auto _ : state) {
+    std::vector<uint8_t> data = file.read(offset, length);
+    benchmark::DoNotOptimize(data.data());
+    offset = (offset + length) % (READ_FILE_BYTES - length + 1);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * length);
+}
+
+// readBatch of range(0) 64KB reads
+void BM_MappedReadBatch(benchmark::State &state) {
+  MemoryMappedCache &file = readFile();
+  size_t count = static_cast<size_t>(state.range(0));
+  std::vector<StorageBackend::ReadOperation> operations(count);
+  uint64_t offset = 0;
+  for (auto _ : state) {
+    for (auto &operation : operations) {
+      operation = {offset, CHUNK_BYTES};
+      offset = (offset + CHUNK_BYTES) % READ_FILE_BYTES;
+    }
+    auto results = file.readBatch(operations);
+    benchmark::DoNotOptimize(results.data());
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * count * CHUNK_BYTES);
+}
+
+} // namespace
+
+BENCHMARK(BM_MappedAppend)
+    ->Arg(1 << 20)
+    ->Arg(16 << 20)
+    ->Arg(256 << 20)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_MappedWriteSegmentBoundary)->Arg(0)->Arg(1);
+BENCHMARK(BM_MappedRead)->Arg(4 << 10)->Arg(64 << 10)->Arg(1 << 20);
+BENCHMARK(BM_MappedReadBatch)->Arg(1)->Arg(16)->Arg(256);
@@ -0,0 +1,104 @@
+#include "memory/stream_manager.h"
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace audio_stream;
+
+namespace {
+
+constexpr size_t STREAM_COUNT = 1024;
+
+/**
+ * The registry as it was before sharding: one std::map behind one mutex,
+ * with the access time written under that mutex on every hit.
+ */
+class GlobalMutexRegistry {
+public:
+  void add(const std::string &streamId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    streams_[streamId] = std::make_shared<StreamContext>(streamId);
+  }
+
+  std::shared_ptr<StreamContext> getStream(const std::string &streamId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = streams_.find(streamId);
+    if (it != streams_.end()) {
+      it->second->lastAccessedAt = std::chrono::system_clock::now();
+      return it->second;
+    }
+    return nullptr;
+  }
+
+private:
+  std::map<std::string, std::shared_ptr<StreamContext>> streams_;
+  std::mutex mutex_;
+};
+
+const std::vector<std::string> &streamIds() {
+  static const std::vector<std::string> ids = [] {
+    std::vector<std::string> result;
+    for (size_t i = 0; i < STREAM_COUNT; ++i) {
+      result.push_back("stream-" + std::to_string(100000 + i));
+    }
+    return result;
+  }();
+  return ids;
+}
+
+GlobalMutexRegistry &globalMutexRegistry() {
+  static GlobalMutexRegistry registry;
+  static bool populated = [] {
+    for (const auto &id : streamIds()) {
+      registry.add(id);
+    }
+    return true;
+  }();
+  (void)populated;
+  return registry;
+}
+
+StreamManager &shardedRegistry() {
+  static std::string cacheDir =
+      (std::filesystem::temp_directory_path() / "audio_server_bench_cache")
+          .string();
+  static StreamManager manager(cacheDir);
+  static bool populated = [] {
+    for (const auto &id : streamIds()) {
+      manager.createStream(id);
+    }
+    return true;
+  }();
+  (void)populated;
+  return manager;
+}
+
+template <typename Registry>
+void runLookups(benchmark::State &state, Registry &registry) {
+  const auto &ids = streamIds();
+  // Start each thread at a different stream so threads spread over shards
+  size_t index = static_cast<size_t>(state.thread_index()) * 7919;
+  for (auto _ : state) {
+    auto stream = registry.getStream(ids[index++ % ids.size()]);
+    benchmark::DoNotOptimize(stream);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_GlobalMutexRegistryLookup(benchmark::State &state) {
+  runLookups(state, globalMutexRegistry());
+}
+
+void BM_ShardedRegistryLookup(benchmark::State &state) {
+  runLookups(state, shardedRegistry());
+}
+
+} // namespace
+
+BENCHMARK(BM_GlobalMutexRegistryLookup)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_ShardedRegistryLookup)->ThreadRange(1, 64)->UseRealTime();
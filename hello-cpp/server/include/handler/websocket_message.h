@@ -1,15 +1,23 @@
 #ifndef AUDIO_STREAM_WEBSOCKET_MESSAGE_H
 #define AUDIO_STREAM_WEBSOCKET_MESSAGE_H
 
+#include "binary_protocol.h"
+#include "common_types.h"
+#include "crc32c.h"
+#include "sha256.h"
+#include <array>
+#include <cstring>
 #include <nlohmann/json.hpp>
 #include <optional>
 #include <string>
+#include <vector>
 
 namespace audio_stream {
 
 /**
  * WebSocket control message for JSON serialization/deserialization.
- * Used for all control messages between client and server.
+ * Used for all control messages between client and server, whether they
+ * arrived as JSON text or as binary protocol frames.
  */
 struct WebSocketMessage {
   std::string type;
@@ -18,6 +26,42 @@ struct WebSocketMessage {
   std::optional<size_t> length;
   std::optional<std::string> message;
 
+  // Chunk size negotiation (START request, STARTED reply)
+  std::optional<size_t> chunkSize;
+  std::optional<size_t> minChunkSize;
+  std::optional<size_t> maxChunkSize;
+
+  // Requested durability tier by name (START and PUT requests)
+  std::optional<std::string> durability;
+
+  // Flow control window asked for (START and RESUME requests); a CREDIT
+  // carries the window granted in length
+  std::optional<uint64_t> window;
+
+  // An upload refused for load may be retried after this long (ERROR)
+  std::optional<uint32_t> retryAfterMs;
+
+  // CRC32C of the stored stream (STOPPED reply)
+  std::optional<uint32_t> checksum;
+
+  // Stream handle: assigned in STARTED/RESUMED, echoed on the replies to a
+  // tagged GET or STREAM
+  std::optional<uint32_t> handle;
+
+  // Metrics snapshot (STATS reply)
+  std::optional<nlohmann::json> stats;
+
+  // CAPABILITY_* bits and the largest PUT (HELLO reply)
+  std::optional<uint32_t> capabilities;
+  std::optional<uint64_t> maxPutSize;
+
+  // Upload nonce (STARTED/RESUMED replies); a HAVE's block digest and its
+  // proof, SHA-256 of nonce and block. Binary in the frames, hex in JSON,
+  // and HAVE is only read from binary frames.
+  std::optional<std::array<uint8_t, HAVE_NONCE_BYTES>> nonce;
+  std::optional<sha256::Digest> digest;
+  std::optional<sha256::Digest> proof;
+
   // Default constructor
   WebSocketMessage() = default;
 
@@ -38,6 +82,16 @@ struct WebSocketMessage {
                             msg);
   }
 
+  static WebSocketMessage started(const std::string &streamId,
+                                  size_t chunkSize, size_t minChunkSize,
+                                  size_t maxChunkSize) {
+    WebSocketMessage msg = started(streamId);
+    msg.chunkSize = chunkSize;
+    msg.minChunkSize = minChunkSize;
+    msg.maxChunkSize = maxChunkSize;
+    return msg;
+  }
+
   static WebSocketMessage
   stopped(const std::string &streamId,
           const std::string &msg = "Stream stopped successfully") {
@@ -45,11 +99,84 @@ struct WebSocketMessage {
                             msg);
   }
 
+  static WebSocketMessage stopped(const std::string &streamId,
+                                  uint32_t checksum) {
+    WebSocketMessage msg = stopped(streamId);
+    msg.checksum = checksum;
+    return msg;
+  }
+
+  static WebSocketMessage resumed(const std::string &streamId, size_t offset,
+                                  size_t chunkSize, size_t minChunkSize,
+                                  size_t maxChunkSize) {
+    WebSocketMessage msg("RESUMED", streamId, offset, std::nullopt,
+                         "Stream resumed successfully");
+    msg.chunkSize = chunkSize;
+    msg.minChunkSize = minChunkSize;
+    msg.maxChunkSize = maxChunkSize;
+    return msg;
+  }
+
+  static WebSocketMessage attached(const std::string &streamId,
+                                   size_t chunkSize, size_t minChunkSize,
+                                   size_t maxChunkSize) {
+    WebSocketMessage msg("ATTACHED", streamId, std::nullopt, std::nullopt,
+                         "Stream attached successfully");
+    msg.chunkSize = chunkSize;
+    msg.minChunkSize = minChunkSize;
+    msg.maxChunkSize = maxChunkSize;
+    return msg;
+  }
+
+  static WebSocketMessage detached(const std::string &streamId) {
+    return WebSocketMessage("DETACHED", streamId, std::nullopt, std::nullopt,
+                            "Stream detached successfully");
+  }
+
+  static WebSocketMessage streamed(const std::string &streamId, size_t offset,
+                                   size_t length) {
+    return WebSocketMessage("STREAMED", streamId, offset, length,
+                            "Range streamed successfully");
+  }
+
+  static WebSocketMessage credit(const std::string &streamId,
+                                 uint64_t written, uint64_t window,
+                                 uint32_t handle) {
+    WebSocketMessage msg("CREDIT", streamId, written, window);
+    msg.handle = handle;
+    return msg;
+  }
+
+  static WebSocketMessage has(const std::string &streamId, uint64_t offset,
+                              uint64_t stored) {
+    return WebSocketMessage("HAS", streamId, offset, stored);
+  }
+
+  static WebSocketMessage statsReply(nlohmann::json snapshot) {
+    WebSocketMessage msg("STATS");
+    msg.stats = std::move(snapshot);
+    return msg;
+  }
+
+  static WebSocketMessage hello(uint32_t capabilities, uint64_t maxPutSize) {
+    WebSocketMessage msg("HELLO");
+    msg.capabilities = capabilities;
+    msg.maxPutSize = maxPutSize;
+    return msg;
+  }
+
   static WebSocketMessage error(const std::string &msg) {
     return WebSocketMessage("ERROR", std::nullopt, std::nullopt, std::nullopt,
                             msg);
   }
 
+  static WebSocketMessage retryLater(const std::string &msg,
+                                     uint32_t retryAfterMs) {
+    WebSocketMessage reply = error(msg);
+    reply.retryAfterMs = retryAfterMs;
+    return reply;
+  }
+
   // Convert to JSON
   nlohmann::json toJson() const {
     nlohmann::json j;
@@ -62,6 +189,34 @@ struct WebSocketMessage {
       j["length"] = length.value();
     if (message.has_value())
       j["message"] = message.value();
+    if (chunkSize.has_value())
+      j["chunkSize"] = chunkSize.value();
+    if (minChunkSize.has_value())
+      j["minChunkSize"] = minChunkSize.value();
+    if (maxChunkSize.has_value())
+      j["maxChunkSize"] = maxChunkSize.value();
+    if (durability.has_value())
+      j["durability"] = durability.value();
+    if (window.has_value())
+      j["window"] = window.value();
+    if (retryAfterMs.has_value())
+      j["retryAfterMs"] = retryAfterMs.value();
+    if (checksum.has_value())
+      j["crc32c"] = crc32c::toHex(checksum.value());
+    if (handle.has_value())
+      j["handle"] = handle.value();
+    if (stats.has_value())
+      j["stats"] = stats.value();
+    if (capabilities.has_value())
+      j["capabilities"] = capabilities.value();
+    if (maxPutSize.has_value())
+      j["maxPutSize"] = maxPutSize.value();
+    if (nonce.has_value())
+      j["nonce"] = sha256::toHex(nonce->data(), nonce->size());
+    if (digest.has_value())
+      j["sha256"] = sha256::toHex(digest.value());
+    if (proof.has_value())
+      j["proof"] = sha256::toHex(proof.value());
     return j;
   }
 
@@ -80,6 +235,21 @@ struct WebSocketMessage {
       msg.length = j["length"].get<size_t>();
     if (j.contains("message"))
       msg.message = j["message"].get<std::string>();
+    if (j.contains("chunkSize"))
+      msg.chunkSize = j["chunkSize"].get<size_t>();
+    if (j.contains("minChunkSize"))
+      msg.minChunkSize = j["minChunkSize"].get<size_t>();
+    if (j.contains("maxChunkSize"))
+      msg.maxChunkSize = j["maxChunkSize"].get<size_t>();
+    if (j.contains("durability"))
+      msg.durability = j["durability"].get<std::string>();
+    if (j.contains("window"))
+      msg.window = j["window"].get<uint64_t>();
+    if (j.contains("crc32c"))
+      msg.checksum = static_cast<uint32_t>(
+          std::stoul(j["crc32c"].get<std::string>(), nullptr, 16));
+    if (j.contains("handle"))
+      msg.handle = j["handle"].get<uint32_t>();
     return msg;
   }
 
@@ -88,6 +258,144 @@ struct WebSocketMessage {
     nlohmann::json j = nlohmann::json::parse(jsonStr);
     return fromJson(j);
   }
+
+  // Convert a decoded binary protocol control frame
+  static WebSocketMessage fromBinaryFrame(const BinaryFrame &frame) {
+    WebSocketMessage msg;
+    switch (frame.header.type) {
+    case BinaryFrameType::START:
+      msg.type = "START";
+      if (frame.header.chunkSize > 0)
+        msg.chunkSize = frame.header.chunkSize;
+      msg.durability = durabilityOfTier(frame.header.length);
+      if (frame.header.offset > 0)
+        msg.window = frame.header.offset;
+      break;
+    case BinaryFrameType::PUT:
+      // The payload is the stream; the handler takes it from the frame
+      msg.type = "PUT";
+      msg.length = frame.payloadSize;
+      msg.durability = durabilityOfTier(frame.header.length);
+      break;
+    case BinaryFrameType::STOP:
+      msg.type = "STOP";
+      break;
+    case BinaryFrameType::RESUME:
+      msg.type = "RESUME";
+      if (frame.header.offset > 0)
+        msg.window = frame.header.offset;
+      break;
+    case BinaryFrameType::ATTACH:
+      msg.type = "ATTACH";
+      break;
+    case BinaryFrameType::DETACH:
+      msg.type = "DETACH";
+      break;
+    case BinaryFrameType::GET:
+      msg.type = "GET";
+      msg.offset = static_cast<size_t>(frame.header.offset);
+      msg.length = static_cast<size_t>(frame.header.length);
+      break;
+    case BinaryFrameType::STREAM:
+      msg.type = "STREAM";
+      msg.offset = static_cast<size_t>(frame.header.offset);
+      msg.length = static_cast<size_t>(frame.header.length);
+      if (frame.header.chunkSize > 0)
+        msg.chunkSize = frame.header.chunkSize;
+      break;
+    case BinaryFrameType::HAVE:
+      msg.type = "HAVE";
+      msg.offset = static_cast<size_t>(frame.header.offset);
+      msg.length = static_cast<size_t>(frame.header.length);
+      // Digest then proof; the handler refuses a HAVE without them
+      if (frame.payloadSize == 2 * sha256::DIGEST_BYTES) {
+        msg.digest.emplace();
+        msg.proof.emplace();
+        std::memcpy(msg.digest->data(), frame.payload, sha256::DIGEST_BYTES);
+        std::memcpy(msg.proof->data(), frame.payload + sha256::DIGEST_BYTES,
+                    sha256::DIGEST_BYTES);
+      }
+      break;
+    case BinaryFrameType::STATS:
+      msg.type = "STATS";
+      return msg;
+    case BinaryFrameType::HELLO:
+      msg.type = "HELLO";
+      return msg;
+    default:
+      // Server-to-client types are not valid requests
+      msg.type = "UNKNOWN";
+      return msg;
+    }
+    msg.streamId = std::string(frame.text);
+    if (frame.header.handle != 0)
+      msg.handle = frame.header.handle;
+    return msg;
+  }
+
+  // Durability name of a binary START or PUT tier, none for 0. Unknown
+  // values keep their number, which the handler rejects.
+  static std::optional<std::string> durabilityOfTier(uint64_t tier) {
+    if (tier == 0)
+      return std::nullopt;
+    return tier <= static_cast<uint64_t>(Durability::STRICT_SYNC)
+               ? durabilityToString(static_cast<Durability>(tier))
+               : std::to_string(tier);
+  }
+
+  // Encode as a binary protocol frame (STARTED, STOPPED, RESUMED, ATTACHED,
+  // DETACHED, STREAMED, CREDIT, STATS, HELLO, HAS and ERROR replies)
+  std::vector<uint8_t> toBinaryFrame() const {
+    BinaryFrameHeader header;
+    std::string_view text;
+    if (type == "STATS") {
+      header.type = BinaryFrameType::STATS;
+      header.handle = handle.value_or(0);
+      std::string document = stats.value_or(nlohmann::json::object()).dump();
+      return encodeBinaryFrame(
+          header, {}, reinterpret_cast<const uint8_t *>(document.data()),
+          document.size());
+    }
+    if (type == "STARTED" || type == "RESUMED" || type == "ATTACHED") {
+      header.type = type == "STARTED"   ? BinaryFrameType::STARTED
+                    : type == "RESUMED" ? BinaryFrameType::RESUMED
+                                        : BinaryFrameType::ATTACHED;
+      header.offset = offset.value_or(0);
+      header.chunkSize = static_cast<uint32_t>(chunkSize.value_or(0));
+      header.minChunkSize = static_cast<uint32_t>(minChunkSize.value_or(0));
+      header.maxChunkSize = static_cast<uint32_t>(maxChunkSize.value_or(0));
+    } else if (type == "STOPPED") {
+      header.type = BinaryFrameType::STOPPED;
+      header.checksum = checksum.value_or(0);
+    } else if (type == "DETACHED") {
+      header.type = BinaryFrameType::DETACHED;
+    } else if (type == "HELLO") {
+      header.type = BinaryFrameType::HELLO;
+      header.offset = capabilities.value_or(0);
+      header.length = maxPutSize.value_or(0);
+    } else if (type == "STREAMED" || type == "CREDIT" || type == "HAS") {
+      header.type = type == "STREAMED" ? BinaryFrameType::STREAMED
+                    : type == "CREDIT" ? BinaryFrameType::CREDIT
+                                       : BinaryFrameType::HAS;
+      header.offset = offset.value_or(0);
+      header.length = length.value_or(0);
+    } else {
+      header.type = BinaryFrameType::ERROR_MSG;
+      header.offset = retryAfterMs.value_or(0);
+    }
+    header.handle = handle.value_or(0);
+
+    if (header.type == BinaryFrameType::ERROR_MSG) {
+      if (message.has_value())
+        text = message.value();
+    } else if (streamId.has_value()) {
+      text = streamId.value();
+    }
+    if (nonce.has_value() && carriesChunkSizeLimits(header.type)) {
+      return encodeBinaryFrame(header, text, nonce->data(), nonce->size());
+    }
+    return encodeBinaryFrame(header, text);
+  }
 };
 
 } // namespace audio_stream
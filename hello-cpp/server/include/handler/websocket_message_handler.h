@@ -1,15 +1,46 @@
 #ifndef AUDIO_STREAM_WEBSOCKET_MESSAGE_HANDLER_H
 #define AUDIO_STREAM_WEBSOCKET_MESSAGE_HANDLER_H
 
+#include "compression.h"
 #include "handler/websocket_message.h"
+#include "memory/buffer_view.h"
+#include "memory/chunk_writer.h"
+#include "memory/memory_pool_manager.h"
 #include "memory/stream_manager.h"
+#include "metrics/server_metrics.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace audio_stream {
 
+/**
+ * Limits on the uploads the server takes on at once. A new upload (START
+ * or PUT) is refused with an ERROR carrying retryAfterMs while
+ * maxUploadingStreams are uploading, while the write stage holds more
+ * than maxQueuedBytes not yet written, or while the cache is full of
+ * uploads in progress (StreamManager::isCacheFull). RESUME is always
+ * admitted: it continues an upload already counted. 0 disables a limit.
+ *
+ * Uploads that ask for a window get flow control (CREDIT): a connection's
+ * streams share connectionWindow bytes in flight, and each gets only the
+ * minimum, two maximum-size chunks, while the write stage is over
+ * maxQueuedBytes.
+ */
+struct AdmissionLimits {
+  size_t maxUploadingStreams = 4096;
+  uint64_t maxQueuedBytes = 512ULL * 1024 * 1024;
+  uint64_t connectionWindow = 32ULL * 1024 * 1024;
+  std::chrono::milliseconds retryAfter{1000};
+};
+
 /**
  * Handler for WebSocket messages
  * Processes different message types and coordinates with StreamManager
@@ -18,46 +49,345 @@ class WebSocketMessageHandler {
 public:
   // Callback type for sending responses
   using SendTextCallback = std::function<void(const std::string &)>;
-  using SendBinaryCallback = std::function<void(const std::vector<uint8_t> &)>;
+  // Sends a control reply in the connection's encoding (JSON or binary)
+  using SendMessageCallback = std::function<void(const WebSocketMessage &)>;
+  // Sends GET data; binary protocol connections frame it with its offset,
+  // and compress it as the stream's profile allows if they negotiated it
+  using SendBinaryCallback = std::function<void(
+      uint64_t offset, const BufferView &, CompressionProfile profile)>;
+  // Whether the connection's send buffer has room for more pushed data
+  using CanSendCallback = std::function<bool()>;
 
   explicit WebSocketMessageHandler(
       std::shared_ptr<StreamManager> streamManager);
-  ~WebSocketMessageHandler() = default;
+  ~WebSocketMessageHandler();
 
   // Message handling
   void handleTextMessage(const std::string &message,
                          const std::string &connectionId,
                          SendTextCallback sendText,
-                         SendBinaryCallback sendBinary);
+                         SendBinaryCallback sendBinary,
+                         CanSendCallback canSend = nullptr);
+
+  // Dispatch an already decoded control message
+  void handleMessage(const WebSocketMessage &msg,
+                     const std::string &connectionId,
+                     SendMessageCallback sendMessage,
+                     SendBinaryCallback sendBinary,
+                     CanSendCallback canSend = nullptr);
 
-  void handleBinaryMessage(const std::vector<uint8_t> &data,
+  /**
+   * Queue an upload chunk for the connection's stream with this handle, at
+   * offset if the frame carries one (binary protocol DATA) and otherwise
+   * after the chunks before it. It is written on a writer thread; a failure
+   * is reported from there.
+   */
+  void handleBinaryMessage(PooledBufferPtr data,
                            const std::string &connectionId,
-                           SendTextCallback sendText);
+                           SendMessageCallback sendMessage,
+                           uint32_t handle = 0,
+                           std::optional<uint64_t> offset = std::nullopt);
 
-  // Connection management
-  void associateStreamWithConnection(const std::string &connectionId,
-                                     const std::string &streamId);
+  /**
+   * Store a whole stream sent in one PUT: data holds its bytes (nullptr
+   * for an empty stream). It is stored on a writer thread and answered by
+   * STOPPED with its CRC32C as soon as it is READY, without a handle or a
+   * stream queue left behind on the connection. Streams larger than the
+   * maximum chunk size are refused; they are uploaded with START.
+   */
+  void handlePut(const WebSocketMessage &msg, PooledBufferPtr data,
+                 const std::string &connectionId,
+                 SendMessageCallback sendMessage);
+
+  /**
+   * Set the chunk size range advertised in STARTED. START requests are
+   * clamped into it and larger binary frames are rejected.
+   */
+  void setChunkSizeLimits(size_t minChunkSize, size_t maxChunkSize);
+
+  // Set before the server starts taking connections
+  void setAdmissionLimits(const AdmissionLimits &limits) {
+    admission_ = limits;
+  }
+  const AdmissionLimits &getAdmissionLimits() const { return admission_; }
+
+  /**
+   * Connection management. A connection may upload many streams at once;
+   * each gets a handle, unique on the connection, that tags its frames.
+   * A stream is owned by one connection at a time, so associating it takes
+   * it from any other connection. Other connections may write it beside its
+   * owner once attached (ATTACH), each with a handle of its own.
+   * @return The stream's handle, 0 if the connection already has
+   *         MAX_STREAMS_PER_CONNECTION streams
+   */
+  uint32_t associateStreamWithConnection(const std::string &connectionId,
+                                         const std::string &streamId);
+  void disassociateStream(const std::string &streamId);
+  // Also drops the write queues of its streams once their chunks are
+  // written, unless another connection owns or writes the stream
   void disassociateConnection(const std::string &connectionId);
-  std::string getStreamForConnection(const std::string &connectionId) const;
+  // Handle 0 selects the stream started or resumed last
+  std::string getStreamForConnection(const std::string &connectionId,
+                                     uint32_t handle = 0) const;
+  size_t getStreamCountForConnection(const std::string &connectionId) const;
+
+  static constexpr size_t MAX_STREAMS_PER_CONNECTION = 1024;
+
+  /**
+   * Live tail: a GET at or past the write head of a stream that is still
+   * uploading is parked instead of failing, and answered as soon as a chunk
+   * lands past its offset. It gets "No data available" if the upload stops
+   * short of it or it waits longer than the timeout. Replies to one
+   * connection's GETs of a stream go out in request order: a GET behind a
+   * parked one is parked too, even if its bytes are there.
+   */
+  void setParkedReadTimeout(std::chrono::milliseconds timeout);
+  void expireParkedReads();
+  void cancelParkedReads(const std::string &connectionId);
+  size_t getParkedReadCount() const;
+
+  static constexpr std::chrono::milliseconds DEFAULT_PARKED_READ_TIMEOUT{
+      30000};
+  static constexpr size_t MAX_PARKED_READS = 4096;
+
+  /**
+   * Push the next frames of the queued STREAM ranges, one range at a time
+   * per connection in request order, while canSend reports room. A range
+   * on a stream still uploading waits at the write head.
+   * @return true while any range is left to send
+   */
+  bool pumpRangeStreams();
+  void cancelRangeStreams(const std::string &connectionId);
+  bool hasRangeStreams() const;
+
+  // Frames one range may push per pump, so busy ranges take turns
+  static constexpr size_t RANGE_STREAM_BURST = 64;
+
+  /**
+   * Current values of the cache, buffer pool, write stage and pending
+   * reads, published with the ServerMetrics snapshot by STATS and the
+   * server's metrics endpoint.
+   */
+  std::vector<MetricValue> collectMetrics() const;
 
 private:
+  struct ConnectionStreams {
+    std::unordered_map<uint32_t, std::string> handles; // handle -> streamId
+    std::unordered_set<uint32_t> attached; // Of streams others own
+    uint32_t nextHandle = 1;
+    uint32_t latest = 0; // Receives frames tagged with handle 0
+  };
+
+  struct StreamOwner {
+    std::string connectionId;
+    uint32_t handle;
+  };
+
+  /**
+   * Flow control of an upload that asked for it. CREDIT is sent again once
+   * the stream's written offset passes base by a quarter of length: a
+   * client waiting for credit has more than half the window in flight,
+   * since a window holds at least two chunks, so it never waits forever.
+   */
+  struct UploadCredit {
+    std::string connectionId;
+    uint32_t handle;
+    uint64_t requested; // Window the client asked for
+    uint64_t base;      // Offset and window of the last CREDIT sent
+    uint64_t length;
+    SendMessageCallback sendMessage;
+  };
+
+  struct ParkedRead {
+    std::string connectionId;
+    size_t offset;
+    size_t length;
+    std::chrono::steady_clock::time_point deadline;
+    SendMessageCallback sendMessage;
+    SendBinaryCallback sendBinary;
+  };
+
+  // Parked reads of a stream in arrival order, and the reads per connection
+  // taken from them whose replies are still being sent
+  struct ParkedStream {
+    std::vector<ParkedRead> reads;
+    std::unordered_map<std::string, size_t> answering;
+  };
+
   void handleStartMessage(const WebSocketMessage &msg,
                           const std::string &connectionId,
-                          SendTextCallback sendText);
+                          SendMessageCallback sendMessage);
+
+  void handlePutMessage(const WebSocketMessage &msg,
+                        const std::string &connectionId,
+                        SendMessageCallback sendMessage);
+  void finishPut(const std::string &streamId, Durability durability,
+                 std::shared_ptr<PooledBuffer> data,
+                 SendMessageCallback sendMessage);
+  // Durability a START or PUT asks for, DEFAULT if none; sends an error
+  // and returns nullopt for an unknown tier
+  std::optional<Durability>
+  requestedDurability(const WebSocketMessage &msg,
+                      SendMessageCallback sendMessage);
 
   void handleStopMessage(const WebSocketMessage &msg,
                          const std::string &connectionId,
-                         SendTextCallback sendText);
+                         SendMessageCallback sendMessage);
+  // STOP and RESUME answer once the chunks queued before them are written
+  void finishStop(const std::string &streamId,
+                  SendMessageCallback sendMessage);
+  void finishResume(const std::string &streamId,
+                    const std::string &connectionId, uint32_t handle,
+                    uint64_t window, SendMessageCallback sendMessage);
 
-  void handleGetMessage(const WebSocketMessage &msg, SendTextCallback sendText,
+  void handleResumeMessage(const WebSocketMessage &msg,
+                           const std::string &connectionId,
+                           SendMessageCallback sendMessage);
+
+  // ATTACH is answered at once; DETACH once the chunks the connection sent
+  // before it are written, so every byte of a range is on the stream by
+  // the time its sender hears back
+  void handleAttachMessage(const WebSocketMessage &msg,
+                           const std::string &connectionId,
+                           SendMessageCallback sendMessage);
+  void handleDetachMessage(const WebSocketMessage &msg,
+                           const std::string &connectionId,
+                           SendMessageCallback sendMessage);
+
+  // A HAVE is answered by HAS once the chunks queued before it are written
+  void handleHaveMessage(const WebSocketMessage &msg,
+                         const std::string &connectionId,
+                         SendMessageCallback sendMessage);
+  void finishHave(const std::string &streamId, uint64_t offset,
+                  size_t length, const sha256::Digest &digest,
+                  const sha256::Digest &proof,
+                  SendMessageCallback sendMessage);
+
+  /**
+   * A STREAM request being pushed from offset to end (SIZE_MAX: up to the
+   * end of the stream).
+   */
+  struct RangeStream {
+    std::shared_ptr<StreamContext> stream;
+    size_t offset;
+    size_t next;
+    size_t end;
+    size_t chunkSize;
+    SendMessageCallback sendMessage;
+    SendBinaryCallback sendBinary;
+    CanSendCallback canSend;
+  };
+
+  struct ConnectionRanges {
+    std::deque<RangeStream> ranges; // front() is being pushed
+    bool pumping = false;           // A thread is pushing front()
+    bool cancelled = false;         // Connection closed while pumping
+  };
+
+  void handleStreamMessage(const WebSocketMessage &msg,
+                           const std::string &connectionId,
+                           SendMessageCallback sendMessage,
+                           SendBinaryCallback sendBinary,
+                           CanSendCallback canSend);
+  void pumpConnection(const std::string &connectionId);
+  bool pushRange(RangeStream &range);
+
+  void handleGetMessage(const WebSocketMessage &msg,
+                        const std::string &connectionId,
+                        SendMessageCallback sendMessage,
                         SendBinaryCallback sendBinary);
 
-  void sendErrorMessage(const std::string &error, SendTextCallback sendText);
+  bool parkRead(const std::shared_ptr<StreamContext> &stream,
+                ParkedRead read);
+  void completeParkedReads(const std::string &streamId);
+  void serveParkedRead(const std::string &streamId, const ParkedRead &read);
+  // Caller holds parkedMutex_. Takes the reads that may be answered now,
+  // in order, skipping connections with an earlier read not taken or still
+  // being answered; counts them as answering.
+  template <typename Answerable>
+  std::vector<ParkedRead> takeParkedReads(ParkedStream &parked,
+                                          Answerable answerable);
+  // The replies to reads taken by takeParkedReads have been sent
+  void finishParkedReads(const std::string &streamId,
+                         const std::vector<ParkedRead> &reads);
+
+  void sendErrorMessage(const std::string &error,
+                        SendMessageCallback sendMessage);
+  // An error naming the stream it is about, so an uploading client that
+  // has no request outstanding can tell it fails its upload
+  void sendStreamError(const std::string &streamId, const std::string &error,
+                       SendMessageCallback sendMessage);
+
+  // Attached writers of a stream, beside its owner. attachWriter returns
+  // the connection's handle for the stream, 0 if it has too many streams.
+  uint32_t attachWriter(const std::string &connectionId,
+                        const std::string &streamId);
+  bool detachWriter(const std::string &connectionId,
+                    const std::string &streamId);
+  bool isAttachedHandle(const std::string &connectionId,
+                        uint32_t handle) const;
+  // Caller holds connectionMutex_. addHandle returns 0 if the connection
+  // has MAX_STREAMS_PER_CONNECTION streams.
+  uint32_t addHandle(const std::string &connectionId,
+                     const std::string &streamId);
+  void releaseHandle(const std::string &connectionId, uint32_t handle);
+  // Caller holds connectionMutex_. The connection's handle for the stream
+  // it was attached to, 0 if it was not
+  uint32_t removeWriter(const std::string &streamId,
+                        const std::string &connectionId);
+  // Drop the stream's write queue once no connection owns or writes it;
+  // call after the chunks they sent are written
+  void dropQueueIfUnowned(const std::string &streamId);
+
+  // Why a new upload is refused right now; nullopt if it is admitted
+  std::optional<std::string> admissionRefusal() const;
+  void refuseUpload(const std::string &streamId, const std::string &reason,
+                    SendMessageCallback sendMessage);
+
+  // Start flow control for a stream whose START or RESUME asked for a
+  // window, sending its first CREDIT
+  void openCredit(const std::string &streamId,
+                  const std::string &connectionId, uint32_t handle,
+                  uint64_t requested, uint64_t written,
+                  SendMessageCallback sendMessage);
+  // Called after chunks of the stream were written
+  void updateCredit(const std::string &streamId);
+  void closeCredit(const std::string &streamId);
+  void closeCredits(const std::string &connectionId);
+  uint64_t creditWindow(const std::string &connectionId,
+                        uint64_t requested) const;
 
   std::shared_ptr<StreamManager> streamManager_;
-  std::map<std::string, std::string>
-      connectionStreams_; // connectionId -> streamId
+  std::unordered_map<std::string, ConnectionStreams>
+      connectionStreams_; // connectionId -> streams it uploads
+  std::unordered_map<std::string, StreamOwner>
+      streamOwners_; // streamId -> connection it is uploaded on
+  std::unordered_map<std::string, std::vector<StreamOwner>>
+      streamWriters_; // streamId -> connections attached to it
+  std::unordered_map<std::string, WebSocketMessage>
+      pendingPuts_; // connectionId -> JSON PUT awaiting its data frame
   mutable std::mutex connectionMutex_;
+  size_t minChunkSize_ = MIN_CHUNK_SIZE;
+  size_t maxChunkSize_ = MAX_CHUNK_SIZE;
+
+  std::unordered_map<std::string, ParkedStream>
+      parkedReads_; // streamId -> reads waiting for data or their turn
+  mutable std::mutex parkedMutex_;
+  std::atomic<size_t> parkedCount_{0}; // Lets writes skip parkedMutex_
+  std::chrono::milliseconds parkedReadTimeout_ = DEFAULT_PARKED_READ_TIMEOUT;
+
+  std::unordered_map<std::string, ConnectionRanges>
+      rangeStreams_; // connectionId -> STREAM ranges in request order
+  mutable std::mutex rangeMutex_;
+
+  AdmissionLimits admission_;
+  std::unordered_map<std::string, UploadCredit>
+      uploadCredits_; // streamId -> flow control of its upload
+  mutable std::mutex creditMutex_; // Not held while taking connectionMutex_
+  std::atomic<size_t> creditCount_{0}; // Lets writes skip creditMutex_
+
+  // Last, so its writer threads stop before the state they call back into
+  ChunkWriter chunkWriter_;
 };
 
 } // namespace audio_stream
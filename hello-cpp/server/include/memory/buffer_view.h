@@ -0,0 +1,32 @@
+#ifndef AUDIO_STREAM_BUFFER_VIEW_H
+#define AUDIO_STREAM_BUFFER_VIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace audio_stream {
+
+/**
+ * Read-only, ref-counted view over cached bytes.
+ * The shared owner pins the backing storage (a segment mapping or a pooled
+ * buffer) while the view is alive, so the bytes can be handed to the socket
+ * without first being copied into an intermediate vector.
+ */
+struct BufferView {
+  std::shared_ptr<const uint8_t> data; // Aliases the owning storage
+  size_t length = 0;
+
+  BufferView() = default;
+  BufferView(std::shared_ptr<const uint8_t> data, size_t length)
+      : data(std::move(data)), length(length) {}
+
+  const uint8_t *begin() const { return data.get(); }
+  const uint8_t *end() const { return data.get() + length; }
+  size_t size() const { return length; }
+  bool empty() const { return length == 0; }
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_BUFFER_VIEW_H
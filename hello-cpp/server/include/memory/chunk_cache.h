@@ -0,0 +1,121 @@
+#ifndef AUDIO_STREAM_CHUNK_CACHE_H
+#define AUDIO_STREAM_CHUNK_CACHE_H
+
+#include "memory/buffer_view.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace audio_stream {
+
+/**
+ * In-memory copies of chunks read from READY streams, shared by every
+ * connection that asks for the same (stream, offset, length). Cached bytes
+ * are immutable and ref-counted (BufferView), so a hit is handed to any
+ * number of senders without a copy or the stream's lock, and an evicted
+ * chunk stays valid for views still holding it.
+ *
+ * Split into shards keyed by a hash of the chunk, so readers of different
+ * chunks of one stream do not share a lock; hits take their shard's lock
+ * shared. Each shard keeps an equal part of the byte budget and evicts
+ * with CLOCK: a hit sets the chunk's reference bit, and the hand clears
+ * bits until it reaches a chunk that has not been read since its last
+ * pass. Chunks enter with the bit clear, so a one-off sequential download
+ * does not push out chunks that many clients are reading.
+ *
+ * Nor does it pay for a copy per chunk: a chunk is only copied in on its
+ * second miss. A shard's doorkeeper remembers the keys of chunks missed
+ * once, in a table of GHOST_SLOTS hashes each new key overwrites, so one
+ * pass over a stream fills neither the cache nor more than that table.
+ *
+ * streamKey is StreamContext::instanceId, unique per context, so chunks of
+ * a deleted stream can never be served for a new one with the same ID.
+ */
+class ChunkCache {
+public:
+  explicit ChunkCache(uint64_t maxBytes = DEFAULT_MAX_BYTES);
+
+  ChunkCache(const ChunkCache &) = delete;
+  ChunkCache &operator=(const ChunkCache &) = delete;
+
+  // The cached chunk, or an empty view
+  BufferView find(uint64_t streamKey, uint64_t offset, size_t length);
+
+  /**
+   * Record a chunk just read from storage (a miss), and cache a copy if it
+   * was missed before since the doorkeeper last forgot it. Chunks larger
+   * than MAX_CHUNK_BYTES, or a shard's part of the budget, are not cached.
+   * @param length Length the chunk was requested with, the lookup key
+   */
+  void insert(uint64_t streamKey, uint64_t offset, size_t length,
+              const BufferView &data);
+
+  // Drop every chunk of a stream
+  void erase(uint64_t streamKey);
+
+  // Shrinking evicts down to the new budget; 0 disables the cache
+  void setMaxBytes(uint64_t maxBytes);
+  uint64_t getMaxBytes() const;
+
+  uint64_t getBytes() const;
+  uint64_t getHits() const;
+  uint64_t getMisses() const; // Chunks read from storage
+
+  static constexpr size_t SHARD_COUNT = 16;
+  static constexpr uint64_t DEFAULT_MAX_BYTES = 256ULL * 1024 * 1024;
+  static constexpr size_t MAX_CHUNK_BYTES = 1024 * 1024;
+  static constexpr size_t GHOST_SLOTS = 1024; // Per shard
+
+private:
+  struct Key {
+    uint64_t stream;
+    uint64_t offset;
+    uint64_t length;
+    bool operator==(const Key &other) const {
+      return stream == other.stream && offset == other.offset &&
+             length == other.length;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key &key) const;
+  };
+
+  struct Entry {
+    Key key;
+    BufferView data;
+    std::atomic<bool> referenced{false}; // Set by hits, cleared by the hand
+  };
+
+  struct alignas(64) Shard {
+    mutable std::shared_mutex mutex;
+    std::unordered_map<Key, size_t, KeyHash> index; // Slot of each chunk
+    std::vector<std::unique_ptr<Entry>> slots; // The clock; nullptr: free
+    std::vector<size_t> freeSlots;
+    size_t hand = 0;
+    uint64_t bytes = 0;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    // Doorkeeper: hashes of chunks missed once, lock-free; 0 is empty
+    std::array<std::atomic<uint64_t>, GHOST_SLOTS> ghosts{};
+  };
+
+  Shard &shardFor(const Key &key);
+  // Whether the chunk was missed before; remembers it if not
+  bool admit(Shard &shard, const Key &key);
+  // Caller holds shard.mutex exclusively
+  void evictTo(Shard &shard, uint64_t maxBytes);
+  void removeSlot(Shard &shard, size_t slot);
+
+  std::array<Shard, SHARD_COUNT> shards_;
+  std::atomic<uint64_t> shardMaxBytes_;
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_CHUNK_CACHE_H
@@ -0,0 +1,165 @@
+#ifndef AUDIO_STREAM_CHUNK_WRITER_H
+#define AUDIO_STREAM_CHUNK_WRITER_H
+
+#include "memory/memory_pool_manager.h"
+#include "memory/spsc_queue.h"
+#include "memory/stream_manager.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace audio_stream {
+
+/**
+ * Asynchronous write stage for upload chunks. The I/O thread hands each
+ * frame to its stream's queue and returns; a pool of writer threads drains
+ * the queues, coalescing runs of chunks that continue one another into one
+ * StreamManager::writeBatch, so a batch costs one cache lock and growth check
+ * and page faults on a cold mapping stall a writer instead of the event
+ * loop. A stream is drained by one writer at a time, which keeps its queue
+ * single-consumer.
+ *
+ * A stream whose queue is full is behind storage: the frame is then written
+ * on the submitting thread, which holds back reads on that connection until
+ * storage catches up.
+ */
+class ChunkWriter {
+public:
+  using Callback = std::function<void()>;
+  // Run on a writer thread after chunks of the stream were written
+  using WrittenCallback = std::function<void(const std::string &streamId)>;
+
+  /**
+   * @param streamManager Streams the chunks are written to
+   * @param threads Writer threads; 0 picks DEFAULT_THREADS
+   */
+  explicit ChunkWriter(std::shared_ptr<StreamManager> streamManager,
+                       size_t threads = 0);
+  ~ChunkWriter();
+
+  ChunkWriter(const ChunkWriter &) = delete;
+  ChunkWriter &operator=(const ChunkWriter &) = delete;
+
+  // Set before the first submit
+  void setOnWritten(WrittenCallback onWritten) {
+    onWritten_ = std::move(onWritten);
+  }
+
+  /**
+   * Queue a chunk for writing; does not wait on storage unless the stream's
+   * queue is full. Several threads may submit for one stream (connections
+   * attached to its upload); they take turns at its queue.
+   * @param offset Byte offset in the stream, nullopt to append after the
+   * chunks queued before it
+   * @param onFailure Run (on the writing thread) if the chunk is not written
+   */
+  void submit(const std::string &streamId, std::optional<uint64_t> offset,
+              PooledBufferPtr data, Callback onFailure);
+
+  /**
+   * Run callback on a writer thread once every chunk submitted for the
+   * stream so far has been written (or has failed).
+   */
+  void whenWritten(const std::string &streamId, Callback callback);
+
+  /**
+   * Forget where the stream's appended chunks go; the next one without an
+   * offset starts at the stream's write head (after a RESUME).
+   */
+  void resetAppendOffset(const std::string &streamId);
+
+  // Drop the stream's queue once nothing more is submitted for it
+  void removeStream(const std::string &streamId);
+  // Streams with a queue, whether or not anything is queued on it
+  size_t getStreamCount() const;
+
+  // Write what is queued, then stop the writer threads; call once nothing
+  // submits concurrently
+  void stop();
+
+  size_t getThreadCount() const { return threads_.size(); }
+  size_t getQueuedChunks() const {
+    return queuedChunks_.load(std::memory_order_relaxed);
+  }
+  // Bytes submitted and not yet written, how far storage is behind
+  uint64_t getQueuedBytes() const {
+    return queuedBytes_.load(std::memory_order_relaxed);
+  }
+  uint64_t getBatchCount() const {
+    return batches_.load(std::memory_order_relaxed);
+  }
+  uint64_t getInlineWriteCount() const {
+    return inlineWrites_.load(std::memory_order_relaxed);
+  }
+
+  static constexpr size_t DEFAULT_THREADS = 4;
+  static constexpr size_t QUEUE_CAPACITY = 256;   // Chunks per stream
+  static constexpr size_t MAX_BATCH_CHUNKS = 64;  // Per writeBatch
+
+private:
+  struct PendingWrite {
+    uint64_t offset = 0;
+    PooledBufferPtr data;
+    Callback onFailure;
+  };
+
+  struct Barrier {
+    size_t sequence; // Runs once this many chunks have been written
+    Callback callback;
+  };
+
+  struct StreamQueue {
+    explicit StreamQueue(const std::string &id)
+        : streamId(id), chunks(QUEUE_CAPACITY) {}
+
+    std::string streamId;
+    SpscQueue<PendingWrite> chunks;
+    std::atomic<bool> scheduled{false}; // Queued for, or held by, a writer
+    std::atomic<size_t> written{0};     // Chunks taken and written
+
+    std::mutex producerMutex;             // One submitter at a time
+    std::optional<uint64_t> appendOffset; // Under producerMutex
+
+    std::mutex barrierMutex;
+    std::deque<Barrier> barriers;
+  };
+
+  std::shared_ptr<StreamQueue> queueFor(const std::string &streamId);
+  void schedule(const std::shared_ptr<StreamQueue> &queue);
+  void writerLoop();
+  void drain(StreamQueue &queue);
+  void writeBatch(StreamQueue &queue, std::vector<PendingWrite> &batch);
+  bool hasDueBarrier(StreamQueue &queue);
+  void runDueBarriers(StreamQueue &queue);
+
+  std::shared_ptr<StreamManager> streamManager_;
+  WrittenCallback onWritten_;
+
+  std::unordered_map<std::string, std::shared_ptr<StreamQueue>> queues_;
+  mutable std::shared_mutex queuesMutex_;
+
+  std::deque<std::shared_ptr<StreamQueue>> ready_; // Streams with work
+  std::mutex readyMutex_;
+  std::condition_variable readyCv_;
+  std::atomic<bool> stopped_{false}; // Later chunks are written inline
+  std::vector<std::thread> threads_;
+
+  std::atomic<size_t> queuedChunks_{0};
+  std::atomic<uint64_t> queuedBytes_{0};
+  std::atomic<uint64_t> batches_{0};
+  std::atomic<uint64_t> inlineWrites_{0};
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_CHUNK_WRITER_H
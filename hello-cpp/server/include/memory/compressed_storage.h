@@ -0,0 +1,124 @@
+#ifndef AUDIO_STREAM_COMPRESSED_STORAGE_H
+#define AUDIO_STREAM_COMPRESSED_STORAGE_H
+
+#include "compression.h"
+#include "memory/reader_gate.h"
+#include "memory/storage_backend.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#define AUDIO_STREAM_HAVE_COMPRESSED_STORAGE 1
+#endif
+
+namespace audio_stream {
+
+/**
+ * Read-only cache file of a READY stream, stored as independently
+ * compressed BLOCK_SIZE blocks (compression.h) behind an index, so a GET
+ * at any offset decompresses only the blocks it covers. StreamManager
+ * writes one with compress() once a stream is READY and swaps it in for
+ * the stream's original file; blocks that do not shrink are stored as is.
+ *
+ * File layout (little-endian):
+ *   0  u32 magic "ASCZ"     4 u8 version   5 u8 codec   6 u8 pcm16Channels
+ *   8  u32 blockSize        12 u32 blockCount           16 u64 size
+ *   24 u32 CRC32C of the index                28 u32 CRC32C of bytes 0..27
+ *   32 index: per block u64 file offset, u32 stored bytes (the block's
+ *      length: stored uncompressed), u32 CRC32C of the decompressed block
+ *   then the blocks.
+ *
+ * Reads take no lock: they enter a ReaderGate and use the descriptor and
+ * index, which close() only releases after the readers have left. Reads
+ * decompress into pooled buffers; a read within one block aliases its
+ * buffer. The file is sealed whenever it is open. POSIX only
+ * (AUDIO_STREAM_HAVE_COMPRESSED_STORAGE).
+ */
+class CompressedStorage : public StorageBackend {
+public:
+  explicit CompressedStorage(const std::string &filePath);
+  ~CompressedStorage() override;
+
+  CompressedStorage(const CompressedStorage &) = delete;
+  CompressedStorage &operator=(const CompressedStorage &) = delete;
+
+  /**
+   * Write the first size bytes of source to path in this format, synced
+   * and then renamed into place from path + ".tmp".
+   * @param checksum CRC32C the data must have, or nothing is written
+   * @return Bytes of the written file; 0 if it was not written (an error,
+   *         or it would not be at least an eighth smaller than size)
+   */
+  static uint64_t compress(StorageBackend &source, uint64_t size,
+                           uint32_t checksum, const std::string &path,
+                           CompressionCodec codec, unsigned pcm16Channels);
+
+  // Read-only: create, writes and finalize fail
+  bool create(uint64_t initialSize = 0) override;
+  bool open() override;
+  void close() override;
+
+  size_t write(uint64_t offset, const uint8_t *data, size_t size) override;
+  std::vector<uint8_t> read(uint64_t offset, size_t length) override;
+  BufferView readView(uint64_t offset, size_t length) override;
+  bool seal() override { return isOpen(); }
+  BufferView tryReadView(uint64_t offset, size_t length) override;
+  std::vector<size_t>
+  writeBatch(const std::vector<WriteOperation> &operations) override;
+
+  bool finalize(uint64_t finalSize, bool flushData = true) override;
+  // The file was synced when it was written
+  bool flushAsync() override { return true; }
+  bool flush() override { return true; }
+  bool sync() override { return true; }
+  bool prefetch(uint64_t offset, size_t length) override;
+  bool adviseSequential(bool sequential) override;
+  uint64_t releaseMappings() override { return 0; }
+
+  uint64_t getSize() const override { return size_; }
+  uint64_t getCapacity() const override { return fileLength_; }
+  uint64_t getMappedBytes() const override { return 0; }
+  uint64_t getUnflushedBytes() const override { return 0; }
+  std::string getFilePath() const override { return filePath_; }
+  bool isOpen() const override {
+    return open_.load(std::memory_order_acquire);
+  }
+  CompressionCodec getCodec() const { return codec_; }
+
+  static constexpr size_t BLOCK_SIZE = 64 * 1024;
+  static constexpr uint8_t FORMAT_VERSION = 1;
+  static constexpr size_t HEADER_SIZE = 32;
+  static constexpr size_t INDEX_ENTRY_SIZE = 16;
+
+private:
+  struct Block {
+    uint64_t fileOffset;
+    uint32_t storedBytes;
+    uint32_t crc;
+  };
+
+  // Caller is inside readers_ and saw the file open
+  BufferView readOpen(uint64_t offset, size_t length);
+  bool decodeBlock(size_t index, uint8_t *dest);
+  size_t blockLength(size_t index) const;
+  void logError(const std::string &operation, const std::string &error) const;
+
+  std::string filePath_;
+  std::mutex stateMutex_; // Serializes open and close
+  ReaderGate readers_;
+  std::atomic<bool> open_{false};
+  // Set before open_ is, cleared after readers left; readers only read
+  int fd_ = -1;
+  CompressionCodec codec_ = CompressionCodec::NONE;
+  unsigned pcm16Channels_ = 0;
+  size_t blockSize_ = BLOCK_SIZE;
+  std::vector<Block> blocks_;
+  std::atomic<uint64_t> size_{0};
+  std::atomic<uint64_t> fileLength_{0};
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_COMPRESSED_STORAGE_H
@@ -0,0 +1,76 @@
+#ifndef AUDIO_STREAM_EXTENT_TRACKER_H
+#define AUDIO_STREAM_EXTENT_TRACKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <utility>
+
+namespace audio_stream {
+
+/**
+ * Which bytes of a stream have been written, kept as sorted, disjoint
+ * extents. Chunks may be written at any offset in any order; extents that
+ * touch are merged. Each extent keeps the CRC32C of its bytes, combined
+ * as neighbours join, so a stream filled out of order still ends up with
+ * its checksum without reading it back. Writing over bytes already held
+ * loses the CRC of the extent they fall in; the owner recomputes it from
+ * the data.
+ *
+ * Not synchronized; StreamContext guards it with contextMutex.
+ */
+class ExtentTracker {
+public:
+  /**
+   * Record a write.
+   * @param offset First byte written
+   * @param length Bytes written
+   * @param crc CRC32C of the bytes written
+   */
+  void add(uint64_t offset, uint64_t length, uint32_t crc);
+
+  // Replace everything with one extent [0, length), e.g. a restored stream
+  void assign(uint64_t length, uint32_t crc);
+  void clear();
+
+  /**
+   * End of the run of written bytes that contains offset, or offset itself
+   * if it has not been written. filledEnd(0) is the write head up to which
+   * the stream can be read.
+   */
+  uint64_t filledEnd(uint64_t offset) const;
+
+  // One past the last written byte
+  uint64_t end() const;
+  uint64_t getFilledBytes() const { return filledBytes_; }
+  size_t getExtentCount() const { return extents_.size(); }
+
+  // Whether every byte of [0, size) has been written
+  bool isComplete(uint64_t size) const { return filledEnd(0) >= size; }
+
+  /**
+   * First unwritten range of [0, size)
+   * @return {begin, end} of the gap, {size, size} if there is none
+   */
+  std::pair<uint64_t, uint64_t> firstGap(uint64_t size) const;
+
+  /**
+   * CRC32C of [0, filledEnd(0)), unless it was lost to an overwrite
+   */
+  std::optional<uint32_t> prefixChecksum() const;
+
+private:
+  struct Extent {
+    uint64_t end;
+    uint32_t crc;
+    bool crcKnown;
+  };
+
+  std::map<uint64_t, Extent> extents_; // Keyed by first byte
+  uint64_t filledBytes_ = 0;
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_EXTENT_TRACKER_H
@@ -0,0 +1,106 @@
+#ifndef AUDIO_STREAM_IO_URING_STORAGE_H
+#define AUDIO_STREAM_IO_URING_STORAGE_H
+
+#include "memory/storage_backend.h"
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define AUDIO_STREAM_HAVE_IO_URING 1
+#endif
+#endif
+
+namespace audio_stream {
+
+/**
+ * Cache file served with explicit reads and writes through io_uring
+ * instead of page faults on a mapping. Each thread submits on its own
+ * ring, so callers never share a submission queue; a batch of writes (or a
+ * read spanning several buffers) goes to the kernel in one io_uring_enter.
+ *
+ * With directIo the file is opened O_DIRECT and bypasses the page cache:
+ * I/O goes through block-aligned buffers taken from MemoryPoolManager and
+ * registered with the ring (READ_FIXED/WRITE_FIXED). Writes that start or
+ * end inside a block read that block back first, so direct writes of one
+ * file are serialized; reads are not. Filesystems that refuse O_DIRECT
+ * (tmpfs) get buffered I/O.
+ *
+ * Reads copy into pooled buffers, so views are never zero-copy and nothing
+ * stays mapped: getMappedBytes() is always 0.
+ */
+class IoUringStorage : public StorageBackend {
+public:
+  IoUringStorage(const std::string &filePath, bool directIo);
+  ~IoUringStorage() override;
+
+  IoUringStorage(const IoUringStorage &) = delete;
+  IoUringStorage &operator=(const IoUringStorage &) = delete;
+
+  // Whether this process can set up a ring (kernel support, seccomp)
+  static bool isSupported();
+
+  bool create(uint64_t initialSize = 0) override;
+  bool open() override;
+  void close() override;
+
+  size_t write(uint64_t offset, const uint8_t *data, size_t size) override;
+  std::vector<uint8_t> read(uint64_t offset, size_t length) override;
+  BufferView readView(uint64_t offset, size_t length) override;
+  // Reads take only a shared lock already; there is no sealed path
+  bool seal() override { return false; }
+  BufferView tryReadView(uint64_t, size_t) override { return BufferView(); }
+  std::vector<size_t>
+  writeBatch(const std::vector<WriteOperation> &operations) override;
+
+  bool finalize(uint64_t finalSize, bool flushData = true) override;
+  bool flushAsync() override;
+  bool flush() override;
+  bool sync() override;
+  bool prefetch(uint64_t offset, size_t length) override;
+  bool adviseSequential(bool sequential) override;
+  uint64_t releaseMappings() override { return 0; }
+
+  uint64_t getSize() const override { return fileSize_; }
+  uint64_t getCapacity() const override { return fileLength_; }
+  uint64_t getMappedBytes() const override { return 0; }
+  uint64_t getUnflushedBytes() const override {
+    return unflushedBytes_.load(std::memory_order_relaxed);
+  }
+  std::string getFilePath() const override { return filePath_; }
+  bool isOpen() const override { return fd_ >= 0; }
+  bool usesDirectIo() const { return directIo_; }
+
+  static constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+  static constexpr unsigned RING_ENTRIES = 64;
+  static constexpr size_t FIXED_BUFFERS = 8;           // Per ring
+  static constexpr size_t FIXED_BUFFER_SIZE = 1 << 20; // 1MB each
+
+private:
+  bool openFile(bool create, uint64_t initialSize);
+  bool ensureOpen(std::shared_lock<std::shared_mutex> &lock, bool create);
+  size_t readAt(uint64_t offset, uint8_t *dest, size_t length);
+  std::vector<size_t>
+  writeBuffered(const std::vector<WriteOperation> &operations);
+  std::vector<size_t>
+  writeDirect(const std::vector<WriteOperation> &operations);
+  size_t readDirect(uint64_t offset, uint8_t *dest, size_t length);
+  void recordWritten(uint64_t end, uint64_t diskEnd, size_t bytes);
+  void logError(const std::string &operation, const std::string &error) const;
+
+  std::string filePath_;
+  bool directIo_;
+  int fd_ = -1;
+  std::atomic<uint64_t> fileSize_{0};   // Logical size (bytes written)
+  std::atomic<uint64_t> fileLength_{0}; // On disk; direct writes pad blocks
+  std::atomic<uint64_t> unflushedBytes_{0};
+  mutable std::shared_mutex stateMutex_; // Exclusive to open/close/trim
+  std::mutex directWriteMutex_;
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_IO_URING_STORAGE_H
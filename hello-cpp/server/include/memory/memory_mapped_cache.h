@@ -1,8 +1,15 @@
 #ifndef AUDIO_STREAM_MEMORY_MAPPED_CACHE_H
 #define AUDIO_STREAM_MEMORY_MAPPED_CACHE_H
 
+#include "memory/buffer_view.h"
+#include "memory/memory_pool_manager.h"
+#include "memory/reader_gate.h"
+#include "memory/storage_backend.h"
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <shared_mutex>
 #include <string>
 #include <vector>
@@ -18,20 +25,25 @@
 namespace audio_stream {
 
 /**
- * Memory-mapped file cache for efficient data storage.
- * Provides zero-copy read/write access to cached files.
+ * Memory-mapped file cache for efficient data storage; the default
+ * StorageBackend. Provides zero-copy read/write access to cached files.
  * Follows the unified mmap implementation specification v2.0.0.
  *
  * Key Features:
  * - Large file support (>2GB) using 64-bit offsets
  * - Batch operations for improved I/O efficiency
  * - Thread-safe operations with read-write locks
- * - Memory management with flush/prefetch/evict
+ * - Memory management with flush/prefetch/evict; the caller picks when
+ *   (and whether) written pages are flushed
+ * - Zero-copy reads via ref-counted views that pin the segment mapping
+ * - Append-optimized growth: file capacity is tracked apart from the
+ *   logical size and grows geometrically, so appends only extend the tail
+ *   segment instead of unmapping everything
  * - Cross-platform support (Windows/POSIX)
  *
  * @version 2.0.0
  */
-class MemoryMappedCache {
+class MemoryMappedCache : public StorageBackend {
 public:
   // Configuration constants
   static constexpr uint64_t SEGMENT_SIZE =
@@ -39,74 +51,153 @@ public:
   static constexpr uint64_t MAX_CACHE_SIZE =
       8ULL * 1024 * 1024 * 1024; // 8GB total
   static constexpr size_t BATCH_OPERATION_LIMIT = 1000;
-
-  /**
-   * Write operation for batch processing.
-   */
-  struct WriteOperation {
-    uint64_t offset;
-    std::vector<uint8_t> data;
-  };
-
-  /**
-   * Read operation for batch processing.
-   */
-  struct ReadOperation {
-    uint64_t offset;
-    size_t length;
-  };
+  static constexpr uint64_t MIN_CAPACITY_INCREMENT =
+      1ULL * 1024 * 1024; // 1MB minimum growth step
 
   explicit MemoryMappedCache(const std::string &filePath);
-  ~MemoryMappedCache();
+  ~MemoryMappedCache() override;
 
   // Disable copy and move
   MemoryMappedCache(const MemoryMappedCache &) = delete;
   MemoryMappedCache &operator=(const MemoryMappedCache &) = delete;
 
   // File operations
-  bool create(uint64_t initialSize = 0);
-  bool open();
-  void close();
+  bool create(uint64_t initialSize = 0) override;
+  bool open() override;
+  void close() override;
 
-  // Data operations
+  /**
+   * Data operations. Writes into space that is already allocated and mapped
+   * run under the shared lock, so writers at different offsets of one file
+   * copy concurrently; growing or mapping takes the exclusive lock.
+   */
   size_t write(uint64_t offset, const std::vector<uint8_t> &data);
-  std::vector<uint8_t> read(uint64_t offset, size_t length);
+  size_t write(uint64_t offset, const uint8_t *data, size_t size) override;
+  std::vector<uint8_t> read(uint64_t offset, size_t length) override;
+  BufferView readView(uint64_t offset, size_t length) override;
 
-  // Batch operations
-  std::vector<size_t> writeBatch(const std::vector<WriteOperation> &operations);
+  /**
+   * seal() records the mapped segments in a fixed table that tryReadView
+   * reads under a ReaderGate guard, neither taking rwMutex_ nor opening or
+   * mapping anything; segments mapped later by readView are added to it.
+   * Anything that drops or moves a mapping, or changes the file length,
+   * unseals first and waits out the readers.
+   */
+  bool seal() override;
+  BufferView tryReadView(uint64_t offset, size_t length) override;
+
+  /**
+   * Batch operations. writeBatch takes the lock and grows the file once for
+   * the whole batch.
+   * @return Bytes written by each operation
+   */
+  std::vector<size_t>
+  writeBatch(const std::vector<WriteOperation> &operations) override;
   std::vector<std::vector<uint8_t>>
   readBatch(const std::vector<ReadOperation> &operations);
 
   // Advanced operations
   bool resize(uint64_t newSize);
-  bool finalize(uint64_t finalSize);
-  bool flush();
-  bool prefetch(uint64_t offset, size_t length);
+  bool reserve(uint64_t capacity);
+  /**
+   * Trim the file to its final size.
+   * @param flushData Also write dirty pages back (flush) before returning
+   */
+  bool finalize(uint64_t finalSize, bool flushData = true) override;
+
+  /**
+   * Durability. Writes only dirty the page cache; nothing reaches the disk
+   * until the kernel writes it back or one of these is called.
+   * flushAsync() starts write-back of dirty pages without waiting, flush()
+   * waits for it (msync(MS_SYNC)), and sync() also commits the file's data
+   * to stable storage (fdatasync).
+   */
+  bool flushAsync() override;
+  bool flush() override;
+  bool sync() override;
+  // WILLNEED on the pages of the range only, not on whole segments
+  bool prefetch(uint64_t offset, size_t length) override;
+  // MADV_SEQUENTIAL on every mapping, including segments mapped later
+  bool adviseSequential(bool sequential) override;
   bool evict(uint64_t offset, size_t length);
 
+  /**
+   * Drop every mapped segment so the file holds no resident pages; the
+   * next access maps it again. Segments pinned by views are advised away
+   * (MADV_DONTNEED) and unmapped once the last view is released.
+   * @return Bytes of mappings released
+   */
+  uint64_t releaseMappings() override;
+
   // Utility
-  uint64_t getSize() const;
-  std::string getFilePath() const;
-  bool isOpen() const;
+  uint64_t getSize() const override;
+  uint64_t getCapacity() const override;
+  uint64_t getMappedBytes() const override; // Length of all mappings
+  uint64_t getUnflushedBytes() const override;
+  std::string getFilePath() const override;
+  bool isOpen() const override;
 
 private:
+  /**
+   * A mapped view of one segment. The tail segment may be shorter than
+   * SEGMENT_SIZE and is extended in place as the file capacity grows.
+   * Segments are shared with outstanding BufferViews and are unmapped when
+   * the last owner releases them.
+   */
+  struct MappedSegment : std::enable_shared_from_this<MappedSegment> {
+    void *address = nullptr;
+    uint64_t length = 0;
+#ifdef _WIN32
+    HANDLE mappingHandle = nullptr;
+#endif
+    ~MappedSegment();
+  };
+
   // Internal methods
+  void unseal(); // Caller holds rwMutex_ exclusively
   bool mapSegment(uint64_t segmentIndex);
+  // Map the segments [offset, offset + length) covers; mapping mutates
+  // segments_, so the caller holds rwMutex_ exclusively
+  bool mapRange(uint64_t offset, uint64_t length);
+  void unmapSegment(uint64_t segmentIndex);
+  uint64_t releaseSegment(uint64_t segmentIndex);
   void unmapAllSegments();
+  bool ensureCapacity(uint64_t requiredSize);
+  bool setFileLength(uint64_t newLength);
+  bool remapTailSegment();
+  uint64_t nextCapacity(uint64_t requiredSize) const;
   void *getSegmentAddress(uint64_t segmentIndex);
+  // Copy between mapped segments and memory; the caller holds rwMutex_
+  // (shared is enough) and has checked isMapped or called mapRange
+  size_t copyOut(uint64_t offset, uint8_t *dest, size_t length);
+  size_t copyIn(uint64_t offset, const uint8_t *data, size_t size);
+  bool isMapped(uint64_t offset, size_t length) const;
+  bool prepareWrite(std::shared_lock<std::shared_mutex> &shared,
+                    std::unique_lock<std::shared_mutex> &exclusive,
+                    uint64_t offset, uint64_t length);
   bool validateOffset(uint64_t offset, size_t length) const;
   void logError(const std::string &operation, const std::string &error) const;
 
   // Member variables
   std::string filePath_;
-  uint64_t fileSize_;
+  std::atomic<uint64_t> fileSize_; // Logical size (bytes written)
+  uint64_t capacity_; // Allocated file length on disk
+  std::atomic<uint64_t> unflushedBytes_{0};
+  std::atomic<bool> sequential_{false};
   bool isOpen_;
   mutable std::shared_mutex rwMutex_;
-  std::map<uint64_t, void *> segments_;
+  std::map<uint64_t, std::shared_ptr<MappedSegment>> segments_;
+
+  // Sealed read path; the table is only written while unsealed, or by
+  // mapSegment filling an empty slot
+  static constexpr size_t MAX_SEGMENTS = MAX_CACHE_SIZE / SEGMENT_SIZE;
+  std::atomic<bool> sealed_{false};
+  std::atomic<uint64_t> sealedSize_{0};
+  std::array<std::atomic<MappedSegment *>, MAX_SEGMENTS> sealedSegments_{};
+  ReaderGate readers_;
 
 #ifdef _WIN32
   HANDLE fileHandle_;
-  std::map<uint64_t, HANDLE> mappingHandles_;
 #else
   int fileDescriptor_;
 #endif
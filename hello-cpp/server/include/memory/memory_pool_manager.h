@@ -2,21 +2,95 @@
 #define AUDIO_STREAM_MEMORY_POOL_MANAGER_H
 
 #include "../include/common_types.h"
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
 #include <vector>
 
 namespace audio_stream {
 
+/**
+ * Fixed-capacity byte buffer handed out by MemoryPoolManager.
+ * Storage is left uninitialised and is never zero-filled on reuse; size()
+ * tracks how many bytes the current user filled in. It is page-aligned, so
+ * buffers can be registered with io_uring and used for O_DIRECT I/O.
+ */
+class PooledBuffer {
+public:
+  static constexpr size_t ALIGNMENT = 4096;
+
+  uint8_t *data() { return storage_.get(); }
+  const uint8_t *data() const { return storage_.get(); }
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+
+  // Set the number of valid bytes (must not exceed capacity)
+  void resize(size_t size) { size_ = size <= capacity_ ? size : capacity_; }
+
+private:
+  friend class MemoryPoolManager;
+  PooledBuffer(size_t capacity, int sizeClass)
+      : storage_(static_cast<uint8_t *>(
+            ::operator new[](capacity, std::align_val_t{ALIGNMENT}))),
+        capacity_(capacity), sizeClass_(sizeClass) {}
+
+  struct AlignedDelete {
+    void operator()(uint8_t *storage) const {
+      ::operator delete[](storage, std::align_val_t{ALIGNMENT});
+    }
+  };
+
+  std::unique_ptr<uint8_t[], AlignedDelete> storage_;
+  size_t capacity_;
+  size_t size_ = 0;
+  int sizeClass_; // -1 for oversized buffers that are never pooled
+};
+
+/**
+ * Returns a buffer to the pool instead of freeing it.
+ */
+struct PooledBufferDeleter {
+  void operator()(PooledBuffer *buffer) const;
+};
+
+using PooledBufferPtr = std::unique_ptr<PooledBuffer, PooledBufferDeleter>;
+
 /**
  * Memory pool manager for efficient buffer reuse
  * Pre-allocates buffers to minimize allocation overhead
  * Implemented as a singleton to ensure a single shared pool across all streams
+ *
+ * Buffers come in power-of-two size classes from 4KB to 1MB. Each thread
+ * keeps a small cache per class in front of the shared, mutex-protected
+ * free lists, so steady-state acquire/release is lock-free and
+ * allocation-free. Requests above 1MB are allocated directly.
  */
 class MemoryPoolManager {
 public:
+  static constexpr size_t MIN_BUFFER_SIZE = 4 * 1024;    // 4KB
+  static constexpr size_t MAX_BUFFER_SIZE = 1024 * 1024; // 1MB
+  static constexpr size_t SIZE_CLASS_COUNT = 9;          // 4KB .. 1MB
+  static constexpr size_t THREAD_CACHE_LIMIT = 4; // Per class, per thread
+
+  /**
+   * Pool counters, all monotonic since startup.
+   * - hits: served from the calling thread's cache
+   * - misses: thread cache empty, served from the shared free list
+   * - exhaustions: size class empty, a new buffer was allocated
+   * - oversized: larger than MAX_BUFFER_SIZE, allocated outside the pool
+   * - dropped: released while the size class was full, freed
+   */
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t exhaustions = 0;
+    uint64_t oversized = 0;
+    uint64_t dropped = 0;
+  };
+
   // Singleton access
   static MemoryPoolManager &getInstance(size_t bufferSize = 65536,
                                         size_t poolSize = 100);
@@ -28,22 +102,44 @@ public:
   MemoryPoolManager &operator=(MemoryPoolManager &&) = delete;
 
   // Buffer management
-  std::shared_ptr<std::vector<uint8_t>> acquireBuffer();
-  void releaseBuffer(std::shared_ptr<std::vector<uint8_t>> buffer);
+  PooledBufferPtr acquire(size_t size);
+  void release(PooledBuffer *buffer);
 
   // Statistics
+  Stats getStats() const;
   size_t getAvailableBuffers() const;
   size_t getTotalBuffers() const;
 
 private:
+  struct SizeClass {
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<PooledBuffer>> freeList;
+  };
+
+  struct ThreadCache {
+    std::array<std::vector<std::unique_ptr<PooledBuffer>>, SIZE_CLASS_COUNT>
+        buffers;
+    ~ThreadCache();
+  };
+
   // Private constructor for singleton
   MemoryPoolManager(size_t bufferSize, size_t poolSize);
   ~MemoryPoolManager();
 
+  static int sizeClassFor(size_t size);
+  static size_t classCapacity(int sizeClass);
+  static ThreadCache &threadCache();
+  void returnToSharedPool(std::unique_ptr<PooledBuffer> buffer);
+
   size_t bufferSize_;
-  size_t poolSize_;
-  std::queue<std::shared_ptr<std::vector<uint8_t>>> availableBuffers_;
-  mutable std::mutex mutex_;
+  size_t poolSize_; // Maximum free buffers retained per size class
+  std::array<SizeClass, SIZE_CLASS_COUNT> classes_;
+
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> exhaustions_{0};
+  std::atomic<uint64_t> oversized_{0};
+  std::atomic<uint64_t> dropped_{0};
 };
 
 } // namespace audio_stream
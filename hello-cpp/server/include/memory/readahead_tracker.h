@@ -0,0 +1,68 @@
+#ifndef AUDIO_STREAM_READAHEAD_TRACKER_H
+#define AUDIO_STREAM_READAHEAD_TRACKER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace audio_stream {
+
+/**
+ * Detects sequential reads of one stream and decides what to read ahead.
+ * Several readers may walk the same stream at once (parallel range
+ * downloads, multiplexed GETs), so it follows up to CURSORS of them: a read
+ * starting where a cursor's last read ended continues that cursor, any
+ * other read replaces the least recently used one. After SEQUENTIAL_READS
+ * reads in a row a cursor is streaming and keeps a readahead window of
+ * WINDOW_BYTES past its position, extended in page-aligned steps once less
+ * than half of it is left, so the next reads find their pages resident.
+ * A window cut short by the readable end (an upload still being written)
+ * counts neither hit nor miss for reads past it: that data is new and
+ * still in the page cache.
+ *
+ * Not synchronized; StreamContext guards it with readaheadMutex.
+ */
+class ReadaheadTracker {
+public:
+  struct Decision {
+    bool streaming = false; // The read continued a streaming cursor
+    bool hit = false;       // ...and lay inside its readahead window
+    bool miss = false;      // ...and reached past it
+    bool streamChanged = false; // isStreaming() flipped with this read
+    uint64_t prefetchOffset = 0;
+    uint64_t prefetchLength = 0; // 0: nothing to read ahead
+  };
+
+  /**
+   * Record a read of [offset, offset + length).
+   * @param readableEnd End of the readable data; the window stops there
+   */
+  Decision recordRead(uint64_t offset, uint64_t length, uint64_t readableEnd);
+
+  // Whether any cursor is streaming
+  bool isStreaming() const { return streamingCursors_ > 0; }
+
+  void reset();
+
+  static constexpr size_t CURSORS = 4;
+  static constexpr uint32_t SEQUENTIAL_READS = 2;
+  static constexpr uint64_t WINDOW_BYTES = 4 * 1024 * 1024;
+  static constexpr uint64_t PAGE_BYTES = 4096;
+
+private:
+  struct Cursor {
+    uint64_t next = 0;      // Where the next sequential read starts
+    uint64_t windowEnd = 0; // Read ahead up to here; 0 before the first
+    uint32_t reads = 0;     // Sequential reads so far; 0: unused
+    bool clamped = false;   // Window cut short at the readable end
+    uint64_t lastUsed = 0;
+  };
+
+  std::array<Cursor, CURSORS> cursors_{};
+  size_t streamingCursors_ = 0;
+  uint64_t clock_ = 0;
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_READAHEAD_TRACKER_H
@@ -0,0 +1,72 @@
+#ifndef AUDIO_STREAM_READER_GATE_H
+#define AUDIO_STREAM_READER_GATE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+namespace audio_stream {
+
+/**
+ * Grace periods for data that readers use without a lock. A reader holds a
+ * Guard while it touches the data. A writer first unpublishes the data
+ * (e.g. clears the flag readers check after entering), then calls
+ * synchronize(), which returns once every reader that could still see it
+ * has left; only then is the data changed or freed.
+ *
+ * Entering increments a counter on one of STRIPES cache lines, picked per
+ * thread, so readers on different cores rarely write the same line. Both
+ * sides use sequentially consistent operations: a reader's increment and
+ * its check of the flag cannot pass the writer's clear and its scan.
+ */
+class ReaderGate {
+public:
+  class Guard {
+  public:
+    explicit Guard(std::atomic<uint32_t> &readers) : readers_(readers) {}
+    ~Guard() { readers_.fetch_sub(1, std::memory_order_release); }
+
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+
+  private:
+    std::atomic<uint32_t> &readers_;
+  };
+
+  Guard enter() {
+    auto &readers = stripes_[stripeIndex()].readers;
+    readers.fetch_add(1, std::memory_order_seq_cst);
+    return Guard(readers);
+  }
+
+  // Wait for the readers that entered before the call to leave
+  void synchronize() const {
+    for (const auto &stripe : stripes_) {
+      while (stripe.readers.load(std::memory_order_seq_cst) != 0) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  static constexpr size_t STRIPES = 8;
+
+private:
+  struct alignas(64) Stripe {
+    std::atomic<uint32_t> readers{0};
+  };
+
+  static size_t stripeIndex() {
+    static std::atomic<size_t> nextThread{0};
+    thread_local const size_t index =
+        nextThread.fetch_add(1, std::memory_order_relaxed) % STRIPES;
+    return index;
+  }
+
+  std::array<Stripe, STRIPES> stripes_;
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_READER_GATE_H
@@ -0,0 +1,176 @@
+#ifndef AUDIO_STREAM_SLAB_STORE_H
+#define AUDIO_STREAM_SLAB_STORE_H
+
+#include "common_types.h"
+#include "memory/storage_backend.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#define AUDIO_STREAM_HAVE_SLAB_STORE 1
+#endif
+
+namespace audio_stream {
+
+// Where a stream's bytes lie in the slab files
+struct SlabLocation {
+  uint32_t slab = 0;
+  uint64_t offset = 0;
+};
+
+struct SlabStats {
+  size_t files = 0;
+  size_t streams = 0;     // Streams stored in them
+  uint64_t bytes = 0;     // Of the files on disk
+  uint64_t liveBytes = 0; // Still referenced by those streams
+};
+
+/**
+ * One slab file, shared by the streams stored in it. Mapped read-only once
+ * when it is opened, over SLAB_BYTES for the slab taking appends, so bytes
+ * appended later are readable through the same mapping. The descriptor
+ * and mapping are released with the last reference.
+ */
+struct SlabFile {
+  uint32_t id = 0;
+  std::string path;
+  int fd = -1;
+  const uint8_t *base = nullptr;
+  size_t mappedLength = 0;
+
+  // Under SlabStore's mutex
+  uint64_t end = 0;       // Bytes allocated, the length of the file
+  size_t streams = 0;     // Stored or being stored
+  uint64_t liveBytes = 0; // Their bytes
+  bool sealed = false;    // Takes no more appends
+
+  SlabFile() = default;
+  ~SlabFile();
+  SlabFile(const SlabFile &) = delete;
+  SlabFile &operator=(const SlabFile &) = delete;
+};
+
+/**
+ * Read-only backend of a READY stream stored in a slab file: a window of
+ * the slab's mapping. Views alias the mapping and keep the slab alive, so
+ * reads copy nothing and take no lock; the file is sealed whenever it is
+ * open. Durability was settled when the bytes were appended.
+ */
+class SlabObjectStorage : public StorageBackend {
+public:
+  SlabObjectStorage(std::shared_ptr<SlabFile> slab, uint64_t offset,
+                    uint64_t size);
+
+  // Read-only: create, writes and finalize fail
+  bool create(uint64_t initialSize = 0) override;
+  bool open() override;
+  void close() override;
+
+  size_t write(uint64_t offset, const uint8_t *data, size_t size) override;
+  std::vector<uint8_t> read(uint64_t offset, size_t length) override;
+  BufferView readView(uint64_t offset, size_t length) override;
+  bool seal() override { return isOpen(); }
+  BufferView tryReadView(uint64_t offset, size_t length) override;
+  std::vector<size_t>
+  writeBatch(const std::vector<WriteOperation> &operations) override;
+
+  bool finalize(uint64_t finalSize, bool flushData = true) override;
+  bool flushAsync() override { return true; }
+  bool flush() override { return true; }
+  bool sync() override { return true; }
+  bool prefetch(uint64_t offset, size_t length) override;
+  // The mapping is the slab's, shared with other streams
+  bool adviseSequential(bool) override { return isOpen(); }
+  uint64_t releaseMappings() override { return 0; }
+
+  uint64_t getSize() const override { return size_; }
+  uint64_t getCapacity() const override { return size_; }
+  uint64_t getMappedBytes() const override { return 0; }
+  uint64_t getUnflushedBytes() const override { return 0; }
+  std::string getFilePath() const override { return slab_->path; }
+  bool isOpen() const override {
+    return open_.load(std::memory_order_acquire);
+  }
+
+private:
+  void logError(const std::string &operation, const std::string &error) const;
+
+  std::shared_ptr<SlabFile> slab_;
+  uint64_t offset_;
+  uint64_t size_;
+  std::atomic<bool> open_{true};
+};
+
+/**
+ * Shared append-only slab files for small READY streams, so that they do
+ * not each cost a cache file, a descriptor and a mapping. A stream is
+ * appended whole to the slab taking appends, which is sealed and replaced
+ * by a new one once the next stream does not fit in SLAB_BYTES. Writers
+ * reserve their range under a lock and copy outside it.
+ *
+ * Slabs are never rewritten: one is removed once it is sealed and every
+ * stream in it has been released. Slabs of a previous run are reopened
+ * sealed, for the streams the manifest restores. POSIX only
+ * (AUDIO_STREAM_HAVE_SLAB_STORE).
+ */
+class SlabStore {
+public:
+  // Slab files are directory/slab-<id>.slab
+  explicit SlabStore(const std::string &directory);
+  ~SlabStore();
+
+  SlabStore(const SlabStore &) = delete;
+  SlabStore &operator=(const SlabStore &) = delete;
+
+  /**
+   * Append a stream's bytes and make them as durable as the tier asks:
+   * NONE leaves them in the page cache, PERIODIC starts write-back,
+   * ON_FINALIZE waits for it and STRICT_SYNC also for fdatasync.
+   * @param location Set to where the bytes were stored
+   * @return The stream's backend; nullptr if the bytes were not stored
+   */
+  std::unique_ptr<SlabObjectStorage> append(const uint8_t *data, size_t size,
+                                            Durability durability,
+                                            SlabLocation &location);
+
+  /**
+   * Backend of a stream a previous run stored, opening its slab sealed.
+   * @return nullptr if the slab is missing or shorter than the stream
+   */
+  std::unique_ptr<SlabObjectStorage> restore(const SlabLocation &location,
+                                             uint64_t size);
+
+  // The stream stored at location was deleted; removes a sealed slab that
+  // has no streams left
+  void release(const SlabLocation &location, uint64_t size);
+
+  // Remove slab files no stream was restored from (after restore)
+  size_t removeUnused();
+
+  SlabStats getStats() const;
+  std::string getSlabPath(uint32_t slab) const;
+
+  static constexpr uint64_t SLAB_BYTES = 64ULL * 1024 * 1024;
+  static constexpr const char *EXTENSION = ".slab";
+
+private:
+  std::shared_ptr<SlabFile> createSlab(uint32_t id);
+  std::shared_ptr<SlabFile> openSlab(uint32_t id);
+  // Caller holds mutex_
+  void removeIfUnused(const std::shared_ptr<SlabFile> &slab);
+
+  std::string directory_;
+  mutable std::mutex mutex_;
+  std::unordered_map<uint32_t, std::shared_ptr<SlabFile>> slabs_;
+  std::shared_ptr<SlabFile> active_; // Taking appends; nullptr until needed
+  uint32_t nextId_ = 1;
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_SLAB_STORE_H
@@ -0,0 +1,74 @@
+#ifndef AUDIO_STREAM_SPSC_QUEUE_H
+#define AUDIO_STREAM_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace audio_stream {
+
+/**
+ * Bounded single-producer, single-consumer ring. push() and pop() never
+ * block or allocate; each side only writes its own index, and the two are
+ * kept on separate cache lines.
+ */
+template <typename T> class SpscQueue {
+public:
+  // Capacity is rounded up to a power of two
+  explicit SpscQueue(size_t capacity) : slots_(roundUp(capacity)) {
+    mask_ = slots_.size() - 1;
+  }
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  // Producer side; false if the ring is full
+  bool push(T &&value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+      return false;
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side; false if the ring is empty
+  bool pop(T &value) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+  // Items pushed so far; read by the producer or after synchronizing with it
+  size_t pushed() const { return tail_.load(std::memory_order_acquire); }
+  size_t capacity() const { return slots_.size(); }
+
+private:
+  static size_t roundUp(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  std::vector<T> slots_;
+  size_t mask_;
+  alignas(64) std::atomic<size_t> head_{0}; // Next slot to pop
+  alignas(64) std::atomic<size_t> tail_{0}; // Next slot to fill
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_SPSC_QUEUE_H
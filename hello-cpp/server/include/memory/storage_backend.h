@@ -0,0 +1,147 @@
+#ifndef AUDIO_STREAM_STORAGE_BACKEND_H
+#define AUDIO_STREAM_STORAGE_BACKEND_H
+
+#include "compression.h"
+#include "memory/buffer_view.h"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace audio_stream {
+
+/**
+ * Storage for one stream's cache file, as used by StreamManager through
+ * StreamContext::mmapFile. MemoryMappedCache, the default, serves it
+ * through mmap; IoUringStorage (Linux) through explicit reads and writes,
+ * optionally with O_DIRECT, so I/O cost does not depend on page faults.
+ *
+ * Implementations are thread-safe. Writes at disjoint offsets may run
+ * concurrently; writing to a file that is not open creates it, and reading
+ * one opens it.
+ */
+class StorageBackend {
+public:
+  /**
+   * Write operation for batch processing. Points at the caller's bytes,
+   * which must stay valid until writeBatch returns.
+   */
+  struct WriteOperation {
+    uint64_t offset;
+    const uint8_t *data;
+    size_t size;
+  };
+
+  /**
+   * Read operation for batch processing.
+   */
+  struct ReadOperation {
+    uint64_t offset;
+    size_t length;
+  };
+
+  virtual ~StorageBackend() = default;
+
+  // File operations
+  virtual bool create(uint64_t initialSize = 0) = 0;
+  virtual bool open() = 0;
+  virtual void close() = 0;
+
+  // Data operations
+  virtual size_t write(uint64_t offset, const uint8_t *data, size_t size) = 0;
+  virtual std::vector<uint8_t> read(uint64_t offset, size_t length) = 0;
+  // The view stays valid after the file is closed or remapped
+  virtual BufferView readView(uint64_t offset, size_t length) = 0;
+
+  /**
+   * Lock-free reads of a file that is not written again (a READY stream).
+   * seal() publishes what is needed to read it; tryReadView then serves
+   * reads without taking any lock until something changes the file or
+   * releases its memory, which unseals it. It returns an empty view when
+   * the file is not sealed, or the range cannot be served that way, and
+   * the caller falls back to readView (and may seal again).
+   * @return false if the backend has no lock-free path
+   */
+  virtual bool seal() = 0;
+  virtual BufferView tryReadView(uint64_t offset, size_t length) = 0;
+
+  /**
+   * Write a batch with one pass through the backend.
+   * @return Bytes written by each operation
+   */
+  virtual std::vector<size_t>
+  writeBatch(const std::vector<WriteOperation> &operations) = 0;
+
+  /**
+   * Trim the file to its final size.
+   * @param flushData Also wait for written data to reach the disk
+   */
+  virtual bool finalize(uint64_t finalSize, bool flushData = true) = 0;
+
+  /**
+   * Durability: flushAsync() starts write-back without waiting, flush()
+   * waits for it, sync() also commits the data to stable storage.
+   */
+  virtual bool flushAsync() = 0;
+  virtual bool flush() = 0;
+  virtual bool sync() = 0;
+
+  /**
+   * Start reading [offset, offset + length) into memory without waiting
+   * for it, so later reads of the range do not block on the disk.
+   */
+  virtual bool prefetch(uint64_t offset, size_t length) = 0;
+
+  /**
+   * Access-pattern hint for the whole file: sequential reads get deeper
+   * kernel readahead, and pages behind them may be reclaimed sooner.
+   */
+  virtual bool adviseSequential(bool sequential) = 0;
+
+  /**
+   * Give back the memory the backend pins for this file (mappings).
+   * @return Bytes released
+   */
+  virtual uint64_t releaseMappings() = 0;
+
+  // Utility
+  virtual uint64_t getSize() const = 0;     // Logical size (bytes written)
+  virtual uint64_t getCapacity() const = 0; // Length of the file on disk
+  virtual uint64_t getMappedBytes() const = 0; // Memory pinned, see above
+  virtual uint64_t getUnflushedBytes() const = 0; // Since the last flush
+  virtual std::string getFilePath() const = 0;
+  virtual bool isOpen() const = 0;
+};
+
+enum class StorageBackendType { MMAP, IO_URING };
+
+/**
+ * Which backend new cache files use. directIo applies to IO_URING only:
+ * reads and writes bypass the page cache, going through block-aligned
+ * buffers registered with the ring. compression, when not NONE, is the
+ * codec READY streams are recompressed with in the background
+ * (CompressedStorage); uploads are always written uncompressed.
+ */
+struct StorageOptions {
+  StorageBackendType type = StorageBackendType::MMAP;
+  bool directIo = false;
+  CompressionCodec compression = CompressionCodec::NONE;
+};
+
+// Name as accepted by parseStorageOptions: mmap, io_uring, io_uring_direct,
+// optionally followed by "+" and a codec (e.g. mmap+lz4)
+std::string storageOptionsToString(const StorageOptions &options);
+std::optional<StorageOptions> parseStorageOptions(const std::string &name);
+
+/**
+ * Create the backend for a cache file. Falls back to MMAP when io_uring is
+ * unavailable (not Linux, or refused by the kernel).
+ */
+std::unique_ptr<StorageBackend>
+createStorageBackend(const StorageOptions &options,
+                     const std::string &filePath);
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_STORAGE_BACKEND_H
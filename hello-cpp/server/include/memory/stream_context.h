@@ -2,31 +2,93 @@
 #define AUDIO_STREAM_STREAM_CONTEXT_H
 
 #include "common_types.h"
+#include "compression.h"
+#include "memory/extent_tracker.h"
 #include "memory/memory_mapped_cache.h"
+#include "memory/readahead_tracker.h"
+#include "memory/slab_store.h"
+#include "memory/storage_backend.h"
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <string>
+#include <vector>
 
 namespace audio_stream {
 
 /**
  * Stream context for managing active audio streams
  * Contains stream metadata and cache file handle
+ *
+ * Uploads may write at any offset. extents records what has been written;
+ * currentOffset is the end of the filled prefix, the point up to which
+ * the stream can be read while it uploads, and totalSize is one past the
+ * last byte written.
  */
 struct StreamContext {
   std::string streamId;
+  /// Unique per context, unlike streamId: keys its chunks in ChunkCache
+  const uint64_t instanceId = nextInstanceId();
   std::string cachePath;
-  std::unique_ptr<MemoryMappedCache> mmapFile;
+  std::unique_ptr<StorageBackend> mmapFile; // mmap unless configured
+  /// mmapFile once the stream is READY and the file sealed: read through
+  /// tryReadView without contextMutex. Deleting the stream, or replacing
+  /// its file with a compressed one, clears it and closes the file, which
+  /// waits for those readers, and then keeps the object in retiredFiles,
+  /// since a reader may still have loaded the pointer; tryReadView on a
+  /// closed file returns nothing.
+  std::atomic<StorageBackend *> readyFile{nullptr};
+  std::vector<std::unique_ptr<StorageBackend>> retiredFiles;
+  /// Codec of mmapFile (a CompressedStorage unless NONE) and its length
+  CompressionCodec compression = CompressionCodec::NONE;
+  uint64_t storedBytes = 0;
+  bool compressionChecked = false; // Considered for compression already
+  bool dedupChecked = false;       // Looked up in the content index
+  bool blocksIndexed = false;      // Blocks added to the block index
+  /// The last finalizeStream could not make the file durable, and the
+  /// upload's bytes were forgotten so that they are written again
+  bool storageFailed = false;
+  /// cachePath is a hard link shared with other streams of the same
+  /// content (StreamManager::deduplicateReadyStreams)
+  bool sharedFile = false;
+  /// Stored in a slab file (StreamManager::putStream): mmapFile is then a
+  /// SlabObjectStorage and cachePath the slab's, which is never removed or
+  /// replaced for the stream alone
+  std::optional<SlabLocation> slabLocation;
+  /// Detected from the first bytes: whether chunks are worth compressing
+  /// on the wire, and the PCM16 filter they take. Read without a lock.
+  std::atomic<CompressionProfile> compressionProfile{CompressionProfile{}};
   size_t currentOffset = 0;
   size_t totalSize = 0;
+  size_t chunkSize = CHUNK_SIZE; // Negotiated in START/STARTED
+  Durability durability = Durability::ON_FINALIZE; // Never DEFAULT
+  uint32_t checksum = 0;         // CRC32C of [0, currentOffset)
+  /// Random, set when the upload is created and never changed: HAVE
+  /// proofs of this upload are keyed with it (STARTED/RESUMED carry it)
+  std::array<uint8_t, HAVE_NONCE_BYTES> uploadNonce{};
+  ExtentTracker extents;         // Byte ranges written so far
+  ReadaheadTracker readahead;    // Sequential readers; readaheadMutex
   std::chrono::system_clock::time_point createdAt;
-  std::chrono::system_clock::time_point lastAccessedAt;
+  /// Atomic so lookups can record accesses without holding any lock
+  std::atomic<std::chrono::system_clock::time_point> lastAccessedAt;
   StreamStatus status = StreamStatus::UPLOADING;
 
   /// Mutex for thread-safe access to stream context fields
   mutable std::mutex contextMutex;
 
+  /// Held shared by chunk writes while they copy into the mapping, which
+  /// they do without contextMutex; finalizing or removing the cache file
+  /// takes it exclusively. Taken before contextMutex.
+  mutable std::shared_mutex writeMutex;
+
+  /// Guards readahead. Only ever try-locked: readahead is a hint, so a
+  /// reader that finds it busy skips it instead of waiting.
+  std::mutex readaheadMutex;
+
   StreamContext()
       : createdAt(std::chrono::system_clock::now()),
         lastAccessedAt(std::chrono::system_clock::now()) {}
@@ -34,6 +96,17 @@ struct StreamContext {
   StreamContext(const std::string &id)
       : streamId(id), createdAt(std::chrono::system_clock::now()),
         lastAccessedAt(std::chrono::system_clock::now()) {}
+
+  static uint64_t nextInstanceId() {
+    static std::atomic<uint64_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// Record an access; relaxed ordering is enough for an age hint
+  void touch() {
+    lastAccessedAt.store(std::chrono::system_clock::now(),
+                         std::memory_order_relaxed);
+  }
 };
 
 } // namespace audio_stream
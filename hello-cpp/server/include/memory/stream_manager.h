@@ -1,18 +1,88 @@
 #ifndef AUDIO_STREAM_STREAM_MANAGER_H
 #define AUDIO_STREAM_STREAM_MANAGER_H
 
+#include "memory/chunk_cache.h"
+#include "sha256.h"
 #include "stream_context.h"
-#include <map>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace audio_stream {
 
+/**
+ * Limits the maintenance pass holds the cache to. Mapped bytes bound the
+ * resident page cache the server pins through its mappings; disk bytes
+ * bound the cache directory. Only READY streams are evicted, so uploads in
+ * progress count toward the totals but are never cut short. Chunk cache
+ * bytes bound the copies of hot chunks kept in memory (ChunkCache), which
+ * evicts on its own as chunks are added.
+ */
+struct CacheBudget {
+  uint64_t maxDiskBytes = 64ULL * 1024 * 1024 * 1024;
+  uint64_t maxMappedBytes = 2ULL * 1024 * 1024 * 1024;
+  uint64_t maxChunkCacheBytes = ChunkCache::DEFAULT_MAX_BYTES;
+  std::chrono::seconds streamTtl = std::chrono::hours(24);
+};
+
+/**
+ * How far uploads are pushed towards the disk, for streams whose START asks
+ * for no tier of its own. Writes only dirty the page cache; PERIODIC
+ * streams are written back in the background every flushInterval and
+ * whenever flushBytes have been written since the last write-back.
+ */
+struct DurabilityPolicy {
+  Durability durability = Durability::ON_FINALIZE;
+  std::chrono::milliseconds flushInterval{1000};
+  uint64_t flushBytes = 64ULL * 1024 * 1024;
+};
+
+struct CacheStats {
+  size_t streams = 0;
+  size_t readyStreams = 0;
+  uint64_t diskBytes = 0;
+  uint64_t mappedBytes = 0;
+  uint64_t maxDiskBytes = 0;
+  uint64_t maxMappedBytes = 0;
+  uint64_t evictedStreams = 0;   // Deleted to stay under maxDiskBytes
+  uint64_t expiredStreams = 0;   // Deleted after streamTtl without access
+  uint64_t releasedMappings = 0; // Streams unmapped to meet maxMappedBytes
+  uint64_t releasedBytes = 0;
+  uint64_t readaheadHits = 0;   // Sequential reads already read ahead
+  uint64_t readaheadMisses = 0; // Sequential reads that outran readahead
+  uint64_t readaheadBytes = 0;  // Prefetch requested by sequential readers
+  uint64_t chunkCacheBytes = 0;
+  uint64_t chunkCacheHits = 0;
+  uint64_t chunkCacheMisses = 0; // READY reads that went to storage
+  size_t compressedStreams = 0;   // READY streams in a CompressedStorage
+  uint64_t compressionSavedBytes = 0; // Disk their compression saves
+  uint64_t deduplicatedStreams = 0;   // Linked to another stream's file
+  uint64_t deduplicationSavedBytes = 0; // Disk shared files save now
+  size_t slabFiles = 0;
+  size_t slabStreams = 0;    // Small streams stored in slab files
+  uint64_t slabBytes = 0;    // Of the slab files on disk
+  uint64_t slabLiveBytes = 0; // Of those still referenced by streams
+  size_t indexedBlocks = 0;    // Distinct blocks a HAVE can be answered from
+  uint64_t haveBlocks = 0;     // Blocks stored from a HAVE, not sent
+  uint64_t haveBytes = 0;
+};
+
 /**
  * Stream manager for managing active audio streams
- * Thread-safe registry of stream contexts
+ * Thread-safe registry of stream contexts, split into lock-striped shards
+ * keyed by a hash of the stream ID so concurrent lookups on different
+ * streams do not contend on a single mutex.
  */
 class StreamManager {
 public:
@@ -25,22 +95,312 @@ public:
   bool deleteStream(const std::string &streamId);
   std::vector<std::string> listActiveStreams();
 
-  // Stream operations
+  /**
+   * Called with the ID of every stream that leaves the registry other than
+   * by a restart: deleted, expired or evicted to meet the disk budget. It
+   * runs on the thread that removed the stream (often the maintenance
+   * thread). Setting nullptr waits for a call in progress, so its owner
+   * can clear it before it is destroyed.
+   */
+  using RemovedCallback = std::function<void(const std::string &streamId)>;
+  void setOnStreamRemoved(RemovedCallback onRemoved);
+
+  // Stream operations; writeChunk appends at the stream's write head
   bool writeChunk(const std::string &streamId,
                   const std::vector<uint8_t> &data);
+  bool writeChunk(const std::string &streamId, const uint8_t *data,
+                  size_t size);
+
+  /**
+   * Write a chunk at an explicit offset. Chunks may arrive in any order and
+   * from several writers at once: the copy into the mapping runs outside
+   * contextMutex, which is only taken to record the extent.
+   * @param offset Byte offset in the stream, or APPEND_OFFSET for the write
+   * head
+   */
+  bool writeChunkAt(const std::string &streamId, uint64_t offset,
+                    const uint8_t *data, size_t size);
+
+  /**
+   * Write several chunks at their offsets with one pass through the cache:
+   * one lock and growth check for the batch. Offsets must be explicit.
+   * @return true if every chunk was written
+   */
+  bool
+  writeBatch(const std::string &streamId,
+             const std::vector<StorageBackend::WriteOperation> &operations);
+
+  /**
+   * Reads of an upload in progress end at its filled prefix (currentOffset).
+   * Sequential readers are detected per stream (ReadaheadTracker): their
+   * stream is advised sequential and the next window is prefetched after
+   * each read, so later reads do not fault on the disk.
+   *
+   * READY streams never change, so their reads take no lock of the stream
+   * or of its file: a chunk another read cached is served from the chunk
+   * cache, anything else from the sealed file (StorageBackend::seal).
+   * They only track readahead; the kernel reads ahead of mapped pages of a
+   * stream advised sequential. Reads that cannot be served that way take
+   * the locked path, which seals the file for the next ones.
+   */
   std::vector<uint8_t> readChunk(const std::string &streamId, size_t offset,
                                  size_t length);
-  bool finalizeStream(const std::string &streamId);
+  BufferView readChunkView(const std::string &streamId, size_t offset,
+                           size_t length);
+
+  /**
+   * Mark an upload READY. Fails, leaving it UPLOADING, while any byte below
+   * max(totalSize, expectedSize) has not been written. Returns once the
+   * data is as durable as the stream's tier asks: ON_FINALIZE waits for
+   * write-back, STRICT_SYNC also for fdatasync; NONE and PERIODIC do not wait.
+   * If write-back or fdatasync fails, the stream stays UPLOADING with
+   * nothing written and storageFailed set: the kernel may have dropped the
+   * pages it could not write, and a second sync reports success without
+   * writing them, so the bytes must be sent again before a retry.
+   */
+  bool finalizeStream(const std::string &streamId, size_t expectedSize = 0);
+
+  /**
+   * Store a whole stream at once: READY when it returns, and as durable as
+   * the tier asks. Streams of up to getSmallStreamLimit() bytes are
+   * appended to a shared slab file (SlabStore) rather than given a cache
+   * file of their own; larger ones are written to one as an upload would.
+   * Fails if the stream exists.
+   */
+  bool putStream(const std::string &streamId, const uint8_t *data,
+                 size_t size, Durability durability = Durability::DEFAULT);
+
+  // Largest stream putStream stores in a slab file; 0 stores none there
+  void setSmallStreamLimit(size_t bytes);
+  size_t getSmallStreamLimit() const;
 
   // Utility
   void cleanupOldStreams();
 
+  /**
+   * Re-register the READY streams a previous run left in the cache
+   * directory. Every finalize and delete appends a line to the directory's
+   * manifest journal; startup parses it in parallel, keeps the last record
+   * of each stream and rewrites it compacted. Nothing is opened or mapped
+   * until a stream is first read. Cache files the journal does not list as
+   * READY (uploads cut off by the restart) are removed.
+   * @return Number of streams restored
+   */
+  size_t restoreStreams();
+
+  // Cache budget
+  void setCacheBudget(const CacheBudget &budget);
+  CacheBudget getCacheBudget() const;
+  CacheStats getCacheStats() const;
+
+  // Backend of cache files created (or restored) from now on
+  void setStorageOptions(const StorageOptions &options);
+  StorageOptions getStorageOptions() const;
+
+  // Durability of new streams, and the PERIODIC write-back schedule
+  void setDurabilityPolicy(const DurabilityPolicy &policy);
+  DurabilityPolicy getDurabilityPolicy() const;
+
+  /**
+   * Bring the cache under budget, coldest READY streams first (LRU by
+   * lastAccessedAt): release their mappings until mapped bytes fit, then
+   * delete them until disk bytes fit.
+   */
+  void enforceCacheBudget();
+
+  /**
+   * Whether the last enforceCacheBudget left the cache over its disk
+   * budget: what is left is uploads in progress, which are never evicted,
+   * so new uploads should wait until some finish or are deleted.
+   */
+  bool isCacheFull() const {
+    return cacheFull_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Detect the CompressionProfile of READY streams not seen yet (restored
+   * ones have none), and with a StorageOptions::compression codec rewrite
+   * their cache files as a CompressedStorage, id.cachez, that replaces the
+   * original once written. Streams that do not compress by an eighth, and
+   * compressed audio formats, keep their file. The manifest records the
+   * codec, so restarts reopen the compressed file. A delete of a stream
+   * waits while its file is being compressed.
+   */
+  void compressReadyStreams();
+
+  /**
+   * Store READY streams of identical content once. Streams are indexed by
+   * size and CRC32C; a READY stream whose key is already taken is compared
+   * byte for byte with that stream and, if equal, its file is replaced by
+   * a hard link to the other's (compressed or not), so re-uploads of the
+   * same asset share one file. Deleting either stream only drops its link.
+   * Shared files are counted once in the disk budget, and are not
+   * compressed afterwards, which would unshare them.
+   */
+  void deduplicateReadyStreams();
+
+  /**
+   * Index the blocks of READY streams by SHA-256, for writeStoredBlock:
+   * HAVE_BLOCK_SIZE bytes at each multiple of it, the last block short.
+   * Streams smaller than a block are not indexed. Each pass hashes at most
+   * BLOCK_INDEX_BYTES_PER_PASS (finishing the stream it is in), so a large
+   * restored cache is indexed over several passes rather than holding up
+   * the rest of maintenance.
+   */
+  void indexReadyBlocks();
+
+  /**
+   * Write a block of an upload from a READY stream holding the same bytes,
+   * in place of the client sending it (HAVE). The block is found by its
+   * digest, and only written if proof is SHA-256 of the upload's nonce
+   * followed by those bytes: the client holds the block, not just its
+   * digest.
+   * @return Bytes written at offset: length, or 0 if no indexed block has
+   * the digest and length, the proof does not match or the write failed
+   */
+  size_t writeStoredBlock(const std::string &streamId, uint64_t offset,
+                          size_t length, const sha256::Digest &digest,
+                          const sha256::Digest &proof);
+
+  /**
+   * Run cleanupOldStreams, deduplicateReadyStreams, indexReadyBlocks,
+   * compressReadyStreams and enforceCacheBudget every interval on a
+   * background thread until stopMaintenance (or destruction). A second
+   * thread writes back PERIODIC uploads every flushInterval.
+   */
+  void startMaintenance(std::chrono::milliseconds interval =
+                            DEFAULT_MAINTENANCE_INTERVAL);
+  void stopMaintenance();
+
+  static constexpr size_t SHARD_COUNT = 64;
+  static constexpr uint64_t APPEND_OFFSET = UINT64_MAX;
+  static constexpr const char *MANIFEST_FILE = "streams.manifest";
+  static constexpr size_t DEFAULT_SMALL_STREAM_LIMIT = 256 * 1024;
+  static constexpr uint64_t BLOCK_INDEX_BYTES_PER_PASS = 256ULL << 20;
+  static constexpr std::chrono::milliseconds DEFAULT_MAINTENANCE_INTERVAL{
+      10000};
+
 private:
+  /**
+   * One stripe of the registry. Lookups take the shared lock; only
+   * create/delete take it exclusively. Aligned to keep shard locks on
+   * separate cache lines.
+   */
+  struct alignas(64) Shard {
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<StreamContext>> streams;
+    // Ids putStream is storing, not yet in streams
+    std::unordered_set<std::string> putting;
+  };
+
+  Shard &shardFor(const std::string &streamId);
   std::string getCachePath(const std::string &streamId) const;
+  std::string getCompressedPath(const std::string &streamId) const;
+  // Disk used by the stream's file; caller holds stream.contextMutex
+  uint64_t cacheFileBytes(const StreamContext &stream) const;
+  std::string getManifestPath() const;
+  std::string manifestRecord(const StreamContext &stream) const;
+  bool appendManifest(const std::string &record);
+  void removeCacheFiles(StreamContext &stream);
+  // Caller holds stream.contextMutex
+  void recordWrite(StreamContext &stream, uint64_t offset, size_t size,
+                   uint32_t crc);
+  size_t readableLength(const StreamContext &stream, size_t offset,
+                        size_t length) const;
+  uint64_t readableBytes(const StreamContext &stream) const;
+  // Lock-free read of a READY stream; an empty view if it is not one
+  BufferView readReady(StreamContext &stream, uint64_t offset,
+                       size_t length);
+  // Caller holds stream.contextMutex and has just read a READY stream
+  void sealReady(StreamContext &stream);
+  // The range was just read from file; readableEnd bounds the window.
+  // Without prefetch, only tracks the cursor and the sequential advice.
+  void readAhead(StreamContext &stream, StorageBackend &file, uint64_t offset,
+                 size_t length, uint64_t readableEnd, bool prefetch = true);
+  uint32_t checksumCacheFile(StorageBackend &file, uint64_t size) const;
+  // Whether the first size bytes of both files are equal
+  bool sameContent(StorageBackend &a, StorageBackend &b, uint64_t size) const;
+  // Copy [offset, offset + length) of a READY stream into out; false if it
+  // is no longer READY or shorter
+  bool copyReadyRange(StreamContext &stream, uint64_t offset, size_t length,
+                      uint8_t *out) const;
+  // Replace stream's file with a link to canonical's if their content is
+  // equal; both READY with the same size and CRC32C
+  void linkDuplicate(StreamContext &stream, StreamContext &canonical);
+  std::vector<std::shared_ptr<StreamContext>> snapshotStreams() const;
+  void maintenanceLoop(std::chrono::milliseconds interval);
+  void flushLoop();
+  void flushPeriodicStreams();
+  // Caller holds stream.writeMutex (shared)
+  void flushIfDue(StreamContext &stream, Durability durability);
+  void notifyRemoved(const std::string &streamId);
 
   std::string cacheDir_;
-  std::map<std::string, std::shared_ptr<StreamContext>> streams_;
-  mutable std::mutex mutex_;
+  std::array<Shard, SHARD_COUNT> shards_;
+
+  std::mutex removedMutex_; // Held while onRemoved_ runs
+  RemovedCallback onRemoved_;
+
+  mutable std::mutex budgetMutex_;
+  CacheBudget budget_;
+  std::atomic<uint64_t> evictedStreams_{0};
+  std::atomic<bool> cacheFull_{false}; // See isCacheFull
+  std::atomic<uint64_t> expiredStreams_{0};
+  std::atomic<uint64_t> releasedMappings_{0};
+  std::atomic<uint64_t> releasedBytes_{0};
+  std::atomic<uint64_t> readaheadHits_{0};
+  std::atomic<uint64_t> readaheadMisses_{0};
+  std::atomic<uint64_t> readaheadBytes_{0};
+  ChunkCache chunkCache_;
+
+  // Content index of READY streams: (size, CRC32C) -> first stream seen
+  struct ContentKey {
+    uint64_t size;
+    uint32_t crc;
+    bool operator==(const ContentKey &other) const {
+      return size == other.size && crc == other.crc;
+    }
+  };
+  struct ContentKeyHash {
+    size_t operator()(const ContentKey &key) const {
+      return std::hash<uint64_t>{}(key.size * 0x9E3779B97F4A7C15ULL ^ key.crc);
+    }
+  };
+  std::mutex contentMutex_;
+  std::unordered_map<ContentKey, std::weak_ptr<StreamContext>, ContentKeyHash>
+      contentIndex_;
+  std::atomic<uint64_t> deduplicatedStreams_{0};
+
+  // Block index of READY streams: SHA-256 -> a block with that content
+  struct BlockLocation {
+    std::weak_ptr<StreamContext> stream;
+    uint64_t offset;
+    size_t length;
+  };
+  mutable std::mutex blockMutex_;
+  std::unordered_map<sha256::Digest, BlockLocation, sha256::DigestHash>
+      blockIndex_;
+  std::atomic<uint64_t> haveBlocks_{0};
+  std::atomic<uint64_t> haveBytes_{0};
+
+  mutable std::mutex storageMutex_;
+  StorageOptions storage_;
+
+  mutable std::mutex durabilityMutex_;
+  DurabilityPolicy durability_;
+  std::atomic<uint64_t> flushBytes_{DurabilityPolicy{}.flushBytes};
+
+  std::unique_ptr<SlabStore> slabs_; // nullptr without slab support
+  std::atomic<size_t> smallStreamLimit_{DEFAULT_SMALL_STREAM_LIMIT};
+
+  std::mutex manifestMutex_;
+  std::ofstream manifest_; // Append-only journal of READY/deleted streams
+
+  std::thread maintenanceThread_;
+  std::thread flushThread_;
+  std::mutex maintenanceMutex_;
+  std::condition_variable maintenanceCv_;
+  bool maintenanceStop_ = false;
 };
 
 } // namespace audio_stream
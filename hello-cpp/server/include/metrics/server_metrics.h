@@ -0,0 +1,182 @@
+#ifndef AUDIO_STREAM_SERVER_METRICS_H
+#define AUDIO_STREAM_SERVER_METRICS_H
+
+#include "latency_histogram.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace audio_stream {
+
+// Monotonic event and byte counts
+enum class Counter : size_t {
+  CONTROL_MESSAGES, // Control messages dispatched (JSON or binary)
+  DATA_FRAMES,      // Upload chunks received
+  ERRORS_SENT,      // ERROR replies
+  BYTES_WRITTEN,    // Upload bytes written to cache files
+  BYTES_READ,       // Bytes read for GET and STREAM replies
+  BYTES_SENT,       // Binary frame bytes handed to the socket
+  SEGMENTS_MAPPED,  // mmap segments created
+  CONNECTIONS_OPENED,
+  CONNECTIONS_CLOSED,
+  UPLOADS_REFUSED, // START and PUT refused for load, with a retry-after
+  COUNT
+};
+
+// Recorded distributions; the *_NS ones, which come first, are latencies
+// in nanoseconds
+enum class Histogram : size_t {
+  HANDLER_DISPATCH_NS, // One control message or upload chunk
+  WRITE_CHUNK_NS,      // StreamManager write of one chunk or batch
+  READ_CHUNK_NS,       // StreamManager read for one reply
+  REMAP_NS,            // Growing a mapped cache file
+  SEND_NS,             // Building and queueing one binary frame
+  WRITE_QUEUE_DEPTH,   // Chunks queued for the stream at submit
+  SEND_BUFFER_BYTES,   // Connection's unsent bytes after a send
+  COUNT
+};
+
+constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+constexpr size_t HISTOGRAM_COUNT = static_cast<size_t>(Histogram::COUNT);
+
+// A value collected from elsewhere when a snapshot is published
+struct MetricValue {
+  std::string name; // Without the audio_stream_ prefix
+  std::string help;
+  double value = 0;
+  bool monotonic = false; // Prometheus counter rather than gauge
+};
+
+struct MetricsSnapshot {
+  std::array<uint64_t, COUNTER_COUNT> counters{};
+  std::array<LatencyHistogram, HISTOGRAM_COUNT> histograms;
+
+  uint64_t counter(Counter c) const {
+    return counters[static_cast<size_t>(c)];
+  }
+  const LatencyHistogram &histogram(Histogram h) const {
+    return histograms[static_cast<size_t>(h)];
+  }
+};
+
+/**
+ * Server-wide counters and histograms, implemented as a singleton like
+ * MemoryPoolManager. Each thread records into its own shard, which only
+ * that thread writes, so recording is a few relaxed loads and stores with
+ * no lock, read-modify-write or shared cache line. snapshot() sums the
+ * shards. A shard outlives its thread and is handed to the next thread
+ * that starts, so totals never go backwards.
+ */
+class ServerMetrics {
+public:
+  static ServerMetrics &getInstance();
+
+  ServerMetrics(const ServerMetrics &) = delete;
+  ServerMetrics &operator=(const ServerMetrics &) = delete;
+
+  void add(Counter counter, uint64_t amount = 1) {
+    bump(localShard().counters[static_cast<size_t>(counter)], amount);
+  }
+
+  void record(Histogram histogram, uint64_t value) {
+    Cells &cells =
+        localShard().histograms[static_cast<size_t>(histogram)];
+    bump(cells.buckets[LatencyHistogram::bucketFor(value)], 1);
+    bump(cells.sum, value);
+    if (value > cells.max.load(std::memory_order_relaxed)) {
+      cells.max.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  MetricsSnapshot snapshot() const;
+
+  /**
+   * Publish a snapshot with the collected values.
+   * toJson: counters and values by name, histograms as count, sum, max
+   * and p50/p90/p99/p999.
+   * toPrometheus: text exposition format, every name prefixed with
+   * audio_stream_; histograms with cumulative buckets at the non-empty
+   * bucket bounds.
+   */
+  static nlohmann::json toJson(const MetricsSnapshot &snapshot,
+                               const std::vector<MetricValue> &values);
+  static std::string toPrometheus(const MetricsSnapshot &snapshot,
+                                  const std::vector<MetricValue> &values);
+
+  static const char *counterName(Counter counter);
+  static const char *histogramName(Histogram histogram);
+
+private:
+  struct Cells {
+    std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKETS> buckets{};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+  };
+
+  struct alignas(64) Shard {
+    std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+    std::array<Cells, HISTOGRAM_COUNT> histograms;
+    bool leased = false; // Under shardsMutex_
+  };
+
+  // Holds the thread's shard and returns it when the thread exits
+  struct ShardLease {
+    ShardLease() : shard(getInstance().acquireShard()) {}
+    ~ShardLease() { getInstance().releaseShard(shard); }
+    Shard *shard;
+  };
+
+  ServerMetrics() = default;
+
+  // Only the owning thread writes a shard's cells
+  static void bump(std::atomic<uint64_t> &cell, uint64_t amount) {
+    cell.store(cell.load(std::memory_order_relaxed) + amount,
+               std::memory_order_relaxed);
+  }
+
+  static Shard &localShard() {
+    thread_local ShardLease lease;
+    return *lease.shard;
+  }
+
+  Shard *acquireShard();
+  void releaseShard(Shard *shard);
+
+  mutable std::mutex shardsMutex_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+/**
+ * Records the time from construction to destruction into a latency
+ * histogram.
+ */
+class MetricTimer {
+public:
+  explicit MetricTimer(Histogram histogram)
+      : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+  ~MetricTimer() {
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    ServerMetrics::getInstance().record(
+        histogram_, static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            elapsed)
+                            .count()));
+  }
+
+  MetricTimer(const MetricTimer &) = delete;
+  MetricTimer &operator=(const MetricTimer &) = delete;
+
+private:
+  Histogram histogram_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_SERVER_METRICS_H
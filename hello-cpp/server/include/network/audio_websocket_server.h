@@ -11,14 +11,20 @@
 #endif
 
 #include "../include/common_types.h"
+#include "binary_protocol.h"
 #include "handler/websocket_message_handler.h"
+#include "memory/memory_pool_manager.h"
+#include "memory/storage_backend.h"
 #include "memory/stream_manager.h"
+#include <atomic>
+#include <cstring>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <spdlog/spdlog.h>
 #include <string>
 #include <thread>
+#include <vector>
 
 // Third-party library websocketpp has pointer arithmetic warning in md5.hpp
 // This is a known issue in the library and cannot be fixed without modifying
@@ -36,11 +42,29 @@ using ConnectionHdl = websocketpp::connection_hdl;
 
 /**
  * WebSocket server for audio stream cache system
- * Accepts connections and routes messages to appropriate handlers
+ * Accepts connections and routes messages to appropriate handlers.
+ * A pool of I/O threads runs the shared io_context; websocketpp wraps each
+ * connection's handlers in its own strand, so messages of one connection
+ * are processed strictly in order while different connections run in
+ * parallel.
+ *
+ * Connections that negotiate the BINARY_PROTOCOL subprotocol exchange
+ * fixed-layout binary control frames; all others keep using JSON text.
+ * Those that negotiate it with a codec (compressedBinaryProtocol) may send
+ * and receive COMPRESSED_DATA frames as well.
+ *
+ * Metrics (ServerMetrics plus the handler's collected values) are served
+ * as Prometheus text to plain HTTP GETs of METRICS_PATH on the same port,
+ * and as JSON in reply to a STATS message.
  */
 class WebSocketServer {
 public:
-  WebSocketServer(int port, const std::string &path);
+  /**
+   * @param port Port to listen on
+   * @param path WebSocket path
+   * @param ioThreads Number of I/O threads (0 = one per hardware core)
+   */
+  WebSocketServer(int port, const std::string &path, size_t ioThreads = 0);
   ~WebSocketServer();
 
   // Server lifecycle
@@ -48,22 +72,51 @@ public:
   void stop();
   bool isRunning() const;
 
+  // Limits enforced by the cache maintenance thread while running
+  void setCacheBudget(const CacheBudget &budget);
+  CacheStats getCacheStats() const;
+
+  // Durability tier of streams whose START names none
+  void setDurabilityPolicy(const DurabilityPolicy &policy);
+
+  // Backend of new uploads; streams restored at construction use mmap
+  void setStorageOptions(const StorageOptions &options);
+
+  // Largest PUT stream stored in a shared slab file; 0 stores none there
+  void setSmallStreamLimit(size_t bytes);
+
+  // Uploads taken on at once, and the flow control window of each
+  void setAdmissionLimits(const AdmissionLimits &limits);
+
 private:
   void initializeServer();
+  bool onValidate(ConnectionHdl hdl);
   void onOpen(ConnectionHdl hdl);
   void onClose(ConnectionHdl hdl);
   void onFail(ConnectionHdl hdl);
+  // Serves Prometheus text at METRICS_PATH, 404 elsewhere
+  void onHttp(ConnectionHdl hdl);
+  static constexpr const char *METRICS_PATH = "/metrics";
   template <typename MsgType>
   void onMessage(ConnectionHdl hdl, const MsgType &msg) {
     try {
       if (msg->get_opcode() == websocketpp::frame::opcode::text) {
-        std::string payload = msg->get_payload();
-        spdlog::debug("Text message received: {}", payload);
+        const std::string &payload = msg->get_payload();
+        SPDLOG_DEBUG("Text message received: {}", payload);
         handleTextMessage(hdl, payload);
       } else if (msg->get_opcode() == websocketpp::frame::opcode::binary) {
-        std::string payload = msg->get_payload();
-        std::vector<uint8_t> data(payload.begin(), payload.end());
-        handleBinaryMessage(hdl, data);
+        const std::string &payload = msg->get_payload();
+        if (usesBinaryProtocol(hdl)) {
+          handleBinaryProtocolFrame(
+              hdl, reinterpret_cast<const uint8_t *>(payload.data()),
+              payload.size());
+          return;
+        }
+
+        // Copy the frame into a pooled buffer rather than a fresh vector
+        auto data = MemoryPoolManager::getInstance().acquire(payload.size());
+        std::memcpy(data->data(), payload.data(), payload.size());
+        handleBinaryMessage(hdl, std::move(data));
       }
     } catch (const std::exception &e) {
       spdlog::error("Error handling message: {}", e.what());
@@ -73,23 +126,50 @@ private:
 
   // Message handlers - delegate to message handler
   void handleTextMessage(ConnectionHdl hdl, const std::string &message);
-  void handleBinaryMessage(ConnectionHdl hdl, const std::vector<uint8_t> &data);
+  void handleBinaryMessage(ConnectionHdl hdl, PooledBufferPtr data,
+                           uint32_t handle = 0,
+                           std::optional<uint64_t> offset = std::nullopt);
+  void handleBinaryProtocolFrame(ConnectionHdl hdl, const uint8_t *data,
+                                 size_t size);
 
   // Response helpers
+  WebSocketMessageHandler::SendMessageCallback
+  makeSendMessage(ConnectionHdl hdl, bool binaryProtocol,
+                  uint32_t handle = 0);
+  WebSocketMessageHandler::SendBinaryCallback
+  makeSendBinary(ConnectionHdl hdl, bool binaryProtocol, uint32_t handle = 0);
+  WebSocketMessageHandler::CanSendCallback makeCanSend(ConnectionHdl hdl);
   void sendTextMessage(ConnectionHdl hdl, const std::string &message);
-  void sendBinaryMessage(ConnectionHdl hdl, const std::vector<uint8_t> &data);
+  void sendControlFrame(ConnectionHdl hdl, const WebSocketMessage &message);
+  void sendBinaryMessage(ConnectionHdl hdl, const BufferView &data,
+                         const uint8_t *header = nullptr,
+                         size_t headerSize = 0);
   void sendErrorMessage(ConnectionHdl hdl, const std::string &error);
+  bool usesBinaryProtocol(ConnectionHdl hdl) const;
+  // Codec negotiated for COMPRESSED_DATA; NONE without one
+  CompressionCodec wireCodec(ConnectionHdl hdl) const;
 
   // Helper to get connection ID
   std::string getConnectionId(ConnectionHdl hdl) const;
 
+  // Periodically answer live-tail GETs that waited too long
+  void scheduleParkedReadSweep();
+  static constexpr long PARKED_READ_SWEEP_MS = 1000;
+
+  // Keep pushing STREAM ranges as send buffers drain
+  void scheduleRangeStreamPump();
+  static constexpr long RANGE_STREAM_PUMP_MS = 1;
+  static constexpr size_t RANGE_STREAM_HIGH_WATERMARK = 8 * 1024 * 1024;
+
   int port_;
   std::string path_;
-  bool running_;
+  size_t ioThreadCount_;
+  std::atomic<bool> running_;
   WebSocketServer_t server_;
   std::shared_ptr<StreamManager> streamManager_;
   std::unique_ptr<WebSocketMessageHandler> messageHandler_;
-  std::thread serverThread_;
+  std::vector<std::thread> ioThreads_;
+  std::atomic<bool> rangePumpScheduled_{false};
 
   // Connection to remote endpoint mapping (for logging)
   std::map<ConnectionHdl, std::string, std::owner_less<ConnectionHdl>>
@@ -1,5 +1,6 @@
 #include "audio_server_application.h"
 #include "../include/common_types.h"
+#include "logging.h"
 #include "network/audio_websocket_server.h"
 #include <chrono>
 #include <csignal>
@@ -20,12 +21,19 @@ void signalHandler(int signal) {
 }
 
 int main(int argc, char *argv[]) {
+  logging::AsyncLogging asyncLogging("audio_stream_server");
   spdlog::set_level(spdlog::level::info);
   spdlog::info("Audio Stream Cache Server - C++ Implementation");
 
   // Parse command-line arguments
   int port = DEFAULT_PORT;
   std::string path = DEFAULT_PATH;
+  size_t ioThreads = 0; // 0 = one per hardware core
+  CacheBudget budget;
+  DurabilityPolicy durability;
+  StorageOptions storage;
+  size_t smallStreamLimit = StreamManager::DEFAULT_SMALL_STREAM_LIMIT;
+  AdmissionLimits admission;
 
   if (argc >= 2) {
     port = std::stoi(argv[1]);
@@ -33,6 +41,45 @@ int main(int argc, char *argv[]) {
   if (argc >= 3) {
     path = argv[2];
   }
+  if (argc >= 4) {
+    ioThreads = static_cast<size_t>(std::stoul(argv[3]));
+  }
+  if (argc >= 5) {
+    budget.maxDiskBytes = std::stoull(argv[4]) * 1024 * 1024;
+  }
+  if (argc >= 6) {
+    budget.maxMappedBytes = std::stoull(argv[5]) * 1024 * 1024;
+  }
+  if (argc >= 7) {
+    auto tier = stringToDurability(argv[6]);
+    if (!tier) {
+      spdlog::error("Unknown durability '{}' (none, periodic, finalize or "
+                    "strict)",
+                    argv[6]);
+      return 1;
+    }
+    durability.durability = *tier;
+  }
+  if (argc >= 8) {
+    auto options = parseStorageOptions(argv[7]);
+    if (!options) {
+      spdlog::error("Unknown storage backend '{}' (mmap, io_uring or "
+                    "io_uring_direct, optionally +lz4, +zstd or +deflate "
+                    "if built with that codec)",
+                    argv[7]);
+      return 1;
+    }
+    storage = *options;
+  }
+  if (argc >= 9) {
+    smallStreamLimit = static_cast<size_t>(std::stoul(argv[8])) * 1024;
+  }
+  if (argc >= 10) {
+    admission.maxUploadingStreams = static_cast<size_t>(std::stoul(argv[9]));
+  }
+  if (argc >= 11) {
+    admission.maxQueuedBytes = std::stoull(argv[10]) * 1024 * 1024;
+  }
 
   spdlog::info("Starting server on port {} with path {}", port, path);
 
@@ -42,7 +89,12 @@ int main(int argc, char *argv[]) {
 
   try {
     // Create and start WebSocket server
-    WebSocketServer server(port, path);
+    WebSocketServer server(port, path, ioThreads);
+    server.setCacheBudget(budget);
+    server.setDurabilityPolicy(durability);
+    server.setStorageOptions(storage);
+    server.setSmallStreamLimit(smallStreamLimit);
+    server.setAdmissionLimits(admission);
     server.start();
 
     spdlog::info("Server started successfully. Press Ctrl+C to stop.");
@@ -53,6 +105,28 @@ int main(int argc, char *argv[]) {
     }
 
     // Stop server gracefully
+    CacheStats stats = server.getCacheStats();
+    spdlog::info("Cache: {} streams, {} MB on disk, {} MB mapped, {} evicted, "
+                 "{} expired",
+                 stats.streams, stats.diskBytes / (1024 * 1024),
+                 stats.mappedBytes / (1024 * 1024), stats.evictedStreams,
+                 stats.expiredStreams);
+    spdlog::info("Readahead: {} hits, {} misses, {} MB prefetched",
+                 stats.readaheadHits, stats.readaheadMisses,
+                 stats.readaheadBytes / (1024 * 1024));
+    spdlog::info("Chunk cache: {} MB, {} hits, {} misses",
+                 stats.chunkCacheBytes / (1024 * 1024), stats.chunkCacheHits,
+                 stats.chunkCacheMisses);
+    spdlog::info("Compression: {} streams, {} MB saved on disk",
+                 stats.compressedStreams,
+                 stats.compressionSavedBytes / (1024 * 1024));
+    spdlog::info("Deduplication: {} streams, {} MB saved on disk",
+                 stats.deduplicatedStreams,
+                 stats.deduplicationSavedBytes / (1024 * 1024));
+    spdlog::info("Slabs: {} files, {} streams, {} of {} MB live",
+                 stats.slabFiles, stats.slabStreams,
+                 stats.slabLiveBytes / (1024 * 1024),
+                 stats.slabBytes / (1024 * 1024));
     server.stop();
 
   } catch (const websocketpp::exception &e) {
@@ -1,6 +1,9 @@
 #include "handler/websocket_message_handler.h"
 #include "../include/common_types.h"
 #include "handler/websocket_message.h"
+#include "logging.h"
+#include <algorithm>
+#include <iterator>
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 
@@ -10,20 +13,68 @@ namespace audio_stream {
 
 WebSocketMessageHandler::WebSocketMessageHandler(
     std::shared_ptr<StreamManager> streamManager)
-    : streamManager_(streamManager) {}
+    : streamManager_(streamManager), chunkWriter_(streamManager) {
+  // Tailing readers are answered as soon as the chunks they wait for land,
+  // and flow-controlled uploads get credit for them
+  chunkWriter_.setOnWritten([this](const std::string &streamId) {
+    completeParkedReads(streamId);
+    updateCredit(streamId);
+  });
+
+  // A stream deleted, expired or evicted takes no more chunks; unless a
+  // new one of the same ID has been started since, its queue goes too
+  streamManager_->setOnStreamRemoved([this](const std::string &streamId) {
+    if (!streamManager_->getStream(streamId)) {
+      chunkWriter_.removeStream(streamId);
+    }
+  });
+}
+
+WebSocketMessageHandler::~WebSocketMessageHandler() {
+  streamManager_->setOnStreamRemoved(nullptr);
+}
+
+void WebSocketMessageHandler::setChunkSizeLimits(size_t minChunkSize,
+                                                 size_t maxChunkSize) {
+  minChunkSize_ = minChunkSize;
+  maxChunkSize_ = std::max(minChunkSize, maxChunkSize);
+}
 
 void WebSocketMessageHandler::handleTextMessage(const std::string &message,
                                                 const std::string &connectionId,
                                                 SendTextCallback sendText,
-                                                SendBinaryCallback sendBinary) {
+                                                SendBinaryCallback sendBinary,
+                                                CanSendCallback canSend) {
+  // Held by value: parked GETs and STREAM ranges reply after this returns
+  auto sendMessage = [sendText](const WebSocketMessage &reply) {
+    sendText(reply.toJsonString());
+  };
+
   try {
-    spdlog::debug("Received text message: {}", message);
+    SPDLOG_DEBUG("Received text message: {}", message);
 
     // Parse JSON message to WebSocketMessage
     WebSocketMessage msg = WebSocketMessage::fromJsonString(message);
+    handleMessage(msg, connectionId, sendMessage, sendBinary, canSend);
+  } catch (const json::parse_error &e) {
+    spdlog::error("JSON parse error: {}", e.what());
+    sendErrorMessage("Invalid JSON format", sendMessage);
+  } catch (const std::exception &e) {
+    spdlog::error("Error handling text message: {}", e.what());
+    sendErrorMessage("Internal server error", sendMessage);
+  }
+}
 
+void WebSocketMessageHandler::handleMessage(const WebSocketMessage &msg,
+                                            const std::string &connectionId,
+                                            SendMessageCallback sendMessage,
+                                            SendBinaryCallback sendBinary,
+                                            CanSendCallback canSend) {
+  MetricTimer timer(Histogram::HANDLER_DISPATCH_NS);
+  ServerMetrics::getInstance().add(Counter::CONTROL_MESSAGES);
+  try {
     if (msg.type.empty()) {
-      sendErrorMessage("Missing 'type' field in message", sendText);
+      sendErrorMessage("Missing 'type' field in message", sendMessage);
       return;
     }
 
@@ -31,123 +82,677 @@ void WebSocketMessageHandler::handleTextMessage(const std::string &message,
 
     switch (msgType) {
     case MessageType::START:
-      handleStartMessage(msg, connectionId, sendText);
+      handleStartMessage(msg, connectionId, sendMessage);
       break;
     case MessageType::STOP:
-      handleStopMessage(msg, connectionId, sendText);
+      handleStopMessage(msg, connectionId, sendMessage);
+      break;
+    case MessageType::PUT:
+      handlePutMessage(msg, connectionId, sendMessage);
       break;
     case MessageType::GET:
-      handleGetMessage(msg, sendText, sendBinary);
+      handleGetMessage(msg, connectionId, sendMessage, sendBinary);
+      break;
+    case MessageType::RESUME:
+      handleResumeMessage(msg, connectionId, sendMessage);
+      break;
+    case MessageType::ATTACH:
+      handleAttachMessage(msg, connectionId, sendMessage);
+      break;
+    case MessageType::DETACH:
+      handleDetachMessage(msg, connectionId, sendMessage);
+      break;
+    case MessageType::STREAM:
+      handleStreamMessage(msg, connectionId, sendMessage, sendBinary,
+                          canSend);
+      break;
+    case MessageType::STATS:
+      sendMessage(WebSocketMessage::statsReply(ServerMetrics::toJson(
+          ServerMetrics::getInstance().snapshot(), collectMetrics())));
+      break;
+    case MessageType::HELLO:
+      sendMessage(WebSocketMessage::hello(
+          CAPABILITY_PUT | CAPABILITY_HAVE | CAPABILITY_ATTACH, maxChunkSize_));
+      break;
+    case MessageType::HAVE:
+      handleHaveMessage(msg, connectionId, sendMessage);
       break;
     default:
-      sendErrorMessage("Unknown message type: " + msg.type, sendText);
+      sendErrorMessage("Unknown message type: " + msg.type, sendMessage);
       break;
     }
-  } catch (const json::parse_error &e) {
-    spdlog::error("JSON parse error: {}", e.what());
-    sendErrorMessage("Invalid JSON format", sendText);
   } catch (const std::exception &e) {
-    spdlog::error("Error handling text message: {}", e.what());
-    sendErrorMessage("Internal server error", sendText);
+    spdlog::error("Error handling message: {}", e.what());
+    sendErrorMessage("Internal server error", sendMessage);
   }
 }
 
 void WebSocketMessageHandler::handleBinaryMessage(
-    const std::vector<uint8_t> &data, const std::string &connectionId,
-    SendTextCallback sendText) {
+    PooledBufferPtr data, const std::string &connectionId,
+    SendMessageCallback sendMessage, uint32_t handle,
+    std::optional<uint64_t> offset) {
+  MetricTimer timer(Histogram::HANDLER_DISPATCH_NS);
+  ServerMetrics::getInstance().add(Counter::DATA_FRAMES);
   try {
-    spdlog::debug("Received binary message: {} bytes", data.size());
+    SPDLOG_DEBUG("Received binary message: {} bytes (handle {})",
+                 data->size(), handle);
 
-    // Find the stream associated with this connection
-    std::string streamId = getStreamForConnection(connectionId);
+    // The frame after a JSON PUT carries its bytes
+    if (handle == 0) {
+      std::optional<WebSocketMessage> put;
+      {
+        std::lock_guard<std::mutex> lock(connectionMutex_);
+        auto it = pendingPuts_.find(connectionId);
+        if (it != pendingPuts_.end()) {
+          put = std::move(it->second);
+          pendingPuts_.erase(it);
+        }
+      }
+      if (put) {
+        if (data->size() != put->length.value_or(0)) {
+          sendErrorMessage("PUT of stream " + put->streamId.value_or("") +
+                               " announced " +
+                               std::to_string(put->length.value_or(0)) +
+                               " bytes, got " + std::to_string(data->size()),
+                           sendMessage);
+          return;
+        }
+        handlePut(*put, std::move(data), connectionId, sendMessage);
+        return;
+      }
+    }
+
+    // Find the stream the frame's handle names on this connection
+    std::string streamId = getStreamForConnection(connectionId, handle);
     if (streamId.empty()) {
-      sendErrorMessage("No active stream for binary data", sendText);
+      sendErrorMessage(handle == 0 ? "No active stream for binary data"
+                                   : "Unknown stream handle: " +
+                                         std::to_string(handle),
+                       sendMessage);
       return;
     }
 
-    // Write the chunk to the stream
-    if (streamManager_->writeChunk(streamId, data)) {
-      spdlog::debug("Successfully wrote {} bytes to stream {}", data.size(),
-                    streamId);
-    } else {
-      spdlog::error("Failed to write {} bytes to stream {}", data.size(),
-                    streamId);
-      sendErrorMessage("Failed to write data to stream: " + streamId, sendText);
+    // Chunks of an attached connection go into the middle of the stream;
+    // appending them after whatever was queued last would misplace them
+    if (!offset && isAttachedHandle(connectionId, handle)) {
+      sendStreamError(streamId,
+                      "Chunks of attached stream " + streamId +
+                          " need an offset (binary DATA frames)",
+                      sendMessage);
+      return;
     }
+
+    if (data->size() > maxChunkSize_) {
+      sendErrorMessage("Binary frame of " + std::to_string(data->size()) +
+                           " bytes exceeds maximum chunk size " +
+                           std::to_string(maxChunkSize_),
+                       sendMessage);
+      return;
+    }
+
+    // Hand the chunk to the write stage; the I/O thread does not wait for
+    // storage
+    size_t size = data->size();
+    chunkWriter_.submit(streamId, offset, std::move(data),
+                        [this, streamId, size, sendMessage] {
+                          spdlog::error("Failed to write {} bytes to stream {}",
+                                        size, streamId);
+                          sendStreamError(streamId,
+                                          "Failed to write data to stream: " +
+                                              streamId,
+                                          sendMessage);
+                        });
   } catch (const std::exception &e) {
     spdlog::error("Error handling binary message: {}", e.what());
-    sendErrorMessage("Internal error processing binary message", sendText);
+    sendErrorMessage("Internal error processing binary message", sendMessage);
   }
 }
 
 void WebSocketMessageHandler::handleStartMessage(
     const WebSocketMessage &msg, const std::string &connectionId,
-    SendTextCallback sendText) {
+    SendMessageCallback sendMessage) {
   try {
     if (!msg.streamId.has_value() || msg.streamId.value().empty()) {
-      sendErrorMessage("Missing 'streamId' field in START message", sendText);
+      sendErrorMessage("Missing 'streamId' field in START message",
+                       sendMessage);
       return;
     }
 
     std::string streamId = msg.streamId.value();
     spdlog::info("Starting stream: {}", streamId);
 
+    // Clients that do not ask for a size get the default
+    size_t chunkSize = std::min(
+        std::max(msg.chunkSize.value_or(CHUNK_SIZE), minChunkSize_),
+        maxChunkSize_);
+
+    std::optional<Durability> durability =
+        requestedDurability(msg, sendMessage);
+    if (!durability) {
+      return;
+    }
+
+    if (getStreamCountForConnection(connectionId) >=
+        MAX_STREAMS_PER_CONNECTION) {
+      sendErrorMessage("Too many streams on this connection (limit " +
+                           std::to_string(MAX_STREAMS_PER_CONNECTION) + ")",
+                       sendMessage);
+      return;
+    }
+    if (auto refusal = admissionRefusal()) {
+      refuseUpload(streamId, *refusal, sendMessage);
+      return;
+    }
+
     // Create new stream
     if (streamManager_->createStream(streamId)) {
+      std::optional<std::array<uint8_t, HAVE_NONCE_BYTES>> nonce;
+      if (auto stream = streamManager_->getStream(streamId)) {
+        std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+        stream->chunkSize = chunkSize;
+        if (*durability != Durability::DEFAULT) {
+          stream->durability = *durability;
+        }
+        nonce = stream->uploadNonce;
+      }
+
       // Associate this connection with the stream
-      associateStreamWithConnection(connectionId, streamId);
+      uint32_t handle = associateStreamWithConnection(connectionId, streamId);
+      if (handle == 0) {
+        streamManager_->deleteStream(streamId);
+        sendErrorMessage("Too many streams on this connection (limit " +
+                             std::to_string(MAX_STREAMS_PER_CONNECTION) + ")",
+                         sendMessage);
+        return;
+      }
+
+      // Credit first, so the client knows its window when STARTED arrives
+      if (msg.window.value_or(0) > 0) {
+        openCredit(streamId, connectionId, handle, msg.window.value(), 0,
+                   sendMessage);
+      }
 
-      // Send success response using WebSocketMessage
-      WebSocketMessage response = WebSocketMessage::started(streamId);
-      sendText(response.toJsonString());
+      // Send success response with the negotiated chunk size and the range
+      // the client may adapt within
+      WebSocketMessage response = WebSocketMessage::started(
+          streamId, chunkSize, minChunkSize_, maxChunkSize_);
+      response.handle = handle;
+      response.nonce = nonce;
+      sendMessage(response);
       spdlog::info(
-          "Stream {} started successfully and associated with connection",
-          streamId);
+          "Stream {} started successfully and associated with connection "
+          "(chunk size {}, handle {})",
+          streamId, chunkSize, handle);
     } else {
-      sendErrorMessage("Failed to create stream: " + streamId, sendText);
+      sendErrorMessage("Failed to create stream: " + streamId, sendMessage);
     }
   } catch (const std::exception &e) {
     spdlog::error("Error handling START message: {}", e.what());
-    sendErrorMessage("Internal error processing START message", sendText);
+    sendErrorMessage("Internal error processing START message", sendMessage);
   }
 }
 
-void WebSocketMessageHandler::handleStopMessage(const WebSocketMessage &msg,
-                                                const std::string &connectionId,
-                                                SendTextCallback sendText) {
+std::optional<Durability>
+WebSocketMessageHandler::requestedDurability(const WebSocketMessage &msg,
+                                             SendMessageCallback sendMessage) {
+  // Streams that do not name a tier get the server's
+  if (!msg.durability.has_value()) {
+    return Durability::DEFAULT;
+  }
+  std::optional<Durability> durability =
+      stringToDurability(msg.durability.value());
+  if (!durability) {
+    sendErrorMessage("Unknown durability '" + msg.durability.value() +
+                         "' (none, periodic, finalize or strict)",
+                     sendMessage);
+  }
+  return durability;
+}
+
+void WebSocketMessageHandler::handlePutMessage(
+    const WebSocketMessage &msg, const std::string &connectionId,
+    SendMessageCallback sendMessage) {
+  try {
+    if (!msg.streamId.has_value() || msg.streamId.value().empty() ||
+        !msg.length.has_value()) {
+      sendErrorMessage("Missing required fields in PUT message (streamId, "
+                       "length)",
+                       sendMessage);
+      return;
+    }
+    if (msg.length.value() > maxChunkSize_) {
+      sendErrorMessage("PUT of " + std::to_string(msg.length.value()) +
+                           " bytes exceeds maximum chunk size " +
+                           std::to_string(maxChunkSize_) +
+                           "; upload it with START",
+                       sendMessage);
+      return;
+    }
+    if (!requestedDurability(msg, sendMessage)) {
+      return;
+    }
+
+    // No data frame follows an empty stream
+    if (msg.length.value() == 0) {
+      handlePut(msg, nullptr, connectionId, sendMessage);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(connectionMutex_);
+    pendingPuts_[connectionId] = msg;
+  } catch (const std::exception &e) {
+    spdlog::error("Error handling PUT message: {}", e.what());
+    sendErrorMessage("Internal error processing PUT message", sendMessage);
+  }
+}
+
+void WebSocketMessageHandler::handlePut(const WebSocketMessage &msg,
+                                        PooledBufferPtr data,
+                                        const std::string &connectionId,
+                                        SendMessageCallback sendMessage) {
   try {
     if (!msg.streamId.has_value() || msg.streamId.value().empty()) {
-      sendErrorMessage("Missing 'streamId' field in STOP message", sendText);
+      sendErrorMessage("Missing 'streamId' field in PUT message", sendMessage);
+      return;
+    }
+
+    size_t size = data ? data->size() : 0;
+    if (size > maxChunkSize_) {
+      sendErrorMessage("PUT of " + std::to_string(size) +
+                           " bytes exceeds maximum chunk size " +
+                           std::to_string(maxChunkSize_) +
+                           "; upload it with START",
+                       sendMessage);
+      return;
+    }
+    std::optional<Durability> durability =
+        requestedDurability(msg, sendMessage);
+    if (!durability) {
       return;
     }
 
     std::string streamId = msg.streamId.value();
-    spdlog::info("Stopping stream: {}", streamId);
+    if (auto refusal = admissionRefusal()) {
+      refuseUpload(streamId, *refusal, sendMessage);
+      return;
+    }
+    spdlog::info("Putting stream: {} ({} bytes, connection {})", streamId,
+                 size, connectionId);
 
-    // Disassociate connection from stream
-    disassociateConnection(connectionId);
+    // Stored by the write stage, after anything still queued for the id;
+    // the I/O thread does not wait for storage
+    std::shared_ptr<PooledBuffer> buffer(std::move(data));
+    chunkWriter_.whenWritten(
+        streamId, [this, streamId, tier = *durability, buffer, sendMessage] {
+          finishPut(streamId, tier, buffer, sendMessage);
+        });
+  } catch (const std::exception &e) {
+    spdlog::error("Error handling PUT message: {}", e.what());
+    sendErrorMessage("Internal error processing PUT message", sendMessage);
+  }
+}
+
+void WebSocketMessageHandler::finishPut(const std::string &streamId,
+                                        Durability durability,
+                                        std::shared_ptr<PooledBuffer> data,
+                                        SendMessageCallback sendMessage) {
+  try {
+    bool stored = streamManager_->putStream(
+        streamId, data ? data->data() : nullptr, data ? data->size() : 0,
+        durability);
+    // An upload of the same id keeps its queue
+    auto stream = streamManager_->getStream(streamId);
+    if (!stored && stream) {
+      sendErrorMessage("Stream already exists: " + streamId, sendMessage);
+      return;
+    }
+    chunkWriter_.removeStream(streamId);
+    if (!stored) {
+      sendErrorMessage("Failed to store stream: " + streamId, sendMessage);
+      return;
+    }
 
-    // Send success response using WebSocketMessage
     WebSocketMessage response = WebSocketMessage::stopped(streamId);
-    sendText(response.toJsonString());
+    if (stream) {
+      std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+      response.checksum = stream->checksum;
+    }
+    sendMessage(response);
+  } catch (const std::exception &e) {
+    spdlog::error("Error finishing PUT of stream {}: {}", streamId, e.what());
+    sendErrorMessage("Internal error processing PUT message", sendMessage);
+  }
+}
+
+void WebSocketMessageHandler::handleStopMessage(
+    const WebSocketMessage &msg, const std::string &connectionId,
+    SendMessageCallback sendMessage) {
+  try {
+    if (!msg.streamId.has_value() || msg.streamId.value().empty()) {
+      sendErrorMessage("Missing 'streamId' field in STOP message", sendMessage);
+      return;
+    }
+
+    std::string streamId = msg.streamId.value();
+    spdlog::info("Stopping stream: {} (connection {})", streamId,
+                 connectionId);
+
+    // Finalize once the chunks sent before STOP are on the stream
+    chunkWriter_.whenWritten(streamId, [this, streamId, sendMessage] {
+      finishStop(streamId, sendMessage);
+    });
+  } catch (const std::exception &e) {
+    spdlog::error("Error handling STOP message: {}", e.what());
+    sendErrorMessage("Internal error processing STOP message", sendMessage);
+  }
+}
+
+void WebSocketMessageHandler::finishStop(const std::string &streamId,
+                                         SendMessageCallback sendMessage) {
+  try {
+    // Trim the cache file to its written size and mark it READY
+    if (!streamManager_->finalizeStream(streamId)) {
+      spdlog::warn("Stream {} could not be finalized on STOP", streamId);
+
+      auto stream = streamManager_->getStream(streamId);
+      if (!stream) {
+        disassociateStream(streamId);
+        chunkWriter_.removeStream(streamId);
+        completeParkedReads(streamId);
+        sendErrorMessage("Stream not found: " + streamId, sendMessage);
+        return;
+      }
+
+      // Unless another STOP finalized it meanwhile, the upload stays open
+      // on its handle: the client sends the bytes it is told of and STOPs
+      // again. Nothing was stored durably, so it gets no STOPPED.
+      std::string error;
+      {
+        std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+        if (stream->status != StreamStatus::READY) {
+          auto gap = stream->extents.firstGap(stream->totalSize);
+          if (stream->storageFailed) {
+            error = "Failed to sync stream " + streamId +
+                    " to disk; resume it and send it again";
+          } else if (gap.first < gap.second) {
+            // Chunks written out of order left a hole
+            error = "Stream " + streamId + " is missing bytes " +
+                    std::to_string(gap.first) + "-" +
+                    std::to_string(gap.second);
+          } else {
+            error = "Stream " + streamId + " could not be finalized";
+          }
+        }
+      }
+      if (!error.empty()) {
+        sendStreamError(streamId, error, sendMessage);
+        return;
+      }
+    }
+
+    // The stream's handle is free again, and nothing more is queued for it
+    disassociateStream(streamId);
+    chunkWriter_.removeStream(streamId);
+
+    // Tailing readers get the rest of the stream or reach its end
+    completeParkedReads(streamId);
+
+    // Send success response with the digest of what was stored, so the
+    // client can verify the upload without reading anything back
+    WebSocketMessage response = WebSocketMessage::stopped(streamId);
+    if (auto stream = streamManager_->getStream(streamId)) {
+      std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+      response.checksum = stream->checksum;
+    }
+    sendMessage(response);
     spdlog::info(
         "Stream {} stopped successfully and disconnected from connection",
         streamId);
   } catch (const std::exception &e) {
-    spdlog::error("Error handling STOP message: {}", e.what());
-    sendErrorMessage("Internal error processing STOP message", sendText);
+    spdlog::error("Error finishing STOP of stream {}: {}", streamId, e.what());
+    sendErrorMessage("Internal error processing STOP message", sendMessage);
+  }
+}
+
+void WebSocketMessageHandler::handleResumeMessage(
+    const WebSocketMessage &msg, const std::string &connectionId,
+    SendMessageCallback sendMessage) {
+  try {
+    if (!msg.streamId.has_value() || msg.streamId.value().empty()) {
+      sendErrorMessage("Missing 'streamId' field in RESUME message",
+                       sendMessage);
+      return;
+    }
+
+    std::string streamId = msg.streamId.value();
+    auto stream = streamManager_->getStream(streamId);
+    if (!stream) {
+      sendErrorMessage("Stream not found: " + streamId, sendMessage);
+      return;
+    }
+
+    // Take the stream over first, so later frames from the old connection
+    // are refused; the ones it already queued are written before the offset
+    // is read
+    uint32_t handle = associateStreamWithConnection(connectionId, streamId);
+    if (handle == 0) {
+      sendErrorMessage("Too many streams on this connection (limit " +
+                           std::to_string(MAX_STREAMS_PER_CONNECTION) + ")",
+                       sendMessage);
+      return;
+    }
+
+    chunkWriter_.whenWritten(streamId, [this, streamId, connectionId, handle,
+                                        window = msg.window.value_or(0),
+                                        sendMessage] {
+      finishResume(streamId, connectionId, handle, window, sendMessage);
+    });
+  } catch (const std::exception &e) {
+    spdlog::error("Error handling RESUME message: {}", e.what());
+    sendErrorMessage("Internal error processing RESUME message", sendMessage);
+  }
+}
+
+void WebSocketMessageHandler::finishResume(const std::string &streamId,
+                                           const std::string &connectionId,
+                                           uint32_t handle, uint64_t window,
+                                           SendMessageCallback sendMessage) {
+  try {
+    auto stream = streamManager_->getStream(streamId);
+    if (!stream) {
+      disassociateStream(streamId);
+      sendErrorMessage("Stream not found: " + streamId, sendMessage);
+      return;
+    }
+
+    // Chunks from the new connection continue from the reported offset
+    chunkWriter_.resetAppendOffset(streamId);
+
+    size_t offset;
+    size_t chunkSize;
+    {
+      std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+      if (stream->status != StreamStatus::UPLOADING || !stream->mmapFile) {
+        disassociateStream(streamId);
+        sendErrorMessage("Stream is not uploading: " + streamId, sendMessage);
+        return;
+      }
+      offset = stream->currentOffset;
+      chunkSize = stream->chunkSize;
+    }
+
+    // The old connection's credit no longer applies
+    if (window > 0) {
+      openCredit(streamId, connectionId, handle, window, offset, sendMessage);
+    } else {
+      closeCredit(streamId);
+    }
+
+    WebSocketMessage response = WebSocketMessage::resumed(
+        streamId, offset, chunkSize, minChunkSize_, maxChunkSize_);
+    response.handle = handle;
+    response.nonce = stream->uploadNonce;
+    sendMessage(response);
+    spdlog::info("Stream {} resumed at offset {} on connection {} (handle {})",
+                 streamId, offset, connectionId, handle);
+  } catch (const std::exception &e) {
+    spdlog::error("Error finishing RESUME of stream {}: {}", streamId,
+                  e.what());
+    sendErrorMessage("Internal error processing RESUME message", sendMessage);
+  }
+}
+
+void WebSocketMessageHandler::handleAttachMessage(
+    const WebSocketMessage &msg, const std::string &connectionId,
+    SendMessageCallback sendMessage) {
+  try {
+    if (!msg.streamId.has_value() || msg.streamId.value().empty()) {
+      sendErrorMessage("Missing 'streamId' field in ATTACH message",
+                       sendMessage);
+      return;
+    }
+
+    std::string streamId = msg.streamId.value();
+    auto stream = streamManager_->getStream(streamId);
+    if (!stream) {
+      sendErrorMessage("Stream not found: " + streamId, sendMessage);
+      return;
+    }
+
+    size_t chunkSize;
+    {
+      std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+      if (stream->status != StreamStatus::UPLOADING || !stream->mmapFile) {
+        sendErrorMessage("Stream is not uploading: " + streamId, sendMessage);
+        return;
+      }
+      chunkSize = stream->chunkSize;
+    }
+
+    // Unlike RESUME, the owner keeps the stream and its credit
+    uint32_t handle = attachWriter(connectionId, streamId);
+    if (handle == 0) {
+      sendErrorMessage("Too many streams on this connection (limit " +
+                           std::to_string(MAX_STREAMS_PER_CONNECTION) + ")",
+                       sendMessage);
+      return;
+    }
+
+    WebSocketMessage response = WebSocketMessage::attached(
+        streamId, chunkSize, minChunkSize_, maxChunkSize_);
+    response.handle = handle;
+    sendMessage(response);
+    spdlog::info("Stream {} attached to connection {} (handle {})", streamId,
+                 connectionId, handle);
+  } catch (const std::exception &e) {
+    spdlog::error("Error handling ATTACH message: {}", e.what());
+    sendErrorMessage("Internal error processing ATTACH message", sendMessage);
+  }
+}
+
+void WebSocketMessageHandler::handleDetachMessage(
+    const WebSocketMessage &msg, const std::string &connectionId,
+    SendMessageCallback sendMessage) {
+  try {
+    if (!msg.streamId.has_value() || msg.streamId.value().empty()) {
+      sendErrorMessage("Missing 'streamId' field in DETACH message",
+                       sendMessage);
+      return;
+    }
+
+    std::string streamId = msg.streamId.value();
+    if (!detachWriter(connectionId, streamId)) {
+      sendErrorMessage("Stream " + streamId +
+                           " is not attached to this connection",
+                       sendMessage);
+      return;
+    }
+
+    // A chunk that failed was reported by its own ERROR before this
+    chunkWriter_.whenWritten(streamId, [this, streamId, sendMessage] {
+      dropQueueIfUnowned(streamId);
+      sendMessage(WebSocketMessage::detached(streamId));
+    });
+    spdlog::info("Stream {} detached from connection {}", streamId,
+                 connectionId);
+  } catch (const std::exception &e) {
+    spdlog::error("Error handling DETACH message: {}", e.what());
+    sendErrorMessage("Internal error processing DETACH message", sendMessage);
+  }
+}
+
+void WebSocketMessageHandler::handleHaveMessage(
+    const WebSocketMessage &msg, const std::string &connectionId,
+    SendMessageCallback sendMessage) {
+  try {
+    // JSON carries no digest or proof: only DATA frames with an offset can
+    // leave out a block
+    uint32_t handle = msg.handle.value_or(0);
+    if (handle == 0 || !msg.offset.has_value() || !msg.length.has_value() ||
+        !msg.digest.has_value() || !msg.proof.has_value()) {
+      sendErrorMessage("HAVE needs the binary protocol (handle, offset, "
+                       "length, digest and proof)",
+                       sendMessage);
+      return;
+    }
+    std::string streamId = getStreamForConnection(connectionId, handle);
+    if (streamId.empty()) {
+      sendErrorMessage("Unknown stream handle: " + std::to_string(handle),
+                       sendMessage);
+      return;
+    }
+    uint64_t offset = msg.offset.value();
+    size_t length = msg.length.value();
+    if (offset % HAVE_BLOCK_SIZE != 0 || length == 0 ||
+        length > HAVE_BLOCK_SIZE) {
+      sendErrorMessage("HAVE of stream " + streamId + " at " +
+                           std::to_string(offset) + " is not a block",
+                       sendMessage);
+      return;
+    }
+
+    // Copied by the write stage, in order with the stream's chunks
+    chunkWriter_.whenWritten(streamId, [this, streamId, offset, length,
+                                        digest = msg.digest.value(),
+                                        proof = msg.proof.value(),
+                                        sendMessage] {
+      finishHave(streamId, offset, length, digest, proof, sendMessage);
+    });
+  } catch (const std::exception &e) {
+    spdlog::error("Error handling HAVE message: {}", e.what());
+    sendErrorMessage("Internal error processing HAVE message", sendMessage);
+  }
+}
+
+void WebSocketMessageHandler::finishHave(const std::string &streamId,
+                                         uint64_t offset, size_t length,
+                                         const sha256::Digest &digest,
+                                         const sha256::Digest &proof,
+                                         SendMessageCallback sendMessage) {
+  try {
+    size_t stored = streamManager_->writeStoredBlock(streamId, offset, length,
+                                                     digest, proof);
+    // Written like a chunk, so readers and credit see it the same way
+    if (stored > 0) {
+      completeParkedReads(streamId);
+      updateCredit(streamId);
+    }
+    sendMessage(WebSocketMessage::has(streamId, offset, stored));
+  } catch (const std::exception &e) {
+    spdlog::error("Error finishing HAVE of stream {}: {}", streamId, e.what());
+    sendErrorMessage("Internal error processing HAVE message", sendMessage);
   }
 }
 
 void WebSocketMessageHandler::handleGetMessage(const WebSocketMessage &msg,
-                                               SendTextCallback sendText,
+                                               const std::string &connectionId,
+                                               SendMessageCallback sendMessage,
                                                SendBinaryCallback sendBinary) {
   try {
     if (!msg.streamId.has_value() || !msg.offset.has_value() ||
         !msg.length.has_value()) {
       sendErrorMessage(
           "Missing required fields in GET message (streamId, offset, length)",
-          sendText);
+          sendMessage);
       return;
     }
 
@@ -155,70 +760,907 @@ void WebSocketMessageHandler::handleGetMessage(const WebSocketMessage &msg,
     size_t offset = msg.offset.value();
     size_t length = msg.length.value();
 
-    spdlog::debug("Getting data from stream: {} offset: {} length: {}",
-                  streamId, offset, length);
+    SPDLOG_DEBUG("Getting data from stream: {} offset: {} length: {}",
+                 streamId, offset, length);
 
-    // Read data from stream
-    std::vector<uint8_t> data =
-        streamManager_->readChunk(streamId, offset, length);
+    // At or past the write head of an upload in progress: wait for the data
+    auto stream = streamManager_->getStream(streamId);
+    if (stream &&
+        parkRead(stream, ParkedRead{connectionId, offset, length, {},
+                                    sendMessage, sendBinary})) {
+      SPDLOG_DEBUG("Parked GET on stream {} at offset {}", streamId, offset);
+      return;
+    }
+
+    // Read a view of the cached bytes; it is framed without an extra copy
+    BufferView data = streamManager_->readChunkView(streamId, offset, length);
 
     if (!data.empty()) {
       // Send binary data
-      sendBinary(data);
-      spdlog::debug("Sent {} bytes from stream {}", data.size(), streamId);
+      sendBinary(offset, data,
+                 stream ? stream->compressionProfile.load(
+                              std::memory_order_relaxed)
+                        : CompressionProfile{});
+      SPDLOG_DEBUG("Sent {} bytes from stream {}", data.size(), streamId);
+      AUDIO_STREAM_TRACE(streamId, "sent {} bytes at offset {}", data.size(),
+                         offset);
     } else {
       // Check if this is end of file or an actual error
-      auto stream = streamManager_->getStream(streamId);
-      if (stream && offset >= stream->totalSize) {
+      size_t totalSize = 0;
+      if (stream) {
+        std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+        totalSize = stream->totalSize;
+      }
+      if (stream && offset >= totalSize) {
         // End of file
-        sendErrorMessage("No data available", sendText);
-        spdlog::debug("End of file reached for stream {} at offset {}",
-                      streamId, offset);
+        sendErrorMessage("No data available", sendMessage);
+        SPDLOG_DEBUG("End of file reached for stream {} at offset {}",
+                     streamId, offset);
       } else {
         // Actual error
-        sendErrorMessage("Failed to read from stream: " + streamId, sendText);
+        sendErrorMessage("Failed to read from stream: " + streamId,
+                         sendMessage);
       }
     }
   } catch (const json::parse_error &e) {
     spdlog::error("JSON parse error in GET message: {}", e.what());
-    sendErrorMessage("Invalid JSON in GET message", sendText);
+    sendErrorMessage("Invalid JSON in GET message", sendMessage);
   } catch (const std::exception &e) {
     spdlog::error("Error handling GET message: {}", e.what());
-    sendErrorMessage("Internal error processing GET message", sendText);
+    sendErrorMessage("Internal error processing GET message", sendMessage);
   }
 }
 
-void WebSocketMessageHandler::sendErrorMessage(const std::string &error,
-                                               SendTextCallback sendText) {
+void WebSocketMessageHandler::handleStreamMessage(
+    const WebSocketMessage &msg, const std::string &connectionId,
+    SendMessageCallback sendMessage, SendBinaryCallback sendBinary,
+    CanSendCallback canSend) {
+  try {
+    if (!msg.streamId.has_value() || !msg.offset.has_value()) {
+      sendErrorMessage(
+          "Missing required fields in STREAM message (streamId, offset)",
+          sendMessage);
+      return;
+    }
+
+    std::string streamId = msg.streamId.value();
+    auto stream = streamManager_->getStream(streamId);
+    if (!stream) {
+      sendErrorMessage("Stream not found: " + streamId, sendMessage);
+      return;
+    }
+
+    size_t offset = msg.offset.value();
+    size_t length = msg.length.value_or(0);
+    size_t end = length == 0 || length > SIZE_MAX - offset ? SIZE_MAX
+                                                           : offset + length;
+    size_t chunkSize = std::min(
+        std::max(msg.chunkSize.value_or(CHUNK_SIZE), minChunkSize_),
+        maxChunkSize_);
+
+    {
+      std::lock_guard<std::mutex> lock(rangeMutex_);
+      rangeStreams_[connectionId].ranges.push_back(
+          RangeStream{stream, offset, offset, end, chunkSize, sendMessage,
+                      sendBinary, canSend});
+    }
+    SPDLOG_DEBUG("Streaming stream {} from offset {} ({} byte frames)",
+                 streamId, offset, chunkSize);
+
+    // Start right away; the server's pump continues once the buffer drains
+    pumpConnection(connectionId);
+  } catch (const std::exception &e) {
+    spdlog::error("Error handling STREAM message: {}", e.what());
+    sendErrorMessage("Internal error processing STREAM message", sendMessage);
+  }
+}
+
+bool WebSocketMessageHandler::pumpRangeStreams() {
+  std::vector<std::string> connections;
+  {
+    std::lock_guard<std::mutex> lock(rangeMutex_);
+    for (const auto &[connectionId, ranges] : rangeStreams_) {
+      connections.push_back(connectionId);
+    }
+  }
+
+  for (const auto &connectionId : connections) {
+    pumpConnection(connectionId);
+  }
+  return hasRangeStreams();
+}
+
+void WebSocketMessageHandler::pumpConnection(const std::string &connectionId) {
+  RangeStream *range;
+  {
+    std::lock_guard<std::mutex> lock(rangeMutex_);
+    auto it = rangeStreams_.find(connectionId);
+    if (it == rangeStreams_.end() || it->second.pumping) {
+      return; // Frames of one connection must leave in order
+    }
+    it->second.pumping = true;
+    range = &it->second.ranges.front();
+  }
+
+  while (true) {
+    // Only this thread touches front(); push_back keeps it in place
+    bool done = pushRange(*range);
+
+    std::lock_guard<std::mutex> lock(rangeMutex_);
+    auto it = rangeStreams_.find(connectionId);
+    ConnectionRanges &ranges = it->second;
+    if (ranges.cancelled) {
+      rangeStreams_.erase(it);
+      return;
+    }
+    if (!done) {
+      ranges.pumping = false;
+      return;
+    }
+    ranges.ranges.pop_front();
+    if (ranges.ranges.empty()) {
+      rangeStreams_.erase(it);
+      return;
+    }
+    range = &ranges.ranges.front();
+  }
+}
+
+bool WebSocketMessageHandler::pushRange(RangeStream &range) {
+  try {
+    for (size_t frames = 0; frames < RANGE_STREAM_BURST; ++frames) {
+      // Stop at the end of the range, or of the stream once it is READY;
+      // an upload in progress is followed at its write head
+      size_t available;
+      {
+        std::lock_guard<std::mutex> streamLock(range.stream->contextMutex);
+        bool uploading = range.stream->status == StreamStatus::UPLOADING &&
+                         range.stream->mmapFile != nullptr;
+        available = range.stream->mmapFile ? range.stream->currentOffset : 0;
+        if (uploading && range.next >= available && range.next < range.end) {
+          return false;
+        }
+      }
+      if (range.next >= std::min(range.end, available)) {
+        break;
+      }
+      if (range.canSend && !range.canSend()) {
+        return false;
+      }
+
+      size_t length = std::min({range.chunkSize, range.end - range.next,
+                                available - range.next});
+      BufferView data = streamManager_->readChunkView(range.stream->streamId,
+                                                      range.next, length);
+      if (data.empty()) {
+        break; // Deleted or unreadable; report what was sent
+      }
+      range.sendBinary(
+          range.next, data,
+          range.stream->compressionProfile.load(std::memory_order_relaxed));
+      range.next += data.size();
+
+      if (frames + 1 == RANGE_STREAM_BURST) {
+        return false;
+      }
+    }
+
+    range.sendMessage(WebSocketMessage::streamed(
+        range.stream->streamId, range.offset, range.next - range.offset));
+    SPDLOG_DEBUG("Streamed {} bytes of stream {} from offset {}",
+                 range.next - range.offset, range.stream->streamId,
+                 range.offset);
+  } catch (const std::exception &e) {
+    spdlog::error("Error streaming stream {}: {}", range.stream->streamId,
+                  e.what());
+  }
+  return true;
+}
+
+void WebSocketMessageHandler::cancelRangeStreams(
+    const std::string &connectionId) {
+  std::lock_guard<std::mutex> lock(rangeMutex_);
+  auto it = rangeStreams_.find(connectionId);
+  if (it == rangeStreams_.end()) {
+    return;
+  }
+  if (it->second.pumping) {
+    it->second.cancelled = true; // The pumping thread removes it
+  } else {
+    rangeStreams_.erase(it);
+  }
+}
+
+bool WebSocketMessageHandler::hasRangeStreams() const {
+  std::lock_guard<std::mutex> lock(rangeMutex_);
+  return !rangeStreams_.empty();
+}
+
+void WebSocketMessageHandler::setParkedReadTimeout(
+    std::chrono::milliseconds timeout) {
+  std::lock_guard<std::mutex> lock(parkedMutex_);
+  parkedReadTimeout_ = timeout;
+}
+
+size_t WebSocketMessageHandler::getParkedReadCount() const {
+  return parkedCount_.load(std::memory_order_relaxed);
+}
+
+bool WebSocketMessageHandler::parkRead(
+    const std::shared_ptr<StreamContext> &stream, ParkedRead read) {
+  // The stream lock orders this against chunk writes: a chunk recorded
+  // after the check sees parkedCount_ raised and completes the read
+  std::lock_guard<std::mutex> lock(parkedMutex_);
+  std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+
+  // Behind an unanswered GET of this connection: answering it now would
+  // overtake that reply, and clients match replies in order
+  auto it = parkedReads_.find(stream->streamId);
+  bool behind =
+      it != parkedReads_.end() &&
+      (it->second.answering.count(read.connectionId) > 0 ||
+       std::any_of(it->second.reads.begin(), it->second.reads.end(),
+                   [&](const ParkedRead &parked) {
+                     return parked.connectionId == read.connectionId;
+                   }));
+  if (!behind &&
+      (stream->status != StreamStatus::UPLOADING || !stream->mmapFile ||
+       read.offset < stream->currentOffset ||
+       parkedCount_.load(std::memory_order_relaxed) >= MAX_PARKED_READS)) {
+    return false;
+  }
+  read.deadline = std::chrono::steady_clock::now() + parkedReadTimeout_;
+  parkedReads_[stream->streamId].reads.push_back(std::move(read));
+  parkedCount_.fetch_add(1, std::memory_order_acq_rel);
+  return true;
+}
+
+template <typename Answerable>
+std::vector<WebSocketMessageHandler::ParkedRead>
+WebSocketMessageHandler::takeParkedReads(ParkedStream &parked,
+                                         Answerable answerable) {
+  std::unordered_map<std::string, bool> blocked;
+  for (const auto &entry : parked.answering) {
+    blocked[entry.first] = true;
+  }
+
+  std::vector<ParkedRead> taken;
+  size_t kept = 0;
+  for (size_t i = 0; i < parked.reads.size(); ++i) {
+    ParkedRead &read = parked.reads[i];
+    bool &connectionBlocked = blocked[read.connectionId];
+    if (!connectionBlocked && answerable(read)) {
+      ++parked.answering[read.connectionId];
+      taken.push_back(std::move(read));
+      continue;
+    }
+    connectionBlocked = true; // Later reads wait behind this one
+    if (kept != i) {
+      parked.reads[kept] = std::move(read);
+    }
+    ++kept;
+  }
+  parked.reads.erase(parked.reads.begin() + static_cast<std::ptrdiff_t>(kept),
+                     parked.reads.end());
+  parkedCount_.fetch_sub(taken.size(), std::memory_order_acq_rel);
+  return taken;
+}
+
+void WebSocketMessageHandler::finishParkedReads(
+    const std::string &streamId, const std::vector<ParkedRead> &reads) {
+  std::lock_guard<std::mutex> lock(parkedMutex_);
+  auto it = parkedReads_.find(streamId);
+  if (it == parkedReads_.end()) {
+    return;
+  }
+  auto &answering = it->second.answering;
+  for (const auto &read : reads) {
+    auto entry = answering.find(read.connectionId);
+    if (entry != answering.end() && --entry->second == 0) {
+      answering.erase(entry);
+    }
+  }
+  if (it->second.reads.empty() && answering.empty()) {
+    parkedReads_.erase(it);
+  }
+}
+
+void WebSocketMessageHandler::completeParkedReads(const std::string &streamId) {
+  if (parkedCount_.load(std::memory_order_acquire) == 0) {
+    return;
+  }
+
+  // Each pass answers what it can; reads that were waiting behind the ones
+  // it answered are taken by the next
+  while (true) {
+    std::vector<ParkedRead> ready;
+    {
+      std::lock_guard<std::mutex> lock(parkedMutex_);
+      auto it = parkedReads_.find(streamId);
+      if (it == parkedReads_.end()) {
+        return;
+      }
+
+      // A stream no longer uploading can only answer (data or end of
+      // stream)
+      size_t writeHead = 0;
+      bool uploading = false;
+      if (auto stream = streamManager_->getStream(streamId)) {
+        std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+        writeHead = stream->currentOffset;
+        uploading = stream->status == StreamStatus::UPLOADING &&
+                    stream->mmapFile != nullptr;
+      }
+
+      ready = takeParkedReads(it->second, [&](const ParkedRead &read) {
+        return !uploading || read.offset < writeHead;
+      });
+      if (ready.empty()) {
+        return;
+      }
+    }
+
+    for (const auto &read : ready) {
+      serveParkedRead(streamId, read);
+    }
+    finishParkedReads(streamId, ready);
+  }
+}
+
+void WebSocketMessageHandler::serveParkedRead(const std::string &streamId,
+                                              const ParkedRead &read) {
+  try {
+    BufferView data =
+        streamManager_->readChunkView(streamId, read.offset, read.length);
+    auto stream = streamManager_->getStream(streamId);
+    if (!data.empty()) {
+      read.sendBinary(read.offset, data,
+                      stream ? stream->compressionProfile.load(
+                                   std::memory_order_relaxed)
+                             : CompressionProfile{});
+      SPDLOG_DEBUG("Completed parked GET on stream {}: {} bytes at {}",
+                   streamId, data.size(), read.offset);
+    } else {
+      sendErrorMessage("No data available", read.sendMessage);
+    }
+  } catch (const std::exception &e) {
+    spdlog::error("Error completing parked GET on stream {}: {}", streamId,
+                  e.what());
+  }
+}
+
+void WebSocketMessageHandler::expireParkedReads() {
+  if (parkedCount_.load(std::memory_order_acquire) == 0) {
+    return;
+  }
+
+  std::vector<std::pair<std::string, std::vector<ParkedRead>>> expired;
+  {
+    std::lock_guard<std::mutex> lock(parkedMutex_);
+    auto now = std::chrono::steady_clock::now();
+    for (auto &[streamId, parked] : parkedReads_) {
+      auto reads = takeParkedReads(parked, [now](const ParkedRead &read) {
+        return read.deadline <= now;
+      });
+      if (!reads.empty()) {
+        expired.emplace_back(streamId, std::move(reads));
+      }
+    }
+  }
+
+  for (const auto &[streamId, reads] : expired) {
+    for (const auto &read : reads) {
+      sendErrorMessage("No data available", read.sendMessage);
+    }
+    finishParkedReads(streamId, reads);
+    // Reads behind the expired ones may have their bytes already
+    completeParkedReads(streamId);
+  }
+}
+
+void WebSocketMessageHandler::cancelParkedReads(
+    const std::string &connectionId) {
+  if (parkedCount_.load(std::memory_order_acquire) == 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(parkedMutex_);
+  size_t cancelled = 0;
+  for (auto it = parkedReads_.begin(); it != parkedReads_.end();) {
+    auto &reads = it->second.reads;
+    auto end = std::remove_if(reads.begin(), reads.end(),
+                              [&](const ParkedRead &read) {
+                                return read.connectionId == connectionId;
+                              });
+    cancelled += static_cast<size_t>(reads.end() - end);
+    reads.erase(end, reads.end());
+    // Reads being answered finish and release their stream themselves
+    it = reads.empty() && it->second.answering.empty() ? parkedReads_.erase(it)
+                                                        : std::next(it);
+  }
+  parkedCount_.fetch_sub(cancelled, std::memory_order_acq_rel);
+}
+
+void WebSocketMessageHandler::sendErrorMessage(
+    const std::string &error, SendMessageCallback sendMessage) {
+  ServerMetrics::getInstance().add(Counter::ERRORS_SENT);
   try {
     WebSocketMessage errorMsg = WebSocketMessage::error(error);
-    sendText(errorMsg.toJsonString());
+    sendMessage(errorMsg);
     spdlog::debug("Sent error message: {}", error);
   } catch (const std::exception &e) {
     spdlog::error("Error sending error message: {}", e.what());
   }
 }
 
-void WebSocketMessageHandler::associateStreamWithConnection(
+void WebSocketMessageHandler::sendStreamError(const std::string &streamId,
+                                              const std::string &error,
+                                              SendMessageCallback sendMessage) {
+  ServerMetrics::getInstance().add(Counter::ERRORS_SENT);
+  try {
+    WebSocketMessage errorMsg = WebSocketMessage::error(error);
+    errorMsg.streamId = streamId;
+    sendMessage(errorMsg);
+  } catch (const std::exception &e) {
+    spdlog::error("Error sending error message: {}", e.what());
+  }
+}
+
+std::optional<std::string> WebSocketMessageHandler::admissionRefusal() const {
+  if (admission_.maxUploadingStreams > 0) {
+    size_t uploading;
+    {
+      std::lock_guard<std::mutex> lock(connectionMutex_);
+      uploading = streamOwners_.size();
+    }
+    if (uploading >= admission_.maxUploadingStreams) {
+      return "Too many uploads in progress (limit " +
+             std::to_string(admission_.maxUploadingStreams) + ")";
+    }
+  }
+  uint64_t queued = chunkWriter_.getQueuedBytes();
+  if (admission_.maxQueuedBytes > 0 && queued > admission_.maxQueuedBytes) {
+    return "Storage is behind (" + std::to_string(queued / (1024 * 1024)) +
+           " MB waiting to be written)";
+  }
+  if (streamManager_->isCacheFull()) {
+    return std::string("Cache is full of uploads in progress");
+  }
+  return std::nullopt;
+}
+
+void WebSocketMessageHandler::refuseUpload(const std::string &streamId,
+                                           const std::string &reason,
+                                           SendMessageCallback sendMessage) {
+  ServerMetrics::getInstance().add(Counter::UPLOADS_REFUSED);
+  ServerMetrics::getInstance().add(Counter::ERRORS_SENT);
+  spdlog::info("Refusing upload of stream {}: {}", streamId, reason);
+  try {
+    sendMessage(WebSocketMessage::retryLater(
+        reason + "; retry later",
+        static_cast<uint32_t>(admission_.retryAfter.count())));
+  } catch (const std::exception &e) {
+    spdlog::error("Error sending error message: {}", e.what());
+  }
+}
+
+uint64_t WebSocketMessageHandler::creditWindow(const std::string &connectionId,
+                                               uint64_t requested) const {
+  // Two chunks always fit, so a waiting client is always sent more credit
+  uint64_t minimum = 2 * static_cast<uint64_t>(maxChunkSize_);
+  if (admission_.maxQueuedBytes > 0 &&
+      chunkWriter_.getQueuedBytes() > admission_.maxQueuedBytes) {
+    return minimum;
+  }
+  uint64_t window = requested;
+  if (admission_.connectionWindow > 0) {
+    size_t streams =
+        std::max<size_t>(1, getStreamCountForConnection(connectionId));
+    window = std::min(window, admission_.connectionWindow / streams);
+  }
+  return std::max(minimum, window);
+}
+
+void WebSocketMessageHandler::openCredit(const std::string &streamId,
+                                         const std::string &connectionId,
+                                         uint32_t handle, uint64_t requested,
+                                         uint64_t written,
+                                         SendMessageCallback sendMessage) {
+  uint64_t window = creditWindow(connectionId, requested);
+  {
+    std::lock_guard<std::mutex> lock(creditMutex_);
+    uploadCredits_[streamId] = UploadCredit{connectionId, handle, requested,
+                                            written,      window, sendMessage};
+    creditCount_.store(uploadCredits_.size(), std::memory_order_relaxed);
+  }
+  sendMessage(WebSocketMessage::credit(streamId, written, window, handle));
+}
+
+void WebSocketMessageHandler::updateCredit(const std::string &streamId) {
+  if (creditCount_.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+
+  std::string connectionId;
+  uint64_t requested;
+  uint64_t next; // Written offset that earns new credit
+  {
+    std::lock_guard<std::mutex> lock(creditMutex_);
+    auto it = uploadCredits_.find(streamId);
+    if (it == uploadCredits_.end()) {
+      return;
+    }
+    connectionId = it->second.connectionId;
+    requested = it->second.requested;
+    next = it->second.base + it->second.length / 4;
+  }
+
+  auto stream = streamManager_->getStream(streamId);
+  if (!stream) {
+    return;
+  }
+  uint64_t written;
+  {
+    std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+    written = stream->currentOffset;
+  }
+  if (written < next) {
+    return;
+  }
+
+  uint64_t window = creditWindow(connectionId, requested);
+  WebSocketMessage credit;
+  SendMessageCallback sendMessage;
+  {
+    std::lock_guard<std::mutex> lock(creditMutex_);
+    auto it = uploadCredits_.find(streamId);
+    if (it == uploadCredits_.end() ||
+        it->second.connectionId != connectionId) {
+      return; // Stopped, or resumed elsewhere, meanwhile
+    }
+    it->second.base = written;
+    it->second.length = window;
+    credit =
+        WebSocketMessage::credit(streamId, written, window, it->second.handle);
+    sendMessage = it->second.sendMessage;
+  }
+  sendMessage(credit);
+}
+
+void WebSocketMessageHandler::closeCredit(const std::string &streamId) {
+  std::lock_guard<std::mutex> lock(creditMutex_);
+  uploadCredits_.erase(streamId);
+  creditCount_.store(uploadCredits_.size(), std::memory_order_relaxed);
+}
+
+void WebSocketMessageHandler::closeCredits(const std::string &connectionId) {
+  std::lock_guard<std::mutex> lock(creditMutex_);
+  for (auto it = uploadCredits_.begin(); it != uploadCredits_.end();) {
+    if (it->second.connectionId == connectionId) {
+      it = uploadCredits_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  creditCount_.store(uploadCredits_.size(), std::memory_order_relaxed);
+}
+
+std::vector<MetricValue> WebSocketMessageHandler::collectMetrics() const {
+  CacheStats cache = streamManager_->getCacheStats();
+  auto &pool = MemoryPoolManager::getInstance();
+  MemoryPoolManager::Stats poolStats = pool.getStats();
+  MetricsSnapshot snapshot = ServerMetrics::getInstance().snapshot();
+
+  size_t uploading = 0;
+  {
+    std::lock_guard<std::mutex> lock(connectionMutex_);
+    uploading = streamOwners_.size();
+  }
+  size_t ranges = 0;
+  {
+    std::lock_guard<std::mutex> lock(rangeMutex_);
+    for (const auto &entry : rangeStreams_) {
+      ranges += entry.second.ranges.size();
+    }
+  }
+  auto number = [](uint64_t value) { return static_cast<double>(value); };
+
+  return {
+      {"open_connections", "Connections currently open",
+       number(snapshot.counter(Counter::CONNECTIONS_OPENED) -
+              snapshot.counter(Counter::CONNECTIONS_CLOSED))},
+      {"streams", "Streams in the cache", number(cache.streams)},
+      {"ready_streams", "Streams fully uploaded", number(cache.readyStreams)},
+      {"uploading_streams", "Streams bound to an uploading connection",
+       number(uploading)},
+      {"cache_disk_bytes", "Bytes of cache files on disk",
+       number(cache.diskBytes)},
+      {"cache_mapped_bytes", "Bytes of cache files mapped",
+       number(cache.mappedBytes)},
+      {"cache_max_disk_bytes", "Disk budget, 0 if unlimited",
+       number(cache.maxDiskBytes)},
+      {"cache_max_mapped_bytes", "Mapping budget, 0 if unlimited",
+       number(cache.maxMappedBytes)},
+      {"evicted_streams_total", "Streams deleted to stay in the disk budget",
+       number(cache.evictedStreams), true},
+      {"expired_streams_total", "Streams deleted after their TTL",
+       number(cache.expiredStreams), true},
+      {"readahead_hits_total", "Sequential reads already read ahead",
+       number(cache.readaheadHits), true},
+      {"readahead_misses_total", "Sequential reads that outran readahead",
+       number(cache.readaheadMisses), true},
+      {"chunk_cache_bytes", "Bytes held by the chunk cache",
+       number(cache.chunkCacheBytes)},
+      {"chunk_cache_hits_total", "READY reads served by the chunk cache",
+       number(cache.chunkCacheHits), true},
+      {"chunk_cache_misses_total", "READY reads that went to storage",
+       number(cache.chunkCacheMisses), true},
+      {"compressed_streams", "READY streams stored compressed",
+       number(cache.compressedStreams)},
+      {"compression_saved_bytes", "Disk bytes saved by compression",
+       number(cache.compressionSavedBytes)},
+      {"deduplication_saved_bytes", "Disk bytes saved by shared files",
+       number(cache.deduplicationSavedBytes)},
+      {"indexed_blocks", "Distinct stored blocks a HAVE can name",
+       number(cache.indexedBlocks)},
+      {"have_blocks_total", "Upload blocks stored from a HAVE, not sent",
+       number(cache.haveBlocks), true},
+      {"have_bytes_total", "Upload bytes stored from a HAVE, not sent",
+       number(cache.haveBytes), true},
+      {"slab_files", "Slab files holding small streams",
+       number(cache.slabFiles)},
+      {"slab_streams", "Small streams stored in slab files",
+       number(cache.slabStreams)},
+      {"slab_bytes", "Bytes of slab files on disk", number(cache.slabBytes)},
+      {"slab_live_bytes", "Bytes of slab files streams still reference",
+       number(cache.slabLiveBytes)},
+      {"pool_hits_total", "Buffers served from a thread cache",
+       number(poolStats.hits), true},
+      {"pool_misses_total", "Buffers served from the shared free lists",
+       number(poolStats.misses), true},
+      {"pool_exhaustions_total", "Buffers allocated for an empty size class",
+       number(poolStats.exhaustions), true},
+      {"pool_available_buffers", "Buffers on the shared free lists",
+       number(pool.getAvailableBuffers())},
+      {"write_queue_chunks", "Upload chunks waiting for a writer",
+       number(chunkWriter_.getQueuedChunks())},
+      {"write_queue_bytes", "Upload bytes waiting for a writer",
+       number(chunkWriter_.getQueuedBytes())},
+      {"write_queue_streams", "Streams with a write queue",
+       number(chunkWriter_.getStreamCount())},
+      {"cache_full", "1 while new uploads are refused for the disk budget",
+       number(streamManager_->isCacheFull() ? 1 : 0)},
+      {"write_batches_total", "Batches written by the writer threads",
+       number(chunkWriter_.getBatchCount()), true},
+      {"inline_writes_total", "Chunks written on a full queue's I/O thread",
+       number(chunkWriter_.getInlineWriteCount()), true},
+      {"parked_reads", "GETs waiting at a live stream's write head",
+       number(getParkedReadCount())},
+      {"range_streams", "STREAM ranges queued or being pushed",
+       number(ranges)}};
+}
+
+uint32_t WebSocketMessageHandler::associateStreamWithConnection(
     const std::string &connectionId, const std::string &streamId) {
   std::lock_guard<std::mutex> lock(connectionMutex_);
-  connectionStreams_[connectionId] = streamId;
+
+  auto owner = streamOwners_.find(streamId);
+  if (owner != streamOwners_.end()) {
+    if (owner->second.connectionId == connectionId) {
+      // Already here; it becomes the target of untagged frames again
+      connectionStreams_[connectionId].latest = owner->second.handle;
+      return owner->second.handle;
+    }
+
+    // A stream is owned by one connection at a time
+    releaseHandle(owner->second.connectionId, owner->second.handle);
+    streamOwners_.erase(owner);
+  }
+
+  // A connection attached to the stream takes it over from its owner
+  if (uint32_t attached = removeWriter(streamId, connectionId)) {
+    releaseHandle(connectionId, attached);
+  }
+
+  uint32_t handle = addHandle(connectionId, streamId);
+  if (handle != 0) {
+    streamOwners_[streamId] = StreamOwner{connectionId, handle};
+  }
+  return handle;
+}
+
+uint32_t
+WebSocketMessageHandler::attachWriter(const std::string &connectionId,
+                                      const std::string &streamId) {
+  std::lock_guard<std::mutex> lock(connectionMutex_);
+
+  // The owner writes its stream already
+  auto owner = streamOwners_.find(streamId);
+  if (owner != streamOwners_.end() &&
+      owner->second.connectionId == connectionId) {
+    return owner->second.handle;
+  }
+
+  auto &writers = streamWriters_[streamId];
+  for (const StreamOwner &writer : writers) {
+    if (writer.connectionId == connectionId) {
+      return writer.handle;
+    }
+  }
+
+  uint32_t handle = addHandle(connectionId, streamId);
+  if (handle == 0) {
+    if (writers.empty()) {
+      streamWriters_.erase(streamId);
+    }
+    return 0;
+  }
+  connectionStreams_[connectionId].attached.insert(handle);
+  writers.push_back(StreamOwner{connectionId, handle});
+  return handle;
+}
+
+bool WebSocketMessageHandler::detachWriter(const std::string &connectionId,
+                                           const std::string &streamId) {
+  std::lock_guard<std::mutex> lock(connectionMutex_);
+  uint32_t handle = removeWriter(streamId, connectionId);
+  if (handle == 0) {
+    return false;
+  }
+  releaseHandle(connectionId, handle);
+  return true;
+}
+
+uint32_t
+WebSocketMessageHandler::removeWriter(const std::string &streamId,
+                                      const std::string &connectionId) {
+  auto writers = streamWriters_.find(streamId);
+  if (writers == streamWriters_.end()) {
+    return 0;
+  }
+
+  auto &list = writers->second;
+  auto writer =
+      std::find_if(list.begin(), list.end(), [&](const StreamOwner &entry) {
+        return entry.connectionId == connectionId;
+      });
+  if (writer == list.end()) {
+    return 0;
+  }
+  uint32_t handle = writer->handle;
+  list.erase(writer);
+  if (list.empty()) {
+    streamWriters_.erase(writers);
+  }
+  return handle;
+}
+
+bool WebSocketMessageHandler::isAttachedHandle(const std::string &connectionId,
+                                               uint32_t handle) const {
+  std::lock_guard<std::mutex> lock(connectionMutex_);
+  auto streams = connectionStreams_.find(connectionId);
+  if (streams == connectionStreams_.end()) {
+    return false;
+  }
+  return streams->second.attached.count(
+             handle != 0 ? handle : streams->second.latest) != 0;
+}
+
+uint32_t WebSocketMessageHandler::addHandle(const std::string &connectionId,
+                                            const std::string &streamId) {
+  ConnectionStreams &streams = connectionStreams_[connectionId];
+  if (streams.handles.size() >= MAX_STREAMS_PER_CONNECTION) {
+    return 0;
+  }
+
+  // Handles are only reused after the counter wraps
+  uint32_t handle;
+  do {
+    handle = streams.nextHandle++;
+  } while (handle == 0 || streams.handles.count(handle) != 0);
+
+  streams.handles.emplace(handle, streamId);
+  streams.latest = handle;
+  return handle;
+}
+
+void WebSocketMessageHandler::releaseHandle(const std::string &connectionId,
+                                            uint32_t handle) {
+  auto streams = connectionStreams_.find(connectionId);
+  if (streams == connectionStreams_.end()) {
+    return;
+  }
+  streams->second.handles.erase(handle);
+  streams->second.attached.erase(handle);
+  if (streams->second.latest == handle) {
+    streams->second.latest = 0;
+  }
+  if (streams->second.handles.empty()) {
+    connectionStreams_.erase(streams);
+  }
+}
+
+void WebSocketMessageHandler::dropQueueIfUnowned(const std::string &streamId) {
+  std::lock_guard<std::mutex> lock(connectionMutex_);
+  if (streamOwners_.count(streamId) == 0 &&
+      streamWriters_.count(streamId) == 0) {
+    chunkWriter_.removeStream(streamId);
+  }
+}
+
+void WebSocketMessageHandler::disassociateStream(const std::string &streamId) {
+  closeCredit(streamId);
+
+  std::lock_guard<std::mutex> lock(connectionMutex_);
+  auto owner = streamOwners_.find(streamId);
+  if (owner != streamOwners_.end()) {
+    releaseHandle(owner->second.connectionId, owner->second.handle);
+    streamOwners_.erase(owner);
+  }
+
+  // Its attached connections are done with it too
+  auto writers = streamWriters_.find(streamId);
+  if (writers != streamWriters_.end()) {
+    for (const StreamOwner &writer : writers->second) {
+      releaseHandle(writer.connectionId, writer.handle);
+    }
+    streamWriters_.erase(writers);
+  }
 }
 
 void WebSocketMessageHandler::disassociateConnection(
     const std::string &connectionId) {
-  std::lock_guard<std::mutex> lock(connectionMutex_);
-  connectionStreams_.erase(connectionId);
+  closeCredits(connectionId);
+
+  std::vector<std::string> released;
+  {
+    std::lock_guard<std::mutex> lock(connectionMutex_);
+    pendingPuts_.erase(connectionId);
+    auto streams = connectionStreams_.find(connectionId);
+    if (streams == connectionStreams_.end()) {
+      return;
+    }
+    for (const auto &[handle, streamId] : streams->second.handles) {
+      if (streams->second.attached.count(handle) == 0) {
+        streamOwners_.erase(streamId);
+      } else {
+        removeWriter(streamId, connectionId);
+      }
+      released.push_back(streamId);
+    }
+    connectionStreams_.erase(streams);
+  }
+
+  // A dropped upload may be resumed on another connection, which makes a
+  // new queue; its chunks in flight are written first
+  for (const auto &streamId : released) {
+    chunkWriter_.whenWritten(
+        streamId, [this, streamId] { dropQueueIfUnowned(streamId); });
+  }
 }
 
-std::string WebSocketMessageHandler::getStreamForConnection(
-    const std::string &connectionId) const {
+std::string
+WebSocketMessageHandler::getStreamForConnection(const std::string &connectionId,
+                                                uint32_t handle) const {
   std::lock_guard<std::mutex> lock(connectionMutex_);
-  auto it = connectionStreams_.find(connectionId);
-  if (it != connectionStreams_.end()) {
+  auto streams = connectionStreams_.find(connectionId);
+  if (streams == connectionStreams_.end()) {
+    return "";
+  }
+  auto it = streams->second.handles.find(handle != 0 ? handle
+                                                     : streams->second.latest);
+  if (it != streams->second.handles.end()) {
     return it->second;
   }
   return "";
 }
 
+size_t WebSocketMessageHandler::getStreamCountForConnection(
+    const std::string &connectionId) const {
+  std::lock_guard<std::mutex> lock(connectionMutex_);
+  auto streams = connectionStreams_.find(connectionId);
+  return streams == connectionStreams_.end() ? 0
+                                             : streams->second.handles.size();
+}
+
 } // namespace audio_stream
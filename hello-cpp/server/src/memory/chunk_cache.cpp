@@ -0,0 +1,178 @@
+#include "memory/chunk_cache.h"
+#include "memory/memory_pool_manager.h"
+#include <cstring>
+#include <mutex>
+
+namespace audio_stream {
+
+size_t ChunkCache::KeyHash::operator()(const Key &key) const {
+  // Offsets are mostly chunk multiples, so mix every field thoroughly
+  uint64_t h = key.stream * 0x9E3779B97F4A7C15ULL;
+  h ^= key.offset + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+  h ^= key.length + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+  h ^= h >> 31;
+  h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 29;
+  return static_cast<size_t>(h);
+}
+
+ChunkCache::ChunkCache(uint64_t maxBytes)
+    : shardMaxBytes_(maxBytes / SHARD_COUNT) {}
+
+BufferView ChunkCache::find(uint64_t streamKey, uint64_t offset,
+                            size_t length) {
+  if (shardMaxBytes_.load(std::memory_order_relaxed) == 0) {
+    return BufferView(); // Disabled
+  }
+
+  Key key{streamKey, offset, length};
+  Shard &shard = shardFor(key);
+  std::shared_lock<std::shared_mutex> lock(shard.mutex);
+
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    return BufferView();
+  }
+  Entry &entry = *shard.slots[it->second];
+  // Read before writing, so a popular chunk's line is not written per hit
+  if (!entry.referenced.load(std::memory_order_relaxed)) {
+    entry.referenced.store(true, std::memory_order_relaxed);
+  }
+  shard.hits.fetch_add(1, std::memory_order_relaxed);
+  return entry.data;
+}
+
+void ChunkCache::insert(uint64_t streamKey, uint64_t offset, size_t length,
+                        const BufferView &data) {
+  uint64_t maxBytes = shardMaxBytes_.load(std::memory_order_relaxed);
+  if (data.empty() || data.size() > MAX_CHUNK_BYTES ||
+      data.size() > maxBytes) {
+    return;
+  }
+
+  Key key{streamKey, offset, length};
+  Shard &shard = shardFor(key);
+  shard.misses.fetch_add(1, std::memory_order_relaxed);
+  if (!admit(shard, key)) {
+    return;
+  }
+
+  // Copied outside the lock, and never aliasing a mapping, so caching a
+  // chunk does not keep its segment mapped
+  auto buffer = MemoryPoolManager::getInstance().acquire(data.size());
+  std::memcpy(buffer->data(), data.begin(), data.size());
+  std::shared_ptr<PooledBuffer> owner(std::move(buffer));
+  BufferView copy(std::shared_ptr<const uint8_t>(owner, owner->data()),
+                  owner->size());
+
+  std::unique_lock<std::shared_mutex> lock(shard.mutex);
+  if (shard.index.count(key) > 0) {
+    return; // Another reader of the chunk cached it first
+  }
+
+  evictTo(shard, maxBytes - copy.size());
+  size_t slot;
+  if (!shard.freeSlots.empty()) {
+    slot = shard.freeSlots.back();
+    shard.freeSlots.pop_back();
+  } else {
+    slot = shard.slots.size();
+    shard.slots.emplace_back();
+  }
+  auto entry = std::make_unique<Entry>();
+  entry->key = key;
+  entry->data = std::move(copy);
+  shard.bytes += entry->data.size();
+  shard.slots[slot] = std::move(entry);
+  shard.index.emplace(key, slot);
+}
+
+void ChunkCache::erase(uint64_t streamKey) {
+  for (auto &shard : shards_) {
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    for (size_t slot = 0; slot < shard.slots.size(); ++slot) {
+      if (shard.slots[slot] && shard.slots[slot]->key.stream == streamKey) {
+        removeSlot(shard, slot);
+      }
+    }
+  }
+}
+
+void ChunkCache::setMaxBytes(uint64_t maxBytes) {
+  uint64_t shardMaxBytes = maxBytes / SHARD_COUNT;
+  shardMaxBytes_.store(shardMaxBytes, std::memory_order_relaxed);
+  for (auto &shard : shards_) {
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    evictTo(shard, shardMaxBytes);
+  }
+}
+
+uint64_t ChunkCache::getMaxBytes() const {
+  return shardMaxBytes_.load(std::memory_order_relaxed) * SHARD_COUNT;
+}
+
+uint64_t ChunkCache::getBytes() const {
+  uint64_t bytes = 0;
+  for (const auto &shard : shards_) {
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    bytes += shard.bytes;
+  }
+  return bytes;
+}
+
+uint64_t ChunkCache::getHits() const {
+  uint64_t hits = 0;
+  for (const auto &shard : shards_) {
+    hits += shard.hits.load(std::memory_order_relaxed);
+  }
+  return hits;
+}
+
+uint64_t ChunkCache::getMisses() const {
+  uint64_t misses = 0;
+  for (const auto &shard : shards_) {
+    misses += shard.misses.load(std::memory_order_relaxed);
+  }
+  return misses;
+}
+
+ChunkCache::Shard &ChunkCache::shardFor(const Key &key) {
+  return shards_[KeyHash{}(key) % SHARD_COUNT];
+}
+
+bool ChunkCache::admit(Shard &shard, const Key &key) {
+  // The shard takes the low bits of the hash; the slot, the next ones
+  uint64_t hash = KeyHash{}(key) | 1;
+  auto &ghost = shard.ghosts[(hash / SHARD_COUNT) % GHOST_SLOTS];
+  if (ghost.load(std::memory_order_relaxed) == hash) {
+    ghost.store(0, std::memory_order_relaxed);
+    return true;
+  }
+  ghost.store(hash, std::memory_order_relaxed);
+  return false;
+}
+
+void ChunkCache::evictTo(Shard &shard, uint64_t maxBytes) {
+  // One pass clears every reference bit, so this ends within two
+  while (shard.bytes > maxBytes && !shard.index.empty()) {
+    if (shard.hand >= shard.slots.size()) {
+      shard.hand = 0;
+    }
+    auto &entry = shard.slots[shard.hand];
+    if (entry &&
+        !entry->referenced.exchange(false, std::memory_order_relaxed)) {
+      removeSlot(shard, shard.hand);
+    }
+    ++shard.hand;
+  }
+}
+
+void ChunkCache::removeSlot(Shard &shard, size_t slot) {
+  auto &entry = shard.slots[slot];
+  shard.bytes -= entry->data.size();
+  shard.index.erase(entry->key);
+  entry.reset();
+  shard.freeSlots.push_back(slot);
+}
+
+} // namespace audio_stream
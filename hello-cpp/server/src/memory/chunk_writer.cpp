@@ -0,0 +1,252 @@
+#include "memory/chunk_writer.h"
+#include "metrics/server_metrics.h"
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+namespace audio_stream {
+
+ChunkWriter::ChunkWriter(std::shared_ptr<StreamManager> streamManager,
+                         size_t threads)
+    : streamManager_(std::move(streamManager)) {
+  if (threads == 0) {
+    threads = std::min<size_t>(
+        DEFAULT_THREADS, std::max(1u, std::thread::hardware_concurrency()));
+  }
+  threads_.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    threads_.emplace_back([this] { writerLoop(); });
+  }
+  spdlog::debug("ChunkWriter started with {} writer threads", threads);
+}
+
+ChunkWriter::~ChunkWriter() { stop(); }
+
+void ChunkWriter::submit(const std::string &streamId,
+                         std::optional<uint64_t> offset, PooledBufferPtr data,
+                         Callback onFailure) {
+  auto queue = queueFor(streamId);
+  std::lock_guard<std::mutex> lock(queue->producerMutex);
+
+  // Appended chunks go after the ones still queued, not after the write head
+  if (!offset) {
+    if (!queue->appendOffset) {
+      auto stream = streamManager_->getStream(streamId);
+      if (stream) {
+        std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+        queue->appendOffset = stream->currentOffset;
+      }
+    }
+    offset = queue->appendOffset.value_or(0);
+  }
+  queue->appendOffset = *offset + data->size();
+
+  ServerMetrics::getInstance().record(
+      Histogram::WRITE_QUEUE_DEPTH,
+      queue->chunks.pushed() -
+          queue->written.load(std::memory_order_relaxed));
+
+  size_t size = data->size();
+  PendingWrite write{*offset, std::move(data), std::move(onFailure)};
+  if (!stopped_.load(std::memory_order_acquire) &&
+      queue->chunks.push(std::move(write))) {
+    queuedChunks_.fetch_add(1, std::memory_order_relaxed);
+    queuedBytes_.fetch_add(size, std::memory_order_relaxed);
+    // Pairs with the fence in writerLoop: either the writer sees the chunk
+    // or this sees the queue unscheduled
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    schedule(queue);
+    return;
+  }
+
+  // Queue full (or writers stopped): write here
+  inlineWrites_.fetch_add(1, std::memory_order_relaxed);
+  if (!streamManager_->writeChunkAt(streamId, write.offset, write.data->data(),
+                                    write.data->size())) {
+    if (write.onFailure) {
+      write.onFailure();
+    }
+  }
+  if (onWritten_) {
+    onWritten_(streamId);
+  }
+}
+
+void ChunkWriter::whenWritten(const std::string &streamId,
+                              Callback callback) {
+  if (stopped_.load(std::memory_order_acquire)) {
+    callback();
+    return;
+  }
+
+  auto queue = queueFor(streamId);
+  {
+    std::lock_guard<std::mutex> lock(queue->producerMutex);
+    std::lock_guard<std::mutex> barrierLock(queue->barrierMutex);
+    queue->barriers.push_back(
+        Barrier{queue->chunks.pushed(), std::move(callback)});
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  schedule(queue);
+}
+
+void ChunkWriter::resetAppendOffset(const std::string &streamId) {
+  auto queue = queueFor(streamId);
+  std::lock_guard<std::mutex> lock(queue->producerMutex);
+  queue->appendOffset.reset();
+}
+
+void ChunkWriter::removeStream(const std::string &streamId) {
+  // A writer still holding the queue finishes it through its own reference
+  std::unique_lock<std::shared_mutex> lock(queuesMutex_);
+  queues_.erase(streamId);
+}
+
+size_t ChunkWriter::getStreamCount() const {
+  std::shared_lock<std::shared_mutex> lock(queuesMutex_);
+  return queues_.size();
+}
+
+void ChunkWriter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(readyMutex_);
+    stopped_.store(true, std::memory_order_release);
+  }
+  readyCv_.notify_all();
+  for (auto &thread : threads_) {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+  threads_.clear();
+}
+
+std::shared_ptr<ChunkWriter::StreamQueue>
+ChunkWriter::queueFor(const std::string &streamId) {
+  {
+    std::shared_lock<std::shared_mutex> lock(queuesMutex_);
+    auto it = queues_.find(streamId);
+    if (it != queues_.end()) {
+      return it->second;
+    }
+  }
+
+  std::unique_lock<std::shared_mutex> lock(queuesMutex_);
+  auto &queue = queues_[streamId];
+  if (!queue) {
+    queue = std::make_shared<StreamQueue>(streamId);
+  }
+  return queue;
+}
+
+void ChunkWriter::schedule(const std::shared_ptr<StreamQueue> &queue) {
+  if (queue->scheduled.exchange(true)) {
+    return; // A writer has it and rechecks before letting go
+  }
+  {
+    std::lock_guard<std::mutex> lock(readyMutex_);
+    ready_.push_back(queue);
+  }
+  readyCv_.notify_one();
+}
+
+void ChunkWriter::writerLoop() {
+  while (true) {
+    std::shared_ptr<StreamQueue> queue;
+    {
+      std::unique_lock<std::mutex> lock(readyMutex_);
+      readyCv_.wait(lock, [this] {
+        return !ready_.empty() || stopped_.load(std::memory_order_relaxed);
+      });
+      if (ready_.empty()) {
+        return; // Stopping, and everything queued has been written
+      }
+      queue = std::move(ready_.front());
+      ready_.pop_front();
+    }
+
+    drain(*queue);
+
+    // Work added while draining may have found the queue still scheduled
+    queue->scheduled.store(false);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!queue->chunks.empty() || hasDueBarrier(*queue)) {
+      schedule(queue);
+    }
+  }
+}
+
+void ChunkWriter::drain(StreamQueue &queue) {
+  // Barriers set while the queue was idle are due already
+  runDueBarriers(queue);
+
+  // Up to one queue's worth per turn, so busy streams take turns
+  std::vector<PendingWrite> batch;
+  PendingWrite write;
+  for (size_t popped = 0;
+       popped < QUEUE_CAPACITY && queue.chunks.pop(write); ++popped) {
+    queuedChunks_.fetch_sub(1, std::memory_order_relaxed);
+    if (!batch.empty() &&
+        (batch.size() == MAX_BATCH_CHUNKS ||
+         write.offset != batch.back().offset + batch.back().data->size())) {
+      writeBatch(queue, batch);
+      runDueBarriers(queue);
+    }
+    batch.push_back(std::move(write));
+  }
+  writeBatch(queue, batch);
+  runDueBarriers(queue);
+}
+
+void ChunkWriter::writeBatch(StreamQueue &queue,
+                             std::vector<PendingWrite> &batch) {
+  if (batch.empty()) {
+    return;
+  }
+
+  std::vector<StorageBackend::WriteOperation> operations;
+  operations.reserve(batch.size());
+  uint64_t bytes = 0;
+  for (const PendingWrite &write : batch) {
+    operations.push_back(StorageBackend::WriteOperation{
+        write.offset, write.data->data(), write.data->size()});
+    bytes += write.data->size();
+  }
+
+  if (!streamManager_->writeBatch(queue.streamId, operations)) {
+    // Reported once per batch rather than once per chunk
+    if (batch.back().onFailure) {
+      batch.back().onFailure();
+    }
+  }
+  batches_.fetch_add(1, std::memory_order_relaxed);
+  queuedBytes_.fetch_sub(bytes, std::memory_order_relaxed);
+  queue.written += batch.size();
+  batch.clear(); // Buffers go back to the pool
+
+  if (onWritten_) {
+    onWritten_(queue.streamId);
+  }
+}
+
+bool ChunkWriter::hasDueBarrier(StreamQueue &queue) {
+  std::lock_guard<std::mutex> lock(queue.barrierMutex);
+  return !queue.barriers.empty() &&
+         queue.barriers.front().sequence <= queue.written;
+}
+
+void ChunkWriter::runDueBarriers(StreamQueue &queue) {
+  std::vector<Callback> due;
+  {
+    std::lock_guard<std::mutex> lock(queue.barrierMutex);
+    while (!queue.barriers.empty() &&
+           queue.barriers.front().sequence <= queue.written) {
+      due.push_back(std::move(queue.barriers.front().callback));
+      queue.barriers.pop_front();
+    }
+  }
+  for (const Callback &callback : due) {
+    callback();
+  }
+}
+
+} // namespace audio_stream
@@ -0,0 +1,444 @@
+#include "memory/compressed_storage.h"
+
+#ifdef AUDIO_STREAM_HAVE_COMPRESSED_STORAGE
+
+#include "crc32c.h"
+#include "memory/memory_pool_manager.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace audio_stream {
+
+namespace {
+
+constexpr uint32_t MAGIC = 0x5A435341; // "ASCZ" read little-endian
+
+void putLe(uint8_t *out, uint64_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) {
+    out[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+uint64_t getLe(const uint8_t *in, size_t bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) {
+    value |= static_cast<uint64_t>(in[i]) << (8 * i);
+  }
+  return value;
+}
+
+bool writeAt(int fd, const uint8_t *data, size_t size, uint64_t offset) {
+  while (size > 0) {
+    ssize_t written = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+    offset += static_cast<uint64_t>(written);
+  }
+  return true;
+}
+
+bool readAt(int fd, uint8_t *dest, size_t size, uint64_t offset) {
+  while (size > 0) {
+    ssize_t bytesRead = ::pread(fd, dest, size, static_cast<off_t>(offset));
+    if (bytesRead < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytesRead <= 0) {
+      return false; // Error, or the file is shorter than its index says
+    }
+    dest += bytesRead;
+    size -= static_cast<size_t>(bytesRead);
+    offset += static_cast<uint64_t>(bytesRead);
+  }
+  return true;
+}
+
+} // namespace
+
+CompressedStorage::CompressedStorage(const std::string &filePath)
+    : filePath_(filePath) {}
+
+CompressedStorage::~CompressedStorage() { close(); }
+
+uint64_t CompressedStorage::compress(StorageBackend &source, uint64_t size,
+                                     uint32_t checksum,
+                                     const std::string &path,
+                                     CompressionCodec codec,
+                                     unsigned pcm16Channels) {
+  uint64_t blockCount = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  if (size == 0 || codec == CompressionCodec::NONE ||
+      !isCodecAvailable(codec) || blockCount > UINT32_MAX) {
+    return 0;
+  }
+
+  std::string tempPath = path + ".tmp";
+  int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+  if (fd < 0) {
+    spdlog::error("Failed to create compressed cache file {}: {}", tempPath,
+                  strerror(errno));
+    return 0;
+  }
+
+  // Blocks first, then the index and header in front of them
+  std::vector<uint8_t> index(static_cast<size_t>(blockCount) *
+                             INDEX_ENTRY_SIZE);
+  uint64_t fileOffset = HEADER_SIZE + index.size();
+  uint32_t crc = 0;
+  std::vector<uint8_t> compressed;
+  bool written = true;
+  for (uint64_t block = 0; block < blockCount && written; ++block) {
+    uint64_t offset = block * BLOCK_SIZE;
+    size_t length =
+        static_cast<size_t>(std::min<uint64_t>(BLOCK_SIZE, size - offset));
+    BufferView view = source.readView(offset, length);
+    if (view.size() != length) {
+      spdlog::error("Failed to read {} at offset {} for compression",
+                    source.getFilePath(), offset);
+      written = false;
+      break;
+    }
+
+    uint32_t blockCrc = crc32c::extend(0, view.begin(), length);
+    crc = crc32c::combine(crc, blockCrc, length);
+    const uint8_t *stored = view.begin();
+    size_t storedBytes = length;
+    if (compressBlock(codec, view.begin(), length, compressed,
+                      pcm16Channels)) {
+      stored = compressed.data();
+      storedBytes = compressed.size();
+    }
+    written = writeAt(fd, stored, storedBytes, fileOffset);
+
+    uint8_t *entry = index.data() + block * INDEX_ENTRY_SIZE;
+    putLe(entry, fileOffset, 8);
+    putLe(entry + 8, storedBytes, 4);
+    putLe(entry + 12, blockCrc, 4);
+    fileOffset += storedBytes;
+  }
+
+  bool keep = written;
+  if (keep && crc != checksum) {
+    spdlog::warn("Cache file {} does not match its CRC32C {}, not "
+                 "compressing it",
+                 source.getFilePath(), crc32c::toHex(checksum));
+    keep = false;
+  }
+  if (keep && fileOffset > size - size / 8) {
+    spdlog::debug("{} compresses to {} of {} bytes, keeping it as it is",
+                  source.getFilePath(), fileOffset, size);
+    keep = false;
+  }
+
+  if (keep) {
+    uint8_t header[HEADER_SIZE] = {};
+    putLe(header, MAGIC, 4);
+    putLe(header + 4, FORMAT_VERSION, 1);
+    putLe(header + 5, static_cast<uint8_t>(codec), 1);
+    putLe(header + 6, pcm16Channels, 1);
+    putLe(header + 8, BLOCK_SIZE, 4);
+    putLe(header + 12, blockCount, 4);
+    putLe(header + 16, size, 8);
+    putLe(header + 24, crc32c::extend(0, index.data(), index.size()), 4);
+    putLe(header + 28, crc32c::extend(0, header, 28), 4);
+    keep = writeAt(fd, index.data(), index.size(), HEADER_SIZE) &&
+           writeAt(fd, header, HEADER_SIZE, 0) && ::fsync(fd) == 0;
+    if (!keep) {
+      spdlog::error("Failed to write compressed cache file {}: {}", tempPath,
+                    strerror(errno));
+    }
+  }
+  ::close(fd);
+
+  if (keep && ::rename(tempPath.c_str(), path.c_str()) != 0) {
+    spdlog::error("Failed to rename {} to {}: {}", tempPath, path,
+                  strerror(errno));
+    keep = false;
+  }
+  if (!keep) {
+    ::unlink(tempPath.c_str());
+    return 0;
+  }
+  return fileOffset;
+}
+
+bool CompressedStorage::create(uint64_t) {
+  logError("create", "Compressed cache files are read-only");
+  return false;
+}
+
+bool CompressedStorage::open() {
+  std::lock_guard<std::mutex> lock(stateMutex_);
+  if (open_.load(std::memory_order_relaxed)) {
+    return true;
+  }
+
+  int fd = ::open(filePath_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    logError("open", std::string("Failed to open file: ") + strerror(errno));
+    return false;
+  }
+  auto fail = [&](const std::string &error) {
+    ::close(fd);
+    logError("open", error);
+    return false;
+  };
+
+  struct stat st;
+  uint8_t header[HEADER_SIZE];
+  if (::fstat(fd, &st) != 0 || !readAt(fd, header, HEADER_SIZE, 0)) {
+    return fail("Failed to read header");
+  }
+  if (getLe(header, 4) != MAGIC || header[4] != FORMAT_VERSION ||
+      getLe(header + 28, 4) != crc32c::extend(0, header, 28)) {
+    return fail("Not a compressed cache file of this version");
+  }
+
+  auto codec = static_cast<CompressionCodec>(header[5]);
+  unsigned channels = header[6];
+  auto blockSize = static_cast<size_t>(getLe(header + 8, 4));
+  uint64_t blockCount = getLe(header + 12, 4);
+  uint64_t size = getLe(header + 16, 8);
+  if (!isCodecAvailable(codec)) {
+    return fail("Compressed with " + compressionCodecToString(codec) +
+                ", which this build does not have");
+  }
+  if (channels > MAX_PCM16_CHANNELS || blockSize == 0 ||
+      blockSize > MemoryPoolManager::MAX_BUFFER_SIZE ||
+      blockCount != (size + blockSize - 1) / blockSize) {
+    return fail("Invalid header");
+  }
+
+  auto fileLength = static_cast<uint64_t>(st.st_size);
+  std::vector<uint8_t> index(static_cast<size_t>(blockCount) *
+                             INDEX_ENTRY_SIZE);
+  if (HEADER_SIZE + index.size() > fileLength ||
+      !readAt(fd, index.data(), index.size(), HEADER_SIZE) ||
+      getLe(header + 24, 4) != crc32c::extend(0, index.data(), index.size())) {
+    return fail("Invalid block index");
+  }
+
+  std::vector<Block> blocks(static_cast<size_t>(blockCount));
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    const uint8_t *entry = index.data() + i * INDEX_ENTRY_SIZE;
+    Block &block = blocks[i];
+    block.fileOffset = getLe(entry, 8);
+    block.storedBytes = static_cast<uint32_t>(getLe(entry + 8, 4));
+    block.crc = static_cast<uint32_t>(getLe(entry + 12, 4));
+    uint64_t length = std::min<uint64_t>(blockSize, size - i * blockSize);
+    if (block.storedBytes > length || block.fileOffset > fileLength ||
+        block.storedBytes > fileLength - block.fileOffset) {
+      return fail("Block " + std::to_string(i) + " lies outside the file");
+    }
+  }
+
+  fd_ = fd;
+  codec_ = codec;
+  pcm16Channels_ = channels;
+  blockSize_ = blockSize;
+  blocks_ = std::move(blocks);
+  size_ = size;
+  fileLength_ = fileLength;
+  open_.store(true, std::memory_order_release);
+  spdlog::debug("Opened compressed cache file: {} ({} of {} bytes, {})",
+                filePath_, fileLength, size, compressionCodecToString(codec));
+  return true;
+}
+
+void CompressedStorage::close() {
+  std::lock_guard<std::mutex> lock(stateMutex_);
+  if (!open_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  open_.store(false, std::memory_order_seq_cst);
+  readers_.synchronize();
+  ::close(fd_);
+  fd_ = -1;
+  blocks_.clear();
+  spdlog::debug("Closed compressed cache file: {}", filePath_);
+}
+
+size_t CompressedStorage::write(uint64_t, const uint8_t *, size_t) {
+  logError("write", "Compressed cache files are read-only");
+  return 0;
+}
+
+std::vector<size_t> CompressedStorage::writeBatch(
+    const std::vector<WriteOperation> &operations) {
+  logError("writeBatch", "Compressed cache files are read-only");
+  return std::vector<size_t>(operations.size(), 0);
+}
+
+bool CompressedStorage::finalize(uint64_t, bool) {
+  logError("finalize", "Compressed cache files are read-only");
+  return false;
+}
+
+std::vector<uint8_t> CompressedStorage::read(uint64_t offset, size_t length) {
+  BufferView view = readView(offset, length);
+  return std::vector<uint8_t>(view.begin(), view.end());
+}
+
+BufferView CompressedStorage::readView(uint64_t offset, size_t length) {
+  {
+    auto guard = readers_.enter();
+    if (open_.load(std::memory_order_seq_cst)) {
+      return readOpen(offset, length);
+    }
+  }
+  if (!open()) {
+    return BufferView();
+  }
+  auto guard = readers_.enter();
+  return open_.load(std::memory_order_seq_cst) ? readOpen(offset, length)
+                                               : BufferView();
+}
+
+BufferView CompressedStorage::tryReadView(uint64_t offset, size_t length) {
+  auto guard = readers_.enter();
+  if (!open_.load(std::memory_order_seq_cst)) {
+    return BufferView();
+  }
+  return readOpen(offset, length);
+}
+
+BufferView CompressedStorage::readOpen(uint64_t offset, size_t length) {
+  uint64_t size = size_.load(std::memory_order_relaxed);
+  if (offset >= size || length == 0) {
+    return BufferView();
+  }
+  length = static_cast<size_t>(std::min<uint64_t>(length, size - offset));
+  size_t first = static_cast<size_t>(offset / blockSize_);
+  size_t last = static_cast<size_t>((offset + length - 1) / blockSize_);
+  auto &pool = MemoryPoolManager::getInstance();
+
+  // Within one block: the view aliases the decompressed block
+  if (first == last) {
+    size_t blockBytes = blockLength(first);
+    auto buffer = pool.acquire(blockBytes);
+    if (!decodeBlock(first, buffer->data())) {
+      return BufferView();
+    }
+    buffer->resize(blockBytes);
+    std::shared_ptr<PooledBuffer> owner(std::move(buffer));
+    return BufferView(
+        std::shared_ptr<const uint8_t>(
+            owner, owner->data() + (offset - uint64_t(first) * blockSize_)),
+        length);
+  }
+
+  // Blocks the range covers whole decompress straight into the result
+  auto buffer = pool.acquire(length);
+  PooledBufferPtr partial;
+  for (size_t block = first; block <= last; ++block) {
+    uint64_t blockStart = uint64_t(block) * blockSize_;
+    uint64_t blockEnd = blockStart + blockLength(block);
+    uint64_t from = std::max(offset, blockStart);
+    uint64_t to = std::min(offset + length, blockEnd);
+    uint8_t *dest = buffer->data() + (from - offset);
+    if (from == blockStart && to == blockEnd) {
+      if (!decodeBlock(block, dest)) {
+        return BufferView();
+      }
+      continue;
+    }
+    if (!partial) {
+      partial = pool.acquire(blockSize_);
+    }
+    if (!decodeBlock(block, partial->data())) {
+      return BufferView();
+    }
+    std::memcpy(dest, partial->data() + (from - blockStart), to - from);
+  }
+  buffer->resize(length);
+  std::shared_ptr<PooledBuffer> owner(std::move(buffer));
+  return BufferView(std::shared_ptr<const uint8_t>(owner, owner->data()),
+                    length);
+}
+
+bool CompressedStorage::decodeBlock(size_t index, uint8_t *dest) {
+  const Block &block = blocks_[index];
+  size_t length = blockLength(index);
+  bool decoded;
+  if (block.storedBytes == length) {
+    decoded = readAt(fd_, dest, length, block.fileOffset);
+  } else {
+    thread_local std::vector<uint8_t> stored;
+    stored.resize(block.storedBytes);
+    decoded = readAt(fd_, stored.data(), stored.size(), block.fileOffset) &&
+              decompressBlock(codec_, stored.data(), stored.size(), dest,
+                              length, pcm16Channels_);
+  }
+  if (!decoded || crc32c::extend(0, dest, length) != block.crc) {
+    logError("read", "Block " + std::to_string(index) +
+                         " is unreadable or corrupt");
+    return false;
+  }
+  return true;
+}
+
+size_t CompressedStorage::blockLength(size_t index) const {
+  uint64_t start = uint64_t(index) * blockSize_;
+  return static_cast<size_t>(
+      std::min<uint64_t>(blockSize_, size_.load(std::memory_order_relaxed) -
+                                         start));
+}
+
+bool CompressedStorage::prefetch(uint64_t offset, size_t length) {
+  auto guard = readers_.enter();
+  if (!open_.load(std::memory_order_seq_cst)) {
+    return false;
+  }
+  uint64_t size = size_.load(std::memory_order_relaxed);
+  if (offset >= size || length == 0) {
+    return true;
+  }
+#ifdef POSIX_FADV_WILLNEED
+  // The stored bytes of the blocks covering the range
+  const Block &first = blocks_[static_cast<size_t>(offset / blockSize_)];
+  const Block &last = blocks_[static_cast<size_t>(
+      (std::min<uint64_t>(offset + length, size) - 1) / blockSize_)];
+  uint64_t end = last.fileOffset + last.storedBytes;
+  return ::posix_fadvise(fd_, static_cast<off_t>(first.fileOffset),
+                         static_cast<off_t>(end - first.fileOffset),
+                         POSIX_FADV_WILLNEED) == 0;
+#else
+  return true;
+#endif
+}
+
+bool CompressedStorage::adviseSequential([[maybe_unused]] bool sequential) {
+  auto guard = readers_.enter();
+  if (!open_.load(std::memory_order_seq_cst)) {
+    return false;
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  return ::posix_fadvise(fd_, 0, 0,
+                         sequential ? POSIX_FADV_SEQUENTIAL
+                                    : POSIX_FADV_NORMAL) == 0;
+#else
+  return true;
+#endif
+}
+
+void CompressedStorage::logError(const std::string &operation,
+                                 const std::string &error) const {
+  spdlog::error("Error in {} operation for file {}: {}", operation, filePath_,
+                error);
+}
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_HAVE_COMPRESSED_STORAGE
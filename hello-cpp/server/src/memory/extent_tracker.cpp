@@ -0,0 +1,99 @@
+#include "memory/extent_tracker.h"
+#include "crc32c.h"
+#include <algorithm>
+
+namespace audio_stream {
+
+void ExtentTracker::add(uint64_t offset, uint64_t length, uint32_t crc) {
+  if (length == 0) {
+    return;
+  }
+
+  uint64_t begin = offset;
+  Extent merged{offset + length, crc, true};
+
+  // Start at the last extent beginning at or before the write, which may
+  // reach into it or end right where it starts
+  auto it = extents_.upper_bound(begin);
+  if (it != extents_.begin() && std::prev(it)->second.end >= begin) {
+    --it;
+  }
+
+  // Absorb every extent the write touches or overlaps, in offset order
+  while (it != extents_.end() && it->first <= merged.end) {
+    uint64_t extentBegin = it->first;
+    const Extent &extent = it->second;
+    if (extent.end == begin) {
+      // Ends where the write starts
+      merged.crc = crc32c::combine(extent.crc, merged.crc, merged.end - begin);
+      merged.crcKnown = merged.crcKnown && extent.crcKnown;
+      begin = extentBegin;
+    } else if (extentBegin == merged.end) {
+      // Starts where the write ends
+      merged.crc = crc32c::combine(merged.crc, extent.crc,
+                                   extent.end - extentBegin);
+      merged.crcKnown = merged.crcKnown && extent.crcKnown;
+      merged.end = extent.end;
+    } else {
+      // Overlap: the bytes it held were replaced, so its CRC no longer
+      // describes them
+      merged.crcKnown = false;
+      begin = std::min(begin, extentBegin);
+      merged.end = std::max(merged.end, extent.end);
+    }
+    filledBytes_ -= extent.end - extentBegin;
+    it = extents_.erase(it);
+  }
+
+  filledBytes_ += merged.end - begin;
+  extents_.emplace(begin, merged);
+}
+
+void ExtentTracker::assign(uint64_t length, uint32_t crc) {
+  extents_.clear();
+  filledBytes_ = length;
+  if (length > 0) {
+    extents_.emplace(0, Extent{length, crc, true});
+  }
+}
+
+void ExtentTracker::clear() {
+  extents_.clear();
+  filledBytes_ = 0;
+}
+
+uint64_t ExtentTracker::filledEnd(uint64_t offset) const {
+  auto it = extents_.upper_bound(offset);
+  if (it == extents_.begin()) {
+    return offset;
+  }
+  --it;
+  return std::max(offset, it->second.end);
+}
+
+uint64_t ExtentTracker::end() const {
+  return extents_.empty() ? 0 : extents_.rbegin()->second.end;
+}
+
+std::pair<uint64_t, uint64_t> ExtentTracker::firstGap(uint64_t size) const {
+  uint64_t gapBegin = filledEnd(0);
+  if (gapBegin >= size) {
+    return {size, size};
+  }
+  auto next = extents_.upper_bound(gapBegin);
+  uint64_t gapEnd = next == extents_.end() ? size : next->first;
+  return {gapBegin, std::min(gapEnd, size)};
+}
+
+std::optional<uint32_t> ExtentTracker::prefixChecksum() const {
+  auto first = extents_.begin();
+  if (first == extents_.end() || first->first != 0) {
+    return 0; // CRC32C of no bytes
+  }
+  if (!first->second.crcKnown) {
+    return std::nullopt;
+  }
+  return first->second.crc;
+}
+
+} // namespace audio_stream
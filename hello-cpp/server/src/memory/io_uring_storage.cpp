@@ -0,0 +1,904 @@
+#include "memory/io_uring_storage.h"
+
+#ifdef AUDIO_STREAM_HAVE_IO_URING
+
+#include "memory/memory_pool_manager.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace audio_stream {
+
+namespace {
+
+// io_uring lengths are 32-bit; larger transfers are split
+constexpr size_t MAX_REQUEST_BYTES = 1ULL << 30;
+
+uint64_t alignDown(uint64_t value) {
+  return value & ~(uint64_t(IoUringStorage::DIRECT_IO_ALIGNMENT) - 1);
+}
+
+uint64_t alignUp(uint64_t value) {
+  return alignDown(value + IoUringStorage::DIRECT_IO_ALIGNMENT - 1);
+}
+
+void raiseTo(std::atomic<uint64_t> &value, uint64_t target) {
+  uint64_t current = value.load(std::memory_order_relaxed);
+  while (current < target && !value.compare_exchange_weak(current, target)) {
+  }
+}
+
+struct Request {
+  uint8_t opcode; // IORING_OP_READ/WRITE, or the _FIXED variants
+  int fd;
+  uint8_t *buffer;
+  size_t length;
+  uint64_t offset;
+  int fixedIndex = -1;  // Registered buffer, for the _FIXED opcodes
+  int64_t result = 0;   // Bytes transferred, or -errno
+};
+
+bool isWrite(uint8_t opcode) {
+  return opcode == IORING_OP_WRITE || opcode == IORING_OP_WRITE_FIXED;
+}
+
+/**
+ * One submission/completion ring, used only by the thread that set it up.
+ * Speaks the raw io_uring syscalls, so the server needs no liburing.
+ */
+class Ring {
+public:
+  // The calling thread's ring; nullptr if the kernel refuses io_uring
+  static Ring *local() {
+    thread_local std::unique_ptr<Ring> ring;
+    thread_local bool failed = false;
+    if (!ring && !failed) {
+      std::unique_ptr<Ring> created(new Ring());
+      if (created->setup(IoUringStorage::RING_ENTRIES)) {
+        ring = std::move(created);
+      } else {
+        failed = true;
+      }
+    }
+    return ring.get();
+  }
+
+  ~Ring() {
+    if (sqes_ != MAP_FAILED) {
+      munmap(sqes_, sqesSize_);
+    }
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+      munmap(cqRing_, cqRingSize_);
+    }
+    if (sqRing_ != MAP_FAILED) {
+      munmap(sqRing_, sqRingSize_);
+    }
+    if (fd_ >= 0) {
+      ::close(fd_); // Also unregisters the buffers
+    }
+  }
+
+  /**
+   * Submit the requests, as many per io_uring_enter as the ring holds, and
+   * wait for all of them. Short transfers are resubmitted for the rest.
+   * @return false if the ring itself failed; results are then unreliable
+   */
+  bool run(std::vector<Request> &requests) {
+    if (broken_) {
+      return false;
+    }
+    std::vector<size_t> done(requests.size(), 0);
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < requests.size(); ++i) {
+      pending.push_back(i);
+    }
+
+    std::vector<int64_t> results;
+    while (!pending.empty()) {
+      size_t count = std::min<size_t>(pending.size(), sqEntries_);
+      if (!submitAndWait(requests, done, pending, count, results)) {
+        // Completions may still arrive; never reuse the ring
+        broken_ = true;
+        return false;
+      }
+
+      std::vector<size_t> again;
+      for (size_t k = 0; k < count; ++k) {
+        size_t i = pending[k];
+        int64_t res = results[k];
+        if (res == -EINTR || res == -EAGAIN) {
+          again.push_back(i);
+        } else if (res < 0) {
+          requests[i].result = res;
+        } else {
+          done[i] += static_cast<size_t>(res);
+          // 0 is end of file for a read
+          if (res > 0 && done[i] < requests[i].length) {
+            again.push_back(i);
+          } else {
+            requests[i].result = static_cast<int64_t>(done[i]);
+          }
+        }
+      }
+      again.insert(again.end(), pending.begin() + count, pending.end());
+      pending = std::move(again);
+    }
+    return true;
+  }
+
+  /**
+   * Block-aligned buffers of FIXED_BUFFER_SIZE bytes from the pool,
+   * registered with the ring on first use. If registration is refused
+   * (RLIMIT_MEMLOCK) they are still used, with the unregistered opcodes.
+   */
+  uint8_t *fixedBuffer(size_t index) {
+    if (fixed_.empty()) {
+      std::vector<iovec> iovecs;
+      for (size_t i = 0; i < IoUringStorage::FIXED_BUFFERS; ++i) {
+        fixed_.push_back(MemoryPoolManager::getInstance().acquire(
+            IoUringStorage::FIXED_BUFFER_SIZE));
+        iovecs.push_back(
+            iovec{fixed_.back()->data(), IoUringStorage::FIXED_BUFFER_SIZE});
+      }
+      registered_ =
+          syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS,
+                  iovecs.data(), static_cast<unsigned>(iovecs.size())) == 0;
+      if (!registered_) {
+        spdlog::debug("io_uring buffer registration refused: {}",
+                      strerror(errno));
+      }
+    }
+    return fixed_[index]->data();
+  }
+
+  bool buffersRegistered() const { return registered_; }
+
+private:
+  Ring() = default;
+
+  bool setup(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0) {
+      spdlog::debug("io_uring_setup failed: {}", strerror(errno));
+      return false;
+    }
+
+    sqEntries_ = params.sq_entries;
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap) {
+      sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+      return false;
+    }
+    cqRing_ = singleMap ? sqRing_
+                        : mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd_,
+                               IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED) {
+      return false;
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+      return false;
+    }
+
+    auto *sq = static_cast<uint8_t *>(sqRing_);
+    auto *cq = static_cast<uint8_t *>(cqRing_);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  // Queue pending[0..count) and wait for their completions
+  bool submitAndWait(const std::vector<Request> &requests,
+                     const std::vector<size_t> &done,
+                     const std::vector<size_t> &pending, size_t count,
+                     std::vector<int64_t> &results) {
+    auto *sqes = static_cast<io_uring_sqe *>(sqes_);
+    unsigned tail = *sqTail_; // Only this thread writes it
+    for (size_t k = 0; k < count; ++k) {
+      const Request &request = requests[pending[k]];
+      size_t offset = done[pending[k]];
+      unsigned slot = tail & sqMask_;
+      io_uring_sqe &sqe = sqes[slot];
+      std::memset(&sqe, 0, sizeof(sqe));
+      sqe.opcode = request.opcode;
+      sqe.fd = request.fd;
+      sqe.addr = reinterpret_cast<uint64_t>(request.buffer + offset);
+      sqe.len = static_cast<uint32_t>(request.length - offset);
+      sqe.off = request.offset + offset;
+      if (request.fixedIndex >= 0) {
+        sqe.buf_index = static_cast<uint16_t>(request.fixedIndex);
+      }
+      sqe.user_data = k;
+      sqArray_[slot] = slot;
+      ++tail;
+    }
+    __atomic_store_n(sqTail_, tail, __ATOMIC_RELEASE);
+
+    results.assign(count, 0);
+    unsigned toSubmit = static_cast<unsigned>(count);
+    size_t completed = 0;
+    while (completed < count) {
+      long ret = syscall(__NR_io_uring_enter, fd_, toSubmit, 1,
+                         IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        spdlog::error("io_uring_enter failed: {}", strerror(errno));
+        return false;
+      }
+      if (ret > 0) {
+        toSubmit -= static_cast<unsigned>(ret);
+      }
+
+      unsigned head = *cqHead_;
+      unsigned available = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+      for (; head != available; ++head) {
+        const io_uring_cqe &cqe = cqes_[head & cqMask_];
+        results[cqe.user_data] = cqe.res;
+        ++completed;
+      }
+      __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    }
+    return true;
+  }
+
+  int fd_ = -1;
+  unsigned sqEntries_ = 0;
+  void *sqRing_ = MAP_FAILED;
+  void *cqRing_ = MAP_FAILED;
+  void *sqes_ = MAP_FAILED;
+  size_t sqRingSize_ = 0;
+  size_t cqRingSize_ = 0;
+  size_t sqesSize_ = 0;
+  unsigned *sqTail_ = nullptr;
+  unsigned sqMask_ = 0;
+  unsigned *sqArray_ = nullptr;
+  unsigned *cqHead_ = nullptr;
+  unsigned *cqTail_ = nullptr;
+  unsigned cqMask_ = 0;
+  io_uring_cqe *cqes_ = nullptr;
+
+  std::vector<PooledBufferPtr> fixed_;
+  bool registered_ = false;
+  bool broken_ = false;
+};
+
+// Run on this thread's ring, or with pread/pwrite if it has none
+void execute(std::vector<Request> &requests) {
+  Ring *ring = Ring::local();
+  if (ring && ring->run(requests)) {
+    return;
+  }
+
+  // Requests are positioned, so any the ring did complete can be redone
+  for (Request &request : requests) {
+    size_t done = 0;
+    while (done < request.length) {
+      ssize_t ret =
+          isWrite(request.opcode)
+              ? ::pwrite(request.fd, request.buffer + done,
+                         request.length - done, request.offset + done)
+              : ::pread(request.fd, request.buffer + done,
+                        request.length - done, request.offset + done);
+      if (ret < 0 && errno == EINTR) {
+        continue;
+      }
+      if (ret <= 0) {
+        break;
+      }
+      done += static_cast<size_t>(ret);
+    }
+    request.result = static_cast<int64_t>(done);
+  }
+}
+
+/**
+ * Aligned buffers for direct I/O: the ring's registered ones, or pooled
+ * buffers when this thread has no ring.
+ */
+class BounceBuffers {
+public:
+  BounceBuffers() : ring_(Ring::local()) {
+    if (!ring_) {
+      for (size_t i = 0; i < IoUringStorage::FIXED_BUFFERS; ++i) {
+        own_.push_back(MemoryPoolManager::getInstance().acquire(
+            IoUringStorage::FIXED_BUFFER_SIZE));
+      }
+    }
+  }
+
+  uint8_t *get(size_t index) {
+    return ring_ ? ring_->fixedBuffer(index) : own_[index]->data();
+  }
+
+  Request request(bool write, int fd, size_t index, size_t length,
+                  uint64_t offset) {
+    Request request{write ? uint8_t(IORING_OP_WRITE) : uint8_t(IORING_OP_READ),
+                    fd, get(index), length, offset};
+    if (ring_ && ring_->buffersRegistered()) {
+      request.opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+      request.fixedIndex = static_cast<int>(index);
+    }
+    return request;
+  }
+
+private:
+  Ring *ring_;
+  std::vector<PooledBufferPtr> own_;
+};
+
+} // namespace
+
+IoUringStorage::IoUringStorage(const std::string &filePath, bool directIo)
+    : filePath_(filePath), directIo_(directIo) {
+  spdlog::debug("IoUringStorage created for: {}{}", filePath,
+                directIo ? " (O_DIRECT)" : "");
+}
+
+IoUringStorage::~IoUringStorage() { close(); }
+
+bool IoUringStorage::isSupported() {
+  static const bool supported = [] {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, 1, &params));
+    if (fd < 0) {
+      return false;
+    }
+    ::close(fd);
+    return true;
+  }();
+  return supported;
+}
+
+bool IoUringStorage::create(uint64_t initialSize) {
+  std::unique_lock<std::shared_mutex> lock(stateMutex_);
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  return openFile(true, initialSize);
+}
+
+bool IoUringStorage::open() {
+  std::unique_lock<std::shared_mutex> lock(stateMutex_);
+  return openFile(false, 0);
+}
+
+void IoUringStorage::close() {
+  std::unique_lock<std::shared_mutex> lock(stateMutex_);
+  if (fd_ < 0) {
+    return;
+  }
+
+  // Direct writes pad the last block; give the padding back
+  if (fileLength_ > fileSize_ && ::ftruncate(fd_, fileSize_) == 0) {
+    fileLength_ = fileSize_.load();
+  }
+  ::close(fd_);
+  fd_ = -1;
+  spdlog::debug("Closed io_uring file: {}", filePath_);
+}
+
+bool IoUringStorage::openFile(bool create, uint64_t initialSize) {
+  // Caller holds stateMutex_ exclusively
+  if (fd_ >= 0) {
+    return true;
+  }
+
+  int flags = O_RDWR | O_CLOEXEC | O_CREAT | (create ? O_TRUNC : 0);
+  int fd = -1;
+  if (directIo_) {
+    fd = ::open(filePath_.c_str(), flags | O_DIRECT, 0644);
+    if (fd < 0 && errno == EINVAL) {
+      spdlog::warn("O_DIRECT is not supported for {}, using buffered I/O",
+                   filePath_);
+      directIo_ = false;
+    }
+  }
+  if (!directIo_) {
+    fd = ::open(filePath_.c_str(), flags, 0644);
+  }
+  if (fd < 0) {
+    logError(create ? "create" : "open",
+             std::string("Failed to open file: ") + strerror(errno));
+    return false;
+  }
+
+  if (create && initialSize > 0 &&
+      ::ftruncate(fd, static_cast<off_t>(initialSize)) != 0) {
+    logError("create",
+             std::string("Failed to set file length: ") + strerror(errno));
+    ::close(fd);
+    return false;
+  }
+
+  struct stat st;
+  uint64_t size = ::fstat(fd, &st) == 0 ? static_cast<uint64_t>(st.st_size)
+                                        : initialSize;
+  fileSize_ = size;
+  fileLength_ = size;
+  fd_ = fd;
+  spdlog::debug("Opened io_uring file: {} with size: {}", filePath_, size);
+  return true;
+}
+
+bool IoUringStorage::ensureOpen(std::shared_lock<std::shared_mutex> &lock,
+                                bool create) {
+  if (fd_ >= 0) {
+    return true;
+  }
+  lock.unlock();
+  {
+    std::unique_lock<std::shared_mutex> exclusive(stateMutex_);
+    // Reads only open files that exist; writes create them
+    if (fd_ < 0 && !create && ::access(filePath_.c_str(), F_OK) != 0) {
+      return false;
+    }
+    if (!openFile(false, 0)) {
+      return false;
+    }
+  }
+  lock.lock();
+  return fd_ >= 0;
+}
+
+size_t IoUringStorage::write(uint64_t offset, const uint8_t *data,
+                             size_t size) {
+  return writeBatch({WriteOperation{offset, data, size}})[0];
+}
+
+std::vector<size_t>
+IoUringStorage::writeBatch(const std::vector<WriteOperation> &operations) {
+  std::shared_lock<std::shared_mutex> lock(stateMutex_);
+  if (!ensureOpen(lock, true)) {
+    logError("write", "Failed to open file");
+    return std::vector<size_t>(operations.size(), 0);
+  }
+  return directIo_ ? writeDirect(operations) : writeBuffered(operations);
+}
+
+std::vector<size_t>
+IoUringStorage::writeBuffered(const std::vector<WriteOperation> &operations) {
+  // One request per operation (split above MAX_REQUEST_BYTES), all
+  // submitted together
+  std::vector<Request> requests;
+  std::vector<size_t> owner;
+  for (size_t i = 0; i < operations.size(); ++i) {
+    const WriteOperation &op = operations[i];
+    for (size_t done = 0; done < op.size; done += MAX_REQUEST_BYTES) {
+      requests.push_back(Request{IORING_OP_WRITE, fd_,
+                                 const_cast<uint8_t *>(op.data) + done,
+                                 std::min(op.size - done, MAX_REQUEST_BYTES),
+                                 op.offset + done});
+      owner.push_back(i);
+    }
+  }
+  execute(requests);
+
+  std::vector<size_t> results(operations.size(), 0);
+  std::vector<bool> failed(operations.size(), false);
+  for (size_t r = 0; r < requests.size(); ++r) {
+    if (requests[r].result != static_cast<int64_t>(requests[r].length)) {
+      failed[owner[r]] = true;
+    }
+  }
+  for (size_t i = 0; i < operations.size(); ++i) {
+    const WriteOperation &op = operations[i];
+    if (failed[i]) {
+      logError("write", "Failed to write " + std::to_string(op.size) +
+                            " bytes at offset " + std::to_string(op.offset));
+      continue;
+    }
+    results[i] = op.size;
+    recordWritten(op.offset + op.size, op.offset + op.size, op.size);
+  }
+  return results;
+}
+
+std::vector<size_t>
+IoUringStorage::writeDirect(const std::vector<WriteOperation> &operations) {
+  // Edge blocks are read back and rewritten, so writers of one file must
+  // not interleave
+  std::lock_guard<std::mutex> writeLock(directWriteMutex_);
+  BounceBuffers buffers;
+  const uint64_t block = DIRECT_IO_ALIGNMENT;
+
+  // A piece is one aligned buffer's worth of a run of contiguous operations
+  struct Piece {
+    uint64_t begin;     // Aligned
+    uint64_t end;       // Aligned
+    uint64_t dataBegin; // Bytes of the operations inside [begin, end)
+    uint64_t dataEnd;
+    size_t firstOp;
+    size_t lastOp;
+  };
+  std::vector<Piece> round;
+  std::vector<bool> failed(operations.size(), false);
+
+  auto flushRound = [&]() {
+    if (round.empty()) {
+      return;
+    }
+
+    // Keep the bytes of partially covered blocks that are already on disk;
+    // past the end of the file they are zero
+    std::vector<Request> reads;
+    uint64_t diskEnd = fileLength_.load();
+    for (size_t b = 0; b < round.size(); ++b) {
+      const Piece &piece = round[b];
+      uint8_t *buffer = buffers.get(b);
+      uint64_t tailBlock = piece.end - block;
+      bool head = piece.dataBegin > piece.begin;
+      bool tail =
+          piece.dataEnd < piece.end && !(head && tailBlock == piece.begin);
+      if (head) {
+        std::memset(buffer, 0, block);
+        if (piece.begin < diskEnd) {
+          reads.push_back(buffers.request(false, fd_, b, block, piece.begin));
+        }
+      }
+      if (tail) {
+        std::memset(buffer + (tailBlock - piece.begin), 0, block);
+        if (tailBlock < diskEnd) {
+          Request read = buffers.request(false, fd_, b, block, tailBlock);
+          read.buffer += tailBlock - piece.begin;
+          reads.push_back(read);
+        }
+      }
+    }
+    execute(reads);
+    for (const Request &read : reads) {
+      if (read.result < 0) {
+        logError("write", std::string("Failed to read back block: ") +
+                              strerror(static_cast<int>(-read.result)));
+      }
+    }
+
+    std::vector<Request> writes;
+    for (size_t b = 0; b < round.size(); ++b) {
+      const Piece &piece = round[b];
+      uint8_t *buffer = buffers.get(b);
+      for (size_t i = piece.firstOp; i <= piece.lastOp; ++i) {
+        const WriteOperation &op = operations[i];
+        uint64_t from = std::max(op.offset, piece.dataBegin);
+        uint64_t to = std::min(op.offset + op.size, piece.dataEnd);
+        if (from < to) {
+          std::memcpy(buffer + (from - piece.begin),
+                      op.data + (from - op.offset), to - from);
+        }
+      }
+      writes.push_back(buffers.request(true, fd_, b, piece.end - piece.begin,
+                                       piece.begin));
+    }
+    execute(writes);
+
+    for (size_t b = 0; b < round.size(); ++b) {
+      const Piece &piece = round[b];
+      if (writes[b].result != static_cast<int64_t>(piece.end - piece.begin)) {
+        for (size_t i = piece.firstOp; i <= piece.lastOp; ++i) {
+          failed[i] = true;
+        }
+        continue;
+      }
+      raiseTo(fileLength_, piece.end);
+    }
+    round.clear();
+  };
+
+  size_t i = 0;
+  while (i < operations.size()) {
+    if (operations[i].size == 0) {
+      ++i;
+      continue;
+    }
+
+    // Extend the run while operations continue one another
+    size_t last = i;
+    uint64_t runBegin = operations[i].offset;
+    uint64_t runEnd = runBegin + operations[i].size;
+    while (last + 1 < operations.size() &&
+           operations[last + 1].offset == runEnd &&
+           operations[last + 1].size > 0) {
+      ++last;
+      runEnd += operations[last].size;
+    }
+
+    size_t op = i;
+    for (uint64_t begin = alignDown(runBegin); begin < runEnd;) {
+      uint64_t end =
+          std::min<uint64_t>(begin + FIXED_BUFFER_SIZE, alignUp(runEnd));
+      Piece piece{begin, end, std::max(begin, runBegin),
+                  std::min(end, runEnd), op, op};
+      while (operations[op].offset + operations[op].size <= piece.dataBegin) {
+        ++op;
+      }
+      piece.firstOp = op;
+      piece.lastOp = op;
+      while (piece.lastOp < last &&
+             operations[piece.lastOp].offset + operations[piece.lastOp].size <
+                 piece.dataEnd) {
+        ++piece.lastOp;
+      }
+
+      // A block already in this round must be written before it is read
+      bool overlaps = std::any_of(round.begin(), round.end(),
+                                  [&](const Piece &other) {
+                                    return piece.begin < other.end &&
+                                           other.begin < piece.end;
+                                  });
+      if (overlaps || round.size() == FIXED_BUFFERS) {
+        flushRound();
+      }
+      round.push_back(piece);
+      begin = end;
+    }
+    i = last + 1;
+  }
+  flushRound();
+
+  std::vector<size_t> results(operations.size(), 0);
+  for (size_t k = 0; k < operations.size(); ++k) {
+    const WriteOperation &op = operations[k];
+    if (op.size == 0) {
+      continue;
+    }
+    if (failed[k]) {
+      logError("write", "Failed to write " + std::to_string(op.size) +
+                            " bytes at offset " + std::to_string(op.offset));
+      continue;
+    }
+    results[k] = op.size;
+    recordWritten(op.offset + op.size, 0, op.size);
+  }
+  return results;
+}
+
+void IoUringStorage::recordWritten(uint64_t end, uint64_t diskEnd,
+                                   size_t bytes) {
+  raiseTo(fileSize_, end);
+  raiseTo(fileLength_, diskEnd);
+  unflushedBytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+std::vector<uint8_t> IoUringStorage::read(uint64_t offset, size_t length) {
+  std::shared_lock<std::shared_mutex> lock(stateMutex_);
+  if (!ensureOpen(lock, false)) {
+    logError("read", "Failed to open file");
+    return std::vector<uint8_t>();
+  }
+
+  uint64_t size = fileSize_;
+  if (offset >= size) {
+    return std::vector<uint8_t>();
+  }
+  length = static_cast<size_t>(std::min<uint64_t>(length, size - offset));
+  std::vector<uint8_t> result(length);
+  result.resize(directIo_ ? readDirect(offset, result.data(), length)
+                          : readAt(offset, result.data(), length));
+  return result;
+}
+
+BufferView IoUringStorage::readView(uint64_t offset, size_t length) {
+  std::shared_lock<std::shared_mutex> lock(stateMutex_);
+  if (!ensureOpen(lock, false)) {
+    logError("readView", "Failed to open file");
+    return BufferView();
+  }
+
+  uint64_t size = fileSize_;
+  if (offset >= size) {
+    return BufferView();
+  }
+  length = static_cast<size_t>(std::min<uint64_t>(length, size - offset));
+  auto buffer = MemoryPoolManager::getInstance().acquire(length);
+  buffer->resize(directIo_ ? readDirect(offset, buffer->data(), length)
+                           : readAt(offset, buffer->data(), length));
+  std::shared_ptr<PooledBuffer> owner(std::move(buffer));
+  return BufferView(std::shared_ptr<const uint8_t>(owner, owner->data()),
+                    owner->size());
+}
+
+size_t IoUringStorage::readAt(uint64_t offset, uint8_t *dest, size_t length) {
+  std::vector<Request> requests;
+  for (size_t done = 0; done < length; done += MAX_REQUEST_BYTES) {
+    requests.push_back(Request{IORING_OP_READ, fd_, dest + done,
+                               std::min(length - done, MAX_REQUEST_BYTES),
+                               offset + done});
+  }
+  execute(requests);
+
+  // Bytes read before the first request that came up short
+  size_t bytesRead = 0;
+  for (const Request &request : requests) {
+    if (request.result < 0) {
+      logError("read", strerror(static_cast<int>(-request.result)));
+      break;
+    }
+    bytesRead += static_cast<size_t>(request.result);
+    if (request.result != static_cast<int64_t>(request.length)) {
+      break;
+    }
+  }
+  return bytesRead;
+}
+
+size_t IoUringStorage::readDirect(uint64_t offset, uint8_t *dest,
+                                  size_t length) {
+  BounceBuffers buffers;
+  uint64_t end = offset + length;
+  uint64_t begin = alignDown(offset);
+  size_t bytesRead = 0;
+
+  while (begin < end) {
+    // Up to FIXED_BUFFERS aligned reads per submission
+    std::vector<Request> reads;
+    for (size_t b = 0; b < FIXED_BUFFERS && begin < end; ++b) {
+      uint64_t pieceEnd =
+          std::min<uint64_t>(begin + FIXED_BUFFER_SIZE, alignUp(end));
+      reads.push_back(
+          buffers.request(false, fd_, b, pieceEnd - begin, begin));
+      begin = pieceEnd;
+    }
+    execute(reads);
+
+    for (const Request &read : reads) {
+      if (read.result < 0) {
+        logError("read", strerror(static_cast<int>(-read.result)));
+        return bytesRead;
+      }
+      uint64_t from = std::max(read.offset, offset);
+      uint64_t to =
+          std::min(read.offset + static_cast<uint64_t>(read.result), end);
+      if (from < to) {
+        std::memcpy(dest + (from - offset), read.buffer + (from - read.offset),
+                    to - from);
+        bytesRead += to - from;
+      }
+      if (read.result != static_cast<int64_t>(read.length)) {
+        return bytesRead; // End of file
+      }
+    }
+  }
+  return bytesRead;
+}
+
+bool IoUringStorage::finalize(uint64_t finalSize, bool flushData) {
+  {
+    std::unique_lock<std::shared_mutex> lock(stateMutex_);
+    if (fd_ < 0) {
+      spdlog::warn("File not open for finalization: {}", filePath_);
+      return false;
+    }
+    if (::ftruncate(fd_, static_cast<off_t>(finalSize)) != 0) {
+      logError("finalize",
+               std::string("Failed to set file length: ") + strerror(errno));
+      return false;
+    }
+    fileSize_ = finalSize;
+    fileLength_ = finalSize;
+  }
+
+  if (flushData && !flush()) {
+    logError("finalize", "Failed to flush file");
+    return false;
+  }
+  spdlog::debug("Finalized file: {} with size: {}", filePath_, finalSize);
+  return true;
+}
+
+bool IoUringStorage::flushAsync() {
+  std::shared_lock<std::shared_mutex> lock(stateMutex_);
+  if (fd_ < 0) {
+    return false;
+  }
+  unflushedBytes_.store(0, std::memory_order_relaxed);
+  // Direct writes leave nothing in the page cache to write back
+  if (directIo_) {
+    return true;
+  }
+  if (::sync_file_range(fd_, 0, 0, SYNC_FILE_RANGE_WRITE) != 0) {
+    logError("flushAsync",
+             std::string("sync_file_range failed: ") + strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool IoUringStorage::flush() {
+  std::shared_lock<std::shared_mutex> lock(stateMutex_);
+  if (fd_ < 0) {
+    spdlog::warn("File not open for flush: {}", filePath_);
+    return false;
+  }
+  unflushedBytes_.store(0, std::memory_order_relaxed);
+  if (directIo_) {
+    return true;
+  }
+  if (::sync_file_range(fd_, 0, 0,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                            SYNC_FILE_RANGE_WAIT_AFTER) != 0) {
+    logError("flush",
+             std::string("sync_file_range failed: ") + strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool IoUringStorage::sync() {
+  if (!flush()) {
+    return false;
+  }
+  // Also needed with O_DIRECT: the drive's cache and the file's length
+  std::shared_lock<std::shared_mutex> lock(stateMutex_);
+  if (::fdatasync(fd_) != 0) {
+    logError("sync", std::string("fdatasync failed: ") + strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool IoUringStorage::prefetch(uint64_t offset, size_t length) {
+  std::shared_lock<std::shared_mutex> lock(stateMutex_);
+  if (fd_ < 0) {
+    return false;
+  }
+  if (directIo_) {
+    return true; // No page cache to read into
+  }
+  return ::posix_fadvise(fd_, static_cast<off_t>(offset),
+                         static_cast<off_t>(length),
+                         POSIX_FADV_WILLNEED) == 0;
+}
+
+bool IoUringStorage::adviseSequential(bool sequential) {
+  std::shared_lock<std::shared_mutex> lock(stateMutex_);
+  if (fd_ < 0 || directIo_) {
+    return fd_ >= 0;
+  }
+  return ::posix_fadvise(fd_, 0, 0,
+                         sequential ? POSIX_FADV_SEQUENTIAL
+                                    : POSIX_FADV_NORMAL) == 0;
+}
+
+void IoUringStorage::logError(const std::string &operation,
+                              const std::string &error) const {
+  spdlog::error("Error in {} operation for file {}: {}", operation, filePath_,
+                error);
+}
+
+} // namespace audio_stream
+
+#else
+
+namespace audio_stream {
+
+bool IoUringStorage::isSupported() { return false; }
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_HAVE_IO_URING
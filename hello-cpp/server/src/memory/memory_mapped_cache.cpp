@@ -1,4 +1,5 @@
 #include "memory/memory_mapped_cache.h"
+#include "metrics/server_metrics.h"
 #include <algorithm>
 #include <cstring>
 #include <filesystem>
@@ -14,7 +15,7 @@
 namespace audio_stream {
 
 MemoryMappedCache::MemoryMappedCache(const std::string &filePath)
-    : filePath_(filePath), fileSize_(0), isOpen_(false)
+    : filePath_(filePath), fileSize_(0), capacity_(0), isOpen_(false)
 #ifdef _WIN32
       ,
       fileHandle_(INVALID_HANDLE_VALUE)
@@ -54,6 +55,7 @@ bool MemoryMappedCache::create(uint64_t initialSize) {
     } else {
       fileSize_ = 0;
     }
+    capacity_ = fileSize_;
 
     file.close();
 
@@ -92,6 +94,11 @@ bool MemoryMappedCache::open() {
   std::unique_lock<std::shared_mutex> lock(rwMutex_);
 
   try {
+    // Another reader may have opened the file while we waited for the lock
+    if (isOpen_) {
+      return true;
+    }
+
     spdlog::debug("Opening mmap file: {}", filePath_);
 
     // Check if file exists
@@ -102,6 +109,7 @@ bool MemoryMappedCache::open() {
 
     // Get file size
     fileSize_ = std::filesystem::file_size(filePath_);
+    capacity_ = fileSize_;
 
 #ifdef _WIN32
     fileHandle_ = CreateFileA(filePath_.c_str(), GENERIC_READ | GENERIC_WRITE,
@@ -121,7 +129,8 @@ bool MemoryMappedCache::open() {
 #endif
 
     isOpen_ = true;
-    spdlog::debug("Opened mmap file: {} with size: {}", filePath_, fileSize_);
+    spdlog::debug("Opened mmap file: {} with size: {}", filePath_,
+                  fileSize_.load());
     return true;
 
   } catch (const std::exception &e) {
@@ -136,6 +145,11 @@ void MemoryMappedCache::close() {
   if (isOpen_) {
     unmapAllSegments();
 
+    // Give back any pre-allocated capacity that was never written
+    if (capacity_ > fileSize_ && setFileLength(fileSize_)) {
+      capacity_ = fileSize_;
+    }
+
 #ifdef _WIN32
     if (fileHandle_ != INVALID_HANDLE_VALUE) {
       CloseHandle(fileHandle_);
@@ -155,155 +169,344 @@ void MemoryMappedCache::close() {
 
 size_t MemoryMappedCache::write(uint64_t offset,
                                 const std::vector<uint8_t> &data) {
-  std::unique_lock<std::shared_mutex> lock(rwMutex_);
+  return write(offset, data.data(), data.size());
+}
+
+size_t MemoryMappedCache::write(uint64_t offset, const uint8_t *data,
+                                size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+
+  std::shared_lock<std::shared_mutex> shared(rwMutex_);
+  std::unique_lock<std::shared_mutex> exclusive;
+  try {
+    if (!prepareWrite(shared, exclusive, offset, size)) {
+      return 0;
+    }
+
+    size_t bytesWritten = copyIn(offset, data, size);
+
+    SPDLOG_DEBUG("Wrote {} bytes to {} at offset {}", bytesWritten, filePath_,
+                 offset);
+    return bytesWritten;
+
+  } catch (const std::exception &e) {
+    logError("write", e.what());
+    return 0;
+  }
+}
+
+bool MemoryMappedCache::prepareWrite(
+    std::shared_lock<std::shared_mutex> &shared,
+    std::unique_lock<std::shared_mutex> &exclusive, uint64_t offset,
+    uint64_t length) {
+  // Space already allocated and mapped is written under the shared lock
+  if (isOpen_ && offset + length <= capacity_ && isMapped(offset, length)) {
+    return true;
+  }
+  shared.unlock();
+  exclusive = std::unique_lock<std::shared_mutex>(rwMutex_);
+
+  // Auto-create if not open; capacity is allocated below
+  if (!isOpen_) {
+    exclusive.unlock();
+    if (!create()) {
+      return false;
+    }
+    exclusive.lock();
+  }
+
+  if (!validateOffset(offset, length)) {
+    return false;
+  }
+
+  // Grow capacity if needed (no-op for most appends)
+  if (!ensureCapacity(offset + length)) {
+    logError("write", "Failed to grow file capacity");
+    return false;
+  }
+
+  // Map the segment(s) the write covers
+  if (!mapRange(offset, length)) {
+    logError("write", "Failed to map segment");
+    return false;
+  }
+  return true;
+}
+
+std::vector<uint8_t> MemoryMappedCache::read(uint64_t offset, size_t length) {
+  std::shared_lock<std::shared_mutex> lock(rwMutex_);
 
   try {
-    // Auto-create if not open
+    // Auto-open if not open (open() takes the exclusive lock itself)
     if (!isOpen_) {
       lock.unlock();
-      uint64_t initialSize = offset + data.size();
-      if (!create(initialSize)) {
-        return 0;
+      spdlog::debug("File not open, attempting to open for reading: {}",
+                    filePath_);
+      if (!open()) {
+        logError("read", "Failed to open file");
+        return std::vector<uint8_t>();
       }
       lock.lock();
     }
 
-    if (!validateOffset(offset, data.size())) {
-      return 0;
+    // Check bounds
+    if (offset >= fileSize_) {
+      SPDLOG_DEBUG("Read offset {} at or beyond file size {} - end of file",
+                   offset, fileSize_.load());
+      return std::vector<uint8_t>();
     }
 
-    // Resize if needed
-    uint64_t requiredSize = offset + data.size();
-    if (requiredSize > fileSize_) {
+    // Adjust length if needed
+    size_t actualLength =
+        std::min(length, static_cast<size_t>(fileSize_ - offset));
+
+    // Mapping mutates segments_, which needs the exclusive lock; a GET may
+    // run beside a writer or another GET under the shared one
+    std::unique_lock<std::shared_mutex> wlock;
+    if (!isMapped(offset, actualLength)) {
       lock.unlock();
-      if (!resize(requiredSize)) {
-        logError("write", "Failed to resize file");
-        return 0;
+      wlock = std::unique_lock<std::shared_mutex>(rwMutex_);
+      if (offset >= fileSize_) {
+        return std::vector<uint8_t>();
+      }
+      actualLength = std::min(length, static_cast<size_t>(fileSize_ - offset));
+      if (!mapRange(offset, actualLength)) {
+        logError("read", "Failed to map segment");
+        return std::vector<uint8_t>();
       }
-      lock.lock();
     }
 
-    // Write to appropriate segment(s)
-    size_t bytesWritten = 0;
-    uint64_t currentOffset = offset;
-    size_t dataOffset = 0;
+    std::vector<uint8_t> result(actualLength);
+    size_t bytesRead = copyOut(offset, result.data(), actualLength);
 
-    while (dataOffset < data.size()) {
-      uint64_t segmentIndex = currentOffset / SEGMENT_SIZE;
-      uint64_t segmentOffset = currentOffset % SEGMENT_SIZE;
-      size_t bytesToWrite =
-          std::min(data.size() - dataOffset,
-                   static_cast<size_t>(SEGMENT_SIZE - segmentOffset));
+    result.resize(bytesRead);
+    SPDLOG_DEBUG("Read {} bytes from {} at offset {}", bytesRead, filePath_,
+                 offset);
+    return result;
 
-      if (!mapSegment(segmentIndex)) {
-        logError("write", "Failed to map segment");
-        break;
-      }
+  } catch (const std::exception &e) {
+    logError("read", e.what());
+    return std::vector<uint8_t>();
+  }
+}
 
-      void *segmentAddr = getSegmentAddress(segmentIndex);
-      if (!segmentAddr) {
-        logError("write", "Invalid segment address");
-        break;
-      }
+size_t MemoryMappedCache::copyOut(uint64_t offset, uint8_t *dest,
+                                  size_t length) {
+  // Read from the mapped segment(s)
+  uint64_t currentOffset = offset;
+  size_t bytesRead = 0;
+
+  while (bytesRead < length) {
+    uint64_t segmentIndex = currentOffset / SEGMENT_SIZE;
+    uint64_t segmentOffset = currentOffset % SEGMENT_SIZE;
+    size_t bytesToRead =
+        std::min(length - bytesRead,
+                 static_cast<size_t>(SEGMENT_SIZE - segmentOffset));
+
+    void *segmentAddr = getSegmentAddress(segmentIndex);
+    if (!segmentAddr) {
+      logError("read", "Invalid segment address");
+      break;
+    }
 
-      uint8_t *writePtr = static_cast<uint8_t *>(segmentAddr) + segmentOffset;
-      std::memcpy(writePtr, data.data() + dataOffset, bytesToWrite);
+    const uint8_t *readPtr =
+        static_cast<const uint8_t *>(segmentAddr) + segmentOffset;
+    std::memcpy(dest + bytesRead, readPtr, bytesToRead);
 
-      // Flush to disk
-#ifdef _WIN32
-      FlushViewOfFile(writePtr, bytesToWrite);
-#else
-      msync(writePtr, bytesToWrite, MS_ASYNC);
-#endif
+    currentOffset += bytesToRead;
+    bytesRead += bytesToRead;
+  }
 
-      currentOffset += bytesToWrite;
-      dataOffset += bytesToWrite;
-      bytesWritten += bytesToWrite;
+  return bytesRead;
+}
+
+size_t MemoryMappedCache::copyIn(uint64_t offset, const uint8_t *data,
+                                 size_t size) {
+  // Segments must be mapped; callers hold rwMutex_ (shared is enough, as
+  // concurrent writers copy into disjoint bytes)
+  uint64_t currentOffset = offset;
+  size_t bytesWritten = 0;
+
+  while (bytesWritten < size) {
+    uint64_t segmentIndex = currentOffset / SEGMENT_SIZE;
+    uint64_t segmentOffset = currentOffset % SEGMENT_SIZE;
+    size_t bytesToWrite =
+        std::min(size - bytesWritten,
+                 static_cast<size_t>(SEGMENT_SIZE - segmentOffset));
+
+    void *segmentAddr = getSegmentAddress(segmentIndex);
+    if (!segmentAddr) {
+      logError("write", "Invalid segment address");
+      break;
     }
 
-    spdlog::debug("Wrote {} bytes to {} at offset {}", bytesWritten, filePath_,
-                  offset);
-    return bytesWritten;
+    uint8_t *writePtr = static_cast<uint8_t *>(segmentAddr) + segmentOffset;
+    std::memcpy(writePtr, data + bytesWritten, bytesToWrite);
 
-  } catch (const std::exception &e) {
-    logError("write", e.what());
-    return 0;
+    currentOffset += bytesToWrite;
+    bytesWritten += bytesToWrite;
   }
+
+  // Raise the logical size; writers below the end leave it alone
+  uint64_t end = offset + bytesWritten;
+  uint64_t current = fileSize_.load(std::memory_order_relaxed);
+  while (current < end && !fileSize_.compare_exchange_weak(current, end)) {
+  }
+  unflushedBytes_.fetch_add(bytesWritten, std::memory_order_relaxed);
+  return bytesWritten;
 }
 
-std::vector<uint8_t> MemoryMappedCache::read(uint64_t offset, size_t length) {
+bool MemoryMappedCache::isMapped(uint64_t offset, size_t length) const {
+  for (uint64_t segmentIndex = offset / SEGMENT_SIZE;
+       segmentIndex <= (offset + length - 1) / SEGMENT_SIZE; ++segmentIndex) {
+    auto it = segments_.find(segmentIndex);
+    uint64_t segmentOffset = segmentIndex * SEGMENT_SIZE;
+    uint64_t needed =
+        std::min<uint64_t>(offset + length, segmentOffset + SEGMENT_SIZE);
+    if (it == segments_.end() ||
+        segmentOffset + it->second->length < needed) {
+      return false;
+    }
+  }
+  return true;
+}
+
+BufferView MemoryMappedCache::readView(uint64_t offset, size_t length) {
   std::shared_lock<std::shared_mutex> lock(rwMutex_);
 
   try {
-    // Auto-open if not open
+    // Auto-open if not open (open() takes the exclusive lock itself)
     if (!isOpen_) {
       lock.unlock();
-      std::unique_lock<std::shared_mutex> wlock(rwMutex_);
-      if (!isOpen_) {
-        spdlog::debug("File not open, attempting to open for reading: {}",
-                      filePath_);
-        if (!open()) {
-          logError("read", "Failed to open file");
-          return std::vector<uint8_t>();
-        }
+      if (!open()) {
+        logError("readView", "Failed to open file");
+        return BufferView();
       }
-      wlock.unlock();
       lock.lock();
     }
 
-    // Check bounds
     if (offset >= fileSize_) {
-      spdlog::debug("Read offset {} at or beyond file size {} - end of file",
-                    offset, fileSize_);
-      return std::vector<uint8_t>();
+      return BufferView();
     }
 
-    // Adjust length if needed
     size_t actualLength =
         std::min(length, static_cast<size_t>(fileSize_ - offset));
-    std::vector<uint8_t> result(actualLength);
-
-    // Read from appropriate segment(s)
-    uint64_t currentOffset = offset;
-    size_t bytesRead = 0;
+    uint64_t segmentIndex = offset / SEGMENT_SIZE;
+    uint64_t segmentOffset = offset % SEGMENT_SIZE;
 
-    while (bytesRead < actualLength) {
-      uint64_t segmentIndex = currentOffset / SEGMENT_SIZE;
-      uint64_t segmentOffset = currentOffset % SEGMENT_SIZE;
-      size_t bytesToRead =
-          std::min(actualLength - bytesRead,
-                   static_cast<size_t>(SEGMENT_SIZE - segmentOffset));
-
-      if (!const_cast<MemoryMappedCache *>(this)->mapSegment(segmentIndex)) {
-        logError("read", "Failed to map segment");
-        break;
+    // A view must be contiguous, so ranges crossing a segment boundary
+    // are copied into a pooled buffer instead
+    if (segmentOffset + actualLength > SEGMENT_SIZE) {
+      lock.unlock();
+      std::unique_lock<std::shared_mutex> wlock(rwMutex_);
+      if (offset >= fileSize_) {
+        return BufferView();
+      }
+      actualLength = std::min(length, static_cast<size_t>(fileSize_ - offset));
+      if (!mapRange(offset, actualLength)) {
+        logError("readView", "Failed to map segment");
+        return BufferView();
       }
+      auto buffer = MemoryPoolManager::getInstance().acquire(actualLength);
+      buffer->resize(copyOut(offset, buffer->data(), actualLength));
+      std::shared_ptr<PooledBuffer> owner(std::move(buffer));
+      return BufferView(std::shared_ptr<const uint8_t>(owner, owner->data()),
+                        owner->size());
+    }
 
-      void *segmentAddr =
-          const_cast<MemoryMappedCache *>(this)->getSegmentAddress(
-              segmentIndex);
-      if (!segmentAddr) {
-        logError("read", "Invalid segment address");
-        break;
+    auto it = segments_.find(segmentIndex);
+    std::unique_lock<std::shared_mutex> wlock;
+    if (it == segments_.end()) {
+      // Mapping mutates segments_, which needs the exclusive lock
+      lock.unlock();
+      wlock = std::unique_lock<std::shared_mutex>(rwMutex_);
+      if (!mapSegment(segmentIndex)) {
+        logError("readView", "Failed to map segment");
+        return BufferView();
       }
+      it = segments_.find(segmentIndex);
+    }
 
-      const uint8_t *readPtr =
-          static_cast<const uint8_t *>(segmentAddr) + segmentOffset;
-      std::memcpy(result.data() + bytesRead, readPtr, bytesToRead);
+    // Alias the segment's owner so the mapping outlives remaps and evictions
+    const auto *base = static_cast<const uint8_t *>(it->second->address);
+    return BufferView(
+        std::shared_ptr<const uint8_t>(it->second, base + segmentOffset),
+        actualLength);
+
+  } catch (const std::exception &e) {
+    logError("readView", e.what());
+    return BufferView();
+  }
+}
 
-      currentOffset += bytesToRead;
-      bytesRead += bytesToRead;
+bool MemoryMappedCache::seal() {
+  if (sealed_.load(std::memory_order_seq_cst)) {
+    return true;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(rwMutex_);
+  if (!isOpen_) {
+    return false;
+  }
+  if (!sealed_.load(std::memory_order_relaxed)) {
+    sealedSize_.store(fileSize_, std::memory_order_relaxed);
+    for (auto &slot : sealedSegments_) {
+      slot.store(nullptr, std::memory_order_relaxed);
+    }
+    for (const auto &[index, segment] : segments_) {
+      if (index < MAX_SEGMENTS) {
+        sealedSegments_[index].store(segment.get(), std::memory_order_relaxed);
+      }
     }
+    sealed_.store(true, std::memory_order_seq_cst);
+    spdlog::debug("Sealed {} for lock-free reads", filePath_);
+  }
+  return true;
+}
 
-    result.resize(bytesRead);
-    spdlog::debug("Read {} bytes from {} at offset {}", bytesRead, filePath_,
-                  offset);
-    return result;
+BufferView MemoryMappedCache::tryReadView(uint64_t offset, size_t length) {
+  auto guard = readers_.enter();
+  if (!sealed_.load(std::memory_order_seq_cst)) {
+    return BufferView();
+  }
 
-  } catch (const std::exception &e) {
-    logError("read", e.what());
-    return std::vector<uint8_t>();
+  uint64_t size = sealedSize_.load(std::memory_order_relaxed);
+  if (offset >= size || length == 0) {
+    return BufferView();
+  }
+  size_t actualLength =
+      static_cast<size_t>(std::min<uint64_t>(length, size - offset));
+  uint64_t segmentIndex = offset / SEGMENT_SIZE;
+  uint64_t segmentOffset = offset % SEGMENT_SIZE;
+  if (segmentIndex >= MAX_SEGMENTS) {
+    return BufferView();
   }
+
+  // Not mapped yet, or crossing into the next segment: readView handles it
+  MappedSegment *segment =
+      sealedSegments_[segmentIndex].load(std::memory_order_acquire);
+  if (segment == nullptr || segmentOffset + actualLength > segment->length) {
+    return BufferView();
+  }
+
+  // The guard keeps the segment owned until this reference is taken
+  std::shared_ptr<MappedSegment> owner = segment->shared_from_this();
+  const auto *base = static_cast<const uint8_t *>(owner->address);
+  return BufferView(std::shared_ptr<const uint8_t>(owner, base + segmentOffset),
+                    actualLength);
+}
+
+void MemoryMappedCache::unseal() {
+  if (!sealed_.exchange(false, std::memory_order_seq_cst)) {
+    return;
+  }
+  readers_.synchronize();
+  for (auto &slot : sealedSegments_) {
+    slot.store(nullptr, std::memory_order_relaxed);
+  }
+  spdlog::debug("Unsealed {}", filePath_);
 }
 
 std::vector<size_t>
@@ -313,14 +516,38 @@ MemoryMappedCache::writeBatch(const std::vector<WriteOperation> &operations) {
     return std::vector<size_t>();
   }
 
-  std::vector<size_t> results;
-  results.reserve(operations.size());
-
+  std::vector<size_t> results(operations.size(), 0);
+  uint64_t begin = UINT64_MAX;
+  uint64_t end = 0;
   for (const auto &op : operations) {
-    size_t written = write(op.offset, op.data);
-    results.push_back(written);
+    if (op.size > 0) {
+      begin = std::min(begin, op.offset);
+      end = std::max(end, op.offset + op.size);
+    }
+  }
+  if (end == 0) {
+    return results;
   }
 
+  std::shared_lock<std::shared_mutex> shared(rwMutex_);
+  std::unique_lock<std::shared_mutex> exclusive;
+  try {
+    if (!prepareWrite(shared, exclusive, begin, end - begin)) {
+      return results;
+    }
+
+    for (size_t i = 0; i < operations.size(); ++i) {
+      const WriteOperation &op = operations[i];
+      if (op.size > 0) {
+        results[i] = copyIn(op.offset, op.data, op.size);
+      }
+    }
+
+    SPDLOG_DEBUG("Wrote batch of {} operations to {} at {}-{}",
+                 operations.size(), filePath_, begin, end);
+  } catch (const std::exception &e) {
+    logError("writeBatch", e.what());
+  }
   return results;
 }
 
@@ -355,16 +582,22 @@ bool MemoryMappedCache::resize(uint64_t newSize) {
       return false;
     }
 
-    if (newSize == fileSize_) {
+    if (newSize == fileSize_ && newSize == capacity_) {
       return true;
     }
 
-    // Unmap all segments before resizing
+#ifdef _WIN32
+    // Windows refuses to truncate a file while views are mapped
     unmapAllSegments();
+#endif
 
-    // Resize the file
-    std::filesystem::resize_file(filePath_, newSize);
+    // Set the exact file length, then trim or extend the tail mapping only
+    if (!setFileLength(newSize)) {
+      return false;
+    }
+    capacity_ = newSize;
     fileSize_ = newSize;
+    remapTailSegment();
 
     spdlog::debug("Resized file {} to {} bytes", filePath_, newSize);
     return true;
@@ -375,7 +608,22 @@ bool MemoryMappedCache::resize(uint64_t newSize) {
   }
 }
 
-bool MemoryMappedCache::finalize(uint64_t finalSize) {
+bool MemoryMappedCache::reserve(uint64_t capacity) {
+  std::unique_lock<std::shared_mutex> lock(rwMutex_);
+
+  if (!isOpen_) {
+    logError("reserve", "File not open");
+    return false;
+  }
+
+  if (!validateOffset(0, capacity)) {
+    return false;
+  }
+
+  return ensureCapacity(capacity);
+}
+
+bool MemoryMappedCache::finalize(uint64_t finalSize, bool flushData) {
   try {
     if (!isOpen_) {
       spdlog::warn("File not open for finalization: {}", filePath_);
@@ -387,7 +635,7 @@ bool MemoryMappedCache::finalize(uint64_t finalSize) {
       return false;
     }
 
-    if (!flush()) {
+    if (flushData && !flush()) {
       logError("finalize", "Failed to flush file");
       return false;
     }
@@ -401,6 +649,34 @@ bool MemoryMappedCache::finalize(uint64_t finalSize) {
   }
 }
 
+bool MemoryMappedCache::flushAsync() {
+  std::shared_lock<std::shared_mutex> lock(rwMutex_);
+
+  if (!isOpen_) {
+    return false;
+  }
+  unflushedBytes_.store(0, std::memory_order_relaxed);
+
+#if defined(_WIN32)
+  // FlushViewOfFile starts write-back and returns without waiting for it
+  for (const auto &[index, segment] : segments_) {
+    FlushViewOfFile(segment->address, 0);
+  }
+#elif defined(__linux__)
+  // msync(MS_ASYNC) is a no-op on Linux; start write-back of the whole file
+  if (::sync_file_range(fileDescriptor_, 0, 0, SYNC_FILE_RANGE_WRITE) != 0) {
+    logError("flushAsync",
+             std::string("sync_file_range failed: ") + strerror(errno));
+    return false;
+  }
+#else
+  for (const auto &[index, segment] : segments_) {
+    msync(segment->address, segment->length, MS_ASYNC);
+  }
+#endif
+  return true;
+}
+
 bool MemoryMappedCache::flush() {
   std::shared_lock<std::shared_mutex> lock(rwMutex_);
 
@@ -410,16 +686,13 @@ bool MemoryMappedCache::flush() {
       return false;
     }
 
-    for (const auto &[index, addr] : segments_) {
-      if (addr) {
+    unflushedBytes_.store(0, std::memory_order_relaxed);
+    for (const auto &[index, segment] : segments_) {
 #ifdef _WIN32
-        FlushViewOfFile(addr, 0);
+      FlushViewOfFile(segment->address, 0);
 #else
-        uint64_t segmentSize =
-            std::min(SEGMENT_SIZE, fileSize_ - index * SEGMENT_SIZE);
-        msync(addr, segmentSize, MS_SYNC);
+      msync(segment->address, segment->length, MS_SYNC);
 #endif
-      }
     }
 
     spdlog::debug("Flushed file: {}", filePath_);
@@ -431,8 +704,38 @@ bool MemoryMappedCache::flush() {
   }
 }
 
+bool MemoryMappedCache::sync() {
+  if (!flush()) {
+    return false;
+  }
+
+  std::shared_lock<std::shared_mutex> lock(rwMutex_);
+#ifdef _WIN32
+  if (!FlushFileBuffers(fileHandle_)) {
+    logError("sync", "FlushFileBuffers failed");
+    return false;
+  }
+#elif defined(__APPLE__)
+  // fsync on macOS stops at the drive cache; F_FULLFSYNC goes through it
+  if (::fcntl(fileDescriptor_, F_FULLFSYNC) != 0 &&
+      ::fsync(fileDescriptor_) != 0) {
+    logError("sync", std::string("fsync failed: ") + strerror(errno));
+    return false;
+  }
+#else
+  if (::fdatasync(fileDescriptor_) != 0) {
+    logError("sync", std::string("fdatasync failed: ") + strerror(errno));
+    return false;
+  }
+#endif
+
+  spdlog::debug("Synced file: {}", filePath_);
+  return true;
+}
+
 bool MemoryMappedCache::prefetch(uint64_t offset, size_t length) {
   std::shared_lock<std::shared_mutex> lock(rwMutex_);
+  std::unique_lock<std::shared_mutex> wlock;
 
   try {
     if (!isOpen_) {
@@ -444,30 +747,47 @@ bool MemoryMappedCache::prefetch(uint64_t offset, size_t length) {
       return false;
     }
 
-    // Prefetch segments
-    uint64_t startSegment = offset / SEGMENT_SIZE;
-    uint64_t endSegment = (offset + length - 1) / SEGMENT_SIZE;
-
-    for (uint64_t segmentIndex = startSegment; segmentIndex <= endSegment;
-         segmentIndex++) {
-      if (!const_cast<MemoryMappedCache *>(this)->mapSegment(segmentIndex)) {
-        logError("prefetch", "Failed to map segment");
-        return false;
+#ifndef _WIN32
+    // WILLNEED queues reads of just these pages and returns without
+    // waiting for them
+    static const uint64_t pageSize =
+        static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+    uint64_t position = offset - offset % pageSize;
+    while (position < std::min<uint64_t>(offset + length, capacity_)) {
+      uint64_t segmentIndex = position / SEGMENT_SIZE;
+      auto it = segments_.find(segmentIndex);
+      if (it == segments_.end()) {
+        // Mapping mutates segments_, which needs the exclusive lock
+        if (!wlock.owns_lock()) {
+          lock.unlock();
+          wlock = std::unique_lock<std::shared_mutex>(rwMutex_);
+          if (!isOpen_) {
+            return false;
+          }
+          continue;
+        }
+        if (!mapSegment(segmentIndex)) {
+          logError("prefetch", "Failed to map segment");
+          return false;
+        }
+        it = segments_.find(segmentIndex);
       }
 
-#ifndef _WIN32
-      void *addr = const_cast<MemoryMappedCache *>(this)->getSegmentAddress(
-          segmentIndex);
-      if (addr) {
-        uint64_t segmentSize =
-            std::min(SEGMENT_SIZE, fileSize_ - segmentIndex * SEGMENT_SIZE);
-        madvise(addr, segmentSize, MADV_WILLNEED);
+      uint64_t segmentStart = segmentIndex * SEGMENT_SIZE;
+      uint64_t end = std::min({offset + length, capacity_,
+                               segmentStart + it->second->length});
+      if (end <= position) {
+        break;
       }
-#endif
+      madvise(static_cast<uint8_t *>(it->second->address) +
+                  (position - segmentStart),
+              end - position, MADV_WILLNEED);
+      position = end;
     }
+#endif
 
-    spdlog::debug("Prefetched {} bytes from {} at offset {}", length, filePath_,
-                  offset);
+    SPDLOG_DEBUG("Prefetched {} bytes from {} at offset {}", length, filePath_,
+                 offset);
     return true;
 
   } catch (const std::exception &e) {
@@ -495,29 +815,11 @@ bool MemoryMappedCache::evict(uint64_t offset, size_t length) {
 
     for (uint64_t segmentIndex = startSegment; segmentIndex <= endSegment;
          segmentIndex++) {
-      auto it = segments_.find(segmentIndex);
-      if (it != segments_.end()) {
-        void *addr = it->second;
-
-#ifdef _WIN32
-        UnmapViewOfFile(addr);
-        auto handleIt = mappingHandles_.find(segmentIndex);
-        if (handleIt != mappingHandles_.end()) {
-          CloseHandle(handleIt->second);
-          mappingHandles_.erase(handleIt);
-        }
-#else
-        uint64_t segmentSize =
-            std::min(SEGMENT_SIZE, fileSize_ - segmentIndex * SEGMENT_SIZE);
-        munmap(addr, segmentSize);
-#endif
-
-        segments_.erase(it);
-      }
+      releaseSegment(segmentIndex);
     }
 
-    spdlog::debug("Evicted {} bytes from {} at offset {}", length, filePath_,
-                  offset);
+    SPDLOG_DEBUG("Evicted {} bytes from {} at offset {}", length, filePath_,
+                 offset);
     return true;
 
   } catch (const std::exception &e) {
@@ -526,14 +828,66 @@ bool MemoryMappedCache::evict(uint64_t offset, size_t length) {
   }
 }
 
+bool MemoryMappedCache::adviseSequential(bool sequential) {
+  std::shared_lock<std::shared_mutex> lock(rwMutex_);
+  sequential_.store(sequential, std::memory_order_relaxed);
+
+#ifndef _WIN32
+  for (const auto &[index, segment] : segments_) {
+    madvise(segment->address, segment->length,
+            sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+  }
+#endif
+  return true;
+}
+
+uint64_t MemoryMappedCache::releaseMappings() {
+  std::unique_lock<std::shared_mutex> lock(rwMutex_);
+
+  uint64_t released = 0;
+  while (!segments_.empty()) {
+    released += releaseSegment(segments_.begin()->first);
+  }
+
+  if (released > 0) {
+    spdlog::debug("Released {} mapped bytes of {}", released, filePath_);
+  }
+  return released;
+}
+
 uint64_t MemoryMappedCache::getSize() const { return fileSize_; }
 
+uint64_t MemoryMappedCache::getCapacity() const { return capacity_; }
+
+uint64_t MemoryMappedCache::getMappedBytes() const {
+  std::shared_lock<std::shared_mutex> lock(rwMutex_);
+  uint64_t mapped = 0;
+  for (const auto &[index, segment] : segments_) {
+    mapped += segment->length;
+  }
+  return mapped;
+}
+
+uint64_t MemoryMappedCache::getUnflushedBytes() const {
+  return unflushedBytes_.load(std::memory_order_relaxed);
+}
+
 std::string MemoryMappedCache::getFilePath() const { return filePath_; }
 
 bool MemoryMappedCache::isOpen() const { return isOpen_; }
 
 // Private methods
 
+bool MemoryMappedCache::mapRange(uint64_t offset, uint64_t length) {
+  for (uint64_t segmentIndex = offset / SEGMENT_SIZE;
+       segmentIndex <= (offset + length - 1) / SEGMENT_SIZE; ++segmentIndex) {
+    if (!mapSegment(segmentIndex)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool MemoryMappedCache::mapSegment(uint64_t segmentIndex) {
   // Check if already mapped
   if (segments_.find(segmentIndex) != segments_.end()) {
@@ -542,7 +896,10 @@ bool MemoryMappedCache::mapSegment(uint64_t segmentIndex) {
 
   try {
     uint64_t segmentOffset = segmentIndex * SEGMENT_SIZE;
-    uint64_t segmentSize = std::min(SEGMENT_SIZE, fileSize_ - segmentOffset);
+    uint64_t segmentSize =
+        capacity_ > segmentOffset
+            ? std::min(SEGMENT_SIZE, capacity_ - segmentOffset)
+            : 0;
 
     if (segmentSize == 0) {
       logError("mapSegment", "Invalid segment size");
@@ -571,8 +928,11 @@ bool MemoryMappedCache::mapSegment(uint64_t segmentIndex) {
       return false;
     }
 
-    segments_[segmentIndex] = addr;
-    mappingHandles_[segmentIndex] = mappingHandle;
+    auto segment = std::make_shared<MappedSegment>();
+    segment->address = addr;
+    segment->length = segmentSize;
+    segment->mappingHandle = mappingHandle;
+    segments_[segmentIndex] = std::move(segment);
 #else
     void *addr = ::mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE,
                         MAP_SHARED, fileDescriptor_, segmentOffset);
@@ -583,9 +943,24 @@ bool MemoryMappedCache::mapSegment(uint64_t segmentIndex) {
       return false;
     }
 
-    segments_[segmentIndex] = addr;
+    if (sequential_.load(std::memory_order_relaxed)) {
+      madvise(addr, segmentSize, MADV_SEQUENTIAL);
+    }
+
+    auto segment = std::make_shared<MappedSegment>();
+    segment->address = addr;
+    segment->length = segmentSize;
+    segments_[segmentIndex] = std::move(segment);
 #endif
 
+    // A sealed file serves the new segment without locks from now on
+    if (sealed_.load(std::memory_order_relaxed) &&
+        segmentIndex < MAX_SEGMENTS) {
+      sealedSegments_[segmentIndex].store(segments_[segmentIndex].get(),
+                                          std::memory_order_release);
+    }
+
+    ServerMetrics::getInstance().add(Counter::SEGMENTS_MAPPED);
     spdlog::debug("Mapped segment {} ({} bytes) for file: {}", segmentIndex,
                   segmentSize, filePath_);
     return true;
@@ -596,32 +971,145 @@ bool MemoryMappedCache::mapSegment(uint64_t segmentIndex) {
   }
 }
 
-void MemoryMappedCache::unmapAllSegments() {
-  for (const auto &[index, addr] : segments_) {
-    if (addr) {
+MemoryMappedCache::MappedSegment::~MappedSegment() {
+  if (!address) {
+    return;
+  }
 #ifdef _WIN32
-      UnmapViewOfFile(addr);
-      auto handleIt = mappingHandles_.find(index);
-      if (handleIt != mappingHandles_.end()) {
-        CloseHandle(handleIt->second);
-      }
+  UnmapViewOfFile(address);
+  if (mappingHandle) {
+    CloseHandle(mappingHandle);
+  }
 #else
-      uint64_t segmentSize =
-          std::min(SEGMENT_SIZE, fileSize_ - index * SEGMENT_SIZE);
-      munmap(addr, segmentSize);
+  munmap(address, length);
 #endif
-    }
+}
+
+void MemoryMappedCache::unmapSegment(uint64_t segmentIndex) {
+  unseal();
+  // Views still holding the segment keep it mapped until they are released
+  segments_.erase(segmentIndex);
+}
+
+uint64_t MemoryMappedCache::releaseSegment(uint64_t segmentIndex) {
+  auto it = segments_.find(segmentIndex);
+  if (it == segments_.end()) {
+    return 0;
   }
+  unseal();
 
+  uint64_t length = it->second->length;
+#ifndef _WIN32
+  // A view still reads from this mapping, so it cannot be unmapped yet;
+  // dropping its pages is safe, they fault back in from the file
+  if (it->second.use_count() > 1) {
+    madvise(it->second->address, length, MADV_DONTNEED);
+  }
+#endif
+  segments_.erase(it);
+  return length;
+}
+
+void MemoryMappedCache::unmapAllSegments() {
+  unseal();
   segments_.clear();
+}
+
+bool MemoryMappedCache::ensureCapacity(uint64_t requiredSize) {
+  if (requiredSize <= capacity_) {
+    return true;
+  }
+  MetricTimer timer(Histogram::REMAP_NS);
+
+  uint64_t newCapacity = nextCapacity(requiredSize);
+  if (!setFileLength(newCapacity)) {
+    return false;
+  }
+
+  spdlog::debug("Grew capacity of {} from {} to {} bytes", filePath_,
+                capacity_, newCapacity);
+  capacity_ = newCapacity;
+  return remapTailSegment();
+}
+
+uint64_t MemoryMappedCache::nextCapacity(uint64_t requiredSize) const {
+  // Double while below one segment, then grow in whole-segment extents
+  uint64_t grown = capacity_ < SEGMENT_SIZE
+                       ? std::max(capacity_ * 2, MIN_CAPACITY_INCREMENT)
+                       : capacity_ + SEGMENT_SIZE;
+  return std::min(std::max(grown, requiredSize), MAX_CACHE_SIZE);
+}
+
+bool MemoryMappedCache::setFileLength(uint64_t newLength) {
+  // Lock-free readers must not touch pages past a new end of file
+  unseal();
 #ifdef _WIN32
-  mappingHandles_.clear();
+  LARGE_INTEGER length;
+  length.QuadPart = static_cast<LONGLONG>(newLength);
+  if (!SetFilePointerEx(fileHandle_, length, nullptr, FILE_BEGIN) ||
+      !SetEndOfFile(fileHandle_)) {
+    logError("setFileLength", "Failed to set end of file");
+    return false;
+  }
+#else
+#ifdef __linux__
+  // Reserve real blocks for the new extent; fall back to a sparse
+  // ftruncate on filesystems without fallocate support
+  if (newLength > capacity_ &&
+      ::fallocate(fileDescriptor_, 0, static_cast<off_t>(capacity_),
+                  static_cast<off_t>(newLength - capacity_)) == 0) {
+    return true;
+  }
+#endif
+  if (::ftruncate(fileDescriptor_, static_cast<off_t>(newLength)) != 0) {
+    logError("setFileLength",
+             std::string("Failed to set file length: ") + strerror(errno));
+    return false;
+  }
+#endif
+  return true;
+}
+
+bool MemoryMappedCache::remapTailSegment() {
+  unseal(); // Segments below may move or be dropped
+  // Only the segment straddling the end of the file can have a stale
+  // length; everything before it is a full SEGMENT_SIZE view.
+  for (auto it = segments_.begin(); it != segments_.end();) {
+    uint64_t segmentOffset = it->first * SEGMENT_SIZE;
+    uint64_t expectedLength =
+        capacity_ > segmentOffset
+            ? std::min(SEGMENT_SIZE, capacity_ - segmentOffset)
+            : 0;
+    MappedSegment &segment = *it->second;
+    if (expectedLength == segment.length) {
+      ++it;
+      continue;
+    }
+
+#ifdef __linux__
+    // A pinned segment must keep its address, so only unshared ones move
+    if (expectedLength > 0 && it->second.use_count() == 1) {
+      void *addr = ::mremap(segment.address, segment.length, expectedLength,
+                            MREMAP_MAYMOVE);
+      if (addr != MAP_FAILED) {
+        segment.address = addr;
+        segment.length = expectedLength;
+        ++it;
+        continue;
+      }
+      spdlog::debug("mremap failed for segment {} of {}: {}", it->first,
+                    filePath_, strerror(errno));
+    }
 #endif
+    // Drop the stale view; it is re-created on the next access
+    it = segments_.erase(it);
+  }
+  return true;
 }
 
 void *MemoryMappedCache::getSegmentAddress(uint64_t segmentIndex) {
   auto it = segments_.find(segmentIndex);
-  return (it != segments_.end()) ? it->second : nullptr;
+  return (it != segments_.end()) ? it->second->address : nullptr;
 }
 
 bool MemoryMappedCache::validateOffset(uint64_t offset, size_t length) const {
@@ -3,6 +3,10 @@
 
 namespace audio_stream {
 
+void PooledBufferDeleter::operator()(PooledBuffer *buffer) const {
+  MemoryPoolManager::getInstance().release(buffer);
+}
+
 MemoryPoolManager &MemoryPoolManager::getInstance(size_t bufferSize,
                                                   size_t poolSize) {
   static MemoryPoolManager instance(bufferSize, poolSize);
@@ -12,10 +16,15 @@ MemoryPoolManager &MemoryPoolManager::getInstance(size_t bufferSize,
 MemoryPoolManager::MemoryPoolManager(size_t bufferSize, size_t poolSize)
     : bufferSize_(bufferSize), poolSize_(poolSize) {
 
-  // Pre-allocate buffers
-  for (size_t i = 0; i < poolSize; ++i) {
-    auto buffer = std::make_shared<std::vector<uint8_t>>(bufferSize);
-    availableBuffers_.push(buffer);
+  // Pre-allocate buffers in the size class that fits the default chunk
+  int sizeClass = sizeClassFor(bufferSize);
+  if (sizeClass >= 0) {
+    auto &cls = classes_[sizeClass];
+    cls.freeList.reserve(poolSize);
+    for (size_t i = 0; i < poolSize; ++i) {
+      cls.freeList.emplace_back(
+          new PooledBuffer(classCapacity(sizeClass), sizeClass));
+    }
   }
 
   spdlog::info("MemoryPoolManager initialized with {} buffers of {} bytes",
@@ -23,48 +32,136 @@ MemoryPoolManager::MemoryPoolManager(size_t bufferSize, size_t poolSize)
 }
 
 MemoryPoolManager::~MemoryPoolManager() {
-  std::lock_guard<std::mutex> lock(mutex_);
-  while (!availableBuffers_.empty()) {
-    availableBuffers_.pop();
+  for (auto &cls : classes_) {
+    std::lock_guard<std::mutex> lock(cls.mutex);
+    cls.freeList.clear();
+  }
+}
+
+MemoryPoolManager::ThreadCache::~ThreadCache() {
+  // Hand cached buffers back so other threads can reuse them
+  auto &pool = MemoryPoolManager::getInstance();
+  for (auto &cached : buffers) {
+    for (auto &buffer : cached) {
+      pool.returnToSharedPool(std::move(buffer));
+    }
+  }
+}
+
+int MemoryPoolManager::sizeClassFor(size_t size) {
+  if (size > MAX_BUFFER_SIZE) {
+    return -1;
+  }
+  int sizeClass = 0;
+  while (classCapacity(sizeClass) < size) {
+    ++sizeClass;
   }
+  return sizeClass;
 }
 
-std::shared_ptr<std::vector<uint8_t>> MemoryPoolManager::acquireBuffer() {
-  std::lock_guard<std::mutex> lock(mutex_);
+size_t MemoryPoolManager::classCapacity(int sizeClass) {
+  return MIN_BUFFER_SIZE << sizeClass;
+}
 
-  if (availableBuffers_.empty()) {
-    // Pool exhausted, allocate new buffer
-    spdlog::warn("Memory pool exhausted, allocating new buffer");
-    return std::make_shared<std::vector<uint8_t>>(bufferSize_);
+MemoryPoolManager::ThreadCache &MemoryPoolManager::threadCache() {
+  thread_local ThreadCache cache;
+  return cache;
+}
+
+PooledBufferPtr MemoryPoolManager::acquire(size_t size) {
+  int sizeClass = sizeClassFor(size);
+  if (sizeClass < 0) {
+    // Too large to pool, allocate exactly what was asked for
+    oversized_.fetch_add(1, std::memory_order_relaxed);
+    PooledBufferPtr buffer(new PooledBuffer(size, -1));
+    buffer->resize(size);
+    return buffer;
   }
 
-  auto buffer = availableBuffers_.front();
-  availableBuffers_.pop();
-  buffer->clear();
-  buffer->resize(bufferSize_);
+  // Fast path: the calling thread's own cache, no locking
+  auto &cached = threadCache().buffers[sizeClass];
+  if (!cached.empty()) {
+    PooledBufferPtr buffer(cached.back().release());
+    cached.pop_back();
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    buffer->resize(size);
+    return buffer;
+  }
 
+  {
+    auto &cls = classes_[sizeClass];
+    std::lock_guard<std::mutex> lock(cls.mutex);
+    if (!cls.freeList.empty()) {
+      PooledBufferPtr buffer(cls.freeList.back().release());
+      cls.freeList.pop_back();
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      buffer->resize(size);
+      return buffer;
+    }
+  }
+
+  // Pool exhausted, allocate new buffer
+  exhaustions_.fetch_add(1, std::memory_order_relaxed);
+  spdlog::debug("Memory pool exhausted for {} byte class, allocating",
+                classCapacity(sizeClass));
+  PooledBufferPtr buffer(
+      new PooledBuffer(classCapacity(sizeClass), sizeClass));
+  buffer->resize(size);
   return buffer;
 }
 
-void MemoryPoolManager::releaseBuffer(
-    std::shared_ptr<std::vector<uint8_t>> buffer) {
+void MemoryPoolManager::release(PooledBuffer *buffer) {
   if (!buffer)
     return;
 
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<PooledBuffer> owned(buffer);
+  if (owned->sizeClass_ < 0) {
+    return;
+  }
+
+  auto &cached = threadCache().buffers[owned->sizeClass_];
+  if (cached.size() < THREAD_CACHE_LIMIT) {
+    cached.push_back(std::move(owned));
+    return;
+  }
+
+  returnToSharedPool(std::move(owned));
+}
+
+void MemoryPoolManager::returnToSharedPool(
+    std::unique_ptr<PooledBuffer> buffer) {
+  auto &cls = classes_[buffer->sizeClass_];
+  std::lock_guard<std::mutex> lock(cls.mutex);
 
   // Only return to pool if we haven't exceeded pool size
-  if (availableBuffers_.size() < poolSize_) {
-    buffer->clear();
-    availableBuffers_.push(buffer);
+  if (cls.freeList.size() < poolSize_) {
+    cls.freeList.push_back(std::move(buffer));
+  } else {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
   }
 }
 
+MemoryPoolManager::Stats MemoryPoolManager::getStats() const {
+  Stats stats;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  stats.exhaustions = exhaustions_.load(std::memory_order_relaxed);
+  stats.oversized = oversized_.load(std::memory_order_relaxed);
+  stats.dropped = dropped_.load(std::memory_order_relaxed);
+  return stats;
+}
+
 size_t MemoryPoolManager::getAvailableBuffers() const {
-  std::lock_guard<std::mutex> lock(mutex_);
-  return availableBuffers_.size();
+  size_t available = 0;
+  for (auto &cls : classes_) {
+    std::lock_guard<std::mutex> lock(cls.mutex);
+    available += cls.freeList.size();
+  }
+  return available;
 }
 
-size_t MemoryPoolManager::getTotalBuffers() const { return poolSize_; }
+size_t MemoryPoolManager::getTotalBuffers() const {
+  return poolSize_ * SIZE_CLASS_COUNT;
+}
 
 } // namespace audio_stream
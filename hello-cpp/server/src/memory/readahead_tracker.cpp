@@ -0,0 +1,70 @@
+#include "memory/readahead_tracker.h"
+#include <algorithm>
+
+namespace audio_stream {
+
+ReadaheadTracker::Decision
+ReadaheadTracker::recordRead(uint64_t offset, uint64_t length,
+                             uint64_t readableEnd) {
+  Decision decision;
+  if (length == 0) {
+    return decision;
+  }
+
+  const bool wasStreaming = isStreaming();
+  const uint64_t end = offset + length;
+  ++clock_;
+
+  auto cursor = std::find_if(
+      cursors_.begin(), cursors_.end(),
+      [offset](const Cursor &c) { return c.reads > 0 && c.next == offset; });
+  if (cursor == cursors_.end()) {
+    // A new reader, or a seek: take over the least recently used cursor
+    cursor = std::min_element(cursors_.begin(), cursors_.end(),
+                              [](const Cursor &a, const Cursor &b) {
+                                return a.lastUsed < b.lastUsed;
+                              });
+    if (cursor->reads >= SEQUENTIAL_READS) {
+      --streamingCursors_;
+    }
+    *cursor = Cursor{};
+  }
+
+  cursor->next = end;
+  cursor->lastUsed = clock_;
+  if (++cursor->reads == SEQUENTIAL_READS) {
+    ++streamingCursors_;
+  }
+
+  if (cursor->reads >= SEQUENTIAL_READS) {
+    decision.streaming = true;
+    if (cursor->windowEnd > 0) {
+      decision.hit = end <= cursor->windowEnd;
+      decision.miss = !decision.hit && !cursor->clamped;
+    }
+
+    // Extend the window once less than half of it is left
+    if (cursor->windowEnd < end + WINDOW_BYTES / 2) {
+      uint64_t begin = std::max(cursor->windowEnd, end - end % PAGE_BYTES);
+      uint64_t target = (end + WINDOW_BYTES + PAGE_BYTES - 1) /
+                        PAGE_BYTES * PAGE_BYTES;
+      uint64_t windowEnd = std::min(target, readableEnd);
+      if (windowEnd > begin) {
+        decision.prefetchOffset = begin;
+        decision.prefetchLength = windowEnd - begin;
+        cursor->windowEnd = windowEnd;
+        cursor->clamped = windowEnd < target;
+      }
+    }
+  }
+
+  decision.streamChanged = wasStreaming != isStreaming();
+  return decision;
+}
+
+void ReadaheadTracker::reset() {
+  cursors_ = {};
+  streamingCursors_ = 0;
+}
+
+} // namespace audio_stream
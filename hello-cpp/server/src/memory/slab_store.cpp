@@ -0,0 +1,374 @@
+#include "memory/slab_store.h"
+
+#ifdef AUDIO_STREAM_HAVE_SLAB_STORE
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace audio_stream {
+
+namespace {
+
+bool writeAt(int fd, const uint8_t *data, size_t size, uint64_t offset) {
+  while (size > 0) {
+    ssize_t written = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+    offset += static_cast<uint64_t>(written);
+  }
+  return true;
+}
+
+// Make [offset, offset + size) of the file as durable as the tier asks
+bool syncRange(int fd, [[maybe_unused]] uint64_t offset,
+               [[maybe_unused]] size_t size, Durability durability) {
+  switch (durability) {
+  case Durability::NONE:
+  case Durability::DEFAULT:
+    return true;
+  case Durability::PERIODIC:
+#ifdef __linux__
+    return ::sync_file_range(fd, static_cast<off_t>(offset),
+                             static_cast<off_t>(size),
+                             SYNC_FILE_RANGE_WRITE) == 0;
+#else
+    return true; // Written back by the kernel's own schedule
+#endif
+  case Durability::ON_FINALIZE:
+#ifdef __linux__
+    // Write-back of the range alone, without a journal commit
+    return ::sync_file_range(fd, static_cast<off_t>(offset),
+                             static_cast<off_t>(size),
+                             SYNC_FILE_RANGE_WAIT_BEFORE |
+                                 SYNC_FILE_RANGE_WRITE |
+                                 SYNC_FILE_RANGE_WAIT_AFTER) == 0;
+#else
+    [[fallthrough]];
+#endif
+  case Durability::STRICT_SYNC:
+#ifdef __APPLE__
+    // fsync on macOS stops at the drive cache; F_FULLFSYNC goes through it
+    return ::fcntl(fd, F_FULLFSYNC) == 0 || ::fsync(fd) == 0;
+#else
+    return ::fdatasync(fd) == 0;
+#endif
+  }
+  return false;
+}
+
+bool parseSlabId(const std::filesystem::path &path, uint32_t &id) {
+  std::string stem = path.stem().string();
+  if (path.extension() != SlabStore::EXTENSION ||
+      stem.compare(0, 5, "slab-") != 0 || stem.size() == 5 ||
+      !std::all_of(stem.begin() + 5, stem.end(),
+                   [](char c) { return c >= '0' && c <= '9'; })) {
+    return false;
+  }
+  unsigned long value = std::stoul(stem.substr(5));
+  if (value == 0 || value > UINT32_MAX) {
+    return false;
+  }
+  id = static_cast<uint32_t>(value);
+  return true;
+}
+
+} // namespace
+
+SlabFile::~SlabFile() {
+  if (base != nullptr) {
+    ::munmap(const_cast<uint8_t *>(base), mappedLength);
+  }
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+SlabObjectStorage::SlabObjectStorage(std::shared_ptr<SlabFile> slab,
+                                     uint64_t offset, uint64_t size)
+    : slab_(std::move(slab)), offset_(offset), size_(size) {}
+
+bool SlabObjectStorage::create(uint64_t) {
+  logError("create", "Slab streams are read-only");
+  return false;
+}
+
+bool SlabObjectStorage::open() {
+  open_.store(true, std::memory_order_release);
+  return true;
+}
+
+void SlabObjectStorage::close() {
+  // Views already handed out keep the slab mapped
+  open_.store(false, std::memory_order_release);
+}
+
+size_t SlabObjectStorage::write(uint64_t, const uint8_t *, size_t) {
+  logError("write", "Slab streams are read-only");
+  return 0;
+}
+
+std::vector<size_t> SlabObjectStorage::writeBatch(
+    const std::vector<WriteOperation> &operations) {
+  logError("writeBatch", "Slab streams are read-only");
+  return std::vector<size_t>(operations.size(), 0);
+}
+
+bool SlabObjectStorage::finalize(uint64_t, bool) {
+  logError("finalize", "Slab streams are read-only");
+  return false;
+}
+
+std::vector<uint8_t> SlabObjectStorage::read(uint64_t offset, size_t length) {
+  BufferView view = readView(offset, length);
+  return std::vector<uint8_t>(view.begin(), view.end());
+}
+
+BufferView SlabObjectStorage::readView(uint64_t offset, size_t length) {
+  open();
+  return tryReadView(offset, length);
+}
+
+BufferView SlabObjectStorage::tryReadView(uint64_t offset, size_t length) {
+  if (!isOpen() || offset >= size_ || length == 0) {
+    return BufferView();
+  }
+  length = static_cast<size_t>(std::min<uint64_t>(length, size_ - offset));
+  return BufferView(std::shared_ptr<const uint8_t>(
+                        slab_, slab_->base + offset_ + offset),
+                    length);
+}
+
+bool SlabObjectStorage::prefetch(uint64_t offset, size_t length) {
+  if (!isOpen()) {
+    return false;
+  }
+  if (offset >= size_ || length == 0) {
+    return true;
+  }
+#ifdef MADV_WILLNEED
+  // madvise takes a page-aligned start
+  static const uint64_t pageSize =
+      static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+  uint64_t start = offset_ + offset;
+  uint64_t end = offset_ + std::min<uint64_t>(size_, offset + length);
+  uint64_t aligned = start - start % pageSize;
+  return ::madvise(const_cast<uint8_t *>(slab_->base) + aligned,
+                   static_cast<size_t>(end - aligned), MADV_WILLNEED) == 0;
+#else
+  return true;
+#endif
+}
+
+void SlabObjectStorage::logError(const std::string &operation,
+                                 const std::string &error) const {
+  spdlog::error("Error in {} operation for slab stream at {}+{} in {}: {}",
+                operation, offset_, size_, slab_->path, error);
+}
+
+SlabStore::SlabStore(const std::string &directory) : directory_(directory) {
+  // New slabs never reuse the id of one a previous run left
+  std::error_code ec;
+  for (const auto &entry :
+       std::filesystem::directory_iterator(directory_, ec)) {
+    uint32_t id;
+    if (parseSlabId(entry.path(), id) && id >= nextId_) {
+      nextId_ = id + 1;
+    }
+  }
+}
+
+SlabStore::~SlabStore() = default;
+
+std::string SlabStore::getSlabPath(uint32_t slab) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "slab-%08u%s", slab, EXTENSION);
+  return directory_ + "/" + name;
+}
+
+std::shared_ptr<SlabFile> SlabStore::createSlab(uint32_t id) {
+  auto slab = std::make_shared<SlabFile>();
+  slab->id = id;
+  slab->path = getSlabPath(id);
+  slab->fd = ::open(slab->path.c_str(),
+                    O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (slab->fd < 0) {
+    spdlog::error("Failed to create slab file {}: {}", slab->path,
+                  strerror(errno));
+    return nullptr;
+  }
+
+  // Mapped past the end of the file: appends extend it underneath, and
+  // only ranges already written are ever read
+  void *base = ::mmap(nullptr, SLAB_BYTES, PROT_READ, MAP_SHARED, slab->fd, 0);
+  if (base == MAP_FAILED) {
+    spdlog::error("Failed to map slab file {}: {}", slab->path,
+                  strerror(errno));
+    ::unlink(slab->path.c_str());
+    return nullptr;
+  }
+  slab->base = static_cast<const uint8_t *>(base);
+  slab->mappedLength = SLAB_BYTES;
+  spdlog::debug("Created slab file {}", slab->path);
+  return slab;
+}
+
+std::shared_ptr<SlabFile> SlabStore::openSlab(uint32_t id) {
+  auto slab = std::make_shared<SlabFile>();
+  slab->id = id;
+  slab->path = getSlabPath(id);
+  slab->sealed = true;
+  slab->fd = ::open(slab->path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (slab->fd < 0 || ::fstat(slab->fd, &st) != 0) {
+    spdlog::warn("Failed to open slab file {}: {}", slab->path,
+                 strerror(errno));
+    return nullptr;
+  }
+  slab->end = static_cast<uint64_t>(st.st_size);
+  if (slab->end > 0) {
+    void *base = ::mmap(nullptr, static_cast<size_t>(slab->end), PROT_READ,
+                        MAP_SHARED, slab->fd, 0);
+    if (base == MAP_FAILED) {
+      spdlog::warn("Failed to map slab file {}: {}", slab->path,
+                   strerror(errno));
+      return nullptr;
+    }
+    slab->base = static_cast<const uint8_t *>(base);
+    slab->mappedLength = static_cast<size_t>(slab->end);
+  }
+  return slab;
+}
+
+std::unique_ptr<SlabObjectStorage>
+SlabStore::append(const uint8_t *data, size_t size, Durability durability,
+                  SlabLocation &location) {
+  if (size > SLAB_BYTES) {
+    return nullptr;
+  }
+
+  // Reserve the range; counting the stream keeps the slab while it copies
+  std::shared_ptr<SlabFile> slab;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (active_ && active_->end + size > SLAB_BYTES) {
+      active_->sealed = true;
+      removeIfUnused(active_);
+      active_.reset();
+    }
+    if (!active_) {
+      active_ = createSlab(nextId_++);
+      if (!active_) {
+        return nullptr;
+      }
+      slabs_[active_->id] = active_;
+    }
+    slab = active_;
+    location = {slab->id, slab->end};
+    slab->end += size;
+    slab->streams++;
+    slab->liveBytes += size;
+  }
+
+  if (!writeAt(slab->fd, data, size, location.offset) ||
+      !syncRange(slab->fd, location.offset, size, durability)) {
+    spdlog::error("Failed to append {} bytes to slab file {}: {}", size,
+                  slab->path, strerror(errno));
+    release(location, size);
+    return nullptr;
+  }
+  return std::make_unique<SlabObjectStorage>(std::move(slab), location.offset,
+                                             size);
+}
+
+std::unique_ptr<SlabObjectStorage>
+SlabStore::restore(const SlabLocation &location, uint64_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = slabs_.find(location.slab);
+  if (it == slabs_.end()) {
+    auto slab = openSlab(location.slab);
+    if (!slab) {
+      return nullptr;
+    }
+    it = slabs_.emplace(location.slab, std::move(slab)).first;
+  }
+
+  const std::shared_ptr<SlabFile> &slab = it->second;
+  if (location.offset > slab->end || size > slab->end - location.offset) {
+    spdlog::warn("Slab file {} ends at {}, before {}+{}", slab->path,
+                 slab->end, location.offset, size);
+    return nullptr;
+  }
+  slab->streams++;
+  slab->liveBytes += size;
+  return std::make_unique<SlabObjectStorage>(slab, location.offset, size);
+}
+
+void SlabStore::release(const SlabLocation &location, uint64_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = slabs_.find(location.slab);
+  if (it == slabs_.end()) {
+    return;
+  }
+  SlabFile &slab = *it->second;
+  slab.streams -= std::min<size_t>(slab.streams, 1);
+  slab.liveBytes -= std::min(slab.liveBytes, size);
+  removeIfUnused(it->second);
+}
+
+void SlabStore::removeIfUnused(const std::shared_ptr<SlabFile> &slab) {
+  if (!slab->sealed || slab->streams > 0) {
+    return;
+  }
+  // Readers still holding views keep the mapping of the unlinked file
+  if (::unlink(slab->path.c_str()) != 0 && errno != ENOENT) {
+    spdlog::warn("Failed to remove slab file {}: {}", slab->path,
+                 strerror(errno));
+  }
+  spdlog::debug("Removed slab file {}", slab->path);
+  slabs_.erase(slab->id);
+}
+
+size_t SlabStore::removeUnused() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t removed = 0;
+  std::error_code ec;
+  for (const auto &entry :
+       std::filesystem::directory_iterator(directory_, ec)) {
+    uint32_t id;
+    if (parseSlabId(entry.path(), id) && slabs_.count(id) == 0) {
+      std::filesystem::remove(entry.path(), ec);
+      removed++;
+    }
+  }
+  return removed;
+}
+
+SlabStats SlabStore::getStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  SlabStats stats;
+  for (const auto &[id, slab] : slabs_) {
+    stats.files++;
+    stats.streams += slab->streams;
+    stats.bytes += slab->end;
+    stats.liveBytes += slab->liveBytes;
+  }
+  return stats;
+}
+
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_HAVE_SLAB_STORE
@@ -0,0 +1,61 @@
+#include "memory/storage_backend.h"
+#include "memory/io_uring_storage.h"
+#include "memory/memory_mapped_cache.h"
+#include <mutex>
+#include <spdlog/spdlog.h>
+
+namespace audio_stream {
+
+std::string storageOptionsToString(const StorageOptions &options) {
+  std::string name = "mmap";
+  if (options.type == StorageBackendType::IO_URING) {
+    name = options.directIo ? "io_uring_direct" : "io_uring";
+  }
+  if (options.compression != CompressionCodec::NONE) {
+    name += "+" + compressionCodecToString(options.compression);
+  }
+  return name;
+}
+
+std::optional<StorageOptions> parseStorageOptions(const std::string &name) {
+  StorageOptions options;
+  std::string backend = name;
+  size_t plus = name.find('+');
+  if (plus != std::string::npos) {
+    auto codec = parseCompressionCodec(std::string_view(name).substr(plus + 1));
+    if (!codec || !isCodecAvailable(*codec)) {
+      return std::nullopt;
+    }
+    options.compression = *codec;
+    backend = name.substr(0, plus);
+  }
+
+  if (backend == "mmap") {
+    return options;
+  }
+  if (backend == "io_uring" || backend == "io_uring_direct") {
+    options.type = StorageBackendType::IO_URING;
+    options.directIo = backend == "io_uring_direct";
+    return options;
+  }
+  return std::nullopt;
+}
+
+std::unique_ptr<StorageBackend>
+createStorageBackend(const StorageOptions &options,
+                     const std::string &filePath) {
+  if (options.type == StorageBackendType::IO_URING) {
+#ifdef AUDIO_STREAM_HAVE_IO_URING
+    if (IoUringStorage::isSupported()) {
+      return std::make_unique<IoUringStorage>(filePath, options.directIo);
+    }
+#endif
+    static std::once_flag warned;
+    std::call_once(warned, [] {
+      spdlog::warn("io_uring is not available, using mmap storage");
+    });
+  }
+  return std::make_unique<MemoryMappedCache>(filePath);
+}
+
+} // namespace audio_stream
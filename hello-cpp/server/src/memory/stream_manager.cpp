@@ -1,8 +1,20 @@
 #include "memory/stream_manager.h"
+#include "memory/compressed_storage.h"
 #include "memory/memory_mapped_cache.h"
+#include "metrics/server_metrics.h"
+#include "crc32c.h"
+#include "logging.h"
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <random>
 #include <spdlog/spdlog.h>
+#include <string_view>
+#include <utility>
 
 namespace audio_stream {
 
@@ -10,20 +22,33 @@ StreamManager::StreamManager(const std::string &cacheDir)
     : cacheDir_(cacheDir) {
   // Create cache directory if it doesn't exist
   std::filesystem::create_directories(cacheDir);
+#ifdef AUDIO_STREAM_HAVE_SLAB_STORE
+  slabs_ = std::make_unique<SlabStore>(cacheDir);
+#endif
   spdlog::info("StreamManager initialized with cache directory: {}", cacheDir);
 }
 
 StreamManager::~StreamManager() {
+  stopMaintenance();
+
   // Cleanup all streams
-  std::lock_guard<std::mutex> lock(mutex_);
-  streams_.clear();
+  for (auto &shard : shards_) {
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    shard.streams.clear();
+  }
+}
+
+StreamManager::Shard &StreamManager::shardFor(const std::string &streamId) {
+  return shards_[std::hash<std::string>{}(streamId) % SHARD_COUNT];
 }
 
 bool StreamManager::createStream(const std::string &streamId) {
-  std::lock_guard<std::mutex> lock(mutex_);
+  Shard &shard = shardFor(streamId);
+  std::unique_lock<std::shared_mutex> lock(shard.mutex);
 
-  // Check if stream already exists
-  if (streams_.find(streamId) != streams_.end()) {
+  // Check if stream already exists, or is being stored by putStream
+  if (shard.streams.find(streamId) != shard.streams.end() ||
+      shard.putting.count(streamId) > 0) {
     spdlog::warn("Stream already exists: {}", streamId);
     return false;
   }
@@ -38,12 +63,21 @@ bool StreamManager::createStream(const std::string &streamId) {
     context->status = StreamStatus::UPLOADING;
     context->createdAt = std::chrono::system_clock::now();
     context->lastAccessedAt = context->createdAt;
+    context->durability = getDurabilityPolicy().durability;
 
-    // Create memory-mapped cache file
-    context->mmapFile = std::make_unique<MemoryMappedCache>(context->cachePath);
+    // Keys the proofs of the upload's HAVEs, so it must not be guessable
+    thread_local std::random_device random;
+    for (size_t i = 0; i < context->uploadNonce.size(); i += 4) {
+      uint32_t word = random();
+      std::memcpy(context->uploadNonce.data() + i, &word, sizeof(word));
+    }
+
+    // The cache file itself is created by the first write
+    context->mmapFile =
+        createStorageBackend(getStorageOptions(), context->cachePath);
 
     // Add to registry
-    streams_[streamId] = context;
+    shard.streams[streamId] = context;
 
     spdlog::info("Created stream: {} at path: {}", streamId,
                  context->cachePath);
@@ -56,34 +90,36 @@ bool StreamManager::createStream(const std::string &streamId) {
 
 std::shared_ptr<StreamContext>
 StreamManager::getStream(const std::string &streamId) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  auto it = streams_.find(streamId);
-  if (it != streams_.end()) {
-    // Update last accessed time
-    it->second->lastAccessedAt = std::chrono::system_clock::now();
+  Shard &shard = shardFor(streamId);
+  std::shared_lock<std::shared_mutex> lock(shard.mutex);
+  auto it = shard.streams.find(streamId);
+  if (it != shard.streams.end()) {
+    // Update last accessed time (atomic, no exclusive lock needed)
+    it->second->touch();
     return it->second;
   }
   return nullptr;
 }
 
 bool StreamManager::deleteStream(const std::string &streamId) {
-  std::lock_guard<std::mutex> lock(mutex_);
-
-  auto it = streams_.find(streamId);
-  if (it == streams_.end()) {
-    spdlog::warn("Stream not found for deletion: {}", streamId);
-    return false;
+  std::shared_ptr<StreamContext> stream;
+  {
+    // Remove from registry first so the shard lock is not held while we
+    // wait for in-flight chunk operations
+    Shard &shard = shardFor(streamId);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.streams.find(streamId);
+    if (it == shard.streams.end()) {
+      spdlog::warn("Stream not found for deletion: {}", streamId);
+      return false;
+    }
+    stream = std::move(it->second);
+    shard.streams.erase(it);
   }
+  notifyRemoved(streamId);
 
   try {
-    // Close memory-mapped file
-    it->second->mmapFile.reset();
-
-    // Remove cache file
-    std::filesystem::remove(it->second->cachePath);
-
-    // Remove from registry
-    streams_.erase(it);
+    removeCacheFiles(*stream);
 
     spdlog::info("Deleted stream: {}", streamId);
     return true;
@@ -93,47 +129,164 @@ bool StreamManager::deleteStream(const std::string &streamId) {
   }
 }
 
+void StreamManager::setOnStreamRemoved(RemovedCallback onRemoved) {
+  std::lock_guard<std::mutex> lock(removedMutex_);
+  onRemoved_ = std::move(onRemoved);
+}
+
+void StreamManager::notifyRemoved(const std::string &streamId) {
+  std::lock_guard<std::mutex> lock(removedMutex_);
+  if (onRemoved_) {
+    onRemoved_(streamId);
+  }
+}
+
 std::vector<std::string> StreamManager::listActiveStreams() {
-  std::lock_guard<std::mutex> lock(mutex_);
   std::vector<std::string> streamIds;
-  for (const auto &pair : streams_) {
-    streamIds.push_back(pair.first);
+  for (const auto &shard : shards_) {
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    for (const auto &pair : shard.streams) {
+      streamIds.push_back(pair.first);
+    }
   }
   return streamIds;
 }
 
 bool StreamManager::writeChunk(const std::string &streamId,
                                const std::vector<uint8_t> &data) {
+  return writeChunk(streamId, data.data(), data.size());
+}
+
+bool StreamManager::writeChunk(const std::string &streamId,
+                               const uint8_t *data, size_t size) {
+  return writeChunkAt(streamId, APPEND_OFFSET, data, size);
+}
+
+bool StreamManager::writeChunkAt(const std::string &streamId, uint64_t offset,
+                                 const uint8_t *data, size_t size) {
+  MetricTimer timer(Histogram::WRITE_CHUNK_NS);
   auto stream = getStream(streamId);
   if (!stream) {
     spdlog::error("Stream not found for write: {}", streamId);
     return false;
   }
 
-  std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+  // Shared with other writers; keeps the cache file from being finalized
+  // or removed while this one copies into it
+  std::shared_lock<std::shared_mutex> writeLock(stream->writeMutex);
+  Durability durability;
+  {
+    std::lock_guard<std::mutex> streamLock(stream->contextMutex);
 
-  if (stream->status != StreamStatus::UPLOADING) {
-    spdlog::error("Stream {} is not in uploading state", streamId);
-    return false;
+    // The stream may have been deleted after it was looked up
+    if (!stream->mmapFile) {
+      spdlog::error("Stream {} was deleted", streamId);
+      return false;
+    }
+
+    if (stream->status != StreamStatus::UPLOADING) {
+      spdlog::error("Stream {} is not in uploading state", streamId);
+      return false;
+    }
+
+    if (offset == APPEND_OFFSET) {
+      offset = stream->currentOffset;
+    }
+    durability = stream->durability;
   }
 
   try {
-    // Write data to memory-mapped file
-    if (stream->mmapFile->write(stream->currentOffset, data)) {
-      stream->currentOffset += data.size();
-      stream->totalSize += data.size();
-      stream->lastAccessedAt = std::chrono::system_clock::now();
-
-      // Keep UPLOADING status until stream is explicitly stopped (aligned with
-      // Java server) Status only changes to READY in finalizeStream
-
-      spdlog::debug("Wrote {} bytes to stream {} at offset {}", data.size(),
-                    streamId, stream->currentOffset - data.size());
-      return true;
-    } else {
+    // Copy without contextMutex, so writers at other offsets (and readers
+    // of the filled prefix) proceed alongside
+    if (stream->mmapFile->write(offset, data, size) != size) {
       spdlog::error("Failed to write data to stream {}", streamId);
       return false;
     }
+    uint32_t crc = crc32c::extend(0, data, size);
+    if (offset == 0) {
+      stream->compressionProfile.store(detectCompressionProfile(data, size),
+                                       std::memory_order_relaxed);
+    }
+
+    {
+      std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+      recordWrite(*stream, offset, size, crc);
+    }
+    flushIfDue(*stream, durability);
+    ServerMetrics::getInstance().add(Counter::BYTES_WRITTEN, size);
+
+    // Keep UPLOADING status until stream is explicitly stopped (aligned with
+    // Java server) Status only changes to READY in finalizeStream
+
+    SPDLOG_DEBUG("Wrote {} bytes to stream {} at offset {}", size, streamId,
+                 offset);
+    AUDIO_STREAM_TRACE(streamId, "wrote {} bytes at offset {}", size, offset);
+    return true;
+  } catch (const std::exception &e) {
+    spdlog::error("Error writing to stream {}: {}", streamId, e.what());
+    return false;
+  }
+}
+
+bool StreamManager::writeBatch(
+    const std::string &streamId,
+    const std::vector<StorageBackend::WriteOperation> &operations) {
+  MetricTimer timer(Histogram::WRITE_CHUNK_NS);
+  auto stream = getStream(streamId);
+  if (!stream) {
+    spdlog::error("Stream not found for write: {}", streamId);
+    return false;
+  }
+
+  std::shared_lock<std::shared_mutex> writeLock(stream->writeMutex);
+  Durability durability;
+  {
+    std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+    if (!stream->mmapFile) {
+      spdlog::error("Stream {} was deleted", streamId);
+      return false;
+    }
+    if (stream->status != StreamStatus::UPLOADING) {
+      spdlog::error("Stream {} is not in uploading state", streamId);
+      return false;
+    }
+    durability = stream->durability;
+  }
+
+  try {
+    std::vector<size_t> written = stream->mmapFile->writeBatch(operations);
+    std::vector<uint32_t> crcs(operations.size());
+    for (size_t i = 0; i < written.size(); ++i) {
+      crcs[i] = crc32c::extend(0, operations[i].data, written[i]);
+      if (operations[i].offset == 0) {
+        stream->compressionProfile.store(
+            detectCompressionProfile(operations[i].data, written[i]),
+            std::memory_order_relaxed);
+      }
+    }
+
+    // Record what landed, even if part of the batch failed
+    bool complete = written.size() == operations.size();
+    uint64_t bytes = 0;
+    {
+      std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+      for (size_t i = 0; i < written.size(); ++i) {
+        recordWrite(*stream, operations[i].offset, written[i], crcs[i]);
+        complete = complete && written[i] == operations[i].size;
+        bytes += written[i];
+      }
+    }
+    flushIfDue(*stream, durability);
+    ServerMetrics::getInstance().add(Counter::BYTES_WRITTEN, bytes);
+    if (!complete) {
+      spdlog::error("Failed to write batch of {} chunks to stream {}",
+                    operations.size(), streamId);
+      return false;
+    }
+
+    SPDLOG_DEBUG("Wrote batch of {} chunks to stream {}", operations.size(),
+                 streamId);
+    return true;
   } catch (const std::exception &e) {
     spdlog::error("Error writing to stream {}: {}", streamId, e.what());
     return false;
@@ -142,24 +295,48 @@ bool StreamManager::writeChunk(const std::string &streamId,
 
 std::vector<uint8_t> StreamManager::readChunk(const std::string &streamId,
                                               size_t offset, size_t length) {
+  MetricTimer timer(Histogram::READ_CHUNK_NS);
   auto stream = getStream(streamId);
   if (!stream) {
     spdlog::error("Stream not found for read: {}", streamId);
     return std::vector<uint8_t>();
   }
 
+  BufferView ready = readReady(*stream, offset, length);
+  if (!ready.empty()) {
+    ServerMetrics::getInstance().add(Counter::BYTES_READ, ready.size());
+    return std::vector<uint8_t>(ready.begin(), ready.end());
+  }
+
   std::lock_guard<std::mutex> streamLock(stream->contextMutex);
 
+  // The stream may have been deleted after it was looked up
+  if (!stream->mmapFile) {
+    spdlog::error("Stream {} was deleted", streamId);
+    return std::vector<uint8_t>();
+  }
+
   // Align with Java server: don't check state, read directly from cache
-  // Java server has no state management, can read as long as stream exists
+  // Java server has no state management, can read as long as stream exists.
+  // An upload is only read up to its filled prefix; past it may be holes.
+  length = readableLength(*stream, offset, length);
+  if (length == 0) {
+    return std::vector<uint8_t>();
+  }
 
   try {
     // Read data from memory-mapped file
     std::vector<uint8_t> data = stream->mmapFile->read(offset, length);
-    stream->lastAccessedAt = std::chrono::system_clock::now();
+    ServerMetrics::getInstance().add(Counter::BYTES_READ, data.size());
+    stream->touch();
+    readAhead(*stream, *stream->mmapFile, offset, data.size(),
+              readableBytes(*stream));
+    if (stream->status == StreamStatus::READY) {
+      sealReady(*stream);
+    }
 
-    spdlog::debug("Read {} bytes from stream {} at offset {}", data.size(),
-                  streamId, offset);
+    SPDLOG_DEBUG("Read {} bytes from stream {} at offset {}", data.size(),
+                 streamId, offset);
     return data;
   } catch (const std::exception &e) {
     spdlog::error("Error reading from stream {}: {}", streamId, e.what());
@@ -167,74 +344,1387 @@ std::vector<uint8_t> StreamManager::readChunk(const std::string &streamId,
   }
 }
 
-bool StreamManager::finalizeStream(const std::string &streamId) {
+BufferView StreamManager::readChunkView(const std::string &streamId,
+                                        size_t offset, size_t length) {
+  MetricTimer timer(Histogram::READ_CHUNK_NS);
+  auto stream = getStream(streamId);
+  if (!stream) {
+    spdlog::error("Stream not found for read: {}", streamId);
+    return BufferView();
+  }
+
+  BufferView ready = readReady(*stream, offset, length);
+  if (!ready.empty()) {
+    ServerMetrics::getInstance().add(Counter::BYTES_READ, ready.size());
+    return ready;
+  }
+
+  std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+
+  // The stream may have been deleted after it was looked up
+  if (!stream->mmapFile) {
+    spdlog::error("Stream {} was deleted", streamId);
+    return BufferView();
+  }
+
+  // An upload is only read up to its filled prefix; past it may be holes
+  length = readableLength(*stream, offset, length);
+  if (length == 0) {
+    return BufferView();
+  }
+
+  try {
+    // The view pins the mapping, so it stays valid after the lock is released
+    BufferView view = stream->mmapFile->readView(offset, length);
+    ServerMetrics::getInstance().add(Counter::BYTES_READ, view.size());
+    stream->touch();
+    readAhead(*stream, *stream->mmapFile, offset, view.size(),
+              readableBytes(*stream));
+    // Keyed by the requested length, which READY reads are not clamped to
+    if (stream->status == StreamStatus::READY) {
+      chunkCache_.insert(stream->instanceId, offset, length, view);
+      sealReady(*stream);
+    }
+
+    SPDLOG_DEBUG("Read view of {} bytes from stream {} at offset {}",
+                 view.size(), streamId, offset);
+    return view;
+  } catch (const std::exception &e) {
+    spdlog::error("Error reading from stream {}: {}", streamId, e.what());
+    return BufferView();
+  }
+}
+
+bool StreamManager::finalizeStream(const std::string &streamId,
+                                   size_t expectedSize) {
   auto stream = getStream(streamId);
   if (!stream) {
     spdlog::error("Stream not found for finalization: {}", streamId);
     return false;
   }
 
+  // Wait for chunk writes still copying into the mapping
+  std::unique_lock<std::shared_mutex> writeLock(stream->writeMutex);
   std::lock_guard<std::mutex> streamLock(stream->contextMutex);
 
+  // The stream may have been deleted after it was looked up
+  if (!stream->mmapFile) {
+    spdlog::error("Stream {} was deleted", streamId);
+    return false;
+  }
+
   if (stream->status != StreamStatus::UPLOADING) {
     spdlog::warn("Stream {} is not in uploading state for finalization",
                  streamId);
     return false;
   }
+  stream->storageFailed = false;
+
+  // Every byte up to the end must have arrived, whatever order it came in
+  size_t size = std::max(stream->totalSize, expectedSize);
+  if (!stream->extents.isComplete(size)) {
+    auto gap = stream->extents.firstGap(size);
+    spdlog::warn("Stream {} cannot be finalized: bytes {}-{} of {} missing",
+                 streamId, gap.first, gap.second, size);
+    return false;
+  }
 
   try {
-    // Finalize memory-mapped file (truncates to finalSize and flushes)
-    if (stream->mmapFile->finalize(stream->totalSize)) {
-      stream->status = StreamStatus::READY;
-      stream->lastAccessedAt = std::chrono::system_clock::now();
-
-      spdlog::info("Finalized stream: {} with {} bytes", streamId,
-                   stream->totalSize);
-      return true;
-    } else {
-      spdlog::error("Failed to finalize memory-mapped file for stream {}",
-                    streamId);
+    // Chunks written over earlier ones leave the combined CRC unknown
+    std::optional<uint32_t> checksum = stream->extents.prefixChecksum();
+    if (!checksum) {
+      checksum = checksumCacheFile(*stream->mmapFile, size);
+    }
+    stream->checksum = *checksum;
+
+    // Truncate to the final size, then make it as durable as the tier asks
+    StorageBackend &file = *stream->mmapFile;
+    Durability durability = stream->durability;
+    bool finalized =
+        file.finalize(stream->totalSize, durability == Durability::ON_FINALIZE);
+    if (!finalized ||
+        (durability == Durability::STRICT_SYNC && !file.sync())) {
+      // Retrying the flush would not write pages it failed on: keep the
+      // upload open, empty, for its bytes to be written again
+      spdlog::error("Failed to {} stream {} to disk; its bytes must be sent "
+                    "again",
+                    finalized ? "sync" : "finalize", streamId);
+      stream->extents.clear();
+      stream->currentOffset = 0;
+      stream->checksum = 0;
+      stream->storageFailed = true;
       return false;
     }
+    if (durability == Durability::PERIODIC) {
+      file.flushAsync(); // The rest of the upload, without waiting for it
+    }
+
+    stream->status = StreamStatus::READY;
+    stream->touch();
+
+    // Without a manifest record the stream is dropped on the next
+    // restart, but it is still served by this run
+    if (!appendManifest(manifestRecord(*stream))) {
+      spdlog::warn("Stream {} will not survive a restart", streamId);
+    }
+
+    spdlog::info("Finalized stream: {} with {} bytes ({} durability)",
+                 streamId, stream->totalSize, durabilityToString(durability));
+    return true;
   } catch (const std::exception &e) {
     spdlog::error("Error finalizing stream {}: {}", streamId, e.what());
     return false;
   }
 }
 
-void StreamManager::cleanupOldStreams() {
-  std::lock_guard<std::mutex> lock(mutex_);
+bool StreamManager::putStream(const std::string &streamId,
+                              const uint8_t *data, size_t size,
+                              Durability durability) {
+  MetricTimer timer(Histogram::WRITE_CHUNK_NS);
+  Shard &shard = shardFor(streamId);
+  {
+    // Reserve the id, so the shard is not locked while the bytes are stored
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (shard.streams.count(streamId) > 0 ||
+        !shard.putting.insert(streamId).second) {
+      spdlog::warn("Stream already exists: {}", streamId);
+      return false;
+    }
+  }
+
+  if (durability == Durability::DEFAULT) {
+    durability = getDurabilityPolicy().durability;
+  }
+  auto context = std::make_shared<StreamContext>(streamId);
+  context->totalSize = size;
+  context->currentOffset = size;
+  context->checksum = crc32c::extend(0, data, size);
+  context->extents.assign(size, context->checksum);
+  context->durability = durability;
+  context->compressionProfile.store(detectCompressionProfile(data, size),
+                                    std::memory_order_relaxed);
+  context->status = StreamStatus::READY;
+
+  bool stored = false;
+  try {
+#ifdef AUDIO_STREAM_HAVE_SLAB_STORE
+    if (size > 0 && size <= getSmallStreamLimit()) {
+      SlabLocation location;
+      context->mmapFile = slabs_->append(data, size, durability, location);
+      if (context->mmapFile) {
+        context->slabLocation = location;
+        context->cachePath = slabs_->getSlabPath(location.slab);
+        stored = true;
+      }
+    }
+#endif
+    // Larger streams, or the slab could not take it: a file of its own,
+    // made as durable as finalizeStream makes an upload
+    if (!context->mmapFile) {
+      context->cachePath = getCachePath(streamId);
+      context->mmapFile =
+          createStorageBackend(getStorageOptions(), context->cachePath);
+      StorageBackend &file = *context->mmapFile;
+      stored = file.create(size) &&
+               (size == 0 || file.write(0, data, size) == size) &&
+               file.finalize(size, durability == Durability::ON_FINALIZE) &&
+               (durability != Durability::STRICT_SYNC || file.sync());
+      if (stored && durability == Durability::PERIODIC) {
+        file.flushAsync();
+      }
+    }
+  } catch (const std::exception &e) {
+    spdlog::error("Error storing stream {}: {}", streamId, e.what());
+    stored = false;
+  }
 
+  // Journaled before the stream is visible, so that a delete's record
+  // always follows it
+  if (stored && !appendManifest(manifestRecord(*context))) {
+    spdlog::warn("Stream {} will not survive a restart", streamId);
+  }
+
+  {
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    shard.putting.erase(streamId);
+    if (stored) {
+      shard.streams.emplace(streamId, context);
+    }
+  }
+  if (!stored) {
+    spdlog::error("Failed to store stream {}", streamId);
+    if (context->mmapFile && !context->slabLocation) {
+      context->mmapFile->close();
+      std::error_code ec;
+      std::filesystem::remove(context->cachePath, ec);
+    }
+    return false;
+  }
+
+  ServerMetrics::getInstance().add(Counter::BYTES_WRITTEN, size);
+  spdlog::info("Stored stream: {} with {} bytes in {} ({} durability)",
+               streamId, size, context->cachePath,
+               durabilityToString(durability));
+  return true;
+}
+
+void StreamManager::setSmallStreamLimit(size_t bytes) {
+  smallStreamLimit_.store(bytes, std::memory_order_relaxed);
+  spdlog::info("Small stream limit: {} KB", bytes / 1024);
+}
+
+size_t StreamManager::getSmallStreamLimit() const {
+  return smallStreamLimit_.load(std::memory_order_relaxed);
+}
+
+void StreamManager::cleanupOldStreams() {
   auto now = std::chrono::system_clock::now();
-  auto cutoff =
-      now - std::chrono::hours(24); // Remove streams older than 24 hours
+  auto cutoff = now - getCacheBudget().streamTtl;
+
+  for (auto &shard : shards_) {
+    // Unlink expired streams under the shard lock, close them outside it
+    std::vector<std::shared_ptr<StreamContext>> expired;
+    {
+      std::unique_lock<std::shared_mutex> lock(shard.mutex);
+      auto it = shard.streams.begin();
+      while (it != shard.streams.end()) {
+        if (it->second->lastAccessedAt.load(std::memory_order_relaxed) <
+            cutoff) {
+          expired.push_back(std::move(it->second));
+          it = shard.streams.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
 
-  auto it = streams_.begin();
-  while (it != streams_.end()) {
-    if (it->second->lastAccessedAt < cutoff) {
-      spdlog::info("Cleaning up old stream: {}", it->first);
+    for (const auto &stream : expired) {
+      spdlog::info("Cleaning up old stream: {}", stream->streamId);
+      expiredStreams_.fetch_add(1, std::memory_order_relaxed);
+      notifyRemoved(stream->streamId);
 
       try {
-        // Close memory-mapped file
-        it->second->mmapFile.reset();
+        removeCacheFiles(*stream);
+      } catch (const std::exception &e) {
+        spdlog::error("Error cleaning up stream {}: {}", stream->streamId,
+                      e.what());
+      }
+    }
+  }
+}
 
-        // Remove cache file
-        std::filesystem::remove(it->second->cachePath);
+void StreamManager::setCacheBudget(const CacheBudget &budget) {
+  std::lock_guard<std::mutex> lock(budgetMutex_);
+  budget_ = budget;
+  spdlog::info("Cache budget: {} MB disk, {} MB mapped, {} MB chunk cache, "
+               "{}s stream TTL",
+               budget.maxDiskBytes / (1024 * 1024),
+               budget.maxMappedBytes / (1024 * 1024),
+               budget.maxChunkCacheBytes / (1024 * 1024),
+               budget.streamTtl.count());
+  chunkCache_.setMaxBytes(budget.maxChunkCacheBytes);
+}
 
-        // Remove from registry
-        it = streams_.erase(it);
-      } catch (const std::exception &e) {
-        spdlog::error("Error cleaning up stream {}: {}", it->first, e.what());
-        ++it;
+CacheBudget StreamManager::getCacheBudget() const {
+  std::lock_guard<std::mutex> lock(budgetMutex_);
+  return budget_;
+}
+
+void StreamManager::setStorageOptions(const StorageOptions &options) {
+  std::lock_guard<std::mutex> lock(storageMutex_);
+  storage_ = options;
+  spdlog::info("Storage backend: {}", storageOptionsToString(options));
+}
+
+StorageOptions StreamManager::getStorageOptions() const {
+  std::lock_guard<std::mutex> lock(storageMutex_);
+  return storage_;
+}
+
+void StreamManager::setDurabilityPolicy(const DurabilityPolicy &policy) {
+  std::lock_guard<std::mutex> lock(durabilityMutex_);
+  durability_ = policy;
+  if (durability_.durability == Durability::DEFAULT) {
+    durability_.durability = Durability::ON_FINALIZE;
+  }
+  flushBytes_.store(policy.flushBytes, std::memory_order_relaxed);
+  spdlog::info("Durability: {} (periodic write-back every {} ms or {} MB)",
+               durabilityToString(durability_.durability),
+               policy.flushInterval.count(),
+               policy.flushBytes / (1024 * 1024));
+}
+
+DurabilityPolicy StreamManager::getDurabilityPolicy() const {
+  std::lock_guard<std::mutex> lock(durabilityMutex_);
+  return durability_;
+}
+
+std::vector<std::shared_ptr<StreamContext>>
+StreamManager::snapshotStreams() const {
+  std::vector<std::shared_ptr<StreamContext>> streams;
+  for (const auto &shard : shards_) {
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    for (const auto &[id, stream] : shard.streams) {
+      streams.push_back(stream);
+    }
+  }
+  return streams;
+}
+
+CacheStats StreamManager::getCacheStats() const {
+  CacheStats stats;
+  for (const auto &stream : snapshotStreams()) {
+    std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+    stats.streams++;
+    if (stream->status == StreamStatus::READY) {
+      stats.readyStreams++;
+    }
+    if (stream->mmapFile) {
+      uint64_t disk = cacheFileBytes(*stream);
+      stats.diskBytes += disk;
+      stats.mappedBytes += stream->mmapFile->getMappedBytes();
+      if (stream->sharedFile) {
+        stats.deduplicationSavedBytes +=
+            (stream->compression != CompressionCodec::NONE
+                 ? stream->storedBytes
+                 : stream->totalSize) -
+            disk;
+      }
+    }
+    if (stream->mmapFile && stream->compression != CompressionCodec::NONE) {
+      stats.compressedStreams++;
+      stats.compressionSavedBytes += stream->totalSize - stream->storedBytes;
+    }
+  }
+
+  CacheBudget budget = getCacheBudget();
+  stats.maxDiskBytes = budget.maxDiskBytes;
+  stats.maxMappedBytes = budget.maxMappedBytes;
+  stats.evictedStreams = evictedStreams_.load(std::memory_order_relaxed);
+  stats.expiredStreams = expiredStreams_.load(std::memory_order_relaxed);
+  stats.releasedMappings = releasedMappings_.load(std::memory_order_relaxed);
+  stats.releasedBytes = releasedBytes_.load(std::memory_order_relaxed);
+  stats.readaheadHits = readaheadHits_.load(std::memory_order_relaxed);
+  stats.readaheadMisses = readaheadMisses_.load(std::memory_order_relaxed);
+  stats.readaheadBytes = readaheadBytes_.load(std::memory_order_relaxed);
+  stats.chunkCacheBytes = chunkCache_.getBytes();
+  stats.chunkCacheHits = chunkCache_.getHits();
+  stats.chunkCacheMisses = chunkCache_.getMisses();
+  stats.deduplicatedStreams =
+      deduplicatedStreams_.load(std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(blockMutex_);
+    stats.indexedBlocks = blockIndex_.size();
+  }
+  stats.haveBlocks = haveBlocks_.load(std::memory_order_relaxed);
+  stats.haveBytes = haveBytes_.load(std::memory_order_relaxed);
+#ifdef AUDIO_STREAM_HAVE_SLAB_STORE
+  SlabStats slabs = slabs_->getStats();
+  stats.slabFiles = slabs.files;
+  stats.slabStreams = slabs.streams;
+  stats.slabBytes = slabs.bytes;
+  stats.slabLiveBytes = slabs.liveBytes;
+#endif
+  return stats;
+}
+
+void StreamManager::enforceCacheBudget() {
+  struct Candidate {
+    std::shared_ptr<StreamContext> stream;
+    std::chrono::system_clock::time_point lastAccessed;
+    uint64_t diskBytes;
+    uint64_t mappedBytes;
+  };
+
+  CacheBudget budget = getCacheBudget();
+  uint64_t diskBytes = 0;
+  uint64_t mappedBytes = 0;
+  std::vector<Candidate> candidates;
+
+  for (auto &stream : snapshotStreams()) {
+    std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+    if (!stream->mmapFile) {
+      continue;
+    }
+    uint64_t disk = cacheFileBytes(*stream);
+    uint64_t mapped = stream->mmapFile->getMappedBytes();
+    diskBytes += disk;
+    mappedBytes += mapped;
+    if (stream->status == StreamStatus::READY) {
+      candidates.push_back(
+          {stream, stream->lastAccessedAt.load(std::memory_order_relaxed),
+           disk, mapped});
+    }
+  }
+
+  if (diskBytes <= budget.maxDiskBytes &&
+      mappedBytes <= budget.maxMappedBytes) {
+    cacheFull_.store(false, std::memory_order_relaxed);
+    return;
+  }
+
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Candidate &a, const Candidate &b) {
+              return a.lastAccessed < b.lastAccessed;
+            });
+
+  // Memory first: a cold stream that loses its mappings is still served,
+  // it only faults its pages back in on the next GET
+  for (const auto &candidate : candidates) {
+    if (mappedBytes <= budget.maxMappedBytes) {
+      break;
+    }
+    if (candidate.mappedBytes == 0) {
+      continue;
+    }
+
+    std::lock_guard<std::mutex> streamLock(candidate.stream->contextMutex);
+    if (!candidate.stream->mmapFile) {
+      continue;
+    }
+    uint64_t released = candidate.stream->mmapFile->releaseMappings();
+    mappedBytes -= std::min(mappedBytes, released);
+    releasedMappings_.fetch_add(1, std::memory_order_relaxed);
+    releasedBytes_.fetch_add(released, std::memory_order_relaxed);
+  }
+
+  for (const auto &candidate : candidates) {
+    if (diskBytes <= budget.maxDiskBytes) {
+      break;
+    }
+
+    // Skip a stream read since the snapshot; it is no longer the coldest
+    const std::string &streamId = candidate.stream->streamId;
+    {
+      Shard &shard = shardFor(streamId);
+      std::unique_lock<std::shared_mutex> lock(shard.mutex);
+      auto it = shard.streams.find(streamId);
+      if (it == shard.streams.end() || it->second != candidate.stream ||
+          candidate.stream->lastAccessedAt.load(std::memory_order_relaxed) !=
+              candidate.lastAccessed) {
+        continue;
+      }
+      shard.streams.erase(it);
+    }
+    notifyRemoved(streamId);
+
+    spdlog::info("Evicting stream {} ({} bytes) to meet the disk budget",
+                 streamId, candidate.diskBytes);
+    try {
+      removeCacheFiles(*candidate.stream);
+    } catch (const std::exception &e) {
+      spdlog::error("Error evicting stream {}: {}", streamId, e.what());
+    }
+    diskBytes -= std::min(diskBytes, candidate.diskBytes);
+    evictedStreams_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  cacheFull_.store(diskBytes > budget.maxDiskBytes,
+                   std::memory_order_relaxed);
+  if (diskBytes > budget.maxDiskBytes ||
+      mappedBytes > budget.maxMappedBytes) {
+    spdlog::warn("Cache over budget after eviction: {} MB disk, {} MB mapped "
+                 "(uploads in progress are not evicted)",
+                 diskBytes / (1024 * 1024), mappedBytes / (1024 * 1024));
+  }
+}
+
+void StreamManager::compressReadyStreams() {
+  const CompressionCodec codec = getStorageOptions().compression;
+  for (auto &stream : snapshotStreams()) {
+    {
+      std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+      if (!stream->mmapFile || stream->status != StreamStatus::READY ||
+          stream->compressionChecked) {
+        continue;
+      }
+      stream->compressionChecked = true;
+    }
+
+    // Shared like a chunk write: keeps the file from being removed while
+    // it is read; READY streams take no other writes
+    std::shared_lock<std::shared_mutex> writeLock(stream->writeMutex);
+    StorageBackend *source;
+    uint64_t size;
+    uint32_t checksum;
+    bool shared;
+    {
+      std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+      if (!stream->mmapFile) {
+        continue;
+      }
+      source = stream->mmapFile.get();
+      size = stream->totalSize;
+      checksum = stream->checksum;
+      shared = stream->sharedFile || stream->slabLocation.has_value();
+    }
+
+    BufferView head = source->readView(
+        0, static_cast<size_t>(std::min<uint64_t>(
+               size, CompressedStorage::BLOCK_SIZE)));
+    CompressionProfile profile =
+        detectCompressionProfile(head.begin(), head.size());
+    stream->compressionProfile.store(profile, std::memory_order_relaxed);
+    // A shared file is left as it is: compressing one link unshares it,
+    // and a slab holds other streams too
+    if (codec == CompressionCodec::NONE || !profile.compressible || shared ||
+        stream->compression != CompressionCodec::NONE) {
+      continue;
+    }
+
+#ifdef AUDIO_STREAM_HAVE_COMPRESSED_STORAGE
+    std::string path = getCompressedPath(stream->streamId);
+    uint64_t stored = CompressedStorage::compress(
+        *source, size, checksum, path, codec, profile.pcm16Channels);
+    if (stored == 0) {
+      continue;
+    }
+    auto compressed = std::make_unique<CompressedStorage>(path);
+    if (!compressed->open()) {
+      std::filesystem::remove(path);
+      continue;
+    }
+    writeLock.unlock();
+
+    // Swap files like removeCacheFiles retires one, unless the stream was
+    // deleted meanwhile
+    std::string oldPath;
+    std::string record;
+    {
+      std::unique_lock<std::shared_mutex> exclusive(stream->writeMutex);
+      std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+      if (stream->mmapFile.get() == source) {
+        stream->readyFile.store(nullptr, std::memory_order_release);
+        stream->mmapFile->close();
+        stream->retiredFiles.push_back(std::move(stream->mmapFile));
+        stream->mmapFile = std::move(compressed);
+        stream->compression = codec;
+        stream->storedBytes = stored;
+        oldPath = stream->cachePath;
+        stream->cachePath = path;
+        sealReady(*stream);
+        record = manifestRecord(*stream);
+      }
+    }
+    if (record.empty()) {
+      std::filesystem::remove(path);
+      continue;
+    }
+
+    // Until the record is in the manifest a restart still restores the
+    // original file, so only then is it removed
+    if (appendManifest(record)) {
+      std::error_code ec;
+      std::filesystem::remove(oldPath, ec);
+    }
+    spdlog::info("Compressed stream {} with {}: {} of {} bytes ({:.0f}%)",
+                 stream->streamId, compressionCodecToString(codec), stored,
+                 size, 100.0 * static_cast<double>(stored) / size);
+#endif
+  }
+}
+
+void StreamManager::deduplicateReadyStreams() {
+  {
+    std::lock_guard<std::mutex> lock(contentMutex_);
+    for (auto it = contentIndex_.begin(); it != contentIndex_.end();) {
+      it = it->second.expired() ? contentIndex_.erase(it) : std::next(it);
+    }
+  }
+
+  for (auto &stream : snapshotStreams()) {
+    ContentKey key;
+    {
+      std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+      // A slab is not linked to: it holds other streams too
+      if (!stream->mmapFile || stream->status != StreamStatus::READY ||
+          stream->dedupChecked || stream->totalSize == 0 ||
+          stream->slabLocation) {
+        continue;
+      }
+      stream->dedupChecked = true;
+      key = {stream->totalSize, stream->checksum};
+    }
+
+    // The first live stream of each content is the one others link to
+    std::shared_ptr<StreamContext> canonical;
+    {
+      std::lock_guard<std::mutex> lock(contentMutex_);
+      std::weak_ptr<StreamContext> &entry = contentIndex_[key];
+      canonical = entry.lock();
+      bool live = false;
+      if (canonical && canonical != stream) {
+        std::lock_guard<std::mutex> streamLock(canonical->contextMutex);
+        live = canonical->mmapFile != nullptr;
+      }
+      if (!live) {
+        entry = stream;
+        continue;
+      }
+    }
+    linkDuplicate(*stream, *canonical);
+  }
+}
+
+void StreamManager::linkDuplicate(StreamContext &stream,
+                                  StreamContext &canonical) {
+  namespace fs = std::filesystem;
+  StorageBackend *source;
+  std::string canonicalPath;
+  CompressionCodec codec;
+  uint64_t stored;
+  bool linked;
+  {
+    // Shared like chunk writes: neither file is removed while it is read
+    std::shared_lock<std::shared_mutex> writeLock(stream.writeMutex);
+    std::shared_lock<std::shared_mutex> canonicalLock(canonical.writeMutex);
+    StorageBackend *original;
+    std::string path;
+    uint64_t size;
+    {
+      std::lock_guard<std::mutex> streamLock(stream.contextMutex);
+      if (!stream.mmapFile) {
+        return;
+      }
+      source = stream.mmapFile.get();
+      path = stream.cachePath;
+      size = stream.totalSize;
+    }
+    {
+      std::lock_guard<std::mutex> streamLock(canonical.contextMutex);
+      if (!canonical.mmapFile) {
+        return;
+      }
+      original = canonical.mmapFile.get();
+      canonicalPath = canonical.cachePath;
+      codec = canonical.compression;
+      stored = canonical.storedBytes;
+    }
+
+    // Linked by an earlier run: only the flags were lost in the restart
+    std::error_code ec;
+    linked = fs::equivalent(path, canonicalPath, ec);
+    if (!linked && !sameContent(*source, *original, size)) {
+      spdlog::debug("Streams {} and {} share size and CRC32C only",
+                    stream.streamId, canonical.streamId);
+      return;
+    }
+  }
+
+  std::string oldPath;
+  std::string record;
+  if (!linked) {
+    std::string target = codec != CompressionCodec::NONE
+                             ? getCompressedPath(stream.streamId)
+                             : getCachePath(stream.streamId);
+    std::unique_lock<std::shared_mutex> writeLock(stream.writeMutex);
+    std::lock_guard<std::mutex> streamLock(stream.contextMutex);
+    if (stream.mmapFile.get() != source) {
+      return;
+    }
+
+    // Link under a temporary name, then rename it over the stream's file
+    std::string tempPath = target + ".tmp";
+    std::error_code ec;
+    fs::remove(tempPath, ec);
+    fs::create_hard_link(canonicalPath, tempPath, ec);
+    if (!ec) {
+      fs::rename(tempPath, target, ec);
+    }
+    if (ec) {
+      spdlog::warn("Failed to link stream {} to {}: {}", stream.streamId,
+                   canonicalPath, ec.message());
+      fs::remove(tempPath, ec);
+      stream.dedupChecked = false; // Retried on the next pass
+      return;
+    }
+
+    // Swap files like removeCacheFiles retires one
+    stream.readyFile.store(nullptr, std::memory_order_release);
+    stream.mmapFile->close();
+    stream.retiredFiles.push_back(std::move(stream.mmapFile));
+#ifdef AUDIO_STREAM_HAVE_COMPRESSED_STORAGE
+    if (codec != CompressionCodec::NONE) {
+      stream.mmapFile = std::make_unique<CompressedStorage>(target);
+    }
+#endif
+    if (!stream.mmapFile) {
+      stream.mmapFile = createStorageBackend(getStorageOptions(), target);
+    }
+    stream.compression = codec;
+    stream.storedBytes = stored;
+    oldPath = stream.cachePath;
+    stream.cachePath = target;
+    stream.sharedFile = true;
+    record = manifestRecord(stream);
+  } else {
+    std::lock_guard<std::mutex> streamLock(stream.contextMutex);
+    stream.sharedFile = true;
+  }
+  {
+    std::lock_guard<std::mutex> streamLock(canonical.contextMutex);
+    canonical.sharedFile = true;
+  }
+  if (linked) {
+    return;
+  }
+
+  // The file changes name when the other one is compressed and this one is
+  // not (or the other way round); the old one goes once the record is in
+  if (appendManifest(record) && oldPath != stream.cachePath) {
+    std::error_code ec;
+    fs::remove(oldPath, ec);
+  }
+  deduplicatedStreams_.fetch_add(1, std::memory_order_relaxed);
+  spdlog::info("Stream {} has the content of stream {}, sharing its file",
+               stream.streamId, canonical.streamId);
+}
+
+void StreamManager::indexReadyBlocks() {
+  {
+    std::lock_guard<std::mutex> lock(blockMutex_);
+    for (auto it = blockIndex_.begin(); it != blockIndex_.end();) {
+      it = it->second.stream.expired() ? blockIndex_.erase(it) : std::next(it);
+    }
+  }
+
+  std::vector<uint8_t> block(HAVE_BLOCK_SIZE);
+  uint64_t hashed = 0;
+  for (auto &stream : snapshotStreams()) {
+    if (hashed >= BLOCK_INDEX_BYTES_PER_PASS) {
+      break;
+    }
+    uint64_t size;
+    {
+      std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+      if (!stream->mmapFile || stream->status != StreamStatus::READY ||
+          stream->blocksIndexed || stream->totalSize < HAVE_BLOCK_SIZE) {
+        continue;
+      }
+      stream->blocksIndexed = true;
+      size = stream->totalSize;
+    }
+
+    // Hashed before the index is locked; a stream deleted meanwhile adds
+    // nothing
+    std::vector<std::pair<sha256::Digest, BlockLocation>> blocks;
+    for (uint64_t offset = 0; offset < size; offset += HAVE_BLOCK_SIZE) {
+      size_t length =
+          static_cast<size_t>(std::min<uint64_t>(size - offset, block.size()));
+      if (!copyReadyRange(*stream, offset, length, block.data())) {
+        blocks.clear();
+        break;
+      }
+      blocks.push_back({sha256::digest(block.data(), length),
+                        BlockLocation{stream, offset, length}});
+    }
+    hashed += size;
+
+    // The first live stream with a block keeps it
+    std::lock_guard<std::mutex> lock(blockMutex_);
+    for (auto &[digest, location] : blocks) {
+      auto [it, inserted] = blockIndex_.emplace(digest, location);
+      if (!inserted && it->second.stream.expired()) {
+        it->second = std::move(location);
+      }
+    }
+  }
+}
+
+size_t StreamManager::writeStoredBlock(const std::string &streamId,
+                                       uint64_t offset, size_t length,
+                                       const sha256::Digest &digest,
+                                       const sha256::Digest &proof) {
+  auto stream = getStream(streamId);
+  if (!stream || length == 0 || length > HAVE_BLOCK_SIZE) {
+    return 0;
+  }
+
+  std::shared_ptr<StreamContext> source;
+  uint64_t sourceOffset;
+  {
+    std::lock_guard<std::mutex> lock(blockMutex_);
+    auto it = blockIndex_.find(digest);
+    if (it == blockIndex_.end() || it->second.length != length) {
+      return 0;
+    }
+    source = it->second.stream.lock();
+    sourceOffset = it->second.offset;
+  }
+  if (!source || source == stream) {
+    return 0;
+  }
+
+  std::vector<uint8_t> block(length);
+  if (!copyReadyRange(*source, sourceOffset, length, block.data())) {
+    return 0;
+  }
+  // The nonce never changes after creation, so it is read without a lock
+  if (sha256::proof(stream->uploadNonce.data(), stream->uploadNonce.size(),
+                    block.data(), length) != proof) {
+    spdlog::warn("HAVE for stream {} at offset {} has a wrong proof",
+                 streamId, offset);
+    return 0;
+  }
+  if (!writeChunkAt(streamId, offset, block.data(), length)) {
+    return 0;
+  }
+  haveBlocks_.fetch_add(1, std::memory_order_relaxed);
+  haveBytes_.fetch_add(length, std::memory_order_relaxed);
+  SPDLOG_DEBUG("Stored {} bytes of stream {} at offset {} from stream {}",
+               length, streamId, offset, source->streamId);
+  return length;
+}
+
+void StreamManager::startMaintenance(std::chrono::milliseconds interval) {
+  std::lock_guard<std::mutex> lock(maintenanceMutex_);
+  if (maintenanceThread_.joinable()) {
+    return;
+  }
+  maintenanceStop_ = false;
+  maintenanceThread_ =
+      std::thread(&StreamManager::maintenanceLoop, this, interval);
+  flushThread_ = std::thread(&StreamManager::flushLoop, this);
+}
+
+void StreamManager::stopMaintenance() {
+  std::thread thread;
+  std::thread flushThread;
+  {
+    std::lock_guard<std::mutex> lock(maintenanceMutex_);
+    maintenanceStop_ = true;
+    thread = std::move(maintenanceThread_);
+    flushThread = std::move(flushThread_);
+  }
+  maintenanceCv_.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+  }
+  if (flushThread.joinable()) {
+    flushThread.join();
+  }
+}
+
+void StreamManager::maintenanceLoop(std::chrono::milliseconds interval) {
+  std::unique_lock<std::mutex> lock(maintenanceMutex_);
+  while (!maintenanceCv_.wait_for(lock, interval,
+                                  [this] { return maintenanceStop_; })) {
+    lock.unlock();
+    try {
+      cleanupOldStreams();
+      deduplicateReadyStreams();
+      indexReadyBlocks();
+      compressReadyStreams();
+      enforceCacheBudget();
+    } catch (const std::exception &e) {
+      spdlog::error("Cache maintenance failed: {}", e.what());
+    }
+    lock.lock();
+  }
+}
+
+void StreamManager::flushLoop() {
+  std::unique_lock<std::mutex> lock(maintenanceMutex_);
+  while (!maintenanceCv_.wait_for(lock,
+                                  getDurabilityPolicy().flushInterval,
+                                  [this] { return maintenanceStop_; })) {
+    lock.unlock();
+    try {
+      flushPeriodicStreams();
+    } catch (const std::exception &e) {
+      spdlog::error("Periodic write-back failed: {}", e.what());
+    }
+    lock.lock();
+  }
+}
+
+void StreamManager::flushPeriodicStreams() {
+  for (const auto &stream : snapshotStreams()) {
+    // Keeps the cache file open; concurrent chunk writes go on meanwhile
+    std::shared_lock<std::shared_mutex> writeLock(stream->writeMutex);
+    {
+      std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+      if (!stream->mmapFile || stream->status != StreamStatus::UPLOADING ||
+          stream->durability != Durability::PERIODIC) {
+        continue;
+      }
+    }
+    if (stream->mmapFile->getUnflushedBytes() > 0) {
+      stream->mmapFile->flushAsync();
+    }
+  }
+}
+
+size_t StreamManager::restoreStreams() {
+  auto startTime = std::chrono::steady_clock::now();
+  namespace fs = std::filesystem;
+
+  const StorageOptions storage = getStorageOptions();
+  std::string journal;
+  {
+    std::ifstream in(getManifestPath(), std::ios::binary);
+    journal.assign(std::istreambuf_iterator<char>(in),
+                   std::istreambuf_iterator<char>());
+  }
+
+  // Parse in parallel, one contiguous run of lines per thread, so records
+  // can still be applied in journal order afterwards
+  struct Record {
+    std::string streamId;
+    std::shared_ptr<StreamContext> context; // nullptr: stream was deleted
+    std::string_view line;                  // Reused when compacting
+  };
+  size_t threadCount = std::min<size_t>(
+      std::max(1u, std::thread::hardware_concurrency()),
+      journal.size() / (1024 * 1024) + 1);
+  std::vector<std::vector<Record>> parsed(threadCount);
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threadCount; ++t) {
+    workers.emplace_back([&, t]() {
+      size_t begin = journal.size() * t / threadCount;
+      size_t end = journal.size() * (t + 1) / threadCount;
+      // Each run starts after the newline preceding its nominal start
+      if (t > 0) {
+        begin = journal.rfind('\n', begin - 1);
+        begin = begin == std::string::npos ? 0 : begin + 1;
+      }
+      if (t + 1 < threadCount) {
+        end = journal.rfind('\n', end - 1);
+        end = end == std::string::npos ? 0 : end + 1;
+      }
+
+      while (begin < end) {
+        size_t lineEnd = journal.find('\n', begin);
+        if (lineEnd == std::string::npos || lineEnd > end) {
+          lineEnd = end;
+        }
+        // A torn last line from a crash fails to parse and is skipped
+        std::string_view line(journal.data() + begin, lineEnd - begin);
+        auto j = nlohmann::json::parse(line.begin(), line.end(), nullptr,
+                                       false);
+        begin = lineEnd + 1;
+        if (j.is_discarded() || !j.is_object() || !j.contains("streamId")) {
+          continue;
+        }
+
+        try {
+          Record record{j["streamId"].get<std::string>(), nullptr, line};
+          if (j.value("op", "") == "ready") {
+            auto context = std::make_shared<StreamContext>(record.streamId);
+            context->cachePath = getCachePath(record.streamId);
+            context->totalSize = j["size"].get<size_t>();
+            context->currentOffset = context->totalSize;
+            context->checksum = static_cast<uint32_t>(
+                std::stoul(j.value("crc32c", "0"), nullptr, 16));
+            context->extents.assign(context->totalSize, context->checksum);
+            context->createdAt = std::chrono::system_clock::time_point(
+                std::chrono::milliseconds(j.value("createdAt", int64_t{0})));
+            context->status = StreamStatus::READY;
+            // Opened and mapped by the first read
+            if (j.contains("slab")) {
+#ifdef AUDIO_STREAM_HAVE_SLAB_STORE
+              // Its slab is opened once all records are applied
+              context->slabLocation =
+                  SlabLocation{j["slab"].get<uint32_t>(),
+                               j["slabOffset"].get<uint64_t>()};
+              context->cachePath =
+                  slabs_->getSlabPath(context->slabLocation->slab);
+#else
+              throw std::runtime_error("slab files unsupported");
+#endif
+            } else if (j.contains("compression")) {
+#ifdef AUDIO_STREAM_HAVE_COMPRESSED_STORAGE
+              auto codec = parseCompressionCodec(
+                  j["compression"].get<std::string>());
+              if (!codec || !isCodecAvailable(*codec)) {
+                throw std::runtime_error("unavailable codec " +
+                                         j["compression"].dump());
+              }
+              context->compression = *codec;
+              context->storedBytes = j["storedSize"].get<uint64_t>();
+              context->cachePath = getCompressedPath(record.streamId);
+              context->mmapFile =
+                  std::make_unique<CompressedStorage>(context->cachePath);
+#else
+              throw std::runtime_error("compressed cache files unsupported");
+#endif
+            } else {
+              context->mmapFile =
+                  createStorageBackend(storage, context->cachePath);
+            }
+            record.context = std::move(context);
+          }
+          parsed[t].push_back(std::move(record));
+        } catch (const std::exception &e) {
+          spdlog::warn("Skipping invalid manifest record: {}", e.what());
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  std::unordered_map<std::string, Record> latest;
+  for (auto &records : parsed) {
+    for (auto &record : records) {
+      if (record.context) {
+        latest[record.streamId] = std::move(record);
+      } else {
+        latest.erase(record.streamId);
+      }
+    }
+  }
+  parsed.clear();
+
+  // One directory listing instead of a stat per stream; sizes are checked
+  // when a stream is first opened. Keyed by file name: a stream's file is
+  // id.cache, or id.cachez once compressed (id.cachez.tmp while it is).
+  std::unordered_map<std::string, fs::path> cacheFiles;
+  std::error_code ec;
+  for (const auto &entry : fs::directory_iterator(cacheDir_, ec)) {
+    auto extension = entry.path().extension();
+    if (extension == ".cache" || extension == ".cachez" ||
+        entry.path().stem().extension() == ".cachez") {
+      cacheFiles.emplace(entry.path().filename().string(), entry.path());
+    }
+  }
+
+  size_t restored = 0;
+  size_t missing = 0;
+  std::string compacted;
+  compacted.reserve(journal.size());
+  for (auto &[streamId, record] : latest) {
+    std::optional<SlabLocation> slab = record.context->slabLocation;
+    if (slab) {
+#ifdef AUDIO_STREAM_HAVE_SLAB_STORE
+      record.context->mmapFile =
+          slabs_->restore(*slab, record.context->totalSize);
+#endif
+      if (!record.context->mmapFile) {
+        missing++;
+        continue;
       }
     } else {
-      ++it;
+      auto file = cacheFiles.find(
+          fs::path(record.context->cachePath).filename().string());
+      if (file == cacheFiles.end()) {
+        missing++;
+        continue;
+      }
+      cacheFiles.erase(file);
     }
+
+    compacted.append(record.line).push_back('\n');
+    Shard &shard = shardFor(streamId);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (shard.streams.emplace(streamId, std::move(record.context)).second) {
+      restored++;
+    } else if (slab) {
+#ifdef AUDIO_STREAM_HAVE_SLAB_STORE
+      slabs_->release(*slab, record.context->totalSize);
+#endif
+    }
+  }
+
+  size_t removed = cacheFiles.size();
+  for (const auto &[streamId, path] : cacheFiles) {
+    fs::remove(path, ec);
+  }
+#ifdef AUDIO_STREAM_HAVE_SLAB_STORE
+  // Slabs none of the restored streams are stored in
+  removed += slabs_->removeUnused();
+#endif
+
+  // Rewrite the journal with only the live streams, then keep appending
+  {
+    std::lock_guard<std::mutex> lock(manifestMutex_);
+    manifest_.close();
+    std::string tempPath = getManifestPath() + ".tmp";
+    {
+      std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+      out << compacted;
+    }
+    fs::rename(tempPath, getManifestPath(), ec);
+    if (ec) {
+      spdlog::error("Failed to compact stream manifest: {}", ec.message());
+    }
+  }
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - startTime);
+  spdlog::info("Restored {} cached streams from {} in {} ms ({} missing, {} "
+               "incomplete cache files removed)",
+               restored, cacheDir_, elapsed.count(), missing, removed);
+  return restored;
+}
+
+std::string StreamManager::manifestRecord(const StreamContext &stream) const {
+  nlohmann::json j;
+  j["op"] = "ready";
+  j["streamId"] = stream.streamId;
+  j["size"] = stream.totalSize;
+  j["crc32c"] = crc32c::toHex(stream.checksum);
+  if (stream.compression != CompressionCodec::NONE) {
+    j["compression"] = compressionCodecToString(stream.compression);
+    j["storedSize"] = stream.storedBytes;
+  }
+  if (stream.slabLocation) {
+    j["slab"] = stream.slabLocation->slab;
+    j["slabOffset"] = stream.slabLocation->offset;
+  }
+  j["createdAt"] = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       stream.createdAt.time_since_epoch())
+                       .count();
+  return j.dump() + "\n";
+}
+
+bool StreamManager::appendManifest(const std::string &record) {
+  std::lock_guard<std::mutex> lock(manifestMutex_);
+  if (!manifest_.is_open()) {
+    manifest_.open(getManifestPath(), std::ios::binary | std::ios::app);
+  }
+  manifest_ << record;
+  manifest_.flush();
+  if (!manifest_) {
+    spdlog::error("Failed to append to stream manifest {}",
+                  getManifestPath());
+    manifest_.close();
+    return false;
+  }
+  return true;
+}
+
+void StreamManager::removeCacheFiles(StreamContext &stream) {
+  // Close memory-mapped file once in-flight chunk operations finish
+  bool wasReady;
+  std::optional<SlabLocation> slab;
+  {
+    std::unique_lock<std::shared_mutex> writeLock(stream.writeMutex);
+    std::lock_guard<std::mutex> streamLock(stream.contextMutex);
+    wasReady = stream.status == StreamStatus::READY;
+    slab = std::exchange(stream.slabLocation, std::nullopt);
+    stream.readyFile.store(nullptr, std::memory_order_release);
+    if (stream.mmapFile) {
+      // Closing waits for lock-free readers of the file to leave it
+      stream.mmapFile->close();
+      stream.retiredFiles.push_back(std::move(stream.mmapFile));
+    }
+  }
+
+  // Only READY streams have cached chunks. A lock-free read racing with
+  // this may still add one; its instanceId never matches again, so it
+  // just ages out
+  if (wasReady) {
+    chunkCache_.erase(stream.instanceId);
+  }
+
+  // Only finalized streams are in the manifest
+  if (wasReady) {
+    nlohmann::json j;
+    j["op"] = "delete";
+    j["streamId"] = stream.streamId;
+    appendManifest(j.dump() + "\n");
+  }
+
+  // Remove cache file; a slab goes once none of its streams are left
+  if (slab) {
+#ifdef AUDIO_STREAM_HAVE_SLAB_STORE
+    slabs_->release(*slab, stream.totalSize);
+#endif
+    return;
+  }
+  std::filesystem::remove(stream.cachePath);
+}
+
+void StreamManager::recordWrite(StreamContext &stream, uint64_t offset,
+                                size_t size, uint32_t crc) {
+  stream.extents.add(offset, size, crc);
+  stream.currentOffset = stream.extents.filledEnd(0);
+  stream.totalSize = stream.extents.end();
+  if (auto checksum = stream.extents.prefixChecksum()) {
+    stream.checksum = *checksum;
   }
+  stream.touch();
+}
+
+void StreamManager::flushIfDue(StreamContext &stream,
+                               Durability durability) {
+  // Start write-back as soon as a PERIODIC stream's backlog reaches the
+  // threshold, rather than waiting for the next flush pass
+  if (durability == Durability::PERIODIC &&
+      stream.mmapFile->getUnflushedBytes() >=
+          flushBytes_.load(std::memory_order_relaxed)) {
+    stream.mmapFile->flushAsync();
+  }
+}
+
+size_t StreamManager::readableLength(const StreamContext &stream,
+                                     size_t offset, size_t length) const {
+  if (stream.status != StreamStatus::UPLOADING) {
+    return length;
+  }
+  return offset < stream.currentOffset
+             ? std::min(length, stream.currentOffset - offset)
+             : 0;
+}
+
+BufferView StreamManager::readReady(StreamContext &stream, uint64_t offset,
+                                    size_t length) {
+  // Only READY streams have cached chunks
+  BufferView view = chunkCache_.find(stream.instanceId, offset, length);
+  if (!view.empty()) {
+    stream.touch();
+    return view;
+  }
+
+  // Published after the stream became READY, so totalSize is final too
+  StorageBackend *file = stream.readyFile.load(std::memory_order_acquire);
+  if (file == nullptr) {
+    return BufferView();
+  }
+  view = file->tryReadView(offset, length);
+  if (view.empty()) {
+    return view;
+  }
+  stream.touch();
+  // Track only: prefetch takes the file lock, and mapped pages of a
+  // streaming file are read ahead by the kernel (MADV_SEQUENTIAL)
+  readAhead(stream, *file, offset, view.size(), stream.totalSize, false);
+  chunkCache_.insert(stream.instanceId, offset, length, view);
+  return view;
+}
+
+void StreamManager::sealReady(StreamContext &stream) {
+  // Cheap once sealed; seals again after releaseMappings unsealed it
+  if (stream.mmapFile->seal()) {
+    stream.readyFile.store(stream.mmapFile.get(), std::memory_order_release);
+  }
+}
+
+void StreamManager::readAhead(StreamContext &stream, StorageBackend &file,
+                              uint64_t offset, size_t length,
+                              uint64_t readableEnd, bool prefetch) {
+  std::unique_lock<std::mutex> lock(stream.readaheadMutex, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return;
+  }
+  auto decision = stream.readahead.recordRead(offset, length, readableEnd);
+  // Hits and misses only mean something for windows actually read ahead
+  if (prefetch && decision.hit) {
+    readaheadHits_.fetch_add(1, std::memory_order_relaxed);
+  } else if (prefetch && decision.miss) {
+    readaheadMisses_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (decision.streamChanged) {
+    file.adviseSequential(stream.readahead.isStreaming());
+    spdlog::debug("Stream {} is {} read sequentially", stream.streamId,
+                  stream.readahead.isStreaming() ? "now" : "no longer");
+  }
+  if (prefetch && decision.prefetchLength > 0 &&
+      file.prefetch(decision.prefetchOffset, decision.prefetchLength)) {
+    readaheadBytes_.fetch_add(decision.prefetchLength,
+                              std::memory_order_relaxed);
+  }
+}
+
+uint64_t StreamManager::readableBytes(const StreamContext &stream) const {
+  return stream.status == StreamStatus::UPLOADING ? stream.currentOffset
+                                                  : stream.totalSize;
+}
+
+uint32_t StreamManager::checksumCacheFile(StorageBackend &file,
+                                          uint64_t size) const {
+  uint32_t checksum = 0;
+  for (uint64_t offset = 0; offset < size;) {
+    // 1MB steps: bounded copies for backends whose views are not mappings
+    BufferView view = file.readView(
+        offset,
+        static_cast<size_t>(std::min<uint64_t>(size - offset, 1024 * 1024)));
+    if (view.empty()) {
+      break;
+    }
+    checksum = crc32c::extend(checksum, view.begin(), view.size());
+    offset += view.size();
+  }
+  return checksum;
+}
+
+bool StreamManager::sameContent(StorageBackend &a, StorageBackend &b,
+                                uint64_t size) const {
+  for (uint64_t offset = 0; offset < size;) {
+    size_t length =
+        static_cast<size_t>(std::min<uint64_t>(size - offset, 1024 * 1024));
+    BufferView viewA = a.readView(offset, length);
+    BufferView viewB = b.readView(offset, length);
+    // Views may end short of length, e.g. at a mapping segment boundary
+    size_t compared = std::min(viewA.size(), viewB.size());
+    if (compared == 0 ||
+        std::memcmp(viewA.begin(), viewB.begin(), compared) != 0) {
+      return false;
+    }
+    offset += compared;
+  }
+  return true;
+}
+
+bool StreamManager::copyReadyRange(StreamContext &stream, uint64_t offset,
+                                   size_t length, uint8_t *out) const {
+  // Shared like chunk writes: the file is not removed or replaced meanwhile
+  std::shared_lock<std::shared_mutex> writeLock(stream.writeMutex);
+  StorageBackend *file;
+  {
+    std::lock_guard<std::mutex> streamLock(stream.contextMutex);
+    if (!stream.mmapFile || stream.status != StreamStatus::READY ||
+        offset + length > stream.totalSize) {
+      return false;
+    }
+    file = stream.mmapFile.get();
+  }
+  for (size_t copied = 0; copied < length;) {
+    // Views may end short of length, e.g. at a mapping segment boundary
+    BufferView view = file->readView(offset + copied, length - copied);
+    if (view.empty()) {
+      return false;
+    }
+    size_t n = std::min(view.size(), length - copied);
+    std::memcpy(out + copied, view.begin(), n);
+    copied += n;
+  }
+  return true;
 }
 
 std::string StreamManager::getCachePath(const std::string &streamId) const {
   return cacheDir_ + "/" + streamId + ".cache";
 }
 
+std::string
+StreamManager::getCompressedPath(const std::string &streamId) const {
+  return cacheDir_ + "/" + streamId + ".cachez";
+}
+
+uint64_t StreamManager::cacheFileBytes(const StreamContext &stream) const {
+  // READY files are truncated to their size; restored ones are not open
+  if (stream.status != StreamStatus::READY) {
+    return stream.mmapFile->getCapacity();
+  }
+  uint64_t bytes = stream.compression != CompressionCodec::NONE
+                       ? stream.storedBytes
+                       : stream.totalSize;
+  // Each link of a shared file counts its share, so the sum is the file
+  if (stream.sharedFile) {
+    std::error_code ec;
+    auto links = std::filesystem::hard_link_count(stream.cachePath, ec);
+    if (!ec && links > 1) {
+      bytes /= links;
+    }
+  }
+  return bytes;
+}
+
+std::string StreamManager::getManifestPath() const {
+  return cacheDir_ + "/" + MANIFEST_FILE;
+}
+
 } // namespace audio_stream
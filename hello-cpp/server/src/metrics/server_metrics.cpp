@@ -0,0 +1,219 @@
+#include "metrics/server_metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace audio_stream {
+
+namespace {
+
+constexpr const char *PREFIX = "audio_stream_";
+
+bool isLatency(size_t histogram) {
+  return histogram <= static_cast<size_t>(Histogram::SEND_NS);
+}
+
+// Latencies are published in seconds, everything else as recorded
+double scaled(size_t histogram, uint64_t value) {
+  return isLatency(histogram) ? static_cast<double>(value) / 1e9
+                              : static_cast<double>(value);
+}
+
+std::string formatValue(double value) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.9g", value);
+  return text;
+}
+
+// Whole values stay integers in JSON
+nlohmann::json jsonNumber(double value) {
+  if (value >= 0 && value < 9007199254740992.0 &&
+      value == std::floor(value)) {
+    return static_cast<uint64_t>(value);
+  }
+  return value;
+}
+
+void appendHeader(std::string &out, const std::string &name,
+                  const std::string &help, const char *type) {
+  out += "# HELP " + name + " " + help + "\n";
+  out += "# TYPE " + name + " " + type + "\n";
+}
+
+const char *counterHelp(size_t counter) {
+  static const char *HELP[COUNTER_COUNT] = {
+      "Control messages dispatched",
+      "Upload chunks received",
+      "ERROR replies sent",
+      "Upload bytes written to cache files",
+      "Bytes read for GET and STREAM replies",
+      "Binary frame bytes queued on sockets",
+      "Memory-mapped segments created",
+      "Connections opened",
+      "Connections closed"};
+  return HELP[counter];
+}
+
+const char *histogramHelp(size_t histogram) {
+  static const char *HELP[HISTOGRAM_COUNT] = {
+      "Time to dispatch one control message or upload chunk",
+      "Time of one StreamManager chunk or batch write",
+      "Time of one StreamManager read for a reply",
+      "Time to grow and remap a mapped cache file",
+      "Time to build and queue one binary frame",
+      "Chunks queued for the stream when one more is submitted",
+      "Unsent bytes of the connection after a send"};
+  return HELP[histogram];
+}
+
+} // namespace
+
+ServerMetrics &ServerMetrics::getInstance() {
+  static ServerMetrics instance;
+  return instance;
+}
+
+ServerMetrics::Shard *ServerMetrics::acquireShard() {
+  std::lock_guard<std::mutex> lock(shardsMutex_);
+  for (auto &shard : shards_) {
+    if (!shard->leased) {
+      shard->leased = true;
+      return shard.get();
+    }
+  }
+  shards_.push_back(std::make_unique<Shard>());
+  shards_.back()->leased = true;
+  return shards_.back().get();
+}
+
+void ServerMetrics::releaseShard(Shard *shard) {
+  std::lock_guard<std::mutex> lock(shardsMutex_);
+  shard->leased = false;
+}
+
+MetricsSnapshot ServerMetrics::snapshot() const {
+  MetricsSnapshot snapshot;
+  std::lock_guard<std::mutex> lock(shardsMutex_);
+  for (const auto &shard : shards_) {
+    for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+      snapshot.counters[c] +=
+          shard->counters[c].load(std::memory_order_relaxed);
+    }
+    for (size_t h = 0; h < HISTOGRAM_COUNT; ++h) {
+      const Cells &cells = shard->histograms[h];
+      LatencyHistogram &merged = snapshot.histograms[h];
+      // The count is the buckets' sum, so quantiles always add up
+      uint64_t total = 0;
+      for (size_t b = 0; b < LatencyHistogram::BUCKETS; ++b) {
+        uint64_t n = cells.buckets[b].load(std::memory_order_relaxed);
+        merged.buckets[b] += n;
+        total += n;
+      }
+      merged.count += total;
+      merged.sum += cells.sum.load(std::memory_order_relaxed);
+      merged.max =
+          std::max(merged.max, cells.max.load(std::memory_order_relaxed));
+    }
+  }
+  return snapshot;
+}
+
+const char *ServerMetrics::counterName(Counter counter) {
+  static const char *NAMES[COUNTER_COUNT] = {
+      "control_messages_total", "data_frames_total",
+      "errors_sent_total",      "written_bytes_total",
+      "read_bytes_total",       "sent_bytes_total",
+      "mapped_segments_total",  "connections_opened_total",
+      "connections_closed_total", "uploads_refused_total"};
+  return NAMES[static_cast<size_t>(counter)];
+}
+
+const char *ServerMetrics::histogramName(Histogram histogram) {
+  static const char *NAMES[HISTOGRAM_COUNT] = {
+      "handler_dispatch_seconds", "write_chunk_seconds",
+      "read_chunk_seconds",       "remap_seconds",
+      "send_seconds",             "write_queue_depth",
+      "send_buffer_bytes"};
+  return NAMES[static_cast<size_t>(histogram)];
+}
+
+nlohmann::json ServerMetrics::toJson(const MetricsSnapshot &snapshot,
+                                     const std::vector<MetricValue> &values) {
+  nlohmann::json counters = nlohmann::json::object();
+  for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+    counters[counterName(static_cast<Counter>(c))] = snapshot.counters[c];
+  }
+
+  nlohmann::json gauges = nlohmann::json::object();
+  for (const auto &value : values) {
+    (value.monotonic ? counters : gauges)[value.name] =
+        jsonNumber(value.value);
+  }
+
+  nlohmann::json histograms = nlohmann::json::object();
+  for (size_t h = 0; h < HISTOGRAM_COUNT; ++h) {
+    const LatencyHistogram &histogram = snapshot.histograms[h];
+    histograms[histogramName(static_cast<Histogram>(h))] = {
+        {"count", histogram.count},
+        {"sum", scaled(h, histogram.sum)},
+        {"max", scaled(h, histogram.max)},
+        {"p50", scaled(h, histogram.percentile(0.5))},
+        {"p90", scaled(h, histogram.percentile(0.9))},
+        {"p99", scaled(h, histogram.percentile(0.99))},
+        {"p999", scaled(h, histogram.percentile(0.999))}};
+  }
+
+  return {{"counters", counters},
+          {"gauges", gauges},
+          {"histograms", histograms}};
+}
+
+std::string
+ServerMetrics::toPrometheus(const MetricsSnapshot &snapshot,
+                            const std::vector<MetricValue> &values) {
+  std::string out;
+  out.reserve(32 * 1024);
+
+  for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+    std::string name = PREFIX;
+    name += counterName(static_cast<Counter>(c));
+    appendHeader(out, name, counterHelp(c), "counter");
+    out += name + " " + std::to_string(snapshot.counters[c]) + "\n";
+  }
+
+  for (const auto &value : values) {
+    std::string name = PREFIX + value.name;
+    appendHeader(out, name, value.help,
+                 value.monotonic ? "counter" : "gauge");
+    out += name + " " + formatValue(value.value) + "\n";
+  }
+
+  // Cumulative buckets at every power of two: bucket edges line up with
+  // them, so each count is exact and the set of series never changes
+  for (size_t h = 0; h < HISTOGRAM_COUNT; ++h) {
+    const LatencyHistogram &histogram = snapshot.histograms[h];
+    std::string name = PREFIX;
+    name += histogramName(static_cast<Histogram>(h));
+    appendHeader(out, name, histogramHelp(h), "histogram");
+
+    uint64_t cumulative = 0;
+    size_t bucket = 0;
+    for (unsigned exponent = 1; exponent <= LatencyHistogram::MAX_EXPONENT;
+         ++exponent) {
+      uint64_t bound = (uint64_t{1} << exponent) - 1;
+      while (bucket < LatencyHistogram::BUCKETS - 1 &&
+             LatencyHistogram::bucketUpperBound(bucket) <= bound) {
+        cumulative += histogram.buckets[bucket++];
+      }
+      out += name + "_bucket{le=\"" + formatValue(scaled(h, bound)) +
+             "\"} " + std::to_string(cumulative) + "\n";
+    }
+    out += name + "_bucket{le=\"+Inf\"} " + std::to_string(histogram.count) +
+           "\n";
+    out += name + "_sum " + formatValue(scaled(h, histogram.sum)) + "\n";
+    out += name + "_count " + std::to_string(histogram.count) + "\n";
+  }
+  return out;
+}
+
+} // namespace audio_stream
@@ -1,5 +1,7 @@
 #include "network/audio_websocket_server.h"
 #include "handler/websocket_message_handler.h"
+#include "metrics/server_metrics.h"
+#include <algorithm>
 #include <filesystem>
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
@@ -8,8 +10,13 @@ using json = nlohmann::json;
 
 namespace audio_stream {
 
-WebSocketServer::WebSocketServer(int port, const std::string &path)
-    : port_(port), path_(path), running_(false) {
+WebSocketServer::WebSocketServer(int port, const std::string &path,
+                                 size_t ioThreads)
+    : port_(port), path_(path), ioThreadCount_(ioThreads), running_(false) {
+  if (ioThreadCount_ == 0) {
+    ioThreadCount_ = std::max(1u, std::thread::hardware_concurrency());
+  }
+
   initializeServer();
 
   // Create cache directory
@@ -19,10 +26,15 @@ WebSocketServer::WebSocketServer(int port, const std::string &path)
   // Initialize stream manager
   streamManager_ = std::make_shared<StreamManager>(cacheDir);
 
+  // Serve what the previous run finalized instead of forcing re-uploads
+  streamManager_->restoreStreams();
+
   // Initialize message handler
   messageHandler_ = std::make_unique<WebSocketMessageHandler>(streamManager_);
 
-  spdlog::info("WebSocketServer created on port {} with path {}", port, path);
+  spdlog::info(
+      "WebSocketServer created on port {} with path {} ({} I/O threads)", port,
+      path, ioThreadCount_);
 }
 
 WebSocketServer::~WebSocketServer() { stop(); }
@@ -44,6 +56,9 @@ void WebSocketServer::initializeServer() {
         });
 
     // Set connection handlers
+    server_.set_validate_handler(
+        [this](ConnectionHdl hdl) { return this->onValidate(hdl); });
+
     server_.set_open_handler([this](ConnectionHdl hdl) { this->onOpen(hdl); });
 
     server_.set_close_handler(
@@ -51,6 +66,9 @@ void WebSocketServer::initializeServer() {
 
     server_.set_fail_handler([this](ConnectionHdl hdl) { this->onFail(hdl); });
 
+    // Plain HTTP requests on the same port: the metrics endpoint
+    server_.set_http_handler([this](ConnectionHdl hdl) { this->onHttp(hdl); });
+
     spdlog::info("WebSocket server initialized successfully");
   } catch (const std::exception &e) {
     spdlog::error("Failed to initialize WebSocket server: {}", e.what());
@@ -70,14 +88,21 @@ void WebSocketServer::start() {
 
     running_ = true;
 
-    // Run the server in a separate thread
-    serverThread_ = std::thread([this]() {
-      try {
-        server_.run();
-      } catch (const std::exception &e) {
-        spdlog::error("Server thread error: {}", e.what());
-      }
-    });
+    // Evict cold streams in the background to stay within the cache budget
+    streamManager_->startMaintenance();
+    scheduleParkedReadSweep();
+
+    // Run the shared io_context on every I/O thread
+    ioThreads_.reserve(ioThreadCount_);
+    for (size_t i = 0; i < ioThreadCount_; ++i) {
+      ioThreads_.emplace_back([this]() {
+        try {
+          server_.run();
+        } catch (const std::exception &e) {
+          spdlog::error("Server thread error: {}", e.what());
+        }
+      });
+    }
 
     spdlog::info("WebSocket server started successfully");
   } catch (const websocketpp::exception &e) {
@@ -103,10 +128,15 @@ void WebSocketServer::stop() {
       // Stop accepting new connections
       server_.stop();
 
-      // Wait for server thread to finish
-      if (serverThread_.joinable()) {
-        serverThread_.join();
+      // Wait for all I/O threads to finish
+      for (auto &thread : ioThreads_) {
+        if (thread.joinable()) {
+          thread.join();
+        }
       }
+      ioThreads_.clear();
+
+      streamManager_->stopMaintenance();
 
       spdlog::info("WebSocket server stopped successfully");
     } catch (const std::exception &e) {
@@ -117,7 +147,74 @@ void WebSocketServer::stop() {
 
 bool WebSocketServer::isRunning() const { return running_; }
 
+void WebSocketServer::setCacheBudget(const CacheBudget &budget) {
+  streamManager_->setCacheBudget(budget);
+}
+
+void WebSocketServer::setDurabilityPolicy(const DurabilityPolicy &policy) {
+  streamManager_->setDurabilityPolicy(policy);
+}
+
+void WebSocketServer::setStorageOptions(const StorageOptions &options) {
+  streamManager_->setStorageOptions(options);
+}
+
+void WebSocketServer::setSmallStreamLimit(size_t bytes) {
+  streamManager_->setSmallStreamLimit(bytes);
+}
+
+void WebSocketServer::setAdmissionLimits(const AdmissionLimits &limits) {
+  messageHandler_->setAdmissionLimits(limits);
+  spdlog::info("Admission: {} uploads, {} MB queued for writing, {} MB "
+               "window per connection, retry after {} ms",
+               limits.maxUploadingStreams,
+               limits.maxQueuedBytes / (1024 * 1024),
+               limits.connectionWindow / (1024 * 1024),
+               limits.retryAfter.count());
+}
+
+CacheStats WebSocketServer::getCacheStats() const {
+  return streamManager_->getCacheStats();
+}
+
+bool WebSocketServer::onValidate(ConnectionHdl hdl) {
+  try {
+    // Opt in to binary control frames if the client offers them, with the
+    // first offered codec this build has
+    auto con = server_.get_con_from_hdl(hdl);
+    for (const auto &requested : con->get_requested_subprotocols()) {
+      if (binaryProtocolCodec(requested)) {
+        con->select_subprotocol(requested);
+        break;
+      }
+    }
+  } catch (const websocketpp::exception &e) {
+    spdlog::debug("Subprotocol negotiation error code: {}", e.code().value());
+  }
+  return true;
+}
+
+void WebSocketServer::onHttp(ConnectionHdl hdl) {
+  try {
+    auto con = server_.get_con_from_hdl(hdl);
+    if (con->get_resource() != METRICS_PATH) {
+      con->set_status(websocketpp::http::status_code::not_found);
+      return;
+    }
+    con->set_body(ServerMetrics::toPrometheus(
+        ServerMetrics::getInstance().snapshot(),
+        messageHandler_->collectMetrics()));
+    con->append_header("Content-Type", "text/plain; version=0.0.4");
+    con->set_status(websocketpp::http::status_code::ok);
+  } catch (const websocketpp::exception &e) {
+    spdlog::debug("Metrics request error code: {}", e.code().value());
+  } catch (const std::exception &e) {
+    spdlog::error("Error serving metrics: {}", e.what());
+  }
+}
+
 void WebSocketServer::onOpen(ConnectionHdl hdl) {
+  ServerMetrics::getInstance().add(Counter::CONNECTIONS_OPENED);
   try {
     auto con = server_.get_con_from_hdl(hdl);
     std::string endpoint = con->get_remote_endpoint();
@@ -135,6 +232,7 @@ void WebSocketServer::onOpen(ConnectionHdl hdl) {
 }
 
 void WebSocketServer::onClose(ConnectionHdl hdl) {
+  ServerMetrics::getInstance().add(Counter::CONNECTIONS_CLOSED);
   std::string endpoint = "Unknown";
   std::string connectionId = getConnectionId(hdl);
 
@@ -149,12 +247,17 @@ void WebSocketServer::onClose(ConnectionHdl hdl) {
     }
   }
 
-  // Disassociate connection from any stream
-  std::string streamId = messageHandler_->getStreamForConnection(connectionId);
-  if (!streamId.empty()) {
-    messageHandler_->disassociateConnection(connectionId);
-    spdlog::info("Client disconnected from: {} (was streaming: {})", endpoint,
-                 streamId);
+  // Nobody is left to answer this connection's live-tail GETs or ranges
+  messageHandler_->cancelParkedReads(connectionId);
+  messageHandler_->cancelRangeStreams(connectionId);
+
+  // Disassociate connection from its streams, and drop a PUT still
+  // waiting for its data
+  size_t streams = messageHandler_->getStreamCountForConnection(connectionId);
+  messageHandler_->disassociateConnection(connectionId);
+  if (streams > 0) {
+    spdlog::info("Client disconnected from: {} (was streaming {} streams)",
+                 endpoint, streams);
   } else {
     spdlog::info("Client disconnected from: {}", endpoint);
   }
@@ -177,28 +280,225 @@ void WebSocketServer::onFail(ConnectionHdl hdl) {
 void WebSocketServer::handleTextMessage(ConnectionHdl hdl,
                                         const std::string &message) {
   std::string connectionId = getConnectionId(hdl);
+  bool binaryProtocol = usesBinaryProtocol(hdl);
+
+  if (binaryProtocol) {
+    // JSON is still accepted, but replies use the negotiated encoding
+    try {
+      WebSocketMessage msg = WebSocketMessage::fromJsonString(message);
+      uint32_t handle = msg.handle.value_or(0);
+      messageHandler_->handleMessage(msg, connectionId,
+                                     makeSendMessage(hdl, true, handle),
+                                     makeSendBinary(hdl, true, handle),
+                                     makeCanSend(hdl));
+    } catch (const json::parse_error &e) {
+      spdlog::error("JSON parse error: {}", e.what());
+      sendErrorMessage(hdl, "Invalid JSON format");
+    }
+    scheduleRangeStreamPump();
+    return;
+  }
 
   auto sendText = [this, hdl](const std::string &msg) {
     this->sendTextMessage(hdl, msg);
   };
 
-  auto sendBinary = [this, hdl](const std::vector<uint8_t> &data) {
-    this->sendBinaryMessage(hdl, data);
-  };
-
   messageHandler_->handleTextMessage(message, connectionId, sendText,
-                                     sendBinary);
+                                     makeSendBinary(hdl, false),
+                                     makeCanSend(hdl));
+  scheduleRangeStreamPump();
 }
 
 void WebSocketServer::handleBinaryMessage(ConnectionHdl hdl,
-                                          const std::vector<uint8_t> &data) {
+                                          PooledBufferPtr data,
+                                          uint32_t handle,
+                                          std::optional<uint64_t> offset) {
   std::string connectionId = getConnectionId(hdl);
 
-  auto sendText = [this, hdl](const std::string &msg) {
-    this->sendTextMessage(hdl, msg);
+  messageHandler_->handleBinaryMessage(
+      std::move(data), connectionId,
+      makeSendMessage(hdl, usesBinaryProtocol(hdl), handle), handle, offset);
+}
+
+void WebSocketServer::handleBinaryProtocolFrame(ConnectionHdl hdl,
+                                                const uint8_t *data,
+                                                size_t size) {
+  // Decoding points into the websocketpp payload and does not allocate
+  BinaryFrame frame;
+  if (!decodeBinaryFrame(data, size, frame)) {
+    sendErrorMessage(hdl, "Malformed binary protocol frame");
+    return;
+  }
+
+  if (frame.header.type == BinaryFrameType::DATA) {
+    auto buffer = MemoryPoolManager::getInstance().acquire(frame.payloadSize);
+    std::memcpy(buffer->data(), frame.payload, frame.payloadSize);
+    // Upload chunks say where they go, so they may arrive in any order
+    handleBinaryMessage(hdl, std::move(buffer), frame.header.handle,
+                        frame.header.offset);
+    return;
+  }
+
+  if (frame.header.type == BinaryFrameType::COMPRESSED_DATA) {
+    if (wireCodec(hdl) == CompressionCodec::NONE ||
+        frame.header.length > MAX_CHUNK_SIZE) {
+      sendErrorMessage(hdl, "Unexpected COMPRESSED_DATA frame");
+      return;
+    }
+    size_t length = static_cast<size_t>(frame.header.length);
+    auto buffer = MemoryPoolManager::getInstance().acquire(length);
+    if (!decompressFramePayload(frame, buffer->data())) {
+      sendErrorMessage(hdl, "Corrupt COMPRESSED_DATA frame");
+      return;
+    }
+    handleBinaryMessage(hdl, std::move(buffer), frame.header.handle,
+                        frame.header.offset);
+    return;
+  }
+
+  if (frame.header.type == BinaryFrameType::PUT) {
+    // A whole small stream; answered once the write stage has stored it
+    PooledBufferPtr buffer;
+    if (frame.payloadSize > 0) {
+      buffer = MemoryPoolManager::getInstance().acquire(frame.payloadSize);
+      std::memcpy(buffer->data(), frame.payload, frame.payloadSize);
+    }
+    messageHandler_->handlePut(WebSocketMessage::fromBinaryFrame(frame),
+                               std::move(buffer), getConnectionId(hdl),
+                               makeSendMessage(hdl, true, frame.header.handle));
+    return;
+  }
+
+  uint32_t handle = frame.header.handle;
+  messageHandler_->handleMessage(
+      WebSocketMessage::fromBinaryFrame(frame), getConnectionId(hdl),
+      makeSendMessage(hdl, true, handle), makeSendBinary(hdl, true, handle),
+      makeCanSend(hdl));
+  scheduleRangeStreamPump();
+}
+
+WebSocketMessageHandler::SendMessageCallback
+WebSocketServer::makeSendMessage(ConnectionHdl hdl, bool binaryProtocol,
+                                 uint32_t handle) {
+  if (binaryProtocol) {
+    if (handle != 0) {
+      // Tag replies with the request's handle unless they assign one
+      return [this, hdl, handle](const WebSocketMessage &message) {
+        if (message.handle.has_value()) {
+          this->sendControlFrame(hdl, message);
+          return;
+        }
+        WebSocketMessage tagged = message;
+        tagged.handle = handle;
+        this->sendControlFrame(hdl, tagged);
+      };
+    }
+    return [this, hdl](const WebSocketMessage &message) {
+      this->sendControlFrame(hdl, message);
+    };
+  }
+  return [this, hdl](const WebSocketMessage &message) {
+    this->sendTextMessage(hdl, message.toJsonString());
+  };
+}
+
+WebSocketMessageHandler::SendBinaryCallback
+WebSocketServer::makeSendBinary(ConnectionHdl hdl, bool binaryProtocol,
+                                uint32_t handle) {
+  if (binaryProtocol) {
+    // Prefix the data with a DATA header in the same frame, or with a
+    // COMPRESSED_DATA one when the connection has a codec and it shrinks
+    CompressionCodec codec = wireCodec(hdl);
+    return [this, hdl, handle, codec](uint64_t offset, const BufferView &data,
+                                      CompressionProfile profile) {
+      BinaryFrameHeader header;
+      header.type = BinaryFrameType::DATA;
+      header.offset = offset;
+      header.length = data.size();
+      header.handle = handle;
+      uint8_t encoded[BINARY_FRAME_HEADER_SIZE];
+
+      thread_local std::vector<uint8_t> compressed;
+      if (codec != CompressionCodec::NONE && profile.compressible &&
+          compressBlock(codec, data.begin(), data.size(), compressed,
+                        profile.pcm16Channels)) {
+        header.type = BinaryFrameType::COMPRESSED_DATA;
+        header.codec = codec;
+        header.pcm16Channels = profile.pcm16Channels;
+        encodeBinaryFrameHeader(encoded, header, 0);
+        // Not owned: sendBinaryMessage copies it into the frame
+        BufferView payload(std::shared_ptr<const uint8_t>(
+                               std::shared_ptr<void>(), compressed.data()),
+                           compressed.size());
+        this->sendBinaryMessage(hdl, payload, encoded, sizeof(encoded));
+        return;
+      }
+      encodeBinaryFrameHeader(encoded, header, 0);
+      this->sendBinaryMessage(hdl, data, encoded, sizeof(encoded));
+    };
+  }
+  return [this, hdl](uint64_t, const BufferView &data, CompressionProfile) {
+    this->sendBinaryMessage(hdl, data);
+  };
+}
+
+void WebSocketServer::scheduleParkedReadSweep() {
+  server_.set_timer(PARKED_READ_SWEEP_MS,
+                    [this](const websocketpp::lib::error_code &ec) {
+                      if (ec || !running_) {
+                        return;
+                      }
+                      messageHandler_->expireParkedReads();
+                      scheduleParkedReadSweep();
+                    });
+}
+
+WebSocketMessageHandler::CanSendCallback
+WebSocketServer::makeCanSend(ConnectionHdl hdl) {
+  return [this, hdl]() {
+    websocketpp::lib::error_code ec;
+    auto con = server_.get_con_from_hdl(hdl, ec);
+    return !ec && con &&
+           con->get_buffered_amount() < RANGE_STREAM_HIGH_WATERMARK;
   };
+}
+
+void WebSocketServer::scheduleRangeStreamPump() {
+  if (!messageHandler_->hasRangeStreams() ||
+      rangePumpScheduled_.exchange(true)) {
+    return;
+  }
+  server_.set_timer(RANGE_STREAM_PUMP_MS,
+                    [this](const websocketpp::lib::error_code &ec) {
+                      // Clear first: a range queued during the pump then
+                      // schedules its own timer
+                      rangePumpScheduled_ = false;
+                      if (ec || !running_) {
+                        return;
+                      }
+                      messageHandler_->pumpRangeStreams();
+                      scheduleRangeStreamPump();
+                    });
+}
+
+bool WebSocketServer::usesBinaryProtocol(ConnectionHdl hdl) const {
+  // Need to cast away const to call get_con_from_hdl
+  auto &non_const_server = const_cast<WebSocketServer_t &>(server_);
+  websocketpp::lib::error_code ec;
+  auto con = non_const_server.get_con_from_hdl(hdl, ec);
+  return !ec && con &&
+         binaryProtocolCodec(con->get_subprotocol()).has_value();
+}
 
-  messageHandler_->handleBinaryMessage(data, connectionId, sendText);
+CompressionCodec WebSocketServer::wireCodec(ConnectionHdl hdl) const {
+  auto &non_const_server = const_cast<WebSocketServer_t &>(server_);
+  websocketpp::lib::error_code ec;
+  auto con = non_const_server.get_con_from_hdl(hdl, ec);
+  if (ec || !con) {
+    return CompressionCodec::NONE;
+  }
+  return binaryProtocolCodec(con->get_subprotocol())
+      .value_or(CompressionCodec::NONE);
 }
 
 std::string WebSocketServer::getConnectionId(ConnectionHdl hdl) const {
@@ -217,7 +517,7 @@ void WebSocketServer::sendTextMessage(ConnectionHdl hdl,
                                       const std::string &message) {
   try {
     server_.send(hdl, message, websocketpp::frame::opcode::text);
-    spdlog::debug("Sent text message: {}", message);
+    SPDLOG_DEBUG("Sent text message: {}", message);
   } catch (const websocketpp::exception &e) {
     // Log error code only to avoid localized messages
     spdlog::debug("Error sending text message, error code: {}",
@@ -228,11 +528,38 @@ void WebSocketServer::sendTextMessage(ConnectionHdl hdl,
 }
 
 void WebSocketServer::sendBinaryMessage(ConnectionHdl hdl,
-                                        const std::vector<uint8_t> &data) {
+                                        const BufferView &data,
+                                        const uint8_t *header,
+                                        size_t headerSize) {
+  MetricTimer timer(Histogram::SEND_NS);
   try {
-    std::string binaryData(data.begin(), data.end());
-    server_.send(hdl, binaryData, websocketpp::frame::opcode::binary);
-    spdlog::debug("Sent binary message: {} bytes", data.size());
+    // Build the outgoing frame directly from the view. Handing websocketpp
+    // an already prepared message skips its own payload-to-frame copy, so
+    // the cached bytes are copied once into the frame and then to the socket.
+    auto con = server_.get_con_from_hdl(hdl);
+    size_t frameSize = headerSize + data.size();
+    auto msg = con->get_message(websocketpp::frame::opcode::binary, frameSize);
+    websocketpp::frame::basic_header frameHeader(
+        websocketpp::frame::opcode::binary, frameSize, true, false);
+    websocketpp::frame::extended_header extHeader(frameSize);
+    msg->set_header(
+        websocketpp::frame::prepare_header(frameHeader, extHeader));
+    if (headerSize > 0) {
+      msg->append_payload(header, headerSize);
+    }
+    msg->append_payload(data.begin(), data.size());
+    msg->set_prepared(true);
+
+    websocketpp::lib::error_code ec = con->send(msg);
+    if (ec) {
+      spdlog::debug("Error sending binary message, error code: {}",
+                    ec.value());
+      return;
+    }
+    auto &metrics = ServerMetrics::getInstance();
+    metrics.add(Counter::BYTES_SENT, frameSize);
+    metrics.record(Histogram::SEND_BUFFER_BYTES, con->get_buffered_amount());
+    SPDLOG_DEBUG("Sent binary message: {} bytes", frameSize);
   } catch (const websocketpp::exception &e) {
     // Log error code only to avoid localized messages
     spdlog::debug("Error sending binary message, error code: {}",
@@ -242,9 +569,29 @@ void WebSocketServer::sendBinaryMessage(ConnectionHdl hdl,
   }
 }
 
+void WebSocketServer::sendControlFrame(ConnectionHdl hdl,
+                                       const WebSocketMessage &message) {
+  try {
+    std::vector<uint8_t> frame = message.toBinaryFrame();
+    server_.send(hdl, frame.data(), frame.size(),
+                 websocketpp::frame::opcode::binary);
+    SPDLOG_DEBUG("Sent {} control frame", message.type);
+  } catch (const websocketpp::exception &e) {
+    // Log error code only to avoid localized messages
+    spdlog::debug("Error sending control frame, error code: {}",
+                  e.code().value());
+  } catch (const std::exception &e) {
+    spdlog::debug("Error sending control frame: {}", e.what());
+  }
+}
+
 void WebSocketServer::sendErrorMessage(ConnectionHdl hdl,
                                        const std::string &error) {
   try {
+    if (usesBinaryProtocol(hdl)) {
+      sendControlFrame(hdl, WebSocketMessage::error(error));
+      return;
+    }
     json errorMsg = {{"type", "error"}, {"message", error}};
     sendTextMessage(hdl, errorMsg.dump());
     spdlog::debug("Sent error message: {}", error);
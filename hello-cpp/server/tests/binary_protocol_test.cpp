@@ -0,0 +1,368 @@
+#include "binary_protocol.h"
+#include "handler/websocket_message.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace audio_stream {
+namespace {
+
+BinaryFrame decode(const std::vector<uint8_t> &encoded) {
+  BinaryFrame frame;
+  EXPECT_TRUE(decodeBinaryFrame(encoded.data(), encoded.size(), frame));
+  return frame;
+}
+
+TEST(BinaryProtocolTest, DataFrameRoundTrip) {
+  std::vector<uint8_t> payload{1, 2, 3, 4, 5};
+  BinaryFrameHeader header;
+  header.type = BinaryFrameType::DATA;
+  header.offset = 0x0102030405060708ULL;
+  header.length = payload.size();
+  header.handle = 42;
+  auto encoded = encodeBinaryFrame(header, {}, payload.data(), payload.size());
+  ASSERT_EQ(encoded.size(), BINARY_FRAME_HEADER_SIZE + payload.size());
+  EXPECT_EQ(encoded[0], BINARY_PROTOCOL_VERSION);
+  EXPECT_EQ(encoded[8], 0x08); // Little-endian offset
+
+  BinaryFrame frame = decode(encoded);
+  EXPECT_EQ(frame.header.type, BinaryFrameType::DATA);
+  EXPECT_EQ(frame.header.offset, header.offset);
+  EXPECT_EQ(frame.header.length, payload.size());
+  EXPECT_EQ(frame.header.handle, 42u);
+  EXPECT_TRUE(frame.text.empty());
+  ASSERT_EQ(frame.payloadSize, payload.size());
+  EXPECT_EQ(std::vector<uint8_t>(frame.payload,
+                                 frame.payload + frame.payloadSize),
+            payload);
+}
+
+TEST(BinaryProtocolTest, TextAndPayloadFollowHeader) {
+  std::vector<uint8_t> payload(100, 0xAB);
+  BinaryFrameHeader header;
+  header.type = BinaryFrameType::PUT;
+  header.length = static_cast<uint64_t>(Durability::ON_FINALIZE);
+  auto encoded =
+      encodeBinaryFrame(header, "stream-1", payload.data(), payload.size());
+
+  BinaryFrame frame = decode(encoded);
+  EXPECT_EQ(frame.header.type, BinaryFrameType::PUT);
+  EXPECT_EQ(frame.text, "stream-1");
+  EXPECT_EQ(frame.payloadSize, payload.size());
+  EXPECT_EQ(frame.payload[0], 0xAB);
+  EXPECT_EQ(frame.header.length,
+            static_cast<uint64_t>(Durability::ON_FINALIZE));
+}
+
+TEST(BinaryProtocolTest, StartedCarriesChunkLimitsAndHandle) {
+  BinaryFrameHeader header;
+  header.type = BinaryFrameType::STARTED;
+  header.chunkSize = 65536;
+  header.minChunkSize = 4096;
+  header.maxChunkSize = 1048576;
+  header.handle = 7;
+  header.length = 999; // Not sent: the handle takes its bytes
+  BinaryFrame frame = decode(encodeBinaryFrame(header, "s"));
+  EXPECT_EQ(frame.header.chunkSize, 65536u);
+  EXPECT_EQ(frame.header.minChunkSize, 4096u);
+  EXPECT_EQ(frame.header.maxChunkSize, 1048576u);
+  EXPECT_EQ(frame.header.handle, 7u);
+  EXPECT_EQ(frame.header.length, 0u);
+}
+
+TEST(BinaryProtocolTest, StoppedCarriesChecksum) {
+  BinaryFrameHeader header;
+  header.type = BinaryFrameType::STOPPED;
+  header.checksum = 0xDEADBEEF;
+  header.handle = 3; // Shares the checksum's bytes, not sent
+  BinaryFrame frame = decode(encodeBinaryFrame(header, "s"));
+  EXPECT_EQ(frame.header.checksum, 0xDEADBEEFu);
+  EXPECT_EQ(frame.header.handle, 0u);
+}
+
+TEST(BinaryProtocolTest, CompressedDataCarriesCodecAndChannels) {
+  BinaryFrameHeader header;
+  header.type = BinaryFrameType::COMPRESSED_DATA;
+  header.codec = CompressionCodec::DEFLATE;
+  header.pcm16Channels = 2;
+  header.length = 4096;
+  BinaryFrame frame = decode(encodeBinaryFrame(header));
+  EXPECT_EQ(frame.header.codec, CompressionCodec::DEFLATE);
+  EXPECT_EQ(frame.header.pcm16Channels, 2u);
+  EXPECT_EQ(frame.header.length, 4096u);
+}
+
+TEST(BinaryProtocolTest, CompressedPayloadRoundTrip) {
+  if (!isCodecAvailable(CompressionCodec::DEFLATE)) {
+    GTEST_SKIP() << "deflate not compiled in";
+  }
+  std::vector<uint8_t> data(8192);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i / 64);
+  }
+  std::vector<uint8_t> compressed;
+  ASSERT_TRUE(compressBlock(CompressionCodec::DEFLATE, data.data(),
+                            data.size(), compressed));
+
+  BinaryFrameHeader header;
+  header.type = BinaryFrameType::COMPRESSED_DATA;
+  header.codec = CompressionCodec::DEFLATE;
+  header.length = data.size();
+  auto encoded =
+      encodeBinaryFrame(header, {}, compressed.data(), compressed.size());
+  BinaryFrame frame = decode(encoded);
+  std::vector<uint8_t> out(data.size());
+  ASSERT_TRUE(decompressFramePayload(frame, out.data()));
+  EXPECT_EQ(out, data);
+}
+
+TEST(BinaryProtocolTest, RejectsTruncatedHeader) {
+  BinaryFrameHeader header;
+  auto encoded = encodeBinaryFrame(header);
+  BinaryFrame frame;
+  EXPECT_FALSE(decodeBinaryFrame(encoded.data(), 0, frame));
+  EXPECT_FALSE(decodeBinaryFrame(encoded.data(),
+                                 BINARY_FRAME_HEADER_SIZE - 1, frame));
+  EXPECT_TRUE(
+      decodeBinaryFrame(encoded.data(), BINARY_FRAME_HEADER_SIZE, frame));
+}
+
+TEST(BinaryProtocolTest, RejectsTextPastEndOfFrame) {
+  BinaryFrameHeader header;
+  header.type = BinaryFrameType::GET;
+  auto encoded = encodeBinaryFrame(header, "stream-1");
+  BinaryFrame frame;
+  EXPECT_FALSE(decodeBinaryFrame(encoded.data(), encoded.size() - 1, frame));
+}
+
+TEST(BinaryProtocolTest, RejectsUnknownVersion) {
+  auto encoded = encodeBinaryFrame(BinaryFrameHeader{});
+  encoded[0] = BINARY_PROTOCOL_VERSION + 1;
+  BinaryFrame frame;
+  EXPECT_FALSE(decodeBinaryFrame(encoded.data(), encoded.size(), frame));
+}
+
+TEST(BinaryProtocolTest, RejectsUnknownType) {
+  auto encoded = encodeBinaryFrame(BinaryFrameHeader{});
+  BinaryFrame frame;
+  encoded[1] = 0;
+  EXPECT_FALSE(decodeBinaryFrame(encoded.data(), encoded.size(), frame));
+  encoded[1] = static_cast<uint8_t>(BinaryFrameType::DETACHED) + 1;
+  EXPECT_FALSE(decodeBinaryFrame(encoded.data(), encoded.size(), frame));
+  encoded[1] = static_cast<uint8_t>(BinaryFrameType::DETACHED);
+  EXPECT_TRUE(decodeBinaryFrame(encoded.data(), encoded.size(), frame));
+}
+
+TEST(BinaryProtocolTest, TruncatesTextToSixtyFourKilobytes) {
+  std::string text(UINT16_MAX + 10, 'x');
+  BinaryFrame frame = decode(encodeBinaryFrame(BinaryFrameHeader{}, text));
+  EXPECT_EQ(frame.text.size(), UINT16_MAX);
+  EXPECT_EQ(frame.payloadSize, 0u);
+}
+
+TEST(BinaryProtocolTest, SubprotocolCodec) {
+  EXPECT_EQ(binaryProtocolCodec(BINARY_PROTOCOL), CompressionCodec::NONE);
+  EXPECT_FALSE(binaryProtocolCodec("audio-stream.json").has_value());
+  EXPECT_FALSE(binaryProtocolCodec("audio-stream.binary.v1x").has_value());
+  EXPECT_FALSE(binaryProtocolCodec("audio-stream.binary.v1+none"));
+  EXPECT_FALSE(binaryProtocolCodec("audio-stream.binary.v1+bogus"));
+  if (isCodecAvailable(CompressionCodec::DEFLATE)) {
+    std::string offered = compressedBinaryProtocol(CompressionCodec::DEFLATE);
+    EXPECT_EQ(offered, "audio-stream.binary.v1+deflate");
+    EXPECT_EQ(binaryProtocolCodec(offered), CompressionCodec::DEFLATE);
+  }
+}
+
+TEST(BinaryProtocolTest, RequestsConvertToMessages) {
+  BinaryFrameHeader header;
+  header.type = BinaryFrameType::GET;
+  header.offset = 1000;
+  header.length = 500;
+  header.handle = 9;
+  WebSocketMessage get = WebSocketMessage::fromBinaryFrame(
+      decode(encodeBinaryFrame(header, "stream-1")));
+  EXPECT_EQ(get.type, "GET");
+  EXPECT_EQ(get.streamId, "stream-1");
+  EXPECT_EQ(get.offset, 1000u);
+  EXPECT_EQ(get.length, 500u);
+  EXPECT_EQ(get.handle, 9u);
+
+  header = BinaryFrameHeader{};
+  header.type = BinaryFrameType::START;
+  header.chunkSize = 65536;
+  header.offset = 1 << 20;
+  header.length = static_cast<uint64_t>(Durability::STRICT_SYNC);
+  WebSocketMessage start = WebSocketMessage::fromBinaryFrame(
+      decode(encodeBinaryFrame(header, "stream-2")));
+  EXPECT_EQ(start.type, "START");
+  EXPECT_EQ(start.chunkSize, 65536u);
+  EXPECT_EQ(start.window, 1u << 20);
+  EXPECT_EQ(start.durability, durabilityToString(Durability::STRICT_SYNC));
+
+  header.length = 99; // Unknown tier keeps its number for the handler
+  start = WebSocketMessage::fromBinaryFrame(
+      decode(encodeBinaryFrame(header, "stream-2")));
+  EXPECT_EQ(start.durability, "99");
+}
+
+TEST(BinaryProtocolTest, ServerOnlyFramesAreNotRequests) {
+  BinaryFrameHeader header;
+  header.type = BinaryFrameType::STOPPED;
+  WebSocketMessage msg = WebSocketMessage::fromBinaryFrame(
+      decode(encodeBinaryFrame(header, "stream-1")));
+  EXPECT_EQ(msg.type, "UNKNOWN");
+}
+
+TEST(BinaryProtocolTest, RepliesEncodeToFrames) {
+  WebSocketMessage credit =
+      WebSocketMessage::credit("stream-1", 4096, 1 << 20, 5);
+  BinaryFrame frame = decode(credit.toBinaryFrame());
+  EXPECT_EQ(frame.header.type, BinaryFrameType::CREDIT);
+  EXPECT_EQ(frame.text, "stream-1");
+  EXPECT_EQ(frame.header.offset, 4096u);
+  EXPECT_EQ(frame.header.length, 1u << 20);
+  EXPECT_EQ(frame.header.handle, 5u);
+
+  auto stoppedFrame = WebSocketMessage::stopped("stream-1", 0x12345678)
+                          .toBinaryFrame();
+  frame = decode(stoppedFrame);
+  EXPECT_EQ(frame.header.type, BinaryFrameType::STOPPED);
+  EXPECT_EQ(frame.header.checksum, 0x12345678u);
+
+  auto errorFrame =
+      WebSocketMessage::retryLater("Server busy", 1000).toBinaryFrame();
+  frame = decode(errorFrame);
+  EXPECT_EQ(frame.header.type, BinaryFrameType::ERROR_MSG);
+  EXPECT_EQ(frame.text, "Server busy");
+  EXPECT_EQ(frame.header.offset, 1000u);
+
+  auto helloFrame =
+      WebSocketMessage::hello(CAPABILITY_PUT, 1 << 20).toBinaryFrame();
+  frame = decode(helloFrame);
+  EXPECT_EQ(frame.header.type, BinaryFrameType::HELLO);
+  EXPECT_EQ(frame.header.offset, CAPABILITY_PUT);
+  EXPECT_EQ(frame.header.length, 1u << 20);
+
+  auto statsFrame =
+      WebSocketMessage::statsReply({{"gauges", {{"streams", 3}}}})
+          .toBinaryFrame();
+  frame = decode(statsFrame);
+  EXPECT_EQ(frame.header.type, BinaryFrameType::STATS);
+  auto stats = nlohmann::json::parse(frame.payload,
+                                     frame.payload + frame.payloadSize);
+  EXPECT_EQ(stats["gauges"]["streams"], 3);
+}
+
+TEST(BinaryProtocolTest, HaveCarriesDigestAndProof) {
+  std::vector<uint8_t> payload(2 * sha256::DIGEST_BYTES);
+  for (size_t i = 0; i < payload.size(); ++i) {
+    payload[i] = static_cast<uint8_t>(i);
+  }
+  BinaryFrameHeader header;
+  header.type = BinaryFrameType::HAVE;
+  header.offset = 3 * HAVE_BLOCK_SIZE;
+  header.length = HAVE_BLOCK_SIZE;
+  header.handle = 4;
+  auto encoded = encodeBinaryFrame(header, {}, payload.data(), payload.size());
+  WebSocketMessage have = WebSocketMessage::fromBinaryFrame(decode(encoded));
+  EXPECT_EQ(have.type, "HAVE");
+  EXPECT_EQ(have.offset, 3 * HAVE_BLOCK_SIZE);
+  EXPECT_EQ(have.length, HAVE_BLOCK_SIZE);
+  EXPECT_EQ(have.handle, 4u);
+  ASSERT_TRUE(have.digest.has_value());
+  ASSERT_TRUE(have.proof.has_value());
+  EXPECT_TRUE(std::equal(have.digest->begin(), have.digest->end(),
+                         payload.begin()));
+  EXPECT_TRUE(std::equal(have.proof->begin(), have.proof->end(),
+                         payload.begin() + sha256::DIGEST_BYTES));
+
+  // Without both digests the handler refuses it
+  encoded = encodeBinaryFrame(header, {}, payload.data(), 10);
+  have = WebSocketMessage::fromBinaryFrame(decode(encoded));
+  EXPECT_FALSE(have.digest.has_value());
+  EXPECT_FALSE(have.proof.has_value());
+}
+
+TEST(BinaryProtocolTest, StartedCarriesNonceAndHasItsBytes) {
+  WebSocketMessage started =
+      WebSocketMessage::started("stream-1", 65536, 4096, 1048576);
+  started.handle = 2;
+  started.nonce.emplace();
+  for (size_t i = 0; i < HAVE_NONCE_BYTES; ++i) {
+    (*started.nonce)[i] = static_cast<uint8_t>(0xA0 + i);
+  }
+  auto encoded = started.toBinaryFrame();
+  BinaryFrame frame = decode(encoded);
+  EXPECT_EQ(frame.header.handle, 2u);
+  ASSERT_EQ(frame.payloadSize, HAVE_NONCE_BYTES);
+  EXPECT_TRUE(std::equal(started.nonce->begin(), started.nonce->end(),
+                         frame.payload));
+  EXPECT_EQ(started.toJson()["nonce"], "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf");
+
+  WebSocketMessage has = WebSocketMessage::has("stream-1", HAVE_BLOCK_SIZE, 0);
+  has.handle = 2;
+  auto hasFrame = has.toBinaryFrame();
+  frame = decode(hasFrame);
+  EXPECT_EQ(frame.header.type, BinaryFrameType::HAS);
+  EXPECT_EQ(frame.text, "stream-1");
+  EXPECT_EQ(frame.header.offset, HAVE_BLOCK_SIZE);
+  EXPECT_EQ(frame.header.length, 0u);
+  EXPECT_EQ(frame.header.handle, 2u);
+}
+
+TEST(BinaryProtocolTest, AttachAndDetachFrames) {
+  BinaryFrameHeader header;
+  header.type = BinaryFrameType::ATTACH;
+  auto encoded = encodeBinaryFrame(header, "stream-1");
+  WebSocketMessage attach = WebSocketMessage::fromBinaryFrame(decode(encoded));
+  EXPECT_EQ(attach.type, "ATTACH");
+  EXPECT_EQ(attach.streamId, "stream-1");
+
+  // ATTACHED carries handle and chunk sizes where STARTED does
+  WebSocketMessage attached =
+      WebSocketMessage::attached("stream-1", 65536, 4096, 1048576);
+  attached.handle = 3;
+  auto attachedFrame = attached.toBinaryFrame();
+  BinaryFrame frame = decode(attachedFrame);
+  EXPECT_EQ(frame.header.type, BinaryFrameType::ATTACHED);
+  EXPECT_EQ(frame.text, "stream-1");
+  EXPECT_EQ(frame.header.handle, 3u);
+  EXPECT_EQ(frame.header.chunkSize, 65536u);
+  EXPECT_EQ(frame.header.minChunkSize, 4096u);
+  EXPECT_EQ(frame.header.maxChunkSize, 1048576u);
+
+  header.type = BinaryFrameType::DETACH;
+  header.handle = 3;
+  encoded = encodeBinaryFrame(header, "stream-1");
+  WebSocketMessage detach = WebSocketMessage::fromBinaryFrame(decode(encoded));
+  EXPECT_EQ(detach.type, "DETACH");
+  EXPECT_EQ(detach.handle, 3u);
+
+  WebSocketMessage detached = WebSocketMessage::detached("stream-1");
+  auto detachedFrame = detached.toBinaryFrame();
+  frame = decode(detachedFrame);
+  EXPECT_EQ(frame.header.type, BinaryFrameType::DETACHED);
+  EXPECT_EQ(frame.text, "stream-1");
+}
+
+TEST(BinaryProtocolTest, JsonRoundTrip) {
+  WebSocketMessage started =
+      WebSocketMessage::started("stream-1", 65536, 4096, 1048576);
+  started.handle = 11;
+  WebSocketMessage parsed =
+      WebSocketMessage::fromJsonString(started.toJsonString());
+  EXPECT_EQ(parsed.type, "STARTED");
+  EXPECT_EQ(parsed.streamId, "stream-1");
+  EXPECT_EQ(parsed.chunkSize, 65536u);
+  EXPECT_EQ(parsed.minChunkSize, 4096u);
+  EXPECT_EQ(parsed.maxChunkSize, 1048576u);
+  EXPECT_EQ(parsed.handle, 11u);
+
+  parsed = WebSocketMessage::fromJsonString(
+      WebSocketMessage::stopped("stream-1", 0x0000ABCD).toJsonString());
+  EXPECT_EQ(parsed.checksum, 0x0000ABCDu);
+}
+
+} // namespace
+} // namespace audio_stream
@@ -0,0 +1,223 @@
+#include "memory/chunk_cache.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+namespace audio_stream {
+namespace {
+
+constexpr size_t CHUNK = 1024;
+
+BufferView chunkOf(uint8_t fill, size_t size = CHUNK) {
+  std::shared_ptr<uint8_t> data(new uint8_t[size],
+                                std::default_delete<uint8_t[]>());
+  std::fill(data.get(), data.get() + size, fill);
+  return BufferView(std::shared_ptr<const uint8_t>(data), size);
+}
+
+// Misses a chunk twice, so the doorkeeper lets the second miss cache it
+void cacheChunk(ChunkCache &cache, uint64_t streamKey, uint64_t offset,
+                size_t length, const BufferView &chunk) {
+  cache.insert(streamKey, offset, length, chunk);
+  cache.insert(streamKey, offset, length, chunk);
+}
+
+// Offsets of stream 1 whose chunks share one shard: with room for a single
+// chunk per shard, caching one of them evicts the other
+std::vector<uint64_t> offsetsInOneShard(size_t count) {
+  ChunkCache cache(ChunkCache::SHARD_COUNT * CHUNK);
+  std::vector<uint64_t> offsets{0};
+  for (uint64_t offset = CHUNK; offsets.size() < count; offset += CHUNK) {
+    cache.setMaxBytes(ChunkCache::SHARD_COUNT * CHUNK);
+    cacheChunk(cache, 1, 0, CHUNK, chunkOf(0));
+    cacheChunk(cache, 1, offset, CHUNK, chunkOf(0));
+    if (cache.find(1, 0, CHUNK).empty()) {
+      offsets.push_back(offset);
+    }
+    cache.setMaxBytes(0);
+  }
+  return offsets;
+}
+
+class ChunkCacheClockTest : public ::testing::Test {
+protected:
+  // Three chunks fit in a shard
+  ChunkCacheClockTest()
+      : cache_(3 * ChunkCache::SHARD_COUNT * CHUNK),
+        offsets_(offsetsInOneShard(5)) {}
+
+  void insert(size_t i) {
+    cacheChunk(cache_, 1, offsets_[i], CHUNK,
+               chunkOf(static_cast<uint8_t>(i)));
+  }
+  bool cached(size_t i) { return !cache_.find(1, offsets_[i], CHUNK).empty(); }
+
+  ChunkCache cache_;
+  std::vector<uint64_t> offsets_;
+};
+
+TEST(ChunkCacheTest, HitReturnsCachedBytes) {
+  ChunkCache cache;
+  EXPECT_TRUE(cache.find(1, 0, CHUNK).empty());
+  cacheChunk(cache, 1, 0, CHUNK, chunkOf(0x5A));
+
+  BufferView hit = cache.find(1, 0, CHUNK);
+  ASSERT_EQ(hit.size(), CHUNK);
+  EXPECT_EQ(hit.begin()[0], 0x5A);
+  EXPECT_EQ(hit.begin()[CHUNK - 1], 0x5A);
+  EXPECT_EQ(cache.getBytes(), CHUNK);
+  EXPECT_EQ(cache.getHits(), 1u);
+  EXPECT_EQ(cache.getMisses(), 2u);
+}
+
+TEST(ChunkCacheTest, SinglePassReadDoesNotFillTheCache) {
+  ChunkCache cache;
+  for (uint64_t offset = 0; offset < 256 * CHUNK; offset += CHUNK) {
+    cache.insert(1, offset, CHUNK, chunkOf(1));
+  }
+  EXPECT_EQ(cache.getBytes(), 0u);
+  EXPECT_EQ(cache.getMisses(), 256u);
+  EXPECT_TRUE(cache.find(1, 0, CHUNK).empty());
+  EXPECT_TRUE(cache.find(1, 255 * CHUNK, CHUNK).empty());
+}
+
+TEST(ChunkCacheTest, SecondMissCachesTheChunk) {
+  ChunkCache cache;
+  cache.insert(1, 0, CHUNK, chunkOf(1));
+  cache.insert(1, CHUNK, CHUNK, chunkOf(2));
+  cache.insert(1, 0, CHUNK, chunkOf(1));
+  EXPECT_FALSE(cache.find(1, 0, CHUNK).empty());
+  EXPECT_TRUE(cache.find(1, CHUNK, CHUNK).empty());
+  EXPECT_EQ(cache.getBytes(), CHUNK);
+}
+
+TEST(ChunkCacheTest, KeyIncludesStreamOffsetAndLength) {
+  ChunkCache cache;
+  cacheChunk(cache, 1, 0, CHUNK, chunkOf(1));
+  EXPECT_TRUE(cache.find(2, 0, CHUNK).empty());
+  EXPECT_TRUE(cache.find(1, CHUNK, CHUNK).empty());
+  EXPECT_TRUE(cache.find(1, 0, CHUNK / 2).empty());
+}
+
+TEST(ChunkCacheTest, CachesACopy) {
+  ChunkCache cache;
+  BufferView source = chunkOf(7);
+  cacheChunk(cache, 1, 0, CHUNK, source);
+  const_cast<uint8_t *>(source.begin())[0] = 8;
+  EXPECT_EQ(cache.find(1, 0, CHUNK).begin()[0], 7);
+}
+
+TEST(ChunkCacheTest, SecondInsertOfAChunkKeepsTheFirst) {
+  ChunkCache cache;
+  cacheChunk(cache, 1, 0, CHUNK, chunkOf(1));
+  cacheChunk(cache, 1, 0, CHUNK, chunkOf(2));
+  EXPECT_EQ(cache.find(1, 0, CHUNK).begin()[0], 1);
+  EXPECT_EQ(cache.getBytes(), CHUNK);
+}
+
+TEST(ChunkCacheTest, SkipsOversizedAndEmptyChunks) {
+  ChunkCache cache;
+  cacheChunk(cache, 1, 0, ChunkCache::MAX_CHUNK_BYTES + 1,
+               chunkOf(1, ChunkCache::MAX_CHUNK_BYTES + 1));
+  cacheChunk(cache, 1, 0, 0, BufferView());
+  EXPECT_EQ(cache.getBytes(), 0u);
+
+  // Nor chunks larger than a shard's part of the budget
+  ChunkCache small(ChunkCache::SHARD_COUNT * CHUNK);
+  cacheChunk(small, 1, 0, 2 * CHUNK, chunkOf(1, 2 * CHUNK));
+  EXPECT_EQ(small.getBytes(), 0u);
+}
+
+TEST(ChunkCacheTest, ZeroBudgetDisablesTheCache) {
+  ChunkCache cache;
+  cacheChunk(cache, 1, 0, CHUNK, chunkOf(1));
+  cache.setMaxBytes(0);
+  EXPECT_EQ(cache.getBytes(), 0u);
+  cacheChunk(cache, 1, 0, CHUNK, chunkOf(1));
+  EXPECT_TRUE(cache.find(1, 0, CHUNK).empty());
+}
+
+TEST(ChunkCacheTest, EraseDropsOneStream) {
+  ChunkCache cache;
+  for (uint64_t offset = 0; offset < 64 * CHUNK; offset += CHUNK) {
+    cacheChunk(cache, 1, offset, CHUNK, chunkOf(1));
+    cacheChunk(cache, 2, offset, CHUNK, chunkOf(2));
+  }
+  cache.erase(1);
+  EXPECT_EQ(cache.getBytes(), 64 * CHUNK);
+  EXPECT_TRUE(cache.find(1, 0, CHUNK).empty());
+  EXPECT_FALSE(cache.find(2, 0, CHUNK).empty());
+}
+
+TEST(ChunkCacheTest, ShrinkingEvictsToTheNewBudget) {
+  ChunkCache cache;
+  for (uint64_t offset = 0; offset < 256 * CHUNK; offset += CHUNK) {
+    cacheChunk(cache, 1, offset, CHUNK, chunkOf(1));
+  }
+  cache.setMaxBytes(ChunkCache::SHARD_COUNT * 2 * CHUNK);
+  EXPECT_LE(cache.getBytes(), cache.getMaxBytes());
+  EXPECT_EQ(cache.getMaxBytes(), ChunkCache::SHARD_COUNT * 2 * CHUNK);
+}
+
+TEST(ChunkCacheTest, EvictedViewStaysValid) {
+  ChunkCache cache;
+  cacheChunk(cache, 1, 0, CHUNK, chunkOf(9));
+  BufferView held = cache.find(1, 0, CHUNK);
+  cache.erase(1);
+  EXPECT_TRUE(cache.find(1, 0, CHUNK).empty());
+  EXPECT_EQ(held.begin()[CHUNK - 1], 9);
+}
+
+TEST_F(ChunkCacheClockTest, UnreadChunksLeaveInInsertionOrder) {
+  insert(0);
+  insert(1);
+  insert(2);
+  insert(3);
+  EXPECT_FALSE(cached(0));
+  insert(4);
+  EXPECT_FALSE(cached(1));
+  EXPECT_TRUE(cached(2));
+  EXPECT_TRUE(cached(3));
+  EXPECT_TRUE(cached(4));
+}
+
+TEST_F(ChunkCacheClockTest, ReadChunkGetsASecondChance) {
+  insert(0);
+  insert(1);
+  insert(2);
+  EXPECT_TRUE(cached(0)); // Sets its reference bit
+  insert(3);
+  EXPECT_TRUE(cached(0));
+  EXPECT_FALSE(cached(1));
+  EXPECT_TRUE(cached(2));
+  EXPECT_TRUE(cached(3));
+}
+
+TEST_F(ChunkCacheClockTest, HotChunkSurvivesASequentialScan) {
+  insert(0);
+  for (size_t i = 1; i < offsets_.size(); ++i) {
+    EXPECT_TRUE(cached(0));
+    insert(i);
+  }
+  EXPECT_TRUE(cached(0));
+}
+
+TEST_F(ChunkCacheClockTest, AllReadChunksEvictWithinTwoPasses) {
+  insert(0);
+  insert(1);
+  insert(2);
+  EXPECT_TRUE(cached(0));
+  EXPECT_TRUE(cached(1));
+  EXPECT_TRUE(cached(2));
+  // The hand clears every bit, then comes back to the first chunk
+  insert(3);
+  EXPECT_EQ(cache_.getBytes(), 3 * CHUNK);
+  EXPECT_FALSE(cached(0));
+  EXPECT_TRUE(cached(1));
+  EXPECT_TRUE(cached(2));
+  EXPECT_TRUE(cached(3));
+}
+
+} // namespace
+} // namespace audio_stream
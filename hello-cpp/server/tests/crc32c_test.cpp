@@ -0,0 +1,109 @@
+#include "crc32c.h"
+#include "test_support.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace audio_stream {
+namespace {
+
+using test::pattern;
+
+uint32_t crcOf(const std::string &text) {
+  return crc32c::extend(0, reinterpret_cast<const uint8_t *>(text.data()),
+                        text.size());
+}
+
+TEST(Crc32cTest, KnownVectors) {
+  EXPECT_EQ(crcOf(""), 0u);
+  EXPECT_EQ(crcOf("123456789"), 0xE3069283u);
+  // RFC 3720 B.4: 32 bytes of zeros
+  std::vector<uint8_t> zeros(32, 0);
+  EXPECT_EQ(crc32c::extend(0, zeros.data(), zeros.size()), 0x8A9136AAu);
+}
+
+TEST(Crc32cTest, ExtendIsIncremental) {
+  auto data = pattern(1000);
+  uint32_t whole = crc32c::extend(0, data.data(), data.size());
+  uint32_t crc = 0;
+  for (size_t offset = 0; offset < data.size(); offset += 37) {
+    size_t length = std::min<size_t>(37, data.size() - offset);
+    crc = crc32c::extend(crc, data.data() + offset, length);
+  }
+  EXPECT_EQ(crc, whole);
+}
+
+TEST(Crc32cTest, SoftwareMatchesExtendAtEveryAlignment) {
+  auto data = pattern(300);
+  for (size_t begin = 0; begin < 16; ++begin) {
+    size_t length = data.size() - begin;
+    uint32_t software =
+        ~crc32c::detail::extendSoftware(~0u, data.data() + begin, length);
+    EXPECT_EQ(software, crc32c::extend(0, data.data() + begin, length))
+        << "begin " << begin;
+  }
+}
+
+TEST(Crc32cTest, CombineMatchesConcatenation) {
+  auto data = pattern(4096 + 13);
+  uint32_t whole = crc32c::extend(0, data.data(), data.size());
+  for (size_t split : {size_t{0}, size_t{1}, size_t{7}, size_t{8},
+                       size_t{1000}, size_t{4096}, data.size() - 1,
+                       data.size()}) {
+    uint32_t first = crc32c::extend(0, data.data(), split);
+    uint32_t second =
+        crc32c::extend(0, data.data() + split, data.size() - split);
+    EXPECT_EQ(crc32c::combine(first, second, data.size() - split), whole)
+        << "split " << split;
+  }
+}
+
+TEST(Crc32cTest, CombineOfManyBlocksInAnyGrouping) {
+  auto data = pattern(64 * 1024);
+  uint32_t whole = crc32c::extend(0, data.data(), data.size());
+  const size_t block = 4096;
+
+  // Left to right, as blocks arrive
+  uint32_t left = 0;
+  for (size_t offset = 0; offset < data.size(); offset += block) {
+    left = crc32c::combine(left, crc32c::extend(0, data.data() + offset, block),
+                           block);
+  }
+  EXPECT_EQ(left, whole);
+
+  // Right to left, as a stream filled from its end
+  uint32_t right = 0;
+  uint64_t rightLength = 0;
+  for (size_t offset = data.size(); offset > 0; offset -= block) {
+    uint32_t crc = crc32c::extend(0, data.data() + offset - block, block);
+    right = crc32c::combine(crc, right, rightLength);
+    rightLength += block;
+  }
+  EXPECT_EQ(right, whole);
+}
+
+TEST(Crc32cTest, CombineWithEmptyBlock) {
+  EXPECT_EQ(crc32c::combine(0x12345678, 0, 0), 0x12345678u);
+  uint32_t crc = crcOf("123456789");
+  EXPECT_EQ(crc32c::combine(0, crc, 9), crc);
+}
+
+TEST(Crc32cTest, CombineOverLargeLengths) {
+  // A second block of 1 MB takes the operator through 20 squarings
+  auto data = pattern(64);
+  uint32_t crc = crc32c::extend(0, data.data(), data.size());
+  std::vector<uint8_t> zeros(1 << 20, 0);
+  uint32_t zerosCrc = crc32c::extend(0, zeros.data(), zeros.size());
+  uint32_t expected = crc32c::extend(crc, zeros.data(), zeros.size());
+  EXPECT_EQ(crc32c::combine(crc, zerosCrc, zeros.size()), expected);
+}
+
+TEST(Crc32cTest, ToHex) {
+  EXPECT_EQ(crc32c::toHex(0), "00000000");
+  EXPECT_EQ(crc32c::toHex(0xE3069283), "e3069283");
+  EXPECT_EQ(crc32c::toHex(0x0000ABCD), "0000abcd");
+}
+
+} // namespace
+} // namespace audio_stream
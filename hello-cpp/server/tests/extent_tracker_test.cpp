@@ -0,0 +1,163 @@
+#include "memory/extent_tracker.h"
+#include "crc32c.h"
+#include "test_support.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace audio_stream {
+namespace {
+
+using test::pattern;
+
+uint32_t crcOf(const std::vector<uint8_t> &data, uint64_t offset,
+               uint64_t length) {
+  return crc32c::extend(0, data.data() + offset, length);
+}
+
+std::pair<uint64_t, uint64_t> gap(uint64_t begin, uint64_t end) {
+  return {begin, end};
+}
+
+void write(ExtentTracker &tracker, const std::vector<uint8_t> &data,
+           uint64_t offset, uint64_t length) {
+  tracker.add(offset, length, crcOf(data, offset, length));
+}
+
+TEST(ExtentTrackerTest, EmptyTrackerHasOneGap) {
+  ExtentTracker tracker;
+  EXPECT_EQ(tracker.filledEnd(0), 0u);
+  EXPECT_EQ(tracker.end(), 0u);
+  EXPECT_EQ(tracker.getExtentCount(), 0u);
+  EXPECT_FALSE(tracker.isComplete(10));
+  EXPECT_TRUE(tracker.isComplete(0));
+  EXPECT_EQ(tracker.firstGap(10), gap(0, 10));
+  EXPECT_EQ(tracker.prefixChecksum(), 0u);
+}
+
+TEST(ExtentTrackerTest, EmptyWriteIsIgnored) {
+  ExtentTracker tracker;
+  tracker.add(100, 0, 0);
+  EXPECT_EQ(tracker.getExtentCount(), 0u);
+  EXPECT_EQ(tracker.getFilledBytes(), 0u);
+}
+
+TEST(ExtentTrackerTest, InOrderWritesMergeIntoOneExtent) {
+  auto data = pattern(300);
+  ExtentTracker tracker;
+  write(tracker, data, 0, 100);
+  write(tracker, data, 100, 100);
+  write(tracker, data, 200, 100);
+
+  EXPECT_EQ(tracker.getExtentCount(), 1u);
+  EXPECT_EQ(tracker.getFilledBytes(), 300u);
+  EXPECT_EQ(tracker.filledEnd(0), 300u);
+  EXPECT_TRUE(tracker.isComplete(300));
+  EXPECT_EQ(tracker.prefixChecksum(), crcOf(data, 0, 300));
+}
+
+TEST(ExtentTrackerTest, OutOfOrderWritesReportGapsUntilFilled) {
+  auto data = pattern(400);
+  ExtentTracker tracker;
+  write(tracker, data, 300, 100);
+  write(tracker, data, 0, 100);
+
+  EXPECT_EQ(tracker.getExtentCount(), 2u);
+  EXPECT_EQ(tracker.filledEnd(0), 100u);
+  EXPECT_EQ(tracker.filledEnd(300), 400u);
+  EXPECT_EQ(tracker.filledEnd(150), 150u);
+  EXPECT_EQ(tracker.end(), 400u);
+  EXPECT_EQ(tracker.firstGap(400),
+            gap(100, 300));
+  EXPECT_EQ(tracker.prefixChecksum(), crcOf(data, 0, 100));
+
+  write(tracker, data, 200, 100);
+  EXPECT_EQ(tracker.getExtentCount(), 2u);
+  EXPECT_EQ(tracker.firstGap(400),
+            gap(100, 200));
+
+  // The last chunk joins both neighbours and combines their CRCs
+  write(tracker, data, 100, 100);
+  EXPECT_EQ(tracker.getExtentCount(), 1u);
+  EXPECT_EQ(tracker.getFilledBytes(), 400u);
+  EXPECT_EQ(tracker.firstGap(400),
+            gap(400, 400));
+  EXPECT_EQ(tracker.prefixChecksum(), crcOf(data, 0, 400));
+}
+
+TEST(ExtentTrackerTest, GapIsClippedToSize) {
+  auto data = pattern(100);
+  ExtentTracker tracker;
+  write(tracker, data, 0, 50);
+  EXPECT_EQ(tracker.firstGap(80), gap(50, 80));
+  EXPECT_EQ(tracker.firstGap(40), gap(40, 40));
+}
+
+TEST(ExtentTrackerTest, ReverseOrderWritesKeepChecksum) {
+  auto data = pattern(1000);
+  ExtentTracker tracker;
+  for (uint64_t offset = 900;; offset -= 100) {
+    write(tracker, data, offset, 100);
+    if (offset == 0) {
+      break;
+    }
+  }
+  EXPECT_EQ(tracker.getExtentCount(), 1u);
+  EXPECT_EQ(tracker.prefixChecksum(), crcOf(data, 0, 1000));
+}
+
+TEST(ExtentTrackerTest, OverlappingWriteLosesChecksum) {
+  auto data = pattern(300);
+  ExtentTracker tracker;
+  write(tracker, data, 0, 200);
+  write(tracker, data, 100, 200);
+
+  EXPECT_EQ(tracker.getExtentCount(), 1u);
+  EXPECT_EQ(tracker.getFilledBytes(), 300u);
+  EXPECT_EQ(tracker.filledEnd(0), 300u);
+  EXPECT_FALSE(tracker.prefixChecksum().has_value());
+}
+
+TEST(ExtentTrackerTest, OverwriteSpanningSeveralExtents) {
+  auto data = pattern(500);
+  ExtentTracker tracker;
+  write(tracker, data, 0, 100);
+  write(tracker, data, 200, 100);
+  write(tracker, data, 400, 100);
+  write(tracker, data, 50, 400);
+
+  EXPECT_EQ(tracker.getExtentCount(), 1u);
+  EXPECT_EQ(tracker.getFilledBytes(), 500u);
+  EXPECT_TRUE(tracker.isComplete(500));
+}
+
+TEST(ExtentTrackerTest, OverlapElsewhereKeepsPrefixChecksum) {
+  auto data = pattern(600);
+  ExtentTracker tracker;
+  write(tracker, data, 0, 100);
+  write(tracker, data, 300, 200);
+  write(tracker, data, 400, 200);
+
+  EXPECT_EQ(tracker.getExtentCount(), 2u);
+  EXPECT_EQ(tracker.prefixChecksum(), crcOf(data, 0, 100));
+}
+
+TEST(ExtentTrackerTest, AssignAndClear) {
+  ExtentTracker tracker;
+  tracker.add(500, 100, 1);
+  tracker.assign(1000, 0x1234);
+  EXPECT_EQ(tracker.getExtentCount(), 1u);
+  EXPECT_EQ(tracker.getFilledBytes(), 1000u);
+  EXPECT_EQ(tracker.prefixChecksum(), 0x1234u);
+
+  tracker.assign(0, 0);
+  EXPECT_EQ(tracker.getExtentCount(), 0u);
+
+  tracker.add(0, 10, 1);
+  tracker.clear();
+  EXPECT_EQ(tracker.getExtentCount(), 0u);
+  EXPECT_EQ(tracker.getFilledBytes(), 0u);
+  EXPECT_EQ(tracker.end(), 0u);
+}
+
+} // namespace
+} // namespace audio_stream
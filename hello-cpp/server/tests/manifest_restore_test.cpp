@@ -0,0 +1,176 @@
+#include "memory/stream_manager.h"
+#include "test_support.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace audio_stream {
+namespace {
+
+namespace fs = std::filesystem;
+
+using test::pattern;
+
+class ManifestRestoreTest : public ::testing::Test {
+protected:
+  ManifestRestoreTest() : cacheDir_(directory_.path()) {}
+
+  // Upload a stream with START-style chunks and finalize it
+  void upload(StreamManager &manager, const std::string &streamId,
+              const std::vector<uint8_t> &data) {
+    ASSERT_TRUE(manager.createStream(streamId));
+    for (size_t offset = 0; offset < data.size(); offset += 4096) {
+      size_t size = std::min<size_t>(4096, data.size() - offset);
+      ASSERT_TRUE(manager.writeChunk(streamId, data.data() + offset, size));
+    }
+    ASSERT_TRUE(manager.finalizeStream(streamId, data.size()));
+  }
+
+  std::string manifestPath() const {
+    return cacheDir_ + "/" + StreamManager::MANIFEST_FILE;
+  }
+
+  size_t manifestLines() const {
+    std::ifstream in(manifestPath());
+    size_t lines = 0;
+    for (std::string line; std::getline(in, line);) {
+      lines++;
+    }
+    return lines;
+  }
+
+  test::TempDirectory directory_;
+  std::string cacheDir_;
+};
+
+TEST_F(ManifestRestoreTest, RestoresReadyStreams) {
+  auto first = pattern(100000, 1);
+  auto second = pattern(5000, 2);
+  uint32_t firstChecksum = 0;
+  {
+    StreamManager manager(cacheDir_);
+    upload(manager, "first", first);
+    ASSERT_TRUE(manager.putStream("second", second.data(), second.size()));
+    firstChecksum = manager.getStream("first")->checksum;
+  }
+
+  StreamManager manager(cacheDir_);
+  EXPECT_EQ(manager.restoreStreams(), 2u);
+
+  auto stream = manager.getStream("first");
+  ASSERT_NE(stream, nullptr);
+  EXPECT_EQ(stream->status, StreamStatus::READY);
+  EXPECT_EQ(stream->totalSize, first.size());
+  EXPECT_EQ(stream->checksum, firstChecksum);
+  EXPECT_EQ(manager.readChunk("first", 0, first.size()), first);
+  EXPECT_EQ(manager.readChunk("second", 0, second.size()), second);
+}
+
+TEST_F(ManifestRestoreTest, DeletedStreamsStayDeleted) {
+  {
+    StreamManager manager(cacheDir_);
+    upload(manager, "kept", pattern(8192, 3));
+    upload(manager, "deleted", pattern(8192, 4));
+    ASSERT_TRUE(manager.deleteStream("deleted"));
+  }
+
+  StreamManager manager(cacheDir_);
+  EXPECT_EQ(manager.restoreStreams(), 1u);
+  EXPECT_NE(manager.getStream("kept"), nullptr);
+  EXPECT_EQ(manager.getStream("deleted"), nullptr);
+}
+
+TEST_F(ManifestRestoreTest, RemovesUnfinishedUploads) {
+  {
+    StreamManager manager(cacheDir_);
+    upload(manager, "done", pattern(8192, 5));
+    ASSERT_TRUE(manager.createStream("cut-off"));
+    auto data = pattern(4096, 6);
+    ASSERT_TRUE(manager.writeChunk("cut-off", data.data(), data.size()));
+  }
+  EXPECT_TRUE(fs::exists(cacheDir_ + "/cut-off.cache"));
+
+  StreamManager manager(cacheDir_);
+  EXPECT_EQ(manager.restoreStreams(), 1u);
+  EXPECT_EQ(manager.getStream("cut-off"), nullptr);
+  EXPECT_FALSE(fs::exists(cacheDir_ + "/cut-off.cache"));
+}
+
+TEST_F(ManifestRestoreTest, SkipsTornAndInvalidRecords) {
+  auto data = pattern(8192, 7);
+  {
+    StreamManager manager(cacheDir_);
+    upload(manager, "intact", data);
+  }
+  {
+    std::ofstream out(manifestPath(), std::ios::app);
+    out << "not json\n";
+    out << "{\"op\":\"ready\",\"streamId\":\"bad\",\"size\":\"x\"}\n";
+    out << "{\"op\":\"ready\",\"streamId\":\"torn\",\"si"; // Crash mid-line
+  }
+
+  StreamManager manager(cacheDir_);
+  EXPECT_EQ(manager.restoreStreams(), 1u);
+  EXPECT_EQ(manager.readChunk("intact", 0, data.size()), data);
+  EXPECT_EQ(manager.getStream("torn"), nullptr);
+}
+
+TEST_F(ManifestRestoreTest, CompactsTheJournal) {
+  {
+    StreamManager manager(cacheDir_);
+    for (int i = 0; i < 10; ++i) {
+      upload(manager, "stream-" + std::to_string(i), pattern(4096, i));
+    }
+    for (int i = 0; i < 5; ++i) {
+      ASSERT_TRUE(manager.deleteStream("stream-" + std::to_string(i)));
+    }
+  }
+  EXPECT_EQ(manifestLines(), 15u);
+
+  {
+    StreamManager manager(cacheDir_);
+    EXPECT_EQ(manager.restoreStreams(), 5u);
+  }
+  EXPECT_EQ(manifestLines(), 5u);
+
+  // The compacted journal restores the same streams
+  StreamManager manager(cacheDir_);
+  EXPECT_EQ(manager.restoreStreams(), 5u);
+  EXPECT_NE(manager.getStream("stream-9"), nullptr);
+}
+
+TEST_F(ManifestRestoreTest, ParsesLargeJournalsInParallel) {
+  auto data = pattern(4096, 8);
+  {
+    StreamManager manager(cacheDir_);
+    upload(manager, "early", data);
+  }
+  {
+    // Records of streams whose files are gone, enough for several parse
+    // threads, and a live stream deleted and re-uploaded across them
+    std::ofstream out(manifestPath(), std::ios::app);
+    for (int i = 0; i < 40000; ++i) {
+      out << "{\"op\":\"ready\",\"streamId\":\"gone-" << i
+          << "\",\"size\":4096,\"crc32c\":\"00000000\",\"createdAt\":0}\n";
+      if (i == 20000) {
+        out << "{\"op\":\"delete\",\"streamId\":\"early\"}\n";
+      }
+    }
+  }
+  {
+    StreamManager manager(cacheDir_);
+    upload(manager, "late", data);
+  }
+
+  StreamManager manager(cacheDir_);
+  EXPECT_EQ(manager.restoreStreams(), 1u);
+  EXPECT_EQ(manager.getStream("early"), nullptr);
+  EXPECT_EQ(manager.readChunk("late", 0, data.size()), data);
+  EXPECT_EQ(manifestLines(), 1u);
+}
+
+} // namespace
+} // namespace audio_stream
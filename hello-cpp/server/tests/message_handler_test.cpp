@@ -0,0 +1,391 @@
+#include "handler/websocket_message_handler.h"
+#include "crc32c.h"
+#include "test_support.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace audio_stream {
+namespace {
+
+using test::pattern;
+
+// Forwards to the stream's real file, but sync() fails while failSync is set
+class FailingSyncStorage : public StorageBackend {
+public:
+  explicit FailingSyncStorage(std::unique_ptr<StorageBackend> file)
+      : file_(std::move(file)) {}
+
+  bool failSync = true;
+  size_t syncCalls = 0;
+
+  bool create(uint64_t initialSize) override {
+    return file_->create(initialSize);
+  }
+  bool open() override { return file_->open(); }
+  void close() override { file_->close(); }
+  size_t write(uint64_t offset, const uint8_t *data, size_t size) override {
+    return file_->write(offset, data, size);
+  }
+  std::vector<uint8_t> read(uint64_t offset, size_t length) override {
+    return file_->read(offset, length);
+  }
+  BufferView readView(uint64_t offset, size_t length) override {
+    return file_->readView(offset, length);
+  }
+  bool seal() override { return file_->seal(); }
+  BufferView tryReadView(uint64_t offset, size_t length) override {
+    return file_->tryReadView(offset, length);
+  }
+  std::vector<size_t>
+  writeBatch(const std::vector<WriteOperation> &operations) override {
+    return file_->writeBatch(operations);
+  }
+  bool finalize(uint64_t finalSize, bool flushData) override {
+    return file_->finalize(finalSize, flushData);
+  }
+  bool flushAsync() override { return file_->flushAsync(); }
+  bool flush() override { return file_->flush(); }
+  bool sync() override {
+    syncCalls++;
+    return !failSync && file_->sync();
+  }
+  bool prefetch(uint64_t offset, size_t length) override {
+    return file_->prefetch(offset, length);
+  }
+  bool adviseSequential(bool sequential) override {
+    return file_->adviseSequential(sequential);
+  }
+  uint64_t releaseMappings() override { return file_->releaseMappings(); }
+  uint64_t getSize() const override { return file_->getSize(); }
+  uint64_t getCapacity() const override { return file_->getCapacity(); }
+  uint64_t getMappedBytes() const override { return file_->getMappedBytes(); }
+  uint64_t getUnflushedBytes() const override {
+    return file_->getUnflushedBytes();
+  }
+  std::string getFilePath() const override { return file_->getFilePath(); }
+  bool isOpen() const override { return file_->isOpen(); }
+
+private:
+  std::unique_ptr<StorageBackend> file_;
+};
+
+class MessageHandlerTest : public ::testing::Test {
+protected:
+  static constexpr const char *CONNECTION = "connection-1";
+
+  MessageHandlerTest()
+      : manager_(std::make_shared<StreamManager>(directory_.path())),
+        handler_(std::make_unique<WebSocketMessageHandler>(manager_)) {}
+
+  ~MessageHandlerTest() override { handler_.reset(); }
+
+  void send(const std::string &json,
+            const std::string &connectionId = CONNECTION) {
+    handler_->handleTextMessage(
+        json, connectionId,
+        [this](const std::string &reply) {
+          record(nlohmann::json::parse(reply));
+        },
+        [](uint64_t, const BufferView &, CompressionProfile) {});
+  }
+
+  // A binary DATA frame when offset is set, a raw JSON-protocol one if not
+  void sendData(const std::vector<uint8_t> &data,
+                std::optional<uint64_t> offset = std::nullopt,
+                const std::string &connectionId = CONNECTION,
+                uint32_t handle = 0) {
+    PooledBufferPtr buffer =
+        MemoryPoolManager::getInstance().acquire(data.size());
+    std::memcpy(buffer->data(), data.data(), data.size());
+    handler_->handleBinaryMessage(
+        std::move(buffer), connectionId,
+        [this](const WebSocketMessage &reply) { record(reply.toJson()); },
+        handle, offset);
+  }
+
+  void record(nlohmann::json reply) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    replies_.push_back(std::move(reply));
+    cv_.notify_all();
+  }
+
+  // The next reply, answered on a writer thread for STOP and RESUME
+  nlohmann::json nextReply() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    EXPECT_TRUE(cv_.wait_for(lock, std::chrono::seconds(5),
+                             [this] { return !replies_.empty(); }));
+    if (replies_.empty()) {
+      return nlohmann::json::object();
+    }
+    nlohmann::json reply = replies_.front();
+    replies_.erase(replies_.begin());
+    return reply;
+  }
+
+  double metric(const std::string &name) const {
+    for (const MetricValue &value : handler_->collectMetrics()) {
+      if (value.name == name) {
+        return value.value;
+      }
+    }
+    ADD_FAILURE() << "No metric " << name;
+    return -1;
+  }
+
+  // Write queues are dropped on a writer thread once their chunks are in
+  bool waitForWriteQueues(double streams) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (metric("write_queue_streams") != streams) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+  }
+
+  // Start a strict upload whose file fails to sync until told otherwise
+  FailingSyncStorage *startFailingUpload(const std::string &streamId) {
+    send(R"({"type": "START", "streamId": ")" + streamId +
+         R"(", "durability": "strict"})");
+    EXPECT_EQ(nextReply().value("type", ""), "STARTED");
+    auto stream = manager_->getStream(streamId);
+    std::unique_lock<std::shared_mutex> writeLock(stream->writeMutex);
+    std::lock_guard<std::mutex> streamLock(stream->contextMutex);
+    auto file =
+        std::make_unique<FailingSyncStorage>(std::move(stream->mmapFile));
+    FailingSyncStorage *failing = file.get();
+    stream->mmapFile = std::move(file);
+    return failing;
+  }
+
+  test::TempDirectory directory_;
+  std::shared_ptr<StreamManager> manager_;
+  std::unique_ptr<WebSocketMessageHandler> handler_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<nlohmann::json> replies_;
+};
+
+TEST_F(MessageHandlerTest, StopAnswersWithTheChecksum) {
+  auto data = pattern(10000, 1);
+  send(R"({"type": "START", "streamId": "s", "durability": "strict"})");
+  ASSERT_EQ(nextReply().value("type", ""), "STARTED");
+  sendData(data);
+  send(R"({"type": "STOP", "streamId": "s"})");
+
+  nlohmann::json reply = nextReply();
+  EXPECT_EQ(reply.value("type", ""), "STOPPED");
+  EXPECT_EQ(reply.value("crc32c", ""),
+            crc32c::toHex(crc32c::extend(0, data.data(), data.size())));
+  EXPECT_EQ(manager_->getStream("s")->status, StreamStatus::READY);
+  EXPECT_TRUE(handler_->getStreamForConnection(CONNECTION).empty());
+}
+
+TEST_F(MessageHandlerTest, FailedSyncIsAnErrorAndKeepsTheUploadOpen) {
+  auto data = pattern(10000, 2);
+  FailingSyncStorage *file = startFailingUpload("s");
+  sendData(data);
+  send(R"({"type": "STOP", "streamId": "s"})");
+
+  nlohmann::json reply = nextReply();
+  EXPECT_EQ(reply.value("type", ""), "ERROR");
+  EXPECT_EQ(reply.value("streamId", ""), "s");
+  EXPECT_EQ(file->syncCalls, 1u);
+
+  // Not READY, nothing counted as written, and still on its handle
+  auto stream = manager_->getStream("s");
+  EXPECT_EQ(stream->status, StreamStatus::UPLOADING);
+  EXPECT_EQ(stream->currentOffset, 0u);
+  EXPECT_EQ(handler_->getStreamForConnection(CONNECTION), "s");
+
+  // STOP again without sending the bytes again does not sync what failed
+  send(R"({"type": "STOP", "streamId": "s"})");
+  reply = nextReply();
+  EXPECT_EQ(reply.value("type", ""), "ERROR");
+  EXPECT_EQ(file->syncCalls, 1u);
+  EXPECT_EQ(stream->status, StreamStatus::UPLOADING);
+}
+
+TEST_F(MessageHandlerTest, UploadSentAgainAfterAFailedSyncIsStored) {
+  auto data = pattern(10000, 3);
+  FailingSyncStorage *file = startFailingUpload("s");
+  sendData(data);
+  send(R"({"type": "STOP", "streamId": "s"})");
+  ASSERT_EQ(nextReply().value("type", ""), "ERROR");
+
+  file->failSync = false;
+  send(R"({"type": "RESUME", "streamId": "s"})");
+  nlohmann::json resumed = nextReply();
+  ASSERT_EQ(resumed.value("type", ""), "RESUMED");
+  EXPECT_EQ(resumed.value("offset", size_t{1}), 0u);
+
+  sendData(data);
+  send(R"({"type": "STOP", "streamId": "s"})");
+  nlohmann::json reply = nextReply();
+  EXPECT_EQ(reply.value("type", ""), "STOPPED");
+  EXPECT_EQ(reply.value("crc32c", ""),
+            crc32c::toHex(crc32c::extend(0, data.data(), data.size())));
+  EXPECT_EQ(file->syncCalls, 2u);
+  EXPECT_EQ(manager_->readChunk("s", 0, data.size()), data);
+}
+
+TEST_F(MessageHandlerTest, DeletedUploadDropsItsWriteQueue) {
+  send(R"({"type": "START", "streamId": "s"})");
+  ASSERT_EQ(nextReply().value("type", ""), "STARTED");
+  sendData(pattern(1000, 4));
+  EXPECT_EQ(metric("write_queue_streams"), 1);
+
+  EXPECT_TRUE(manager_->deleteStream("s"));
+  EXPECT_EQ(metric("write_queue_streams"), 0);
+}
+
+TEST_F(MessageHandlerTest, ExpiredUploadDropsItsWriteQueue) {
+  send(R"({"type": "START", "streamId": "s"})");
+  ASSERT_EQ(nextReply().value("type", ""), "STARTED");
+  sendData(pattern(1000, 5));
+
+  CacheBudget budget = manager_->getCacheBudget();
+  budget.streamTtl = std::chrono::seconds(0);
+  manager_->setCacheBudget(budget);
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  manager_->cleanupOldStreams();
+  EXPECT_EQ(manager_->getStream("s"), nullptr);
+  EXPECT_EQ(metric("write_queue_streams"), 0);
+}
+
+TEST_F(MessageHandlerTest, ClosedConnectionDropsItsWriteQueues) {
+  send(R"({"type": "START", "streamId": "a"})");
+  ASSERT_EQ(nextReply().value("type", ""), "STARTED");
+  sendData(pattern(1000, 6));
+  send(R"({"type": "START", "streamId": "b"})");
+  ASSERT_EQ(nextReply().value("type", ""), "STARTED");
+  sendData(pattern(1000, 7));
+  EXPECT_EQ(metric("write_queue_streams"), 2);
+
+  handler_->disassociateConnection(CONNECTION);
+  EXPECT_TRUE(waitForWriteQueues(0));
+
+  // The chunks sent before the connection closed were written
+  EXPECT_EQ(manager_->getStream("a")->currentOffset, 1000u);
+  EXPECT_EQ(manager_->getStream("b")->currentOffset, 1000u);
+}
+
+TEST_F(MessageHandlerTest, UploadTakenOverKeepsItsWriteQueue) {
+  send(R"({"type": "START", "streamId": "s"})");
+  ASSERT_EQ(nextReply().value("type", ""), "STARTED");
+  sendData(pattern(1000, 8));
+  send(R"({"type": "RESUME", "streamId": "s"})", "connection-2");
+  ASSERT_EQ(nextReply().value("type", ""), "RESUMED");
+
+  handler_->disassociateConnection(CONNECTION);
+  EXPECT_EQ(handler_->getStreamForConnection("connection-2"), "s");
+  EXPECT_EQ(metric("write_queue_streams"), 1);
+
+  send(R"({"type": "STOP", "streamId": "s"})", "connection-2");
+  ASSERT_EQ(nextReply().value("type", ""), "STOPPED");
+  EXPECT_EQ(metric("write_queue_streams"), 0);
+}
+
+TEST_F(MessageHandlerTest, AttachedConnectionsUploadRangesOfOneStream) {
+  auto data = pattern(30000, 9);
+  auto range = [&](size_t begin, size_t end) {
+    return std::vector<uint8_t>(data.begin() + begin, data.begin() + end);
+  };
+  send(R"({"type": "START", "streamId": "s"})");
+  ASSERT_EQ(nextReply().value("type", ""), "STARTED");
+
+  send(R"({"type": "ATTACH", "streamId": "s"})", "connection-2");
+  nlohmann::json second = nextReply();
+  ASSERT_EQ(second.value("type", ""), "ATTACHED");
+  send(R"({"type": "ATTACH", "streamId": "s"})", "connection-3");
+  nlohmann::json third = nextReply();
+  ASSERT_EQ(third.value("type", ""), "ATTACHED");
+  EXPECT_GT(third.value("chunkSize", size_t{0}), 0u);
+
+  // Each sends its own range, in any order; the owner keeps the stream
+  sendData(range(20000, 30000), 20000, "connection-3",
+           third.value("handle", 0u));
+  sendData(range(0, 10000), 0);
+  sendData(range(10000, 20000), 10000, "connection-2",
+           second.value("handle", 0u));
+  EXPECT_EQ(handler_->getStreamForConnection(CONNECTION), "s");
+
+  send(R"({"type": "DETACH", "streamId": "s"})", "connection-2");
+  send(R"({"type": "DETACH", "streamId": "s"})", "connection-3");
+  EXPECT_EQ(nextReply().value("type", ""), "DETACHED");
+  EXPECT_EQ(nextReply().value("type", ""), "DETACHED");
+  EXPECT_TRUE(handler_->getStreamForConnection("connection-2").empty());
+
+  send(R"({"type": "STOP", "streamId": "s"})");
+  nlohmann::json reply = nextReply();
+  EXPECT_EQ(reply.value("type", ""), "STOPPED");
+  EXPECT_EQ(reply.value("crc32c", ""),
+            crc32c::toHex(crc32c::extend(0, data.data(), data.size())));
+  EXPECT_EQ(manager_->readChunk("s", 0, data.size()), data);
+  EXPECT_EQ(metric("write_queue_streams"), 0);
+}
+
+TEST_F(MessageHandlerTest, ClosedAttachedConnectionLeavesTheUploadToItsOwner) {
+  send(R"({"type": "START", "streamId": "s"})");
+  ASSERT_EQ(nextReply().value("type", ""), "STARTED");
+  send(R"({"type": "ATTACH", "streamId": "s"})", "connection-2");
+  nlohmann::json attached = nextReply();
+  ASSERT_EQ(attached.value("type", ""), "ATTACHED");
+  sendData(pattern(1000, 10), 1000, "connection-2",
+           attached.value("handle", 0u));
+
+  handler_->disassociateConnection("connection-2");
+  EXPECT_EQ(handler_->getStreamForConnection(CONNECTION), "s");
+  EXPECT_EQ(metric("write_queue_streams"), 1);
+
+  sendData(pattern(1000, 11), 0);
+  send(R"({"type": "STOP", "streamId": "s"})");
+  EXPECT_EQ(nextReply().value("type", ""), "STOPPED");
+  EXPECT_EQ(manager_->getStream("s")->totalSize, 2000u);
+}
+
+TEST_F(MessageHandlerTest, ChunksOfAnAttachedConnectionNeedAnOffset) {
+  send(R"({"type": "START", "streamId": "s"})");
+  ASSERT_EQ(nextReply().value("type", ""), "STARTED");
+  send(R"({"type": "ATTACH", "streamId": "s"})", "connection-2");
+  ASSERT_EQ(nextReply().value("type", ""), "ATTACHED");
+
+  sendData(pattern(1000, 12), std::nullopt, "connection-2");
+  nlohmann::json reply = nextReply();
+  EXPECT_EQ(reply.value("type", ""), "ERROR");
+  EXPECT_EQ(reply.value("streamId", ""), "s");
+
+  // Nor did it land after the owner's chunks
+  sendData(pattern(1000, 13));
+  send(R"({"type": "STOP", "streamId": "s"})");
+  ASSERT_EQ(nextReply().value("type", ""), "STOPPED");
+  EXPECT_EQ(manager_->getStream("s")->totalSize, 1000u);
+}
+
+TEST_F(MessageHandlerTest, AttachNeedsAnUploadingStream) {
+  send(R"({"type": "ATTACH", "streamId": "missing"})", "connection-2");
+  EXPECT_EQ(nextReply().value("type", ""), "ERROR");
+
+  send(R"({"type": "START", "streamId": "s"})");
+  ASSERT_EQ(nextReply().value("type", ""), "STARTED");
+  sendData(pattern(1000, 14));
+  send(R"({"type": "STOP", "streamId": "s"})");
+  ASSERT_EQ(nextReply().value("type", ""), "STOPPED");
+  send(R"({"type": "ATTACH", "streamId": "s"})", "connection-2");
+  EXPECT_EQ(nextReply().value("type", ""), "ERROR");
+  send(R"({"type": "DETACH", "streamId": "s"})", "connection-2");
+  EXPECT_EQ(nextReply().value("type", ""), "ERROR");
+  EXPECT_EQ(handler_->getStreamCountForConnection("connection-2"), 0u);
+}
+
+} // namespace
+} // namespace audio_stream
@@ -0,0 +1,92 @@
+#include "sha256.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace audio_stream {
+namespace {
+
+std::string hexOf(const std::string &message) {
+  return sha256::toHex(sha256::digest(
+      reinterpret_cast<const uint8_t *>(message.data()), message.size()));
+}
+
+TEST(Sha256Test, KnownVectors) {
+  // FIPS 180-4 examples
+  EXPECT_EQ(hexOf(""), "e3b0c44298fc1c149afbf4c8996fb924"
+                       "27ae41e4649b934ca495991b7852b855");
+  EXPECT_EQ(hexOf("abc"), "ba7816bf8f01cfea414140de5dae2223"
+                          "b00361a396177a9cb410ff61f20015ad");
+  EXPECT_EQ(hexOf("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+            "248d6a61d20638b8e5c026930c3e6039"
+            "a33ce45964ff2167f6ecedd419db06c1");
+  EXPECT_EQ(hexOf(std::string(1000000, 'a')),
+            "cdc76e5c9914fb9281a1c7e284d73e67"
+            "f1809a48a497200e046d39ccc7112cd0");
+}
+
+TEST(Sha256Test, PaddingAtBlockBoundaries) {
+  // 55 bytes pad within one block, 56 spill into a second
+  EXPECT_EQ(hexOf(std::string(55, 'a')),
+            "9f4390f8d30c2dd92ec9f095b65e2b9a"
+            "e9b0a925a5258e241c9f1e910f734318");
+  EXPECT_EQ(hexOf(std::string(56, 'a')),
+            "b35439a4ac6f0948b6d6f9e3c6af0f5f"
+            "590ce20f1bde7090ef7970686ec6738a");
+  EXPECT_EQ(hexOf(std::string(64, 'a')),
+            "ffe054fe7ae0cb6dc65c3af9b61d5209"
+            "f439851db43d0ba5997337df154668eb");
+}
+
+TEST(Sha256Test, UpdateInPiecesMatchesOneCall) {
+  std::vector<uint8_t> data(10000);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i * 17 + 3);
+  }
+  sha256::Digest whole = sha256::digest(data.data(), data.size());
+  for (size_t piece : {size_t{1}, size_t{7}, size_t{63}, size_t{64},
+                       size_t{65}, size_t{1000}}) {
+    sha256::Hasher hasher;
+    for (size_t offset = 0; offset < data.size(); offset += piece) {
+      hasher.update(data.data() + offset,
+                    std::min(piece, data.size() - offset));
+    }
+    EXPECT_EQ(hasher.finish(), whole) << "piece " << piece;
+  }
+}
+
+TEST(Sha256Test, ProofDependsOnNonceAndBlock) {
+  std::vector<uint8_t> block(4096, 0x42);
+  uint8_t nonce[16] = {1, 2, 3};
+  uint8_t other[16] = {1, 2, 4};
+  sha256::Digest proof =
+      sha256::proof(nonce, sizeof(nonce), block.data(), block.size());
+
+  sha256::Hasher hasher;
+  hasher.update(nonce, sizeof(nonce));
+  hasher.update(block.data(), block.size());
+  EXPECT_EQ(proof, hasher.finish());
+
+  EXPECT_NE(proof,
+            sha256::proof(other, sizeof(other), block.data(), block.size()));
+  block[100] ^= 1;
+  EXPECT_NE(proof,
+            sha256::proof(nonce, sizeof(nonce), block.data(), block.size()));
+}
+
+TEST(Sha256Test, HexRoundTrip) {
+  sha256::Digest digest = sha256::digest(nullptr, 0);
+  sha256::Digest parsed{};
+  ASSERT_TRUE(sha256::fromHex(sha256::toHex(digest), parsed.data(),
+                              parsed.size()));
+  EXPECT_EQ(parsed, digest);
+
+  uint8_t byte;
+  EXPECT_TRUE(sha256::fromHex("Af", &byte, 1));
+  EXPECT_EQ(byte, 0xAF);
+  EXPECT_FALSE(sha256::fromHex("a", &byte, 1));
+  EXPECT_FALSE(sha256::fromHex("zz", &byte, 1));
+}
+
+} // namespace
+} // namespace audio_stream
@@ -0,0 +1,179 @@
+#include "memory/slab_store.h"
+#include "test_support.h"
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#ifdef AUDIO_STREAM_HAVE_SLAB_STORE
+
+namespace audio_stream {
+namespace {
+
+namespace fs = std::filesystem;
+
+using test::pattern;
+
+std::vector<uint8_t> contents(StorageBackend &storage) {
+  return storage.read(0, static_cast<size_t>(storage.getSize()));
+}
+
+class SlabStoreTest : public ::testing::Test {
+protected:
+  SlabStoreTest() : directory_(temp_.path()) {}
+
+  size_t slabFiles() const {
+    size_t files = 0;
+    for (const auto &entry : fs::directory_iterator(directory_)) {
+      files += entry.path().extension() == SlabStore::EXTENSION;
+    }
+    return files;
+  }
+
+  test::TempDirectory temp_;
+  std::string directory_;
+};
+
+TEST_F(SlabStoreTest, AppendsStreamsBackToBack) {
+  SlabStore store(directory_);
+  auto first = pattern(1000, 1);
+  auto second = pattern(3000, 2);
+  SlabLocation a;
+  SlabLocation b;
+  auto storageA = store.append(first.data(), first.size(), Durability::NONE, a);
+  auto storageB =
+      store.append(second.data(), second.size(), Durability::STRICT_SYNC, b);
+  ASSERT_NE(storageA, nullptr);
+  ASSERT_NE(storageB, nullptr);
+
+  EXPECT_EQ(a.slab, b.slab);
+  EXPECT_EQ(a.offset, 0u);
+  EXPECT_EQ(b.offset, first.size());
+  EXPECT_EQ(contents(*storageA), first);
+  EXPECT_EQ(contents(*storageB), second);
+  EXPECT_EQ(storageB->getFilePath(), store.getSlabPath(b.slab));
+
+  SlabStats stats = store.getStats();
+  EXPECT_EQ(stats.files, 1u);
+  EXPECT_EQ(stats.streams, 2u);
+  EXPECT_EQ(stats.bytes, first.size() + second.size());
+  EXPECT_EQ(stats.liveBytes, first.size() + second.size());
+}
+
+TEST_F(SlabStoreTest, ViewsAreClippedToTheStream) {
+  SlabStore store(directory_);
+  auto first = pattern(100, 1);
+  auto second = pattern(100, 2);
+  SlabLocation location;
+  auto storage =
+      store.append(first.data(), first.size(), Durability::NONE, location);
+  store.append(second.data(), second.size(), Durability::NONE, location);
+
+  BufferView view = storage->readView(50, 1000);
+  EXPECT_EQ(view.size(), 50u);
+  EXPECT_EQ(view.begin()[0], first[50]);
+  EXPECT_TRUE(storage->readView(100, 10).empty());
+}
+
+TEST_F(SlabStoreTest, StreamsAreReadOnly) {
+  SlabStore store(directory_);
+  auto data = pattern(100, 1);
+  SlabLocation location;
+  auto storage =
+      store.append(data.data(), data.size(), Durability::NONE, location);
+  EXPECT_EQ(storage->write(0, data.data(), data.size()), 0u);
+  EXPECT_FALSE(storage->create(100));
+  EXPECT_FALSE(storage->finalize(100));
+  EXPECT_EQ(contents(*storage), data);
+}
+
+TEST_F(SlabStoreTest, RefusesStreamsLargerThanASlab) {
+  SlabStore store(directory_);
+  uint8_t byte = 0;
+  SlabLocation location;
+  EXPECT_EQ(store.append(&byte, SlabStore::SLAB_BYTES + 1, Durability::NONE,
+                         location),
+            nullptr);
+  EXPECT_EQ(store.getStats().files, 0u);
+}
+
+TEST_F(SlabStoreTest, FullSlabIsSealedAndRemovedWhenEmpty) {
+  SlabStore store(directory_);
+  auto big = pattern(SlabStore::SLAB_BYTES / 2 + 1, 3);
+  SlabLocation first;
+  SlabLocation second;
+  auto storageA = store.append(big.data(), big.size(), Durability::NONE, first);
+  auto storageB =
+      store.append(big.data(), big.size(), Durability::NONE, second);
+  ASSERT_NE(storageB, nullptr);
+  EXPECT_NE(first.slab, second.slab);
+  EXPECT_EQ(second.offset, 0u);
+  EXPECT_EQ(slabFiles(), 2u);
+
+  // The sealed slab goes with its last stream; views keep its mapping
+  BufferView held = storageA->readView(0, 16);
+  store.release(first, big.size());
+  EXPECT_FALSE(fs::exists(store.getSlabPath(first.slab)));
+  EXPECT_EQ(held.begin()[15], big[15]);
+
+  // The slab taking appends stays, empty or not
+  store.release(second, big.size());
+  EXPECT_TRUE(fs::exists(store.getSlabPath(second.slab)));
+  SlabStats stats = store.getStats();
+  EXPECT_EQ(stats.files, 1u);
+  EXPECT_EQ(stats.streams, 0u);
+  EXPECT_EQ(stats.liveBytes, 0u);
+}
+
+TEST_F(SlabStoreTest, RestoresStreamsOfAPreviousRun) {
+  auto first = pattern(1000, 4);
+  auto second = pattern(2000, 5);
+  SlabLocation a;
+  SlabLocation b;
+  {
+    SlabStore store(directory_);
+    store.append(first.data(), first.size(), Durability::ON_FINALIZE, a);
+    store.append(second.data(), second.size(), Durability::ON_FINALIZE, b);
+  }
+
+  SlabStore store(directory_);
+  auto storageB = store.restore(b, second.size());
+  ASSERT_NE(storageB, nullptr);
+  EXPECT_EQ(contents(*storageB), second);
+  EXPECT_EQ(store.restore(b, second.size() + 1), nullptr);
+  EXPECT_EQ(store.restore(SlabLocation{b.slab + 1, 0}, 1), nullptr);
+
+  // Restored slabs are sealed: new streams go to a new slab, with a new id
+  SlabLocation c;
+  ASSERT_NE(store.append(first.data(), first.size(), Durability::NONE, c),
+            nullptr);
+  EXPECT_GT(c.slab, b.slab);
+
+  store.release(b, second.size());
+  EXPECT_FALSE(fs::exists(store.getSlabPath(b.slab)));
+}
+
+TEST_F(SlabStoreTest, RemovesSlabsNoStreamWasRestoredFrom) {
+  auto data = pattern(100, 6);
+  SlabLocation kept;
+  SlabLocation dropped;
+  {
+    SlabStore store(directory_);
+    auto big = pattern(SlabStore::SLAB_BYTES - 50, 7);
+    store.append(big.data(), big.size(), Durability::NONE, dropped);
+    store.append(data.data(), data.size(), Durability::NONE, kept);
+  }
+  ASSERT_NE(kept.slab, dropped.slab);
+  EXPECT_EQ(slabFiles(), 2u);
+
+  SlabStore store(directory_);
+  ASSERT_NE(store.restore(kept, data.size()), nullptr);
+  EXPECT_EQ(store.removeUnused(), 1u);
+  EXPECT_FALSE(fs::exists(store.getSlabPath(dropped.slab)));
+  EXPECT_TRUE(fs::exists(store.getSlabPath(kept.slab)));
+}
+
+} // namespace
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_HAVE_SLAB_STORE
@@ -0,0 +1,154 @@
+#include "memory/stream_manager.h"
+#include "sha256.h"
+#include "test_support.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace audio_stream {
+namespace {
+
+using test::pattern;
+
+class StoredBlockTest : public ::testing::Test {
+protected:
+  StoredBlockTest()
+      : cacheDir_(directory_.path()),
+        manager_(std::make_unique<StreamManager>(cacheDir_)) {}
+
+  void upload(const std::string &streamId, const std::vector<uint8_t> &data) {
+    ASSERT_TRUE(manager_->createStream(streamId));
+    ASSERT_TRUE(manager_->writeChunkAt(streamId, 0, data.data(), data.size()));
+    ASSERT_TRUE(manager_->finalizeStream(streamId, data.size()));
+  }
+
+  // The proof a client holding data's block at offset sends for streamId
+  sha256::Digest proofFor(const std::string &streamId,
+                          const std::vector<uint8_t> &data, uint64_t offset,
+                          size_t length) {
+    auto stream = manager_->getStream(streamId);
+    return sha256::proof(stream->uploadNonce.data(),
+                         stream->uploadNonce.size(), data.data() + offset,
+                         length);
+  }
+
+  size_t offer(const std::string &streamId, const std::vector<uint8_t> &data,
+               uint64_t offset) {
+    size_t length = static_cast<size_t>(
+        std::min<uint64_t>(data.size() - offset, HAVE_BLOCK_SIZE));
+    return manager_->writeStoredBlock(
+        streamId, offset, length,
+        sha256::digest(data.data() + offset, length),
+        proofFor(streamId, data, offset, length));
+  }
+
+  test::TempDirectory directory_;
+  std::string cacheDir_;
+  std::unique_ptr<StreamManager> manager_;
+};
+
+TEST_F(StoredBlockTest, ReuploadIsStoredFromIndexedBlocks) {
+  auto data = pattern(2 * HAVE_BLOCK_SIZE + 1000, 1);
+  upload("original", data);
+  manager_->indexReadyBlocks();
+  EXPECT_EQ(manager_->getCacheStats().indexedBlocks, 3u);
+
+  ASSERT_TRUE(manager_->createStream("copy"));
+  for (uint64_t offset = 0; offset < data.size(); offset += HAVE_BLOCK_SIZE) {
+    EXPECT_EQ(offer("copy", data, offset),
+              std::min<size_t>(data.size() - offset, HAVE_BLOCK_SIZE));
+  }
+  ASSERT_TRUE(manager_->finalizeStream("copy", data.size()));
+  EXPECT_EQ(manager_->readChunk("copy", 0, data.size()), data);
+  EXPECT_EQ(manager_->getStream("copy")->checksum,
+            manager_->getStream("original")->checksum);
+
+  CacheStats stats = manager_->getCacheStats();
+  EXPECT_EQ(stats.haveBlocks, 3u);
+  EXPECT_EQ(stats.haveBytes, data.size());
+}
+
+TEST_F(StoredBlockTest, MixesStoredAndSentBlocks) {
+  auto data = pattern(3 * HAVE_BLOCK_SIZE, 2);
+  upload("original", data);
+  manager_->indexReadyBlocks();
+
+  // The middle block changed: it is offered in vain and sent instead
+  auto edited = data;
+  edited[HAVE_BLOCK_SIZE + 5] ^= 0xFF;
+  ASSERT_TRUE(manager_->createStream("edited"));
+  EXPECT_EQ(offer("edited", edited, 0), HAVE_BLOCK_SIZE);
+  EXPECT_EQ(offer("edited", edited, HAVE_BLOCK_SIZE), 0u);
+  EXPECT_EQ(offer("edited", edited, 2 * HAVE_BLOCK_SIZE), HAVE_BLOCK_SIZE);
+  EXPECT_FALSE(manager_->finalizeStream("edited", edited.size()));
+  ASSERT_TRUE(manager_->writeChunkAt("edited", HAVE_BLOCK_SIZE,
+                                     edited.data() + HAVE_BLOCK_SIZE,
+                                     HAVE_BLOCK_SIZE));
+  ASSERT_TRUE(manager_->finalizeStream("edited", edited.size()));
+  EXPECT_EQ(manager_->readChunk("edited", 0, edited.size()), edited);
+}
+
+TEST_F(StoredBlockTest, DigestWithoutTheBytesIsRefused) {
+  auto data = pattern(HAVE_BLOCK_SIZE, 3);
+  upload("original", data);
+  manager_->indexReadyBlocks();
+  ASSERT_TRUE(manager_->createStream("probe"));
+
+  sha256::Digest digest = sha256::digest(data.data(), data.size());
+  // Knowing the digest is not enough to prove the block
+  sha256::Digest guess = sha256::digest(digest.data(), digest.size());
+  EXPECT_EQ(manager_->writeStoredBlock("probe", 0, data.size(), digest, guess),
+            0u);
+  // Nor is a proof keyed by another upload's nonce
+  ASSERT_TRUE(manager_->createStream("other"));
+  EXPECT_EQ(manager_->writeStoredBlock("probe", 0, data.size(), digest,
+                                       proofFor("other", data, 0,
+                                                data.size())),
+            0u);
+  EXPECT_EQ(manager_->getStream("probe")->totalSize, 0u);
+
+  EXPECT_EQ(offer("probe", data, 0), data.size());
+}
+
+TEST_F(StoredBlockTest, UnindexedContentIsNotFound) {
+  auto data = pattern(HAVE_BLOCK_SIZE, 4);
+  // Streams smaller than a block are not indexed
+  auto small = pattern(HAVE_BLOCK_SIZE / 2, 5);
+  upload("small", small);
+  manager_->indexReadyBlocks();
+  EXPECT_EQ(manager_->getCacheStats().indexedBlocks, 0u);
+
+  ASSERT_TRUE(manager_->createStream("upload"));
+  EXPECT_EQ(offer("upload", data, 0), 0u);
+  small.resize(HAVE_BLOCK_SIZE / 2);
+  EXPECT_EQ(offer("upload", small, 0), 0u);
+}
+
+TEST_F(StoredBlockTest, DeletedStreamsLeaveTheIndex) {
+  auto data = pattern(HAVE_BLOCK_SIZE, 6);
+  upload("original", data);
+  manager_->indexReadyBlocks();
+  ASSERT_TRUE(manager_->deleteStream("original"));
+  manager_->indexReadyBlocks();
+  EXPECT_EQ(manager_->getCacheStats().indexedBlocks, 0u);
+
+  ASSERT_TRUE(manager_->createStream("upload"));
+  EXPECT_EQ(offer("upload", data, 0), 0u);
+}
+
+TEST_F(StoredBlockTest, OnlyUploadsAreWritten) {
+  auto data = pattern(HAVE_BLOCK_SIZE, 7);
+  upload("original", data);
+  upload("ready", pattern(HAVE_BLOCK_SIZE, 8));
+  manager_->indexReadyBlocks();
+
+  EXPECT_EQ(offer("ready", data, 0), 0u);
+  sha256::Digest digest = sha256::digest(data.data(), data.size());
+  EXPECT_EQ(manager_->writeStoredBlock("missing", 0, data.size(), digest,
+                                       digest),
+            0u);
+}
+
+} // namespace
+} // namespace audio_stream
@@ -0,0 +1,63 @@
+#ifndef AUDIO_STREAM_TEST_SUPPORT_H
+#define AUDIO_STREAM_TEST_SUPPORT_H
+
+#include <cstdint>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace audio_stream {
+namespace test {
+
+/**
+ * Pseudo-random bytes (xorshift), the same for the same seed. No two
+ * blocks of a pattern are alike, so block-level deduplication and
+ * checksums see distinct content throughout.
+ */
+inline std::vector<uint8_t> pattern(size_t size, uint32_t seed = 0) {
+  std::vector<uint8_t> data(size);
+  uint32_t state = seed * 2654435761u + 1;
+  for (auto &byte : data) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    byte = static_cast<uint8_t>(state);
+  }
+  return data;
+}
+
+/**
+ * An empty directory for the running test, removed with it. Named after
+ * the test suite and test, so tests that ctest runs in parallel never
+ * share one.
+ */
+class TempDirectory {
+public:
+  TempDirectory() {
+    const auto *info = ::testing::UnitTest::GetInstance()->current_test_info();
+    path_ = (std::filesystem::temp_directory_path() /
+             (std::string(info->test_suite_name()) + "_" + info->name()))
+                .string();
+    std::filesystem::remove_all(path_);
+    std::filesystem::create_directories(path_);
+  }
+
+  ~TempDirectory() {
+    std::error_code ignored;
+    std::filesystem::remove_all(path_, ignored);
+  }
+
+  TempDirectory(const TempDirectory &) = delete;
+  TempDirectory &operator=(const TempDirectory &) = delete;
+
+  const std::string &path() const { return path_; }
+
+private:
+  std::string path_;
+};
+
+} // namespace test
+} // namespace audio_stream
+
+#endif // AUDIO_STREAM_TEST_SUPPORT_H